@@ -457,6 +457,31 @@ infinoted_config_reload(InfinotedRun* run,
   startup->options->daemonize = run->startup->options->daemonize;
 #endif
 
+  /* All connections of the running server are registered with the current
+   * I/O object, so it cannot be exchanged on the fly. */
+  if(startup->options->io_backend != run->startup->options->io_backend)
+  {
+    infinoted_log_warning(
+      startup->log,
+      _("Changing the I/O backend requires a server restart. The server "
+        "keeps using the previous I/O backend until then.")
+    );
+
+    startup->options->io_backend = run->startup->options->io_backend;
+  }
+
+  /* Same for the worker threads, which are owned by the directory */
+  if(startup->options->worker_threads != run->startup->options->worker_threads)
+  {
+    infinoted_log_warning(
+      startup->log,
+      _("Changing the number of worker threads requires a server restart. "
+        "The server keeps using the previous number of threads until then.")
+    );
+
+    startup->options->worker_threads = run->startup->options->worker_threads;
+  }
+
   if(run->xmpp4 != NULL)
   {
     g_object_set(
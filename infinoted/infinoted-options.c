@@ -37,6 +37,49 @@
 
 static const gchar INFINOTED_OPTIONS_GROUP[] = "infinoted";
 
+static gboolean
+infinoted_options_convert_io_backend(gpointer out,
+                                     gpointer in,
+                                     GError** error)
+{
+  gchar** in_str;
+  InfinotedOptionsIoBackend* out_val;
+
+  in_str = (gchar**)in;
+  out_val = (InfinotedOptionsIoBackend*)out;
+
+  if(strcmp(*in_str, "poll") == 0)
+  {
+    *out_val = INFINOTED_OPTIONS_IO_BACKEND_POLL;
+  }
+#ifdef LIBINFINITY_HAVE_EPOLL
+  else if(strcmp(*in_str, "epoll") == 0)
+  {
+    *out_val = INFINOTED_OPTIONS_IO_BACKEND_EPOLL;
+  }
+#endif
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_options_error_quark(),
+      INFINOTED_OPTIONS_ERROR_INVALID_IO_BACKEND,
+#ifdef LIBINFINITY_HAVE_EPOLL
+      _("\"%s\" is not a valid I/O backend. Allowed values are "
+        "\"poll\" or \"epoll\""),
+#else
+      _("\"%s\" is not a valid I/O backend. The only supported value on "
+        "this platform is \"poll\""),
+#endif
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
   {
     "log-file",
@@ -128,6 +171,31 @@ const InfinotedParameterInfo INFINOTED_OPTIONS[] = {
        "documents on the server, and where they are read from after a "
        "server restart. [Default=~/.infinote]"),
     N_("DIRECTORY")
+  }, {
+    "io-backend",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedOptions, io_backend),
+    infinoted_options_convert_io_backend,
+    0,
+    N_("The mechanism used to wait for network events. \"poll\" works on "
+       "all platforms. \"epoll\" is only available on Linux, and scales "
+       "better to a large number of simultaneous connections. Changing "
+       "this option requires a server restart. [Default=poll]"),
+    N_("poll|epoll")
+  }, {
+    "worker-threads",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedOptions, worker_threads),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("The number of threads that run sessions. With 0, all sessions are "
+       "run in the thread that handles the network traffic. Using more "
+       "threads allows several documents to be edited concurrently on "
+       "machines with multiple processors. Changing this option requires a "
+       "server restart. [Default=0]"),
+    N_("NUM")
   }, {
     "plugins",
     INFINOTED_PARAMETER_STRING_LIST,
@@ -975,6 +1043,8 @@ infinoted_options_new(const gchar* const* config_files,
   options->security_policy = INF_XMPP_CONNECTION_SECURITY_ONLY_TLS;
   options->root_directory =
     g_build_filename(g_get_home_dir(), ".infinote", NULL);
+  options->io_backend = INFINOTED_OPTIONS_IO_BACKEND_POLL;
+  options->worker_threads = 0;
   options->plugins = g_malloc(2 * sizeof(gchar*));
   options->plugins[0] = g_strdup("note-text");
   options->plugins[1] = NULL;
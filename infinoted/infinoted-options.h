@@ -27,6 +27,11 @@
 
 G_BEGIN_DECLS
 
+typedef enum _InfinotedOptionsIoBackend {
+  INFINOTED_OPTIONS_IO_BACKEND_POLL,
+  INFINOTED_OPTIONS_IO_BACKEND_EPOLL
+} InfinotedOptionsIoBackend;
+
 typedef struct _InfinotedOptions InfinotedOptions;
 struct _InfinotedOptions {
   GKeyFile* config_key_file;
@@ -42,6 +47,8 @@ struct _InfinotedOptions {
   InfIpAddress *listen_address;
   InfXmppConnectionSecurityPolicy security_policy;
   gchar* root_directory;
+  InfinotedOptionsIoBackend io_backend;
+  guint worker_threads;
 
   gchar** plugins;
 
@@ -66,7 +73,8 @@ typedef enum _InfinotedOptionsError {
   INFINOTED_OPTIONS_ERROR_INVALID_CREATE_OPTIONS,
   INFINOTED_OPTIONS_ERROR_EMPTY_KEY_FILE,
   INFINOTED_OPTIONS_ERROR_EMPTY_CERTIFICATE_FILE,
-  INFINOTED_OPTIONS_ERROR_INVALID_AUTHENTICATION_SETTINGS
+  INFINOTED_OPTIONS_ERROR_INVALID_AUTHENTICATION_SETTINGS,
+  INFINOTED_OPTIONS_ERROR_INVALID_IO_BACKEND
 } InfinotedOptionsError;
 
 InfinotedOptions*
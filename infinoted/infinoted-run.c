@@ -25,6 +25,7 @@
 #include <libinfinity/server/infd-filesystem-account-storage.h>
 #include <libinfinity/server/infd-tcp-server.h>
 #include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-epoll-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 #include <libinfinity/common/inf-xmpp-manager.h>
 
@@ -38,6 +39,62 @@
 static const guint8 INFINOTED_RUN_IPV6_ANY_ADDR[16] =
   { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
+static InfIo*
+infinoted_run_io_new(InfinotedOptionsIoBackend backend)
+{
+  switch(backend)
+  {
+  case INFINOTED_OPTIONS_IO_BACKEND_POLL:
+    return INF_IO(inf_standalone_io_new());
+#ifdef LIBINFINITY_HAVE_EPOLL
+  case INFINOTED_OPTIONS_IO_BACKEND_EPOLL:
+    return INF_IO(inf_epoll_io_new());
+#endif
+  default:
+    g_assert_not_reached();
+    return NULL;
+  }
+}
+
+static void
+infinoted_run_io_loop(InfIo* io)
+{
+#ifdef LIBINFINITY_HAVE_EPOLL
+  if(INF_IS_EPOLL_IO(io))
+  {
+    inf_epoll_io_loop(INF_EPOLL_IO(io));
+    return;
+  }
+#endif
+
+  inf_standalone_io_loop(INF_STANDALONE_IO(io));
+}
+
+static void
+infinoted_run_io_loop_quit(InfIo* io)
+{
+#ifdef LIBINFINITY_HAVE_EPOLL
+  if(INF_IS_EPOLL_IO(io))
+  {
+    inf_epoll_io_loop_quit(INF_EPOLL_IO(io));
+    return;
+  }
+#endif
+
+  inf_standalone_io_loop_quit(INF_STANDALONE_IO(io));
+}
+
+static gboolean
+infinoted_run_io_loop_running(InfIo* io)
+{
+#ifdef LIBINFINITY_HAVE_EPOLL
+  if(INF_IS_EPOLL_IO(io))
+    return inf_epoll_io_loop_running(INF_EPOLL_IO(io));
+#endif
+
+  return inf_standalone_io_loop_running(INF_STANDALONE_IO(io));
+}
+
 static gboolean
 infinoted_run_load_directory(InfinotedRun* run,
                              InfinotedStartup* startup,
@@ -57,12 +114,17 @@ infinoted_run_load_directory(InfinotedRun* run,
 
   communication_manager = inf_communication_manager_new();
 
-  run->io = inf_standalone_io_new();
+  run->io = infinoted_run_io_new(startup->options->io_backend);
 
-  run->directory = infd_directory_new(
-    INF_IO(run->io),
-    INFD_STORAGE(storage),
-    communication_manager
+  run->directory = INFD_DIRECTORY(
+    g_object_new(
+      INFD_TYPE_DIRECTORY,
+      "io", run->io,
+      "storage", storage,
+      "communication-manager", communication_manager,
+      "worker-threads", startup->options->worker_threads,
+      NULL
+    )
   );
 
   infd_directory_enable_chat(run->directory, TRUE);
@@ -318,8 +380,8 @@ infinoted_run_free(InfinotedRun* run)
 {
   InfdXmlServerStatus status;
 
-  if(inf_standalone_io_loop_running(run->io))
-    inf_standalone_io_loop_quit(run->io);
+  if(infinoted_run_io_loop_running(run->io))
+    infinoted_run_io_loop_quit(run->io);
 
   if(run->xmpp6 != NULL)
   {
@@ -345,8 +407,11 @@ infinoted_run_free(InfinotedRun* run)
 
   if(run->plugin_manager != NULL)
   {
+    /* Plugins clean up the sessions they are attached to */
+    infd_directory_lock(run->directory);
     g_object_unref(run->plugin_manager);
     run->plugin_manager = NULL;
+    infd_directory_unlock(run->directory);
   }
 
   g_object_unref(run->io);
@@ -479,7 +544,7 @@ infinoted_run_start(InfinotedRun* run)
 
   if(run->xmpp4 != NULL || run->xmpp6 != NULL)
   {
-    inf_standalone_io_loop(run->io);
+    infinoted_run_io_loop(run->io);
 
     infinoted_log_info(
       run->startup->log,
@@ -497,7 +562,7 @@ infinoted_run_start(InfinotedRun* run)
 void
 infinoted_run_stop(InfinotedRun* run)
 {
-  inf_standalone_io_loop_quit(run->io);
+  infinoted_run_io_loop_quit(run->io);
 }
 
 /* vim:set et sw=2 ts=2: */
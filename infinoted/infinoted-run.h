@@ -27,7 +27,7 @@
 
 #include <libinfinity/server/infd-server-pool.h>
 #include <libinfinity/server/infd-directory.h>
-#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-io.h>
 #include <libinfinity/common/inf-discovery-avahi.h>
 
 #include <glib.h>
@@ -38,7 +38,7 @@ typedef struct _InfinotedRun InfinotedRun;
 struct _InfinotedRun {
   InfinotedStartup* startup;
 
-  InfStandaloneIo* io;
+  InfIo* io;
   InfdDirectory* directory;
   InfdServerPool* pool;
 
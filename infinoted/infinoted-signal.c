@@ -41,6 +41,7 @@ infinoted_signal_sig_func(InfNativeSocket* fd,
   InfinotedSignal* sig;
   int occured;
   GError* error;
+  gboolean result;
 
   sig = (InfinotedSignal*)user_data;
 
@@ -65,12 +66,18 @@ infinoted_signal_sig_func(InfNativeSocket* fd,
     if(occured == SIGINT || occured == SIGTERM || occured == SIGQUIT)
     {
       printf("\n");
-      inf_standalone_io_loop_quit(sig->run->io);
+      infinoted_run_stop(sig->run);
     }
     else if(occured == SIGHUP)
     {
       error = NULL;
-      if(!infinoted_config_reload(sig->run, &error))
+
+      /* Reloading replaces storage and plugins of the running directory */
+      infd_directory_lock(sig->run->directory);
+      result = infinoted_config_reload(sig->run, &error);
+      infd_directory_unlock(sig->run->directory);
+
+      if(!result)
       {
         infinoted_log_error(
           sig->run->startup->log,
@@ -97,7 +104,7 @@ infinoted_signal_terminate(void)
 {
   InfinotedRun* run;
 
-  /* We do a hard exit here, not calling inf_standalone_io_loop_quit(),
+  /* We do a hard exit here, not calling infinoted_run_stop(),
    * because the signal handler could be called from anywhere in the code. */
   if(_infinoted_signal_server != NULL)
   {
@@ -23,15 +23,60 @@
 #include <libinftext/inf-text-session.h>
 #include <libinftext/inf-text-default-buffer.h>
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-filesystem-journal.h>
 
 #include <libinfinity/inf-i18n.h>
 
+#include <string.h>
+
 typedef struct _InfinotedPluginNoteText InfinotedPluginNoteText;
 struct _InfinotedPluginNoteText {
   InfinotedPluginManager* manager;
+  InfTextFilesystemFormatType format;
+  gboolean journal;
+  guint journal_sync_interval;
+  guint journal_compact_size;
+
+  InfdNotePlugin note_plugin;
   const InfdNotePlugin* plugin;
 };
 
+/* A document that is being read in the background for
+ * infinoted_plugin_note_text_session_read_async() */
+typedef struct _InfinotedPluginNoteTextRead InfinotedPluginNoteTextRead;
+struct _InfinotedPluginNoteTextRead {
+  InfIo* io;
+  InfCommunicationManager* manager;
+  InfdNotePluginSessionReadFunc func;
+  gpointer user_data;
+};
+
+/* The journal recording the changes of a session is attached to the
+ * session object with this key. */
+#define INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY \
+  "infinoted-plugin-note-text-journal"
+
+static void
+infinoted_plugin_note_text_attach_journal(InfinotedPluginNoteText* plugin,
+                                          InfSession* session,
+                                          InfTextFilesystemJournal* journal)
+{
+  g_object_set(
+    G_OBJECT(journal),
+    "sync-interval", plugin->journal_sync_interval,
+    "compact-size", plugin->journal_compact_size * 1024,
+    "snapshot-type", plugin->format,
+    NULL
+  );
+
+  g_object_set_data_full(
+    G_OBJECT(session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY,
+    journal,
+    g_object_unref
+  );
+}
+
 /* Note plugin implementation */
 static InfSession*
 infinoted_plugin_note_text_session_new(InfIo* io,
@@ -69,23 +114,46 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
                                         gpointer user_data,
                                         GError** error)
 {
+  InfinotedPluginNoteText* plugin;
   InfUserTable* user_table;
   InfTextBuffer* buffer;
+  InfTextFilesystemJournal* journal;
   gboolean result;
   InfTextSession* session;
 
   g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
 
+  plugin = (InfinotedPluginNoteText*)user_data;
   user_table = inf_user_table_new();
   buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  journal = NULL;
 
-  result = inf_text_filesystem_format_read(
-    INFD_FILESYSTEM_STORAGE(storage),
-    path,
-    user_table,
-    buffer,
-    error
-  );
+  if(plugin->journal)
+  {
+    journal = inf_text_filesystem_journal_open(
+      io,
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      user_table,
+      buffer,
+      error
+    );
+
+    result = (journal != NULL);
+  }
+  else
+  {
+    /* Apply the journal in case the document was stored with journal
+     * before. */
+    result = inf_text_filesystem_journal_recover(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      user_table,
+      buffer,
+      NULL,
+      error
+    );
+  }
 
   if(result == FALSE)
   {
@@ -104,6 +172,15 @@ infinoted_plugin_note_text_session_read(InfdStorage* storage,
     NULL
   );
 
+  if(journal != NULL)
+  {
+    infinoted_plugin_note_text_attach_journal(
+      plugin,
+      INF_SESSION(session),
+      journal
+    );
+  }
+
   g_object_unref(user_table);
   g_object_unref(buffer);
 
@@ -117,22 +194,167 @@ infinoted_plugin_note_text_session_write(InfdStorage* storage,
                                          gpointer user_data,
                                          GError** error)
 {
-  return inf_text_filesystem_format_write(
+  InfinotedPluginNoteText* plugin;
+  InfTextFilesystemJournal* journal;
+  GError* local_error;
+
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  if(!plugin->journal)
+  {
+    return inf_text_filesystem_format_write_with_type(
+      INFD_FILESYSTEM_STORAGE(storage),
+      path,
+      inf_session_get_user_table(session),
+      INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+      plugin->format,
+      error
+    );
+  }
+
+  /* All changes since the last save are in the journal already, so only
+   * make sure that they are on disk. */
+  journal = g_object_get_data(
+    G_OBJECT(session),
+    INFINOTED_PLUGIN_NOTE_TEXT_JOURNAL_KEY
+  );
+
+  if(journal != NULL &&
+     strcmp(inf_text_filesystem_journal_get_path(journal), path) == 0)
+  {
+    local_error = NULL;
+    if(inf_text_filesystem_journal_sync(journal, &local_error))
+      return TRUE;
+
+    /* Start over with a new snapshot if writing the journal failed */
+    g_error_free(local_error);
+  }
+
+  journal = inf_text_filesystem_journal_create(
+    inf_adopted_session_get_io(INF_ADOPTED_SESSION(session)),
     INFD_FILESYSTEM_STORAGE(storage),
     path,
     inf_session_get_user_table(session),
     INF_TEXT_BUFFER(inf_session_get_buffer(session)),
     error
   );
+
+  if(journal == NULL)
+    return FALSE;
+
+  infinoted_plugin_note_text_attach_journal(plugin, session, journal);
+  return TRUE;
+}
+
+static void
+infinoted_plugin_note_text_session_read_cb(InfUserTable* user_table,
+                                           InfTextBuffer* buffer,
+                                           const GError* error,
+                                           gpointer user_data)
+{
+  InfinotedPluginNoteTextRead* read;
+  InfTextSession* session;
+
+  read = (InfinotedPluginNoteTextRead*)user_data;
+
+  if(error != NULL)
+  {
+    read->func(NULL, error, read->user_data);
+  }
+  else
+  {
+    session = inf_text_session_new_with_user_table(
+      read->manager,
+      buffer,
+      read->io,
+      user_table,
+      INF_SESSION_RUNNING,
+      NULL,
+      NULL
+    );
+
+    read->func(INF_SESSION(session), NULL, read->user_data);
+    g_object_unref(session);
+  }
+
+  g_object_unref(read->io);
+  g_object_unref(read->manager);
+  g_slice_free(InfinotedPluginNoteTextRead, read);
 }
 
-const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
+/* Only used without journal; a journal is opened synchronously. */
+static void
+infinoted_plugin_note_text_session_read_async(
+  InfdStorage* storage,
+  InfIo* io,
+  InfCommunicationManager* manager,
+  const gchar* path,
+  gpointer user_data,
+  InfIo* callback_io,
+  InfdNotePluginSessionReadFunc func,
+  gpointer func_user_data)
+{
+  InfinotedPluginNoteTextRead* read;
+
+  g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  read = g_slice_new(InfinotedPluginNoteTextRead);
+  read->io = io;
+  read->manager = manager;
+  read->func = func;
+  read->user_data = func_user_data;
+
+  g_object_ref(io);
+  g_object_ref(manager);
+
+  /* Apply the journal in case the document was stored with journal
+   * before. */
+  inf_text_filesystem_journal_recover_async(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    callback_io,
+    infinoted_plugin_note_text_session_read_cb,
+    read
+  );
+}
+
+/* Only used without journal */
+static void
+infinoted_plugin_note_text_session_write_async(
+  InfdStorage* storage,
+  InfSession* session,
+  const gchar* path,
+  gpointer user_data,
+  InfIo* callback_io,
+  InfdNotePluginSessionWriteFunc func,
+  gpointer func_user_data)
+{
+  InfinotedPluginNoteText* plugin;
+  plugin = (InfinotedPluginNoteText*)user_data;
+
+  g_assert(INFD_IS_FILESYSTEM_STORAGE(storage));
+
+  inf_text_filesystem_format_write_async(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    plugin->format,
+    callback_io,
+    func,
+    func_user_data
+  );
+}
+
+static const InfdNotePlugin INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN = {
   NULL,
   "InfdFilesystemStorage",
   "InfText",
   infinoted_plugin_note_text_session_new,
   infinoted_plugin_note_text_session_read,
-  infinoted_plugin_note_text_session_write
+  infinoted_plugin_note_text_session_write,
+  NULL,
+  NULL
 };
 
 /* Infinoted plugin glue */
@@ -143,6 +365,10 @@ infinoted_plugin_note_text_info_initialize(gpointer plugin_info)
   plugin = (InfinotedPluginNoteText*)plugin_info;
 
   plugin->manager = NULL;
+  plugin->format = INF_TEXT_FILESYSTEM_FORMAT_XML;
+  plugin->journal = FALSE;
+  plugin->journal_sync_interval = 1000;
+  plugin->journal_compact_size = 1024;
   plugin->plugin = NULL;
 }
 
@@ -158,9 +384,22 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
 
   plugin->manager = manager;
 
+  plugin->note_plugin = INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->note_plugin.user_data = plugin;
+
+  /* Saving a document with journal only syncs the changes made since the
+   * last save, so it is done synchronously, as is opening the journal. */
+  if(!plugin->journal)
+  {
+    plugin->note_plugin.session_read_async =
+      infinoted_plugin_note_text_session_read_async;
+    plugin->note_plugin.session_write_async =
+      infinoted_plugin_note_text_session_write_async;
+  }
+
   result = infd_directory_add_plugin(
     infinoted_plugin_manager_get_directory(manager),
-    &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN
+    &plugin->note_plugin
   );
 
   if(result != TRUE)
@@ -176,7 +415,7 @@ infinoted_plugin_note_text_initialize(InfinotedPluginManager* manager,
     return FALSE;
   }
 
-  plugin->plugin = &INFINOTED_PLUGIN_NOTE_TEXT_PLUGIN;
+  plugin->plugin = &plugin->note_plugin;
   return TRUE;
 }
 
@@ -202,8 +441,99 @@ infinoted_plugin_note_text_deinitialize(gpointer plugin_info)
   }
 }
 
+static gboolean
+infinoted_plugin_note_text_convert_format(gpointer out,
+                                          gpointer in,
+                                          GError** error)
+{
+  gchar** in_str;
+  InfTextFilesystemFormatType* out_val;
+
+  in_str = (gchar**)in;
+  out_val = (InfTextFilesystemFormatType*)out;
+
+  if(strcmp(*in_str, "xml") == 0)
+  {
+    *out_val = INF_TEXT_FILESYSTEM_FORMAT_XML;
+  }
+  else if(strcmp(*in_str, "binary") == 0)
+  {
+    *out_val = INF_TEXT_FILESYSTEM_FORMAT_BINARY;
+  }
+  else if(strcmp(*in_str, "xml-with-binary") == 0)
+  {
+    *out_val = INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY;
+  }
+  else
+  {
+    g_set_error(
+      error,
+      infinoted_parameter_error_quark(),
+      INFINOTED_PARAMETER_ERROR_INVALID_FLAG,
+      _("\"%s\" is not a valid document format. Allowed values are "
+        "\"xml\", \"binary\" or \"xml-with-binary\""),
+      *in_str
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 static const InfinotedParameterInfo INFINOTED_PLUGIN_NOTE_TEXT_OPTIONS[] = {
   {
+    "format",
+    INFINOTED_PARAMETER_STRING,
+    0,
+    offsetof(InfinotedPluginNoteText, format),
+    infinoted_plugin_note_text_convert_format,
+    0,
+    N_("The format in which documents are stored, either \"xml\", "
+       "\"binary\", or \"xml-with-binary\" to store an additional binary "
+       "copy next to the XML file. Documents in the binary format are much "
+       "faster to load, but cannot be edited by hand. Documents are read in "
+       "any format regardless of this setting. With journal enabled, this "
+       "applies to the snapshots written when the journal is compacted. "
+       "[Default: xml]"),
+    N_("FORMAT")
+  }, {
+    "journal",
+    INFINOTED_PARAMETER_BOOLEAN,
+    0,
+    offsetof(InfinotedPluginNoteText, journal),
+    infinoted_parameter_convert_boolean,
+    0,
+    N_("Whether to store documents as a snapshot plus a journal of the "
+       "changes made to them. Changes are appended to the journal as they "
+       "are made, so that saving a document does not need to write the "
+       "whole document again, and a crash only loses the changes made "
+       "within the last sync interval. [Default: false]"),
+    NULL
+  }, {
+    "journal-sync-interval",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteText, journal_sync_interval),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Interval, in milliseconds, in which changes are written to the "
+       "journal on disk, or 0 to write each change to disk immediately. "
+       "[Default: 1000]"),
+    N_("MILLISECONDS")
+  }, {
+    "journal-compact-size",
+    INFINOTED_PARAMETER_INT,
+    0,
+    offsetof(InfinotedPluginNoteText, journal_compact_size),
+    infinoted_parameter_convert_nonnegative,
+    0,
+    N_("Size of the journal of a document, in KiB, after which a new "
+       "snapshot of the document is written in the background and the "
+       "journal is cleared, or 0 to not write snapshots automatically. "
+       "[Default: 1024]"),
+    N_("KIB")
+  }, {
     NULL,
     0,
     0,
@@ -21,6 +21,8 @@
 #include <infinoted/infinoted-parameter.h>
 #include <infinoted/infinoted-util.h>
 
+#include <libinfinity/common/inf-xml-blob.h>
+
 #include <libinfinity/inf-signals.h>
 #include <libinfinity/inf-i18n.h>
 
@@ -105,14 +107,13 @@ infinoted_plugin_traffic_logging_sent_cb(InfXmlConnection* conn,
 {
   InfinotedPluginTrafficLoggingConnectionInfo* info;
   xmlBufferPtr buffer;
-  xmlSaveCtxtPtr ctx;
 
   info = (InfinotedPluginTrafficLoggingConnectionInfo*)user_data;
 
+  /* Sent messages can contain references to shared, pre-serialized group
+   * messages, which xmlSaveTree() would write as empty elements. */
   buffer = xmlBufferCreate();
-  ctx = xmlSaveToBuffer(buffer, "UTF-8", 0);
-  xmlSaveTree(ctx, xml);
-  xmlSaveClose(ctx);
+  inf_xml_blob_dump(buffer, NULL, xml);
 
   infinoted_plugin_traffic_logging_write(
     info,
@@ -77,6 +77,12 @@ struct _InfAdoptedAlgorithmLocalUser {
   gboolean can_redo;
 };
 
+typedef struct _InfAdoptedAlgorithmLcpDiffData InfAdoptedAlgorithmLcpDiffData;
+struct _InfAdoptedAlgorithmLcpDiffData {
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedStateVector* old_vector;
+};
+
 typedef struct _InfAdoptedAlgorithmPrivate InfAdoptedAlgorithmPrivate;
 struct _InfAdoptedAlgorithmPrivate {
   /* request log policy */
@@ -87,6 +93,12 @@ struct _InfAdoptedAlgorithmPrivate {
 
   InfAdoptedRequest* execute_request;
 
+  /* Set while inf_adopted_algorithm_execute_requests() runs. In that case
+   * the can-undo/can-redo state is only recomputed once at the end, unless
+   * it is needed earlier. */
+  gboolean in_batch;
+  gboolean undo_redo_dirty;
+
   InfUserTable* user_table;
   InfBuffer* buffer;
 
@@ -96,6 +108,22 @@ struct _InfAdoptedAlgorithmPrivate {
   InfAdoptedUser** users_end;
 
   GSList* local_users;
+
+  /* Least common predecessor of the current state and the vectors of all
+   * available users, as required by inf_adopted_algorithm_cleanup(). It is
+   * updated incrementally as the vectors advance. lcp_vectors maps each
+   * available user to the copy of its vector that lcp accounts for. For each
+   * nonzero component of lcp, lcp_count holds how many of these vectors,
+   * including current, have the same value in that component. If lcp_valid
+   * is FALSE, all of this is recomputed from scratch on the next cleanup. */
+  gboolean lcp_valid;
+  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector* lcp_count;
+  GHashTable* lcp_vectors;
+  guint64 lcp_sum;
+
+  /* Cleanup cannot remove any requests before lcp_sum reaches this */
+  guint64 cleanup_lcp_sum;
 };
 
 enum {
@@ -129,78 +157,6 @@ static guint algorithm_signals[LAST_SIGNAL];
 G_DEFINE_TYPE_WITH_CODE(InfAdoptedAlgorithm, inf_adopted_algorithm, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfAdoptedAlgorithm))
 
-/* Returns a new state vector v so that both first and second are causally
- * before v and so that there is no other state vector with the same property
- * that is causally before v. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_successor(InfAdoptedAlgorithm* algorithm,
-                                             InfAdoptedStateVector* first,
-                                             InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MAX(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  g_assert(inf_adopted_state_vector_causally_before(first, result));
-  g_assert(inf_adopted_state_vector_causally_before(second, result));
-  return result;
-}
-
-/* Returns a new state vector v so that v is both causally before first and
- * second and so that there is no other state vector with the same property
- * so that v is causally before that vector. */
-/* TODO: Move this to state vector, possibly with a faster O(n)
- * implementation (This is O(n log n), at best) */
-/* TODO: A version modifying first instead of returning a new result,
- * use in inf_adopted_algorithm_cleanup(). */
-static InfAdoptedStateVector*
-inf_adopted_algorithm_least_common_predecessor(InfAdoptedAlgorithm* algorithm,
-                                               InfAdoptedStateVector* first,
-                                               InfAdoptedStateVector* second)
-{
-  InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedUser** user;
-  InfAdoptedStateVector* result;
-  guint id;
-
-  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
-  result = inf_adopted_state_vector_new();
-
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    id = inf_user_get_id(INF_USER(*user));
-    inf_adopted_state_vector_set(
-      result,
-      id,
-      MIN(
-        inf_adopted_state_vector_get(first, id),
-        inf_adopted_state_vector_get(second, id)
-      )
-    );
-  }
-
-  return result;
-}
-
 /* Checks whether the given request can be undone (or redone if it is an
  * undo request). In general, a user can perform an undo when
  * there is a request to undo in the request log. However, if there are too
@@ -339,6 +295,267 @@ inf_adopted_algorithm_local_user_free(InfAdoptedAlgorithm* algorithm,
   g_slice_free(InfAdoptedAlgorithmLocalUser, local);
 }
 
+static void
+inf_adopted_algorithm_vector_sum_foreach_func(guint id,
+                                              guint value,
+                                              gpointer user_data)
+{
+  *(guint64*)user_data += value;
+}
+
+static guint64
+inf_adopted_algorithm_vector_sum(InfAdoptedStateVector* vec)
+{
+  guint64 sum;
+
+  sum = 0;
+  inf_adopted_state_vector_foreach(
+    vec,
+    inf_adopted_algorithm_vector_sum_foreach_func,
+    &sum
+  );
+
+  return sum;
+}
+
+static void
+inf_adopted_algorithm_lcp_count_foreach_func(guint id,
+                                             guint value,
+                                             gpointer user_data)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithmPrivate* priv;
+  GHashTableIter iter;
+  gpointer vector;
+  guint count;
+
+  algorithm = INF_ADOPTED_ALGORITHM(user_data);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  count = 0;
+  if(inf_adopted_state_vector_get(priv->current, id) == value)
+    ++count;
+
+  g_hash_table_iter_init(&iter, priv->lcp_vectors);
+  while(g_hash_table_iter_next(&iter, NULL, &vector))
+    if(inf_adopted_state_vector_get(vector, id) == value)
+      ++count;
+
+  inf_adopted_state_vector_set(priv->lcp_count, id, count);
+}
+
+/* Computes the least common predecessor from scratch */
+static void
+inf_adopted_algorithm_lcp_rebuild(InfAdoptedAlgorithm* algorithm)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
+  InfAdoptedStateVector* vector;
+  InfAdoptedStateVector* temp;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  if(priv->lcp != NULL)
+  {
+    inf_adopted_state_vector_free(priv->lcp);
+    inf_adopted_state_vector_free(priv->lcp_count);
+  }
+
+  g_hash_table_remove_all(priv->lcp_vectors);
+  priv->lcp = inf_adopted_state_vector_copy(priv->current);
+
+  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  {
+    if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
+    {
+      vector = inf_adopted_state_vector_copy(
+        inf_adopted_user_get_vector(*user)
+      );
+
+      g_hash_table_insert(priv->lcp_vectors, *user, vector);
+
+      temp = inf_adopted_state_vector_least_common_predecessor(
+        priv->lcp,
+        vector
+      );
+
+      inf_adopted_state_vector_free(priv->lcp);
+      priv->lcp = temp;
+    }
+  }
+
+  priv->lcp_count = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_foreach(
+    priv->lcp,
+    inf_adopted_algorithm_lcp_count_foreach_func,
+    algorithm
+  );
+
+  priv->lcp_sum = inf_adopted_algorithm_vector_sum(priv->lcp);
+  priv->lcp_valid = TRUE;
+
+  /* Let the next cleanup check all request logs */
+  priv->cleanup_lcp_sum = 0;
+}
+
+/* Recomputes a single component of the least common predecessor, after the
+ * vector reaching it has advanced in that component. */
+static void
+inf_adopted_algorithm_lcp_recompute_component(InfAdoptedAlgorithm* algorithm,
+                                              guint id)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  GHashTableIter iter;
+  gpointer vector;
+  guint old_n;
+  guint min;
+  guint count;
+  guint n;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  old_n = inf_adopted_state_vector_get(priv->lcp, id);
+
+  min = inf_adopted_state_vector_get(priv->current, id);
+  count = 1;
+
+  /* Zero components are not counted, so we can stop as soon as we see one */
+  g_hash_table_iter_init(&iter, priv->lcp_vectors);
+  while(min > 0 && g_hash_table_iter_next(&iter, NULL, &vector))
+  {
+    n = inf_adopted_state_vector_get(vector, id);
+    if(n < min)
+    {
+      min = n;
+      count = 1;
+    }
+    else if(n == min)
+    {
+      ++count;
+    }
+  }
+
+  inf_adopted_state_vector_set(priv->lcp, id, min);
+  inf_adopted_state_vector_set(priv->lcp_count, id, min > 0 ? count : 0);
+  priv->lcp_sum = priv->lcp_sum - old_n + min;
+}
+
+/* Updates the least common predecessor after component id of current or of
+ * one of the vectors in lcp_vectors has changed from old_n to new_n. Only if
+ * that vector was the last one at the minimum does the minimum move, so
+ * usually this does not need to look at the vectors of other users. */
+static void
+inf_adopted_algorithm_lcp_update(InfAdoptedAlgorithm* algorithm,
+                                 guint id,
+                                 guint old_n,
+                                 guint new_n)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  guint lcp_n;
+  guint count;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  if(!priv->lcp_valid) return;
+
+  lcp_n = inf_adopted_state_vector_get(priv->lcp, id);
+
+  /* Vectors only advance, except in special situations such as a user
+   * joining. Start from scratch in that case. */
+  if(new_n < lcp_n)
+  {
+    priv->lcp_valid = FALSE;
+    return;
+  }
+
+  if(old_n != lcp_n || new_n == old_n)
+    return;
+
+  if(lcp_n > 0)
+  {
+    count = inf_adopted_state_vector_get(priv->lcp_count, id);
+    if(count > 1)
+    {
+      inf_adopted_state_vector_set(priv->lcp_count, id, count - 1);
+      return;
+    }
+  }
+
+  inf_adopted_algorithm_lcp_recompute_component(algorithm, id);
+}
+
+static void
+inf_adopted_algorithm_lcp_diff_foreach_func(guint id,
+                                            guint value,
+                                            gpointer user_data)
+{
+  InfAdoptedAlgorithmLcpDiffData* data;
+  guint old_n;
+
+  data = (InfAdoptedAlgorithmLcpDiffData*)user_data;
+  old_n = inf_adopted_state_vector_get(data->old_vector, id);
+
+  if(old_n != value)
+    inf_adopted_algorithm_lcp_update(data->algorithm, id, old_n, value);
+}
+
+static void
+inf_adopted_algorithm_user_notify_vector_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedAlgorithmLcpDiffData data;
+  InfAdoptedStateVector* vector;
+
+  algorithm = INF_ADOPTED_ALGORITHM(user_data);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  if(!priv->lcp_valid) return;
+
+  /* Not contained if the user is unavailable */
+  data.old_vector = g_hash_table_lookup(priv->lcp_vectors, object);
+  if(data.old_vector == NULL) return;
+
+  g_hash_table_steal(priv->lcp_vectors, object);
+
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_user_get_vector(INF_ADOPTED_USER(object))
+  );
+
+  g_hash_table_insert(priv->lcp_vectors, object, vector);
+
+  data.algorithm = algorithm;
+  inf_adopted_state_vector_foreach(
+    vector,
+    inf_adopted_algorithm_lcp_diff_foreach_func,
+    &data
+  );
+
+  inf_adopted_state_vector_free(data.old_vector);
+}
+
+static void
+inf_adopted_algorithm_user_notify_status_cb(GObject* object,
+                                            GParamSpec* pspec,
+                                            gpointer user_data)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithmPrivate* priv;
+  gboolean available;
+  gboolean contained;
+
+  algorithm = INF_ADOPTED_ALGORITHM(user_data);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  available = inf_user_get_status(INF_USER(object)) != INF_USER_UNAVAILABLE;
+  contained = g_hash_table_lookup(priv->lcp_vectors, object) != NULL;
+
+  /* A user that leaves can let the least common predecessor advance, and a
+   * user that (re)joins can hold it back. */
+  if(available != contained)
+    priv->lcp_valid = FALSE;
+}
+
 static void
 inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user)
@@ -364,6 +581,22 @@ inf_adopted_algorithm_add_user(InfAdoptedAlgorithm* algorithm,
     g_realloc(priv->users_begin, sizeof(InfAdoptedUser*) * user_count);
   priv->users_end = priv->users_begin + user_count;
   priv->users_begin[user_count - 1] = user;
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::vector",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_vector_cb),
+    algorithm
+  );
+
+  g_signal_connect(
+    G_OBJECT(user),
+    "notify::status",
+    G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+    algorithm
+  );
+
+  priv->lcp_valid = FALSE;
 }
 
 static void
@@ -640,8 +873,7 @@ inf_adopted_algorithm_transform_request(InfAdoptedAlgorithm* algorithm,
   concurrency_id = INF_ADOPTED_CONCURRENCY_NONE;
   if(inf_adopted_request_need_concurrency_id(request_at, against_at) == TRUE)
   {
-    lcs = inf_adopted_algorithm_least_common_successor(
-      algorithm,
+    lcs = inf_adopted_state_vector_least_common_successor(
       inf_adopted_request_get_vector(request),
       inf_adopted_request_get_vector(against)
     );
@@ -873,6 +1105,14 @@ inf_adopted_algorithm_log_request(InfAdoptedAlgorithm* algorithm,
     inf_adopted_request_log_add_request(log, request);
     /* Update current document state */
     inf_adopted_state_vector_add(priv->current, user_id, 1);
+
+    inf_adopted_algorithm_lcp_update(
+      algorithm,
+      user_id,
+      inf_adopted_state_vector_get(priv->current, user_id) - 1,
+      inf_adopted_state_vector_get(priv->current, user_id)
+    );
+
     /* Update local user times */
     inf_adopted_algorithm_update_local_user_times(algorithm);
 
@@ -1035,6 +1275,8 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
 
   priv->max_total_log_size = 2048;
   priv->execute_request = NULL;
+  priv->in_batch = FALSE;
+  priv->undo_redo_dirty = FALSE;
 
   priv->current = inf_adopted_state_vector_new();
   priv->buffer_modified_time = NULL;
@@ -1047,6 +1289,19 @@ inf_adopted_algorithm_init(InfAdoptedAlgorithm* algorithm)
   priv->users_end = NULL;
 
   priv->local_users = NULL;
+
+  priv->lcp_valid = FALSE;
+  priv->lcp = NULL;
+  priv->lcp_count = NULL;
+  priv->lcp_vectors = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    (GDestroyNotify)inf_adopted_state_vector_free
+  );
+
+  priv->lcp_sum = 0;
+  priv->cleanup_lcp_sum = 0;
 }
 
 static void
@@ -1106,6 +1361,7 @@ inf_adopted_algorithm_dispose(GObject* object)
 {
   InfAdoptedAlgorithm* algorithm;
   InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser** user;
   GList* item;
 
   algorithm = INF_ADOPTED_ALGORITHM(object);
@@ -1114,7 +1370,27 @@ inf_adopted_algorithm_dispose(GObject* object)
   while(priv->local_users != NULL)
     inf_adopted_algorithm_local_user_free(algorithm, priv->local_users->data);
 
+  for(user = priv->users_begin; user != priv->users_end; ++ user)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_vector_cb),
+      algorithm
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(*user),
+      G_CALLBACK(inf_adopted_algorithm_user_notify_status_cb),
+      algorithm
+    );
+  }
+
+  g_hash_table_remove_all(priv->lcp_vectors);
+  priv->lcp_valid = FALSE;
+
   g_free(priv->users_begin);
+  priv->users_begin = NULL;
+  priv->users_end = NULL;
 
   if(priv->buffer != NULL)
   {
@@ -1169,6 +1445,14 @@ inf_adopted_algorithm_finalize(GObject* object)
 
   inf_adopted_state_vector_free(priv->current);
 
+  if(priv->lcp != NULL)
+  {
+    inf_adopted_state_vector_free(priv->lcp);
+    inf_adopted_state_vector_free(priv->lcp_count);
+  }
+
+  g_hash_table_destroy(priv->lcp_vectors);
+
   G_OBJECT_CLASS(inf_adopted_algorithm_parent_class)->finalize(object);
 }
 
@@ -1769,71 +2053,17 @@ inf_adopted_algorithm_translate_request(InfAdoptedAlgorithm* algorithm,
   return result;
 }
 
-/**
- * inf_adopted_algorithm_execute_request:
- * @algorithm: A #InfAdoptedAlgorithm.
- * @request: The request to execute.
- * @apply: Whether to apply the request to the buffer.
- * @error: Location to store error information, if any.
- *
- * This function transforms the given request such that it can be applied to
- * the current document state and then applies it the buffer and adds it to
- * the request log of the algorithm, so that it is used for future
- * transformations of other requests.
- *
- * If @apply is %FALSE then the request is not applied to the buffer. In this
- * case, it is assumed that the buffer is already modified, and that the
- * request is made as a result from the buffer modification. This also means
- * that the request must be applicable to the current document state, without
- * requiring transformation.
- *
- * In addition, the function emits the
- * #InfAdoptedAlgorithm::begin-execute-request and
- * #InfAdoptedAlgorithm::end-execute-request signals, and makes
- * inf_adopted_algorithm_get_execute_request() return @request during that
- * period.
- *
- * This allows other code to hook in before and after request processing. This
- * does not cause any loss of generality because this function is not
- * re-entrant anyway: it cannot work when used concurrently by multiple
- * threads nor in a recursive manner, because only when one request has been
- * added to the log the next request can be translated, since it might need
- * the previous request for the translation path and it needs to be translated
- * to a state where the effect of the previous request is included so that it
- * can consistently applied to the buffer.
- *
- * There are also runtime errors that can occur if @request execution fails.
- * In this case the function returns %FALSE and @error is set. Possible
- * reasons for this include @request being an %INF_ADOPTED_REQUEST_UNDO or
- * %INF_ADOPTED_REQUEST_REDO request without there being an operation to
- * undo or redo, or if the translated operation cannot be applied to the
- * buffer. This usually means that the input @request was invalid. However,
- * this is not considered a programmer error because typically requests are
- * received from untrusted input sources such as network connections.
- * Note that there cannot be any runtime errors if @apply is set to %FALSE.
- * In that case it is safe to call the function with %NULL error.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
-                                      InfAdoptedRequest* request,
-                                      gboolean apply,
-                                      GError** error)
+/* Checks the preconditions for executing request, and returns the user
+ * issuing it, or NULL if a precondition is not met. */
+static InfAdoptedUser*
+inf_adopted_algorithm_check_execute_request(InfAdoptedAlgorithm* algorithm,
+                                            InfAdoptedRequest* request,
+                                            gboolean apply)
 {
   InfAdoptedAlgorithmPrivate* priv;
   InfAdoptedUser* user;
-  InfAdoptedRequestLog* log;
-
-  InfAdoptedRequest* original;
-  InfAdoptedRequest* translated;
-  InfAdoptedRequest* log_request;
 
-  GError* local_error;
-  gchar* request_str;
-
-  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), FALSE);
-  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), FALSE);
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
 
   priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
 
@@ -1842,7 +2072,7 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
       inf_adopted_request_get_vector(request),
       priv->current
     ),
-    FALSE
+    NULL
   );
 
   g_return_val_if_fail(
@@ -1853,7 +2083,7 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
       ) == 0 && 
       inf_adopted_request_get_request_type(request) == INF_ADOPTED_REQUEST_DO
     ),
-    FALSE
+    NULL
   );
 
   user = INF_ADOPTED_USER(
@@ -1863,10 +2093,35 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     )
   );
 
-  g_return_val_if_fail(user != NULL, FALSE);
+  g_return_val_if_fail(user != NULL, NULL);
 
   /* not re-entrant */
-  g_return_val_if_fail(priv->execute_request == NULL, FALSE);
+  g_return_val_if_fail(priv->execute_request == NULL, NULL);
+
+  return user;
+}
+
+/* Executes a single request, assuming the preconditions have been checked
+ * with inf_adopted_algorithm_check_execute_request(). The caller needs to
+ * block the buffer's notify::modified handler. */
+static gboolean
+inf_adopted_algorithm_execute_request_internal(InfAdoptedAlgorithm* algorithm,
+                                               InfAdoptedUser* user,
+                                               InfAdoptedRequest* request,
+                                               gboolean apply,
+                                               GError** error)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedRequestLog* log;
+
+  InfAdoptedRequest* original;
+  InfAdoptedRequest* translated;
+  InfAdoptedRequest* log_request;
+
+  GError* local_error;
+  gchar* request_str;
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
   priv->execute_request = request;
 
   inf_adopted_request_set_execute_time(request, g_get_real_time());
@@ -1879,6 +2134,14 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     request
   );
 
+  /* The undo/redo checks below rely on the cached state of local users */
+  if(priv->undo_redo_dirty &&
+     inf_adopted_request_get_request_type(request) != INF_ADOPTED_REQUEST_DO)
+  {
+    priv->undo_redo_dirty = FALSE;
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
+
   local_error = NULL;
   switch(inf_adopted_request_get_request_type(request))
   {
@@ -1966,12 +2229,6 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     inf_adopted_request_get_request_type(translated) == INF_ADOPTED_REQUEST_DO
   );
 
-  inf_signal_handlers_block_by_func(
-    G_OBJECT(priv->buffer),
-    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
-    algorithm
-  );
-
   if(apply == TRUE)
   {
     log_request = inf_adopted_algorithm_apply_request(
@@ -1984,12 +2241,6 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
 
     if(local_error != NULL)
     {
-      inf_signal_handlers_unblock_by_func(
-        G_OBJECT(priv->buffer),
-        G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
-        algorithm
-      );
-
       g_signal_emit(
         G_OBJECT(algorithm),
         algorithm_signals[END_EXECUTE_REQUEST],
@@ -2019,13 +2270,10 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
     log_request
   );
 
-  inf_signal_handlers_unblock_by_func(
-    G_OBJECT(priv->buffer),
-    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
-    algorithm
-  );
-
-  inf_adopted_algorithm_update_undo_redo(algorithm);
+  if(priv->in_batch)
+    priv->undo_redo_dirty = TRUE;
+  else
+    inf_adopted_algorithm_update_undo_redo(algorithm);
 
   g_signal_emit(
     G_OBJECT(algorithm),
@@ -2044,6 +2292,218 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
   return TRUE;
 }
 
+
+/**
+ * inf_adopted_algorithm_execute_request:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @request: The request to execute.
+ * @apply: Whether to apply the request to the buffer.
+ * @error: Location to store error information, if any.
+ *
+ * This function transforms the given request such that it can be applied to
+ * the current document state and then applies it the buffer and adds it to
+ * the request log of the algorithm, so that it is used for future
+ * transformations of other requests.
+ *
+ * If @apply is %FALSE then the request is not applied to the buffer. In this
+ * case, it is assumed that the buffer is already modified, and that the
+ * request is made as a result from the buffer modification. This also means
+ * that the request must be applicable to the current document state, without
+ * requiring transformation.
+ *
+ * In addition, the function emits the
+ * #InfAdoptedAlgorithm::begin-execute-request and
+ * #InfAdoptedAlgorithm::end-execute-request signals, and makes
+ * inf_adopted_algorithm_get_execute_request() return @request during that
+ * period.
+ *
+ * This allows other code to hook in before and after request processing. This
+ * does not cause any loss of generality because this function is not
+ * re-entrant anyway: it cannot work when used concurrently by multiple
+ * threads nor in a recursive manner, because only when one request has been
+ * added to the log the next request can be translated, since it might need
+ * the previous request for the translation path and it needs to be translated
+ * to a state where the effect of the previous request is included so that it
+ * can consistently applied to the buffer.
+ *
+ * There are also runtime errors that can occur if @request execution fails.
+ * In this case the function returns %FALSE and @error is set. Possible
+ * reasons for this include @request being an %INF_ADOPTED_REQUEST_UNDO or
+ * %INF_ADOPTED_REQUEST_REDO request without there being an operation to
+ * undo or redo, or if the translated operation cannot be applied to the
+ * buffer. This usually means that the input @request was invalid. However,
+ * this is not considered a programmer error because typically requests are
+ * received from untrusted input sources such as network connections.
+ * Note that there cannot be any runtime errors if @apply is set to %FALSE.
+ * In that case it is safe to call the function with %NULL error.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
+                                      InfAdoptedRequest* request,
+                                      gboolean apply,
+                                      GError** error)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser* user;
+  gboolean result;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), FALSE);
+  g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), FALSE);
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  user = inf_adopted_algorithm_check_execute_request(algorithm, request, apply);
+  if(user == NULL) return FALSE;
+
+  inf_signal_handlers_block_by_func(
+    G_OBJECT(priv->buffer),
+    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
+    algorithm
+  );
+
+  result = inf_adopted_algorithm_execute_request_internal(
+    algorithm,
+    user,
+    request,
+    apply,
+    error
+  );
+
+  inf_signal_handlers_unblock_by_func(
+    G_OBJECT(priv->buffer),
+    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
+    algorithm
+  );
+
+  return result;
+}
+
+/**
+ * inf_adopted_algorithm_execute_requests:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ * @requests: (array length=n_requests): The requests to execute.
+ * @n_requests: The number of requests in @requests.
+ * @apply: Whether to apply the requests to the buffer.
+ * @n_executed: (out) (allow-none): Location to store the number of
+ * successfully executed requests, or %NULL.
+ * @error: Location to store error information, if any.
+ *
+ * Executes all requests in @requests in order, as if
+ * inf_adopted_algorithm_execute_request() was called for each of them. The
+ * requests must be causally ordered, i.e. each request must be executable
+ * after all previous requests in the array have been executed.
+ *
+ * This is more efficient than calling inf_adopted_algorithm_execute_request()
+ * repeatedly when a large number of requests arrive at once, for example when
+ * a connection delivers a burst of buffered requests. Intermediate
+ * translations are shared via the request log caches, the can-undo and
+ * can-redo state of local users is recomputed only once, and property
+ * notifications of the buffer are held back until all requests have been
+ * executed, so that the #InfBuffer:modified property is notified at most
+ * once. The #InfAdoptedAlgorithm::begin-execute-request and
+ * #InfAdoptedAlgorithm::end-execute-request signals are still emitted for
+ * every request.
+ *
+ * If a request fails to execute, then execution stops at that request,
+ * @error is set and the function returns %FALSE. The requests before the
+ * failing one remain executed. @n_executed can be used to find out how
+ * many requests were executed successfully. This includes requests which
+ * do not meet the preconditions of inf_adopted_algorithm_execute_request(),
+ * such as a request which is not causally before the current state. For
+ * these, a critical warning is emitted as by
+ * inf_adopted_algorithm_execute_request(), and in addition @error is set
+ * to %INF_ADOPTED_ALGORITHM_ERROR_FAILED.
+ *
+ * Returns: %TRUE if all requests were executed, or %FALSE on error.
+ */
+gboolean
+inf_adopted_algorithm_execute_requests(InfAdoptedAlgorithm* algorithm,
+                                       InfAdoptedRequest** requests,
+                                       guint n_requests,
+                                       gboolean apply,
+                                       guint* n_executed,
+                                       GError** error)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedUser* user;
+  gboolean result;
+  guint i;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), FALSE);
+  g_return_val_if_fail(requests != NULL || n_requests == 0, FALSE);
+
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+  g_return_val_if_fail(priv->in_batch == FALSE, FALSE);
+
+  priv->in_batch = TRUE;
+  result = TRUE;
+
+  inf_signal_handlers_block_by_func(
+    G_OBJECT(priv->buffer),
+    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
+    algorithm
+  );
+
+  g_object_freeze_notify(G_OBJECT(priv->buffer));
+
+  for(i = 0; i < n_requests; ++i)
+  {
+    user = inf_adopted_algorithm_check_execute_request(
+      algorithm,
+      requests[i],
+      apply
+    );
+
+    if(user == NULL)
+    {
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_ADOPTED_ALGORITHM_ERROR"),
+        INF_ADOPTED_ALGORITHM_ERROR_FAILED,
+        "%s",
+        _("The request cannot be executed in the current state")
+      );
+
+      result = FALSE;
+      break;
+    }
+
+    result = inf_adopted_algorithm_execute_request_internal(
+      algorithm,
+      user,
+      requests[i],
+      apply,
+      error
+    );
+
+    if(result == FALSE)
+      break;
+  }
+
+  /* Thaw before unblocking, so that our own notify::modified handler does
+   * not see the changes we made to the modified flag ourselves. */
+  g_object_thaw_notify(G_OBJECT(priv->buffer));
+
+  inf_signal_handlers_unblock_by_func(
+    G_OBJECT(priv->buffer),
+    G_CALLBACK(inf_adopted_algorithm_buffer_notify_modified_cb),
+    algorithm
+  );
+
+  priv->in_batch = FALSE;
+  if(priv->undo_redo_dirty)
+  {
+    priv->undo_redo_dirty = FALSE;
+    inf_adopted_algorithm_update_undo_redo(algorithm);
+  }
+
+  if(n_executed != NULL)
+    *n_executed = i;
+
+  return result;
+}
+
 /**
  * inf_adopted_algorithm_cleanup:
  * @algorithm: A #InfAdoptedAlgorithm.
@@ -2061,7 +2521,6 @@ void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
 {
   InfAdoptedAlgorithmPrivate* priv;
-  InfAdoptedStateVector* temp;
   InfAdoptedStateVector* lcp;
   InfAdoptedUser** user;
   InfAdoptedRequestLog* log;
@@ -2069,6 +2528,8 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
   InfAdoptedStateVector* req_vec;
   InfAdoptedStateVector* low_vec;
   gboolean req_before_lcp;
+  guint64 cleanup_lcp_sum;
+  guint64 low_sum;
   guint n;
   guint id;
   guint vdiff;
@@ -2102,21 +2563,26 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
    * are additional conditions. However, in the current case, some requests
    * are just kept a bit longer than necessary, in favor of simplicity. */
 
-  lcp = inf_adopted_state_vector_copy(priv->current);
-  for(user = priv->users_begin; user != priv->users_end; ++ user)
-  {
-    if(inf_user_get_status(INF_USER(*user)) != INF_USER_UNAVAILABLE)
-    {
-      temp = inf_adopted_algorithm_least_common_predecessor(
-        algorithm,
-        lcp,
-        inf_adopted_user_get_vector(*user)
-      );
+  /* The lcp is maintained incrementally as the state vectors of the users
+   * advance, see inf_adopted_algorithm_lcp_update(). */
+  if(!priv->lcp_valid)
+    inf_adopted_algorithm_lcp_rebuild(algorithm);
+
+  /* A set of related requests is only removed if the vdiff of its lower
+   * related request to the lcp reaches max-total-log-size. The vdiff is the
+   * difference of the sums of their components, so as long as the sum of
+   * the lcp components stays below the smallest such threshold of the
+   * oldest request set in all logs, there is nothing to do. This check
+   * makes calling this function after every request cheap. */
+  if(priv->lcp_sum < priv->cleanup_lcp_sum)
+    return;
 
-      inf_adopted_state_vector_free(lcp);
-      lcp = temp;
-    }
-  }
+  lcp = priv->lcp;
+
+  /* Requests that are added to the logs later on have a vector that is
+   * not causally before the current lcp, so their threshold is at least
+   * this. */
+  cleanup_lcp_sum = priv->lcp_sum + priv->max_total_log_size;
 
   for(user = priv->users_begin; user != priv->users_end; ++ user)
   {
@@ -2170,9 +2636,138 @@ inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm)
     }
 
     inf_adopted_request_log_remove_requests(log, n);
+
+    if(n < inf_adopted_request_log_get_end(log))
+    {
+      low_sum = inf_adopted_algorithm_vector_sum(
+        inf_adopted_request_get_vector(
+          inf_adopted_request_log_get_request(log, n)
+        )
+      );
+
+      cleanup_lcp_sum =
+        MIN(cleanup_lcp_sum, low_sum + priv->max_total_log_size);
+    }
   }
 
-  inf_adopted_state_vector_free(lcp);
+  priv->cleanup_lcp_sum = cleanup_lcp_sum;
+}
+
+/**
+ * inf_adopted_algorithm_get_snapshot_begin:
+ * @algorithm: A #InfAdoptedAlgorithm.
+ *
+ * Returns, for each user, the index of the first request in that user's
+ * request log that a site joining the session in the current state needs to
+ * know about. This is used to synchronize a session without its full request
+ * history, see #InfAdoptedSession:snapshot-sync.
+ *
+ * All requests that are not causally before the least common predecessor of
+ * all available users are included, since another user might still issue a
+ * request that is concurrent to them. So are all requests that their user
+ * can still undo or redo, as limited by the
+ * #InfAdoptedAlgorithm:max-total-log-size property, and all requests that
+ * are required to transform these to the current state. Requests are never
+ * split from their related requests, see
+ * inf_adopted_request_log_upper_related(). Therefore, a site that only knows
+ * the requests from the returned indices on can process every request that
+ * any user can still issue. If #InfAdoptedAlgorithm:max-total-log-size is
+ * unlimited, this means the full request logs.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector holding the index of
+ * the first request for each user. Free with inf_adopted_state_vector_free()
+ * when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_algorithm_get_snapshot_begin(InfAdoptedAlgorithm* algorithm)
+{
+  InfAdoptedAlgorithmPrivate* priv;
+  InfAdoptedStateVector* boundary;
+  InfAdoptedStateVector* begin;
+  InfAdoptedStateVector* temp;
+  InfAdoptedUser** user;
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* req;
+  InfAdoptedStateVector* req_vec;
+  InfAdoptedStateVector* user_vec;
+  gboolean changed;
+  guint n;
+  guint id;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_ALGORITHM(algorithm), NULL);
+  priv = INF_ADOPTED_ALGORITHM_PRIVATE(algorithm);
+
+  if(!priv->lcp_valid)
+    inf_adopted_algorithm_lcp_rebuild(algorithm);
+
+  boundary = inf_adopted_state_vector_copy(priv->lcp);
+  begin = inf_adopted_state_vector_new();
+
+  /* Requests that are kept might need to be transformed from their own
+   * state, so the boundary is lowered to the state of the first kept request
+   * of every log, until it does not change anymore. The boundary only ever
+   * moves backwards, so this terminates. */
+  do
+  {
+    changed = FALSE;
+
+    for(user = priv->users_begin; user != priv->users_end; ++ user)
+    {
+      id = inf_user_get_id(INF_USER(*user));
+      log = inf_adopted_user_get_request_log(*user);
+      user_vec = inf_adopted_user_get_vector(*user);
+      n = inf_adopted_request_log_get_begin(log);
+
+      /* Skip all sets of related requests that are causally before the
+       * boundary, as in inf_adopted_algorithm_cleanup(), unless the user
+       * can still undo or redo one of them. This is the check made by
+       * inf_adopted_algorithm_can_undo_redo(), for the newest request of
+       * the set, which is the closest one to the user's state. Later sets
+       * are even closer, so they can be reached as well. */
+      while(n < inf_adopted_request_log_get_end(log))
+      {
+        req = inf_adopted_request_log_upper_related(log, n);
+        req_vec = inf_adopted_request_get_vector(req);
+
+        if(!inf_adopted_state_vector_causally_before_inc(req_vec, boundary, id))
+          break;
+
+        if(priv->max_total_log_size == G_MAXUINT ||
+           !inf_adopted_state_vector_causally_before(req_vec, user_vec) ||
+           inf_adopted_state_vector_vdiff(req_vec, user_vec) <
+             priv->max_total_log_size)
+        {
+          break;
+        }
+
+        n = inf_adopted_state_vector_get(req_vec, id) + 1;
+      }
+
+      inf_adopted_state_vector_set(begin, id, n);
+
+      if(n < inf_adopted_request_log_get_end(log))
+      {
+        req_vec = inf_adopted_request_get_vector(
+          inf_adopted_request_log_get_request(log, n)
+        );
+
+        if(!inf_adopted_state_vector_causally_before(boundary, req_vec))
+        {
+          temp = inf_adopted_state_vector_least_common_predecessor(
+            boundary,
+            req_vec
+          );
+
+          inf_adopted_state_vector_free(boundary);
+          boundary = temp;
+          changed = TRUE;
+        }
+      }
+    }
+  } while(changed);
+
+  inf_adopted_state_vector_free(boundary);
+  return begin;
 }
 
 /**
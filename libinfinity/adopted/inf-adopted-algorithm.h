@@ -143,9 +143,20 @@ inf_adopted_algorithm_execute_request(InfAdoptedAlgorithm* algorithm,
                                       gboolean apply,
                                       GError** error);
 
+gboolean
+inf_adopted_algorithm_execute_requests(InfAdoptedAlgorithm* algorithm,
+                                       InfAdoptedRequest** requests,
+                                       guint n_requests,
+                                       gboolean apply,
+                                       guint* n_executed,
+                                       GError** error);
+
 void
 inf_adopted_algorithm_cleanup(InfAdoptedAlgorithm* algorithm);
 
+InfAdoptedStateVector*
+inf_adopted_algorithm_get_snapshot_begin(InfAdoptedAlgorithm* algorithm);
+
 gboolean
 inf_adopted_algorithm_can_undo(InfAdoptedAlgorithm* algorithm,
                                InfAdoptedUser* user);
@@ -40,12 +40,17 @@
 
 #include <string.h> /* For (g_)memmove */
 
-typedef struct _InfAdoptedRequestLogCleanupCacheData
-  InfAdoptedRequestLogCleanupCacheData;
-struct _InfAdoptedRequestLogCleanupCacheData {
-  guint user_id;
-  guint up_to;
-  GSList* requests_to_remove;
+/* An entry in the transformation cache. Each entry is in the list of
+ * entries with the same user component, so that cleanup can find the
+ * entries to remove without looking at all others, and in the LRU list for
+ * eviction once the cache is full. */
+typedef struct _InfAdoptedRequestLogCacheEntry InfAdoptedRequestLogCacheEntry;
+struct _InfAdoptedRequestLogCacheEntry {
+  InfAdoptedRequest* request;
+  guint n; /* component of the log's user in the request's vector */
+
+  GList* lru_link;
+  GList* component_link;
 };
 
 typedef struct _InfAdoptedRequestLogEntry InfAdoptedRequestLogEntry;
@@ -64,7 +69,15 @@ typedef struct _InfAdoptedRequestLogPrivate InfAdoptedRequestLogPrivate;
 struct _InfAdoptedRequestLogPrivate {
   guint user_id;
   InfAdoptedRequestLogEntry* entries;
-  GTree* cache;
+
+  /* Transformation cache. cache maps state vectors to cache entries,
+   * cache_components maps the user component of cached requests to a
+   * GQueue of cache entries, and cache_lru contains all entries with the
+   * most recently used first. */
+  GHashTable* cache;
+  GHashTable* cache_components;
+  GQueue cache_lru;
+  guint max_cache_size;
 
   InfAdoptedRequestLogEntry* next_undo;
   InfAdoptedRequestLogEntry* next_redo;
@@ -85,7 +98,9 @@ enum {
   PROP_END,
 
   PROP_NEXT_UNDO,
-  PROP_NEXT_REDO
+  PROP_NEXT_REDO,
+
+  PROP_MAX_CACHE_SIZE
 };
 
 enum {
@@ -159,63 +174,69 @@ inf_adopted_request_log_verify_related(InfAdoptedRequestLog* log)
  * Transformation cache
  */
 
-static int
-inf_adopted_request_log_cache_key_cmp(gconstpointer a,
-                                      gconstpointer b,
-                                      gpointer user_data)
+static gboolean
+inf_adopted_request_log_cache_key_equal(gconstpointer a,
+                                        gconstpointer b)
 {
-  InfAdoptedRequestLog* log;
-  InfAdoptedRequestLogPrivate* priv;
-  const InfAdoptedStateVector* key_a;
-  const InfAdoptedStateVector* key_b;
-  guint n_a, n_b;
+  /* Cached requests refer to interned vectors, so when looking up the
+   * vector of another request this is a pointer comparison. */
+  return inf_adopted_state_vector_compare(a, b) == 0;
+}
 
-  key_a = (const InfAdoptedStateVector*)a;
-  key_b = (const InfAdoptedStateVector*)b;
+static void
+inf_adopted_request_log_cache_entry_free(gpointer data)
+{
+  InfAdoptedRequestLogCacheEntry* entry;
+  entry = (InfAdoptedRequestLogCacheEntry*)data;
+
+  g_object_unref(entry->request);
+  g_slice_free(InfAdoptedRequestLogCacheEntry, entry);
+}
+
+static void
+inf_adopted_request_log_cache_remove_entry(InfAdoptedRequestLog* log,
+                                           InfAdoptedRequestLogCacheEntry* ent)
+{
+  InfAdoptedRequestLogPrivate* priv;
+  GQueue* queue;
 
-  log = (InfAdoptedRequestLog*)user_data;
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  /* Primary, order by component of user ID -- this makes cleanup very
-   * efficient. */
-  n_a = inf_adopted_state_vector_get(key_a, priv->user_id);
-  n_b = inf_adopted_state_vector_get(key_b, priv->user_id);
+  queue = g_hash_table_lookup(
+    priv->cache_components,
+    GUINT_TO_POINTER(ent->n)
+  );
 
-  if(n_a < n_b)
-    return -1;
-  if(n_a > n_b)
-    return 1;
+  g_assert(queue != NULL);
+  g_queue_delete_link(queue, ent->component_link);
+  if(g_queue_is_empty(queue))
+  {
+    g_hash_table_remove(priv->cache_components, GUINT_TO_POINTER(ent->n));
+  }
+
+  g_queue_delete_link(&priv->cache_lru, ent->lru_link);
 
-  /* If user ID component is equal, go by other components. */
-  return inf_adopted_state_vector_compare(key_a, key_b);
+  /* This frees the entry */
+  g_hash_table_remove(
+    priv->cache,
+    inf_adopted_request_get_vector(ent->request)
+  );
 }
 
-static gboolean
-inf_adopted_request_log_remove_requests_cache_foreach_func(gpointer key,
-                                                           gpointer value,
-                                                           gpointer user_data)
+static void
+inf_adopted_request_log_cache_clear(InfAdoptedRequestLog* log)
 {
-  InfAdoptedStateVector* vector;
-  InfAdoptedRequestLogCleanupCacheData* data;
-
-  vector = (InfAdoptedStateVector*)key;
-  data = (InfAdoptedRequestLogCleanupCacheData*)user_data;
+  InfAdoptedRequestLogPrivate* priv;
+  priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  /* Remove all requests which are a cached translation of one of the requests
-   * that have been removed, i.e. have a user component smaller than up_to. */
-  if(inf_adopted_state_vector_get(vector, data->user_id) < data->up_to)
-  {
-    data->requests_to_remove =
-      g_slist_prepend(data->requests_to_remove, vector);
-    return FALSE;
-  }
-  else
+  if(priv->cache != NULL)
   {
-    /* Stop traversal. The tree is traversed in sorted order, and the primary
-     * sort criteria of the tree is the vector component of the user. So if
-     * we have reached this point, all other elements in the tree will have
-     * a higher user component and are not scheduled for removal. */
-    return TRUE;
+    g_queue_clear(&priv->cache_lru);
+    g_hash_table_destroy(priv->cache_components);
+    g_hash_table_destroy(priv->cache);
+
+    priv->cache_components = NULL;
+    priv->cache = NULL;
   }
 }
 
@@ -297,6 +318,9 @@ inf_adopted_request_log_init(InfAdoptedRequestLog* log)
   priv->alloc = INF_ADOPTED_REQUEST_LOG_INC;
   priv->entries = g_malloc(priv->alloc * sizeof(InfAdoptedRequestLogEntry));
   priv->cache = NULL;
+  priv->cache_components = NULL;
+  g_queue_init(&priv->cache_lru);
+  priv->max_cache_size = 4096;
   priv->begin = 0;
   priv->end = 0;
   priv->offset = 0;
@@ -315,11 +339,7 @@ inf_adopted_request_log_dispose(GObject* object)
   log = INF_ADOPTED_REQUEST_LOG(object);
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
 
-  if(priv->cache != NULL)
-  {
-    g_tree_destroy(priv->cache);
-    priv->cache = NULL;
-  }
+  inf_adopted_request_log_cache_clear(log);
 
   for(i = priv->offset; i < priv->offset + (priv->end - priv->begin); ++ i)
     g_object_unref(G_OBJECT(priv->entries[i].request));
@@ -368,6 +388,20 @@ inf_adopted_request_log_set_property(GObject* object,
     g_assert(priv->begin == 0); /* construct only */
     priv->begin = g_value_get_uint(value);
     priv->end = priv->begin;
+    break;
+  case PROP_MAX_CACHE_SIZE:
+    priv->max_cache_size = g_value_get_uint(value);
+
+    /* Evict least recently used entries if the cache is now too big */
+    while(priv->cache != NULL &&
+          g_hash_table_size(priv->cache) > priv->max_cache_size)
+    {
+      inf_adopted_request_log_cache_remove_entry(
+        log,
+        (InfAdoptedRequestLogCacheEntry*)g_queue_peek_tail(&priv->cache_lru)
+      );
+    }
+
     break;
   case PROP_END:
   case PROP_NEXT_UNDO:
@@ -415,6 +449,9 @@ inf_adopted_request_log_get_property(GObject* object,
     else
       g_value_set_object(value, NULL);
 
+    break;
+  case PROP_MAX_CACHE_SIZE:
+    g_value_set_uint(value, priv->max_cache_size);
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -706,6 +743,21 @@ inf_adopted_request_log_class_init(
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_CACHE_SIZE,
+    g_param_spec_uint(
+      "max-cache-size",
+      "Maximum cache size",
+      "The maximum number of translated requests to keep in the cache, or "
+      "G_MAXUINT for no limit",
+      0,
+      G_MAXUINT,
+      4096,
+      G_PARAM_READWRITE
+    )
+  );
+
   /**
    * InfAdoptedRequestLog::add-request:
    * @log: The #InfAdoptedRequestLog to which a new request is added.
@@ -943,9 +995,10 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
                                         guint up_to)
 {
   InfAdoptedRequestLogPrivate* priv;
-  InfAdoptedRequestLogCleanupCacheData data;
+  GQueue* queue;
+  guint old_begin;
   guint i;
-  GSList* item;
+  guint n;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
 
@@ -985,25 +1038,36 @@ inf_adopted_request_log_remove_requests(InfAdoptedRequestLog* log,
     }
   }
 
+  old_begin = priv->begin;
   priv->offset += (up_to - priv->begin);
   priv->begin = up_to;
   g_object_notify(G_OBJECT(log), "begin");
 
+  /* Remove all requests which are a cached translation of one of the requests
+   * that have been removed. Their user component is at least the one of the
+   * request they are a translation of, so only the components between the
+   * old and new beginning of the log need to be looked at. */
   if(priv->cache != NULL)
   {
-    data.user_id = priv->user_id;
-    data.up_to = up_to;
-    data.requests_to_remove = NULL;
-
-    g_tree_foreach(
-      priv->cache,
-      inf_adopted_request_log_remove_requests_cache_foreach_func,
-      &data
-    );
-    
-    for(item = data.requests_to_remove; item != NULL; item = item->next)
-      g_tree_remove(priv->cache, (InfAdoptedStateVector*)item->data);
-    g_slist_free(data.requests_to_remove);
+    for(i = old_begin; i < up_to; ++i)
+    {
+      queue = g_hash_table_lookup(
+        priv->cache_components,
+        GUINT_TO_POINTER(i)
+      );
+
+      /* The queue is freed when its last entry is removed */
+      if(queue != NULL)
+      {
+        for(n = queue->length; n > 0; --n)
+        {
+          inf_adopted_request_log_cache_remove_entry(
+            log,
+            g_queue_peek_head(queue)
+          );
+        }
+      }
+    }
   }
 
   inf_adopted_request_log_verify_related(log);
@@ -1324,7 +1388,9 @@ inf_adopted_request_log_lower_related(InfAdoptedRequestLog* log,
  *
  * The data structure of the cache is optimized for quick lookup of entries
  * by the state vector and cleaning up entries in an efficient manner also
- * when the cache has grown very big.
+ * when the cache has grown very big. The number of entries is limited by
+ * the #InfAdoptedRequestLog:max-cache-size property. If the cache is full,
+ * the least recently used entry is removed from it.
  *
  * The request cache is mainly used by #InfAdoptedAlgorithm to efficiently
  * handle big transformations.
@@ -1338,6 +1404,8 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
 {
   InfAdoptedRequestLogPrivate* priv;
   InfAdoptedStateVector* vector;
+  InfAdoptedRequestLogCacheEntry* entry;
+  GQueue* queue;
 
   g_return_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log));
   g_return_if_fail(INF_ADOPTED_IS_REQUEST(request));
@@ -1345,26 +1413,65 @@ inf_adopted_request_log_add_cached_request(InfAdoptedRequestLog* log,
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
   g_return_if_fail(inf_adopted_request_get_user_id(request) == priv->user_id);
 
+  if(priv->max_cache_size == 0)
+    return;
+
   vector = inf_adopted_request_get_vector(request);
 
   if(priv->cache == NULL)
   {
-    priv->cache = g_tree_new_full(
-      inf_adopted_request_log_cache_key_cmp,
-      log,
+    priv->cache = g_hash_table_new_full(
+      (GHashFunc)inf_adopted_state_vector_hash,
+      inf_adopted_request_log_cache_key_equal,
+      NULL,
+      inf_adopted_request_log_cache_entry_free
+    );
+
+    priv->cache_components = g_hash_table_new_full(
+      NULL,
+      NULL,
       NULL,
-      g_object_unref
+      (GDestroyNotify)g_queue_free
     );
   }
 
-  g_return_if_fail(g_tree_lookup(priv->cache, vector) == NULL);
+  g_return_if_fail(g_hash_table_lookup(priv->cache, vector) == NULL);
+
+  if(g_hash_table_size(priv->cache) >= priv->max_cache_size)
+  {
+    inf_adopted_request_log_cache_remove_entry(
+      log,
+      (InfAdoptedRequestLogCacheEntry*)g_queue_peek_tail(&priv->cache_lru)
+    );
+  }
 
-  g_tree_insert(priv->cache, vector, request);
+  entry = g_slice_new(InfAdoptedRequestLogCacheEntry);
+  entry->request = request;
+  entry->n = inf_adopted_state_vector_get(vector, priv->user_id);
   g_object_ref(request);
 
-  /* Implement lookup_cached_request */
-  /* Use this implementation in InfAdoptedAlgorithm */
-  /* Make the performance tests */
+  g_queue_push_head(&priv->cache_lru, entry);
+  entry->lru_link = priv->cache_lru.head;
+
+  queue = g_hash_table_lookup(
+    priv->cache_components,
+    GUINT_TO_POINTER(entry->n)
+  );
+
+  if(queue == NULL)
+  {
+    queue = g_queue_new();
+    g_hash_table_insert(
+      priv->cache_components,
+      GUINT_TO_POINTER(entry->n),
+      queue
+    );
+  }
+
+  g_queue_push_tail(queue, entry);
+  entry->component_link = queue->tail;
+
+  g_hash_table_insert(priv->cache, vector, entry);
 }
 
 /**
@@ -1386,6 +1493,7 @@ inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
                                               InfAdoptedStateVector* vec)
 {
   InfAdoptedRequestLogPrivate* priv;
+  InfAdoptedRequestLogCacheEntry* entry;
 
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST_LOG(log), NULL);
   g_return_val_if_fail(vec != NULL, NULL);
@@ -1393,7 +1501,14 @@ inf_adopted_request_log_lookup_cached_request(InfAdoptedRequestLog* log,
   priv = INF_ADOPTED_REQUEST_LOG_PRIVATE(log);
   if(priv->cache == NULL) return NULL;
 
-  return INF_ADOPTED_REQUEST(g_tree_lookup(priv->cache, vec));
+  entry = g_hash_table_lookup(priv->cache, vec);
+  if(entry == NULL) return NULL;
+
+  /* Move to the front of the LRU list */
+  g_queue_unlink(&priv->cache_lru, entry->lru_link);
+  g_queue_push_head_link(&priv->cache_lru, entry->lru_link);
+
+  return entry->request;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -157,7 +157,7 @@ inf_adopted_request_set_property(GObject* object,
     break;
   case PROP_VECTOR:
     g_assert(priv->vector == NULL); /* construct only */
-    priv->vector = g_value_dup_boxed(value);
+    priv->vector = inf_adopted_state_vector_intern(g_value_get_boxed(value));
     break;
   case PROP_USER_ID:
     g_assert(priv->user_id == 0); /* construct only */
@@ -310,6 +310,41 @@ inf_adopted_request_class_init(InfAdoptedRequestClass* request_class)
   );
 }
 
+/* Creates a new request without going through the property system, which
+ * is comparatively expensive. Requests are created in large numbers while
+ * transforming, so this makes a difference. The request refers to the
+ * interned version of vector, so that requests made at the same state share
+ * their vector. */
+static InfAdoptedRequest*
+inf_adopted_request_new_internal(InfAdoptedRequestType type,
+                                 InfAdoptedStateVector* vector,
+                                 guint user_id,
+                                 InfAdoptedOperation* operation,
+                                 gint64 received,
+                                 gint64 executed)
+{
+  InfAdoptedRequest* request;
+  InfAdoptedRequestPrivate* priv;
+
+  request = INF_ADOPTED_REQUEST(g_object_new(INF_ADOPTED_TYPE_REQUEST, NULL));
+  priv = INF_ADOPTED_REQUEST_PRIVATE(request);
+
+  priv->type = type;
+  priv->vector = inf_adopted_state_vector_intern(vector);
+  priv->user_id = user_id;
+  priv->received = received;
+  priv->executed = executed;
+
+  if(type == INF_ADOPTED_REQUEST_DO)
+  {
+    g_assert(operation != NULL);
+    priv->operation = operation;
+    g_object_ref(operation);
+  }
+
+  return request;
+}
+
 /**
  * inf_adopted_request_new_do: (constructor)
  * @vector: The vector time at which the request was made.
@@ -327,23 +362,18 @@ inf_adopted_request_new_do(InfAdoptedStateVector* vector,
                            InfAdoptedOperation* operation,
                            gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
   g_return_val_if_fail(INF_ADOPTED_IS_OPERATION(operation), NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_DO,
-    "vector", vector,
-    "user-id", user_id,
-    "operation", operation,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
+    vector,
+    user_id,
+    operation,
+    received,
+    0
   );
-
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -364,21 +394,17 @@ inf_adopted_request_new_undo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
 
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_UNDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_UNDO,
+    vector,
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -399,21 +425,17 @@ inf_adopted_request_new_redo(InfAdoptedStateVector* vector,
                              guint user_id,
                              gint64 received)
 {
-  GObject* object;
-  
   g_return_val_if_fail(vector != NULL, NULL);
   g_return_val_if_fail(user_id != 0, NULL);
-  
-  object = g_object_new(
-    INF_ADOPTED_TYPE_REQUEST,
-    "type", INF_ADOPTED_REQUEST_REDO,
-    "vector", vector,
-    "user-id", user_id,
-    "received", received,
-    NULL
+
+  return inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_REDO,
+    vector,
+    user_id,
+    NULL,
+    received,
+    0
   );
-  
-  return INF_ADOPTED_REQUEST(object);
 }
 
 /**
@@ -428,39 +450,18 @@ InfAdoptedRequest*
 inf_adopted_request_copy(InfAdoptedRequest* request)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
-  GObject* object;
-  
+
   g_return_val_if_fail(INF_ADOPTED_IS_REQUEST(request), NULL);
   priv = INF_ADOPTED_REQUEST_PRIVATE(request);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "operation", priv->operation,
-      "received", priv->received,
-      NULL
-    );
-  }
-  else
-  {
-    object = g_object_new(
-      INF_ADOPTED_TYPE_REQUEST,
-      "type", priv->type,
-      "vector", priv->vector,
-      "user-id", priv->user_id,
-      "received", priv->received,
-      NULL
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(INF_ADOPTED_REQUEST(object));
-  new_priv->executed = priv->executed;
-  return INF_ADOPTED_REQUEST(object);
+  return inf_adopted_request_new_internal(
+    priv->type,
+    priv->vector,
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 }
 
 /**
@@ -700,7 +701,6 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   InfAdoptedRequestPrivate* against_priv;
   InfAdoptedRequestPrivate* request_lcs_priv;
   InfAdoptedRequestPrivate* against_lcs_priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
   InfAdoptedRequest* new_request;
@@ -794,18 +794,17 @@ inf_adopted_request_transform(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(request_priv->vector);
   inf_adopted_state_vector_add(new_vector, against_priv->user_id, 1);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     request_priv->user_id,
     new_operation,
-    request_priv->received
+    request_priv->received,
+    request_priv->executed
   );
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = request_priv->executed;
-
-  g_object_unref(new_operation);
   inf_adopted_state_vector_free(new_vector);
+  g_object_unref(new_operation);
   return new_request;
 }
 
@@ -832,7 +831,6 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
                            guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedOperation* new_operation;
   InfAdoptedStateVector* new_vector;
   InfAdoptedRequest* new_request;
@@ -851,18 +849,17 @@ inf_adopted_request_mirror(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, priv->user_id, by);
 
-  new_request = inf_adopted_request_new_do(
+  new_request = inf_adopted_request_new_internal(
+    INF_ADOPTED_REQUEST_DO,
     new_vector,
     priv->user_id,
     new_operation,
-    priv->received
+    priv->received,
+    priv->executed
   );
 
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
-
-  g_object_unref(new_operation);
   inf_adopted_state_vector_free(new_vector);
+  g_object_unref(new_operation);
   return new_request;
 }
 
@@ -889,7 +886,6 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
                          guint by)
 {
   InfAdoptedRequestPrivate* priv;
-  InfAdoptedRequestPrivate* new_priv;
   InfAdoptedStateVector* new_vector;
   InfAdoptedRequest* new_request;
 
@@ -903,36 +899,14 @@ inf_adopted_request_fold(InfAdoptedRequest* request,
   new_vector = inf_adopted_state_vector_copy(priv->vector);
   inf_adopted_state_vector_add(new_vector, into, by);
 
-  if(priv->type == INF_ADOPTED_REQUEST_DO)
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "operation", priv->operation,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-  else
-  {
-    new_request = INF_ADOPTED_REQUEST(
-      g_object_new(
-        INF_ADOPTED_TYPE_REQUEST,
-        "type", priv->type,
-        "vector", new_vector,
-        "user-id", priv->user_id,
-        "received", priv->received,
-        NULL
-      )
-    );
-  }
-
-  new_priv = INF_ADOPTED_REQUEST_PRIVATE(new_request);
-  new_priv->executed = priv->executed;
+  new_request = inf_adopted_request_new_internal(
+    priv->type,
+    new_vector,
+    priv->user_id,
+    priv->operation,
+    priv->received,
+    priv->executed
+  );
 
   inf_adopted_state_vector_free(new_vector);
   return new_request;
@@ -40,6 +40,8 @@
 #include <libinfinity/adopted/inf-adopted-session.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-xml-blob.h>
+#include <libinfinity/common/inf-binary-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -52,6 +54,57 @@ typedef struct _InfAdoptedSessionToXmlSyncForeachData
 struct _InfAdoptedSessionToXmlSyncForeachData {
   InfAdoptedSession* session;
   xmlNodePtr parent_xml;
+  InfAdoptedStateVector* begin; /* NULL to send the full request logs */
+};
+
+typedef struct _InfAdoptedSessionSyncRequestsForeachData
+  InfAdoptedSessionSyncRequestsForeachData;
+struct _InfAdoptedSessionSyncRequestsForeachData {
+  GPtrArray* requests;
+  InfAdoptedStateVector* begin; /* NULL to send the full request logs */
+};
+
+/* The requests of all request logs at the time a synchronization started,
+ * and their serialized sync-request messages, as far as generated yet */
+typedef struct _InfAdoptedSessionSyncSnapshot InfAdoptedSessionSyncSnapshot;
+struct _InfAdoptedSessionSyncSnapshot {
+  guint ref_count;
+  InfAdoptedSession* session; /* NULL if no longer the session's snapshot */
+  InfAdoptedStateVector* vector;
+  GPtrArray* requests;
+  GPtrArray* blobs;
+};
+
+typedef struct _InfAdoptedSessionSyncRequests InfAdoptedSessionSyncRequests;
+struct _InfAdoptedSessionSyncRequests {
+  InfAdoptedSessionSyncSnapshot* snapshot;
+  guint pos;
+};
+
+typedef struct _InfAdoptedSessionBufferedRequest
+  InfAdoptedSessionBufferedRequest;
+struct _InfAdoptedSessionBufferedRequest {
+  InfAdoptedRequest* request;
+  /* The request can not be executed before the component user_id of the
+   * current state has reached n. */
+  guint user_id;
+  guint n;
+};
+
+typedef struct _InfAdoptedSessionBufferedRequestFindData
+  InfAdoptedSessionBufferedRequestFindData;
+struct _InfAdoptedSessionBufferedRequestFindData {
+  InfAdoptedStateVector* current;
+  guint user_id;
+  guint n;
+};
+
+typedef struct _InfAdoptedSessionBinaryDiffForeachData
+  InfAdoptedSessionBinaryDiffForeachData;
+struct _InfAdoptedSessionBinaryDiffForeachData {
+  InfAdoptedStateVector* orig;
+  GByteArray* data; /* NULL to only count the components */
+  guint n_components;
 };
 
 typedef struct _InfAdoptedSessionLocalUser InfAdoptedSessionLocalUser;
@@ -65,6 +118,7 @@ typedef struct _InfAdoptedSessionPrivate InfAdoptedSessionPrivate;
 struct _InfAdoptedSessionPrivate {
   InfIo* io;
   guint max_total_log_size;
+  gboolean snapshot_sync;
 
   InfAdoptedAlgorithm* algorithm;
   GSList* local_users; /* having zero or one item in 99.9% of all cases */
@@ -73,8 +127,21 @@ struct _InfAdoptedSessionPrivate {
   InfIoTimeout* noop_timeout;
   /* User to send the time for */
   InfAdoptedSessionLocalUser* next_noop_user;
-  /* Buffer for requests that are not ready to be executed yet */
-  GPtrArray* request_buffer;
+  /* Buffer for requests that are not ready to be executed yet. Each
+   * buffered request waits for one component of the current state, and it
+   * is stored in the sequence for that component's user ID, sorted by the
+   * value it waits for. This way only the requests whose dependency has been
+   * satisfied need to be looked at when the state changes. */
+  GHashTable* request_buffer; /* user ID -> GSequence of BufferedRequest */
+
+  /* Snapshot of the request logs shared by synchronizations that run
+   * at the same time. Not referenced by the session itself. */
+  InfAdoptedSessionSyncSnapshot* sync_snapshot;
+
+  gboolean binary_requests;
+  /* Connections we have been synchronized with -> whether requests can be
+   * sent to them in binary form, as negotiated during synchronization */
+  GHashTable* binary_connections;
 };
 
 enum {
@@ -85,7 +152,11 @@ enum {
   PROP_MAX_TOTAL_LOG_SIZE,
 
   /* read only */
-  PROP_ALGORITHM
+  PROP_ALGORITHM,
+
+  /* read/write */
+  PROP_SNAPSHOT_SYNC,
+  PROP_BINARY_REQUESTS
 };
 
 enum {
@@ -98,7 +169,6 @@ enum {
 
 static guint session_signals[LAST_SIGNAL];
 
-static GQuark inf_adopted_session_error_quark;
 /* TODO: This should perhaps be a property: */
 static const int INF_ADOPTED_SESSION_NOOP_INTERVAL = 30;
 
@@ -155,7 +225,7 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
   {
     g_set_error(
       error,
-      inf_adopted_session_error_quark,
+      inf_adopted_session_error_quark(),
       INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
       _("Request has index '%u', but index '%u' was expected"),
       n,
@@ -176,7 +246,7 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
       {
         g_set_error_literal(
           error,
-          inf_adopted_session_error_quark,
+          inf_adopted_session_error_quark(),
           INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
           _("Undo received, but no previous request found")
         );
@@ -192,7 +262,7 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
       {
         g_set_error_literal(
           error,
-          inf_adopted_session_error_quark,
+          inf_adopted_session_error_quark(),
           INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
           _("Redo received, but no previous request found")
         );
@@ -211,29 +281,21 @@ inf_adopted_session_validate_request(InfAdoptedRequestLog* log,
 }
 
 static InfAdoptedUser*
-inf_adopted_session_user_from_request_xml(InfAdoptedSession* session,
-                                          xmlNodePtr xml,
-                                          GError** error)
+inf_adopted_session_user_from_id(InfAdoptedSession* session,
+                                 guint user_id,
+                                 GError** error)
 {
   InfUserTable* user_table;
   InfUser* user;
-  guint user_id;
 
   user_table = inf_session_get_user_table(INF_SESSION(session));
-
-  if(!inf_xml_util_get_attribute_uint_required(xml, "user", &user_id, error))
-    return FALSE;
-
-  /* User ID 0 means no user */
-  if(user_id == 0) return NULL;
-
   user = inf_user_table_lookup_user_by_id(user_table, user_id);
 
   if(user == NULL)
   {
     g_set_error(
       error,
-      inf_adopted_session_error_quark,
+      inf_adopted_session_error_quark(),
       INF_ADOPTED_SESSION_ERROR_NO_SUCH_USER,
       _("No such user with user ID '%u'"),
       user_id
@@ -246,6 +308,362 @@ inf_adopted_session_user_from_request_xml(InfAdoptedSession* session,
   return INF_ADOPTED_USER(user);
 }
 
+static InfAdoptedUser*
+inf_adopted_session_user_from_request_xml(InfAdoptedSession* session,
+                                          xmlNodePtr xml,
+                                          GError** error)
+{
+  guint user_id;
+
+  if(!inf_xml_util_get_attribute_uint_required(xml, "user", &user_id, error))
+    return FALSE;
+
+  /* User ID 0 means no user */
+  if(user_id == 0) return NULL;
+
+  return inf_adopted_session_user_from_id(session, user_id, error);
+}
+
+/*
+ * Binary requests
+ */
+
+/* Whether we offer binary requests to the sites we synchronize with. We can
+ * always read binary requests if the session type supports them, but we only
+ * send them to sites that offered them, too. */
+static gboolean
+inf_adopted_session_get_binary_enabled(InfAdoptedSession* session)
+{
+  InfAdoptedSessionClass* session_class;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+
+  return INF_ADOPTED_SESSION_PRIVATE(session)->binary_requests &&
+    session_class->operation_to_binary != NULL &&
+    session_class->binary_to_operation != NULL;
+}
+
+static void
+inf_adopted_session_binary_connection_notify_status_cb(GObject* object,
+                                                       GParamSpec* pspec,
+                                                       gpointer user_data)
+{
+  InfAdoptedSession* session;
+  InfAdoptedSessionPrivate* priv;
+  InfXmlConnectionStatus status;
+
+  session = INF_ADOPTED_SESSION(user_data);
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_XML_CONNECTION_CLOSING ||
+     status == INF_XML_CONNECTION_CLOSED)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      object,
+      G_CALLBACK(inf_adopted_session_binary_connection_notify_status_cb),
+      session
+    );
+
+    g_hash_table_remove(priv->binary_connections, object);
+  }
+}
+
+static void
+inf_adopted_session_set_binary_connection(InfAdoptedSession* session,
+                                          InfXmlConnection* connection,
+                                          gboolean binary)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(!g_hash_table_contains(priv->binary_connections, connection))
+  {
+    g_signal_connect(
+      G_OBJECT(connection),
+      "notify::status",
+      G_CALLBACK(inf_adopted_session_binary_connection_notify_status_cb),
+      session
+    );
+
+    g_object_ref(connection);
+  }
+
+  g_hash_table_insert(
+    priv->binary_connections,
+    connection,
+    GINT_TO_POINTER(binary)
+  );
+}
+
+/* Returns whether all members of the subscription group, except exclude,
+ * can receive requests in binary form. Connections that have been added to
+ * the group without having been synchronized with cannot. */
+static gboolean
+inf_adopted_session_binary_group(InfAdoptedSession* session,
+                                 InfXmlConnection* exclude)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfCommunicationGroup* group;
+  GSList* members;
+  GSList* item;
+  gboolean result;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  group = inf_session_get_subscription_group(INF_SESSION(session));
+  if(group == NULL) return FALSE;
+
+  members = inf_communication_group_get_members(group);
+  result = TRUE;
+
+  for(item = members; item != NULL && result; item = item->next)
+  {
+    if(item->data != exclude)
+    {
+      result = GPOINTER_TO_INT(
+        g_hash_table_lookup(priv->binary_connections, item->data)
+      );
+    }
+  }
+
+  g_slist_free(members);
+  return result;
+}
+
+static void
+inf_adopted_session_binary_diff_foreach_func(guint id,
+                                             guint value,
+                                             gpointer user_data)
+{
+  InfAdoptedSessionBinaryDiffForeachData* foreach_data;
+  guint diff;
+
+  foreach_data = (InfAdoptedSessionBinaryDiffForeachData*)user_data;
+  diff = value - inf_adopted_state_vector_get(foreach_data->orig, id);
+
+  if(diff > 0)
+  {
+    if(foreach_data->data != NULL)
+    {
+      inf_binary_util_write_uint(foreach_data->data, id);
+      inf_binary_util_write_uint(foreach_data->data, diff);
+    }
+
+    ++ foreach_data->n_components;
+  }
+}
+
+static xmlNodePtr
+inf_adopted_session_binary_request_to_xml(GByteArray* data)
+{
+  xmlNodePtr xml;
+  gchar* encoded;
+
+  /* The transport only carries XML, so the binary data is embedded as
+   * base64. This is still much smaller and cheaper to parse than the
+   * attributes and child nodes of a <request>. */
+  xml = xmlNewNode(NULL, (const xmlChar*)"binary-request");
+  encoded = g_base64_encode(data->data, data->len);
+  xmlNodeAddContent(xml, (const xmlChar*)encoded);
+  g_free(encoded);
+
+  return xml;
+}
+
+/* Reports errors that occurred while reading binary data, such as the ones
+ * of InfBinaryUtil or of the binary_to_operation vfunc, as
+ * INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST. Errors in the
+ * InfAdoptedSessionError domain are propagated as they are. */
+static void
+inf_adopted_session_propagate_binary_error(GError** dest,
+                                           GError* src)
+{
+  if(src->domain == inf_adopted_session_error_quark())
+  {
+    g_propagate_error(dest, src);
+  }
+  else
+  {
+    g_set_error_literal(
+      dest,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+      src->message
+    );
+
+    g_error_free(src);
+  }
+}
+
+/* Reads a request written with inf_adopted_session_request_to_binary(). The
+ * error can be in another domain if reading from the binary data failed, see
+ * inf_adopted_session_propagate_binary_error(). */
+static InfAdoptedRequest*
+inf_adopted_session_read_binary_request(InfAdoptedSession* session,
+                                        const guchar* data,
+                                        gsize length,
+                                        InfAdoptedStateVector* diff_vec,
+                                        guint* num,
+                                        GError** error)
+{
+  InfAdoptedSessionClass* session_class;
+  const guchar* pos;
+  const guchar* end;
+  guint user_id;
+  guint type;
+  guint n_components;
+  guint prev_id;
+  guint id;
+  guint diff;
+  guint i;
+
+  InfAdoptedStateVector* vector;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  pos = data;
+  end = data + length;
+
+  if(!inf_binary_util_read_uint(&pos, end, &user_id, error))
+    return NULL;
+  if(inf_adopted_session_user_from_id(session, user_id, error) == NULL)
+    return NULL;
+  if(!inf_binary_util_read_uint(&pos, end, &type, error))
+    return NULL;
+  if(!inf_binary_util_read_uint(&pos, end, num, error))
+    return NULL;
+  if(!inf_binary_util_read_uint(&pos, end, &n_components, error))
+    return NULL;
+
+  if(type > INF_ADOPTED_REQUEST_REDO || *num == 0)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+      _("Invalid request type or count in binary request")
+    );
+
+    return NULL;
+  }
+
+  vector = inf_adopted_state_vector_copy(diff_vec);
+  prev_id = 0;
+
+  for(i = 0; i < n_components; ++i)
+  {
+    if(!inf_binary_util_read_uint(&pos, end, &id, error) ||
+       !inf_binary_util_read_uint(&pos, end, &diff, error))
+    {
+      inf_adopted_state_vector_free(vector);
+      return NULL;
+    }
+
+    if((i > 0 && id <= prev_id) || diff == 0)
+    {
+      g_set_error_literal(
+        error,
+        inf_adopted_session_error_quark(),
+        INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+        _("Invalid state vector in binary request")
+      );
+
+      inf_adopted_state_vector_free(vector);
+      return NULL;
+    }
+
+    inf_adopted_state_vector_add(vector, id, diff);
+    prev_id = id;
+  }
+
+  operation = NULL;
+  if(type == INF_ADOPTED_REQUEST_DO)
+  {
+    if(session_class->binary_to_operation == NULL)
+    {
+      g_set_error_literal(
+        error,
+        inf_adopted_session_error_quark(),
+        INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+        _("Binary requests are not supported by this session")
+      );
+
+      inf_adopted_state_vector_free(vector);
+      return NULL;
+    }
+
+    operation =
+      session_class->binary_to_operation(session, user_id, &pos, end, error);
+
+    if(operation == NULL)
+    {
+      inf_adopted_state_vector_free(vector);
+      return NULL;
+    }
+  }
+
+  if(pos != end)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+      _("Unexpected data at the end of binary request")
+    );
+
+    if(operation != NULL) g_object_unref(operation);
+    inf_adopted_state_vector_free(vector);
+    return NULL;
+  }
+
+  switch(type)
+  {
+  case INF_ADOPTED_REQUEST_DO:
+    request = inf_adopted_request_new_do(
+      vector,
+      user_id,
+      operation,
+      g_get_real_time()
+    );
+
+    g_object_unref(operation);
+    break;
+  case INF_ADOPTED_REQUEST_UNDO:
+    request = inf_adopted_request_new_undo(vector, user_id, g_get_real_time());
+    break;
+  case INF_ADOPTED_REQUEST_REDO:
+    request = inf_adopted_request_new_redo(vector, user_id, g_get_real_time());
+    break;
+  default:
+    g_assert_not_reached();
+    request = NULL;
+    break;
+  }
+
+  inf_adopted_state_vector_free(vector);
+  return request;
+}
+
+/* Turns a received <binary-request> into the equivalent <request>, so that
+ * it can be forwarded to sites which do not understand binary requests. */
+static void
+inf_adopted_session_binary_request_to_legacy(InfAdoptedSession* session,
+                                             xmlNodePtr xml,
+                                             InfAdoptedRequest* request,
+                                             InfAdoptedStateVector* diff_vec,
+                                             guint num)
+{
+  InfAdoptedSessionClass* session_class;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+
+  xmlNodeSetContent(xml, NULL);
+  xmlNodeSetName(xml, (const xmlChar*)"request");
+
+  session_class->request_to_xml(session, xml, request, diff_vec, FALSE);
+  if(num > 1) inf_xml_util_set_attribute_uint(xml, "num", num);
+}
+
 /*
  * Noop timer
  */
@@ -395,6 +813,7 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   guint user_id;
   InfUser* user;
   InfAdoptedSessionLocalUser* local;
+  GByteArray* data;
   xmlNodePtr xml;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
@@ -412,17 +831,37 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   );
   g_assert(local != NULL);
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+  if(inf_adopted_session_get_binary_enabled(session) &&
+     inf_adopted_session_binary_group(session, NULL))
+  {
+    data = g_byte_array_new();
 
-  session_class->request_to_xml(
-    session,
-    xml,
-    request,
-    local->last_send_vector,
-    FALSE
-  );
+    inf_adopted_session_request_to_binary(
+      session,
+      request,
+      local->last_send_vector,
+      n,
+      data
+    );
+
+    xml = inf_adopted_session_binary_request_to_xml(data);
+    g_byte_array_unref(data);
+  }
+  else
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"request");
+
+    session_class->request_to_xml(
+      session,
+      xml,
+      request,
+      local->last_send_vector,
+      FALSE
+    );
+
+    if(n > 1) inf_xml_util_set_attribute_uint(xml, "num", n);
+  }
 
-  if(n > 1) inf_xml_util_set_attribute_uint(xml, "num", n);
   inf_session_send_to_subscriptions(INF_SESSION(session), xml);
 
   inf_adopted_state_vector_free(local->last_send_vector);
@@ -438,123 +877,349 @@ inf_adopted_session_broadcast_n_requests(InfAdoptedSession* session,
   inf_adopted_session_stop_noop_timer(session, local);
 }
 
+static void
+inf_adopted_session_buffered_request_free(gpointer data)
+{
+  InfAdoptedSessionBufferedRequest* buffered;
+  buffered = (InfAdoptedSessionBufferedRequest*)data;
+
+  g_object_unref(buffered->request);
+  g_slice_free(InfAdoptedSessionBufferedRequest, buffered);
+}
+
+static gint
+inf_adopted_session_buffered_request_cmp(gconstpointer a,
+                                         gconstpointer b,
+                                         gpointer user_data)
+{
+  const InfAdoptedSessionBufferedRequest* first;
+  const InfAdoptedSessionBufferedRequest* second;
+
+  first = (const InfAdoptedSessionBufferedRequest*)a;
+  second = (const InfAdoptedSessionBufferedRequest*)b;
+
+  /* Requests waiting for the same value are kept in insertion order */
+  if(first->n > second->n) return 1;
+  return -1;
+}
+
+static void
+inf_adopted_session_buffered_request_find_foreach_func(guint id,
+                                                       guint value,
+                                                       gpointer user_data)
+{
+  InfAdoptedSessionBufferedRequestFindData* data;
+  data = (InfAdoptedSessionBufferedRequestFindData*)user_data;
+
+  if(data->n == 0 && value > inf_adopted_state_vector_get(data->current, id))
+  {
+    data->user_id = id;
+    data->n = value;
+  }
+}
+
+/* Stores request in the request buffer so that it is woken up as soon as the
+ * first component of the current state it is waiting for is reached. If the
+ * request is not waiting for anything, returns FALSE and does not take
+ * ownership of the request. */
 static gboolean
-inf_adopted_session_process_request(InfAdoptedSession* session,
-                                    InfAdoptedRequest* request,
-                                    InfAdoptedUser* user,
-                                    GError** error)
+inf_adopted_session_buffer_request(InfAdoptedSession* session,
+                                   InfAdoptedRequest* request)
 {
   InfAdoptedSessionPrivate* priv;
-  InfAdoptedStateVector* request_vector;
-  InfAdoptedStateVector* current_vector;
+  InfAdoptedSessionBufferedRequestFindData data;
+  InfAdoptedSessionBufferedRequest* buffered;
+  GSequence* sequence;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  data.current = inf_adopted_algorithm_get_current(priv->algorithm);
+  data.user_id = 0;
+  data.n = 0;
+
+  inf_adopted_state_vector_foreach(
+    inf_adopted_request_get_vector(request),
+    inf_adopted_session_buffered_request_find_foreach_func,
+    &data
+  );
+
+  if(data.n == 0)
+    return FALSE;
+
+  if(priv->request_buffer == NULL)
+  {
+    priv->request_buffer = g_hash_table_new_full(
+      NULL,
+      NULL,
+      NULL,
+      (GDestroyNotify)g_sequence_free
+    );
+  }
+
+  sequence = g_hash_table_lookup(
+    priv->request_buffer,
+    GUINT_TO_POINTER(data.user_id)
+  );
+
+  if(sequence == NULL)
+  {
+    sequence = g_sequence_new(inf_adopted_session_buffered_request_free);
+
+    g_hash_table_insert(
+      priv->request_buffer,
+      GUINT_TO_POINTER(data.user_id),
+      sequence
+    );
+  }
+
+  buffered = g_slice_new(InfAdoptedSessionBufferedRequest);
+  buffered->request = request;
+  buffered->user_id = data.user_id;
+  buffered->n = data.n;
+
+  g_sequence_insert_sorted(
+    sequence,
+    buffered,
+    inf_adopted_session_buffered_request_cmp,
+    NULL
+  );
+
+  return TRUE;
+}
+
+/* Moves all buffered requests that have become ready for execution into
+ * ready. Requests which are still waiting for another component of the
+ * current state are re-indexed. */
+static void
+inf_adopted_session_wake_buffered_requests(InfAdoptedSession* session,
+                                           GQueue* ready)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedStateVector* current;
+  GHashTableIter hash_iter;
+  gpointer key;
+  gpointer value;
+  GSequence* sequence;
+  GSequenceIter* iter;
+  GSequenceIter* begin;
+  InfAdoptedSessionBufferedRequest* buffered;
+  GQueue woken;
+  guint n;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  if(priv->request_buffer == NULL)
+    return;
+
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+  g_queue_init(&woken);
+
+  g_hash_table_iter_init(&hash_iter, priv->request_buffer);
+  while(g_hash_table_iter_next(&hash_iter, &key, &value))
+  {
+    sequence = (GSequence*)value;
+    n = inf_adopted_state_vector_get(current, GPOINTER_TO_UINT(key));
+
+    begin = g_sequence_get_begin_iter(sequence);
+    for(iter = begin; !g_sequence_iter_is_end(iter);
+        iter = g_sequence_iter_next(iter))
+    {
+      buffered = (InfAdoptedSessionBufferedRequest*)g_sequence_get(iter);
+      if(buffered->n > n) break;
+
+      g_queue_push_tail(&woken, buffered->request);
+      g_object_ref(buffered->request);
+    }
+
+    g_sequence_remove_range(begin, iter);
+    if(g_sequence_get_length(sequence) == 0)
+      g_hash_table_iter_remove(&hash_iter);
+  }
+
+  /* Re-index the requests that still wait for another component, all
+   * others are ready for execution. */
+  while(!g_queue_is_empty(&woken))
+  {
+    value = g_queue_pop_head(&woken);
+    if(!inf_adopted_session_buffer_request(session, value))
+      g_queue_push_tail(ready, value);
+  }
+}
+
+/* Emits the check-request signal for request and returns FALSE with error
+ * set if the request was rejected. */
+static gboolean
+inf_adopted_session_emit_check_request(InfAdoptedSession* session,
+                                       InfAdoptedRequest* request,
+                                       InfAdoptedUser* user,
+                                       GError** error)
+{
   gboolean reject_request;
-  GError* local_error;
-  gboolean execute_result;
 
+  g_signal_emit(
+    G_OBJECT(session),
+    session_signals[CHECK_REQUEST],
+    0,
+    request,
+    user,
+    &reject_request
+  );
+
+  if(reject_request)
+  {
+    g_set_error_literal(
+      error,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+      _("The request was rejected via the API")
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Send a message back to where the request came from, to let them know we
+ * couldn't handle this. Note that at the moment this is not explicitly
+ * handled, but it can aid in debugging. */
+static void
+inf_adopted_session_report_request_error(InfAdoptedSession* session,
+                                         InfAdoptedRequest* request,
+                                         InfAdoptedUser* user,
+                                         const GError* error)
+{
+  InfAdoptedSessionPrivate* priv;
   xmlNodePtr reply_xml;
   gchar* request_str;
   gchar* current_str;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
-  request_vector = inf_adopted_request_get_vector(request);
-  current_vector = inf_adopted_algorithm_get_current(priv->algorithm);
 
-  if(inf_adopted_state_vector_causally_before(request_vector, current_vector))
+  if(inf_user_get_connection(INF_USER(user)) != NULL)
   {
-    g_signal_emit(
-      G_OBJECT(session),
-      session_signals[CHECK_REQUEST],
-      0,
-      request,
-      user,
-      &reject_request
+    request_str = inf_adopted_state_vector_to_string(
+      inf_adopted_request_get_vector(request)
     );
 
-    local_error = NULL;
-    
-    if(reject_request)
-    {
-      g_set_error_literal(
-        &local_error,
-        inf_adopted_session_error_quark,
-        INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
-        _("The request was rejected via the API")
-      );
+    current_str = inf_adopted_state_vector_to_string(
+      inf_adopted_algorithm_get_current(priv->algorithm)
+    );
 
-      execute_result = FALSE;
-    }
-    else
-    {
-      execute_result = inf_adopted_algorithm_execute_request(
-        priv->algorithm,
-        request,
-        TRUE,
-        &local_error
-      );
-    }
+    reply_xml = xmlNewNode(NULL, (const xmlChar*)"invalid-request");
 
-    if(local_error != NULL)
-    {
-      /* Send a message back to where the request came from, to let them
-       * know we couldn't handle this. Note that at the moment this is not
-       * explicitly handled, but it can aid in debugging. */
-      if(inf_user_get_connection(INF_USER(user)) != NULL)
-      {
-        /* Send a message back to where we got this request from, to inform
-         * them that the request cannot be handled. */
-        request_str = inf_adopted_state_vector_to_string(request_vector);
-        current_str = inf_adopted_state_vector_to_string(current_vector);
+    inf_xml_util_set_attribute(
+      reply_xml,
+      "request",
+      request_str
+    );
 
-        reply_xml = xmlNewNode(NULL, (const xmlChar*)"invalid-request");
+    inf_xml_util_set_attribute(
+      reply_xml,
+      "state",
+      current_str
+    );
 
-        inf_xml_util_set_attribute(
-          reply_xml,
-          "request",
-          request_str
-        );
+    inf_xml_util_set_attribute_uint(
+      reply_xml,
+      "user",
+      inf_user_get_id(INF_USER(user))
+    );
 
-        inf_xml_util_set_attribute(
-          reply_xml,
-          "state",
-          current_str
-        );
+    xmlNewChild(
+      reply_xml,
+      NULL,
+      (const xmlChar*)"reason",
+      (const xmlChar*)error->message
+    );
 
-        inf_xml_util_set_attribute_uint(
-          reply_xml,
-          "user",
-          inf_user_get_id(INF_USER(user))
-        );
+    g_free(request_str);
+    g_free(current_str);
 
-        xmlNewChild(
-          reply_xml,
-          NULL,
-          (const xmlChar*)"reason",
-          (const xmlChar*)local_error->message
-        );
+    inf_communication_group_send_message(
+      inf_session_get_subscription_group(INF_SESSION(session)),
+      inf_user_get_connection(INF_USER(user)),
+      reply_xml
+    );
+  }
+}
 
-        g_free(request_str);
-        g_free(current_str);
+static gboolean
+inf_adopted_session_process_request(InfAdoptedSession* session,
+                                    InfAdoptedRequest* request,
+                                    InfAdoptedUser* user,
+                                    GError** error)
+{
+  InfAdoptedSessionPrivate* priv;
+  GError* local_error;
+  gboolean execute_result;
 
-        inf_communication_group_send_message(
-          inf_session_get_subscription_group(INF_SESSION(session)),
-          inf_user_get_connection(INF_USER(user)),
-          reply_xml
-        );
-      }
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
 
-      g_propagate_error(error, local_error);
-    }
+  g_object_ref(request);
+  if(inf_adopted_session_buffer_request(session, request))
+    return TRUE;
+  g_object_unref(request);
+
+  local_error = NULL;
+  execute_result = inf_adopted_session_emit_check_request(
+    session,
+    request,
+    user,
+    &local_error
+  );
 
-    return execute_result;
+  if(execute_result)
+  {
+    execute_result = inf_adopted_algorithm_execute_request(
+      priv->algorithm,
+      request,
+      TRUE,
+      &local_error
+    );
   }
-  else
+
+  if(local_error != NULL)
+  {
+    inf_adopted_session_report_request_error(
+      session,
+      request,
+      user,
+      local_error
+    );
+
+    g_propagate_error(error, local_error);
+  }
+
+  return execute_result;
+}
+
+static gboolean
+inf_adopted_session_check_request(InfAdoptedSession* session,
+                                  InfAdoptedRequest* request,
+                                  InfAdoptedUser* user)
+{
+  /* Accept all requests by default */
+  return FALSE;
+}
+
+/* Returns whether requests can be rejected via the check-request signal. If
+ * so, the signal needs to be emitted right before each request is executed,
+ * so that handlers see the state the request is going to be executed in. */
+static gboolean
+inf_adopted_session_has_request_checks(InfAdoptedSession* session)
+{
+  if(INF_ADOPTED_SESSION_GET_CLASS(session)->check_request !=
+     inf_adopted_session_check_request)
   {
-    if(priv->request_buffer == NULL)
-      priv->request_buffer = g_ptr_array_new();
-    g_ptr_array_add(priv->request_buffer, request);
-    g_object_ref(request);
     return TRUE;
   }
+
+  return g_signal_has_handler_pending(
+    G_OBJECT(session),
+    session_signals[CHECK_REQUEST],
+    0,
+    FALSE
+  );
 }
 
 static void
@@ -562,33 +1227,38 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
 {
   InfAdoptedSessionPrivate* priv;
   InfUserTable* user_table;
-  InfAdoptedStateVector* current;
-
-  guint i;
+  GQueue ready;
+  GPtrArray* batch;
   InfAdoptedRequest* request;
-  InfAdoptedStateVector* vector;
-
-  guint user_id;
   InfUser* user;
+  GError* error;
+  gboolean accepted;
+  gboolean executed;
+  guint n_executed;
+  guint i;
 
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  if(priv->request_buffer == NULL)
+    return;
 
-  if(priv->request_buffer != NULL)
+  user_table = inf_session_get_user_table(INF_SESSION(session));
+  batch = g_ptr_array_new();
+  g_queue_init(&ready);
+
+  inf_adopted_session_wake_buffered_requests(session, &ready);
+  while(!g_queue_is_empty(&ready))
   {
-    user_table = inf_session_get_user_table(INF_SESSION(session));
-    current = inf_adopted_algorithm_get_current(priv->algorithm);
-    for(i = 0; i < priv->request_buffer->len; ++i)
+    if(inf_adopted_session_has_request_checks(session))
     {
-      request =
-        INF_ADOPTED_REQUEST(g_ptr_array_index(priv->request_buffer, i));
-      vector = inf_adopted_request_get_vector(request);
-
-      if(inf_adopted_state_vector_causally_before(vector, current))
+      /* Check and execute the requests one by one */
+      while(!g_queue_is_empty(&ready))
       {
-        g_ptr_array_remove_index_fast(priv->request_buffer, i);
+        request = INF_ADOPTED_REQUEST(g_queue_pop_head(&ready));
+        user = inf_user_table_lookup_user_by_id(
+          user_table,
+          inf_adopted_request_get_user_id(request)
+        );
 
-        user_id = inf_adopted_request_get_user_id(request);
-        user = inf_user_table_lookup_user_by_id(user_table, user_id);
         g_assert(INF_ADOPTED_IS_USER(user));
 
         /* Note that there is no error handling here, since the buffered
@@ -599,14 +1269,102 @@ inf_adopted_session_process_buffered_requests(InfAdoptedSession* session)
           session,
           request,
           INF_ADOPTED_USER(user),
-          NULL
+          NULL
+        );
+
+        g_object_unref(request);
+      }
+    }
+
+    /* All requests that are ready now stay ready when the others are being
+     * executed, so they can be executed in one go. Nobody can reject them
+     * at this point, so emitting check-request before executing the first
+     * one does not make a difference. */
+    while(!g_queue_is_empty(&ready))
+    {
+      request = INF_ADOPTED_REQUEST(g_queue_pop_head(&ready));
+      user = inf_user_table_lookup_user_by_id(
+        user_table,
+        inf_adopted_request_get_user_id(request)
+      );
+
+      g_assert(INF_ADOPTED_IS_USER(user));
+
+      /* Note that there is no error handling here, since the buffered
+       * requests are not related to the request which has currently been
+       * received. In order to handle a failure here, the
+       * InfAdoptedAlgorithm::end-execute-request signal should be used. */
+      error = NULL;
+      accepted = inf_adopted_session_emit_check_request(
+        session,
+        request,
+        INF_ADOPTED_USER(user),
+        &error
+      );
+
+      if(accepted)
+      {
+        g_ptr_array_add(batch, request);
+      }
+      else
+      {
+        inf_adopted_session_report_request_error(
+          session,
+          request,
+          INF_ADOPTED_USER(user),
+          error
+        );
+
+        g_error_free(error);
+        g_object_unref(request);
+      }
+    }
+
+    i = 0;
+    while(i < batch->len)
+    {
+      error = NULL;
+
+      executed = inf_adopted_algorithm_execute_requests(
+        priv->algorithm,
+        (InfAdoptedRequest**)batch->pdata + i,
+        batch->len - i,
+        TRUE,
+        &n_executed,
+        &error
+      );
+
+      i += n_executed;
+      if(!executed)
+      {
+        /* Skip the failed request, and go on with the others */
+        request = INF_ADOPTED_REQUEST(g_ptr_array_index(batch, i));
+        user = inf_user_table_lookup_user_by_id(
+          user_table,
+          inf_adopted_request_get_user_id(request)
+        );
+
+        inf_adopted_session_report_request_error(
+          session,
+          request,
+          INF_ADOPTED_USER(user),
+          error
         );
 
-        g_object_unref(request);
-        return inf_adopted_session_process_buffered_requests(session);
+        g_error_free(error);
+
+        ++i;
       }
     }
+
+    for(i = 0; i < batch->len; ++i)
+      g_object_unref(g_ptr_array_index(batch, i));
+    g_ptr_array_set_size(batch, 0);
+
+    inf_adopted_session_wake_buffered_requests(session, &ready);
   }
+
+  g_ptr_array_free(batch, TRUE);
 }
 
 /*
@@ -799,11 +1557,21 @@ inf_adopted_session_init(InfAdoptedSession* session)
 
   priv->io = NULL;
   priv->max_total_log_size = 2048;
+  priv->snapshot_sync = FALSE;
   priv->algorithm = NULL;
   priv->local_users = NULL;
   priv->noop_timeout = NULL;
   priv->next_noop_user = NULL;
   priv->request_buffer = NULL;
+  priv->sync_snapshot = NULL;
+  priv->binary_requests = TRUE;
+
+  priv->binary_connections = g_hash_table_new_full(
+    NULL,
+    NULL,
+    g_object_unref,
+    NULL
+  );
 }
 
 static void
@@ -872,7 +1640,8 @@ inf_adopted_session_dispose(GObject* object)
   InfAdoptedSession* session;
   InfAdoptedSessionPrivate* priv;
   InfUserTable* user_table;
-  guint i;
+  GHashTableIter iter;
+  gpointer key;
 
   session = INF_ADOPTED_SESSION(object);
   priv = INF_ADOPTED_SESSION_PRIVATE(session);
@@ -905,12 +1674,28 @@ inf_adopted_session_dispose(GObject* object)
 
   if(priv->request_buffer != NULL)
   {
-    for(i = 0; i < priv->request_buffer->len; ++i)
-      g_object_unref(g_ptr_array_index(priv->request_buffer, i));
-    g_ptr_array_free(priv->request_buffer, TRUE);
+    g_hash_table_destroy(priv->request_buffer);
     priv->request_buffer = NULL;
   }
 
+  if(priv->sync_snapshot != NULL)
+  {
+    priv->sync_snapshot->session = NULL;
+    priv->sync_snapshot = NULL;
+  }
+
+  g_hash_table_iter_init(&iter, priv->binary_connections);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(key),
+      G_CALLBACK(inf_adopted_session_binary_connection_notify_status_cb),
+      session
+    );
+  }
+
+  g_hash_table_remove_all(priv->binary_connections);
+
   if(priv->algorithm != NULL)
   {
     inf_signal_handlers_disconnect_by_func(
@@ -942,6 +1727,8 @@ inf_adopted_session_finalize(GObject* object)
   /* Should have been freed in close, called by dispose */
   g_assert(priv->local_users == NULL);
 
+  g_hash_table_destroy(priv->binary_connections);
+
   G_OBJECT_CLASS(inf_adopted_session_parent_class)->finalize(object);
 }
 
@@ -966,6 +1753,12 @@ inf_adopted_session_set_property(GObject* object,
   case PROP_MAX_TOTAL_LOG_SIZE:
     priv->max_total_log_size = g_value_get_uint(value);
     break;
+  case PROP_SNAPSHOT_SYNC:
+    priv->snapshot_sync = g_value_get_boolean(value);
+    break;
+  case PROP_BINARY_REQUESTS:
+    priv->binary_requests = g_value_get_boolean(value);
+    break;
   case PROP_ALGORITHM:
     /* read only */
   default:
@@ -997,6 +1790,12 @@ inf_adopted_session_get_property(GObject* object,
   case PROP_ALGORITHM:
     g_value_set_object(value, G_OBJECT(priv->algorithm));
     break;
+  case PROP_SNAPSHOT_SYNC:
+    g_value_set_boolean(value, priv->snapshot_sync);
+    break;
+  case PROP_BINARY_REQUESTS:
+    g_value_set_boolean(value, priv->binary_requests);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
@@ -1007,6 +1806,26 @@ inf_adopted_session_get_property(GObject* object,
  * VFunc implementations.
  */
 
+/* Returns the index of the first request of log to synchronize, given the
+ * result of inf_adopted_algorithm_get_snapshot_begin(), or NULL for the full
+ * request log. */
+static guint
+inf_adopted_session_sync_log_begin(InfAdoptedStateVector* begin,
+                                   InfUser* user,
+                                   InfAdoptedRequestLog* log)
+{
+  guint log_begin;
+
+  log_begin = inf_adopted_request_log_get_begin(log);
+  if(begin == NULL)
+    return log_begin;
+
+  return MAX(
+    log_begin,
+    inf_adopted_state_vector_get(begin, inf_user_get_id(user))
+  );
+}
+
 static void
 inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
                                                   gpointer user_data)
@@ -1027,7 +1846,8 @@ inf_adopted_session_to_xml_sync_foreach_user_func(InfUser* user,
   session_class = INF_ADOPTED_SESSION_GET_CLASS(data->session);
   g_assert(session_class->request_to_xml != NULL);
 
-  for(i = inf_adopted_request_log_get_begin(log); i < end; ++ i)
+  i = inf_adopted_session_sync_log_begin(data->begin, user, log);
+  for(; i < end; ++ i)
   {
     request = inf_adopted_request_log_get_request(log, i);
 
@@ -1061,12 +1881,297 @@ inf_adopted_session_to_xml_sync(InfSession* session,
 
   foreach_data.session = INF_ADOPTED_SESSION(session);
   foreach_data.parent_xml = parent;
+  foreach_data.begin = NULL;
+
+  if(priv->snapshot_sync)
+  {
+    foreach_data.begin =
+      inf_adopted_algorithm_get_snapshot_begin(priv->algorithm);
+  }
 
   inf_user_table_foreach_user(
     inf_session_get_user_table(session),
     inf_adopted_session_to_xml_sync_foreach_user_func,
     &foreach_data
   );
+
+  if(foreach_data.begin != NULL)
+    inf_adopted_state_vector_free(foreach_data.begin);
+}
+
+static void
+inf_adopted_session_init_sync_generator_foreach_user_func(InfUser* user,
+                                                          gpointer user_data)
+{
+  InfAdoptedSessionSyncRequestsForeachData* data;
+  InfAdoptedRequestLog* log;
+  guint i;
+  guint end;
+
+  g_assert(INF_ADOPTED_IS_USER(user));
+
+  data = (InfAdoptedSessionSyncRequestsForeachData*)user_data;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+  end = inf_adopted_request_log_get_end(log);
+
+  i = inf_adopted_session_sync_log_begin(data->begin, user, log);
+  for(; i < end; ++ i)
+  {
+    g_ptr_array_add(
+      data->requests,
+      g_object_ref(inf_adopted_request_log_get_request(log, i))
+    );
+  }
+}
+
+/* Returns whether snap consists of exactly the given requests */
+static gboolean
+inf_adopted_session_sync_snapshot_equal(InfAdoptedSessionSyncSnapshot* snap,
+                                        GPtrArray* requests)
+{
+  guint i;
+
+  if(snap->requests->len != requests->len)
+    return FALSE;
+
+  for(i = 0; i < requests->len; ++ i)
+  {
+    if(g_ptr_array_index(snap->requests, i) !=
+       g_ptr_array_index(requests, i))
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Drops a reference on a snapshot of the request logs */
+static void
+inf_adopted_session_sync_snapshot_unref(InfAdoptedSessionSyncSnapshot* snap)
+{
+  InfAdoptedSessionPrivate* priv;
+  guint i;
+
+  if(-- snap->ref_count > 0)
+    return;
+
+  if(snap->session != NULL)
+  {
+    priv = INF_ADOPTED_SESSION_PRIVATE(snap->session);
+    g_assert(priv->sync_snapshot == snap);
+    priv->sync_snapshot = NULL;
+  }
+
+  for(i = 0; i < snap->requests->len; ++ i)
+  {
+    g_object_unref(g_ptr_array_index(snap->requests, i));
+    if(g_ptr_array_index(snap->blobs, i) != NULL)
+      inf_xml_blob_unref(g_ptr_array_index(snap->blobs, i));
+  }
+
+  g_ptr_array_free(snap->requests, TRUE);
+  g_ptr_array_free(snap->blobs, TRUE);
+  inf_adopted_state_vector_free(snap->vector);
+  g_slice_free(InfAdoptedSessionSyncSnapshot, snap);
+}
+
+/* Returns a snapshot of the request logs. It is shared with the other
+ * synchronizations that run at the same time, as long as no requests have
+ * been added to or removed from the logs in between. */
+static InfAdoptedSessionSyncSnapshot*
+inf_adopted_session_sync_snapshot_get(InfAdoptedSession* session)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionSyncSnapshot* snap;
+  InfAdoptedSessionSyncSnapshot* old_snap;
+  InfAdoptedSessionSyncRequestsForeachData foreach_data;
+  InfAdoptedStateVector* current;
+  GHashTable* old_blobs;
+  InfXmlBlob* blob;
+  guint i;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  current = inf_adopted_algorithm_get_current(priv->algorithm);
+
+  snap = g_slice_new(InfAdoptedSessionSyncSnapshot);
+  snap->requests = g_ptr_array_new();
+
+  foreach_data.requests = snap->requests;
+  foreach_data.begin = NULL;
+
+  if(priv->snapshot_sync)
+  {
+    foreach_data.begin =
+      inf_adopted_algorithm_get_snapshot_begin(priv->algorithm);
+  }
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_adopted_session_init_sync_generator_foreach_user_func,
+    &foreach_data
+  );
+
+  if(foreach_data.begin != NULL)
+    inf_adopted_state_vector_free(foreach_data.begin);
+
+  /* The snapshot can be shared if it consists of the very same requests.
+   * The ends of the logs are given by the current state, so checking that
+   * first rules out most differing snapshots cheaply. */
+  old_snap = priv->sync_snapshot;
+  if(old_snap != NULL &&
+     inf_adopted_state_vector_compare(old_snap->vector, current) == 0 &&
+     inf_adopted_session_sync_snapshot_equal(old_snap, snap->requests))
+  {
+    for(i = 0; i < snap->requests->len; ++ i)
+      g_object_unref(g_ptr_array_index(snap->requests, i));
+    g_ptr_array_free(snap->requests, TRUE);
+    g_slice_free(InfAdoptedSessionSyncSnapshot, snap);
+
+    ++ old_snap->ref_count;
+    return old_snap;
+  }
+
+  snap->ref_count = 1;
+  snap->session = session;
+  snap->vector = inf_adopted_state_vector_copy(current);
+  snap->blobs = g_ptr_array_sized_new(snap->requests->len);
+
+  /* Requests never change, so the messages that have already been
+   * serialized for a previous snapshot can be reused. */
+  old_blobs = NULL;
+  if(old_snap != NULL)
+  {
+    old_blobs = g_hash_table_new(NULL, NULL);
+    for(i = 0; i < old_snap->requests->len; ++ i)
+    {
+      blob = g_ptr_array_index(old_snap->blobs, i);
+      if(blob != NULL)
+      {
+        g_hash_table_insert(
+          old_blobs,
+          g_ptr_array_index(old_snap->requests, i),
+          blob
+        );
+      }
+    }
+
+    /* The old snapshot stays alive as long as synchronizations use it, but
+     * new synchronizations use the new one. */
+    old_snap->session = NULL;
+  }
+
+  for(i = 0; i < snap->requests->len; ++ i)
+  {
+    blob = NULL;
+    if(old_blobs != NULL)
+    {
+      blob = g_hash_table_lookup(
+        old_blobs,
+        g_ptr_array_index(snap->requests, i)
+      );
+    }
+
+    if(blob != NULL)
+      inf_xml_blob_ref(blob);
+    g_ptr_array_add(snap->blobs, blob);
+  }
+
+  if(old_blobs != NULL)
+    g_hash_table_destroy(old_blobs);
+
+  priv->sync_snapshot = snap;
+  return snap;
+}
+
+static void
+inf_adopted_session_sync_requests_func(InfSession* session,
+                                       xmlNodePtr parent,
+                                       guint n_messages,
+                                       gpointer user_data)
+{
+  InfAdoptedSessionSyncRequests* sync_requests;
+  InfAdoptedSessionSyncSnapshot* snap;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfXmlBlob* blob;
+  xmlNodePtr xml;
+  guint i;
+
+  sync_requests = (InfAdoptedSessionSyncRequests*)user_data;
+  snap = sync_requests->snapshot;
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_assert(session_class->request_to_xml != NULL);
+
+  for(i = 0; i < n_messages; ++ i)
+  {
+    g_assert(sync_requests->pos < snap->requests->len);
+
+    /* Serialize each request only once, for the first synchronization
+     * that gets to it. */
+    blob = g_ptr_array_index(snap->blobs, sync_requests->pos);
+    if(blob == NULL)
+    {
+      request = g_ptr_array_index(snap->requests, sync_requests->pos);
+      xml = xmlNewNode(NULL, (const xmlChar*)"sync-request");
+
+      session_class->request_to_xml(
+        INF_ADOPTED_SESSION(session),
+        xml,
+        request,
+        NULL,
+        TRUE
+      );
+
+      blob = inf_xml_blob_new(xml);
+      g_ptr_array_index(snap->blobs, sync_requests->pos) = blob;
+    }
+
+    xmlAddChild(parent, inf_xml_blob_reference_new(blob));
+    ++ sync_requests->pos;
+  }
+}
+
+static void
+inf_adopted_session_sync_requests_free(gpointer user_data)
+{
+  InfAdoptedSessionSyncRequests* sync_requests;
+  sync_requests = (InfAdoptedSessionSyncRequests*)user_data;
+
+  inf_adopted_session_sync_snapshot_unref(sync_requests->snapshot);
+  g_slice_free(InfAdoptedSessionSyncRequests, sync_requests);
+}
+
+static void
+inf_adopted_session_init_sync_generator(InfSession* session,
+                                        InfSessionSyncGenerator* generator)
+{
+  InfAdoptedSessionPrivate* priv;
+  InfAdoptedSessionSyncRequests* sync_requests;
+
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+  g_assert(priv->algorithm != NULL);
+
+  INF_SESSION_CLASS(inf_adopted_session_parent_class)->init_sync_generator(
+    session,
+    generator
+  );
+
+  /* Requests do not change once they are made, so referencing them is
+   * enough to keep a snapshot of the request logs. They are only converted
+   * to XML when they are about to be sent. */
+  sync_requests = g_slice_new(InfAdoptedSessionSyncRequests);
+  sync_requests->snapshot =
+    inf_adopted_session_sync_snapshot_get(INF_ADOPTED_SESSION(session));
+  sync_requests->pos = 0;
+
+  inf_session_sync_generator_add_step(
+    generator,
+    sync_requests->snapshot->requests->len,
+    inf_adopted_session_sync_requests_func,
+    sync_requests,
+    inf_adopted_session_sync_requests_free
+  );
 }
 
 static gboolean
@@ -1075,49 +2180,242 @@ inf_adopted_session_process_xml_sync(InfSession* session,
                                      const xmlNodePtr xml,
                                      GError** error)
 {
-  InfAdoptedSessionClass* session_class;
-  InfAdoptedRequest* request;
-  InfAdoptedUser* user;
-  InfAdoptedRequestLog* log;
-  InfSessionClass* parent_class;
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  InfAdoptedRequestLog* log;
+  InfSessionClass* parent_class;
+
+  if(strcmp((const char*)xml->name, "sync-request") == 0)
+  {
+    session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+    g_assert(session_class->xml_to_request != NULL);
+
+    request = session_class->xml_to_request(
+      INF_ADOPTED_SESSION(session),
+      xml,
+      NULL, /* TODO: Diff to previous request, if any. */
+      TRUE,
+      error
+    );
+
+    if(request == NULL) return FALSE;
+
+    user = INF_ADOPTED_USER(
+      inf_user_table_lookup_user_by_id(
+        inf_session_get_user_table(session),
+        inf_adopted_request_get_user_id(request)
+      )
+    );
+
+    log = inf_adopted_user_get_request_log(user);
+    if(inf_adopted_session_validate_request(log, request, error) == FALSE)
+    {
+      g_object_unref(request);
+      return FALSE;
+    }
+
+    inf_adopted_request_log_add_request(log, request);
+    g_object_unref(request);
+
+    return TRUE;
+  }
+
+  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
+  return parent_class->process_xml_sync(session, connection, xml, error);
+}
+
+/* Returns a copy of request with the component of its own user increased
+ * by the given amount, for requests that are sent with num > 1. */
+static InfAdoptedRequest*
+inf_adopted_session_advance_request(InfAdoptedRequest* request,
+                                    guint by)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequest* result;
+  guint user_id;
+
+  user_id = inf_adopted_request_get_user_id(request);
+  vector = inf_adopted_state_vector_copy(
+    inf_adopted_request_get_vector(request)
+  );
+
+  inf_adopted_state_vector_add(vector, user_id, by);
+
+  switch(inf_adopted_request_get_request_type(request))
+  {
+  case INF_ADOPTED_REQUEST_DO:
+    result = inf_adopted_request_new_do(
+      vector,
+      user_id,
+      inf_adopted_request_get_operation(request),
+      inf_adopted_request_get_receive_time(request)
+    );
+
+    break;
+  case INF_ADOPTED_REQUEST_UNDO:
+    result = inf_adopted_request_new_undo(
+      vector,
+      user_id,
+      inf_adopted_request_get_receive_time(request)
+    );
+
+    break;
+  case INF_ADOPTED_REQUEST_REDO:
+    result = inf_adopted_request_new_redo(
+      vector,
+      user_id,
+      inf_adopted_request_get_receive_time(request)
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    result = NULL;
+    break;
+  }
+
+  inf_adopted_state_vector_free(vector);
+  return result;
+}
+
+/* Checks that requests issued by user may be received from connection */
+static gboolean
+inf_adopted_session_check_request_connection(InfAdoptedUser* user,
+                                             InfXmlConnection* connection,
+                                             GError** error)
+{
+  if(inf_user_get_status(INF_USER(user)) == INF_USER_UNAVAILABLE ||
+     inf_user_get_connection(INF_USER(user)) != connection)
+  {
+    g_set_error_literal(
+      error,
+      inf_user_error_quark(),
+      INF_USER_ERROR_NOT_JOINED,
+      _("User did not join from this connection")
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Processes a request received from the network, no matter whether it was
+ * transmitted as XML or in binary form. */
+static InfCommunicationScope
+inf_adopted_session_receive_request(InfAdoptedSession* session,
+                                    InfAdoptedUser* user,
+                                    InfAdoptedRequest* request,
+                                    guint num,
+                                    GError** error)
+{
+  guint user_id;
 
-  if(strcmp((const char*)xml->name, "sync-request") == 0)
+  InfAdoptedStateVector* user_vector;
+  InfAdoptedStateVector* request_vector;
+
+  gboolean process_request;
+  InfAdoptedRequest* copy_req;
+  guint i;
+
+  gchar* request_str;
+  gchar* user_str;
+
+  user_id = inf_user_get_id(INF_USER(user));
+  user_vector = inf_adopted_user_get_vector(user);
+  request_vector = inf_adopted_request_get_vector(request);
+
+  if(!inf_adopted_state_vector_causally_before(user_vector, request_vector))
   {
-    session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
-    g_assert(session_class->xml_to_request != NULL);
+    /* Note that this can actually not happen, since the request time is
+     * transferred as a diff to the previous user time. If the absolute
+     * time were transmitted this would need to be handled as an error. */
+    g_assert_not_reached();
+  }
+  else if(inf_adopted_request_get_index(request) !=
+          inf_adopted_state_vector_get(user_vector, user_id))
+  {
+    request_str = inf_adopted_state_vector_to_string(request_vector);
+    user_str = inf_adopted_state_vector_to_string(user_vector);
 
-    request = session_class->xml_to_request(
-      INF_ADOPTED_SESSION(session),
-      xml,
-      NULL, /* TODO: Diff to previous request, if any. */
-      TRUE,
-      error
+    g_set_error(
+      error,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
+      _("Request \"%s\" by user \"%s\" is not consecutive with respect to "
+        "previously received request \"%s\""),
+      request_str,
+      inf_user_get_name(INF_USER(user)),
+      user_str
     );
 
-    if(request == NULL) return FALSE;
+    g_free(request_str);
+    g_free(user_str);
+    return INF_COMMUNICATION_SCOPE_PTP;
+  }
 
-    user = INF_ADOPTED_USER(
-      inf_user_table_lookup_user_by_id(
-        inf_session_get_user_table(session),
-        inf_adopted_request_get_user_id(request)
-      )
+  /* Update the user vector to the state of the request. */
+  user_vector = inf_adopted_state_vector_copy(request_vector);
+  /* Note that this function takes ownership of user_vector */
+  inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
+
+  /* Apply the request more than once if num >= 2 is given. This is mostly
+   * used for multiple undos and redos, but is in general allowed for any
+   * request. */
+  for(i = 0; i < num; ++i)
+  {
+    if(i == 0)
+    {
+      copy_req = request;
+      g_object_ref(copy_req);
+    }
+    else
+    {
+      copy_req = inf_adopted_session_advance_request(request, i);
+    }
+
+    process_request = inf_adopted_session_process_request(
+      session,
+      copy_req,
+      user,
+      error
     );
 
-    log = inf_adopted_user_get_request_log(user);
-    if(inf_adopted_session_validate_request(log, request, error) == FALSE)
+    /* Update the user vector again, including the component of the
+     * processed request. */
+    if(inf_adopted_request_affects_buffer(request))
     {
-      g_object_unref(request);
-      return FALSE;
+      user_vector = inf_adopted_state_vector_copy(
+        inf_adopted_request_get_vector(copy_req)
+      );
+
+      inf_adopted_state_vector_add(user_vector, user_id, 1);
+      /* Note that this function takes ownership of user_vector */
+      inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
     }
 
-    inf_adopted_request_log_add_request(log, request);
-    g_object_unref(request);
+    g_object_unref(copy_req);
 
-    return TRUE;
+    /* If an error occurred then break here, and do not process the
+     * subsequent requests -- they will likely fail as well. */
+    if(process_request == FALSE)
+      break;
   }
 
-  parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
-  return parent_class->process_xml_sync(session, connection, xml, error);
+  /* The processed request(s) might have caused some of the buffered
+   * requests to become ready. */
+  if(i > 0)
+    inf_adopted_session_process_buffered_requests(session);
+
+  /* Cleanup requests that are no longer used after
+   * having processed everything */
+  inf_adopted_algorithm_cleanup(inf_adopted_session_get_algorithm(session));
+
+  /* Requests can always be forwarded since user is given. Explicitly allow
+   * forwarding if the request could not be applied... maybe others are more
+   * lucky? In the worst case it will just fail for them as well. */
+  return INF_COMMUNICATION_SCOPE_GROUP;
 }
 
 static InfCommunicationScope
@@ -1126,29 +2424,24 @@ inf_adopted_session_process_xml_run(InfSession* session,
                                     const xmlNodePtr xml,
                                     GError** error)
 {
-  InfAdoptedSessionPrivate* priv;
   InfAdoptedSessionClass* session_class;
   InfAdoptedRequest* request;
   InfAdoptedUser* user;
-  guint user_id;
-
   InfAdoptedStateVector* user_vector;
-  InfAdoptedStateVector* request_vector;
+  InfCommunicationScope scope;
 
   gboolean has_num;
-  gboolean process_request;
   guint num;
   GError* local_error;
-  InfAdoptedRequest* copy_req;
-  guint i;
 
-  gchar* request_str;
-  gchar* user_str;
+  xmlChar* content;
+  guchar* data;
+  const guchar* pos;
+  gsize length;
+  guint user_id;
 
   InfSessionClass* parent_class;
 
-  priv = INF_ADOPTED_SESSION_PRIVATE(session);
-
   if(strcmp((const char*)xml->name, "request") == 0)
   {
     session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
@@ -1163,18 +2456,8 @@ inf_adopted_session_process_xml_run(InfSession* session,
     if(user == NULL)
       return INF_COMMUNICATION_SCOPE_PTP;
 
-    if(inf_user_get_status(INF_USER(user)) == INF_USER_UNAVAILABLE ||
-       inf_user_get_connection(INF_USER(user)) != connection)
-    {
-      g_set_error_literal(
-        error,
-        inf_user_error_quark(),
-        INF_USER_ERROR_NOT_JOINED,
-        _("User did not join from this connection")
-      );
-
+    if(!inf_adopted_session_check_request_connection(user, connection, error))
       return INF_COMMUNICATION_SCOPE_PTP;
-    }
 
     local_error = NULL;
     has_num = inf_xml_util_get_attribute_uint(xml, "num", &num, &local_error);
@@ -1187,13 +2470,10 @@ inf_adopted_session_process_xml_run(InfSession* session,
     if(has_num == FALSE)
       num = 1;
 
-    user_id = inf_user_get_id(INF_USER(user));
-    user_vector = inf_adopted_user_get_vector(user);
-
     request = session_class->xml_to_request(
       INF_ADOPTED_SESSION(session),
       xml,
-      user_vector,
+      inf_adopted_user_get_vector(user),
       FALSE,
       error
     );
@@ -1201,120 +2481,145 @@ inf_adopted_session_process_xml_run(InfSession* session,
     if(request == NULL)
       return INF_COMMUNICATION_SCOPE_PTP;
 
-    request_vector = inf_adopted_request_get_vector(request);
-
-    if(!inf_adopted_state_vector_causally_before(user_vector, request_vector))
-    {
-      /* Note that this can actually not happen, since the request time is
-       * transferred as a diff to the previous user time. If the absolute
-       * time were transmitted this would need to be handled as an error. */
-      g_assert_not_reached();
-    }
-    else if(inf_adopted_request_get_index(request) !=
-            inf_adopted_state_vector_get(user_vector, user_id))
-    {
-      request_str = inf_adopted_state_vector_to_string(request_vector);
-      user_str = inf_adopted_state_vector_to_string(user_vector);
-
-      g_set_error(
-        error,
-        inf_adopted_session_error_quark,
-        INF_ADOPTED_SESSION_ERROR_INVALID_REQUEST,
-        _("Request \"%s\" by user \"%s\" is not consecutive with respect to "
-          "previously received request \"%s\""),
-        request_str,
-        inf_user_get_name(INF_USER(user)),
-        user_str
-      );
+    scope = inf_adopted_session_receive_request(
+      INF_ADOPTED_SESSION(session),
+      user,
+      request,
+      num,
+      error
+    );
 
-      g_free(request_str);
-      g_free(user_str);
-      g_object_unref(request);
-      return INF_COMMUNICATION_SCOPE_PTP;
-    }
+    g_object_unref(request);
+    return scope;
+  }
+  else if(strcmp((const char*)xml->name, "binary-request") == 0)
+  {
+    content = xmlNodeGetContent(xml);
+    if(content == NULL)
+      content = xmlStrdup((const xmlChar*)"");
 
-    /* Update the user vector to the state of the request. */
-    user_vector = inf_adopted_state_vector_copy(request_vector);
-    /* Note that this function takes ownership of user_vector */
-    inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
+    data = g_base64_decode_inplace((gchar*)content, &length);
 
-    /* Apply the request more than once if num >= 2 is given. This is mostly
-     * used for multiple undos and redos, but is in general allowed for any
-     * request. */
-    for(i = 0; i < num; ++i)
+    /* The user comes first, so that we know the vector that the request
+     * time is relative to. */
+    pos = data;
+    user = NULL;
+    local_error = NULL;
+    if(inf_binary_util_read_uint(&pos, data + length, &user_id, &local_error))
     {
-      if(i == 0)
-      {
-        copy_req = request;
-        g_object_ref(copy_req);
-      }
-      else
-      {
-        copy_req = inf_adopted_request_copy(request);
-
-        /* TODO: This is a bit of a hack since requests are normally
-         * immutable. It avoids an additional vector copy here though. */
-        inf_adopted_state_vector_add(
-          inf_adopted_request_get_vector(copy_req),
-          inf_user_get_id(INF_USER(user)),
-          i
-        );
-      }
-
-      process_request = inf_adopted_session_process_request(
+      user = inf_adopted_session_user_from_id(
         INF_ADOPTED_SESSION(session),
-        copy_req,
-        user,
+        user_id,
         error
       );
+    }
+    else
+    {
+      inf_adopted_session_propagate_binary_error(error, local_error);
+    }
 
-      g_object_unref(copy_req);
-
-      /* Update the user vector again, including the component of the processed request. */
-      if(inf_adopted_request_affects_buffer(request))
-      {
-        user_vector = inf_adopted_state_vector_copy(
-          inf_adopted_request_get_vector(copy_req)
-        );
+    if(user == NULL ||
+       !inf_adopted_session_check_request_connection(user, connection, error))
+    {
+      xmlFree(content);
+      return INF_COMMUNICATION_SCOPE_PTP;
+    }
 
-        inf_adopted_state_vector_add(user_vector, user_id, 1);
-        /* Note that this function takes ownership of user_vector */
-        inf_adopted_user_set_vector(INF_ADOPTED_USER(user), user_vector);
-      }
+    user_vector = inf_adopted_user_get_vector(user);
 
-      /* If an error occurred then break here, and do not process the
-       * subsequent requests -- they will likely fail as well. */
-      if(process_request == FALSE)
-        break;
-    }
+    request = inf_adopted_session_request_from_binary(
+      INF_ADOPTED_SESSION(session),
+      data,
+      length,
+      user_vector,
+      &num,
+      error
+    );
 
-    g_object_unref(request);
+    xmlFree(content);
+    if(request == NULL)
+      return INF_COMMUNICATION_SCOPE_PTP;
 
-    /* The processed request(s) might have caused some of the buffered
-     * requests to become ready. */
-    if(i > 0)
+    /* Forward the request as XML if any of the other group members does not
+     * understand binary requests. This needs to be done before processing,
+     * since processing changes the user vector the request is relative to. */
+    if(!inf_adopted_session_binary_group(INF_ADOPTED_SESSION(session),
+                                         connection))
     {
-      inf_adopted_session_process_buffered_requests(
-        INF_ADOPTED_SESSION(session)
+      inf_adopted_session_binary_request_to_legacy(
+        INF_ADOPTED_SESSION(session),
+        xml,
+        request,
+        user_vector,
+        num
       );
     }
 
-    /* Cleanup requests that are no longer used after
-     * having processed everything */
-    inf_adopted_algorithm_cleanup(
-      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+    scope = inf_adopted_session_receive_request(
+      INF_ADOPTED_SESSION(session),
+      user,
+      request,
+      num,
+      error
     );
 
-    /* Requests can always be forwarded since user is given. Explicitly allow
-     * forwarding if the request could not be applied... maybe others are more
-     * lucky? In the worst case it will just fail for them as well. */
-    return INF_COMMUNICATION_SCOPE_GROUP;
+    g_object_unref(request);
+    return scope;
   }
 
   parent_class = INF_SESSION_CLASS(inf_adopted_session_parent_class);
   return parent_class->process_xml_run(session, connection, xml, error);
 }
 
+static void
+inf_adopted_session_set_xml_sync_features(InfSession* session,
+                                          InfXmlConnection* connection,
+                                          xmlNodePtr xml)
+{
+  InfAdoptedSessionPrivate* priv;
+  priv = INF_ADOPTED_SESSION_PRIVATE(session);
+
+  if(inf_adopted_session_get_binary_enabled(INF_ADOPTED_SESSION(session)))
+    inf_xml_util_set_attribute(xml, "request-encoding", "binary");
+
+  /* Until we know better, the remote site only understands XML requests */
+  if(!g_hash_table_contains(priv->binary_connections, connection))
+  {
+    inf_adopted_session_set_binary_connection(
+      INF_ADOPTED_SESSION(session),
+      connection,
+      FALSE
+    );
+  }
+}
+
+static void
+inf_adopted_session_get_xml_sync_features(InfSession* session,
+                                          InfXmlConnection* connection,
+                                          xmlNodePtr xml)
+{
+  xmlChar* encoding;
+  gboolean binary;
+
+  encoding = inf_xml_util_get_attribute(xml, "request-encoding");
+  binary = FALSE;
+
+  if(encoding != NULL)
+  {
+    binary =
+      strcmp((const char*)encoding, "binary") == 0 &&
+      inf_adopted_session_get_binary_enabled(INF_ADOPTED_SESSION(session));
+
+    xmlFree(encoding);
+  }
+
+  inf_adopted_session_set_binary_connection(
+    INF_ADOPTED_SESSION(session),
+    connection,
+    binary
+  );
+}
+
 static GArray*
 inf_adopted_session_get_xml_user_props(InfSession* session,
                                        InfXmlConnection* conn,
@@ -1431,7 +2736,7 @@ inf_adopted_session_validate_user_props(InfSession* session,
   {
     g_set_error_literal(
       error,
-      inf_adopted_session_error_quark,
+      inf_adopted_session_error_quark(),
       INF_ADOPTED_SESSION_ERROR_MISSING_STATE_VECTOR,
       _("\"time\" attribute in user message is missing")
     );
@@ -1519,15 +2824,6 @@ inf_adopted_session_synchronization_complete(InfSession* session,
   g_object_thaw_notify(G_OBJECT(session));
 }
 
-static gboolean
-inf_adopted_session_check_request(InfAdoptedSession* session,
-                                  InfAdoptedRequest* request,
-                                  InfAdoptedUser* user)
-{
-  /* Accept all requests by default */
-  return FALSE;
-}
-
 /*
  * Gype registration.
  */
@@ -1548,12 +2844,17 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
   object_class->get_property = inf_adopted_session_get_property;
 
   session_class->to_xml_sync = inf_adopted_session_to_xml_sync;
+  session_class->init_sync_generator = inf_adopted_session_init_sync_generator;
   session_class->process_xml_sync = inf_adopted_session_process_xml_sync;
   session_class->process_xml_run = inf_adopted_session_process_xml_run;
   session_class->get_xml_user_props = inf_adopted_session_get_xml_user_props;
   session_class->set_xml_user_props = inf_adopted_session_set_xml_user_props;
   session_class->validate_user_props =
     inf_adopted_session_validate_user_props;
+  session_class->set_xml_sync_features =
+    inf_adopted_session_set_xml_sync_features;
+  session_class->get_xml_sync_features =
+    inf_adopted_session_get_xml_sync_features;
 
   session_class->close = inf_adopted_session_close;
   
@@ -1562,12 +2863,10 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
 
   adopted_session_class->xml_to_request = NULL;
   adopted_session_class->request_to_xml = NULL;
+  adopted_session_class->operation_to_binary = NULL;
+  adopted_session_class->binary_to_operation = NULL;
   adopted_session_class->check_request = inf_adopted_session_check_request;
 
-  inf_adopted_session_error_quark = g_quark_from_static_string(
-    "INF_ADOPTED_SESSION_ERROR"
-  );
-
   /**
    * InfAdoptedSession::check-request:
    * @session: The #InfAdoptedSession which is about to process a request.
@@ -1583,6 +2882,10 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
    * before it gets distributed to all other clients. If there is one signal
    * handler returning %TRUE the request is rejected, i.e. only if all signal
    * handlers return %FALSE it is accepted.
+   *
+   * The signal is emitted right before the request is executed, so the
+   * current state of the session's #InfAdoptedAlgorithm is the state the
+   * request is going to be transformed to.
    */
   session_signals[CHECK_REQUEST] = g_signal_new(
     "check-request",
@@ -1634,12 +2937,79 @@ inf_adopted_session_class_init(InfAdoptedSessionClass* adopted_session_class)
       G_PARAM_READABLE
     )
   );
+
+  /**
+   * InfAdoptedSession:snapshot-sync:
+   *
+   * Whether to leave out old requests when synchronizing the session to
+   * another site. If this is %TRUE, then only the requests returned by
+   * inf_adopted_algorithm_get_snapshot_begin() are sent along with the
+   * buffer content, instead of the full request logs. This makes
+   * synchronization of long-lived sessions much faster. Requests that can
+   * still be undone or redone are never left out, so this only has an
+   * effect if #InfAdoptedSession:max-total-log-size is limited.
+   *
+   * No support from the synchronized site is required, since the request
+   * logs are not complete after inf_adopted_algorithm_cleanup() either.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_SNAPSHOT_SYNC,
+    g_param_spec_boolean(
+      "snapshot-sync",
+      "Snapshot synchronization",
+      "Whether to synchronize only the requests that are still required",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  /**
+   * InfAdoptedSession:binary-requests:
+   *
+   * Whether to exchange requests in compact binary form with sites that
+   * support it. Binary requests are much smaller than their XML
+   * counterparts, and they can be read without creating XML nodes for the
+   * request and its operation.
+   *
+   * Support for binary requests is negotiated separately for each
+   * connection when the session is synchronized to or from it, so changing
+   * this property only affects later synchronizations. Requests are sent in
+   * binary form only if all subscribed connections support them, and
+   * binary requests are forwarded as XML to connections which do not.
+   * Binary requests can only be used if the session type implements the
+   * operation_to_binary and binary_to_operation virtual functions.
+   */
+  g_object_class_install_property(
+    object_class,
+    PROP_BINARY_REQUESTS,
+    g_param_spec_boolean(
+      "binary-requests",
+      "Binary requests",
+      "Whether to exchange requests in binary form if possible",
+      TRUE,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 /*
  * Public API.
  */
 
+/**
+ * inf_adopted_session_error_quark:
+ *
+ * The domain for #InfAdoptedSessionError errors.
+ *
+ * Returns: A #GQuark for that domain.
+ **/
+GQuark
+inf_adopted_session_error_quark(void)
+{
+  return g_quark_from_static_string("INF_ADOPTED_SESSION_ERROR");
+}
+
 /**
  * inf_adopted_session_get_io:
  * @session: A #InfAdoptedSession.
@@ -1879,7 +3249,7 @@ inf_adopted_session_read_request_info(InfAdoptedSession* session,
     {
       g_set_error_literal(
         error,
-        inf_adopted_session_error_quark,
+        inf_adopted_session_error_quark(),
         INF_ADOPTED_SESSION_ERROR_MISSING_OPERATION,
         _("Operation for request missing")
       );
@@ -1941,4 +3311,139 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
     xmlAddChild(xml, operation);
 }
 
+/**
+ * inf_adopted_session_request_to_binary:
+ * @session: A #InfAdoptedSession.
+ * @request: The #InfAdoptedRequest to write.
+ * @diff_vec: The reference vector for the state of @request.
+ * @num: The number of times the request is to be applied, usually 1.
+ * @data: The #GByteArray to append the request to.
+ *
+ * Appends @request to @data in compact binary form. Numbers are written with
+ * inf_binary_util_write_uint(). First comes the ID of the user that issued
+ * the request, the request type (0 for Do, 1 for Undo and 2 for Redo) and
+ * @num. Then the state of the request is written as a diff to @diff_vec,
+ * which must be causally before the state of @request: the number of
+ * components that differ, followed by ID and difference of each such
+ * component in increasing order of IDs. For Do requests, this is followed by
+ * the operation as written by the operation_to_binary virtual function, which
+ * must be implemented by @session.
+ *
+ * Deserializing the request again with
+ * inf_adopted_session_request_from_binary() requires the same @diff_vec.
+ */
+void
+inf_adopted_session_request_to_binary(InfAdoptedSession* session,
+                                      InfAdoptedRequest* request,
+                                      InfAdoptedStateVector* diff_vec,
+                                      guint num,
+                                      GByteArray* data)
+{
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedSessionBinaryDiffForeachData foreach_data;
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequestType type;
+
+  g_return_if_fail(INF_ADOPTED_IS_SESSION(session));
+  g_return_if_fail(INF_ADOPTED_IS_REQUEST(request));
+  g_return_if_fail(diff_vec != NULL);
+  g_return_if_fail(num > 0);
+  g_return_if_fail(data != NULL);
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  g_return_if_fail(session_class->operation_to_binary != NULL);
+
+  vector = inf_adopted_request_get_vector(request);
+  g_return_if_fail(inf_adopted_state_vector_causally_before(diff_vec, vector));
+
+  type = inf_adopted_request_get_request_type(request);
+
+  inf_binary_util_write_uint(data, inf_adopted_request_get_user_id(request));
+  inf_binary_util_write_uint(data, type);
+  inf_binary_util_write_uint(data, num);
+
+  foreach_data.orig = diff_vec;
+  foreach_data.data = NULL;
+  foreach_data.n_components = 0;
+
+  inf_adopted_state_vector_foreach(
+    vector,
+    inf_adopted_session_binary_diff_foreach_func,
+    &foreach_data
+  );
+
+  inf_binary_util_write_uint(data, foreach_data.n_components);
+
+  foreach_data.data = data;
+  foreach_data.n_components = 0;
+
+  inf_adopted_state_vector_foreach(
+    vector,
+    inf_adopted_session_binary_diff_foreach_func,
+    &foreach_data
+  );
+
+  if(type == INF_ADOPTED_REQUEST_DO)
+  {
+    session_class->operation_to_binary(
+      session,
+      inf_adopted_request_get_operation(request),
+      data
+    );
+  }
+}
+
+/**
+ * inf_adopted_session_request_from_binary:
+ * @session: A #InfAdoptedSession.
+ * @data: (array length=length): The binary data to read.
+ * @length: The number of bytes in @data.
+ * @diff_vec: The reference vector that was used to write @data.
+ * @num: (out): Location to store the number of times the request is to be
+ * applied.
+ * @error: Location to place an error, if any.
+ *
+ * Reads a request written with inf_adopted_session_request_to_binary(). No
+ * XML nodes are created in the process. @data must contain exactly one
+ * request. If it does not contain a valid request, then the function
+ * returns %NULL and @error is set to
+ * %INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST. If it refers to a user
+ * that does not exist in @session, then @error is set to
+ * %INF_ADOPTED_SESSION_ERROR_NO_SUCH_USER.
+ *
+ * Returns: (transfer full): A new #InfAdoptedRequest, or %NULL on error.
+ */
+InfAdoptedRequest*
+inf_adopted_session_request_from_binary(InfAdoptedSession* session,
+                                        const guchar* data,
+                                        gsize length,
+                                        InfAdoptedStateVector* diff_vec,
+                                        guint* num,
+                                        GError** error)
+{
+  InfAdoptedRequest* request;
+  GError* local_error;
+
+  g_return_val_if_fail(INF_ADOPTED_IS_SESSION(session), NULL);
+  g_return_val_if_fail(data != NULL || length == 0, NULL);
+  g_return_val_if_fail(diff_vec != NULL, NULL);
+  g_return_val_if_fail(num != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  local_error = NULL;
+  request = inf_adopted_session_read_binary_request(
+    session,
+    data,
+    length,
+    diff_vec,
+    num,
+    &local_error
+  );
+
+  if(local_error != NULL)
+    inf_adopted_session_propagate_binary_error(error, local_error);
+
+  return request;
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -52,6 +52,8 @@ typedef struct _InfAdoptedSessionClass InfAdoptedSessionClass;
  * @INF_ADOPTED_SESSION_ERROR_MISSING_STATE_VECTOR: A synchronized user does
  * not contain that the state that user currently is in.
  * @INF_ADOPTED_SESSION_ERROR_FAILED: No further specified error code.
+ * @INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST: A request message in
+ * binary form could not be decoded.
  *
  * Error codes for #InfAdoptedSession. These only occur when invalid requests
  * are received from the network.
@@ -63,7 +65,9 @@ typedef enum _InfAdoptedSessionError {
 
   INF_ADOPTED_SESSION_ERROR_MISSING_STATE_VECTOR,
   
-  INF_ADOPTED_SESSION_ERROR_FAILED
+  INF_ADOPTED_SESSION_ERROR_FAILED,
+
+  INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST
 } InfAdoptedSessionError;
 
 /**
@@ -75,6 +79,14 @@ typedef enum _InfAdoptedSessionError {
  * to XML. This function should add properties and children to the given XML
  * node. At might use inf_adopted_session_write_request_info() to write the
  * common info.
+ * @operation_to_binary: Virtual function to append the operation of a Do
+ * request in compact binary form to the given byte array. Can be %NULL if
+ * the session does not support binary requests.
+ * @binary_to_operation: Virtual function to read an operation written by
+ * @operation_to_binary, for a request made by the user with the given ID.
+ * It must advance the read position past the operation and never read
+ * beyond the end of the data. Can be %NULL if the session does not support
+ * binary requests.
  * @check_request: Default signal handler of the
  * InfAdoptedSession::check-request signal.
  *
@@ -99,6 +111,16 @@ struct _InfAdoptedSessionClass {
                         InfAdoptedStateVector* diff_vec,
                         gboolean for_sync);
 
+  void(*operation_to_binary)(InfAdoptedSession* session,
+                             InfAdoptedOperation* operation,
+                             GByteArray* data);
+
+  InfAdoptedOperation*(*binary_to_operation)(InfAdoptedSession* session,
+                                             guint user_id,
+                                             const guchar** data,
+                                             const guchar* end,
+                                             GError** error);
+
   /* Signals */
 
   gboolean(*check_request)(InfAdoptedSession* session,
@@ -120,6 +142,9 @@ struct _InfAdoptedSession {
 GType
 inf_adopted_session_get_type(void);
 
+GQuark
+inf_adopted_session_error_quark(void);
+
 InfIo*
 inf_adopted_session_get_io(InfAdoptedSession* session);
 
@@ -156,6 +181,21 @@ inf_adopted_session_write_request_info(InfAdoptedSession* session,
                                        xmlNodePtr xml,
                                        xmlNodePtr operation);
 
+void
+inf_adopted_session_request_to_binary(InfAdoptedSession* session,
+                                      InfAdoptedRequest* request,
+                                      InfAdoptedStateVector* diff_vec,
+                                      guint num,
+                                      GByteArray* data);
+
+InfAdoptedRequest*
+inf_adopted_session_request_from_binary(InfAdoptedSession* session,
+                                        const guchar* data,
+                                        gsize length,
+                                        InfAdoptedStateVector* diff_vec,
+                                        guint* num,
+                                        GError** error);
+
 G_END_DECLS
 
 #endif /* __INF_ADOPTED_SESSION_H__ */
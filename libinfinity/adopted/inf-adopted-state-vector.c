@@ -28,6 +28,12 @@
  * The #InfAdoptedStateVector represents a state in the current state space.
  * It basically maps user IDs to operation counts and states how many
  * operations of the corresponding user have already been performed.
+ *
+ * State vectors can be interned with inf_adopted_state_vector_intern(). All
+ * interned vectors with the same components are the same object, so that
+ * memory is shared between them and equality checks reduce to pointer
+ * comparisons. Interned vectors are immutable and reference counted;
+ * inf_adopted_state_vector_free() releases one reference.
  **/
 
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
@@ -43,35 +49,89 @@ G_DEFINE_BOXED_TYPE(InfAdoptedStateVector, inf_adopted_state_vector, inf_adopted
  * performed by each user. This number is called a timestamp, although it has
  * nothing to do with actual time. */
 
-typedef struct _InfAdoptedStateVectorComponent InfAdoptedStateVectorComponent;
-struct _InfAdoptedStateVectorComponent {
-  guint id;
-  guint n; /* timestamp */
+/* Number of components that are stored within the state vector itself,
+ * without an extra heap allocation. Most sessions only have a handful of
+ * users that ever made a request. */
+#define INF_ADOPTED_STATE_VECTOR_INLINE_SIZE 4
+
+/* The vector is stored as two parallel arrays sorted by user ID, so that
+ * loops over timestamps of vectors with the same set of users can be
+ * vectorized by the compiler. Components with timestamp 0 are never
+ * stored. If max_size exceeds INF_ADOPTED_STATE_VECTOR_INLINE_SIZE, then ids
+ * points to a heap block of 2 * max_size entries, and n to its second half.
+ * Otherwise they point to the inline arrays. */
+struct _InfAdoptedStateVector {
+  guint size;
+  guint max_size;
+  guint* ids;
+  guint* n; /* timestamps */
+
+  /* Zero for vectors that are not interned, and otherwise the number of
+   * references to the interned vector. The hash is only valid for interned
+   * vectors. */
+  gint ref_count;
+  guint hash;
+
+  guint inline_ids[INF_ADOPTED_STATE_VECTOR_INLINE_SIZE];
+  guint inline_n[INF_ADOPTED_STATE_VECTOR_INLINE_SIZE];
 };
 
-typedef struct _InfAdoptedStateVectorForeachData
-  InfAdoptedStateVectorForeachData;
-struct _InfAdoptedStateVectorForeachData {
-  InfAdoptedStateVectorForeachFunc func;
-  gpointer user_data;
-};
+static InfAdoptedStateVector*
+inf_adopted_state_vector_new_sized(guint size)
+{
+  InfAdoptedStateVector* vec;
 
-struct _InfAdoptedStateVector {
-  gsize size;
-  gsize max_size;
-  InfAdoptedStateVectorComponent* data;
-};
+  vec = g_slice_new(InfAdoptedStateVector);
+  vec->size = 0;
+  vec->ref_count = 0;
+
+  if(size <= INF_ADOPTED_STATE_VECTOR_INLINE_SIZE)
+  {
+    vec->max_size = INF_ADOPTED_STATE_VECTOR_INLINE_SIZE;
+    vec->ids = vec->inline_ids;
+    vec->n = vec->inline_n;
+  }
+  else
+  {
+    vec->max_size = size;
+    vec->ids = g_new(guint, 2 * size);
+    vec->n = vec->ids + size;
+  }
+
+  return vec;
+}
+
+static void
+inf_adopted_state_vector_reserve(InfAdoptedStateVector* vec,
+                                 guint size)
+{
+  guint max_size;
+  guint* block;
+
+  if(size <= vec->max_size)
+    return;
 
-static gsize
+  max_size = MAX(vec->max_size * 2, size);
+  block = g_new(guint, 2 * max_size);
+
+  memcpy(block, vec->ids, vec->size * sizeof(guint));
+  memcpy(block + max_size, vec->n, vec->size * sizeof(guint));
+
+  if(vec->ids != vec->inline_ids)
+    g_free(vec->ids);
+
+  vec->max_size = max_size;
+  vec->ids = block;
+  vec->n = block + max_size;
+}
+
+static guint
 inf_adopted_state_vector_find_insert_pos(const InfAdoptedStateVector* vec,
                                          guint id)
 {
-  gsize begin;
-  gsize end;
-  gsize middle;
-  InfAdoptedStateVectorComponent* comp;
-
-  if(vec->size == 0) return 0;
+  guint begin;
+  guint end;
+  guint middle;
 
   begin = 0;
   end = vec->size;
@@ -80,68 +140,244 @@ inf_adopted_state_vector_find_insert_pos(const InfAdoptedStateVector* vec,
   while(begin != end)
   {
     middle = begin + (end - begin) / 2;
-    comp = vec->data + middle;
-    if (comp->id == id)
-    {
+    if(vec->ids[middle] == id)
       return middle;
-    }
 
-    if (comp->id < id)
-    {
+    if(vec->ids[middle] < id)
       begin = middle + 1;
-    }
     else
-    {
       end = middle;
-    }
   }
+
   return begin;
 }
 
-static InfAdoptedStateVectorComponent*
-inf_adopted_state_vector_lookup(const InfAdoptedStateVector* vec,
-                                guint id)
+static void
+inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
+                                guint id,
+                                guint value,
+                                guint insert_pos)
 {
-  gsize pos;
+  g_assert(value > 0);
 
-  pos = inf_adopted_state_vector_find_insert_pos(vec, id);
-  if(pos < vec->size && vec->data[pos].id == id)
-    return vec->data + pos;
-  return NULL;
+  inf_adopted_state_vector_reserve(vec, vec->size + 1);
+
+  if(insert_pos < vec->size)
+  {
+    g_assert(vec->ids[insert_pos] != id);
+
+    g_memmove(
+      vec->ids + insert_pos + 1,
+      vec->ids + insert_pos,
+      (vec->size - insert_pos) * sizeof(guint)
+    );
+
+    g_memmove(
+      vec->n + insert_pos + 1,
+      vec->n + insert_pos,
+      (vec->size - insert_pos) * sizeof(guint)
+    );
+  }
+
+  ++vec->size;
+  vec->ids[insert_pos] = id;
+  vec->n[insert_pos] = value;
 }
 
-static InfAdoptedStateVectorComponent*
-inf_adopted_state_vector_insert(InfAdoptedStateVector* vec,
-                                guint id,
-                                guint value,
-                                gsize insert_pos)
+static void
+inf_adopted_state_vector_remove(InfAdoptedStateVector* vec,
+                                guint pos)
 {
-  InfAdoptedStateVectorComponent* comp;
+  g_assert(pos < vec->size);
 
-  if(vec->max_size <= vec->size)
+  --vec->size;
+  if(pos < vec->size)
   {
-    vec->max_size += 5;
-    vec->data = g_realloc(vec->data,
-                vec->max_size * sizeof(InfAdoptedStateVectorComponent));
+    g_memmove(
+      vec->ids + pos,
+      vec->ids + pos + 1,
+      (vec->size - pos) * sizeof(guint)
+    );
+
+    g_memmove(
+      vec->n + pos,
+      vec->n + pos + 1,
+      (vec->size - pos) * sizeof(guint)
+    );
   }
+}
 
-  comp = vec->data + insert_pos;
-  if(insert_pos < vec->size)
+/* Returns whether the two vectors have components for exactly the same set
+ * of users. In that case, loops can work on the timestamp arrays directly,
+ * without merging. */
+static gboolean
+inf_adopted_state_vector_same_ids(const InfAdoptedStateVector* first,
+                                  const InfAdoptedStateVector* second)
+{
+  if(first->size != second->size)
+    return FALSE;
+
+  return memcmp(first->ids, second->ids, first->size * sizeof(guint)) == 0;
+}
+
+static gboolean
+inf_adopted_state_vector_intern_equal(gconstpointer a,
+                                     gconstpointer b)
+{
+  const InfAdoptedStateVector* first;
+  const InfAdoptedStateVector* second;
+
+  first = (const InfAdoptedStateVector*)a;
+  second = (const InfAdoptedStateVector*)b;
+
+  if(!inf_adopted_state_vector_same_ids(first, second))
+    return FALSE;
+
+  return memcmp(first->n, second->n, first->size * sizeof(guint)) == 0;
+}
+
+/* Interned vectors are shared between all sessions, which might run in
+ * different threads, so access to the table is protected by a mutex. */
+static GMutex inf_adopted_state_vector_intern_mutex;
+static GHashTable* inf_adopted_state_vector_intern_table;
+
+static void
+inf_adopted_state_vector_unref(InfAdoptedStateVector* vec)
+{
+  gint ref_count;
+
+  /* Drop references that are not the last one without locking. The last
+   * reference is dropped with the table locked, so that it cannot be
+   * handed out again by inf_adopted_state_vector_intern() meanwhile. */
+  for(;;)
+  {
+    ref_count = g_atomic_int_get(&vec->ref_count);
+    if(ref_count == 1)
+      break;
+
+    if(g_atomic_int_compare_and_exchange(
+         &vec->ref_count, ref_count, ref_count - 1))
+    {
+      return;
+    }
+  }
+
+  g_mutex_lock(&inf_adopted_state_vector_intern_mutex);
+  if(g_atomic_int_dec_and_test(&vec->ref_count))
   {
-    gsize move_count;
+    g_hash_table_remove(inf_adopted_state_vector_intern_table, vec);
+    g_mutex_unlock(&inf_adopted_state_vector_intern_mutex);
 
-    g_assert(comp->id != id);
+    if(vec->ids != vec->inline_ids)
+      g_free(vec->ids);
 
-    move_count = (vec->size - insert_pos);
-    g_memmove(comp + 1, comp,
-              move_count * sizeof(InfAdoptedStateVectorComponent));
+    g_slice_free(InfAdoptedStateVector, vec);
   }
+  else
+  {
+    g_mutex_unlock(&inf_adopted_state_vector_intern_mutex);
+  }
+}
 
-  ++vec->size;
-  comp->id = id;
-  comp->n = value;
+/* Merges first and second into a new vector that contains all components of
+ * either of them. Components available in both are either added up or the
+ * larger one is taken, depending on add. */
+static InfAdoptedStateVector*
+inf_adopted_state_vector_union(const InfAdoptedStateVector* first,
+                               const InfAdoptedStateVector* second,
+                               gboolean add)
+{
+  InfAdoptedStateVector* result;
+  guint first_pos;
+  guint second_pos;
+  guint size;
+  guint i;
+
+  if(inf_adopted_state_vector_same_ids(first, second))
+  {
+    result = inf_adopted_state_vector_new_sized(first->size);
+    memcpy(result->ids, first->ids, first->size * sizeof(guint));
+
+    if(add)
+    {
+      for(i = 0; i < first->size; ++i)
+        result->n[i] = first->n[i] + second->n[i];
+    }
+    else
+    {
+      for(i = 0; i < first->size; ++i)
+        result->n[i] = MAX(first->n[i], second->n[i]);
+    }
+
+    result->size = first->size;
+    return result;
+  }
+
+  result = inf_adopted_state_vector_new_sized(first->size + second->size);
+  first_pos = 0;
+  second_pos = 0;
+  size = 0;
+
+  while(first_pos < first->size && second_pos < second->size)
+  {
+    if(first->ids[first_pos] < second->ids[second_pos])
+    {
+      result->ids[size] = first->ids[first_pos];
+      result->n[size] = first->n[first_pos];
+      ++first_pos;
+    }
+    else if(first->ids[first_pos] > second->ids[second_pos])
+    {
+      result->ids[size] = second->ids[second_pos];
+      result->n[size] = second->n[second_pos];
+      ++second_pos;
+    }
+    else
+    {
+      result->ids[size] = first->ids[first_pos];
+      if(add)
+        result->n[size] = first->n[first_pos] + second->n[second_pos];
+      else
+        result->n[size] = MAX(first->n[first_pos], second->n[second_pos]);
+
+      ++first_pos;
+      ++second_pos;
+    }
+
+    ++size;
+  }
+
+  /* At most one of the two has remaining components */
+  memcpy(
+    result->ids + size,
+    first->ids + first_pos,
+    (first->size - first_pos) * sizeof(guint)
+  );
+
+  memcpy(
+    result->n + size,
+    first->n + first_pos,
+    (first->size - first_pos) * sizeof(guint)
+  );
+
+  size += first->size - first_pos;
+
+  memcpy(
+    result->ids + size,
+    second->ids + second_pos,
+    (second->size - second_pos) * sizeof(guint)
+  );
+
+  memcpy(
+    result->n + size,
+    second->n + second_pos,
+    (second->size - second_pos) * sizeof(guint)
+  );
 
-  return comp;
+  size += second->size - second_pos;
+
+  result->size = size;
+  return result;
 }
 
 /**
@@ -167,21 +403,15 @@ inf_adopted_state_vector_error_quark(void)
 InfAdoptedStateVector*
 inf_adopted_state_vector_new(void)
 {
-  InfAdoptedStateVector* vec;
-
-  vec = g_slice_new(InfAdoptedStateVector);
-  vec->size = 0;
-  vec->max_size = 0;
-  vec->data = NULL;
-
-  return vec;
+  return inf_adopted_state_vector_new_sized(0);
 }
 
 /**
  * inf_adopted_state_vector_copy:
  * @vec: The #InfAdoptedStateVector to copy
  *
- * Returns a copy of @vec.
+ * Returns a copy of @vec. The copy is never interned, so it can be
+ * modified even if @vec is interned.
  *
  * Returns: (transfer full): A copy of @vec.
  **/
@@ -192,21 +422,11 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec)
 
   g_return_val_if_fail(vec != NULL, NULL);
 
-  new_vec = g_slice_new(InfAdoptedStateVector);
+  new_vec = inf_adopted_state_vector_new_sized(vec->size);
   new_vec->size = vec->size;
-  new_vec->max_size = vec->max_size;
 
-  if(new_vec->max_size == 0)
-  {
-    new_vec->data = NULL;
-  }
-  else
-  {
-    new_vec->data =
-      g_malloc(new_vec->max_size * sizeof(InfAdoptedStateVectorComponent));
-    memcpy(new_vec->data, vec->data,
-           new_vec->size * sizeof(InfAdoptedStateVectorComponent));
-  }
+  memcpy(new_vec->ids, vec->ids, vec->size * sizeof(guint));
+  memcpy(new_vec->n, vec->n, vec->size * sizeof(guint));
 
   return new_vec;
 }
@@ -216,17 +436,137 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec)
  * @vec: A #InfAdoptedStateVector.
  *
  * Frees a state vector allocated by inf_adopted_state_vector_new() or
- * inf_adopted_state_vector_copy().
+ * inf_adopted_state_vector_copy(). For a vector returned by
+ * inf_adopted_state_vector_intern(), this releases the reference obtained
+ * with it.
  **/
 void
 inf_adopted_state_vector_free(InfAdoptedStateVector* vec)
 {
   g_return_if_fail(vec != NULL);
 
-  g_free(vec->data);
+  if(vec->ref_count > 0)
+  {
+    inf_adopted_state_vector_unref(vec);
+    return;
+  }
+
+  if(vec->ids != vec->inline_ids)
+    g_free(vec->ids);
+
   g_slice_free(InfAdoptedStateVector, vec);
 }
 
+/**
+ * inf_adopted_state_vector_intern:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Returns the interned state vector with the same components as @vec. If
+ * there is no such vector yet, a copy of @vec is interned. If @vec is
+ * interned itself, then it is returned with an additional reference.
+ *
+ * The returned vector must not be modified. It can be shared between
+ * threads.
+ *
+ * Returns: (transfer full): The interned #InfAdoptedStateVector equal to
+ * @vec. Free with inf_adopted_state_vector_free() when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_intern(const InfAdoptedStateVector* vec)
+{
+  InfAdoptedStateVector* interned;
+
+  g_return_val_if_fail(vec != NULL, NULL);
+
+  /* The caller holds a reference, so it cannot drop to zero meanwhile */
+  interned = (InfAdoptedStateVector*)vec;
+  if(interned->ref_count > 0)
+  {
+    g_atomic_int_inc(&interned->ref_count);
+    return interned;
+  }
+
+  g_mutex_lock(&inf_adopted_state_vector_intern_mutex);
+
+  if(inf_adopted_state_vector_intern_table == NULL)
+  {
+    inf_adopted_state_vector_intern_table = g_hash_table_new(
+      (GHashFunc)inf_adopted_state_vector_hash,
+      inf_adopted_state_vector_intern_equal
+    );
+  }
+
+  interned = g_hash_table_lookup(inf_adopted_state_vector_intern_table, vec);
+  if(interned != NULL)
+  {
+    g_atomic_int_inc(&interned->ref_count);
+  }
+  else
+  {
+    interned = inf_adopted_state_vector_copy((InfAdoptedStateVector*)vec);
+    interned->hash = inf_adopted_state_vector_hash(vec);
+    interned->ref_count = 1;
+
+    g_hash_table_add(inf_adopted_state_vector_intern_table, interned);
+  }
+
+  g_mutex_unlock(&inf_adopted_state_vector_intern_mutex);
+  return interned;
+}
+
+/**
+ * inf_adopted_state_vector_get_intern_statistics:
+ * @n_vectors: (out) (allow-none): Location to store the number of interned
+ * vectors, or %NULL.
+ * @n_references: (out) (allow-none): Location to store the total number of
+ * references to interned vectors, or %NULL.
+ * @n_bytes: (out) (allow-none): Location to store the memory used by the
+ * interned vectors, in bytes, or %NULL.
+ *
+ * Reports how much the interned state vectors are shared. Without
+ * interning, each reference would have been a vector of its own.
+ **/
+void
+inf_adopted_state_vector_get_intern_statistics(guint* n_vectors,
+                                               guint* n_references,
+                                               gsize* n_bytes)
+{
+  GHashTableIter iter;
+  gpointer key;
+  InfAdoptedStateVector* vec;
+  guint vectors;
+  guint references;
+  gsize bytes;
+
+  vectors = 0;
+  references = 0;
+  bytes = 0;
+
+  g_mutex_lock(&inf_adopted_state_vector_intern_mutex);
+
+  if(inf_adopted_state_vector_intern_table != NULL)
+  {
+    g_hash_table_iter_init(&iter, inf_adopted_state_vector_intern_table);
+    while(g_hash_table_iter_next(&iter, &key, NULL))
+    {
+      vec = (InfAdoptedStateVector*)key;
+
+      ++vectors;
+      references += g_atomic_int_get(&vec->ref_count);
+
+      bytes += sizeof(InfAdoptedStateVector);
+      if(vec->ids != vec->inline_ids)
+        bytes += 2 * vec->max_size * sizeof(guint);
+    }
+  }
+
+  g_mutex_unlock(&inf_adopted_state_vector_intern_mutex);
+
+  if(n_vectors != NULL) *n_vectors = vectors;
+  if(n_references != NULL) *n_references = references;
+  if(n_bytes != NULL) *n_bytes = bytes;
+}
+
 /**
  * inf_adopted_state_vector_get:
  * @vec: A #InfAdoptedStateVector.
@@ -241,16 +581,15 @@ guint
 inf_adopted_state_vector_get(const InfAdoptedStateVector* vec,
                              guint id)
 {
-  InfAdoptedStateVectorComponent* comp;
+  guint pos;
 
   g_return_val_if_fail(vec != NULL, 0);
 
-  comp = inf_adopted_state_vector_lookup(vec, id);
-
-  if(comp == NULL)
-    return 0;
+  pos = inf_adopted_state_vector_find_insert_pos(vec, id);
+  if(pos < vec->size && vec->ids[pos] == id)
+    return vec->n[pos];
 
-  return comp->n;
+  return 0;
 }
 
 /**
@@ -259,22 +598,30 @@ inf_adopted_state_vector_get(const InfAdoptedStateVector* vec,
  * @id: The component to change.
  * @value: The value to set the component to.
  *
- * Sets the given component of @vec to @value.
+ * Sets the given component of @vec to @value. @vec must not be interned.
  **/
 void
 inf_adopted_state_vector_set(InfAdoptedStateVector* vec,
                              guint id,
                              guint value)
 {
-  gsize pos;
+  guint pos;
 
   g_return_if_fail(vec != NULL);
+  g_return_if_fail(vec->ref_count == 0);
 
   pos = inf_adopted_state_vector_find_insert_pos(vec, id);
-  if(pos < vec->size && vec->data[pos].id == id)
-    vec->data[pos].n = value;
-  else
+  if(pos < vec->size && vec->ids[pos] == id)
+  {
+    if(value > 0)
+      vec->n[pos] = value;
+    else
+      inf_adopted_state_vector_remove(vec, pos);
+  }
+  else if(value > 0)
+  {
     inf_adopted_state_vector_insert(vec, id, value, pos);
+  }
 }
 
 /**
@@ -285,30 +632,32 @@ inf_adopted_state_vector_set(InfAdoptedStateVector* vec,
  *
  * Adds @value to the current value of @component. @value may be negative in
  * which case the current value is actually decreased. Make sure to not drop
- * below zero this way.
+ * below zero this way. @vec must not be interned.
  **/
 void
 inf_adopted_state_vector_add(InfAdoptedStateVector* vec,
                              guint id,
                              gint value)
 {
-  InfAdoptedStateVectorComponent* comp;
-  gsize pos;
+  guint pos;
 
   g_return_if_fail(vec != NULL);
+  g_return_if_fail(vec->ref_count == 0);
 
   pos = inf_adopted_state_vector_find_insert_pos(vec, id);
-  comp = vec->data + pos;
-  if(pos == vec->size || comp->id != id)
+  if(pos == vec->size || vec->ids[pos] != id)
   {
-    g_assert(value > 0);
-    comp = inf_adopted_state_vector_insert(vec, id, value, pos);
+    g_assert(value >= 0);
+    if(value > 0)
+      inf_adopted_state_vector_insert(vec, id, value, pos);
   }
   else
   {
-    g_assert(value > 0 || comp->n >= (guint)-value);
+    g_assert(value > 0 || vec->n[pos] >= (guint)-value);
 
-    comp->n += value;
+    vec->n[pos] += value;
+    if(vec->n[pos] == 0)
+      inf_adopted_state_vector_remove(vec, pos);
   }
 }
 
@@ -326,15 +675,13 @@ inf_adopted_state_vector_foreach(const InfAdoptedStateVector* vec,
                                  InfAdoptedStateVectorForeachFunc func,
                                  gpointer user_data)
 {
-  gsize pos;
+  guint pos;
 
   g_return_if_fail(vec != NULL);
   g_return_if_fail(func != NULL);
 
   for(pos = 0; pos < vec->size; ++pos)
-  {
-    func(vec->data[pos].id, vec->data[pos].n, user_data);
-  }
+    func(vec->ids[pos], vec->n[pos], user_data);
 }
 
 /**
@@ -352,83 +699,69 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second)
 {
-  gsize first_pos;
-  gsize second_pos;
-  InfAdoptedStateVectorComponent* first_comp;
-  InfAdoptedStateVectorComponent* second_comp;
+  guint size;
+  guint pos;
 
   g_return_val_if_fail(first != NULL, 0);
   g_return_val_if_fail(second != NULL, 0);
 
-  first_pos = 0;
-  second_pos = 0;
-
-  /* TODO: Some test that verifies that this function
-   * provides strict weak ordering */
+  if(first == second)
+    return 0;
 
-  for(;;)
-  {
-    /* Jump over components whose value is 0. This is necessary because
-     * components that are not in the sequence are treated like having the
-     * value zero and should be compared equal. */
-    while(first_pos < first->size)
-    {
-      first_comp = first->data + first_pos;
-      if(first_comp->n > 0)
-        break;
-      ++first_pos;
-    }
-    
-    while(second_pos < second->size)
-    {
-      second_comp = second->data + second_pos;
-      if(second_comp->n > 0)
-        break;
-      ++second_pos;
-    }
+  /* Since components with value 0 are not stored, vectors compare equal
+   * exactly if their arrays are equal. Otherwise, the first differing
+   * component decides, comparing the ID first and then the timestamp. */
+  size = MIN(first->size, second->size);
 
-    if(first_pos == first->size || second_pos == second->size)
-    {
+  for(pos = 0; pos < size; ++pos)
+    if(first->ids[pos] != second->ids[pos] || first->n[pos] != second->n[pos])
       break;
-    }
-
-    /* first_comp and second_comp are set here */
-
-    if(first_comp->id < second_comp->id)
-    {
-      return -1;
-    }
-    else if(first_comp->id > second_comp->id)
-    {
-      return 1;
-    }
-    else if(first_comp->n < second_comp->n)
-    {
-      return -1;
-    }
-    else if(first_comp->n > second_comp->n)
-    {
-      return 1;
-    }
-
-    /* Component matches, check next */
 
-    ++first_pos;
-    ++second_pos;
-  }
-
-  if(first_pos == first->size && second_pos == second->size)
+  if(pos < size)
   {
-    return 0; 
+    if(first->ids[pos] != second->ids[pos])
+      return first->ids[pos] < second->ids[pos] ? -1 : 1;
+    return first->n[pos] < second->n[pos] ? -1 : 1;
   }
-  else if(first_pos == first->size)
-  {
+
+  if(first->size == second->size)
+    return 0;
+  else if(first->size < second->size)
     return -1;
-  }
   else
-  {
     return 1;
+}
+
+/**
+ * inf_adopted_state_vector_hash:
+ * @vec: A #InfAdoptedStateVector.
+ *
+ * Computes a hash value for @vec, so that vectors comparing equal by
+ * inf_adopted_state_vector_compare() have the same hash value. For interned
+ * vectors, the hash value is computed only once.
+ *
+ * Returns: A hash value for @vec.
+ **/
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec)
+{
+  guint hash;
+  guint pos;
+
+  g_return_val_if_fail(vec != NULL, 0);
+
+  if(vec->ref_count > 0)
+    return vec->hash;
+
+  /* FNV-1a over all components */
+  hash = 2166136261u;
+  for(pos = 0; pos < vec->size; ++pos)
+  {
+    hash = (hash ^ vec->ids[pos]) * 16777619u;
+    hash = (hash ^ vec->n[pos]) * 16777619u;
   }
+
+  return hash;
 }
 
 /**
@@ -447,53 +780,48 @@ gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second)
 {
-  gsize first_pos;
-  gsize second_pos;
-  InfAdoptedStateVectorComponent* first_comp;
-  InfAdoptedStateVectorComponent* second_comp;
+  guint first_pos;
+  guint second_pos;
+  guint violated;
 
   g_return_val_if_fail(first != NULL, FALSE);
   g_return_val_if_fail(second != NULL, FALSE);
 
-  first_pos = 0;
-  second_pos = 0;
+  /* All components of first are nonzero, so each of them needs to be
+   * present in second as well. */
+  if(first->size > second->size)
+    return FALSE;
 
-  while(first_pos < first->size)
+  if(inf_adopted_state_vector_same_ids(first, second))
   {
-    first_comp = first->data + first_pos++;
+    /* No early exit, so that this loop can be vectorized */
+    violated = 0;
+    for(first_pos = 0; first_pos < first->size; ++first_pos)
+      violated |= (first->n[first_pos] > second->n[first_pos]);
+
+    return violated == 0;
+  }
 
-    if(second_pos == second->size)
+  second_pos = 0;
+  for(first_pos = 0; first_pos < first->size; ++first_pos)
+  {
+    while(second_pos < second->size &&
+          second->ids[second_pos] < first->ids[first_pos])
     {
-      /* That component is not contained in second (thus 0) */
-      if(first_comp->n > 0)
-        return FALSE;
+      ++second_pos;
     }
-    else
+
+    /* That component is not contained in second (thus 0) */
+    if(second_pos == second->size ||
+       second->ids[second_pos] != first->ids[first_pos])
     {
-      second_comp = second->data + second_pos;
-      while(second_comp != NULL && first_comp->id > second_comp->id)
-      {
-        ++second_pos;
-        if(second_pos != second->size)
-          second_comp = second->data + second_pos;
-        else
-          second_comp = NULL;
-      }
-
-      if(second_comp == NULL || first_comp->id < second_comp->id)
-      {
-        /* That component is not contained in second (thus 0) */
-        if(first_comp->n > 0)
-          return FALSE;
-        else
-          /* 0 <= 0 */
-          continue;
-      }
-
-      g_assert(first_comp->id == second_comp->id);
-      if(first_comp->n > second_comp->n)
-        return FALSE;
+      return FALSE;
     }
+
+    if(first->n[first_pos] > second->n[second_pos])
+      return FALSE;
+
+    ++second_pos;
   }
 
   return TRUE;
@@ -525,98 +853,19 @@ inf_adopted_state_vector_causally_before_inc(
   const InfAdoptedStateVector* second,
   guint inc_component)
 {
-  gsize first_pos;
-  gsize second_pos;
-  gboolean inc_comp_seen;
-
-  InfAdoptedStateVectorComponent* first_comp;
-  InfAdoptedStateVectorComponent* second_comp;
-  InfAdoptedStateVectorComponent inc_comp;
-
   g_return_val_if_fail(first != NULL, FALSE);
   g_return_val_if_fail(second != NULL, FALSE);
 
-  first_pos = 0;
-  second_pos = 0;
-  inc_comp.id = inc_component;
-  inc_comp_seen = FALSE;
-
-  while(first_pos < first->size || !inc_comp_seen)
+  /* Increasing a single component of first by one keeps the relation for
+   * all other components, and for the increased one it is equivalent to
+   * the original component being strictly less. */
+  if(inf_adopted_state_vector_get(first, inc_component) >=
+     inf_adopted_state_vector_get(second, inc_component))
   {
-    /* Set first_comp as if there was inc_component increased by one */
-    if(!inc_comp_seen)
-    {
-      if(first_pos < first->size)
-      {
-        first_comp = first->data + first_pos;
-        if(first_comp->id < inc_component)
-        {
-          ++ first_pos;
-        }
-        else if(first_comp->id == inc_component)
-        {
-          inc_comp.n = first_comp->n + 1;
-          first_comp = &inc_comp;
-          inc_comp_seen = TRUE;
-          ++ first_pos;
-        }
-        else
-        {
-          inc_comp.n = 1;
-          first_comp = &inc_comp;
-          inc_comp_seen = TRUE;
-        }
-      }
-      else
-      {
-        /* inc_comp is the only component of first */
-        inc_comp.n = 1;
-        first_comp = &inc_comp;
-        inc_comp_seen = TRUE;
-      }
-    }
-    else
-    {
-      /* inc_comp already handled, business as usual */
-      first_comp = first->data + first_pos;
-      ++ first_pos;
-    }
-
-    if(second_pos == second->size)
-    {
-      /* That component is not contained in second (thus 0) */
-      if(first_comp->n > 0)
-        return FALSE;
-    }
-    else
-    {
-      second_comp = second->data + second_pos;
-      while(second_comp != NULL && first_comp->id > second_comp->id)
-      {
-        ++second_pos;
-        if(second_pos != second->size)
-          second_comp = second->data + second_pos;
-        else
-          second_comp = NULL;
-      }
-
-      if(second_comp == NULL || first_comp->id < second_comp->id)
-      {
-        /* That component is not contained in second (thus 0) */
-        if(first_comp->n > 0)
-          return FALSE;
-        else
-          /* 0 <= 0 */
-          continue;
-      }
-
-      g_assert(first_comp->id == second_comp->id);
-      if(first_comp->n > second_comp->n)
-        return FALSE;
-    }
+    return FALSE;
   }
 
-  return TRUE;
+  return inf_adopted_state_vector_causally_before(first, second);
 }
 
 /**
@@ -635,7 +884,7 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second)
 {
-  gsize n;
+  guint n;
   guint first_sum;
   guint second_sum;
 
@@ -648,14 +897,107 @@ inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
   second_sum = 0;
 
   for(n = 0; n < first->size; ++ n)
-    first_sum += first->data[n].n;
+    first_sum += first->n[n];
   for(n = 0; n < second->size; ++ n)
-    second_sum += second->data[n].n;
+    second_sum += second->n[n];
 
   g_assert(second_sum >= first_sum);
   return second_sum - first_sum;
 }
 
+/**
+ * inf_adopted_state_vector_least_common_successor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector v so that both @first and @second are causally
+ * before v and so that there is no other state vector with the same property
+ * that is causally before v. Each component of v is the maximum of the
+ * corresponding components of @first and @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector. Free with
+ * inf_adopted_state_vector_free() when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
+
+  return inf_adopted_state_vector_union(first, second, FALSE);
+}
+
+/**
+ * inf_adopted_state_vector_least_common_predecessor:
+ * @first: A #InfAdoptedStateVector.
+ * @second: Another #InfAdoptedStateVector.
+ *
+ * Returns a new state vector v so that v is causally before both @first and
+ * @second and so that there is no other state vector with the same property
+ * that v is causally before. Each component of v is the minimum of the
+ * corresponding components of @first and @second.
+ *
+ * Returns: (transfer full): A new #InfAdoptedStateVector. Free with
+ * inf_adopted_state_vector_free() when no longer needed.
+ **/
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second)
+{
+  InfAdoptedStateVector* result;
+  guint first_pos;
+  guint second_pos;
+  guint size;
+
+  g_return_val_if_fail(first != NULL, NULL);
+  g_return_val_if_fail(second != NULL, NULL);
+
+  if(inf_adopted_state_vector_same_ids(first, second))
+  {
+    result = inf_adopted_state_vector_new_sized(first->size);
+    memcpy(result->ids, first->ids, first->size * sizeof(guint));
+
+    for(size = 0; size < first->size; ++size)
+      result->n[size] = MIN(first->n[size], second->n[size]);
+
+    result->size = first->size;
+    return result;
+  }
+
+  /* Only components present in both vectors are nonzero in the result */
+  result = inf_adopted_state_vector_new_sized(MIN(first->size, second->size));
+  first_pos = 0;
+  second_pos = 0;
+  size = 0;
+
+  while(first_pos < first->size && second_pos < second->size)
+  {
+    if(first->ids[first_pos] < second->ids[second_pos])
+    {
+      ++first_pos;
+    }
+    else if(first->ids[first_pos] > second->ids[second_pos])
+    {
+      ++second_pos;
+    }
+    else
+    {
+      result->ids[size] = first->ids[first_pos];
+      result->n[size] = MIN(first->n[first_pos], second->n[second_pos]);
+
+      ++first_pos;
+      ++second_pos;
+      ++size;
+    }
+  }
+
+  result->size = size;
+  return result;
+}
+
 /**
  * inf_adopted_state_vector_to_string:
  * @vec: A #InfAdoptedStateVector.
@@ -669,8 +1011,7 @@ gchar*
 inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec)
 {
   GString* str;
-  gsize pos;
-  InfAdoptedStateVectorComponent* component;
+  guint pos;
 
   g_return_val_if_fail(vec != NULL, NULL);
 
@@ -678,15 +1019,10 @@ inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec)
 
   for(pos = 0; pos < vec->size; ++pos)
   {
-    component = vec->data + pos;
-
-    if(component->n > 0)
-    {
-      if(str->len > 0)
-        g_string_append_c(str, ';');
+    if(str->len > 0)
+      g_string_append_c(str, ';');
 
-      g_string_append_printf(str, "%u:%u", component->id, component->n);
-    }
+    g_string_append_printf(str, "%u:%u", vec->ids[pos], vec->n[pos]);
   }
 
   return g_string_free(str, FALSE);
@@ -707,9 +1043,10 @@ inf_adopted_state_vector_from_string(const gchar* str,
                                      GError** error)
 {
   InfAdoptedStateVector* vec;
+  GHashTable* zero_ids;
   const char* strpos;
   char* endpos;
-  gsize pos;
+  guint pos;
   guint id;
   guint n;
 
@@ -718,6 +1055,10 @@ inf_adopted_state_vector_from_string(const gchar* str,
   vec = inf_adopted_state_vector_new();
   strpos = str;
 
+  /* IDs with a zero component, which are not stored in vec, so that they
+   * are detected as duplicates as well. Only created when needed. */
+  zero_ids = NULL;
+
   while(*strpos)
   {
     id = strtoul(strpos, &endpos, 10);
@@ -730,12 +1071,15 @@ inf_adopted_state_vector_from_string(const gchar* str,
         _("Expected \":\" after ID")
       );
 
+      if(zero_ids != NULL) g_hash_table_destroy(zero_ids);
       inf_adopted_state_vector_free(vec);
       return NULL;
     }
 
     pos = inf_adopted_state_vector_find_insert_pos(vec, id);
-    if(pos < vec->size && vec->data[pos].id == id)
+    if((pos < vec->size && vec->ids[pos] == id) ||
+       (zero_ids != NULL &&
+        g_hash_table_contains(zero_ids, GUINT_TO_POINTER(id))))
     {
       g_set_error(
         error,
@@ -745,6 +1089,7 @@ inf_adopted_state_vector_from_string(const gchar* str,
         id
       );
 
+      if(zero_ids != NULL) g_hash_table_destroy(zero_ids);
       inf_adopted_state_vector_free(vec);
       return NULL;
     }
@@ -762,15 +1107,27 @@ inf_adopted_state_vector_from_string(const gchar* str,
         id
       );
 
+      if(zero_ids != NULL) g_hash_table_destroy(zero_ids);
       inf_adopted_state_vector_free(vec);
       return NULL;
     }
 
-    inf_adopted_state_vector_insert(vec, id, n, pos);
+    if(n > 0)
+    {
+      inf_adopted_state_vector_insert(vec, id, n, pos);
+    }
+    else
+    {
+      if(zero_ids == NULL)
+        zero_ids = g_hash_table_new(NULL, NULL);
+      g_hash_table_add(zero_ids, GUINT_TO_POINTER(id));
+    }
+
     strpos = endpos;
     if(*strpos != '\0') ++ strpos; /* step over ';' */
   }
 
+  if(zero_ids != NULL) g_hash_table_destroy(zero_ids);
   return vec;
 }
 
@@ -792,10 +1149,9 @@ gchar*
 inf_adopted_state_vector_to_string_diff(const InfAdoptedStateVector* vec,
                                         const InfAdoptedStateVector* orig)
 {
-  gsize vec_pos;
-  gsize orig_pos;
-  InfAdoptedStateVectorComponent* vec_comp;
-  InfAdoptedStateVectorComponent* orig_comp;
+  guint vec_pos;
+  guint orig_pos;
+  guint diff;
   GString* str;
 
   g_return_val_if_fail(vec != NULL, NULL);
@@ -806,64 +1162,31 @@ inf_adopted_state_vector_to_string_diff(const InfAdoptedStateVector* vec,
     NULL
   );
 
-  g_assert(vec->data != NULL || vec->size == 0);
-
   str = g_string_sized_new(vec->size * 12);
-  vec_pos = 0;
+  orig_pos = 0;
 
-  for(orig_pos = 0; orig_pos < orig->size; ++orig_pos)
+  /* Since orig is causally before vec, every component of orig is also
+   * present in vec. Components of vec without counterpart in orig are
+   * implicitely zero there. */
+  for(vec_pos = 0; vec_pos < vec->size; ++vec_pos)
   {
-    orig_comp = orig->data + orig_pos;
-    if(orig_comp->n == 0) continue;
-
-    g_assert(vec_pos < vec->size);
-    vec_comp = vec->data + vec_pos;
-    while(vec_comp->id < orig_comp->id)
-    {
-      /* There does not seem to be a corresponding entry in orig_comp, so
-       * it is implicitely zero. */
-      if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(str, "%u:%u", vec_comp->id, vec_comp->n);
-
-      ++vec_pos;
-
-      g_assert(vec_pos < vec->size);
-      vec_comp = vec->data + vec_pos;
-    }
-
-    /* Otherwise the inf_adopted_state_vector_causally_before test above
-     * should not have passed since orig_comp->n is not 0. */
-    g_assert(vec_comp->id == orig_comp->id);
-    g_assert(vec_comp->n >= orig_comp->n);
+    diff = vec->n[vec_pos];
 
-    if(vec_comp->n > orig_comp->n)
+    if(orig_pos < orig->size && orig->ids[orig_pos] == vec->ids[vec_pos])
     {
-      if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(
-        str,
-        "%u:%u",
-        vec_comp->id,
-        vec_comp->n - orig_comp->n
-      );
+      g_assert(vec->n[vec_pos] >= orig->n[orig_pos]);
+      diff -= orig->n[orig_pos];
+      ++orig_pos;
     }
 
-    ++vec_pos;
-  }
-
-  /* All remaining components in vec have no counterpart in orig, meaning
-   * their values in orig are implicitely zero. */
-  while(vec_pos < vec->size)
-  {
-    vec_comp = vec->data + vec_pos;
-    if (vec_comp->n > 0)
+    if(diff > 0)
     {
       if(str->len > 0) g_string_append_c(str, ';');
-      g_string_append_printf(str, "%u:%u", vec_comp->id, vec_comp->n);
+      g_string_append_printf(str, "%u:%u", vec->ids[vec_pos], diff);
     }
-
-    ++vec_pos;
   }
 
+  g_assert(orig_pos == orig->size);
   return g_string_free(str, FALSE);
 }
 
@@ -885,66 +1208,17 @@ inf_adopted_state_vector_from_string_diff(const gchar* str,
                                           const InfAdoptedStateVector* orig,
                                           GError** error)
 {
+  InfAdoptedStateVector* diff;
   InfAdoptedStateVector* vec;
-  gsize vec_pos;
-  gsize orig_pos;
-  InfAdoptedStateVectorComponent* vec_comp;
-  InfAdoptedStateVectorComponent* orig_comp;
 
   g_return_val_if_fail(str != NULL, NULL);
   g_return_val_if_fail(orig != NULL, NULL);
 
-  vec = inf_adopted_state_vector_from_string(str, error);
-  if(vec == NULL) return NULL;
+  diff = inf_adopted_state_vector_from_string(str, error);
+  if(diff == NULL) return NULL;
 
-  vec_pos = 0;
-
-  for(orig_pos = 0; orig_pos < orig->size; ++orig_pos)
-  {
-    orig_comp = orig->data + orig_pos;
-    if(orig_comp->n == 0) continue;
-
-    if(vec_pos == vec->size)
-    {
-      inf_adopted_state_vector_insert(
-        vec,
-        orig_comp->id,
-        orig_comp->n,
-        vec_pos
-      );
-    }
-    else
-    {
-      vec_comp = vec->data + vec_pos;
-      while(vec_comp->id < orig_comp->id)
-      {
-        ++vec_pos;
-        if(vec_pos < vec->size)
-        {
-          vec_comp = vec->data + vec_pos;
-        }
-        else
-        {
-          break;
-        }
-      }
-
-      if(vec_comp->id == orig_comp->id)
-      {
-        vec_comp->n += orig_comp->n;
-        ++vec_pos;
-      }
-      else
-      {
-        inf_adopted_state_vector_insert(
-          vec,
-          orig_comp->id,
-          orig_comp->n,
-          vec_pos
-        );
-      }
-    }
-  }
+  vec = inf_adopted_state_vector_union(orig, diff, TRUE);
+  inf_adopted_state_vector_free(diff);
 
   return vec;
 }
@@ -78,6 +78,14 @@ inf_adopted_state_vector_copy(InfAdoptedStateVector* vec);
 void
 inf_adopted_state_vector_free(InfAdoptedStateVector* vec);
 
+InfAdoptedStateVector*
+inf_adopted_state_vector_intern(const InfAdoptedStateVector* vec);
+
+void
+inf_adopted_state_vector_get_intern_statistics(guint* n_vectors,
+                                               guint* n_references,
+                                               gsize* n_bytes);
+
 guint
 inf_adopted_state_vector_get(const InfAdoptedStateVector* vec,
                              guint id);
@@ -101,6 +109,9 @@ int
 inf_adopted_state_vector_compare(const InfAdoptedStateVector* first,
                                  const InfAdoptedStateVector* second);
 
+guint
+inf_adopted_state_vector_hash(const InfAdoptedStateVector* vec);
+
 gboolean
 inf_adopted_state_vector_causally_before(const InfAdoptedStateVector* first,
                                          const InfAdoptedStateVector* second);
@@ -115,6 +126,16 @@ guint
 inf_adopted_state_vector_vdiff(const InfAdoptedStateVector* first,
                                const InfAdoptedStateVector* second);
 
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_successor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
+InfAdoptedStateVector*
+inf_adopted_state_vector_least_common_predecessor(
+  const InfAdoptedStateVector* first,
+  const InfAdoptedStateVector* second);
+
 gchar*
 inf_adopted_state_vector_to_string(const InfAdoptedStateVector* vec);
 
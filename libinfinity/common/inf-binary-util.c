@@ -0,0 +1,296 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-binary-util
+ * @title: Binary utility functions
+ * @short_description: Helper functions to read and write compact binary data
+ * @include: libinfinity/common/inf-binary-util.h
+ * @stability: Unstable
+ *
+ * Some messages, such as requests in an #InfAdoptedSession, can be
+ * transmitted in a compact binary form instead of as XML. These functions
+ * write and read the basic data types of such messages. Unsigned numbers are
+ * written as variable-length integers using seven bits per byte, so that
+ * small numbers take only a single byte. Signed numbers are mapped to
+ * unsigned ones first so that small negative numbers are short as well.
+ * Strings are prefixed by their length in bytes.
+ *
+ * The reading functions take a pointer to the current read position, which
+ * is advanced past the value that has been read, and a pointer to the end of
+ * the data. They never read beyond the end, so that they can safely be used
+ * on data received from the network.
+ **/
+
+#include <libinfinity/common/inf-binary-util.h>
+#include <libinfinity/common/inf-error.h>
+#include <libinfinity/inf-i18n.h>
+
+/**
+ * inf_binary_util_write_uint:
+ * @data: A #GByteArray to append to.
+ * @value: The value to write.
+ *
+ * Appends @value to @data as a variable-length integer. Values smaller
+ * than 128 take one byte, and no value takes more than five bytes.
+ */
+void
+inf_binary_util_write_uint(GByteArray* data,
+                           guint value)
+{
+  guint8 buf[5];
+  guint len;
+
+  g_return_if_fail(data != NULL);
+
+  len = 0;
+  while(value >= 0x80)
+  {
+    buf[len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+
+  buf[len++] = value;
+  g_byte_array_append(data, buf, len);
+}
+
+/**
+ * inf_binary_util_write_int:
+ * @data: A #GByteArray to append to.
+ * @value: The value to write.
+ *
+ * Appends @value to @data as a variable-length integer. Numbers with a small
+ * absolute value take one byte.
+ */
+void
+inf_binary_util_write_int(GByteArray* data,
+                          gint value)
+{
+  g_return_if_fail(data != NULL);
+
+  /* Map 0, -1, 1, -2, 2, ... to 0, 1, 2, 3, 4, ... */
+  inf_binary_util_write_uint(
+    data,
+    ((guint)value << 1) ^ (guint)(value < 0 ? -1 : 0)
+  );
+}
+
+/**
+ * inf_binary_util_write_string:
+ * @data: A #GByteArray to append to.
+ * @str: (array length=bytes): The string to write.
+ * @bytes: The length of @str, in bytes.
+ *
+ * Appends @bytes to @data as an unsigned number, followed by the first
+ * @bytes bytes of @str. @str does not need to be nul-terminated.
+ */
+void
+inf_binary_util_write_string(GByteArray* data,
+                             const gchar* str,
+                             gsize bytes)
+{
+  g_return_if_fail(data != NULL);
+  g_return_if_fail(str != NULL || bytes == 0);
+  g_return_if_fail(bytes <= G_MAXUINT);
+
+  inf_binary_util_write_uint(data, bytes);
+  g_byte_array_append(data, (const guint8*)str, bytes);
+}
+
+/**
+ * inf_binary_util_read_uint:
+ * @data: (inout): Pointer to the current read position.
+ * @end: Pointer to the end of the data.
+ * @value: (out): Location to store the value.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a number written with inf_binary_util_write_uint() and advances
+ * @data past it. If the data ends before the number does, or if the number
+ * does not fit into an unsigned integer, then the function returns %FALSE
+ * and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_binary_util_read_uint(const guchar** data,
+                          const guchar* end,
+                          guint* value,
+                          GError** error)
+{
+  const guchar* pos;
+  guint result;
+  guint shift;
+
+  g_return_val_if_fail(data != NULL, FALSE);
+  g_return_val_if_fail(*data != NULL, FALSE);
+  g_return_val_if_fail(end != NULL, FALSE);
+  g_return_val_if_fail(value != NULL, FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  pos = *data;
+  result = 0;
+
+  for(shift = 0; pos < end; shift += 7)
+  {
+    /* The fifth byte may only carry the four most significant bits */
+    if(shift == 28 && (*pos & 0xf0) != 0)
+      break;
+
+    result |= (guint)(*pos & 0x7f) << shift;
+    if((*pos++ & 0x80) == 0)
+    {
+      *data = pos;
+      *value = result;
+      return TRUE;
+    }
+  }
+
+  g_set_error(
+    error,
+    inf_request_error_quark(),
+    INF_REQUEST_ERROR_INVALID_NUMBER,
+    "%s",
+    pos < end ? _("Binary number causes overflow")
+              : _("Binary data ends within a number")
+  );
+
+  return FALSE;
+}
+
+/**
+ * inf_binary_util_read_int:
+ * @data: (inout): Pointer to the current read position.
+ * @end: Pointer to the end of the data.
+ * @value: (out): Location to store the value.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a number written with inf_binary_util_write_int() and advances
+ * @data past it. If the number cannot be read, then the function returns
+ * %FALSE and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_binary_util_read_int(const guchar** data,
+                         const guchar* end,
+                         gint* value,
+                         GError** error)
+{
+  guint encoded;
+
+  g_return_val_if_fail(value != NULL, FALSE);
+
+  if(!inf_binary_util_read_uint(data, end, &encoded, error))
+    return FALSE;
+
+  *value = (gint)((encoded >> 1) ^ -(encoded & 1));
+  return TRUE;
+}
+
+/**
+ * inf_binary_util_read_utf8:
+ * @data: (inout): Pointer to the current read position.
+ * @end: Pointer to the end of the data.
+ * @bytes: (out): Location to store the length of the string, in bytes.
+ * @chars: (out) (allow-none): Location to store the length of the string,
+ * in characters, or %NULL.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a string written with inf_binary_util_write_string() and advances
+ * @data past it. The string must be valid UTF-8. It may contain nul
+ * characters. The returned string is not copied and not nul-terminated.
+ * If the string cannot be read or is not valid UTF-8, then the function
+ * returns %NULL and @error is set.
+ *
+ * Returns: (array length=bytes) (transfer none): A pointer to the string
+ * within the data, or %NULL on error.
+ */
+const gchar*
+inf_binary_util_read_utf8(const guchar** data,
+                          const guchar* end,
+                          gsize* bytes,
+                          guint* chars,
+                          GError** error)
+{
+  const guchar* pos;
+  const gchar* text;
+  const gchar* valid_end;
+  guint len;
+  guint n_chars;
+
+  g_return_val_if_fail(bytes != NULL, NULL);
+
+  pos = *data;
+  if(!inf_binary_util_read_uint(&pos, end, &len, error))
+    return NULL;
+
+  if(len > (gsize)(end - pos))
+  {
+    g_set_error_literal(
+      error,
+      inf_request_error_quark(),
+      INF_REQUEST_ERROR_INVALID_ATTRIBUTE,
+      _("Binary data ends within a string")
+    );
+
+    return NULL;
+  }
+
+  text = (const gchar*)pos;
+  n_chars = 0;
+
+  /* g_utf8_validate() stops at nul characters, so skip over them */
+  while(pos < (const guchar*)text + len)
+  {
+    if(!g_utf8_validate((const gchar*)pos,
+                        (const gchar*)text + len - (const gchar*)pos,
+                        &valid_end))
+    {
+      if(*valid_end != '\0' || valid_end == text + len)
+      {
+        g_set_error_literal(
+          error,
+          inf_request_error_quark(),
+          INF_REQUEST_ERROR_INVALID_ATTRIBUTE,
+          _("Binary string is not valid UTF-8")
+        );
+
+        return NULL;
+      }
+
+      ++ valid_end;
+    }
+    else
+    {
+      valid_end = text + len;
+    }
+
+    /* Count every byte that does not continue a multi-byte sequence */
+    for(; pos < (const guchar*)valid_end; ++pos)
+      if((*pos & 0xc0) != 0x80)
+        ++ n_chars;
+  }
+
+  *data = pos;
+  *bytes = len;
+  if(chars != NULL) *chars = n_chars;
+  return text;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,63 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_BINARY_UTIL_H__
+#define __INF_BINARY_UTIL_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+void
+inf_binary_util_write_uint(GByteArray* data,
+                           guint value);
+
+void
+inf_binary_util_write_int(GByteArray* data,
+                          gint value);
+
+void
+inf_binary_util_write_string(GByteArray* data,
+                             const gchar* str,
+                             gsize bytes);
+
+gboolean
+inf_binary_util_read_uint(const guchar** data,
+                          const guchar* end,
+                          guint* value,
+                          GError** error);
+
+gboolean
+inf_binary_util_read_int(const guchar** data,
+                         const guchar* end,
+                         gint* value,
+                         GError** error);
+
+const gchar*
+inf_binary_util_read_utf8(const guchar** data,
+                          const guchar* end,
+                          gsize* bytes,
+                          guint* chars,
+                          GError** error);
+
+G_END_DECLS
+
+#endif /* __INF_BINARY_UTIL_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -36,7 +36,7 @@
 G_DEFINE_BOXED_TYPE(InfCertificateChain, inf_certificate_chain, inf_certificate_chain_ref, inf_certificate_chain_unref)
 
 struct _InfCertificateChain {
-  guint ref_count;
+  gint ref_count;
 
   gnutls_x509_crt_t* certs;
   guint n_certs;
@@ -76,7 +76,7 @@ inf_certificate_chain_new(gnutls_x509_crt_t* certs,
 InfCertificateChain*
 inf_certificate_chain_ref(InfCertificateChain* chain)
 {
-  ++ chain->ref_count;
+  g_atomic_int_inc(&chain->ref_count);
   return chain;
 }
 
@@ -92,8 +92,7 @@ inf_certificate_chain_unref(InfCertificateChain* chain)
 {
   guint i;
 
-  -- chain->ref_count;
-  if(chain->ref_count == 0)
+  if(g_atomic_int_dec_and_test(&chain->ref_count))
   {
     for(i = 0; i < chain->n_certs; ++ i)
       gnutls_x509_crt_deinit(chain->certs[i]);
@@ -784,20 +784,15 @@ inf_chat_session_get_property(GObject* object,
  */
 
 static void
-inf_chat_session_to_xml_sync(InfSession* session,
-                             xmlNodePtr parent)
+inf_chat_session_to_xml_sync_messages(InfSession* session,
+                                      xmlNodePtr parent)
 {
   InfChatBuffer* buffer;
-  InfSessionClass* parent_class;
   const InfChatBufferMessage* message;
   xmlNodePtr child;
   guint i;
 
   buffer = INF_CHAT_BUFFER(inf_session_get_buffer(session));
-  parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
-
-  g_assert(parent_class->to_xml_sync != NULL);
-  parent_class->to_xml_sync(session, parent);
 
   for(i = 0; i < inf_chat_buffer_get_n_messages(buffer); ++i)
   {
@@ -813,6 +808,36 @@ inf_chat_session_to_xml_sync(InfSession* session,
   }
 }
 
+static void
+inf_chat_session_to_xml_sync(InfSession* session,
+                             xmlNodePtr parent)
+{
+  InfSessionClass* parent_class;
+  parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
+
+  g_assert(parent_class->to_xml_sync != NULL);
+  parent_class->to_xml_sync(session, parent);
+
+  inf_chat_session_to_xml_sync_messages(session, parent);
+}
+
+static void
+inf_chat_session_init_sync_generator(InfSession* session,
+                                     InfSessionSyncGenerator* generator)
+{
+  InfSessionClass* parent_class;
+  xmlNodePtr container;
+
+  parent_class = INF_SESSION_CLASS(inf_chat_session_parent_class);
+  parent_class->init_sync_generator(session, generator);
+
+  /* The chat buffer only keeps a limited number of messages, so they can
+   * be converted to XML right away. */
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  inf_chat_session_to_xml_sync_messages(session, container);
+  inf_session_sync_generator_add_xml(generator, container);
+}
+
 static gboolean
 inf_chat_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1031,6 +1056,7 @@ inf_chat_session_class_init(InfChatSessionClass* chat_session_class)
   object_class->get_property = inf_chat_session_get_property;
 
   session_class->to_xml_sync = inf_chat_session_to_xml_sync;
+  session_class->init_sync_generator = inf_chat_session_init_sync_generator;
   session_class->process_xml_sync = inf_chat_session_process_xml_sync;
   session_class->process_xml_run = inf_chat_session_process_xml_run;
   session_class->synchronization_complete =
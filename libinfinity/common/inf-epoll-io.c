@@ -0,0 +1,921 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-epoll-io
+ * @title: InfEpollIo
+ * @short_description: Event loop implementation based on epoll
+ * @include: libinfinity/common/inf-epoll-io.h
+ * @see_also: #InfIo, #InfStandaloneIo
+ * @stability: Unstable
+ *
+ * #InfEpollIo is an implementation of the #InfIo interface which uses the
+ * Linux epoll facility to wait for events. It provides the same API as
+ * #InfStandaloneIo and can be used in its place. Adding, updating and
+ * removing watches takes constant time, and the cost of waiting for events
+ * does not grow with the number of watched sockets, which makes it suitable
+ * for servers with many simultaneous connections. All events that are
+ * reported by a single call to epoll_wait() are processed in one iteration.
+ * The class is fully thread-safe.
+ *
+ * This class is only available if the macro
+ * <literal>LIBINFINITY_HAVE_EPOLL</literal> is defined.
+ */
+
+#include <libinfinity/common/inf-epoll-io.h>
+#include <libinfinity/common/inf-io.h>
+#include <libinfinity/inf-config.h> /* LIBINFINITY_HAVE_EPOLL */
+
+#ifdef LIBINFINITY_HAVE_EPOLL
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+
+/* Maximum number of events to retrieve with one call to epoll_wait() */
+#define INF_EPOLL_IO_MAX_EVENTS 256
+
+struct _InfIoWatch {
+  InfNativeSocket* socket;
+  InfIoWatchFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+
+  /* Protection flags to avoid freeing the watch object when running
+   * the callback */
+  gboolean executing;
+  gboolean disposed;
+};
+
+struct _InfIoTimeout {
+  gint64 deadline;
+  guint64 serial;
+  GSequenceIter* iter;
+
+  InfIoTimeoutFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+struct _InfIoDispatch {
+  InfIoDispatchFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+typedef struct _InfEpollIoPrivate InfEpollIoPrivate;
+struct _InfEpollIoPrivate {
+  GMutex mutex;
+
+  int epoll_fd;
+  int wakeup_fd;
+  struct epoll_event events[INF_EPOLL_IO_MAX_EVENTS];
+
+  /* All active watches. Watches that are removed while an iteration is
+   * running might still be referenced by the events array, so they are only
+   * freed once the iteration has finished. */
+  GHashTable* watches;
+  GSList* disposed_watches;
+
+  /* Sorted by deadline, and by creation order for equal deadlines */
+  GSequence* timeouts;
+  guint64 timeout_serial;
+
+  GQueue dispatchs;
+
+  gboolean polling;
+  gboolean iterating;
+  gboolean loop_running;
+};
+
+#define INF_EPOLL_IO_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_EPOLL_IO, InfEpollIoPrivate))
+
+static void inf_epoll_io_io_iface_init(InfIoInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfEpollIo, inf_epoll_io, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfEpollIo)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_epoll_io_io_iface_init))
+
+static guint32
+inf_epoll_io_events_to_epoll(InfIoEvent events)
+{
+  guint32 epoll_events;
+
+  /* EPOLLERR and EPOLLHUP are always reported, no need to ask for them */
+  epoll_events = 0;
+  if(events & INF_IO_INCOMING)
+    epoll_events |= EPOLLIN;
+  if(events & INF_IO_OUTGOING)
+    epoll_events |= EPOLLOUT;
+  if(events & INF_IO_ERROR)
+    epoll_events |= EPOLLPRI;
+
+  return epoll_events;
+}
+
+static InfIoEvent
+inf_epoll_io_events_from_epoll(guint32 epoll_events)
+{
+  InfIoEvent events;
+
+  events = 0;
+  if(epoll_events & EPOLLIN)
+    events |= INF_IO_INCOMING;
+  if(epoll_events & EPOLLOUT)
+    events |= INF_IO_OUTGOING;
+  /* We treat EPOLLPRI as error because it should not occur in infinote. */
+  if(epoll_events & (EPOLLERR | EPOLLPRI | EPOLLHUP))
+    events |= INF_IO_ERROR;
+
+  return events;
+}
+
+static gint
+inf_epoll_io_timeout_compare_func(gconstpointer a,
+                                  gconstpointer b,
+                                  gpointer user_data)
+{
+  const InfIoTimeout* first;
+  const InfIoTimeout* second;
+
+  first = (const InfIoTimeout*)a;
+  second = (const InfIoTimeout*)b;
+
+  if(first->deadline < second->deadline)
+    return -1;
+  if(first->deadline > second->deadline)
+    return 1;
+
+  if(first->serial < second->serial)
+    return -1;
+  if(first->serial > second->serial)
+    return 1;
+
+  return 0;
+}
+
+static void
+inf_epoll_io_wakeup(InfEpollIo* io)
+{
+  /* Wake up the main loop in case it is currently sleeping. This function is
+   * called whenever a timeout or dispatch is added that needs to be taken
+   * into account earlier than the current wait allows. Changes to watches
+   * do not need this, since the kernel applies them to a running
+   * epoll_wait() call directly. */
+  /* Should only ever be called with the IO's mutex being locked. */
+
+  InfEpollIoPrivate* priv;
+  guint64 value;
+  ssize_t ret;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  if(priv->polling)
+  {
+    value = 1;
+    ret = write(priv->wakeup_fd, &value, sizeof(value));
+    if(ret == -1 && errno != EAGAIN)
+    {
+      g_warning(
+        "write() failed when attempting to wake up the main loop: %s",
+        strerror(errno)
+      );
+    }
+  }
+}
+
+static void
+inf_epoll_io_clear_wakeup(InfEpollIo* io,
+                          guint32 epoll_events)
+{
+  InfEpollIoPrivate* priv;
+  guint64 value;
+  ssize_t ret;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  /* we were not polling for outgoing */
+  g_assert(~epoll_events & EPOLLOUT);
+  if(epoll_events & (EPOLLERR | EPOLLHUP))
+  {
+    g_warning("Error condition on wakeup file descriptor");
+  }
+  else
+  {
+    ret = read(priv->wakeup_fd, &value, sizeof(value));
+    if(ret == -1 && errno != EAGAIN)
+    {
+      g_warning(
+        "read() on wakeup file descriptor failed: %s",
+        strerror(errno)
+      );
+    }
+  }
+}
+
+/* Run one iteration of the main loop. Call this only with the mutex locked
+ * and a local reference added to io. */
+static void
+inf_epoll_io_iteration_impl(InfEpollIo* io,
+                            int timeout)
+{
+  InfEpollIoPrivate* priv;
+  InfIoWatch* watch;
+  InfIoTimeout* cur_timeout;
+  InfIoDispatch* dispatch;
+  InfIoEvent events;
+  GSequenceIter* iter;
+  GSList* item;
+  gint64 current;
+  gint64 remaining;
+  guint64 serial;
+  guint n_dispatchs;
+  int result;
+  int i;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  /* Find number of milliseconds to wait */
+  if(!g_queue_is_empty(&priv->dispatchs))
+  {
+    timeout = 0;
+  }
+  else if(!g_sequence_is_empty(priv->timeouts))
+  {
+    cur_timeout = (InfIoTimeout*)g_sequence_get(
+      g_sequence_get_begin_iter(priv->timeouts)
+    );
+
+    current = g_get_monotonic_time();
+    if(cur_timeout->deadline <= current)
+    {
+      timeout = 0;
+    }
+    else
+    {
+      /* Round up, so that we do not wake up before the deadline */
+      remaining = (cur_timeout->deadline - current + 999) / 1000;
+      if(remaining > G_MAXINT)
+        remaining = G_MAXINT;
+
+      if(timeout == -1 || remaining < timeout)
+        timeout = (int)remaining;
+    }
+  }
+
+  priv->polling = TRUE;
+  priv->iterating = TRUE;
+  g_mutex_unlock(&priv->mutex);
+
+  result = epoll_wait(
+    priv->epoll_fd,
+    priv->events,
+    INF_EPOLL_IO_MAX_EVENTS,
+    timeout
+  );
+
+  g_mutex_lock(&priv->mutex);
+  priv->polling = FALSE;
+
+  if(result == -1)
+  {
+    if(errno != EINTR)
+      g_warning("epoll_wait() failed: %s\n", strerror(errno));
+    result = 0;
+  }
+
+  for(i = 0; i < result; ++i)
+  {
+    watch = (InfIoWatch*)priv->events[i].data.ptr;
+
+    if(watch == NULL)
+    {
+      /* wakeup call */
+      inf_epoll_io_clear_wakeup(io, priv->events[i].events);
+    }
+    else if(watch->disposed == FALSE)
+    {
+      events = inf_epoll_io_events_from_epoll(priv->events[i].events);
+
+      /* protect from removing the watch object via
+       * inf_io_remove_watch() when running the callback. */
+      watch->executing = TRUE;
+      g_mutex_unlock(&priv->mutex);
+
+      watch->func(watch->socket, events, watch->user_data);
+
+      g_mutex_lock(&priv->mutex);
+      watch->executing = FALSE;
+      if(watch->disposed == TRUE)
+      {
+        g_mutex_unlock(&priv->mutex);
+        if(watch->notify) watch->notify(watch->user_data);
+        g_mutex_lock(&priv->mutex);
+
+        /* A watch shows up at most once in the result of epoll_wait(), so
+         * it is safe to free it right away. */
+        g_slice_free(InfIoWatch, watch);
+      }
+    }
+  }
+
+  /* Run all timeouts that have elapsed, but not the ones that are added by
+   * the timeout callbacks themselves, so that a timeout which re-schedules
+   * itself cannot block the loop. */
+  current = g_get_monotonic_time();
+  serial = priv->timeout_serial;
+  while(!g_sequence_is_empty(priv->timeouts))
+  {
+    iter = g_sequence_get_begin_iter(priv->timeouts);
+    cur_timeout = (InfIoTimeout*)g_sequence_get(iter);
+    if(cur_timeout->deadline > current || cur_timeout->serial >= serial)
+      break;
+
+    g_sequence_remove(iter);
+    cur_timeout->iter = NULL;
+    g_mutex_unlock(&priv->mutex);
+
+    cur_timeout->func(cur_timeout->user_data);
+    if(cur_timeout->notify)
+      cur_timeout->notify(cur_timeout->user_data);
+    g_slice_free(InfIoTimeout, cur_timeout);
+
+    g_mutex_lock(&priv->mutex);
+  }
+
+  /* Same for dispatched messages */
+  n_dispatchs = g_queue_get_length(&priv->dispatchs);
+  while(n_dispatchs > 0 && !g_queue_is_empty(&priv->dispatchs))
+  {
+    dispatch = (InfIoDispatch*)g_queue_pop_head(&priv->dispatchs);
+    g_mutex_unlock(&priv->mutex);
+
+    dispatch->func(dispatch->user_data);
+    if(dispatch->notify)
+      dispatch->notify(dispatch->user_data);
+    g_slice_free(InfIoDispatch, dispatch);
+
+    g_mutex_lock(&priv->mutex);
+    --n_dispatchs;
+  }
+
+  priv->iterating = FALSE;
+
+  for(item = priv->disposed_watches; item != NULL; item = item->next)
+    g_slice_free(InfIoWatch, item->data);
+  g_slist_free(priv->disposed_watches);
+  priv->disposed_watches = NULL;
+}
+
+static void
+inf_epoll_io_init(InfEpollIo* io)
+{
+  InfEpollIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_init(&priv->mutex);
+
+  priv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if(priv->epoll_fd == -1)
+    g_error("Failed to create epoll instance: %s", strerror(errno));
+
+  priv->wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if(priv->wakeup_fd == -1)
+    g_error("Failed to create wakeup file descriptor: %s", strerror(errno));
+
+  /* The wakeup file descriptor is the only one with NULL user data */
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, priv->wakeup_fd, &event) == -1)
+  {
+    g_error(
+      "Failed to add wakeup file descriptor to epoll instance: %s",
+      strerror(errno)
+    );
+  }
+
+  priv->watches = g_hash_table_new(NULL, NULL);
+  priv->disposed_watches = NULL;
+  priv->timeouts = g_sequence_new(NULL);
+  priv->timeout_serial = 0;
+  g_queue_init(&priv->dispatchs);
+
+  priv->polling = FALSE;
+  priv->iterating = FALSE;
+  priv->loop_running = FALSE;
+}
+
+static void
+inf_epoll_io_finalize(GObject* object)
+{
+  InfEpollIo* io;
+  InfEpollIoPrivate* priv;
+  GHashTableIter hash_iter;
+  GSequenceIter* iter;
+  GSList* item;
+  gpointer key;
+  InfIoWatch* watch;
+  InfIoTimeout* timeout;
+  InfIoDispatch* dispatch;
+
+  io = INF_EPOLL_IO(object);
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+
+  g_hash_table_iter_init(&hash_iter, priv->watches);
+  while(g_hash_table_iter_next(&hash_iter, &key, NULL))
+  {
+    watch = (InfIoWatch*)key;
+
+    /* cannot dispose the IO while running a callback since the IO is
+     * reffed on the stack. */
+    g_assert(watch->executing == FALSE);
+
+    if(watch->notify)
+      watch->notify(watch->user_data);
+    g_slice_free(InfIoWatch, watch);
+  }
+
+  for(item = priv->disposed_watches; item != NULL; item = item->next)
+    g_slice_free(InfIoWatch, item->data);
+
+  for(iter = g_sequence_get_begin_iter(priv->timeouts);
+      !g_sequence_iter_is_end(iter);
+      iter = g_sequence_iter_next(iter))
+  {
+    timeout = (InfIoTimeout*)g_sequence_get(iter);
+    if(timeout->notify)
+      timeout->notify(timeout->user_data);
+    g_slice_free(InfIoTimeout, timeout);
+  }
+
+  while(!g_queue_is_empty(&priv->dispatchs))
+  {
+    dispatch = (InfIoDispatch*)g_queue_pop_head(&priv->dispatchs);
+    if(dispatch->notify)
+      dispatch->notify(dispatch->user_data);
+    g_slice_free(InfIoDispatch, dispatch);
+  }
+
+  g_hash_table_destroy(priv->watches);
+  g_slist_free(priv->disposed_watches);
+  g_sequence_free(priv->timeouts);
+
+  if(close(priv->wakeup_fd) == -1)
+  {
+    g_warning(
+      "Failed to close wakeup file descriptor: %s",
+      strerror(errno)
+    );
+  }
+
+  if(close(priv->epoll_fd) == -1)
+  {
+    g_warning(
+      "Failed to close epoll instance: %s",
+      strerror(errno)
+    );
+  }
+
+  g_mutex_unlock(&priv->mutex);
+  g_mutex_clear(&priv->mutex);
+
+  G_OBJECT_CLASS(inf_epoll_io_parent_class)->finalize(object);
+}
+
+static InfIoWatch*
+inf_epoll_io_io_add_watch(InfIo* io,
+                          InfNativeSocket* socket,
+                          InfIoEvent events,
+                          InfIoWatchFunc func,
+                          gpointer user_data,
+                          GDestroyNotify notify)
+{
+  InfEpollIoPrivate* priv;
+  InfIoWatch* watch;
+  struct epoll_event event;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  watch = g_slice_new(InfIoWatch);
+  watch->socket = socket;
+  watch->func = func;
+  watch->user_data = user_data;
+  watch->notify = notify;
+  watch->executing = FALSE;
+  watch->disposed = FALSE;
+
+  event.events = inf_epoll_io_events_to_epoll(events);
+  event.data.ptr = watch;
+
+  g_mutex_lock(&priv->mutex);
+
+  /* This fails with EEXIST if the socket is watched already */
+  if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, *socket, &event) == -1)
+  {
+    if(errno != EEXIST)
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+
+    g_mutex_unlock(&priv->mutex);
+    g_slice_free(InfIoWatch, watch);
+    return NULL;
+  }
+
+  g_hash_table_add(priv->watches, watch);
+  g_mutex_unlock(&priv->mutex);
+
+  return watch;
+}
+
+static void
+inf_epoll_io_io_update_watch(InfIo* io,
+                             InfIoWatch* watch,
+                             InfIoEvent events)
+{
+  InfEpollIoPrivate* priv;
+  struct epoll_event event;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  event.events = inf_epoll_io_events_to_epoll(events);
+  event.data.ptr = watch;
+
+  g_mutex_lock(&priv->mutex);
+
+  if(g_hash_table_contains(priv->watches, watch))
+  {
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_MOD, *watch->socket, &event) == -1)
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+  }
+
+  g_mutex_unlock(&priv->mutex);
+}
+
+static void
+inf_epoll_io_io_remove_watch(InfIo* io,
+                             InfIoWatch* watch)
+{
+  InfEpollIoPrivate* priv;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+
+  if(g_hash_table_remove(priv->watches, watch))
+  {
+    /* If the socket has been closed already, then the kernel has removed it
+     * from the epoll set by itself. */
+    if(epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, *watch->socket, NULL) == -1 &&
+       errno != EBADF && errno != ENOENT)
+    {
+      g_warning("epoll_ctl() failed: %s", strerror(errno));
+    }
+
+    watch->disposed = TRUE;
+
+    /* If the callback of the watch is currently running, we don't want to
+     * destroy the user data while it is, so we wait for the callback to
+     * return and then free the user_data and the InfIoWatch struct. */
+    if(!watch->executing)
+    {
+      /* Free user_data */
+      if(watch->notify)
+        watch->notify(watch->user_data);
+
+      if(priv->iterating)
+      {
+        priv->disposed_watches =
+          g_slist_prepend(priv->disposed_watches, watch);
+      }
+      else
+      {
+        g_slice_free(InfIoWatch, watch);
+      }
+    }
+  }
+
+  g_mutex_unlock(&priv->mutex);
+}
+
+static InfIoTimeout*
+inf_epoll_io_io_add_timeout(InfIo* io,
+                            guint msecs,
+                            InfIoTimeoutFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+  InfEpollIoPrivate* priv;
+  InfIoTimeout* timeout;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+  timeout = g_slice_new(InfIoTimeout);
+
+  timeout->deadline = g_get_monotonic_time() + (gint64)msecs * 1000;
+  timeout->func = func;
+  timeout->user_data = user_data;
+  timeout->notify = notify;
+
+  g_mutex_lock(&priv->mutex);
+
+  timeout->serial = priv->timeout_serial++;
+  timeout->iter = g_sequence_insert_sorted(
+    priv->timeouts,
+    timeout,
+    inf_epoll_io_timeout_compare_func,
+    NULL
+  );
+
+  /* Only wake up the main loop if it needs to wake up earlier now */
+  if(g_sequence_iter_is_begin(timeout->iter))
+    inf_epoll_io_wakeup(INF_EPOLL_IO(io));
+
+  g_mutex_unlock(&priv->mutex);
+
+  return timeout;
+}
+
+static void
+inf_epoll_io_io_remove_timeout(InfIo* io,
+                               InfIoTimeout* timeout)
+{
+  InfEpollIoPrivate* priv;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+
+  /* The iterator is unset while the timeout's callback is running */
+  if(timeout->iter != NULL)
+  {
+    g_sequence_remove(timeout->iter);
+    timeout->iter = NULL;
+    g_mutex_unlock(&priv->mutex);
+
+    if(timeout->notify)
+      timeout->notify(timeout->user_data);
+
+    g_slice_free(InfIoTimeout, timeout);
+
+    /* No need to wake up the main loop; it might run into its timeout sooner
+     * than necessary now, but that's OK. */
+  }
+  else
+  {
+    g_mutex_unlock(&priv->mutex);
+  }
+}
+
+static InfIoDispatch*
+inf_epoll_io_io_add_dispatch(InfIo* io,
+                             InfIoDispatchFunc func,
+                             gpointer user_data,
+                             GDestroyNotify notify)
+{
+  InfEpollIoPrivate* priv;
+  InfIoDispatch* dispatch;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+  dispatch = g_slice_new(InfIoDispatch);
+
+  dispatch->func = func;
+  dispatch->user_data = user_data;
+  dispatch->notify = notify;
+
+  g_mutex_lock(&priv->mutex);
+  g_queue_push_tail(&priv->dispatchs, dispatch);
+  inf_epoll_io_wakeup(INF_EPOLL_IO(io));
+  g_mutex_unlock(&priv->mutex);
+
+  return dispatch;
+}
+
+static void
+inf_epoll_io_io_remove_dispatch(InfIo* io,
+                                InfIoDispatch* dispatch)
+{
+  InfEpollIoPrivate* priv;
+
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+
+  if(g_queue_remove(&priv->dispatchs, dispatch))
+  {
+    g_mutex_unlock(&priv->mutex);
+
+    if(dispatch->notify)
+      dispatch->notify(dispatch->user_data);
+
+    g_slice_free(InfIoDispatch, dispatch);
+  }
+  else
+  {
+    g_mutex_unlock(&priv->mutex);
+  }
+}
+
+static void
+inf_epoll_io_class_init(InfEpollIoClass* io_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(io_class);
+
+  object_class->finalize = inf_epoll_io_finalize;
+}
+
+static void
+inf_epoll_io_io_iface_init(InfIoInterface* iface)
+{
+  iface->add_watch = inf_epoll_io_io_add_watch;
+  iface->update_watch = inf_epoll_io_io_update_watch;
+  iface->remove_watch = inf_epoll_io_io_remove_watch;
+  iface->add_timeout = inf_epoll_io_io_add_timeout;
+  iface->remove_timeout = inf_epoll_io_io_remove_timeout;
+  iface->add_dispatch = inf_epoll_io_io_add_dispatch;
+  iface->remove_dispatch = inf_epoll_io_io_remove_dispatch;
+}
+
+/**
+ * inf_epoll_io_new: (constructor)
+ *
+ * Creates a new #InfEpollIo.
+ *
+ * Returns: (transfer full): A new #InfEpollIo. Free with g_object_unref()
+ * when no longer needed.
+ **/
+InfEpollIo*
+inf_epoll_io_new(void)
+{
+  GObject* object;
+  object = g_object_new(INF_TYPE_EPOLL_IO, NULL);
+  return INF_EPOLL_IO(object);
+}
+
+/**
+ * inf_epoll_io_iteration:
+ * @io: A #InfEpollIo.
+ *
+ * Performs a single iteration of @io. The call will block until a first
+ * event has occurred. Then, it will process all events that are pending at
+ * that point and return.
+ **/
+void
+inf_epoll_io_iteration(InfEpollIo* io)
+{
+  InfEpollIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_EPOLL_IO(io));
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_object_ref(io);
+  g_mutex_lock(&priv->mutex);
+
+  g_return_val_if_fail(priv->iterating == FALSE, g_mutex_unlock(&priv->mutex));
+
+  inf_epoll_io_iteration_impl(io, -1);
+
+  g_mutex_unlock(&priv->mutex);
+  g_object_unref(io);
+}
+
+/**
+ * inf_epoll_io_iteration_timeout:
+ * @io: A #InfEpollIo.
+ * @timeout: Maximum number of milliseconds to block.
+ *
+ * Performs a single iteration of @io. The call will block until either an
+ * event occurred or @timeout milliseconds have elapsed. All events that
+ * are pending at that point will be processed before returning.
+ **/
+void
+inf_epoll_io_iteration_timeout(InfEpollIo* io,
+                               guint timeout)
+{
+  InfEpollIoPrivate* priv;
+  g_return_if_fail(INF_IS_EPOLL_IO(io));
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_object_ref(io);
+  g_mutex_lock(&priv->mutex);
+
+  g_return_val_if_fail(priv->iterating == FALSE, g_mutex_unlock(&priv->mutex));
+
+  inf_epoll_io_iteration_impl(io, (int)MIN(timeout, G_MAXINT));
+
+  g_mutex_unlock(&priv->mutex);
+  g_object_unref(io);
+}
+
+/**
+ * inf_epoll_io_loop:
+ * @io: A #InfEpollIo.
+ *
+ * This call will cause @io to wait for events and process them, but not
+ * return until inf_epoll_io_loop_quit() is called.
+ **/
+void
+inf_epoll_io_loop(InfEpollIo* io)
+{
+  InfEpollIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_EPOLL_IO(io));
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_object_ref(io);
+  g_mutex_lock(&priv->mutex);
+
+  g_return_val_if_fail(
+    priv->loop_running == FALSE,
+    g_mutex_unlock(&priv->mutex)
+  );
+
+  g_return_val_if_fail(
+    priv->iterating == FALSE,
+    g_mutex_unlock(&priv->mutex)
+  );
+
+  priv->loop_running = TRUE;
+
+  while(priv->loop_running == TRUE)
+    inf_epoll_io_iteration_impl(io, -1);
+
+  g_mutex_unlock(&priv->mutex);
+  g_object_unref(io);
+}
+
+/**
+ * inf_epoll_io_loop_quit:
+ * @io: A #InfEpollIo.
+ *
+ * Exits a loop in which @io is running through a call to
+ * inf_epoll_io_loop().
+ **/
+void
+inf_epoll_io_loop_quit(InfEpollIo* io)
+{
+  InfEpollIoPrivate* priv;
+
+  g_return_if_fail(INF_IS_EPOLL_IO(io));
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+
+  g_return_val_if_fail(
+    priv->loop_running == TRUE,
+    g_mutex_unlock(&priv->mutex)
+  );
+
+  priv->loop_running = FALSE;
+
+  inf_epoll_io_wakeup(io);
+  g_mutex_unlock(&priv->mutex);
+}
+
+/**
+ * inf_epoll_io_loop_running:
+ * @io: A #InfEpollIo.
+ *
+ * Returns whether @io runs currently in a loop initiated with
+ * inf_epoll_io_loop().
+ *
+ * Returns: Whether @io runs in a loop.
+ **/
+gboolean
+inf_epoll_io_loop_running(InfEpollIo* io)
+{
+  InfEpollIoPrivate* priv;
+  gboolean running;
+
+  g_return_val_if_fail(INF_IS_EPOLL_IO(io), FALSE);
+  priv = INF_EPOLL_IO_PRIVATE(io);
+
+  g_mutex_lock(&priv->mutex);
+  running = priv->loop_running;
+  g_mutex_unlock(&priv->mutex);
+
+  return running;
+}
+
+#endif /* LIBINFINITY_HAVE_EPOLL */
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,90 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_EPOLL_IO_H__
+#define __INF_EPOLL_IO_H__
+
+#include <libinfinity/inf-config.h> /* For LIBINFINITY_HAVE_EPOLL */
+
+#include <glib-object.h>
+
+#ifdef LIBINFINITY_HAVE_EPOLL
+
+G_BEGIN_DECLS
+
+#define INF_TYPE_EPOLL_IO                 (inf_epoll_io_get_type())
+#define INF_EPOLL_IO(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TYPE_EPOLL_IO, InfEpollIo))
+#define INF_EPOLL_IO_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INF_TYPE_EPOLL_IO, InfEpollIoClass))
+#define INF_IS_EPOLL_IO(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INF_TYPE_EPOLL_IO))
+#define INF_IS_EPOLL_IO_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TYPE_EPOLL_IO))
+#define INF_EPOLL_IO_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TYPE_EPOLL_IO, InfEpollIoClass))
+
+typedef struct _InfEpollIo InfEpollIo;
+typedef struct _InfEpollIoClass InfEpollIoClass;
+
+/**
+ * InfEpollIoClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfEpollIoClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfEpollIo:
+ *
+ * #InfEpollIo is an opaque data type. You should only access it via the
+ * public API functions.
+ */
+struct _InfEpollIo {
+  /*< private >*/
+  GObject parent;
+};
+
+GType
+inf_epoll_io_get_type(void) G_GNUC_CONST;
+
+InfEpollIo*
+inf_epoll_io_new(void);
+
+void
+inf_epoll_io_iteration(InfEpollIo* io);
+
+void
+inf_epoll_io_iteration_timeout(InfEpollIo* io,
+                               guint timeout);
+
+void
+inf_epoll_io_loop(InfEpollIo* io);
+
+void
+inf_epoll_io_loop_quit(InfEpollIo* io);
+
+gboolean
+inf_epoll_io_loop_running(InfEpollIo* io);
+
+G_END_DECLS
+
+#endif /* LIBINFINITY_HAVE_EPOLL */
+
+#endif /* __INF_EPOLL_IO_H__ */
+
+/* vim:set et sw=2 ts=2: */
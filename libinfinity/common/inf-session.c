@@ -59,6 +59,7 @@
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-buffer.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-xml-blob.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/communication/inf-communication-object.h>
 #include <libinfinity/inf-i18n.h>
@@ -95,6 +96,20 @@ static const GEnumValue inf_session_status_values[] = {
   }
 };
 
+typedef struct _InfSessionSyncGeneratorStep InfSessionSyncGeneratorStep;
+struct _InfSessionSyncGeneratorStep {
+  guint n_messages;
+  InfSessionSyncGeneratorFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+struct _InfSessionSyncGenerator {
+  InfSession* session;
+  GQueue steps;
+  guint n_messages;
+};
+
 typedef struct _InfSessionSync InfSessionSync;
 struct _InfSessionSync {
   InfCommunicationGroup* group;
@@ -103,6 +118,17 @@ struct _InfSessionSync {
   guint messages_total;
   guint messages_sent;
   InfSessionSyncStatus status;
+
+  /* Produces the messages between sync-begin and sync-end. NULL once
+   * sync-end has been queued. */
+  InfSessionSyncGenerator* generator;
+  guint messages_queued;
+  gboolean generating;
+  gboolean flush;
+
+  /* Group whose group messages to conn are held back by the communication
+   * method until sync-end has been queued, or NULL. */
+  InfCommunicationGroup* held_group;
 };
 
 typedef struct _InfSessionPrivate InfSessionPrivate;
@@ -176,6 +202,13 @@ enum {
 
 #define INF_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TYPE_SESSION, InfSessionPrivate))
 
+/* Number of synchronization messages that are generated at once */
+static const guint INF_SESSION_SYNC_BATCH_SIZE = 16;
+
+/* Maximum number of synchronization messages that have been passed to the
+ * communication group but not yet been sent */
+static const guint INF_SESSION_SYNC_WINDOW_SIZE = 32;
+
 static guint session_signals[LAST_SIGNAL];
 static GQuark inf_session_sync_error_quark;
 
@@ -278,6 +311,262 @@ inf_session_find_sync_by_connection(InfSession* session,
   return (InfSessionSync*)item->data;
 }
 
+static InfSessionSyncGenerator*
+inf_session_sync_generator_new(InfSession* session)
+{
+  InfSessionSyncGenerator* generator;
+
+  generator = g_slice_new(InfSessionSyncGenerator);
+  generator->session = session;
+  g_queue_init(&generator->steps);
+  generator->n_messages = 0;
+
+  return generator;
+}
+
+static void
+inf_session_sync_generator_free(InfSessionSyncGenerator* generator)
+{
+  InfSessionSyncGeneratorStep* step;
+
+  while(!g_queue_is_empty(&generator->steps))
+  {
+    step = g_queue_pop_head(&generator->steps);
+    if(step->notify != NULL)
+      step->notify(step->user_data);
+    g_slice_free(InfSessionSyncGeneratorStep, step);
+  }
+
+  g_slice_free(InfSessionSyncGenerator, generator);
+}
+
+/* Adds up to max_messages messages to parent and returns how many */
+static guint
+inf_session_sync_generator_run(InfSessionSyncGenerator* generator,
+                               xmlNodePtr parent,
+                               guint max_messages)
+{
+  InfSessionSyncGeneratorStep* step;
+  guint n_generated;
+  guint n;
+
+  n_generated = 0;
+  while(n_generated < max_messages && !g_queue_is_empty(&generator->steps))
+  {
+    step = g_queue_peek_head(&generator->steps);
+    n = MIN(max_messages - n_generated, step->n_messages);
+
+    if(n > 0)
+    {
+      step->func(generator->session, parent, n, step->user_data);
+
+      step->n_messages -= n;
+      generator->n_messages -= n;
+      n_generated += n;
+    }
+
+    if(step->n_messages == 0)
+    {
+      g_queue_pop_head(&generator->steps);
+      if(step->notify != NULL)
+        step->notify(step->user_data);
+      g_slice_free(InfSessionSyncGeneratorStep, step);
+    }
+  }
+
+  return n_generated;
+}
+
+static void
+inf_session_sync_generator_free_xml(gpointer data)
+{
+  inf_xml_blob_release_references((xmlNodePtr)data);
+  xmlFreeNode((xmlNodePtr)data);
+}
+
+static void
+inf_session_sync_generator_xml_func(InfSession* session,
+                                    xmlNodePtr parent,
+                                    guint n_messages,
+                                    gpointer user_data)
+{
+  xmlNodePtr container;
+  xmlNodePtr xml;
+  guint i;
+
+  container = (xmlNodePtr)user_data;
+
+  for(i = 0; i < n_messages; ++ i)
+  {
+    xml = container->children;
+    g_assert(xml != NULL);
+
+    xmlUnlinkNode(xml);
+    xmlAddChild(parent, xml);
+  }
+}
+
+/* Lets the communication method send the group messages that have been held
+ * back while sync was in progress. */
+static void
+inf_session_sync_release_group_messages(InfSessionSync* sync)
+{
+  InfCommunicationGroup* group;
+
+  if(sync->held_group != NULL)
+  {
+    /* Reset first, since sending the messages can lead to the
+     * synchronization being released. */
+    group = sync->held_group;
+    sync->held_group = NULL;
+
+    inf_communication_group_release_group_messages(group, sync->conn);
+    g_object_unref(group);
+  }
+}
+
+/* Generates further messages for sync and passes them to the communication
+ * group, as long as there are not too many messages waiting to be sent
+ * already, or all of them if sync->flush is set. */
+static void
+inf_session_sync_generate(InfSession* session,
+                          InfSessionSync* sync)
+{
+  InfSessionPrivate* priv;
+  InfXmlConnection* connection;
+  xmlNodePtr messages;
+  xmlNodePtr xml;
+  InfXmlBlob* blob;
+  guint n;
+
+  priv = INF_SESSION_PRIVATE(session);
+
+  /* Sending a message can lead to this function being called recursively
+   * from the sent callback, in which case the newly generated messages
+   * would overtake the ones of the current batch. The loop below picks up
+   * where the recursive call would have continued anyway. */
+  if(sync->generating) return;
+
+  sync->generating = TRUE;
+  connection = sync->conn;
+
+  g_object_ref(session);
+  g_object_ref(connection);
+
+  while(sync != NULL && sync->generator != NULL &&
+        (sync->flush ||
+         sync->messages_queued - sync->messages_sent <
+           INF_SESSION_SYNC_WINDOW_SIZE))
+  {
+    /* Name is irrelevant because the node is only used to collect the
+     * generated messages. */
+    messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+
+    n = inf_session_sync_generator_run(
+      sync->generator,
+      messages,
+      sync->flush ? G_MAXUINT : INF_SESSION_SYNC_BATCH_SIZE
+    );
+
+    g_assert(xmlChildElementCount(messages) == n);
+
+    if(sync->generator->n_messages == 0)
+    {
+      inf_session_sync_generator_free(sync->generator);
+      sync->generator = NULL;
+
+      xmlNewChild(messages, NULL, (const xmlChar*)"sync-end", NULL);
+    }
+
+    while(sync != NULL && (xml = messages->children) != NULL)
+    {
+      xmlUnlinkNode(xml);
+      ++ sync->messages_queued;
+
+      /* Messages that are shared between several synchronizations are
+       * added as references to the serialized message. */
+      blob = inf_xml_blob_reference_get_blob(xml);
+      if(blob != NULL)
+      {
+        inf_communication_group_send_blob(sync->group, connection, blob);
+
+        inf_xml_blob_release_references(xml);
+        xmlFreeNode(xml);
+      }
+      else
+      {
+        inf_communication_group_send_message(sync->group, connection, xml);
+      }
+
+      /* The synchronization might have been cancelled as a result of
+       * sending the message, for example because the connection was
+       * closed. */
+      if(priv->status != INF_SESSION_RUNNING ||
+         inf_session_find_sync_by_connection(session, connection) != sync)
+      {
+        sync = NULL;
+      }
+    }
+
+    inf_xml_blob_release_references(messages);
+    xmlFreeNode(messages);
+  }
+
+  if(sync != NULL)
+  {
+    sync->generating = FALSE;
+
+    /* Everything that has been sent to the subscription group meanwhile
+     * can follow sync-end now. */
+    if(sync->generator == NULL)
+      inf_session_sync_release_group_messages(sync);
+  }
+
+  g_object_unref(connection);
+  g_object_unref(session);
+}
+
+/* Queues all remaining synchronization messages. This needs to be done
+ * before anything else is sent to the connections being synchronized,
+ * since the remote side expects the synchronization messages to arrive
+ * without other messages in between. Synchronizations for which the
+ * communication method holds back the subscription group's messages are
+ * left alone, so that they keep generating messages only as the previous
+ * ones are sent. */
+static void
+inf_session_flush_synchronizations(InfSession* session)
+{
+  InfSessionPrivate* priv;
+  InfSessionSync* sync;
+  GSList* item;
+  gboolean found;
+
+  priv = INF_SESSION_PRIVATE(session);
+
+  /* Start from the beginning after each synchronization, since the list
+   * might have been modified meanwhile. */
+  do
+  {
+    found = FALSE;
+    if(priv->status != INF_SESSION_RUNNING)
+      break;
+
+    for(item = priv->shared.run.syncs; item != NULL; item = item->next)
+    {
+      sync = (InfSessionSync*)item->data;
+      if(sync->generator != NULL && !sync->flush &&
+         (sync->held_group == NULL ||
+          sync->held_group != priv->subscription_group))
+      {
+        sync->flush = TRUE;
+        inf_session_sync_generate(session, sync);
+        found = TRUE;
+        break;
+      }
+    }
+  } while(found);
+}
+
 /* Required by inf_session_release_connection() */
 static void
 inf_session_connection_notify_status_cb(InfXmlConnection* connection,
@@ -314,13 +603,21 @@ inf_session_release_connection(InfSession* session,
     priv->shared.sync.group = NULL;
     break;
   case INF_SESSION_RUNNING:
-    item = inf_session_find_sync_item_by_connection(session, connection);
-    g_assert(item != NULL);
+    sync = inf_session_find_sync_by_connection(session, connection);
+    g_assert(sync != NULL);
+
+    /* Do not keep the messages held back forever if the synchronization
+     * is aborted. */
+    inf_session_sync_release_group_messages(sync);
 
-    sync = item->data;
+    item = inf_session_find_sync_item_by_connection(session, connection);
+    g_assert(item != NULL && item->data == sync);
 
     g_object_unref(sync->group);
 
+    if(sync->generator != NULL)
+      inf_session_sync_generator_free(sync->generator);
+
     g_slice_free(InfSessionSync, sync);
     priv->shared.run.syncs = g_slist_delete_link(
       priv->shared.run.syncs,
@@ -834,6 +1131,18 @@ inf_session_to_xml_sync_impl(InfSession* session,
   );
 }
 
+static void
+inf_session_init_sync_generator_impl(InfSession* session,
+                                     InfSessionSyncGenerator* generator)
+{
+  xmlNodePtr container;
+
+  /* User information is small, so just take the snapshot in XML form */
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  inf_session_to_xml_sync_impl(session, container);
+  inf_session_sync_generator_add_xml(generator, container);
+}
+
 static gboolean
 inf_session_process_xml_sync_impl(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1256,6 +1565,9 @@ inf_session_handle_received_sync_message(InfSession* session,
         priv->shared.sync.messages_received = 1;
         xmlFree(num_messages);
 
+        if(session_class->get_xml_sync_features != NULL)
+          session_class->get_xml_sync_features(session, connection, node);
+
         g_signal_emit(
           G_OBJECT(session),
           session_signals[SYNCHRONIZATION_PROGRESS],
@@ -1291,6 +1603,9 @@ inf_session_handle_received_sync_message(InfSession* session,
        * fail anymore. */
       xml_reply = xmlNewNode(NULL, (const xmlChar*)"sync-ack");
 
+      if(session_class->set_xml_sync_features != NULL)
+        session_class->set_xml_sync_features(session, connection, xml_reply);
+
       inf_communication_group_send_message(
         priv->shared.sync.group,
         connection,
@@ -1403,6 +1718,15 @@ inf_session_communication_object_sent(InfCommunicationObject* comm_object,
       /* We need to wait for the sync-ack before synchronization is
        * completed so that the synchronizee still has a chance to tell
        * us if something goes wrong. */
+
+      /* Generate more messages as the queue drains. A signal handler might
+       * have cancelled the synchronization, so look it up again. */
+      if(priv->status == INF_SESSION_RUNNING)
+      {
+        sync = inf_session_find_sync_by_connection(session, connection);
+        if(sync != NULL && sync->generator != NULL)
+          inf_session_sync_generate(session, sync);
+      }
     }
   }
 }
@@ -1558,6 +1882,10 @@ inf_session_communication_object_received(InfCommunicationObject* comm_object,
               sync->status == INF_SESSION_SYNC_AWAITING_ACK)
       {
         /* Got ack we were waiting for */
+        session_class = INF_SESSION_GET_CLASS(session);
+        if(session_class->get_xml_sync_features != NULL)
+          session_class->get_xml_sync_features(session, connection, node);
+
         g_signal_emit(
           G_OBJECT(comm_object),
           session_signals[SYNCHRONIZATION_COMPLETE],
@@ -1619,6 +1947,15 @@ inf_session_communication_object_received(InfCommunicationObject* comm_object,
         g_error_free(local_error);
       }
 
+      /* The message is going to be forwarded to the other group members,
+       * which must not happen in the middle of a synchronization, unless
+       * the communication method holds it back. */
+      if(scope == INF_COMMUNICATION_SCOPE_GROUP &&
+         priv->status == INF_SESSION_RUNNING)
+      {
+        inf_session_flush_synchronizations(session);
+      }
+
       return scope;
     }
   case INF_SESSION_CLOSED:
@@ -1708,8 +2045,6 @@ inf_session_synchronization_begin_handler(InfSession* session,
   InfSessionPrivate* priv;
   InfSessionClass* session_class;
   InfSessionSync* sync;
-  xmlNodePtr messages;
-  xmlNodePtr next;
   xmlNodePtr xml;
   gchar num_messages_buf[16];
 
@@ -1719,13 +2054,18 @@ inf_session_synchronization_begin_handler(InfSession* session,
   g_assert(inf_session_find_sync_by_connection(session, connection) == NULL);
 
   session_class = INF_SESSION_GET_CLASS(session);
-  g_return_if_fail(session_class->to_xml_sync != NULL);
+  g_return_if_fail(session_class->init_sync_generator != NULL);
 
   sync = g_slice_new(InfSessionSync);
   sync->conn = connection;
   sync->messages_sent = 0;
   sync->messages_total = 2; /* including sync-begin and sync-end */
   sync->status = INF_SESSION_SYNC_IN_PROGRESS;
+  sync->generator = NULL;
+  sync->messages_queued = 0;
+  sync->generating = FALSE;
+  sync->flush = FALSE;
+  sync->held_group = NULL;
 
   g_object_ref(G_OBJECT(connection));
   priv->shared.run.syncs = g_slist_prepend(priv->shared.run.syncs, sync);
@@ -1743,13 +2083,29 @@ inf_session_synchronization_begin_handler(InfSession* session,
   /* The group needs to contain that connection, of course. */
   g_assert(inf_communication_group_is_member(sync->group, connection));
 
-  /* Name is irrelevant because the node is only used to collect the child
-   * nodes via the to_xml_sync vfunc. */
-  messages = xmlNewNode(NULL, (const xmlChar*)"sync-container");
-  session_class->to_xml_sync(session, messages);
-
-  for(xml = messages->children; xml != NULL; xml = xml->next)
-    ++ sync->messages_total;
+  /* The messages are not generated all at once, but in batches whenever
+   * the previous messages have been sent, see
+   * inf_session_communication_object_sent(). This way, the whole session
+   * does not need to be held in memory in XML form. */
+  sync->generator = inf_session_sync_generator_new(session);
+  session_class->init_sync_generator(session, sync->generator);
+  sync->messages_total += sync->generator->n_messages;
+
+  /* Messages sent to the subscription group while the synchronization is
+   * in progress must not end up in between the synchronization messages.
+   * Have the communication method hold them back until sync-end has been
+   * queued. If it cannot do that, the remaining synchronization messages
+   * are queued before anything is sent to the group instead, see
+   * inf_session_flush_synchronizations(). */
+  if(priv->subscription_group != NULL &&
+     inf_communication_group_is_member(priv->subscription_group, connection) &&
+     inf_communication_group_hold_group_messages(
+       priv->subscription_group,
+       connection))
+  {
+    sync->held_group = priv->subscription_group;
+    g_object_ref(sync->held_group);
+  }
 
   sprintf(num_messages_buf, "%u", sync->messages_total - 2);
 
@@ -1761,20 +2117,17 @@ inf_session_synchronization_begin_handler(InfSession* session,
     (const xmlChar*)num_messages_buf
   );
 
+  if(session_class->set_xml_sync_features != NULL)
+    session_class->set_xml_sync_features(session, connection, xml);
+
+  ++ sync->messages_queued;
   inf_communication_group_send_message(sync->group, connection, xml);
 
-  /* TODO: Add a function that can send multiple messages */
-  for(xml = messages->children; xml != NULL; xml = next)
+  if(priv->status == INF_SESSION_RUNNING &&
+     inf_session_find_sync_by_connection(session, connection) == sync)
   {
-    next = xml->next;
-    xmlUnlinkNode(xml);
-
-    inf_communication_group_send_message(sync->group, connection, xml);
+    inf_session_sync_generate(session, sync);
   }
-
-  xmlFreeNode(messages);
-  xml = xmlNewNode(NULL, (const xmlChar*)"sync-end");
-  inf_communication_group_send_message(sync->group, connection, xml);
 }
 
 static void
@@ -1880,6 +2233,7 @@ inf_session_class_init(InfSessionClass* session_class)
   object_class->get_property = inf_session_get_property;
 
   session_class->to_xml_sync = inf_session_to_xml_sync_impl;
+  session_class->init_sync_generator = inf_session_init_sync_generator_impl;
   session_class->process_xml_sync = inf_session_process_xml_sync_impl;
   session_class->process_xml_run = inf_session_process_xml_run_impl;
 
@@ -1888,6 +2242,8 @@ inf_session_class_init(InfSessionClass* session_class)
   session_class->validate_user_props = inf_session_validate_user_props_impl;
 
   session_class->user_new = NULL;
+  session_class->set_xml_sync_features = NULL;
+  session_class->get_xml_sync_features = NULL;
 
   session_class->close = inf_session_close_handler;
   session_class->error = NULL;
@@ -2604,6 +2960,12 @@ inf_session_cancel_synchronization(InfSession* session,
      * to cancel anything. */
     if(sync->status == INF_SESSION_SYNC_IN_PROGRESS)
     {
+      if(sync->generator != NULL)
+      {
+        inf_session_sync_generator_free(sync->generator);
+        sync->generator = NULL;
+      }
+
       inf_communication_group_cancel_messages(sync->group, sync->conn);
 
       xml = xmlNewNode(NULL, (const xmlChar*)"sync-cancel");
@@ -2763,6 +3125,51 @@ inf_session_get_synchronization_progress(InfSession* session,
   }
 }
 
+/**
+ * inf_session_get_synchronization_queue_length:
+ * @session: A #InfSession.
+ * @connection: A #InfXmlConnection.
+ *
+ * This function requires that the synchronization status of @connection
+ * is %INF_SESSION_SYNC_IN_PROGRESS or %INF_SESSION_SYNC_AWAITING_ACK
+ * (see inf_session_get_synchronization_status()). If @session synchronizes
+ * itself to @connection, then it returns the number of synchronization
+ * messages that have been passed to the communication layer but not yet
+ * been sent. Otherwise, it returns 0.
+ *
+ * Synchronization messages are generated in batches as the previous ones
+ * are sent, so that this number stays small even for large sessions.
+ *
+ * Return Value: The number of synchronization messages waiting to be sent.
+ **/
+guint
+inf_session_get_synchronization_queue_length(InfSession* session,
+                                             InfXmlConnection* connection)
+{
+  InfSessionPrivate* priv;
+  InfSessionSync* sync;
+
+  g_return_val_if_fail(INF_IS_SESSION(session), 0);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), 0);
+
+  g_return_val_if_fail(
+    inf_session_get_synchronization_status(
+      session,
+      connection
+    ) != INF_SESSION_SYNC_NONE,
+    0
+  );
+
+  priv = INF_SESSION_PRIVATE(session);
+  if(priv->status != INF_SESSION_RUNNING)
+    return 0;
+
+  sync = inf_session_find_sync_by_connection(session, connection);
+  g_assert(sync != NULL);
+
+  return sync->messages_queued - sync->messages_sent;
+}
+
 /**
  * inf_session_has_synchronizations:
  * @session: A #InfSession.
@@ -2874,7 +3281,80 @@ inf_session_send_to_subscriptions(InfSession* session,
   priv = INF_SESSION_PRIVATE(session);
   g_return_if_fail(priv->subscription_group != NULL);
 
+  if(priv->status == INF_SESSION_RUNNING)
+    inf_session_flush_synchronizations(session);
+
   inf_communication_group_send_group_message(priv->subscription_group, xml);
 }
 
+/**
+ * inf_session_sync_generator_add_step:
+ * @generator: A #InfSessionSyncGenerator.
+ * @n_messages: The number of messages that @func generates in total.
+ * @func: (scope notified): Function generating the messages.
+ * @user_data: Additional data to pass to @func.
+ * @notify: Function to free @user_data after all messages have been
+ * generated, or when the synchronization is cancelled, or %NULL.
+ *
+ * Appends a step to @generator that generates @n_messages synchronization
+ * messages by calling @func, possibly in several batches. @func is only
+ * called once all messages of the previously added steps have been
+ * generated.
+ *
+ * This function is meant to be called from
+ * #InfSessionClass.init_sync_generator.
+ */
+void
+inf_session_sync_generator_add_step(InfSessionSyncGenerator* generator,
+                                    guint n_messages,
+                                    InfSessionSyncGeneratorFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify)
+{
+  InfSessionSyncGeneratorStep* step;
+
+  g_return_if_fail(generator != NULL);
+  g_return_if_fail(func != NULL);
+
+  step = g_slice_new(InfSessionSyncGeneratorStep);
+  step->n_messages = n_messages;
+  step->func = func;
+  step->user_data = user_data;
+  step->notify = notify;
+
+  g_queue_push_tail(&generator->steps, step);
+  generator->n_messages += n_messages;
+}
+
+/**
+ * inf_session_sync_generator_add_xml:
+ * @generator: A #InfSessionSyncGenerator.
+ * @container: (transfer full): A XML node whose children to send.
+ *
+ * Appends a step to @generator that sends the child nodes of @container as
+ * synchronization messages. This is useful for parts of the session that
+ * are small enough to be generated all at once. The function takes
+ * ownership of @container.
+ *
+ * Children of @container can also be reference nodes created with
+ * inf_xml_blob_reference_new(), in which case the serialized message of the
+ * blob is sent without being copied. The same applies to the nodes
+ * generated by a #InfSessionSyncGeneratorFunc.
+ */
+void
+inf_session_sync_generator_add_xml(InfSessionSyncGenerator* generator,
+                                   xmlNodePtr container)
+{
+  g_return_if_fail(generator != NULL);
+  g_return_if_fail(container != NULL);
+
+  inf_session_sync_generator_add_step(
+    generator,
+    xmlChildElementCount(container),
+    inf_session_sync_generator_xml_func,
+    container,
+    inf_session_sync_generator_free_xml
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
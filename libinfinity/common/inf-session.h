@@ -147,6 +147,34 @@ typedef enum _InfSessionSyncError {
   INF_SESSION_SYNC_ERROR_FAILED
 } InfSessionSyncError;
 
+/**
+ * InfSessionSyncGenerator:
+ *
+ * #InfSessionSyncGenerator is an opaque data type. It produces the messages
+ * of a synchronization in batches, as the connection is ready to send them.
+ * Use inf_session_sync_generator_add_step() and
+ * inf_session_sync_generator_add_xml() to add messages to it from
+ * #InfSessionClass.init_sync_generator.
+ */
+typedef struct _InfSessionSyncGenerator InfSessionSyncGenerator;
+
+/**
+ * InfSessionSyncGeneratorFunc:
+ * @session: The #InfSession being synchronized.
+ * @parent: The node to add the generated messages to.
+ * @n_messages: The number of messages to generate.
+ * @user_data: The user data passed to inf_session_sync_generator_add_step().
+ *
+ * This function is called to generate the next @n_messages messages of a
+ * synchronization step. It must add exactly @n_messages child nodes to
+ * @parent. It is called repeatedly until all of the messages that were
+ * announced in inf_session_sync_generator_add_step() have been generated.
+ */
+typedef void(*InfSessionSyncGeneratorFunc)(InfSession* session,
+                                           xmlNodePtr parent,
+                                           guint n_messages,
+                                           gpointer user_data);
+
 /**
  * InfSessionClass:
  * @to_xml_sync: Virtual function that saves the session within a XML
@@ -155,6 +183,13 @@ typedef enum _InfSessionSyncError {
  * these are sent to a client and it is not allowed that other traffic is put
  * in between those nodes. This way, communication through the same connection
  * does not hang just because a large session is synchronized.
+ * @init_sync_generator: Virtual function that adds the messages that
+ * @to_xml_sync would create to @generator, in the same order. This is used
+ * to synchronize the session to another host, so that the messages do not
+ * need to be held in memory all at once. Implementations need to take a
+ * snapshot of the session state when called, since the session can change
+ * while the messages are being generated. Subclasses that override
+ * @to_xml_sync need to override this function as well.
  * @process_xml_sync: Virtual function that is called for every node in the
  * XML document created by @to_xml_sync. It is supposed to reconstruct the
  * session content from the XML data.
@@ -172,6 +207,12 @@ typedef enum _InfSessionSyncError {
  * function does ignore it when validating.
  * @user_new: Virtual function that creates a new user object with the given
  * properties.
+ * @set_xml_sync_features: Virtual function that writes the features this
+ * session supports on a connection into the XML node that begins or
+ * acknowledges a synchronization with that connection. Can be %NULL.
+ * @get_xml_sync_features: Virtual function that reads the features the
+ * remote session supports from the XML node that begins or acknowledges a
+ * synchronization on the given connection. Can be %NULL.
  * @close: Default signal handler for the #InfSession::close signal. This
  * cancels currently running synchronization in #InfSession.
  * @error: Default signal handler for the #InfSession::error signal.
@@ -202,6 +243,9 @@ struct _InfSessionClass {
   void(*to_xml_sync)(InfSession* session,
                      xmlNodePtr parent);
 
+  void(*init_sync_generator)(InfSession* session,
+                             InfSessionSyncGenerator* generator);
+
   gboolean(*process_xml_sync)(InfSession* session,
                               InfXmlConnection* connection,
                               xmlNodePtr xml,
@@ -231,6 +275,14 @@ struct _InfSessionClass {
                       GParameter* params,
                       guint n_params);
 
+  void(*set_xml_sync_features)(InfSession* session,
+                               InfXmlConnection* connection,
+                               xmlNodePtr xml);
+
+  void(*get_xml_sync_features)(InfSession* session,
+                               InfXmlConnection* connection,
+                               xmlNodePtr xml);
+
   /* Signals */
   void(*close)(InfSession* session);
   void(*error)(InfSession* session,
@@ -330,6 +382,10 @@ gdouble
 inf_session_get_synchronization_progress(InfSession* session,
                                          InfXmlConnection* connection);
 
+guint
+inf_session_get_synchronization_queue_length(InfSession* session,
+                                             InfXmlConnection* connection);
+
 gboolean
 inf_session_has_synchronizations(InfSession* session);
 
@@ -344,6 +400,17 @@ void
 inf_session_send_to_subscriptions(InfSession* session,
                                   xmlNodePtr xml);
 
+void
+inf_session_sync_generator_add_step(InfSessionSyncGenerator* generator,
+                                    guint n_messages,
+                                    InfSessionSyncGeneratorFunc func,
+                                    gpointer user_data,
+                                    GDestroyNotify notify);
+
+void
+inf_session_sync_generator_add_xml(InfSessionSyncGenerator* generator,
+                                   xmlNodePtr container);
+
 G_END_DECLS
 
 #endif /* __INF_SESSION_H__ */
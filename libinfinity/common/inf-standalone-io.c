@@ -36,14 +36,13 @@
  * another library such as a UI toolkit, a custom class should be created
  * instead which implements the #InfIo interface. For the GTK+ toolkit, there
  * is #InfGtkIo in the libinfgtk library, to integrate with the Glib main
- * loop.
+ * loop. On Linux, #InfEpollIo provides the same API as this class but scales
+ * better to a large number of sockets.
  */
 
 #include <libinfinity/common/inf-standalone-io.h>
 #include <libinfinity/common/inf-io.h>
 
-/* TODO: Modularize the FD handling, then add epoll support */
-
 #ifdef G_OS_WIN32
 # include <winsock2.h>
 #else
@@ -93,8 +92,13 @@ struct _InfIoWatch {
 };
 
 struct _InfIoTimeout {
-  GTimeVal begin;
-  guint msecs;
+  /* Monotonic time at which the timeout elapses, in microseconds */
+  gint64 deadline;
+  /* Orders timeouts with the same deadline by creation */
+  guint64 serial;
+  /* Position in the timeout heap, or G_MAXUINT if not in the heap */
+  guint index;
+
   InfIoTimeoutFunc func;
   gpointer user_data;
   GDestroyNotify notify;
@@ -117,7 +121,13 @@ struct _InfStandaloneIoPrivate {
   /* this array has fd_size-1 entries and fd_alloc-1 allocations: */
   InfIoWatch** watches;
 
-  GList* timeouts;
+  /* Binary min-heap of timeouts, ordered by deadline */
+  GPtrArray* timeouts;
+  /* The timeouts in the heap, to validate handles without dereferencing
+   * them */
+  GHashTable* timeout_handles;
+  guint64 timeout_serial;
+
   GList* dispatchs;
 
 #ifndef G_OS_WIN32
@@ -155,17 +165,158 @@ G_DEFINE_TYPE_WITH_CODE(InfStandaloneIo, inf_standalone_io, G_TYPE_OBJECT,
   G_ADD_PRIVATE(InfStandaloneIo)
   G_IMPLEMENT_INTERFACE(INF_TYPE_IO, inf_standalone_io_io_iface_init))
 
-static guint
-inf_standalone_io_timeval_diff(GTimeVal* first,
-                               GTimeVal* second)
+static gboolean
+inf_standalone_io_timeout_less(const InfIoTimeout* first,
+                               const InfIoTimeout* second)
+{
+  if(first->deadline != second->deadline)
+    return first->deadline < second->deadline;
+  return first->serial < second->serial;
+}
+
+static void
+inf_standalone_io_timeout_heap_set(InfStandaloneIoPrivate* priv,
+                                   guint index,
+                                   InfIoTimeout* timeout)
+{
+  g_ptr_array_index(priv->timeouts, index) = timeout;
+  timeout->index = index;
+}
+
+static void
+inf_standalone_io_timeout_heap_sift_up(InfStandaloneIoPrivate* priv,
+                                       guint index)
 {
-  g_assert(first->tv_sec > second->tv_sec ||
-           (first->tv_sec == second->tv_sec &&
-            first->tv_usec >= second->tv_usec));
+  InfIoTimeout* timeout;
+  InfIoTimeout* parent;
+
+  timeout = g_ptr_array_index(priv->timeouts, index);
+  while(index > 0)
+  {
+    parent = g_ptr_array_index(priv->timeouts, (index - 1) / 2);
+    if(!inf_standalone_io_timeout_less(timeout, parent))
+      break;
 
-  /* Don't risk overflow, don't need to convert to signed int */
-  return (first->tv_sec - second->tv_sec) * 1000 +
-         (first->tv_usec+500)/1000 - (second->tv_usec+500)/1000;
+    inf_standalone_io_timeout_heap_set(priv, index, parent);
+    index = (index - 1) / 2;
+  }
+
+  inf_standalone_io_timeout_heap_set(priv, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_sift_down(InfStandaloneIoPrivate* priv,
+                                         guint index)
+{
+  InfIoTimeout* timeout;
+  InfIoTimeout* child;
+  guint child_index;
+
+  timeout = g_ptr_array_index(priv->timeouts, index);
+  for(;;)
+  {
+    child_index = 2 * index + 1;
+    if(child_index >= priv->timeouts->len)
+      break;
+
+    child = g_ptr_array_index(priv->timeouts, child_index);
+    if(child_index + 1 < priv->timeouts->len &&
+       inf_standalone_io_timeout_less(
+         g_ptr_array_index(priv->timeouts, child_index + 1),
+         child))
+    {
+      ++child_index;
+      child = g_ptr_array_index(priv->timeouts, child_index);
+    }
+
+    if(!inf_standalone_io_timeout_less(child, timeout))
+      break;
+
+    inf_standalone_io_timeout_heap_set(priv, index, child);
+    index = child_index;
+  }
+
+  inf_standalone_io_timeout_heap_set(priv, index, timeout);
+}
+
+static void
+inf_standalone_io_timeout_heap_insert(InfStandaloneIoPrivate* priv,
+                                      InfIoTimeout* timeout)
+{
+  g_ptr_array_add(priv->timeouts, timeout);
+  g_hash_table_add(priv->timeout_handles, timeout);
+  timeout->index = priv->timeouts->len - 1;
+  inf_standalone_io_timeout_heap_sift_up(priv, timeout->index);
+}
+
+static void
+inf_standalone_io_timeout_heap_remove(InfStandaloneIoPrivate* priv,
+                                      InfIoTimeout* timeout)
+{
+  InfIoTimeout* last;
+  guint index;
+
+  index = timeout->index;
+  last = g_ptr_array_index(priv->timeouts, priv->timeouts->len - 1);
+  g_ptr_array_set_size(priv->timeouts, priv->timeouts->len - 1);
+  g_hash_table_remove(priv->timeout_handles, timeout);
+  timeout->index = G_MAXUINT;
+
+  /* Move the last element into the gap and restore the heap property */
+  if(last != timeout)
+  {
+    inf_standalone_io_timeout_heap_set(priv, index, last);
+    if(index > 0 &&
+       inf_standalone_io_timeout_less(
+         last,
+         g_ptr_array_index(priv->timeouts, (index - 1) / 2)))
+    {
+      inf_standalone_io_timeout_heap_sift_up(priv, index);
+    }
+    else
+    {
+      inf_standalone_io_timeout_heap_sift_down(priv, index);
+    }
+  }
+}
+
+/* Runs all timeouts that have elapsed. Timeouts that are added by the
+ * callbacks are not run, even if they elapse immediately, so that a timeout
+ * which re-schedules itself cannot block the loop. Call this only with the
+ * mutex locked. Returns whether a timeout was run. */
+static gboolean
+inf_standalone_io_dispatch_timeouts(InfStandaloneIo* io)
+{
+  InfStandaloneIoPrivate* priv;
+  InfIoTimeout* timeout;
+  gint64 current;
+  guint64 serial;
+  gboolean dispatched;
+
+  priv = INF_STANDALONE_IO_PRIVATE(io);
+  current = g_get_monotonic_time();
+  serial = priv->timeout_serial;
+  dispatched = FALSE;
+
+  while(priv->timeouts->len > 0)
+  {
+    timeout = g_ptr_array_index(priv->timeouts, 0);
+    if(timeout->deadline > current || timeout->serial >= serial)
+      break;
+
+    inf_standalone_io_timeout_heap_remove(priv, timeout);
+    g_mutex_unlock(&priv->mutex);
+
+    timeout->func(timeout->user_data);
+    if(timeout->notify)
+      timeout->notify(timeout->user_data);
+    g_slice_free(InfIoTimeout, timeout);
+
+    g_mutex_lock(&priv->mutex);
+    dispatched = TRUE;
+  }
+
+  return dispatched;
 }
 
 /* Run one iteration of the main loop. Call this only with the mutex locked
@@ -179,12 +330,10 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
   InfStandaloneIoPollResult result;
   guint i;
 
-  GList* item;
-  GTimeVal current;
   InfIoWatch* watch;
   InfIoTimeout* cur_timeout;
   InfIoDispatch* dispatch;
-  guint elapsed;
+  gint64 remaining;
 
 #ifdef G_OS_WIN32
   gchar* error_message;
@@ -203,29 +352,27 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
     /* TODO: Don't even poll */
     timeout = 0;
   }
-  else
+  else if(priv->timeouts->len > 0)
   {
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+    cur_timeout = g_ptr_array_index(priv->timeouts, 0);
+    remaining = cur_timeout->deadline - g_get_monotonic_time();
+
+    if(remaining <= 0)
     {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
+      /* already elapsed */
+      timeout = 0;
+    }
+    else
+    {
+      /* Round up, so that we do not wake up before the deadline */
+      remaining = (remaining + 999) / 1000;
+      if(remaining > G_MAXINT)
+        remaining = G_MAXINT;
 
-      if(elapsed >= cur_timeout->msecs)
-      {
-        /* already elapsed */
-        /* TODO: Don't even poll */
-        timeout = 0;
-        /* no need to check other timeouts */
-        break;
-      }
-      else
+      if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
+         (guint)remaining < (guint)timeout)
       {
-        if(timeout == INF_STANDALONE_IO_POLL_INFINITE ||
-           cur_timeout->msecs - elapsed < (guint)timeout)
-        {
-          timeout = cur_timeout->msecs - elapsed;
-        }
+        timeout = (InfStandaloneIoPollTimeout)remaining;
       }
     }
   }
@@ -263,26 +410,9 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
 
   if(result == INF_STANDALONE_IO_POLL_TIMEOUT)
   {
-    /* No file descriptor is active, so check whether a timeout elapsed */
-    g_get_current_time(&current);
-    for(item = priv->timeouts; item != NULL; item = g_list_next(item))
-    {
-      cur_timeout = (InfIoTimeout*)item->data;
-      elapsed = inf_standalone_io_timeval_diff(&current, &cur_timeout->begin);
-      if(elapsed >= cur_timeout->msecs)
-      {
-        priv->timeouts = g_list_delete_link(priv->timeouts, item);
-        g_mutex_unlock(&priv->mutex);
-
-        cur_timeout->func(cur_timeout->user_data);
-        if(cur_timeout->notify)
-          cur_timeout->notify(cur_timeout->user_data);
-        g_slice_free(InfIoTimeout, cur_timeout);
-
-        g_mutex_lock(&priv->mutex);
-        return;
-      }
-    }
+    /* No file descriptor is active, so run all timeouts that elapsed */
+    if(inf_standalone_io_dispatch_timeouts(io))
+      return;
   }
 #ifdef G_OS_WIN32
   else if(result >= WSA_WAIT_EVENT_0 &&
@@ -338,6 +468,8 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
         g_mutex_lock(&priv->mutex);
       }
 
+      /* Don't let busy sockets hold back elapsed timeouts */
+      inf_standalone_io_dispatch_timeouts(io);
       return;
     }
   }
@@ -422,6 +554,8 @@ inf_standalone_io_iteration_impl(InfStandaloneIo* io,
               g_mutex_lock(&priv->mutex);
             }
 
+            /* Don't let busy sockets hold back elapsed timeouts */
+            inf_standalone_io_dispatch_timeouts(io);
             return;
           }
         }
@@ -492,7 +626,9 @@ inf_standalone_io_init(InfStandaloneIo* io)
 #endif
 
   priv->watches = g_malloc(sizeof(InfIoWatch*) * (priv->fd_alloc - 1) );
-  priv->timeouts = NULL;
+  priv->timeouts = g_ptr_array_new();
+  priv->timeout_handles = g_hash_table_new(NULL, NULL);
+  priv->timeout_serial = 0;
   priv->dispatchs = NULL;
 
   priv->polling = FALSE;
@@ -541,9 +677,9 @@ inf_standalone_io_finalize(GObject* object)
     g_slice_free(InfIoWatch, watch);
   }
 
-  for(item = priv->timeouts; item != NULL; item = g_list_next(item))
+  for(i = 0; i < priv->timeouts->len; ++i)
   {
-    timeout = (InfIoTimeout*)item->data;
+    timeout = g_ptr_array_index(priv->timeouts, i);
     if(timeout->notify)
       timeout->notify(timeout->user_data);
     g_slice_free(InfIoTimeout, timeout);
@@ -571,7 +707,8 @@ inf_standalone_io_finalize(GObject* object)
 
   g_free(priv->events);
   g_free(priv->watches);
-  g_list_free(priv->timeouts);
+  g_ptr_array_free(priv->timeouts, TRUE);
+  g_hash_table_destroy(priv->timeout_handles);
   g_list_free(priv->dispatchs);
 
 #ifndef G_OS_WIN32
@@ -956,15 +1093,18 @@ inf_standalone_io_io_add_timeout(InfIo* io,
   priv = INF_STANDALONE_IO_PRIVATE(io);
   timeout = g_slice_new(InfIoTimeout);
 
-  g_get_current_time(&timeout->begin);
-  timeout->msecs = msecs;
+  timeout->deadline = g_get_monotonic_time() + (gint64)msecs * 1000;
   timeout->func = func;
   timeout->user_data = user_data;
   timeout->notify = notify;
 
   g_mutex_lock(&priv->mutex);
-  priv->timeouts = g_list_prepend(priv->timeouts, timeout);
-  inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
+  timeout->serial = priv->timeout_serial++;
+  inf_standalone_io_timeout_heap_insert(priv, timeout);
+
+  /* Only wake up the main loop if it needs to wake up earlier now */
+  if(timeout->index == 0)
+    inf_standalone_io_wakeup(INF_STANDALONE_IO(io));
   g_mutex_unlock(&priv->mutex);
 
   return timeout;
@@ -975,16 +1115,23 @@ inf_standalone_io_io_remove_timeout(InfIo* io,
                                     InfIoTimeout* timeout)
 {
   InfStandaloneIoPrivate* priv;
-  GList* item;
 
   priv = INF_STANDALONE_IO_PRIVATE(io);
 
   g_mutex_lock(&priv->mutex);
 
-  item = g_list_find(priv->timeouts, timeout);
-  if(item != NULL)
+  /* @timeout must have been returned by inf_io_add_timeout() on this
+   * InfStandaloneIo. An elapsed timeout is taken out of the heap before its
+   * callback runs and is freed afterwards, so the handle may be dangling.
+   * Look it up before dereferencing it, so that removing a timeout which
+   * has elapsed or was removed before does nothing, as it did when the
+   * timeouts were kept in a list. */
+  if(g_hash_table_contains(priv->timeout_handles, timeout))
   {
-    priv->timeouts = g_list_delete_link(priv->timeouts, item);
+    g_assert(timeout->index < priv->timeouts->len &&
+             g_ptr_array_index(priv->timeouts, timeout->index) == timeout);
+
+    inf_standalone_io_timeout_heap_remove(priv, timeout);
     g_mutex_unlock(&priv->mutex);
 
     if(timeout->notify)
@@ -1098,7 +1245,8 @@ inf_standalone_io_new(void)
  * @io: A #InfStandaloneIo.
  *
  * Performs a single iteration of @io. The call will block until a first
- * event has occurred. Then, it will process that event and return.
+ * event has occurred. Then, it will process that event and return. All
+ * timeouts that have elapsed at that point are processed together.
  **/
 void
 inf_standalone_io_iteration(InfStandaloneIo* io)
@@ -63,12 +63,40 @@
 # include <unistd.h>
 # include <fcntl.h>
 
+# include <sys/uio.h>
+
 # include <errno.h>
 # include <string.h>
 #else
 # include <ws2tcpip.h>
 #endif
 
+/* The receive buffer starts small and doubles whenever a recv() call fills
+ * it completely, up to the maximum size. It shrinks again when the
+ * connection only sees small amounts of data. */
+#define INF_TCP_CONNECTION_RECV_BUFFER_MIN 4096
+#define INF_TCP_CONNECTION_RECV_BUFFER_MAX (256 * 1024)
+
+/* Small messages are coalesced into send queue segments of at least this
+ * size. */
+#define INF_TCP_CONNECTION_SEGMENT_SIZE 4096
+
+/* Maximum number of segments to pass to a single sendmsg() call */
+#define INF_TCP_CONNECTION_MAX_IOV 64
+
+/* A segment either owns its data, in which case more data can be appended
+ * as long as it fits into alloc, or it references a GBytes given to
+ * inf_tcp_connection_send_bytes(), in which case data points into the
+ * GBytes, is never modified and alloc is equal to len. */
+typedef struct _InfTcpConnectionSegment InfTcpConnectionSegment;
+struct _InfTcpConnectionSegment {
+  GBytes* bytes;
+  guint8* data;
+  gsize offset; /* number of bytes already sent */
+  gsize len;
+  gsize alloc;
+};
+
 static const GEnumValue inf_tcp_connection_status_values[] = {
   {
     INF_TCP_CONNECTION_CONNECTING,
@@ -106,10 +134,11 @@ struct _InfTcpConnectionPrivate {
   guint remote_port;
   unsigned int device_index;
 
-  guint8* queue;
-  gsize front_pos;
-  gsize back_pos;
-  gsize alloc;
+  /* Data waiting to be sent, as a queue of InfTcpConnectionSegment */
+  GQueue queue;
+
+  guint8* recv_buffer;
+  gsize recv_size;
 };
 
 enum {
@@ -269,6 +298,82 @@ inf_tcp_connection_system_error(InfTcpConnection* connection,
   g_error_free(error);
 }
 
+static void
+inf_tcp_connection_segment_free(InfTcpConnectionSegment* segment)
+{
+  if(segment->bytes != NULL)
+    g_bytes_unref(segment->bytes);
+  else
+    g_free(segment->data);
+
+  g_slice_free(InfTcpConnectionSegment, segment);
+}
+
+static void
+inf_tcp_connection_clear_queue(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  InfTcpConnectionSegment* segment;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  while(!g_queue_is_empty(&priv->queue))
+  {
+    segment = g_queue_pop_head(&priv->queue);
+    inf_tcp_connection_segment_free(segment);
+  }
+}
+
+/* Appends data to the send queue. Small amounts of data are appended to
+ * the last segment if it has room, so that many small messages do not end
+ * up as many small segments. */
+static void
+inf_tcp_connection_enqueue(InfTcpConnection* connection,
+                           gconstpointer data,
+                           gsize len)
+{
+  InfTcpConnectionPrivate* priv;
+  InfTcpConnectionSegment* segment;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  segment = g_queue_peek_tail(&priv->queue);
+
+  if(segment == NULL || segment->alloc - segment->len < len)
+  {
+    segment = g_slice_new(InfTcpConnectionSegment);
+    segment->bytes = NULL;
+    segment->alloc = MAX(len, INF_TCP_CONNECTION_SEGMENT_SIZE);
+    segment->data = g_malloc(segment->alloc);
+    segment->offset = 0;
+    segment->len = 0;
+    g_queue_push_tail(&priv->queue, segment);
+  }
+
+  memcpy(segment->data + segment->len, data, len);
+  segment->len += len;
+}
+
+/* Appends a reference to bytes to the send queue, of which the first
+ * offset bytes have already been sent. */
+static void
+inf_tcp_connection_enqueue_bytes(InfTcpConnection* connection,
+                                 GBytes* bytes,
+                                 gsize offset)
+{
+  InfTcpConnectionPrivate* priv;
+  InfTcpConnectionSegment* segment;
+  gsize size;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  segment = g_slice_new(InfTcpConnectionSegment);
+  segment->bytes = g_bytes_ref(bytes);
+  segment->data = (guint8*)g_bytes_get_data(bytes, &size);
+  segment->offset = offset;
+  segment->len = size;
+  segment->alloc = size;
+  g_queue_push_tail(&priv->queue, segment);
+}
+
 static void
 inf_tcp_connection_io(InfNativeSocket* socket,
                       InfIoEvent events,
@@ -282,8 +387,7 @@ inf_tcp_connection_connected(InfTcpConnection* connection)
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
 
   priv->status = INF_TCP_CONNECTION_CONNECTED;
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
 
   priv->events = INF_IO_INCOMING | INF_IO_ERROR;
 
@@ -634,21 +738,103 @@ inf_tcp_connection_send_real(InfTcpConnection* connection,
   return TRUE;
 }
 
+/* Sends as much of the send queue as the kernel accepts with a single
+ * scatter/gather call. Returns the number of bytes sent, or -1 on error in
+ * which case the error has been reported already. */
+static gssize
+inf_tcp_connection_send_queue(InfTcpConnection* connection)
+{
+  InfTcpConnectionPrivate* priv;
+  InfTcpConnectionSegment* segment;
+  GList* item;
+  guint n_iov;
+  int errcode;
+#ifdef G_OS_WIN32
+  WSABUF iov[INF_TCP_CONNECTION_MAX_IOV];
+  DWORD sent;
+  int ret;
+#else
+  struct iovec iov[INF_TCP_CONNECTION_MAX_IOV];
+  struct msghdr msg;
+#endif
+  gssize result;
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+
+  n_iov = 0;
+  for(item = priv->queue.head;
+      item != NULL && n_iov < INF_TCP_CONNECTION_MAX_IOV;
+      item = item->next)
+  {
+    segment = (InfTcpConnectionSegment*)item->data;
+#ifdef G_OS_WIN32
+    iov[n_iov].buf = (char*)segment->data + segment->offset;
+    iov[n_iov].len = segment->len - segment->offset;
+#else
+    iov[n_iov].iov_base = segment->data + segment->offset;
+    iov[n_iov].iov_len = segment->len - segment->offset;
+#endif
+    ++n_iov;
+  }
+
+#ifndef G_OS_WIN32
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = n_iov;
+#endif
+
+  do
+  {
+#ifdef G_OS_WIN32
+    ret = WSASend(priv->socket, iov, n_iov, &sent, 0, NULL, NULL);
+    result = (ret == 0) ? (gssize)sent : -1;
+#else
+    /* Use sendmsg() instead of writev() so that we can pass
+     * INF_NATIVE_SOCKET_SENDRECV_FLAGS, which prevents SIGPIPE. */
+    result = sendmsg(priv->socket, &msg, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+#endif
+    errcode = INF_NATIVE_SOCKET_LAST_ERROR;
+  } while(result < 0 && errcode == INF_NATIVE_SOCKET_EINTR);
+
+  if(result < 0)
+  {
+    if(errcode == INF_NATIVE_SOCKET_EAGAIN)
+      return 0;
+
+    inf_tcp_connection_system_error(connection, errcode);
+    return -1;
+  }
+  else if(result == 0)
+  {
+    inf_tcp_connection_close(connection);
+    return -1;
+  }
+
+  return result;
+}
+
 static void
 inf_tcp_connection_io_incoming(InfTcpConnection* connection)
 {
   InfTcpConnectionPrivate* priv;
-  gchar buf[2048];
   int errcode;
   ssize_t result;
+  gsize max_received;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
 
   g_assert(priv->status == INF_TCP_CONNECTION_CONNECTED);
 
+  max_received = 0;
   do
   {
-    result = recv(priv->socket, buf, 2048, INF_NATIVE_SOCKET_SENDRECV_FLAGS);
+    result = recv(
+      priv->socket,
+      priv->recv_buffer,
+      priv->recv_size,
+      INF_NATIVE_SOCKET_SENDRECV_FLAGS
+    );
+
     errcode = INF_NATIVE_SOCKET_LAST_ERROR;
 
     if(result < 0 &&
@@ -667,13 +853,36 @@ inf_tcp_connection_io_incoming(InfTcpConnection* connection)
         G_OBJECT(connection),
         tcp_connection_signals[RECEIVED],
         0,
-        buf,
+        priv->recv_buffer,
         (guint)result
       );
+
+      if((gsize)result > max_received)
+        max_received = result;
+
+      /* More data is probably waiting, so read it in bigger chunks. This
+       * keeps the number of signal emissions and parser invocations low
+       * when a lot of data arrives, such as during synchronization. */
+      if((gsize)result == priv->recv_size &&
+         priv->recv_size < INF_TCP_CONNECTION_RECV_BUFFER_MAX)
+      {
+        priv->recv_size *= 2;
+        g_free(priv->recv_buffer);
+        priv->recv_buffer = g_malloc(priv->recv_size);
+      }
     }
   } while( ((result > 0) ||
             (result < 0 && errcode == INF_NATIVE_SOCKET_EINTR)) &&
            (priv->status != INF_TCP_CONNECTION_CLOSED));
+
+  /* Give memory back when the connection has calmed down again */
+  if(max_received < priv->recv_size / 4 &&
+     priv->recv_size > INF_TCP_CONNECTION_RECV_BUFFER_MIN)
+  {
+    priv->recv_size /= 2;
+    g_free(priv->recv_buffer);
+    priv->recv_buffer = g_malloc(priv->recv_size);
+  }
 }
 
 static void
@@ -684,8 +893,12 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
   socklen_t len;
   int errcode;
 
-  gconstpointer data;
-  guint data_len;
+  InfTcpConnectionSegment* segment;
+  InfTcpConnectionSegment* partial;
+  GQueue sent;
+  gssize result;
+  gsize segment_len;
+  gsize partial_len;
 
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
   switch(priv->status)
@@ -709,32 +922,72 @@ inf_tcp_connection_io_outgoing(InfTcpConnection* connection)
 
     break;
   case INF_TCP_CONNECTION_CONNECTED:
-    g_assert(priv->back_pos < priv->front_pos);
+    g_assert(!g_queue_is_empty(&priv->queue));
     g_assert(priv->events & INF_IO_OUTGOING);
 
-    data = priv->queue + priv->back_pos;
-    data_len = priv->front_pos - priv->back_pos;
-    if(inf_tcp_connection_send_real(connection, data, &data_len) == TRUE)
+    result = inf_tcp_connection_send_queue(connection);
+    if(result <= 0)
+      break;
+
+    /* Take the segments that have been sent completely out of the queue
+     * before emitting any signals, since signal handlers might send more
+     * data or close the connection. */
+    g_queue_init(&sent);
+    partial = NULL;
+    partial_len = 0;
+
+    while(result > 0)
     {
-      priv->back_pos += data_len;
+      segment = g_queue_peek_head(&priv->queue);
+      segment_len = segment->len - segment->offset;
 
-      if(priv->front_pos == priv->back_pos)
+      if((gsize)result >= segment_len)
       {
-        /* sent everything */
-        priv->front_pos = 0;
-        priv->back_pos = 0;
+        g_queue_push_tail(&sent, g_queue_pop_head(&priv->queue));
+        result -= segment_len;
+      }
+      else
+      {
+        /* A partially sent segment stays in the queue */
+        partial = segment;
+        partial_len = result;
+        segment->offset += result;
+        result = 0;
+      }
+    }
 
-        priv->events &= ~INF_IO_OUTGOING;
+    if(g_queue_is_empty(&priv->queue))
+    {
+      /* sent everything */
+      priv->events &= ~INF_IO_OUTGOING;
+      inf_io_update_watch(priv->io, priv->watch, priv->events);
+    }
 
-        inf_io_update_watch(priv->io, priv->watch, priv->events);
-      }
+    while(!g_queue_is_empty(&sent))
+    {
+      segment = g_queue_pop_head(&sent);
 
       g_signal_emit(
         G_OBJECT(connection),
         tcp_connection_signals[SENT],
         0,
-        data,
-        data_len
+        segment->data + segment->offset,
+        (guint)(segment->len - segment->offset)
+      );
+
+      inf_tcp_connection_segment_free(segment);
+    }
+
+    /* If a signal handler closed the connection, then the partially sent
+     * segment has been freed together with the rest of the queue. */
+    if(partial != NULL && priv->status == INF_TCP_CONNECTION_CONNECTED)
+    {
+      g_signal_emit(
+        G_OBJECT(connection),
+        tcp_connection_signals[SENT],
+        0,
+        partial->data + partial->offset - partial_len,
+        (guint)partial_len
       );
     }
 
@@ -910,10 +1163,10 @@ inf_tcp_connection_init(InfTcpConnection* connection)
   priv->remote_port = 0;
   priv->device_index = 0;
 
-  priv->queue = g_malloc(1024);
-  priv->front_pos = 0;
-  priv->back_pos = 0;
-  priv->alloc = 1024;
+  g_queue_init(&priv->queue);
+
+  priv->recv_size = INF_TCP_CONNECTION_RECV_BUFFER_MIN;
+  priv->recv_buffer = g_malloc(priv->recv_size);
 }
 
 static void
@@ -954,7 +1207,8 @@ inf_tcp_connection_finalize(GObject* object)
   if(priv->socket != INVALID_SOCKET)
     closesocket(priv->socket);
 
-  g_free(priv->queue);
+  inf_tcp_connection_clear_queue(connection);
+  g_free(priv->recv_buffer);
 
   G_OBJECT_CLASS(inf_tcp_connection_parent_class)->finalize(object);
 }
@@ -1588,44 +1842,31 @@ inf_tcp_connection_close(InfTcpConnection* connection)
     priv->watch = NULL;
   }
 
-  priv->front_pos = 0;
-  priv->back_pos = 0;
+  inf_tcp_connection_clear_queue(connection);
 
   priv->status = INF_TCP_CONNECTION_CLOSED;
   g_object_notify(G_OBJECT(connection), "status");
 }
 
-/**
- * inf_tcp_connection_send:
- * @connection: A #InfTcpConnection with status %INF_TCP_CONNECTION_CONNECTED.
- * @data: (type guint8*) (array length=len): The data to send.
- * @len: Number of bytes to send.
- *
- * Sends data through the TCP connection. The data is not sent immediately,
- * but enqueued to a buffer and will be sent as soon as kernel space
- * becomes available. The "sent" signal will be emitted when data has
- * really been sent.
- **/
-void
-inf_tcp_connection_send(InfTcpConnection* connection,
-                        gconstpointer data,
-                        guint len)
+/* Sends data right away if possible, and queues what could not be sent.
+ * If bytes is non-NULL, then data is the content of bytes, and the rest of
+ * it is queued by reference instead of being copied. */
+static void
+inf_tcp_connection_send_data(InfTcpConnection* connection,
+                             gconstpointer data,
+                             guint len,
+                             GBytes* bytes)
 {
   InfTcpConnectionPrivate* priv;
   gconstpointer sent_data;
   guint sent_len;
 
-  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
-  g_return_if_fail(len == 0 || data != NULL);
-
   priv = INF_TCP_CONNECTION_PRIVATE(connection);
-  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
-
   g_object_ref(connection);
 
   /* Check whether we have data currently queued. If we have, then we need
    * to wait until that data has been sent before sending the new data. */
-  if(priv->front_pos == priv->back_pos)
+  if(g_queue_is_empty(&priv->queue))
   {
     /* Must not be set, because otherwise we would need something to send,
      * but there is nothing in the queue. */
@@ -1657,35 +1898,10 @@ inf_tcp_connection_send(InfTcpConnection* connection,
   /* If we couldn't send all the data... */
   if(len > 0)
   {
-    /* If we have not enough space for the new data, move queue data back
-     * onto the beginning of the queue, if not already */
-    if(priv->alloc - priv->front_pos < len && priv->back_pos > 0)
-    {
-      memmove(
-        priv->queue,
-        priv->queue + priv->back_pos,
-        priv->front_pos - priv->back_pos
-      );
-
-      priv->front_pos -= priv->back_pos;
-      priv->back_pos = 0;
-    }
-
-    /* Allocate more memory if there is still not enough space */
-    if(priv->alloc - priv->front_pos < len)
-    {
-      /* Make sure we allocate enough */
-      priv->alloc = priv->front_pos + len;
-
-      /* Always allocate a multiple of 1024 */
-      if(priv->alloc % 1024 != 0)
-        priv->alloc = priv->alloc + (1024 - priv->alloc % 1024);
-
-      priv->queue = g_realloc(priv->queue, priv->alloc);
-    }
-
-    memcpy(priv->queue + priv->front_pos, data, len);
-    priv->front_pos += len;
+    if(bytes != NULL)
+      inf_tcp_connection_enqueue_bytes(connection, bytes, sent_len);
+    else
+      inf_tcp_connection_enqueue(connection, data, len);
 
     if(~priv->events & INF_IO_OUTGOING)
     {
@@ -1708,6 +1924,67 @@ inf_tcp_connection_send(InfTcpConnection* connection,
   g_object_unref(connection);
 }
 
+/**
+ * inf_tcp_connection_send:
+ * @connection: A #InfTcpConnection with status %INF_TCP_CONNECTION_CONNECTED.
+ * @data: (type guint8*) (array length=len): The data to send.
+ * @len: Number of bytes to send.
+ *
+ * Sends data through the TCP connection. The data is not sent immediately,
+ * but enqueued to a buffer and will be sent as soon as kernel space
+ * becomes available. The "sent" signal will be emitted when data has
+ * really been sent.
+ **/
+void
+inf_tcp_connection_send(InfTcpConnection* connection,
+                        gconstpointer data,
+                        guint len)
+{
+  InfTcpConnectionPrivate* priv;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  g_return_if_fail(len == 0 || data != NULL);
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  inf_tcp_connection_send_data(connection, data, len, NULL);
+}
+
+/**
+ * inf_tcp_connection_send_bytes:
+ * @connection: A #InfTcpConnection with status
+ * %INF_TCP_CONNECTION_CONNECTED.
+ * @bytes: The data to send.
+ *
+ * Sends data through the TCP connection, like inf_tcp_connection_send().
+ * The difference is that if the data cannot be sent immediately, then the
+ * connection keeps a reference on @bytes until it has been sent, instead of
+ * copying the data into its send buffer. This avoids copying large amounts
+ * of already serialized data. The "sent" signal will be emitted when the
+ * data has really been sent.
+ **/
+void
+inf_tcp_connection_send_bytes(InfTcpConnection* connection,
+                              GBytes* bytes)
+{
+  InfTcpConnectionPrivate* priv;
+  gconstpointer data;
+  gsize size;
+
+  g_return_if_fail(INF_IS_TCP_CONNECTION(connection));
+  g_return_if_fail(bytes != NULL);
+
+  priv = INF_TCP_CONNECTION_PRIVATE(connection);
+  g_return_if_fail(priv->status == INF_TCP_CONNECTION_CONNECTED);
+
+  data = g_bytes_get_data(bytes, &size);
+  g_return_if_fail(size <= G_MAXUINT);
+
+  if(size > 0)
+    inf_tcp_connection_send_data(connection, data, (guint)size, bytes);
+}
+
 /**
  * inf_tcp_connection_get_remote_address:
  * @connection: A #InfTcpConnection.
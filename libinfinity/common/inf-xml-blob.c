@@ -0,0 +1,448 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-xml-blob
+ * @title: InfXmlBlob
+ * @short_description: XML messages serialized once and shared
+ * @see_also: #InfCommunicationRegistry, #InfXmppConnection
+ * @include: libinfinity/common/inf-xml-blob.h
+ * @stability: Unstable
+ *
+ * #InfXmlBlob is a reference-counted, immutable XML message together with
+ * its serialized representation. It is used when the same message is sent
+ * to many connections, such as for group broadcasts, so that the message
+ * needs to be serialized only once and does not need to be copied for
+ * every recipient.
+ *
+ * A blob can be placed into a larger XML tree by means of a reference node,
+ * created with inf_xml_blob_reference_new(). A reference node is a childless
+ * element that stands in for the blob's message and owns one reference on
+ * the blob. Reference nodes are only recognized as the root of a tree or as
+ * a direct child of it, which is how #InfCommunicationRegistry places
+ * messages into its group containers. Code that frees such a tree needs to
+ * call inf_xml_blob_release_references() before xmlFreeNode(), and
+ * inf_xml_blob_dump() should be used to serialize it.
+ *
+ * Since a blob is never modified after creation and its reference count is
+ * updated atomically, blobs may be shared between threads.
+ **/
+
+#include <libinfinity/common/inf-xml-blob.h>
+
+struct _InfXmlBlob {
+  gint ref_count;
+
+  xmlNodePtr xml;
+  xmlBufferPtr buffer;
+};
+
+/* Stored in the psvi field of reference nodes, to distinguish them from
+ * regular nodes which might use _private for something else. */
+static const gchar inf_xml_blob_reference_tag[] = "InfXmlBlob";
+
+G_DEFINE_BOXED_TYPE(InfXmlBlob, inf_xml_blob, inf_xml_blob_ref, inf_xml_blob_unref)
+
+static gboolean
+inf_xml_blob_is_reference(xmlNodePtr xml)
+{
+  return xml->type == XML_ELEMENT_NODE &&
+         xml->psvi == (void*)inf_xml_blob_reference_tag &&
+         xml->_private != NULL;
+}
+
+static gboolean
+inf_xml_blob_has_reference_children(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+
+  for(child = xml->children; child != NULL; child = child->next)
+    if(inf_xml_blob_is_reference(child))
+      return TRUE;
+
+  return FALSE;
+}
+
+static void
+inf_xml_blob_dump_qname(xmlBufferPtr buffer,
+                        xmlNsPtr ns,
+                        const xmlChar* name)
+{
+  if(ns != NULL && ns->prefix != NULL)
+  {
+    xmlBufferCat(buffer, ns->prefix);
+    xmlBufferCCat(buffer, ":");
+  }
+
+  xmlBufferCat(buffer, name);
+}
+
+/* Serializes xml, which is neither a reference itself nor a tree without
+ * any references. */
+static void
+inf_xml_blob_dump_container(xmlBufferPtr buffer,
+                            xmlDocPtr doc,
+                            xmlNodePtr xml)
+{
+  xmlNsPtr ns;
+  xmlAttrPtr attr;
+  xmlChar* value;
+  xmlNodePtr child;
+  InfXmlBlob* blob;
+
+  xmlBufferCCat(buffer, "<");
+  inf_xml_blob_dump_qname(buffer, xml->ns, xml->name);
+
+  for(ns = xml->nsDef; ns != NULL; ns = ns->next)
+  {
+    xmlBufferCCat(buffer, " xmlns");
+    if(ns->prefix != NULL)
+    {
+      xmlBufferCCat(buffer, ":");
+      xmlBufferCat(buffer, ns->prefix);
+    }
+
+    xmlBufferCCat(buffer, "=");
+    xmlBufferWriteQuotedString(buffer, ns->href);
+  }
+
+  for(attr = xml->properties; attr != NULL; attr = attr->next)
+  {
+    xmlBufferCCat(buffer, " ");
+    inf_xml_blob_dump_qname(buffer, attr->ns, attr->name);
+    xmlBufferCCat(buffer, "=\"");
+
+    value = xmlNodeListGetString(doc, attr->children, 1);
+    if(value != NULL)
+    {
+      xmlAttrSerializeTxtContent(buffer, doc, attr, value);
+      xmlFree(value);
+    }
+
+    xmlBufferCCat(buffer, "\"");
+  }
+
+  xmlBufferCCat(buffer, ">");
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(inf_xml_blob_is_reference(child))
+    {
+      blob = (InfXmlBlob*)child->_private;
+      xmlBufferAdd(
+        buffer,
+        xmlBufferContent(blob->buffer),
+        xmlBufferLength(blob->buffer)
+      );
+    }
+    else
+    {
+      xmlNodeDump(buffer, doc, child, 0, 0);
+    }
+  }
+
+  xmlBufferCCat(buffer, "</");
+  inf_xml_blob_dump_qname(buffer, xml->ns, xml->name);
+  xmlBufferCCat(buffer, ">");
+}
+
+/**
+ * inf_xml_blob_new: (constructor)
+ * @xml: (transfer full): The XML message to share.
+ *
+ * Creates a new #InfXmlBlob holding @xml, and serializes @xml. The function
+ * takes ownership of @xml, which must not be modified anymore afterwards,
+ * since the serialized representation would no longer match.
+ *
+ * Returns: (transfer full): A new #InfXmlBlob. Free with
+ * inf_xml_blob_unref() when no longer needed.
+ */
+InfXmlBlob*
+inf_xml_blob_new(xmlNodePtr xml)
+{
+  InfXmlBlob* blob;
+
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  xmlUnlinkNode(xml);
+
+  blob = g_slice_new(InfXmlBlob);
+  blob->ref_count = 1;
+  blob->xml = xml;
+  blob->buffer = xmlBufferCreate();
+
+  xmlNodeDump(blob->buffer, NULL, xml, 0, 0);
+  return blob;
+}
+
+/**
+ * inf_xml_blob_ref:
+ * @blob: A #InfXmlBlob.
+ *
+ * Increases the reference count of @blob by one.
+ *
+ * Returns: The same @blob.
+ */
+InfXmlBlob*
+inf_xml_blob_ref(InfXmlBlob* blob)
+{
+  g_return_val_if_fail(blob != NULL, NULL);
+
+  g_atomic_int_inc(&blob->ref_count);
+  return blob;
+}
+
+/**
+ * inf_xml_blob_unref:
+ * @blob: A #InfXmlBlob.
+ *
+ * Decreases the reference count of @blob by one. If the reference count
+ * reaches zero, then @blob is freed.
+ */
+void
+inf_xml_blob_unref(InfXmlBlob* blob)
+{
+  g_return_if_fail(blob != NULL);
+
+  if(g_atomic_int_dec_and_test(&blob->ref_count))
+  {
+    xmlBufferFree(blob->buffer);
+    xmlFreeNode(blob->xml);
+    g_slice_free(InfXmlBlob, blob);
+  }
+}
+
+/**
+ * inf_xml_blob_get_xml:
+ * @blob: A #InfXmlBlob.
+ *
+ * Returns the XML message held by @blob. It must not be modified.
+ *
+ * Returns: (transfer none): The XML message held by @blob.
+ */
+xmlNodePtr
+inf_xml_blob_get_xml(const InfXmlBlob* blob)
+{
+  g_return_val_if_fail(blob != NULL, NULL);
+  return blob->xml;
+}
+
+/**
+ * inf_xml_blob_get_data:
+ * @blob: A #InfXmlBlob.
+ * @length: (out): Location to store the length of the serialized message,
+ * in bytes.
+ *
+ * Returns the serialized representation of the message held by @blob. The
+ * data is not null-terminated.
+ *
+ * Returns: (transfer none): The serialized message, owned by @blob.
+ */
+const gchar*
+inf_xml_blob_get_data(const InfXmlBlob* blob,
+                      gsize* length)
+{
+  g_return_val_if_fail(blob != NULL, NULL);
+  g_return_val_if_fail(length != NULL, NULL);
+
+  *length = xmlBufferLength(blob->buffer);
+  return (const gchar*)xmlBufferContent(blob->buffer);
+}
+
+/**
+ * inf_xml_blob_reference_new:
+ * @blob: A #InfXmlBlob.
+ *
+ * Creates a new reference node for @blob. The node has the same name as the
+ * message held by @blob, but no attributes or children. It holds a reference
+ * on @blob which is released by inf_xml_blob_release_references().
+ *
+ * Returns: (transfer full): A new reference node.
+ */
+xmlNodePtr
+inf_xml_blob_reference_new(InfXmlBlob* blob)
+{
+  xmlNodePtr xml;
+
+  g_return_val_if_fail(blob != NULL, NULL);
+
+  xml = xmlNewNode(NULL, blob->xml->name);
+  xml->_private = inf_xml_blob_ref(blob);
+  xml->psvi = (void*)inf_xml_blob_reference_tag;
+  return xml;
+}
+
+/**
+ * inf_xml_blob_reference_get_blob:
+ * @xml: A XML node.
+ *
+ * If @xml is a reference node created with inf_xml_blob_reference_new(),
+ * then returns the #InfXmlBlob it refers to. Otherwise, returns %NULL.
+ *
+ * Returns: (transfer none) (allow-none): The #InfXmlBlob referred to by
+ * @xml, or %NULL.
+ */
+InfXmlBlob*
+inf_xml_blob_reference_get_blob(xmlNodePtr xml)
+{
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  if(!inf_xml_blob_is_reference(xml))
+    return NULL;
+
+  return (InfXmlBlob*)xml->_private;
+}
+
+/**
+ * inf_xml_blob_reference_resolve:
+ * @xml: A XML node.
+ *
+ * If @xml is a reference node, then returns the XML message of the blob it
+ * refers to. Otherwise, returns @xml itself. This is useful to hand out the
+ * actual message to code which inspects it.
+ *
+ * Returns: (transfer none): The XML message @xml stands for.
+ */
+xmlNodePtr
+inf_xml_blob_reference_resolve(xmlNodePtr xml)
+{
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  if(!inf_xml_blob_is_reference(xml))
+    return xml;
+
+  return ((InfXmlBlob*)xml->_private)->xml;
+}
+
+/**
+ * inf_xml_blob_copy_tree:
+ * @xml: A XML node, possibly containing reference nodes.
+ *
+ * Creates a deep copy of @xml. Unlike xmlCopyNode(), reference nodes in
+ * @xml are copied as new reference nodes to the same blob, instead of
+ * being copied as empty elements.
+ *
+ * Returns: (transfer full): A copy of @xml.
+ */
+xmlNodePtr
+inf_xml_blob_copy_tree(xmlNodePtr xml)
+{
+  xmlNodePtr copy;
+  xmlNodePtr child;
+
+  g_return_val_if_fail(xml != NULL, NULL);
+
+  if(inf_xml_blob_is_reference(xml))
+    return inf_xml_blob_reference_new((InfXmlBlob*)xml->_private);
+  if(!inf_xml_blob_has_reference_children(xml))
+    return xmlCopyNode(xml, 1);
+
+  copy = xmlCopyNode(xml, 2);
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(inf_xml_blob_is_reference(child))
+    {
+      xmlAddChild(
+        copy,
+        inf_xml_blob_reference_new((InfXmlBlob*)child->_private)
+      );
+    }
+    else
+    {
+      xmlAddChild(copy, xmlCopyNode(child, 1));
+    }
+  }
+
+  return copy;
+}
+
+/**
+ * inf_xml_blob_release_references:
+ * @xml: A XML node, possibly containing reference nodes.
+ *
+ * Releases the blob references held by @xml, if it is a reference node, and
+ * by its direct children. This needs to be called before freeing a tree
+ * which might contain reference nodes. After the call, the reference nodes
+ * are regular, empty elements.
+ */
+void
+inf_xml_blob_release_references(xmlNodePtr xml)
+{
+  xmlNodePtr child;
+
+  g_return_if_fail(xml != NULL);
+
+  if(inf_xml_blob_is_reference(xml))
+  {
+    inf_xml_blob_unref((InfXmlBlob*)xml->_private);
+    xml->_private = NULL;
+    xml->psvi = NULL;
+  }
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(inf_xml_blob_is_reference(child))
+    {
+      inf_xml_blob_unref((InfXmlBlob*)child->_private);
+      child->_private = NULL;
+      child->psvi = NULL;
+    }
+  }
+}
+
+/**
+ * inf_xml_blob_dump:
+ * @buffer: The buffer to append the serialized XML to.
+ * @doc: (allow-none): The document @xml belongs to, or %NULL.
+ * @xml: The XML node to serialize, possibly containing reference nodes.
+ *
+ * Serializes @xml into @buffer, in the same way as xmlNodeDump() without
+ * formatting. For reference nodes the serialized representation of the
+ * blob they refer to is written, without serializing the message again.
+ */
+void
+inf_xml_blob_dump(xmlBufferPtr buffer,
+                  xmlDocPtr doc,
+                  xmlNodePtr xml)
+{
+  InfXmlBlob* blob;
+
+  g_return_if_fail(buffer != NULL);
+  g_return_if_fail(xml != NULL);
+
+  if(inf_xml_blob_is_reference(xml))
+  {
+    blob = (InfXmlBlob*)xml->_private;
+    xmlBufferAdd(
+      buffer,
+      xmlBufferContent(blob->buffer),
+      xmlBufferLength(blob->buffer)
+    );
+  }
+  else if(inf_xml_blob_has_reference_children(xml))
+  {
+    inf_xml_blob_dump_container(buffer, doc, xml);
+  }
+  else
+  {
+    xmlNodeDump(buffer, doc, xml, 0, 0);
+  }
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,83 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+
+#ifndef __INF_XML_BLOB_H__
+#define __INF_XML_BLOB_H__
+
+#include <libxml/tree.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TYPE_XML_BLOB                 (inf_xml_blob_get_type())
+
+/**
+ * InfXmlBlob:
+ *
+ * #InfXmlBlob is an opaque data type. You should only access it
+ * via the public API functions.
+ */
+typedef struct _InfXmlBlob InfXmlBlob;
+
+GType
+inf_xml_blob_get_type(void) G_GNUC_CONST;
+
+InfXmlBlob*
+inf_xml_blob_new(xmlNodePtr xml);
+
+InfXmlBlob*
+inf_xml_blob_ref(InfXmlBlob* blob);
+
+void
+inf_xml_blob_unref(InfXmlBlob* blob);
+
+xmlNodePtr
+inf_xml_blob_get_xml(const InfXmlBlob* blob);
+
+const gchar*
+inf_xml_blob_get_data(const InfXmlBlob* blob,
+                      gsize* length);
+
+xmlNodePtr
+inf_xml_blob_reference_new(InfXmlBlob* blob);
+
+InfXmlBlob*
+inf_xml_blob_reference_get_blob(xmlNodePtr xml);
+
+xmlNodePtr
+inf_xml_blob_reference_resolve(xmlNodePtr xml);
+
+xmlNodePtr
+inf_xml_blob_copy_tree(xmlNodePtr xml);
+
+void
+inf_xml_blob_release_references(xmlNodePtr xml);
+
+void
+inf_xml_blob_dump(xmlBufferPtr buffer,
+                  xmlDocPtr doc,
+                  xmlNodePtr xml);
+
+G_END_DECLS
+
+#endif /* __INF_XML_BLOB_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -294,6 +294,33 @@ void inf_xml_connection_send(InfXmlConnection* connection,
   iface->send(connection, xml);
 }
 
+/**
+ * inf_xml_connection_accepts_blob_references:
+ * @connection: A #InfXmlConnection.
+ *
+ * Returns whether @connection can send messages which contain reference
+ * nodes to a #InfXmlBlob, as created by inf_xml_blob_reference_new(). Such a
+ * connection serializes the messages with inf_xml_blob_dump() and releases
+ * the references with inf_xml_blob_release_references() once it is done
+ * with them. Messages for other connections must not contain reference
+ * nodes.
+ *
+ * Returns: Whether @connection accepts #InfXmlBlob reference nodes.
+ **/
+gboolean
+inf_xml_connection_accepts_blob_references(InfXmlConnection* connection)
+{
+  InfXmlConnectionInterface* iface;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  iface = INF_XML_CONNECTION_GET_IFACE(connection);
+  if(iface->accepts_blob_references == NULL)
+    return FALSE;
+
+  return iface->accepts_blob_references(connection);
+}
+
 /**
  * inf_xml_connection_sent:
  * @connection: A #InfXmlConnection.
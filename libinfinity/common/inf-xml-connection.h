@@ -64,6 +64,9 @@ typedef enum _InfXmlConnectionStatus {
  * @open: Virtual function to start the connection.
  * @close: Virtual function to stop the connection.
  * @send: Virtual function to transmit data over the connection.
+ * @accepts_blob_references: Virtual function which returns whether messages
+ * passed to @send can contain #InfXmlBlob reference nodes, see
+ * inf_xml_blob_reference_new(). If %NULL, they cannot.
  * @sent: Default signal handler of the #InfXmlConnection::sent signal.
  * @received: Default signal handler of the #InfXmlConnection::received
  * signal.
@@ -84,6 +87,7 @@ struct _InfXmlConnectionInterface {
   void (*close)(InfXmlConnection* connection);
   void (*send)(InfXmlConnection* connection,
                xmlNodePtr xml);
+  gboolean (*accepts_blob_references)(InfXmlConnection* connection);
 
   /* Signals */
   void (*sent)(InfXmlConnection* connection,
@@ -111,6 +115,9 @@ void
 inf_xml_connection_send(InfXmlConnection* connection,
                         xmlNodePtr xml);
 
+gboolean
+inf_xml_connection_accepts_blob_references(InfXmlConnection* connection);
+
 void
 inf_xml_connection_sent(InfXmlConnection* connection,
                         const xmlNodePtr xml);
@@ -337,6 +337,76 @@ inf_xml_util_add_child_text(xmlNodePtr xml,
     xmlNodeAddContentLen(xml, (const xmlChar*) text, p - text);
 }
 
+/**
+ * inf_xml_util_write_child_text:
+ * @writer: A #xmlTextWriterPtr.
+ * @text: (array length=bytes): The child text to write.
+ * @bytes: The number of bytes of @text.
+ *
+ * Writes the given text as child text of the element currently open in
+ * @writer, in the same way inf_xml_util_add_child_text() adds it to a
+ * #xmlNodePtr. Characters that are not valid in XML text are written as
+ * &lt;uchar /&gt; elements. This allows to serialize text without building
+ * the XML tree in memory first.
+ *
+ * Returns: A negative value if writing failed, or a non-negative value
+ * otherwise.
+ */
+int
+inf_xml_util_write_child_text(xmlTextWriterPtr writer,
+                              const gchar* text,
+                              gsize bytes)
+{
+  const gchar* p;
+  const gchar* next;
+  gchar* run;
+  gunichar ch;
+  gsize i;
+  int result;
+
+  for(i = 0, p = text; i < bytes; i += next - p, p = next)
+  {
+    next = inf_utf8_next_char(p);
+    ch = g_utf8_get_char(p);
+    if(!inf_xml_util_valid_xml_char(ch))
+    {
+      if(p != text)
+      {
+        run = g_strndup(text, p - text);
+        result = xmlTextWriterWriteString(writer, (const xmlChar*)run);
+        g_free(run);
+        if(result < 0) return result;
+      }
+
+      result = xmlTextWriterStartElement(writer, (const xmlChar*)"uchar");
+      if(result < 0) return result;
+
+      result = xmlTextWriterWriteFormatAttribute(
+        writer,
+        (const xmlChar*)"codepoint",
+        "%"G_GUINT32_FORMAT,
+        ch
+      );
+      if(result < 0) return result;
+
+      result = xmlTextWriterEndElement(writer);
+      if(result < 0) return result;
+
+      text = next;
+    }
+  }
+
+  if(p != text)
+  {
+    run = g_strndup(text, p - text);
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)run);
+    g_free(run);
+    if(result < 0) return result;
+  }
+
+  return 0;
+}
+
 /**
  * inf_xml_util_get_child_text:
  * @xml: A #xmlNodePtr
@@ -22,6 +22,7 @@
 
 #include <glib.h>
 #include <libxml/tree.h>
+#include <libxml/xmlwriter.h>
 
 G_BEGIN_DECLS
 
@@ -30,6 +31,11 @@ inf_xml_util_add_child_text(xmlNodePtr xml,
                             const gchar* text,
                             gsize bytes);
 
+int
+inf_xml_util_write_child_text(xmlTextWriterPtr writer,
+                              const gchar* text,
+                              gsize bytes);
+
 gchar*
 inf_xml_util_get_child_text(xmlNodePtr xml,
                             gsize* bytes,
@@ -37,6 +37,7 @@
 
 #include <libinfinity/common/inf-xmpp-connection.h>
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-blob.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-error.h>
@@ -46,6 +47,7 @@
 #include <libinfinity/inf-define-enum.h>
 
 #include <gnutls/x509.h>
+#include <zlib.h>
 
 #include <errno.h>
 #include <string.h>
@@ -53,6 +55,21 @@
 
 #include "config.h"
 
+/* Size of the buffer for decrypted TLS data. This is the maximum amount of
+ * plaintext a single TLS record can carry, so that a record never needs to
+ * be read in more than one gnutls_record_recv() call. */
+#define INF_XMPP_CONNECTION_TLS_RECV_SIZE 16384
+
+/* Serialized messages of at least this size are handed over to the TCP
+ * connection by reference on unencrypted connections, so that they are not
+ * copied into its send queue if they cannot be sent right away. Smaller
+ * messages are cheaper to copy than to allocate a new buffer for. */
+#define INF_XMPP_CONNECTION_ZERO_COPY_SIZE 16384
+
+/* Size of the buffer that compressed data received from the remote site is
+ * inflated into before it is fed to the XML parser. */
+#define INF_XMPP_CONNECTION_INFLATE_SIZE 16384
+
 static const GEnumValue inf_xmpp_connection_site_values[] = {
   {
     INF_XMPP_CONNECTION_CLIENT,
@@ -110,7 +127,9 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_CONNECTED,
   /* Initial <stream:stream> has been sent */
   INF_XMPP_CONNECTION_INITIATED,
-  /* Same as above, but the stream has already been authenticated */
+  /* Same as above, but the stream has already been authenticated. A server
+   * that offered stream compression waits for the client's <compress>
+   * request in this state. */
   INF_XMPP_CONNECTION_AUTH_INITIATED,
   /* <stream:stream> has been received, waiting for features (client only) */
   INF_XMPP_CONNECTION_AWAITING_FEATURES,
@@ -118,6 +137,8 @@ typedef enum _InfXmppConnectionStatus {
   INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES,
   /* <starttls> request has been sent (client only) */
   INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED,
+  /* <compress> request has been sent (client only) */
+  INF_XMPP_CONNECTION_COMPRESSION_REQUESTED,
   /* TLS handshake is being performed */
   INF_XMPP_CONNECTION_HANDSHAKING,
   /* SASL authentication is in progress */
@@ -190,6 +211,11 @@ struct _InfXmppConnectionPrivate {
   const gchar* pull_data;
   gsize pull_len;
 
+  /* Stream compression */
+  gboolean compression;
+  z_stream* deflate_stream;
+  z_stream* inflate_stream;
+
   /* SASL */
   InfSaslContext* sasl_context;
   InfSaslContext* sasl_own_context;
@@ -212,6 +238,9 @@ enum {
   PROP_TLS_ENABLED,
   PROP_CREDENTIALS,
 
+  PROP_COMPRESSION,
+  PROP_COMPRESSION_ENABLED,
+
   PROP_SASL_CONTEXT,
   PROP_SASL_MECHANISMS,
 
@@ -663,6 +692,21 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
     g_object_notify(G_OBJECT(xmpp), "tls-enabled");
   }
 
+  if(priv->deflate_stream != NULL)
+  {
+    g_assert(priv->inflate_stream != NULL);
+
+    deflateEnd(priv->deflate_stream);
+    inflateEnd(priv->inflate_stream);
+    g_slice_free(z_stream, priv->deflate_stream);
+    g_slice_free(z_stream, priv->inflate_stream);
+
+    priv->deflate_stream = NULL;
+    priv->inflate_stream = NULL;
+
+    g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+  }
+
   if(priv->parser != NULL)
   {
     xmlFreeParserCtxt(priv->parser);
@@ -696,10 +740,16 @@ inf_xmpp_connection_clear(InfXmppConnection* xmpp)
   g_object_thaw_notify(G_OBJECT(xmpp));
 }
 
+/* Sends len bytes at data through TLS, or directly to the TCP connection if
+ * TLS is not enabled. The data is sent as-is, that is, it must already be
+ * compressed if stream compression is enabled. If bytes is non-NULL, then
+ * data is the content of bytes, which the TCP connection can keep a
+ * reference on instead of copying it. */
 static void
-inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
-                               gconstpointer data,
-                               guint len)
+inf_xmpp_connection_send_raw(InfXmppConnection* xmpp,
+                             gconstpointer data,
+                             guint len,
+                             GBytes* bytes)
 {
   InfXmppConnectionPrivate* priv;
   ssize_t cur_bytes;
@@ -707,12 +757,6 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
-  g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
-           priv->status != INF_XMPP_CONNECTION_CLOSED);
-
-  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
-
   /* From here on we go into a GnuTLS callback. Set this flag to prevent
    * premature cleanup -- make sure that if the connection is being brought
    * down from a GnuTLS callback then we keep the GnuTLS context around
@@ -755,7 +799,11 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   else
   {
     priv->position += len;
-    inf_tcp_connection_send(priv->tcp, data, len);
+
+    if(bytes != NULL)
+      inf_tcp_connection_send_bytes(priv->tcp, bytes);
+    else
+      inf_tcp_connection_send(priv->tcp, data, len);
   }
 
   g_assert(priv->parsing > 0);
@@ -773,18 +821,148 @@ inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
   }
 }
 
+/* Compresses len bytes at data with the connection's deflate stream and
+ * returns the compressed data in a newly allocated buffer, whose length is
+ * stored in out_len. The stream is flushed after the data, so that the
+ * remote site can decompress the whole message as soon as it has received
+ * the returned data, while the compression history is kept for the next
+ * message. */
+static guchar*
+inf_xmpp_connection_deflate(InfXmppConnection* xmpp,
+                            gconstpointer data,
+                            guint len,
+                            guint* out_len)
+{
+  InfXmppConnectionPrivate* priv;
+  z_stream* stream;
+  guchar* out;
+  gsize size;
+  int res;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  stream = priv->deflate_stream;
+
+  /* deflateBound() does not account for the empty block that is emitted by
+   * the flush, so add some extra space for it. Normally the buffer is large
+   * enough for everything then, but grow it if it is not. */
+  size = deflateBound(stream, len) + 16;
+  out = g_malloc(size);
+
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+  stream->next_out = out;
+  stream->avail_out = size;
+
+  for(;;)
+  {
+    res = deflate(stream, Z_SYNC_FLUSH);
+
+    /* Z_BUF_ERROR only means that no progress was possible because the
+     * previous call already flushed everything. Other errors can only
+     * occur if the stream state is inconsistent. */
+    g_assert(res == Z_OK || res == Z_BUF_ERROR);
+
+    /* The flush is complete if deflate() did not fill the whole output
+     * buffer. */
+    if(stream->avail_out > 0)
+      break;
+
+    out = g_realloc(out, size * 2);
+    stream->next_out = out + size;
+    stream->avail_out = size;
+    size *= 2;
+  }
+
+  g_assert(stream->avail_in == 0);
+
+  stream->next_in = NULL;
+  stream->next_out = NULL;
+
+  *out_len = size - stream->avail_out;
+  return out;
+}
+
+/* Sends len bytes at data, compressing them first if stream compression is
+ * enabled. If bytes is non-NULL, then data is the content of bytes, which
+ * the TCP connection can keep a reference on instead of copying it. */
+static void
+inf_xmpp_connection_send_data(InfXmppConnection* xmpp,
+                              gconstpointer data,
+                              guint len,
+                              GBytes* bytes)
+{
+  InfXmppConnectionPrivate* priv;
+  guchar* compressed;
+  guint compressed_len;
+  GBytes* compressed_bytes;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+
+  g_assert(priv->status != INF_XMPP_CONNECTION_HANDSHAKING &&
+           priv->status != INF_XMPP_CONNECTION_CLOSED);
+
+  if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+    printf("\033[00;34m%.*s\033[00;00m\n", (int)len, (const char*)data);
+
+  if(priv->deflate_stream != NULL)
+  {
+    compressed = inf_xmpp_connection_deflate(
+      xmpp,
+      data,
+      len,
+      &compressed_len
+    );
+
+    if(priv->session == NULL)
+    {
+      /* The compressed buffer is not used anymore after this call, so let
+       * the TCP connection take it over instead of copying it. */
+      compressed_bytes = g_bytes_new_take(compressed, compressed_len);
+
+      inf_xmpp_connection_send_raw(
+        xmpp,
+        compressed,
+        compressed_len,
+        compressed_bytes
+      );
+
+      g_bytes_unref(compressed_bytes);
+    }
+    else
+    {
+      inf_xmpp_connection_send_raw(xmpp, compressed, compressed_len, NULL);
+      g_free(compressed);
+    }
+  }
+  else
+  {
+    inf_xmpp_connection_send_raw(xmpp, data, len, bytes);
+  }
+}
+
+static void
+inf_xmpp_connection_send_chars(InfXmppConnection* xmpp,
+                               gconstpointer data,
+                               guint len)
+{
+  inf_xmpp_connection_send_data(xmpp, data, len, NULL);
+}
+
 static void
 inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
                              xmlNodePtr xml)
 {
   InfXmppConnectionPrivate* priv;
+  xmlBufferPtr buffer;
+  GBytes* bytes;
+
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
 
   g_return_if_fail(priv->doc != NULL);
   g_return_if_fail(priv->buf != NULL);
 
   xmlDocSetRootElement(priv->doc, xml);
-  xmlNodeDump(priv->buf, priv->doc, xml, 0, 0);
+  inf_xml_blob_dump(priv->buf, priv->doc, xml);
   xmlUnlinkNode(xml);
   xmlSetListDoc(xml, NULL);
 
@@ -792,17 +970,44 @@ inf_xmpp_connection_send_xml(InfXmppConnection* xmpp,
    * the buffer variable afterwards. */
   g_object_ref(xmpp);
 
-  inf_xmpp_connection_send_chars(
-    xmpp,
-    xmlBufferContent(priv->buf),
-    xmlBufferLength(priv->buf)
-  );
+  if(priv->session == NULL && priv->deflate_stream == NULL &&
+     xmlBufferLength(priv->buf) >= INF_XMPP_CONNECTION_ZERO_COPY_SIZE)
+  {
+    /* Hand the buffer over to the TCP connection, and use a new one for
+     * the next message. */
+    buffer = priv->buf;
+    priv->buf = xmlBufferCreate();
 
-  /* The connection might be closed & cleared as a result from
-   * inf_xmpp_connection_send_chars(), so make sure the buffer still
-   * exists before emptying it. */
-  if(priv->buf != NULL)
-    xmlBufferEmpty(priv->buf);
+    bytes = g_bytes_new_with_free_func(
+      xmlBufferContent(buffer),
+      xmlBufferLength(buffer),
+      (GDestroyNotify)xmlBufferFree,
+      buffer
+    );
+
+    inf_xmpp_connection_send_data(
+      xmpp,
+      xmlBufferContent(buffer),
+      xmlBufferLength(buffer),
+      bytes
+    );
+
+    g_bytes_unref(bytes);
+  }
+  else
+  {
+    inf_xmpp_connection_send_chars(
+      xmpp,
+      xmlBufferContent(priv->buf),
+      xmlBufferLength(priv->buf)
+    );
+
+    /* The connection might be closed & cleared as a result from
+     * inf_xmpp_connection_send_chars(), so make sure the buffer still
+     * exists before emptying it. */
+    if(priv->buf != NULL)
+      xmlBufferEmpty(priv->buf);
+  }
 
   g_object_unref(xmpp);
 }
@@ -838,6 +1043,15 @@ inf_xmpp_connection_node_new_tls(const gchar* name)
   );
 }
 
+static xmlNodePtr
+inf_xmpp_connection_node_new_compress(const gchar* name)
+{
+  return inf_xmpp_connection_node_new(
+    name,
+    "http://jabber.org/protocol/compress"
+  );
+}
+
 static xmlNodePtr
 inf_xmpp_connection_node_new_sasl(const gchar* name)
 {
@@ -1862,6 +2076,172 @@ inf_xmpp_connection_sasl_init(InfXmppConnection* xmpp,
   }
 }
 
+/*
+ * Stream compression
+ */
+
+/* Checks whether xml, a <compression> feature or a <compress> request, has
+ * a <method> child with the given compression method. */
+static gboolean
+inf_xmpp_connection_compression_has_method(xmlNodePtr xml,
+                                           const gchar* method)
+{
+  xmlNodePtr child;
+  xmlChar* content;
+  gboolean result;
+
+  for(child = xml->children; child != NULL; child = child->next)
+  {
+    if(child->type == XML_ELEMENT_NODE &&
+       strcmp((const gchar*)child->name, "method") == 0)
+    {
+      content = xmlNodeGetContent(child);
+      result = content != NULL && strcmp((const gchar*)content, method) == 0;
+      xmlFree(content);
+
+      if(result == TRUE)
+        return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Sets up the zlib streams once both sites agreed on stream compression, and
+ * restarts the stream, which from now on is compressed in both directions.
+ * If zlib could not be initialized, the connection is closed. */
+static void
+inf_xmpp_connection_compression_init(InfXmppConnection* xmpp)
+{
+  InfXmppConnectionPrivate* priv;
+  GError* error;
+  int deflate_res;
+  int inflate_res;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->deflate_stream == NULL);
+  g_assert(priv->inflate_stream == NULL);
+
+  priv->deflate_stream = g_slice_new0(z_stream);
+  priv->inflate_stream = g_slice_new0(z_stream);
+
+  deflate_res = deflateInit(priv->deflate_stream, Z_DEFAULT_COMPRESSION);
+  inflate_res = inflateInit(priv->inflate_stream);
+
+  if(deflate_res != Z_OK || inflate_res != Z_OK)
+  {
+    if(deflate_res == Z_OK) deflateEnd(priv->deflate_stream);
+    if(inflate_res == Z_OK) inflateEnd(priv->inflate_stream);
+
+    g_slice_free(z_stream, priv->deflate_stream);
+    g_slice_free(z_stream, priv->inflate_stream);
+    priv->deflate_stream = NULL;
+    priv->inflate_stream = NULL;
+
+    error = g_error_new_literal(
+      inf_xmpp_connection_error_quark(),
+      INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE,
+      _("Failed to initialize stream compression")
+    );
+
+    inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+    g_error_free(error);
+
+    inf_tcp_connection_close(priv->tcp);
+    return;
+  }
+
+  g_object_notify(G_OBJECT(xmpp), "compression-enabled");
+
+  /* Compression is set up, restart the stream, as for TLS and SASL. */
+  priv->status = INF_XMPP_CONNECTION_AUTH_CONNECTED;
+
+  /* We might be in a XML callback here, so do not initiate the stream right
+   * now because it replaces the XML parser. The stream is reinitiated in
+   * received_cb(). */
+  if(priv->parsing == 0)
+    inf_xmpp_connection_initiate(xmpp);
+}
+
+/* Feeds len bytes at data received from the remote site into the XML
+ * parser, decompressing them first if stream compression is enabled. color
+ * is the escape sequence used to print the plain traffic in debug mode. */
+static void
+inf_xmpp_connection_parse(InfXmppConnection* xmpp,
+                          const gchar* data,
+                          gsize len,
+                          const gchar* color)
+{
+  InfXmppConnectionPrivate* priv;
+  gchar buffer[INF_XMPP_CONNECTION_INFLATE_SIZE];
+  z_stream* stream;
+  gsize out_len;
+  GError* error;
+  int res;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  stream = priv->inflate_stream;
+
+  if(stream == NULL)
+  {
+    if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+      printf("%s%.*s\033[00;00m\n", color, (int)len, data);
+    xmlParseChunk(priv->parser, data, len, 0);
+    return;
+  }
+
+  stream->next_in = (Bytef*)data;
+  stream->avail_in = len;
+
+  do
+  {
+    stream->next_out = (Bytef*)buffer;
+    stream->avail_out = INF_XMPP_CONNECTION_INFLATE_SIZE;
+
+    res = inflate(stream, Z_SYNC_FLUSH);
+
+    /* Z_BUF_ERROR means that no progress was possible, which is expected
+     * when all input has been consumed. The remote site never finishes the
+     * compressed stream, so Z_STREAM_END is an error as well. */
+    if(res != Z_OK && res != Z_BUF_ERROR)
+    {
+      error = g_error_new_literal(
+        inf_xmpp_connection_error_quark(),
+        INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE,
+        _("The remote site sent corrupt compressed data")
+      );
+
+      inf_xml_connection_error(INF_XML_CONNECTION(xmpp), error);
+      g_error_free(error);
+
+      /* The stream cannot be decompressed anymore, so there is no way to
+       * recover from this. Just close the underlying TCP connection, as we
+       * do for TLS errors. */
+      inf_tcp_connection_close(priv->tcp);
+      break;
+    }
+
+    out_len = INF_XMPP_CONNECTION_INFLATE_SIZE - stream->avail_out;
+    if(out_len > 0)
+    {
+      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
+        printf("%s%.*s\033[00;00m\n", color, (int)out_len, buffer);
+      xmlParseChunk(priv->parser, buffer, out_len, 0);
+
+      /* If the callback made us disconnect then don't try to decompress
+       * more data. */
+      if(priv->status == INF_XMPP_CONNECTION_CLOSING_GNUTLS ||
+         priv->status == INF_XMPP_CONNECTION_CLOSED)
+      {
+        break;
+      }
+    }
+  } while(stream->avail_in > 0 || stream->avail_out == 0);
+
+  stream->next_in = NULL;
+  stream->next_out = NULL;
+}
+
 /*
  * XMPP messaging
  */
@@ -1932,7 +2312,10 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   xmlNodePtr starttls;
   xmlNodePtr mechanisms;
   xmlNodePtr mechanism;
+  xmlNodePtr compression;
   gchar* mechanism_dup;
+  gboolean offer_compression;
+  const xmlChar** attr;
   GError* error;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -1942,6 +2325,25 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
   g_assert(priv->status == INF_XMPP_CONNECTION_CONNECTED ||
            priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED);
 
+  /* Stream compression is only offered after authentication, and only to
+   * clients that announced in their <stream:stream> that they want it.
+   * Other clients do not reply to the features once authenticated, so we
+   * could not know when to start the session. */
+  offer_compression = FALSE;
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED &&
+     priv->compression == TRUE && priv->deflate_stream == NULL &&
+     attrs != NULL)
+  {
+    for(attr = attrs; *attr != NULL; attr += 2)
+    {
+      if(strcmp((const gchar*)attr[0], "compression") == 0 &&
+         attr[1] != NULL && strcmp((const gchar*)attr[1], "zlib") == 0)
+      {
+        offer_compression = TRUE;
+      }
+    }
+  }
+
   reply = g_strdup_printf(
     xmpp_connection_initial_request,
     priv->local_hostname
@@ -2058,12 +2460,32 @@ inf_xmpp_connection_process_connected(InfXmppConnection* xmpp,
     }
   }
 
+  if(offer_compression == TRUE)
+  {
+    compression = inf_xmpp_connection_node_new(
+      "compression",
+      "http://jabber.org/features/compress"
+    );
+
+    xmlAddChild(features, compression);
+
+    xmlNewTextChild(
+      compression,
+      NULL,
+      (const xmlChar*)"method",
+      (const xmlChar*)"zlib"
+    );
+  }
+
   inf_xmpp_connection_send_xml(xmpp, features);
   xmlFreeNode(features);
 
-  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED)
+  /* Authentication done, <stream:features> sent. Session is ready, unless
+   * we offered compression, in which case we wait for the client to
+   * request it first. */
+  if(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED &&
+     offer_compression == FALSE)
   {
-    /* Authentication done, <stream:features> sent. Session is ready. */
     priv->status = INF_XMPP_CONNECTION_READY;
     g_object_notify(G_OBJECT(xmpp), "status");
   }
@@ -2316,6 +2738,7 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   xmlNodePtr child;
   xmlNodePtr req;
   xmlNodePtr starttls;
+  xmlNodePtr compress;
   const char* suggestion;
   GError* error;
 
@@ -2435,8 +2858,38 @@ inf_xmpp_connection_process_features(InfXmppConnection* xmpp,
   }
   else if(priv->status == INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES)
   {
-    priv->status = INF_XMPP_CONNECTION_READY;
-    g_object_notify(G_OBJECT(xmpp), "status");
+    child = NULL;
+    if(priv->compression == TRUE && priv->deflate_stream == NULL)
+    {
+      for(child = xml->children; child != NULL; child = child->next)
+        if(strcmp((const gchar*)child->name, "compression") == 0)
+          break;
+    }
+
+    /* Request compression if the server offers it, otherwise the session
+     * is ready now. */
+    if(child != NULL &&
+       inf_xmpp_connection_compression_has_method(child, "zlib"))
+    {
+      compress = inf_xmpp_connection_node_new_compress("compress");
+
+      xmlNewTextChild(
+        compress,
+        NULL,
+        (const xmlChar*)"method",
+        (const xmlChar*)"zlib"
+      );
+
+      inf_xmpp_connection_send_xml(xmpp, compress);
+      xmlFreeNode(compress);
+
+      priv->status = INF_XMPP_CONNECTION_COMPRESSION_REQUESTED;
+    }
+    else
+    {
+      priv->status = INF_XMPP_CONNECTION_READY;
+      g_object_notify(G_OBJECT(xmpp), "status");
+    }
   }
 }
 
@@ -2479,6 +2932,82 @@ inf_xmpp_connection_process_encryption(InfXmppConnection* xmpp,
   }
 }
 
+static void
+inf_xmpp_connection_process_compression(InfXmppConnection* xmpp,
+                                        xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+  g_assert(priv->status == INF_XMPP_CONNECTION_COMPRESSION_REQUESTED);
+
+  if(strcmp((const gchar*)xml->name, "compressed") == 0)
+  {
+    inf_xmpp_connection_compression_init(xmpp);
+  }
+  else if(strcmp((const gchar*)xml->name, "failure") == 0)
+  {
+    /* Compression is optional, so just go on without it. The server does
+     * not restart the stream in this case, and the session is ready. */
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+  }
+  else
+  {
+    /* We got neither 'compressed' nor 'failure'. Ignore and wait for either
+     * of them. */
+  }
+}
+
+/* Processes the first message a client sends after the server has offered
+ * stream compression in its <stream:features>. */
+static void
+inf_xmpp_connection_process_compression_request(InfXmppConnection* xmpp,
+                                                xmlNodePtr xml)
+{
+  InfXmppConnectionPrivate* priv;
+  xmlNodePtr reply;
+
+  priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
+  g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+  g_assert(priv->status == INF_XMPP_CONNECTION_AUTH_INITIATED);
+
+  if(strcmp((const gchar*)xml->name, "compress") == 0)
+  {
+    if(inf_xmpp_connection_compression_has_method(xml, "zlib"))
+    {
+      /* This is still sent uncompressed, everything after it is
+       * compressed. */
+      reply = inf_xmpp_connection_node_new_compress("compressed");
+      inf_xmpp_connection_send_xml(xmpp, reply);
+      xmlFreeNode(reply);
+
+      inf_xmpp_connection_compression_init(xmpp);
+    }
+    else
+    {
+      reply = inf_xmpp_connection_node_new_compress("failure");
+      xmlNewChild(reply, NULL, (const xmlChar*)"unsupported-method", NULL);
+      inf_xmpp_connection_send_xml(xmpp, reply);
+      xmlFreeNode(reply);
+
+      priv->status = INF_XMPP_CONNECTION_READY;
+      g_object_notify(G_OBJECT(xmpp), "status");
+    }
+  }
+  else
+  {
+    /* The client decided not to use compression and started the session
+     * right away. */
+    priv->status = INF_XMPP_CONNECTION_READY;
+    g_object_notify(G_OBJECT(xmpp), "status");
+
+    if(priv->status == INF_XMPP_CONNECTION_READY)
+      inf_xml_connection_received(INF_XML_CONNECTION(xmpp), xml);
+  }
+}
+
 static void
 inf_xmpp_connection_process_authentication_error(
   InfXmppConnection* xmpp,
@@ -2688,6 +3217,12 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
         inf_xmpp_connection_process_initiated(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_AUTH_INITIATED:
+        /* Same as above. The server only stays in this state after having
+         * sent <stream:features> if it offered stream compression. */
+        g_assert(priv->site == INF_XMPP_CONNECTION_SERVER);
+        inf_xmpp_connection_process_compression_request(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AWAITING_FEATURES:
       case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
         /* This is a client-only state */
@@ -2699,6 +3234,11 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
         g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
         inf_xmpp_connection_process_encryption(xmpp, priv->root);
         break;
+      case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
+        /* This is a client-only state */
+        g_assert(priv->site == INF_XMPP_CONNECTION_CLIENT);
+        inf_xmpp_connection_process_compression(xmpp, priv->root);
+        break;
       case INF_XMPP_CONNECTION_AUTHENTICATING:
         inf_xmpp_connection_process_authentication(xmpp, priv->root);
         break;
@@ -2710,11 +3250,6 @@ inf_xmpp_connection_process_end_element(InfXmppConnection* xmpp,
          * other XML nodes from the remote side before that happens, but we
          * ignore them here. */
         break;
-      case INF_XMPP_CONNECTION_AUTH_INITIATED:
-        /* The client should be waiting for <stream:stream> from the server
-         * in this state, and sax_end_element should not have called this
-         * function. Also, this is a client-only state (the server goes
-         * directly to READY after having received <stream:stream>). */
       case INF_XMPP_CONNECTION_CONNECTING:
       case INF_XMPP_CONNECTION_CONNECTED:
       case INF_XMPP_CONNECTION_AUTH_CONNECTED:
@@ -2804,6 +3339,7 @@ inf_xmpp_connection_sax_start_element(void* context,
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_process_start_element(xmpp, name, attrs);
@@ -2869,6 +3405,7 @@ inf_xmpp_connection_sax_end_element(void* context,
     case INF_XMPP_CONNECTION_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
     case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+    case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
     case INF_XMPP_CONNECTION_READY:
       /* Also terminate stream in these states */
       inf_xmpp_connection_terminate(xmpp);
@@ -3045,9 +3582,10 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
 {
   static const gchar xmpp_connection_initial_request[] =
     "<stream:stream version=\"1.0\" xmlns=\"jabber:client\" "
-    "xmlns:stream=\"http://etherx.jabber.org/streams\" to=\"%s\">";
+    "xmlns:stream=\"http://etherx.jabber.org/streams\" to=\"%s\"%s>";
 
   InfXmppConnectionPrivate* priv;
+  const gchar* compression;
   gchar* request;
 
   priv = INF_XMPP_CONNECTION_PRIVATE(xmpp);
@@ -3074,9 +3612,20 @@ inf_xmpp_connection_initiate(InfXmppConnection* xmpp)
 
   if(priv->site == INF_XMPP_CONNECTION_CLIENT)
   {
+    /* Tell the server that we would like to use stream compression once
+     * authenticated, so that it offers it in its <stream:features> and
+     * waits for our request before it considers the session ready. */
+    compression = "";
+    if(priv->status == INF_XMPP_CONNECTION_AUTH_CONNECTED &&
+       priv->compression == TRUE && priv->deflate_stream == NULL)
+    {
+      compression = " compression=\"zlib\"";
+    }
+
     request = g_strdup_printf(
       xmpp_connection_initial_request,
-      priv->remote_hostname
+      priv->remote_hostname,
+      compression
     );
 
     inf_xmpp_connection_send_chars(xmpp, request, strlen(request));
@@ -3180,7 +3729,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
 {
   InfXmppConnection* xmpp;
   InfXmppConnectionPrivate* priv;
-  gchar buffer[2048];
+  gchar buffer[INF_XMPP_CONNECTION_TLS_RECV_SIZE];
   ssize_t res;
   GError* error;
   gboolean receiving;
@@ -3230,7 +3779,11 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
       while(receiving && (priv->pull_len > 0 ||
                           gnutls_record_check_pending(priv->session) > 0))
       {
-        res = gnutls_record_recv(priv->session, buffer, 2048);
+        res = gnutls_record_recv(
+          priv->session,
+          buffer,
+          INF_XMPP_CONNECTION_TLS_RECV_SIZE
+        );
         if(res < 0)
         {
           /* Just try again if we were interrupted */
@@ -3258,9 +3811,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
         else
         {
           /* Feed decoded data into XML parser */
-          if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-            printf("\033[00;32m%.*s\033[00;00m\n", (int)res, buffer);
-          xmlParseChunk(priv->parser, buffer, res, 0);
+          inf_xmpp_connection_parse(xmpp, buffer, res, "\033[00;32m");
 
           /* If the callback changed made us disconnect then don't try
            * to read more data. */
@@ -3275,9 +3826,7 @@ inf_xmpp_connection_received_cb(InfTcpConnection* tcp,
     else
     {
       /* Feed input directly into XML parser */
-      if(INF_XMPP_CONNECTION_PRINT_TRAFFIC)
-        printf("\033[00;31m%.*s\033[00;00m\n", (int)len, (const char*)data);
-      xmlParseChunk(priv->parser, data, len, 0);
+      inf_xmpp_connection_parse(xmpp, data, len, "\033[00;31m");
     }
   }
 
@@ -3543,6 +4092,7 @@ inf_xmpp_connection_get_xml_status(InfXmppConnection* xmpp)
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_ENCRYPTION_REQUESTED:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_HANDSHAKING:
   case INF_XMPP_CONNECTION_AUTHENTICATING:
     return INF_XML_CONNECTION_OPENING;
@@ -3625,6 +4175,10 @@ inf_xmpp_connection_init(InfXmppConnection* connection)
   priv->pull_data = NULL;
   priv->pull_len = 0;
 
+  priv->compression = FALSE;
+  priv->deflate_stream = NULL;
+  priv->inflate_stream = NULL;
+
   priv->sasl_context = NULL;
   priv->sasl_own_context = NULL;
   priv->sasl_session = NULL;
@@ -3800,6 +4354,9 @@ inf_xmpp_connection_set_property(GObject* object,
     if(priv->creds != NULL) inf_certificate_credentials_unref(priv->creds);
     priv->creds = g_value_dup_boxed(value);
 
+    break;
+  case PROP_COMPRESSION:
+    priv->compression = g_value_get_boolean(value);
     break;
   case PROP_SASL_CONTEXT:
     /* Cannot change context when currently in use */
@@ -3870,6 +4427,15 @@ inf_xmpp_connection_get_property(GObject* object,
   case PROP_CREDENTIALS:
     g_value_set_boxed(value, priv->creds);
     break;
+  case PROP_COMPRESSION:
+    g_value_set_boolean(value, priv->compression);
+    break;
+  case PROP_COMPRESSION_ENABLED:
+    g_value_set_boolean(
+      value,
+      inf_xmpp_connection_get_compression_enabled(xmpp)
+    );
+    break;
   case PROP_SASL_CONTEXT:
     g_value_set_boxed(value, priv->sasl_context);
     break;
@@ -3931,6 +4497,7 @@ static void
 inf_xmpp_connection_xml_connection_send_free(InfXmppConnection* xmpp,
                                              gpointer xml)
 {
+  inf_xml_blob_release_references((xmlNodePtr)xml);
   xmlFreeNode((xmlNodePtr)xml);
 }
 
@@ -4006,6 +4573,7 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
   case INF_XMPP_CONNECTION_AUTH_INITIATED:
   case INF_XMPP_CONNECTION_AWAITING_FEATURES:
   case INF_XMPP_CONNECTION_AUTH_AWAITING_FEATURES:
+  case INF_XMPP_CONNECTION_COMPRESSION_REQUESTED:
   case INF_XMPP_CONNECTION_READY:
     inf_xmpp_connection_deinitiate(INF_XMPP_CONNECTION(connection));
     break;
@@ -4015,6 +4583,15 @@ inf_xmpp_connection_xml_connection_close(InfXmlConnection* connection)
   }
 }
 
+static gboolean
+inf_xmpp_connection_xml_connection_accepts_blob_references(
+  InfXmlConnection* connection)
+{
+  /* Messages are serialized with inf_xml_blob_dump() and the references
+   * released in inf_xmpp_connection_xml_connection_send_free(). */
+  return TRUE;
+}
+
 static void
 inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
                                         xmlNodePtr xml)
@@ -4040,6 +4617,7 @@ inf_xmpp_connection_xml_connection_send(InfXmlConnection* connection,
   }
   else
   {
+    inf_xml_blob_release_references(xml);
     xmlFreeNode(xml);
   }
 }
@@ -4154,6 +4732,30 @@ inf_xmpp_connection_class_init(InfXmppConnectionClass* xmpp_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION,
+    g_param_spec_boolean(
+      "compression",
+      "Compression",
+      "Whether to use (or offer, as a server) zlib stream compression",
+      FALSE,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPRESSION_ENABLED,
+    g_param_spec_boolean(
+      "compression-enabled",
+      "Compression enabled",
+      "Whether stream compression is enabled for the connection or not",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_SASL_CONTEXT,
@@ -4203,6 +4805,8 @@ inf_xmpp_connection_xml_connection_iface_init(
   iface->open = inf_xmpp_connection_xml_connection_open;
   iface->close = inf_xmpp_connection_xml_connection_close;
   iface->send = inf_xmpp_connection_xml_connection_send;
+  iface->accepts_blob_references =
+    inf_xmpp_connection_xml_connection_accepts_blob_references;
 }
 
 /*
@@ -4321,6 +4925,29 @@ inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp)
   return TRUE;
 }
 
+/**
+ * inf_xmpp_connection_get_compression_enabled:
+ * @xmpp: A #InfXmppConnection.
+ *
+ * Returns whether zlib stream compression is enabled for @xmpp. This is only
+ * the case if the #InfXmppConnection:compression property is set on both
+ * sites of the connection. Compression is negotiated after authentication,
+ * so this returns %FALSE before that has completed.
+ *
+ * Note that compressing data before encrypting it can reveal secrets to an
+ * attacker who is able to inject own data into the stream and observe the
+ * size of the encrypted data. Only enable compression if that is not a
+ * concern for the data exchanged on the connection.
+ *
+ * Returns: %TRUE if stream compression is enabled and %FALSE otherwise.
+ */
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp)
+{
+  g_return_val_if_fail(INF_IS_XMPP_CONNECTION(xmpp), FALSE);
+  return INF_XMPP_CONNECTION_PRIVATE(xmpp)->deflate_stream != NULL;
+}
+
 /**
  * inf_xmpp_connection_get_own_certificate:
  * @xmpp: A #InfXmppConnection.
@@ -107,6 +107,9 @@ typedef enum _InfXmppConnectionSecurityPolicy {
  * provide any authentication mechanisms.
  * @INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM: The server does not offer
  * a suitable authentication mechanism that is accepted by the client.
+ * @INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE: Stream compression could
+ * not be set up, or data received from the remote site could not be
+ * decompressed.
  * @INF_XMPP_CONNECTION_ERROR_FAILED: General error code for otherwise
  * unknown errors.
  *
@@ -121,6 +124,7 @@ typedef enum _InfXmppConnectionError {
   INF_XMPP_CONNECTION_ERROR_CERTIFICATE_NOT_TRUSTED,
   INF_XMPP_CONNECTION_ERROR_AUTHENTICATION_UNSUPPORTED,
   INF_XMPP_CONNECTION_ERROR_NO_SUITABLE_MECHANISM,
+  INF_XMPP_CONNECTION_ERROR_COMPRESSION_FAILURE,
 
   INF_XMPP_CONNECTION_ERROR_FAILED
 } InfXmppConnectionError;
@@ -329,6 +333,9 @@ inf_xmpp_connection_new(InfTcpConnection* tcp,
 gboolean
 inf_xmpp_connection_get_tls_enabled(InfXmppConnection* xmpp);
 
+gboolean
+inf_xmpp_connection_get_compression_enabled(InfXmppConnection* xmpp);
+
 gnutls_x509_crt_t
 inf_xmpp_connection_get_own_certificate(InfXmppConnection* xmpp);
 
@@ -42,6 +42,10 @@ struct _InfCommunicationCentralMethodPrivate {
   gboolean is_publisher; /* Whether the local host is publisher of group */
 
   GSList* connections;
+
+  /* Connections for which group messages are held back, mapped to a GQueue
+   * of the held back messages as InfXmlBlobs. */
+  GHashTable* held;
 };
 
 enum {
@@ -72,8 +76,11 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   InfXmlConnection* connection;
   gboolean is_registered;
   InfXmlConnectionStatus status;
+  InfXmlBlob* blob;
+  GQueue* held;
 
   priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+  blob = NULL;
 
   /* Each of the inf_communication_registry_send() calls can do a callback
    * which might possibly screw up our connection list completely. So be safe
@@ -106,24 +113,41 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
        status == INF_XML_CONNECTION_OPEN &&
        connection != except)
     {
-      if(connections->next != NULL)
-      {
-        /* Keep ownership of XML if there might be more connections we should
-         * send it to. */
-        inf_communication_registry_send(
-          registry,
-          group,
-          connection,
-          xmlCopyNode(xml, 1)
-        );
-      }
-      else
+      held = g_hash_table_lookup(priv->held, connection);
+
+      if(held == NULL && blob == NULL && connections->next == NULL)
       {
         /* Pass ownership of XML if this is definitely the last connection
-         * in the list. */
+         * in the list, and we did not share it with another connection. */
         inf_communication_registry_send(registry, group, connection, xml);
         xml = NULL;
       }
+      else
+      {
+        /* There might be more connections we should send the message to,
+         * or we need to keep it until it is released. Serialize it only
+         * once, and share the result between all of them instead of
+         * copying the message for every connection. */
+        if(blob == NULL)
+        {
+          blob = inf_xml_blob_new(xml);
+          xml = NULL;
+        }
+
+        if(held != NULL)
+        {
+          g_queue_push_tail(held, inf_xml_blob_ref(blob));
+        }
+        else
+        {
+          inf_communication_registry_send_blob(
+            registry,
+            group,
+            connection,
+            blob
+          );
+        }
+      }
     }
 
     g_object_unref(connection);
@@ -134,10 +158,23 @@ inf_communication_central_method_broadcast(InfCommunicationMethod* method,
   g_object_unref(registry);
   g_object_unref(group);
 
+  if(blob != NULL)
+    inf_xml_blob_unref(blob);
   if(xml != NULL)
     xmlFreeNode(xml);
 }
 
+static void
+inf_communication_central_method_free_held(gpointer data)
+{
+  GQueue* queue;
+  queue = (GQueue*)data;
+
+  while(!g_queue_is_empty(queue))
+    inf_xml_blob_unref(g_queue_pop_head(queue));
+  g_queue_free(queue);
+}
+
 static void
 inf_communication_central_method_notify_status_cb(GObject* object,
                                                   GParamSpec* pspec,
@@ -251,6 +288,8 @@ inf_communication_central_method_remove_member(InfCommunicationMethod* method,
     method
   );
 
+  /* Messages held back for the connection cannot be sent anymore */
+  g_hash_table_remove(priv->held, connection);
   priv->connections = g_slist_remove(priv->connections, connection);
 }
 
@@ -266,6 +305,15 @@ inf_communication_central_method_is_member(InfCommunicationMethod* method,
   return TRUE;
 }
 
+static GSList*
+inf_communication_central_method_get_members(InfCommunicationMethod* method)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  return g_slist_copy(priv->connections);
+}
+
 static void
 inf_communication_central_method_send_single(InfCommunicationMethod* method,
                                              InfXmlConnection* connection,
@@ -282,6 +330,23 @@ inf_communication_central_method_send_single(InfCommunicationMethod* method,
   );
 }
 
+static void
+inf_communication_central_method_send_single_blob(
+  InfCommunicationMethod* method,
+  InfXmlConnection* connection,
+  InfXmlBlob* blob)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  inf_communication_registry_send_blob(
+    priv->registry,
+    priv->group,
+    connection,
+    blob
+  );
+}
+
 static void
 inf_communication_central_method_send_all(InfCommunicationMethod* method,
                                           xmlNodePtr xml)
@@ -303,6 +368,65 @@ inf_communication_central_method_cancel_messages(InfCommunicationMethod* meth,
   );
 }
 
+static void
+inf_communication_central_method_hold_group_messages(
+  InfCommunicationMethod* method,
+  InfXmlConnection* connection)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  if(!g_hash_table_contains(priv->held, connection))
+    g_hash_table_insert(priv->held, connection, g_queue_new());
+}
+
+static void
+inf_communication_central_method_release_group_messages(
+  InfCommunicationMethod* method,
+  InfXmlConnection* connection)
+{
+  InfCommunicationCentralMethodPrivate* priv;
+  InfCommunicationRegistry* registry;
+  InfCommunicationGroup* group;
+  InfXmlConnectionStatus status;
+  GQueue* held;
+  InfXmlBlob* blob;
+
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+  if(!g_hash_table_contains(priv->held, connection))
+    return;
+
+  g_object_ref(method);
+  registry = g_object_ref(priv->registry);
+  group = g_object_ref(priv->group);
+  g_object_ref(connection);
+
+  /* Keep the queue in place while sending, so that messages broadcast from
+   * a callback are appended to it instead of overtaking the held back
+   * ones. The queue is gone if a callback removed the connection from the
+   * group, or released the messages recursively. */
+  while( (held = g_hash_table_lookup(priv->held, connection)) != NULL &&
+         (blob = g_queue_pop_head(held)) != NULL)
+  {
+    g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+    if(status == INF_XML_CONNECTION_OPEN &&
+       inf_communication_registry_is_registered(registry, group, connection))
+    {
+      inf_communication_registry_send_blob(registry, group, connection, blob);
+    }
+
+    inf_xml_blob_unref(blob);
+  }
+
+  g_hash_table_remove(priv->held, connection);
+
+  g_object_unref(connection);
+  g_object_unref(group);
+  g_object_unref(registry);
+  g_object_unref(method);
+}
+
 static InfCommunicationScope
 inf_communication_central_method_received(InfCommunicationMethod* method,
                                           InfXmlConnection* connection,
@@ -501,6 +625,13 @@ inf_communication_central_method_init(InfCommunicationCentralMethod* method)
   priv->registry = NULL;
   priv->is_publisher = FALSE;
   priv->connections = NULL;
+
+  priv->held = g_hash_table_new_full(
+    NULL,
+    NULL,
+    NULL,
+    inf_communication_central_method_free_held
+  );
 }
 
 static void
@@ -526,6 +657,22 @@ inf_communication_central_method_dispose(GObject* object)
   G_OBJECT_CLASS(inf_communication_central_method_parent_class)->dispose(object);
 }
 
+static void
+inf_communication_central_method_finalize(GObject* object)
+{
+  InfCommunicationCentralMethod* method;
+  InfCommunicationCentralMethodPrivate* priv;
+
+  method = INF_COMMUNICATION_CENTRAL_METHOD(object);
+  priv = INF_COMMUNICATION_CENTRAL_METHOD_PRIVATE(method);
+
+  g_hash_table_destroy(priv->held);
+
+  G_OBJECT_CLASS(inf_communication_central_method_parent_class)->finalize(
+    object
+  );
+}
+
 static void
 inf_communication_central_method_set_property(GObject* object,
                                               guint prop_id,
@@ -602,6 +749,7 @@ inf_communication_central_method_class_init(
   object_class = G_OBJECT_CLASS(method_class);
 
   object_class->dispose = inf_communication_central_method_dispose;
+  object_class->finalize = inf_communication_central_method_finalize;
   object_class->set_property = inf_communication_central_method_set_property;
   object_class->get_property = inf_communication_central_method_get_property;
 
@@ -637,12 +785,19 @@ inf_communication_central_method_method_iface_init(
   iface->add_member = inf_communication_central_method_add_member;
   iface->remove_member = inf_communication_central_method_remove_member;
   iface->is_member = inf_communication_central_method_is_member;
+  iface->get_members = inf_communication_central_method_get_members;
   iface->send_single = inf_communication_central_method_send_single;
+  iface->send_single_blob =
+    inf_communication_central_method_send_single_blob;
   iface->send_all = inf_communication_central_method_send_all;
   iface->cancel_messages = inf_communication_central_method_cancel_messages;
   iface->received = inf_communication_central_method_received;
   iface->enqueued = inf_communication_central_method_enqueued;
   iface->sent = inf_communication_central_method_sent;
+  iface->hold_group_messages =
+    inf_communication_central_method_hold_group_messages;
+  iface->release_group_messages =
+    inf_communication_central_method_release_group_messages;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -676,6 +676,40 @@ inf_communication_group_is_member(InfCommunicationGroup* group,
     return FALSE;
 }
 
+/**
+ * inf_communication_group_get_members:
+ * @group: A #InfCommunicationGroup.
+ *
+ * Returns all connections that are a member of @group, on any network.
+ *
+ * Returns: (transfer container) (element-type InfXmlConnection): A list of
+ * the members of @group. Free with g_slist_free() when done.
+ */
+GSList*
+inf_communication_group_get_members(InfCommunicationGroup* group)
+{
+  InfCommunicationGroupPrivate* priv;
+  GHashTableIter iter;
+  gpointer value;
+  GSList* members;
+
+  g_return_val_if_fail(INF_COMMUNICATION_IS_GROUP(group), NULL);
+
+  priv = INF_COMMUNICATION_GROUP_PRIVATE(group);
+  members = NULL;
+
+  g_hash_table_iter_init(&iter, priv->methods);
+  while(g_hash_table_iter_next(&iter, NULL, &value))
+  {
+    members = g_slist_concat(
+      inf_communication_method_get_members(INF_COMMUNICATION_METHOD(value)),
+      members
+    );
+  }
+
+  return members;
+}
+
 /**
  * inf_communication_group_send_message:
  * @group: A #InfCommunicationGroup.
@@ -706,6 +740,38 @@ inf_communication_group_send_message(InfCommunicationGroup* group,
   inf_communication_method_send_single(method, connection, xml);
 }
 
+/**
+ * inf_communication_group_send_blob:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection to which to send the message.
+ * @blob: The message to send.
+ *
+ * Sends the message held by @blob to @connection which must be a member of
+ * @group. This is useful when the same message is sent to several
+ * connections at different times, since it needs to be serialized only
+ * once. The function does not take ownership of @blob.
+ */
+void
+inf_communication_group_send_blob(InfCommunicationGroup* group,
+                                  InfXmlConnection* connection,
+                                  InfXmlBlob* blob)
+{
+  InfCommunicationMethod* method;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(blob != NULL);
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_if_fail(method != NULL);
+
+  inf_communication_method_send_single_blob(method, connection, blob);
+}
+
 /**
  * inf_communication_group_send_group_message:
  * @group: A #InfCommunicationGroup.
@@ -778,6 +844,74 @@ inf_communication_group_cancel_messages(InfCommunicationGroup* group,
   inf_communication_method_cancel_messages(method, connection);
 }
 
+/**
+ * inf_communication_group_hold_group_messages:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection for which to hold back messages.
+ *
+ * Holds back messages sent to all members of @group, such as with
+ * inf_communication_group_send_group_message() or when a received message is
+ * forwarded to the other group members, from being sent to @connection.
+ * Messages sent to @connection with inf_communication_group_send_message()
+ * are still sent as usual. This allows sending a sequence of messages to
+ * @connection without any group messages in between, even if the sequence
+ * is only generated bit by bit. Call
+ * inf_communication_group_release_group_messages() to send the held back
+ * messages afterwards.
+ *
+ * @connection needs to be a member of this group.
+ *
+ * Returns: %TRUE if messages are held back for @connection, or %FALSE if
+ * the communication method used for @connection does not support it.
+ */
+gboolean
+inf_communication_group_hold_group_messages(InfCommunicationGroup* group,
+                                            InfXmlConnection* connection)
+{
+  InfCommunicationMethod* method;
+
+  g_return_val_if_fail(INF_COMMUNICATION_IS_GROUP(group), FALSE);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  g_return_val_if_fail(method != NULL, FALSE);
+
+  return inf_communication_method_hold_group_messages(method, connection);
+}
+
+/**
+ * inf_communication_group_release_group_messages:
+ * @group: A #InfCommunicationGroup.
+ * @connection: The #InfXmlConnection for which to release messages.
+ *
+ * Sends all messages that have been held back for @connection since
+ * inf_communication_group_hold_group_messages() was called, and stops
+ * holding back messages for it. If @connection has left the group
+ * meanwhile, the held back messages have already been dropped, and this
+ * function does nothing.
+ */
+void
+inf_communication_group_release_group_messages(InfCommunicationGroup* group,
+                                               InfXmlConnection* connection)
+{
+  InfCommunicationMethod* method;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  method = inf_communication_group_lookup_method_for_connection(
+    group,
+    connection
+  );
+
+  if(method != NULL)
+    inf_communication_method_release_group_messages(method, connection);
+}
+
 /**
  * inf_communication_group_get_method_for_network:
  * @group: A #InfCommunicationGroup.
@@ -21,6 +21,7 @@
 #define __INF_COMMUNICATION_GROUP_H__
 
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-blob.h>
 #include <libinfinity/communication/inf-communication-object.h>
 
 #include <glib-object.h>
@@ -99,11 +100,19 @@ gboolean
 inf_communication_group_is_member(InfCommunicationGroup* group,
                                   InfXmlConnection* connection);
 
+GSList*
+inf_communication_group_get_members(InfCommunicationGroup* group);
+
 void
 inf_communication_group_send_message(InfCommunicationGroup* group,
                                      InfXmlConnection* connection,
                                      xmlNodePtr xml);
 
+void
+inf_communication_group_send_blob(InfCommunicationGroup* group,
+                                  InfXmlConnection* connection,
+                                  InfXmlBlob* blob);
+
 void
 inf_communication_group_send_group_message(InfCommunicationGroup* group,
                                            xmlNodePtr xml);
@@ -112,6 +121,14 @@ void
 inf_communication_group_cancel_messages(InfCommunicationGroup* group,
                                         InfXmlConnection* connection);
 
+gboolean
+inf_communication_group_hold_group_messages(InfCommunicationGroup* group,
+                                            InfXmlConnection* connection);
+
+void
+inf_communication_group_release_group_messages(InfCommunicationGroup* group,
+                                               InfXmlConnection* connection);
+
 const gchar*
 inf_communication_group_get_method_for_network(InfCommunicationGroup* group,
                                                const gchar* network);
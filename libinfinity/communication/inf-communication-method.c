@@ -161,6 +161,29 @@ inf_communication_method_is_member(InfCommunicationMethod* method,
   return iface->is_member(method, connection);
 }
 
+/**
+ * inf_communication_method_get_members:
+ * @method: A #InfCommunicationMethod.
+ *
+ * Returns all connections that were added to the group via
+ * inf_communication_method_add_member() and not removed since.
+ *
+ * Returns: (transfer container) (element-type InfXmlConnection): A list of
+ * the group members. Free with g_slist_free() when done.
+ */
+GSList*
+inf_communication_method_get_members(InfCommunicationMethod* method)
+{
+  InfCommunicationMethodInterface* iface;
+
+  g_return_val_if_fail(INF_COMMUNICATION_IS_METHOD(method), NULL);
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(method);
+  g_return_val_if_fail(iface->get_members != NULL, NULL);
+
+  return iface->get_members(method);
+}
+
 /**
  * inf_communication_method_send_single:
  * @method: A #InfCommunicationMethod.
@@ -187,6 +210,48 @@ inf_communication_method_send_single(InfCommunicationMethod* method,
   iface->send_single(method, connection, xml);
 }
 
+/**
+ * inf_communication_method_send_single_blob:
+ * @method: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection that is a group member.
+ * @blob: The message to send.
+ *
+ * Sends the message held by @blob to @connection. Unlike
+ * inf_communication_method_send_single(), this allows the method to send
+ * the already serialized message without copying it, if the connection
+ * supports it. The function does not take ownership of @blob, it adds a
+ * reference if it needs to keep it.
+ */
+void
+inf_communication_method_send_single_blob(InfCommunicationMethod* method,
+                                          InfXmlConnection* connection,
+                                          InfXmlBlob* blob)
+{
+  InfCommunicationMethodInterface* iface;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_METHOD(method));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(inf_communication_method_is_member(method, connection));
+  g_return_if_fail(blob != NULL);
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(method);
+
+  if(iface->send_single_blob != NULL)
+  {
+    iface->send_single_blob(method, connection, blob);
+  }
+  else
+  {
+    g_return_if_fail(iface->send_single != NULL);
+
+    iface->send_single(
+      method,
+      connection,
+      xmlCopyNode(inf_xml_blob_get_xml(blob), 1)
+    );
+  }
+}
+
 /**
  * inf_communication_method_send_all:
  * @method: A #InfCommunicationMethod.
@@ -322,4 +387,63 @@ inf_communication_method_sent(InfCommunicationMethod* method,
   iface->sent(method, connection, xml);
 }
 
+/**
+ * inf_communication_method_hold_group_messages:
+ * @method: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection that is a group member.
+ *
+ * Holds back messages sent to all group members, such as with
+ * inf_communication_method_send_all(), from being sent to @connection, until
+ * inf_communication_method_release_group_messages() is called. Messages
+ * sent to @connection only are still sent as usual. The held back messages
+ * are dropped if @connection is removed from the group.
+ *
+ * Returns: %TRUE if messages are held back for @connection, or %FALSE if
+ * @method does not support holding back messages.
+ */
+gboolean
+inf_communication_method_hold_group_messages(InfCommunicationMethod* method,
+                                             InfXmlConnection* connection)
+{
+  InfCommunicationMethodInterface* iface;
+
+  g_return_val_if_fail(INF_COMMUNICATION_IS_METHOD(method), FALSE);
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), FALSE);
+  g_return_val_if_fail(
+    inf_communication_method_is_member(method, connection),
+    FALSE
+  );
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(method);
+  if(iface->hold_group_messages == NULL)
+    return FALSE;
+
+  iface->hold_group_messages(method, connection);
+  return TRUE;
+}
+
+/**
+ * inf_communication_method_release_group_messages:
+ * @method: A #InfCommunicationMethod.
+ * @connection: A #InfXmlConnection.
+ *
+ * Sends the messages that have been held back for @connection since
+ * inf_communication_method_hold_group_messages(), and stops holding back
+ * messages for it. If messages are not held back for @connection, then this
+ * function does nothing.
+ */
+void
+inf_communication_method_release_group_messages(InfCommunicationMethod* meth,
+                                                InfXmlConnection* connection)
+{
+  InfCommunicationMethodInterface* iface;
+
+  g_return_if_fail(INF_COMMUNICATION_IS_METHOD(meth));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+
+  iface = INF_COMMUNICATION_METHOD_GET_IFACE(meth);
+  if(iface->release_group_messages != NULL)
+    iface->release_group_messages(meth, connection);
+}
+
 /* vim:set et sw=2 ts=2: */
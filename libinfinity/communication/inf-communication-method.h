@@ -21,6 +21,7 @@
 #define __INF_COMMUNICATION_METHOD_H__
 
 #include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-blob.h>
 #include <libinfinity/communication/inf-communication-object.h>
 
 #include <glib-object.h>
@@ -50,8 +51,12 @@ typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
  * @remove_member: Default signal handler of the
  * #InfCommunicationMethod::remove-member signal.
  * @is_member: Returns whether the given connection is a member of the group.
+ * @get_members: Returns a newly allocated list of all group members.
  * @send_single: Sends a message to a single connection. Takes ownership of
  * @xml.
+ * @send_single_blob: Sends a shared message to a single connection. This
+ * can be %NULL, in which case a copy of the message is sent with
+ * @send_single.
  * @send_all: Sends a message to all group members, except @except. Takes
  * ownership of @xml.
  * @cancel_messages: Cancel sending messages that have not yet been sent
@@ -62,6 +67,12 @@ typedef struct _InfCommunicationMethodInterface InfCommunicationMethodInterface;
  * @enqueued: Handles when a message has been enqueued to be sent on a
  * registered connection.
  * @sent: Handles when a message has been sent to a registered connection.
+ * @hold_group_messages: Keeps messages that are sent to all group members
+ * from being sent to the given connection, until @release_group_messages is
+ * called. Messages sent to the connection only are not affected. This can
+ * be %NULL if the method does not support it.
+ * @release_group_messages: Sends the messages that have been held back for
+ * the given connection, in the order they were sent to the group.
  *
  * The default signal handlers of virtual methods of #InfCommunicationMethod.
  * These implement communication within a #InfCommunicationGroup.
@@ -80,10 +91,14 @@ struct _InfCommunicationMethodInterface {
   /* Virtual functions */
   gboolean (*is_member)(InfCommunicationMethod* method,
                         InfXmlConnection* connection);
+  GSList* (*get_members)(InfCommunicationMethod* method);
 
   void (*send_single)(InfCommunicationMethod* method,
                       InfXmlConnection* connection,
                       xmlNodePtr xml);
+  void (*send_single_blob)(InfCommunicationMethod* method,
+                           InfXmlConnection* connection,
+                           InfXmlBlob* blob);
   void (*send_all)(InfCommunicationMethod* method,
                    xmlNodePtr xml);
   void (*cancel_messages)(InfCommunicationMethod* method,
@@ -98,6 +113,11 @@ struct _InfCommunicationMethodInterface {
   void (*sent)(InfCommunicationMethod* method,
                InfXmlConnection* connection,
                xmlNodePtr xml);
+
+  void (*hold_group_messages)(InfCommunicationMethod* method,
+                              InfXmlConnection* connection);
+  void (*release_group_messages)(InfCommunicationMethod* method,
+                                 InfXmlConnection* connection);
 };
 
 GType
@@ -115,11 +135,19 @@ gboolean
 inf_communication_method_is_member(InfCommunicationMethod* method,
                                    InfXmlConnection* connection);
 
+GSList*
+inf_communication_method_get_members(InfCommunicationMethod* method);
+
 void
 inf_communication_method_send_single(InfCommunicationMethod* method,
                                      InfXmlConnection* connection,
                                      xmlNodePtr xml);
 
+void
+inf_communication_method_send_single_blob(InfCommunicationMethod* method,
+                                          InfXmlConnection* connection,
+                                          InfXmlBlob* blob);
+
 void
 inf_communication_method_send_all(InfCommunicationMethod* method,
                                   xmlNodePtr xml);
@@ -143,6 +171,14 @@ inf_communication_method_sent(InfCommunicationMethod* method,
                               InfXmlConnection* connection,
                               xmlNodePtr xml);
 
+gboolean
+inf_communication_method_hold_group_messages(InfCommunicationMethod* method,
+                                             InfXmlConnection* connection);
+
+void
+inf_communication_method_release_group_messages(InfCommunicationMethod* meth,
+                                                InfXmlConnection* connection);
+
 G_END_DECLS
 
 #endif /* __INF_COMMUNICATION_METHOD_H__ */
@@ -38,6 +38,7 @@
 
 #include <libinfinity/communication/inf-communication-registry.h>
 #include <libinfinity/communication/inf-communication-group-private.h>
+#include <libinfinity/common/inf-xml-blob.h>
 #include <libinfinity/common/inf-xml-util.h>
 #include <libinfinity/inf-signals.h>
 
@@ -161,7 +162,11 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
       {
         for(xml = child->children; xml != NULL; xml = xml->next)
         {
-          inf_communication_method_enqueued(entry->method, connection, xml);
+          inf_communication_method_enqueued(
+            entry->method,
+            connection,
+            inf_xml_blob_reference_resolve(xml)
+          );
         }
       }
 
@@ -192,6 +197,66 @@ inf_communication_registry_send_real(InfCommunicationRegistryEntry* entry,
   }
 }
 
+static void
+inf_communication_registry_free_queue(InfCommunicationRegistryEntry* entry)
+{
+  xmlNodePtr xml;
+
+  for(xml = entry->queue_begin; xml != NULL; xml = xml->next)
+    inf_xml_blob_release_references(xml);
+
+  xmlFreeNodeList(entry->queue_begin);
+  entry->queue_begin = NULL;
+  entry->queue_end = NULL;
+}
+
+static void
+inf_communication_registry_enqueue(InfCommunicationRegistryEntry* entry,
+                                   xmlNodePtr xml)
+{
+  if(entry->queue_end == NULL)
+  {
+    entry->queue_begin = xml;
+    entry->queue_end = xml;
+  }
+  else
+  {
+    entry->queue_end->next = xml;
+    entry->queue_end = xml;
+  }
+
+  /* If there is something in the inner queue, don't send directly but wait
+   * until the message has been sent, for better packing. */
+  if(entry->inner_count == 0)
+  {
+    inf_communication_registry_send_real(
+      entry,
+      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
+    );
+  }
+}
+
+static InfCommunicationRegistryEntry*
+inf_communication_registry_lookup_entry(InfCommunicationRegistry* registry,
+                                        InfCommunicationGroup* group,
+                                        InfXmlConnection* connection)
+{
+  InfCommunicationRegistryPrivate* priv;
+  InfCommunicationRegistryKey key;
+  InfCommunicationRegistryEntry* entry;
+
+  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
+  key.connection = connection;
+  key.publisher_id =
+    inf_communication_group_get_publisher_id(group, connection);
+  key.group_name = inf_communication_group_get_name(group);
+
+  entry = g_hash_table_lookup(priv->entries, &key);
+  g_free(key.publisher_id);
+
+  return entry;
+}
+
 /* Required by inf_communication_registry_entry_free() */
 static void
 inf_communication_registry_group_unrefed(gpointer user_data,
@@ -228,6 +293,9 @@ inf_communication_registry_entry_free(gpointer data)
       inf_communication_registry_send_real(entry, G_MAXUINT);
   }
 
+  /* Messages that could not be sent anymore */
+  inf_communication_registry_free_queue(entry);
+
   if(entry->group)
   {
     g_object_weak_unref(
@@ -430,7 +498,7 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
   {
     if(entry->sent_list != NULL)
     {
-      entry->sent_list->next = xmlCopyNode(xml, 1);
+      entry->sent_list->next = inf_xml_blob_copy_tree(xml);
       entry->sent_list = entry->sent_list->next;
     }
     else
@@ -457,7 +525,7 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
             inf_communication_method_sent(
               entry->method,
               entry->key.connection,
-              cur
+              inf_xml_blob_reference_resolve(cur)
             );
 
             /* If the callback did unregister us, then the activation count
@@ -475,7 +543,11 @@ inf_communication_registry_sent_cb(InfXmlConnection* connection,
         child = child->next;
 
         if(cur == entry->sent_list) entry->sent_list = NULL;
-        if(cur != xml) xmlFreeNode(cur);
+        if(cur != xml)
+        {
+          inf_xml_blob_release_references(cur);
+          xmlFreeNode(cur);
+        }
       }
     }
 
@@ -997,8 +1069,6 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml)
 {
-  InfCommunicationRegistryPrivate* priv;
-  InfCommunicationRegistryKey key;
   InfCommunicationRegistryEntry* entry;
 
   g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
@@ -1006,38 +1076,56 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
   g_return_if_fail(INF_IS_XML_CONNECTION(connection));
   g_return_if_fail(xml != NULL);
 
-  priv = INF_COMMUNICATION_REGISTRY_PRIVATE(registry);
-  key.connection = connection;
-  key.publisher_id =
-    inf_communication_group_get_publisher_id(group, connection);
-  key.group_name = inf_communication_group_get_name(group);
-
-  entry = g_hash_table_lookup(priv->entries, &key);
+  entry = inf_communication_registry_lookup_entry(registry, group, connection);
   g_assert(entry != NULL && entry->registered == TRUE);
 
   xmlUnlinkNode(xml);
-  if(entry->queue_end == NULL)
-  {
-    entry->queue_begin = xml;
-    entry->queue_end = xml;
-  }
-  else
-  {
-    entry->queue_end->next = xml;
-    entry->queue_end = xml;
-  }
+  inf_communication_registry_enqueue(entry, xml);
+}
 
-  /* If there is something in the inner queue, don't send directly but wait
-   * until the message has been sent, for better packing. */
-  if(entry->inner_count == 0)
-  {
-    inf_communication_registry_send_real(
-      entry,
-      INF_COMMUNICATION_REGISTRY_INNER_QUEUE_LIMIT - entry->inner_count
-    );
-  }
+/**
+ * inf_communication_registry_send_blob:
+ * @registry: A #InfCommunicationRegistry.
+ * @group: The group for which to send the message #InfCommunicationGroup.
+ * @connection: A registered #InfXmlConnection.
+ * @blob: The message to send.
+ *
+ * Sends the XML message held by @blob to @connection, in the same way as
+ * inf_communication_registry_send(). This is meant to be used when the same
+ * message is sent to many connections: If
+ * inf_xml_connection_accepts_blob_references() returns %TRUE for
+ * @connection, only a reference to @blob is queued, and the message is
+ * neither copied nor serialized again for @connection. Otherwise, a copy of
+ * the message is sent.
+ *
+ * The function does not take ownership of @blob, but keeps a reference as
+ * long as it needs it.
+ */
+void
+inf_communication_registry_send_blob(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     InfXmlBlob* blob)
+{
+  InfCommunicationRegistryEntry* entry;
+  xmlNodePtr xml;
 
-  g_free(key.publisher_id);
+  g_return_if_fail(INF_COMMUNICATION_IS_REGISTRY(registry));
+  g_return_if_fail(INF_COMMUNICATION_IS_GROUP(group));
+  g_return_if_fail(INF_IS_XML_CONNECTION(connection));
+  g_return_if_fail(blob != NULL);
+
+  entry = inf_communication_registry_lookup_entry(registry, group, connection);
+  g_assert(entry != NULL && entry->registered == TRUE);
+
+  /* Connections which do not accept blob references might pass the XML on
+   * as-is, so they get a full copy. */
+  if(inf_xml_connection_accepts_blob_references(connection))
+    xml = inf_xml_blob_reference_new(blob);
+  else
+    xml = xmlCopyNode(inf_xml_blob_get_xml(blob), 1);
+
+  inf_communication_registry_enqueue(entry, xml);
 }
 
 /**
@@ -1072,9 +1160,7 @@ inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
   g_assert(entry != NULL && entry->registered == TRUE);
 
   /* TODO: Don't cancel messages prior activation? */
-  xmlFreeNodeList(entry->queue_begin);
-  entry->queue_begin = NULL;
-  entry->queue_end = NULL;
+  inf_communication_registry_free_queue(entry);
 
   g_free(key.publisher_id);
 }
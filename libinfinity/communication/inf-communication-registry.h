@@ -22,6 +22,7 @@
 
 #include <libinfinity/communication/inf-communication-group.h>
 #include <libinfinity/communication/inf-communication-method.h>
+#include <libinfinity/common/inf-xml-blob.h>
 
 #include <glib-object.h>
 
@@ -83,6 +84,12 @@ inf_communication_registry_send(InfCommunicationRegistry* registry,
                                 InfXmlConnection* connection,
                                 xmlNodePtr xml);
 
+void
+inf_communication_registry_send_blob(InfCommunicationRegistry* registry,
+                                     InfCommunicationGroup* group,
+                                     InfXmlConnection* connection,
+                                     InfXmlBlob* blob);
+
 void
 inf_communication_registry_cancel_messages(InfCommunicationRegistry* registry,
                                            InfCommunicationGroup* group,
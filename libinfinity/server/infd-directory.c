@@ -32,12 +32,20 @@
  *
  * #InfdStorage defines where the directory structure and the notes are read
  * from and how they are permanently stored.
+ *
+ * If #InfdDirectory:worker-threads is non-zero, the sessions of the
+ * directory are distributed over that many threads, so that several
+ * documents can be edited concurrently. All network traffic is still handled
+ * by the thread that runs the directory's #InfIo. See infd_directory_lock()
+ * for what this means for code accessing the directory.
  **/
 
 #include <libinfinity/server/infd-directory.h>
 #include <libinfinity/server/infd-account-storage.h>
 #include <libinfinity/server/infd-request.h>
 #include <libinfinity/server/infd-progress-request.h>
+#include <libinfinity/server/infd-worker-io.h>
+#include <libinfinity/server/infd-worker-connection.h>
 #include <libinfinity/common/inf-session.h>
 #include <libinfinity/common/inf-chat-session.h>
 #include <libinfinity/common/inf-request-result.h>
@@ -59,6 +67,9 @@ typedef enum _InfdDirectoryNodeType {
   INFD_DIRECTORY_NODE_UNKNOWN,
 } InfdDirectoryNodeType;
 
+typedef struct _InfdDirectoryExplore InfdDirectoryExplore;
+typedef struct _InfdDirectoryLoad InfdDirectoryLoad;
+
 typedef struct _InfdDirectoryNode InfdDirectoryNode;
 struct _InfdDirectoryNode {
   InfdDirectoryNode* parent;
@@ -82,6 +93,8 @@ struct _InfdDirectoryNode {
       InfIoTimeout* save_timeout;
       /* Whether we hold a weak reference or a strong reference on session */
       gboolean weakref;
+      /* Session being read from the storage, or NULL */
+      InfdDirectoryLoad* load;
     } note;
 
     struct {
@@ -99,10 +112,83 @@ struct _InfdDirectoryNode {
        * This is required because the nodes field may be NULL due to an empty
        * subdirectory or due to an unexplored subdirectory. */
       gboolean explored;
+      /* Exploration in progress, or NULL */
+      InfdDirectoryExplore* explore;
     } subdir;
   } shared;
 };
 
+/* A request that cannot be handled before a subdirectory is explored */
+typedef struct _InfdDirectoryQueuedRequest InfdDirectoryQueuedRequest;
+struct _InfdDirectoryQueuedRequest {
+  InfXmlConnection* connection;
+  xmlNodePtr xml;
+};
+
+typedef struct _InfdDirectoryExploreItem InfdDirectoryExploreItem;
+struct _InfdDirectoryExploreItem {
+  InfdDirectoryExplore* explore;
+  guint index;
+};
+
+/* A subdirectory whose content is read from the storage in the
+ * background */
+struct _InfdDirectoryExplore {
+  /* NULL if the exploration has been cancelled. In that case the results are
+   * dropped when the storage reports them. */
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdProgressRequest* request;
+  gchar* path;
+
+  /* Requests to be handled when the exploration has finished, in reverse
+   * order */
+  GSList* queued;
+
+  /* Results from the storage */
+  GSList* list;
+  guint n_items;
+  GSList** acls;
+  InfdDirectoryExploreItem* items;
+  /* Number of storage calls that have not yet reported back */
+  guint n_pending;
+  GError* error;
+};
+
+/* A session that is read from the storage in the background */
+struct _InfdDirectoryLoad {
+  /* NULL if the load has been cancelled. In that case the session is dropped
+   * when the plugin reports it. */
+  InfdDirectory* directory;
+  InfdDirectoryNode* node;
+  InfdRequest* request;
+  /* Whether the session has been subscribed to locally, in which case it is
+   * linked to the node as soon as it has been read. */
+  gboolean local;
+
+  /* Requests to be handled when the session has been read, in reverse
+   * order */
+  GSList* queued;
+  /* The session that has been read, while the queued requests are being
+   * handled */
+  InfdSessionProxy* proxy;
+};
+
+/* A session that is written to the storage in the background */
+typedef struct _InfdDirectorySave InfdDirectorySave;
+struct _InfdDirectorySave {
+  /* NULL if the directory has been disposed before writing finished */
+  InfdDirectory* directory;
+  guint node_id;
+  InfdSessionProxy* proxy;
+  gchar* path;
+
+  /* The connection that asked for the session to be saved, and its
+   * request, or NULL if the session is saved because it has become idle. */
+  InfXmlConnection* connection;
+  xmlNodePtr xml;
+};
+
 typedef struct _InfdDirectorySessionSaveTimeoutData
   InfdDirectorySessionSaveTimeoutData;
 struct _InfdDirectorySessionSaveTimeoutData {
@@ -173,6 +259,10 @@ typedef struct _InfdDirectoryConnectionInfo InfdDirectoryConnectionInfo;
 struct _InfdDirectoryConnectionInfo {
   guint seq_id;
   InfAclAccountId account_id;
+
+  /* Stand-ins for the connection in each worker thread, created on demand.
+   * NULL if the directory has no worker threads. */
+  InfdWorkerConnection** mirrors;
 };
 
 typedef struct _InfdDirectoryTransientAccount InfdDirectoryTransientAccount;
@@ -205,8 +295,24 @@ struct _InfdDirectoryPrivate {
 
   GSList* sync_ins;
   GSList* subscription_requests;
+  GSList* explores;
+  GSList* loads;
+  GSList* saves;
 
   InfdSessionProxy* chat_session;
+
+  /* Worker threads running sessions. If there are workers, then io is the
+   * pool of the workers, wrapping the InfIo the directory was created
+   * with. */
+  guint n_workers;
+  InfdWorkerIo* workers;
+  InfCommunicationManager** worker_managers;
+
+  /* Nodes whose session changed its idle status in a worker thread. These
+   * are handled in the main thread. Protected by idle_mutex. */
+  GMutex idle_mutex;
+  GHashTable* idle_nodes;
+  InfIoDispatch* idle_dispatch;
 };
 
 enum {
@@ -220,6 +326,8 @@ enum {
   PROP_PRIVATE_KEY,
   PROP_CERTIFICATE,
 
+  PROP_WORKER_THREADS,
+
   /* read only */
   PROP_CHAT_SESSION,
   PROP_STATUS
@@ -274,6 +382,7 @@ static const unsigned int DAYS = 24 * 60 * 60;
 
 static guint directory_signals[LAST_SIGNAL];
 static GQuark infd_directory_node_id_quark;
+static GQuark infd_directory_worker_quark;
 
 /* Time a session needs to be idle before it is unloaded from RAM */
 /* TODO: This should be a property: */
@@ -368,1735 +477,2612 @@ infd_directory_node_make_path(InfdDirectoryNode* node,
 }
 
 /*
- * Save timeout
+ * Worker threads
  */
 
-/* Required by infd_directory_session_save_timeout_func() */
-static void
-infd_directory_node_unlink_session(InfdDirectory* directory,
-                                   InfdDirectoryNode* node,
-                                   InfdRequest* request);
+/* Returns the worker that runs the session of the node with the given ID
+ * if it is loaded from the storage or newly created. The return value is the
+ * index of the worker plus one, or 0 if the directory does not have worker
+ * threads. */
+static guint
+infd_directory_get_worker_for_node(InfdDirectory* directory,
+                                   guint node_id)
+{
+  InfdDirectoryPrivate* priv;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-static void
-infd_directory_session_save_timeout_data_free(gpointer data)
+  if(priv->workers == NULL)
+    return 0;
+
+  return node_id % priv->n_workers + 1;
+}
+
+/* Returns the worker that a subscription group or session proxy has been
+ * assigned to, or 0 if it lives in the main thread. */
+static guint
+infd_directory_get_worker_for_object(gpointer object)
 {
-  g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
+  return GPOINTER_TO_UINT(
+    g_object_get_qdata(G_OBJECT(object), infd_directory_worker_quark)
+  );
 }
 
+/* Returns the InfIo and communication manager to use for objects living in
+ * the given worker. */
 static void
-infd_directory_session_save_timeout_func(gpointer user_data)
+infd_directory_get_worker_context(InfdDirectory* directory,
+                                  guint worker,
+                                  InfIo** io,
+                                  InfCommunicationManager** manager)
 {
-  InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
-  GError* error;
-  gchar* path;
-  gboolean result;
-  InfSession* session;
-
-  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
-
-  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
-  priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
-  error = NULL;
-
-  infd_directory_node_get_path(timeout_data->node, &path, NULL);
-
-  g_object_get(
-    G_OBJECT(timeout_data->node->shared.note.session),
-    "session", &session,
-    NULL
-  );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* TODO: Only write if the buffer modified-flag is set */
+  if(worker == 0)
+  {
+    if(io != NULL) *io = priv->io;
+    if(manager != NULL) *manager = priv->communication_manager;
+  }
+  else
+  {
+    g_assert(priv->workers != NULL && worker <= priv->n_workers);
 
-  result = timeout_data->node->shared.note.plugin->session_write(
-    priv->storage,
-    session,
-    path,
-    timeout_data->node->shared.note.plugin->user_data,
-    &error
-  );
+    if(io != NULL)
+      *io = INF_IO(infd_worker_io_get_worker(priv->workers, worker - 1));
+    if(manager != NULL)
+      *manager = priv->worker_managers[worker - 1];
+  }
+}
 
-  g_object_unref(session);
+/* Returns the connection that represents connection in the thread of proxy.
+ * If the proxy lives in a worker thread, then this is the mirror of the
+ * connection in that worker. If there is no mirror yet it is created if
+ * create is TRUE, otherwise NULL is returned. */
+static InfXmlConnection*
+infd_directory_get_connection_for_proxy(InfdDirectory* directory,
+                                        InfdSessionProxy* proxy,
+                                        InfXmlConnection* connection,
+                                        gboolean create)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryConnectionInfo* info;
+  InfdWorkerIo* worker_io;
+  guint worker;
 
-  /* TODO: Unset modified flag of buffer if result == TRUE */
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  worker = infd_directory_get_worker_for_object(proxy);
+  if(worker == 0) return connection;
 
-  /* The timeout is removed automatically after it has elapsed */
-  timeout_data->node->shared.note.save_timeout = NULL;
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL && info->mirrors != NULL);
 
-  if(result == FALSE)
+  if(info->mirrors[worker - 1] == NULL && create == TRUE)
   {
-    g_warning(
-      _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
-        "save attempt will be made when the server is shut down."),
-      path,
-      error->message
-    );
+    worker_io = infd_worker_io_get_worker(priv->workers, worker - 1);
 
-    g_error_free(error);
-  }
-  else
-  {
-    infd_directory_node_unlink_session(
-      timeout_data->directory,
-      timeout_data->node,
-      NULL
+    info->mirrors[worker - 1] = infd_worker_connection_new(
+      connection,
+      worker_io,
+      infd_worker_io_get_inner(priv->workers)
     );
   }
 
-  g_free(path);
+  return INF_XML_CONNECTION(info->mirrors[worker - 1]);
 }
 
+/* Passes a message that was received or sent on connection on to the mirror
+ * of the connection in the worker responsible for the message's group, if
+ * any. Messages that are not for a session running in that worker are
+ * ignored by the worker's communication registry. */
 static void
-infd_directory_start_session_save_timeout(InfdDirectory* directory,
-                                          InfdDirectoryNode* node)
+infd_directory_forward_to_worker(InfdDirectory* directory,
+                                 InfXmlConnection* connection,
+                                 const xmlNodePtr xml,
+                                 gboolean received)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectorySessionSaveTimeoutData* timeout_data;
+  InfdDirectoryConnectionInfo* info;
+  InfdWorkerConnection* mirror;
+  xmlChar* group_name;
+  const gchar* id_str;
+  gchar* endptr;
+  guint64 node_id;
+
+  static const gchar PREFIX[] = "InfSession_";
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  timeout_data = g_slice_new(InfdDirectorySessionSaveTimeoutData);
-  timeout_data->directory = directory;
-  timeout_data->node = node;
+  info = g_hash_table_lookup(priv->connections, connection);
+  if(info == NULL || info->mirrors == NULL) return;
 
-  if(priv->storage != NULL)
+  if(strcmp((const char*)xml->name, "group") != 0) return;
+  group_name = xmlGetProp(xml, (const xmlChar*)"name");
+  if(group_name == NULL) return;
+
+  mirror = NULL;
+  if(strncmp((const char*)group_name, PREFIX, sizeof(PREFIX) - 1) == 0)
   {
-    node->shared.note.save_timeout = inf_io_add_timeout(
-      priv->io,
-      INFD_DIRECTORY_SAVE_TIMEOUT,
-      infd_directory_session_save_timeout_func,
-      timeout_data,
-      infd_directory_session_save_timeout_data_free
-    );
+    id_str = (const gchar*)group_name + sizeof(PREFIX) - 1;
+    node_id = g_ascii_strtoull(id_str, &endptr, 10);
+
+    if(endptr != id_str && *endptr == '\0' && node_id <= G_MAXUINT)
+    {
+      mirror = info->mirrors[
+        infd_directory_get_worker_for_node(directory, (guint)node_id) - 1
+      ];
+    }
+  }
+
+  xmlFree(group_name);
+
+  if(mirror != NULL)
+  {
+    if(received)
+      infd_worker_connection_forward_received(mirror, xml);
+    else
+      infd_worker_connection_forward_sent(mirror, xml);
   }
 }
 
 static void
-infd_directory_session_weak_ref_cb(gpointer data,
-                                   GObject* where_the_object_was)
+infd_directory_connection_received_cb(InfXmlConnection* connection,
+                                      xmlNodePtr xml,
+                                      gpointer user_data)
 {
-  InfdDirectoryNode* node;
-  node = (InfdDirectoryNode*)data;
-
-  g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
-  g_assert(node->shared.note.weakref == TRUE);
-  g_assert(node->shared.note.save_timeout == NULL);
+  infd_directory_forward_to_worker(
+    INFD_DIRECTORY(user_data),
+    connection,
+    xml,
+    TRUE
+  );
+}
 
-  node->shared.note.session = NULL;
-  node->shared.note.weakref = FALSE;
+static void
+infd_directory_connection_sent_cb(InfXmlConnection* connection,
+                                  xmlNodePtr xml,
+                                  gpointer user_data)
+{
+  infd_directory_forward_to_worker(
+    INFD_DIRECTORY(user_data),
+    connection,
+    xml,
+    FALSE
+  );
 }
 
+/* Closes the mirrors of a connection that is removed from the directory */
 static void
-infd_directory_session_idle_notify_cb(GObject* object,
-                                      GParamSpec* pspec,
-                                      gpointer user_data)
+infd_directory_connection_info_release_mirrors(InfdDirectory* directory,
+                                               InfdDirectoryConnectionInfo* i)
 {
-  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  gpointer node_id;
-  InfdDirectoryNode* node;
+  guint n;
 
-  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  node_id = g_object_get_qdata(object, infd_directory_node_id_quark);
-  node = g_hash_table_lookup(priv->nodes, node_id);
-  g_assert(node != NULL);
+  if(i->mirrors == NULL) return;
 
-  /* Drop session from memory if it remains idle */
-  if(infd_session_proxy_is_idle(INFD_SESSION_PROXY(object)))
+  for(n = 0; n < priv->n_workers; ++n)
   {
-    if(node->shared.note.weakref == FALSE &&
-       node->shared.note.save_timeout == NULL)
+    if(i->mirrors[n] != NULL)
     {
-      infd_directory_start_session_save_timeout(directory, node);
+      infd_worker_connection_detach(i->mirrors[n]);
+      g_object_unref(i->mirrors[n]);
     }
   }
-  else
-  {
-    /* If a session becomes non-idle again then strong-ref it */
-    if(node->shared.note.weakref == TRUE)
-    {
-      g_object_ref(node->shared.note.session);
-      g_assert(node->shared.note.save_timeout == NULL);
-      node->shared.note.weakref = FALSE;
 
-      g_object_weak_unref(
-        G_OBJECT(node->shared.note.session),
-        infd_directory_session_weak_ref_cb,
-        node
-      );
-    }
-    else if(node->shared.note.save_timeout != NULL)
-    {
-      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-      node->shared.note.save_timeout = NULL;
-    }
-  }
+  g_free(i->mirrors);
+  i->mirrors = NULL;
 }
 
-static gboolean
-infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
-                                           InfXmlConnection* connection,
-                                           const GArray* user_properties,
-                                           InfUser* rejoin_user,
-                                           gpointer user_data)
+static void
+infd_directory_lock_workers(InfdDirectory* directory)
 {
-  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  gpointer node_id;
-  InfdDirectoryNode* node;
-
-  InfdDirectoryConnectionInfo* info;
-  InfBrowserIter iter;
-  InfAclMask check_mask;
-  gboolean result;
-
-  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  node_id = g_object_get_qdata(G_OBJECT(proxy), infd_directory_node_id_quark);
-  node = g_hash_table_lookup(priv->nodes, node_id);
-  g_assert(node != NULL);
-
-  /* ACL cannot prevent local users from joining */
-  if(connection != NULL)
-  {
-    info = g_hash_table_lookup(priv->connections, connection);
-    g_assert(info != NULL);
-
-    iter.node_id = node->id;
-    iter.node = node;
-
-    inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
-
-    result = inf_browser_check_acl(
-      INF_BROWSER(directory),
-      &iter,
-      info->account_id,
-      &check_mask,
-      NULL
-    );
-
-    /* Reject the user join if the permission is not set. */
-    if(result == FALSE)
-      return TRUE;
-  }
 
-  return FALSE;
+  if(priv->workers != NULL)
+    infd_worker_io_lock(priv->workers);
 }
 
-/* Releases a session fully from the directory. This is not normally needed
- * because if we don't need a session anymore we still keep a weak reference
- * to it around, in case we need to recover it later. When nobody is holding
- * a strong reference to it anymore we clear the pointer in
- * infd_directory_session_weak_ref_cb(). The only point where this function
- * is being called is when a node with an active session is removed from the
- * directory. */
 static void
-infd_directory_release_session(InfdDirectory* directory,
-                               InfdDirectoryNode* node,
-                               InfdSessionProxy* session)
+infd_directory_unlock_workers(InfdDirectory* directory)
 {
   InfdDirectoryPrivate* priv;
-
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(node->shared.note.session == session);
+  if(priv->workers != NULL)
+    infd_worker_io_unlock(priv->workers);
+}
 
-  if(node->shared.note.save_timeout != NULL)
-  {
-    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
-    node->shared.note.save_timeout = NULL;
-  }
+/*
+ * Save timeout
+ */
 
-  inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(session),
-    G_CALLBACK(infd_directory_session_idle_notify_cb),
-    directory
-  );
+/* Required by infd_directory_session_save_timeout_func() */
+static void
+infd_directory_node_unlink_session(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   InfdRequest* request);
 
-  inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(session),
-    G_CALLBACK(infd_directory_session_reject_user_join_cb),
-    directory
-  );
+static void
+infd_directory_session_save_timeout_data_free(gpointer data)
+{
+  g_slice_free(InfdDirectorySessionSaveTimeoutData, data);
+}
 
-  g_object_set_qdata(
-    G_OBJECT(session),
-    infd_directory_node_id_quark,
-    NULL
-  );
+/* Required by infd_directory_session_save_cb() */
+static gboolean
+infd_directory_make_seq(InfdDirectory* directory,
+                        InfXmlConnection* connection,
+                        xmlNodePtr xml,
+                        gchar** seq,
+                        GError** error);
 
-  if(node->shared.note.weakref == TRUE)
-  {
-    g_object_weak_unref(
-      G_OBJECT(session),
-      infd_directory_session_weak_ref_cb,
-      node
-    );
-  }
-  else
+static void
+infd_directory_send_request_failed(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const xmlNodePtr xml,
+                                   const GError* error);
+
+static void
+infd_directory_save_free(InfdDirectorySave* save)
+{
+  g_object_unref(save->proxy);
+  g_free(save->path);
+
+  if(save->connection != NULL)
   {
-    g_object_unref(session);
+    g_object_unref(save->connection);
+    xmlFreeNode(save->xml);
   }
 
-  node->shared.note.session = NULL;
-  node->shared.note.weakref = FALSE;
+  g_slice_free(InfdDirectorySave, save);
 }
 
-/*
- * ACLs
- */
-
 static void
-infd_directory_announce_acl_account(InfdDirectory* directory,
-                                    const InfAclAccount* account,
-                                    InfXmlConnection* except)
+infd_directory_session_save_cb(const GError* error,
+                               gpointer user_data)
 {
+  InfdDirectorySave* save;
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  InfBrowser* browser;
-  xmlNodePtr xml;
-  InfBrowserIter iter;
-  InfAclMask mask;
-
-  GHashTableIter hash_iter;
-  gpointer key;
-  gpointer value;
+  InfdDirectoryNode* node;
+  xmlNodePtr reply_xml;
+  gchar* seq;
 
-  InfXmlConnection* connection;
-  InfdDirectoryConnectionInfo* conn_info;
-  InfAclAccountId account_id;
+  save = (InfdDirectorySave*)user_data;
+  directory = save->directory;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  browser = INF_BROWSER(directory);
+  if(directory == NULL)
+  {
+    if(error != NULL)
+    {
+      g_warning(
+        _("Failed to save note \"%s\": %s"),
+        save->path,
+        error->message
+      );
+    }
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"add-acl-account");
-  inf_acl_account_to_xml(account, xml);
+    infd_directory_save_free(save);
+    return;
+  }
 
-  iter.node = priv->root;
-  iter.node_id = priv->root->id;
-  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  priv->saves = g_slist_remove(priv->saves, save);
 
-  /* Send to all connections that have the INF_ACL_CAN_QUERY_ACCOUNT_LIST
-   * permission. */
-  g_hash_table_iter_init(&hash_iter, priv->connections);
-  while(g_hash_table_iter_next(&hash_iter, &key, &value))
+  if(save->connection == NULL)
   {
-    connection = INF_XML_CONNECTION(key);
-    conn_info = (InfdDirectoryConnectionInfo*)value;
-    account_id = conn_info->account_id;
-    g_assert(account_id != 0);
+    if(error != NULL)
+    {
+      g_warning(
+        _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+          "save attempt will be made when the server is shut down."),
+        save->path,
+        error->message
+      );
+    }
+    else
+    {
+      /* Only unload the session if it is still the node's session, and if
+       * it has not become active again while it was being written. */
+      node = g_hash_table_lookup(
+        priv->nodes,
+        GUINT_TO_POINTER(save->node_id)
+      );
 
-    if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL) &&
-       connection != except)
+      if(node != NULL &&
+         node->type == INFD_DIRECTORY_NODE_NOTE &&
+         node->shared.note.session == save->proxy &&
+         node->shared.note.weakref == FALSE &&
+         node->shared.note.save_timeout == NULL &&
+         infd_session_proxy_is_idle(save->proxy))
+      {
+        infd_directory_node_unlink_session(directory, node, NULL);
+      }
+    }
+  }
+  else if(g_hash_table_lookup(priv->connections, save->connection) != NULL)
+  {
+    if(error != NULL)
+    {
+      infd_directory_send_request_failed(
+        directory,
+        save->connection,
+        save->xml,
+        error
+      );
+    }
+    else
     {
+      /* The seq attribute has been checked when the request was made */
+      if(!infd_directory_make_seq(directory, save->connection, save->xml,
+                                  &seq, NULL))
+      {
+        seq = NULL;
+      }
+
+      reply_xml = xmlNewNode(NULL, (const xmlChar*)"session-saved");
+      if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+      g_free(seq);
+
       inf_communication_group_send_message(
         INF_COMMUNICATION_GROUP(priv->group),
-        connection,
-        xmlCopyNode(xml, 1)
+        save->connection,
+        reply_xml
       );
     }
   }
 
-  inf_browser_acl_account_added(INF_BROWSER(directory), account, NULL);
-
-  xmlFreeNode(xml);
+  infd_directory_save_free(save);
 }
 
-/* acl_connections is a list of connections which have queried the full ACL.
- * It can be NULL in which case only the default sheet and the sheet for that
- * particular connection are sent. */
-static gboolean
-infd_directory_acl_sheets_to_xml_for_connection(InfdDirectory* directory,
-                                                GSList* acl_connections,
-                                                const InfAclSheetSet* sheets,
-                                                InfXmlConnection* connection,
-                                                xmlNodePtr xml)
+/* Writes the session of node to the storage in the background, with the
+ * plugin's session_write_async. If connection is not NULL, it is told the
+ * result of its request xml when writing has finished. Otherwise, the
+ * session is unlinked if it is still idle by then. */
+static void
+infd_directory_node_save_session_async(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfXmlConnection* connection,
+                                       const xmlNodePtr xml)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryConnectionInfo* info;
-  guint written_sheets;
-  InfAclSheet selected_sheets[2];
-  InfAclSheetSet set;
-  InfAclAccountId default_id;
-  guint i;
+  InfdDirectorySave* save;
+  InfSession* session;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(g_slist_find(acl_connections, connection) != NULL)
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+  g_assert(node->shared.note.plugin->session_write_async != NULL);
+
+  save = g_slice_new(InfdDirectorySave);
+  save->directory = directory;
+  save->node_id = node->id;
+  save->proxy = node->shared.note.session;
+  infd_directory_node_get_path(node, &save->path, NULL);
+  save->connection = connection;
+  save->xml = NULL;
+
+  g_object_ref(save->proxy);
+  if(connection != NULL)
   {
-    if(sheets->n_sheets > 0)
-      inf_acl_sheet_set_to_xml(sheets, xml);
-    written_sheets = sheets->n_sheets;
+    g_object_ref(connection);
+    save->xml = xmlCopyNode(xml, 1);
   }
-  else
-  {
-    /* Otherwise, add only the sheets for the user itself and the default
-     * sheet. */
-    info = g_hash_table_lookup(priv->connections, connection);
-    g_assert(info != NULL);
 
-    default_id = inf_acl_account_id_from_string("default");
+  priv->saves = g_slist_prepend(priv->saves, save);
 
-    written_sheets = 0;
-    for(i = 0; i < sheets->n_sheets && written_sheets < 2; ++i)
-    {
-      if(sheets->sheets[i].account == default_id ||
-         sheets->sheets[i].account == info->account_id)
-      {
-        selected_sheets[written_sheets] = sheets->sheets[i];
-        ++written_sheets;
-      }
-    }
+  g_object_get(G_OBJECT(save->proxy), "session", &session, NULL);
 
-    if(written_sheets > 0)
-    {
-      set.own_sheets = NULL;
-      set.sheets = selected_sheets;
-      set.n_sheets = written_sheets;
-      inf_acl_sheet_set_to_xml(&set, xml);
-    }
-  }
+  node->shared.note.plugin->session_write_async(
+    priv->storage,
+    session,
+    save->path,
+    node->shared.note.plugin->user_data,
+    priv->io,
+    infd_directory_session_save_cb,
+    save
+  );
 
-  if(written_sheets == 0)
-    return FALSE;
-  return TRUE;
+  g_object_unref(session);
 }
 
 static void
-infd_directory_announce_acl_sheets_for_connection(InfdDirectory* directory,
-                                                  const InfdDirectoryNode* nd,
-                                                  const InfAclSheetSet* shts,
-                                                  InfXmlConnection* conn)
+infd_directory_session_save_timeout_func(gpointer user_data)
 {
+  InfdDirectorySessionSaveTimeoutData* timeout_data;
   InfdDirectoryPrivate* priv;
-  gboolean has_sheets;
-  xmlNodePtr xml;
-  gboolean any_sheets;
+  GError* error;
+  gchar* path;
+  gboolean result;
+  InfSession* session;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  timeout_data = (InfdDirectorySessionSaveTimeoutData*)user_data;
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"set-acl");
+  g_assert(timeout_data->node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(timeout_data->node->shared.note.save_timeout != NULL);
+  priv = INFD_DIRECTORY_PRIVATE(timeout_data->directory);
+  error = NULL;
 
-  any_sheets = infd_directory_acl_sheets_to_xml_for_connection(
-    directory,
-    nd->acl_connections,
-    shts,
-    conn,
-    xml
-  );
+  /* TODO: Only write if the buffer modified-flag is set */
 
-  if(any_sheets == TRUE)
+  if(timeout_data->node->shared.note.plugin->session_write_async != NULL)
   {
-    inf_xml_util_set_attribute_uint(xml, "id", nd->id);
+    /* The timeout is removed automatically after it has elapsed */
+    timeout_data->node->shared.note.save_timeout = NULL;
 
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      conn,
-      xml
+    /* The session is unlinked once it has been written */
+    infd_directory_node_save_session_async(
+      timeout_data->directory,
+      timeout_data->node,
+      NULL,
+      NULL
     );
+
+    return;
   }
-  else
-  {
-    xmlFreeNode(xml);
-  }
-}
 
-static void
-infd_directory_announce_acl_sheets(InfdDirectory* directory,
-                                   InfdDirectoryNode* node,
-                                   InfdRequest* request,
-                                   const InfAclSheetSet* sheet_set,
-                                   InfXmlConnection* except)
-{
-  InfdDirectoryPrivate* priv;
-  xmlNodePtr xml;
-  GList* connection_list;
-  GSList* local_connection_list;
-  GList* item;
-  GSList* local_item;
-  InfBrowserIter iter;
+  infd_directory_node_get_path(timeout_data->node, &path, NULL);
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_object_get(
+    G_OBJECT(timeout_data->node->shared.note.session),
+    "session", &session,
+    NULL
+  );
 
-  /* Go through all connections that see this node, i.e. have explored the
-   * parent node. To those connections we need to send an ACL update. */
-  if(node->parent == NULL)
-  {
-    connection_list = g_hash_table_get_keys(priv->connections);
+  result = timeout_data->node->shared.note.plugin->session_write(
+    priv->storage,
+    session,
+    path,
+    timeout_data->node->shared.note.plugin->user_data,
+    &error
+  );
 
-    for(item = connection_list; item != NULL; item = g_list_next(item))
-    {
-      if(item->data != except)
-      {
-        infd_directory_announce_acl_sheets_for_connection(
-          directory,
-          node,
-          sheet_set,
-          INF_XML_CONNECTION(item->data)
-        );
-      }
-    }
+  g_object_unref(session);
 
-    g_list_free(connection_list);
-  }
-  else
+  /* TODO: Unset modified flag of buffer if result == TRUE */
+
+  /* The timeout is removed automatically after it has elapsed */
+  timeout_data->node->shared.note.save_timeout = NULL;
+
+  if(result == FALSE)
   {
-    local_connection_list = node->parent->shared.subdir.connections;
+    g_warning(
+      _("Failed to save note \"%s\": %s\n\nKeeping it in memory. Another "
+        "save attempt will be made when the server is shut down."),
+      path,
+      error->message
+    );
 
-    for(local_item = local_connection_list;
-        local_item != NULL;
-        local_item = g_slist_next(local_item))
-    {
-      if(local_item->data != except)
-      {
-        infd_directory_announce_acl_sheets_for_connection(
-          directory,
-          node,
-          sheet_set,
-          INF_XML_CONNECTION(local_item->data)
-        );
-      }
-    }
+    g_error_free(error);
+  }
+  else if(infd_session_proxy_is_idle(timeout_data->node->shared.note.session))
+  {
+    /* With worker threads, the session might have become active again
+     * without us having been notified yet. */
+    infd_directory_node_unlink_session(
+      timeout_data->directory,
+      timeout_data->node,
+      NULL
+    );
   }
 
-  iter.node_id = node->id;
-  iter.node = node;
-
-  inf_browser_acl_changed(
-    INF_BROWSER(directory),
-    &iter,
-    sheet_set,
-    INF_REQUEST(request)
-  );
+  g_free(path);
 }
 
-static InfAclAccountId
-infd_directory_get_account_for_certificate(InfdDirectory* directory,
-                                           gnutls_x509_crt_t cert,
-                                           GError** error)
+static void
+infd_directory_start_session_save_timeout(InfdDirectory* directory,
+                                          InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
-  gboolean supports_login_by_certificate;
+  InfdDirectorySessionSaveTimeoutData* timeout_data;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  timeout_data = g_slice_new(InfdDirectorySessionSaveTimeoutData);
+  timeout_data->directory = directory;
+  timeout_data->node = node;
 
-  supports_login_by_certificate = FALSE;
-  if(priv->account_storage != NULL)
+  if(priv->storage != NULL)
   {
-    supports_login_by_certificate = infd_account_storage_supports(
-      priv->account_storage,
-      INFD_ACCOUNT_STORAGE_SUPPORT_CERTIFICATE_LOGIN
+    node->shared.note.save_timeout = inf_io_add_timeout(
+      priv->io,
+      INFD_DIRECTORY_SAVE_TIMEOUT,
+      infd_directory_session_save_timeout_func,
+      timeout_data,
+      infd_directory_session_save_timeout_data_free
     );
   }
+}
 
-  /* Don't create an error */
-  if(!supports_login_by_certificate)
-    return 0;
+static void
+infd_directory_session_weak_ref_cb(gpointer data,
+                                   GObject* where_the_object_was)
+{
+  InfdDirectoryNode* node;
+  node = (InfdDirectoryNode*)data;
 
-  return infd_account_storage_login_by_certificate(
-    priv->account_storage,
-    cert,
-    error
-  );
+  g_assert(G_OBJECT(node->shared.note.session) == where_the_object_was);
+  g_assert(node->shared.note.weakref == TRUE);
+  g_assert(node->shared.note.save_timeout == NULL);
+
+  node->shared.note.session = NULL;
+  node->shared.note.weakref = FALSE;
 }
 
-static InfAclAccountId
-infd_directory_login_by_certificate(InfdDirectory* directory,
-                                    InfXmlConnection* connection)
+static void
+infd_directory_session_update_idle(InfdDirectory* directory,
+                                   InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
-  InfCertificateChain* chain;
-  InfAclAccountId login_id;
-  gchar* dn;
-  guint i;
-  GError* error;
-
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  g_object_get(G_OBJECT(connection), "remote-certificate", &chain, NULL);
 
-  login_id = 0;
-  if(chain != NULL)
+  /* Drop session from memory if it remains idle */
+  if(infd_session_proxy_is_idle(node->shared.note.session))
   {
-    error = NULL;
-
-    dn = inf_cert_util_get_dn(
-      inf_certificate_chain_get_own_certificate(chain)
-    );
-    
-    for(i = 0; i < priv->n_transient_accounts; ++i)
+    if(node->shared.note.weakref == FALSE &&
+       node->shared.note.save_timeout == NULL)
     {
-      if(priv->transient_accounts[i].dn != NULL)
-      {
-        if(strcmp(priv->transient_accounts[i].dn, dn) == 0)
-        {
-          login_id = priv->transient_accounts[i].account.id;
-          break;
-        }
-      }
+      infd_directory_start_session_save_timeout(directory, node);
     }
-
-    if(login_id == 0)
+  }
+  else
+  {
+    /* If a session becomes non-idle again then strong-ref it */
+    if(node->shared.note.weakref == TRUE)
     {
-      login_id = infd_directory_get_account_for_certificate(
-        directory,
-        inf_certificate_chain_get_own_certificate(chain),
-        &error
-      );
-
-      if(error != NULL)
-      {
-        dn = inf_cert_util_get_dn(
-          inf_certificate_chain_get_own_certificate(chain)
-        );
-
-        g_warning(
-          _("Failed to login client \"%s\" by certificate: %s"),
-          dn,
-          error->message
-        );
+      g_object_ref(node->shared.note.session);
+      g_assert(node->shared.note.save_timeout == NULL);
+      node->shared.note.weakref = FALSE;
 
-        g_error_free(error);
-      }
+      g_object_weak_unref(
+        G_OBJECT(node->shared.note.session),
+        infd_directory_session_weak_ref_cb,
+        node
+      );
+    }
+    else if(node->shared.note.save_timeout != NULL)
+    {
+      inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+      node->shared.note.save_timeout = NULL;
     }
-
-    g_free(dn);
-    inf_certificate_chain_unref(chain);
   }
-
-  /* No client certificate provided, or certificate not registered with any
-   * account: Fall back to default user. */
-  if(login_id == 0)
-    login_id = inf_acl_account_id_from_string("default");
-
-  return login_id;
 }
 
 static void
-infd_directory_write_acl_at_path(InfdDirectory* directory,
-                                 const gchar* path,
-                                 const InfAclSheetSet* acl)
+infd_directory_session_idle_dispatch_func(gpointer user_data)
 {
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  GError* error;
+  GHashTable* idle_nodes;
+  GHashTableIter iter;
+  gpointer node_id;
+  InfdDirectoryNode* node;
 
+  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* Write the changed ACL into the storage */
-  if(priv->storage != NULL)
-  {
-    error = NULL;
-
-    /* TODO: Don't write sheets for transient accounts. It does not make much
-     * difference, because the transient user account is not stored, so the
-     * sheet will be rejected anyway when it is read from disk next time. */
-    infd_storage_write_acl(priv->storage, path, acl, &error);
+  g_mutex_lock(&priv->idle_mutex);
+  priv->idle_dispatch = NULL;
+  idle_nodes = priv->idle_nodes;
+  priv->idle_nodes = g_hash_table_new(NULL, NULL);
+  g_mutex_unlock(&priv->idle_mutex);
 
-    if(error != NULL)
+  g_hash_table_iter_init(&iter, idle_nodes);
+  while(g_hash_table_iter_next(&iter, &node_id, NULL))
+  {
+    /* The node or its session might have been removed in the meanwhile */
+    node = g_hash_table_lookup(priv->nodes, node_id);
+    if(node != NULL && node->type == INFD_DIRECTORY_NODE_NOTE &&
+       node->shared.note.session != NULL)
     {
-      g_warning(
-        _("Failed to write ACL for node \"%s\": %s\nThe new ACL is applied "
-          "but will be lost after a server re-start. This is a possible "
-          "security problem. Please fix the problem with the storage!"),
-        path,
-        error->message
-      );
-
-      g_error_free(error);
+      infd_directory_session_update_idle(directory, node);
     }
   }
+
+  g_hash_table_destroy(idle_nodes);
 }
 
 static void
-infd_directory_write_acl(InfdDirectory* directory,
-                         InfdDirectoryNode* node)
+infd_directory_session_idle_notify_cb(GObject* object,
+                                      GParamSpec* pspec,
+                                      gpointer user_data)
 {
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  InfAclSheetSet* acl;
-  gchar* path;
+  gpointer node_id;
+  InfdDirectoryNode* node;
 
+  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  node_id = g_object_get_qdata(object, infd_directory_node_id_quark);
 
-  /* Write the changed ACL into the storage */
-  if(priv->storage != NULL)
+  if(infd_worker_io_get_current() != NULL)
   {
-    infd_directory_node_get_path(node, &path, NULL);
+    /* The node belongs to the main thread, so handle this there */
+    g_mutex_lock(&priv->idle_mutex);
+    g_hash_table_add(priv->idle_nodes, node_id);
 
-    /* In case this is the root node, store the original non-altered ACL. This
-     * allows to keep certain permissions at the original value, even if they
-     * are disabled in the current configuration. */
-    acl = node->acl;
-    if(node == priv->root) acl = priv->orig_root_acl;
+    if(priv->idle_dispatch == NULL)
+    {
+      priv->idle_dispatch = inf_io_add_dispatch(
+        priv->io,
+        infd_directory_session_idle_dispatch_func,
+        directory,
+        NULL
+      );
+    }
 
-    infd_directory_write_acl_at_path(directory, path, acl);
+    g_mutex_unlock(&priv->idle_mutex);
+  }
+  else
+  {
+    node = g_hash_table_lookup(priv->nodes, node_id);
+    g_assert(node != NULL);
 
-    g_free(path);
+    infd_directory_session_update_idle(directory, node);
   }
 }
 
-/* This function removes ACL sheets from sheet_set that do not belong to
- * any known user. Known users are given in the verify_accounts hash table,
- * and if lookup_if_not_cached is set to TRUE, then accounts not found in
- * the hash table are looked up from the account storage, and the hash table
- * is updated with the lookup result.
- *
- * The returned sheet set is NULL if no changes were made, or a sheet set
- * containing all changed sheets. If report_changed_sheets is FALSE, the
- * function always returns NULL.
- */
-static InfAclSheetSet*
-infd_directory_verify_acl(InfdDirectory* directory,
-                          InfAclSheetSet* sheet_set,
-                          GHashTable* verify_accounts,
-                          gboolean lookup_if_not_cached,
-                          gboolean report_changed_sheets)
+static gboolean
+infd_directory_session_reject_user_join_cb(InfdSessionProxy* proxy,
+                                           InfXmlConnection* connection,
+                                           const GArray* user_properties,
+                                           InfUser* rejoin_user,
+                                           gpointer user_data)
 {
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
-  GArray* to_be_looked_up;
-  gboolean is_cached;
-  gpointer cache_result;
-  guint i, j;
-
-  InfAclSheetSet* changed_sheets;
-  InfAclSheet* sheet;
+  gpointer node_id;
+  InfdDirectoryNode* node;
 
-  InfAclAccount* accounts;
-  InfAclAccountId account_id;
-  GError* error;
+  InfdDirectoryConnectionInfo* info;
+  InfBrowserIter iter;
+  InfAclMask check_mask;
+  gboolean result;
 
+  directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  node_id = g_object_get_qdata(G_OBJECT(proxy), infd_directory_node_id_quark);
+  node = g_hash_table_lookup(priv->nodes, node_id);
+  g_assert(node != NULL);
 
-  g_assert(verify_accounts != NULL || lookup_if_not_cached == TRUE);
-  g_assert(sheet_set->n_sheets == 0 || sheet_set->own_sheets != NULL);
-
-  changed_sheets = NULL;
-  to_be_looked_up = NULL;
-  for(i = 0; i < sheet_set->n_sheets; )
+  /* ACL cannot prevent local users from joining */
+  if(connection != NULL)
   {
-    if(verify_accounts != NULL)
+    /* In a worker thread, the join request arrives through the mirror of the
+     * client connection. */
+    if(INFD_IS_WORKER_CONNECTION(connection))
     {
-      is_cached = g_hash_table_lookup_extended(
-        verify_accounts,
-        INF_ACL_ACCOUNT_ID_TO_POINTER(sheet_set->sheets[i].account),
-        NULL,
-        &cache_result
+      connection = infd_worker_connection_get_connection(
+        INFD_WORKER_CONNECTION(connection)
       );
-    }
-    else
-    {
-      is_cached = FALSE;
-    }
-
-    if(is_cached == TRUE)
-    {
-      if(GPOINTER_TO_BOOLEAN(cache_result) == FALSE)
-      {
-        account_id = sheet_set->sheets[i].account;
-        inf_acl_sheet_set_remove_sheet(sheet_set, &sheet_set->own_sheets[i]);
 
-        if(report_changed_sheets)
-        {
-          if(changed_sheets == NULL)
-            changed_sheets = inf_acl_sheet_set_new();
-          sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
-          inf_acl_mask_clear(&sheet->mask);
-        }
-      }
-      else
-      {
-        ++i;
-      }
+      /* Connection is going away */
+      if(connection == NULL)
+        return TRUE;
     }
-    else
-    {
-      /* Did not find in the cache */
-      if(lookup_if_not_cached)
-      {
-        /* Check transient accounts */
-        for(j = 0; j < priv->n_transient_accounts; ++j)
-        {
-          if(priv->transient_accounts[j].account.id ==
-             sheet_set->sheets[i].account)
-          {
-            if(verify_accounts != NULL)
-            {
-              g_hash_table_insert(
-                verify_accounts,
-                INF_ACL_ACCOUNT_ID_TO_POINTER(sheet_set->sheets[i].account),
-                GBOOLEAN_TO_POINTER(TRUE)
-              );
-            }
 
-            break;
-          }
-        }
+    info = g_hash_table_lookup(priv->connections, connection);
+    g_assert(info != NULL);
 
-        if(j < priv->n_transient_accounts)
-        {
-          ++i;
-        }
-        else
-        {
-          if(priv->account_storage != NULL)
-          {
-            /* Not a transient account either, so look up from storage */
-            if(to_be_looked_up == NULL)
-            {
-              to_be_looked_up = g_array_new(
-                FALSE,
-                FALSE,
-                sizeof(InfAclAccountId)
-              );
-            }
+    iter.node_id = node->id;
+    iter.node = node;
 
-            g_array_append_val(to_be_looked_up, sheet_set->sheets[i].account);
-            ++i;
-          }
-          else
-          {
-            /* We do not have an account storage, so the account does
-             * definitely not exist */
-            account_id = sheet_set->sheets[i].account;
-            inf_acl_sheet_set_remove_sheet(
-              sheet_set,
-              &sheet_set->own_sheets[i]
-            );
+    inf_acl_mask_set1(&check_mask, INF_ACL_CAN_JOIN_USER);
 
-            if(report_changed_sheets)
-            {
-              if(changed_sheets == NULL)
-                changed_sheets = inf_acl_sheet_set_new();
-              sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
-              inf_acl_mask_clear(&sheet->mask);
-            }
-          }
-        }
-      }
-    }
+    result = inf_browser_check_acl(
+      INF_BROWSER(directory),
+      &iter,
+      info->account_id,
+      &check_mask,
+      NULL
+    );
+
+    /* Reject the user join if the permission is not set. */
+    if(result == FALSE)
+      return TRUE;
   }
 
-  /* Look up the missing pieces */
-  if(to_be_looked_up != NULL)
-  {
-    error = NULL;
+  return FALSE;
+}
 
-    accounts = infd_account_storage_lookup_accounts(
-      priv->account_storage,
-      (InfAclAccountId*)to_be_looked_up->data,
-      to_be_looked_up->len,
-      &error
-    );
+/* Releases a session fully from the directory. This is not normally needed
+ * because if we don't need a session anymore we still keep a weak reference
+ * to it around, in case we need to recover it later. When nobody is holding
+ * a strong reference to it anymore we clear the pointer in
+ * infd_directory_session_weak_ref_cb(). This function is called when a node
+ * with an active session is removed from the directory, and when a session
+ * is unloaded in a directory with worker threads, since weak references
+ * cannot be used there. */
+static void
+infd_directory_release_session(InfdDirectory* directory,
+                               InfdDirectoryNode* node,
+                               InfdSessionProxy* session)
+{
+  InfdDirectoryPrivate* priv;
 
-    if(error != NULL)
-    {
-      /* If an error occurred, keep the sheet set as it is, i.e. don't
-       * remove anything, just in case. */
-      g_warning(
-        _("Failed to look up accounts in account storage: %s"),
-        error->message
-      );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-      g_error_free(error);
-    }
-    else
-    {
-      for(i = 0; i < to_be_looked_up->len; ++i)
-      {
-        account_id = accounts[i].id;
-        if(account_id == 0)
-        {
-          /* Not found, remove from sheet set */
-          account_id = g_array_index(to_be_looked_up, InfAclAccountId, i);
-          sheet = inf_acl_sheet_set_find_sheet(sheet_set, account_id);
-          g_assert(sheet != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session == session);
 
-          inf_acl_sheet_set_remove_sheet(sheet_set, sheet);
+  if(node->shared.note.save_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, node->shared.note.save_timeout);
+    node->shared.note.save_timeout = NULL;
+  }
 
-          if(report_changed_sheets)
-          {
-            if(changed_sheets == NULL)
-              changed_sheets = inf_acl_sheet_set_new();
-            sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
-            inf_acl_mask_clear(&sheet->mask);
-          }
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infd_directory_session_idle_notify_cb),
+    directory
+  );
 
-          if(verify_accounts != NULL)
-          {
-            g_hash_table_insert(
-              verify_accounts,
-              INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
-              GBOOLEAN_TO_POINTER(FALSE)
-            );
-          }
-        }
-        else
-        {
-          /* Found */
-          if(verify_accounts != NULL)
-          {
-            g_hash_table_insert(
-              verify_accounts,
-              INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
-              GBOOLEAN_TO_POINTER(TRUE)
-            );
-          }
-        }
-      }
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infd_directory_session_reject_user_join_cb),
+    directory
+  );
 
-      inf_acl_account_array_free(accounts, to_be_looked_up->len);
-    }
+  g_object_set_qdata(
+    G_OBJECT(session),
+    infd_directory_node_id_quark,
+    NULL
+  );
 
-    g_array_free(to_be_looked_up, TRUE);
+  if(node->shared.note.weakref == TRUE)
+  {
+    g_object_weak_unref(
+      G_OBJECT(session),
+      infd_directory_session_weak_ref_cb,
+      node
+    );
+  }
+  else
+  {
+    g_object_unref(session);
   }
 
-  return changed_sheets;
+  node->shared.note.session = NULL;
+  node->shared.note.weakref = FALSE;
 }
 
+/*
+ * ACLs
+ */
+
 static void
-infd_directory_verify_acl_for_node(InfdDirectory* directory,
-                                   InfdDirectoryNode* node,
-                                   GHashTable* verify_accounts,
-                                   gboolean lookup_if_not_cached)
+infd_directory_announce_acl_account(InfdDirectory* directory,
+                                    const InfAclAccount* account,
+                                    InfXmlConnection* except)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* child;
-  InfAclSheetSet* removed_sheets;
+  InfBrowser* browser;
+  xmlNodePtr xml;
   InfBrowserIter iter;
+  InfAclMask mask;
+
+  GHashTableIter hash_iter;
+  gpointer key;
+  gpointer value;
+
+  InfXmlConnection* connection;
+  InfdDirectoryConnectionInfo* conn_info;
+  InfAclAccountId account_id;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  browser = INF_BROWSER(directory);
 
-  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
-     node->shared.subdir.explored == TRUE)
-  {
-    for(child = node->shared.subdir.child; child != NULL; child = child->next)
-    {
-      infd_directory_verify_acl_for_node(
-        directory,
-        child,
-        verify_accounts,
-        lookup_if_not_cached
-      );
-    }
-  }
+  xml = xmlNewNode(NULL, (const xmlChar*)"add-acl-account");
+  inf_acl_account_to_xml(account, xml);
 
-  if(node->acl != NULL)
+  iter.node = priv->root;
+  iter.node_id = priv->root->id;
+  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+
+  /* Send to all connections that have the INF_ACL_CAN_QUERY_ACCOUNT_LIST
+   * permission. */
+  g_hash_table_iter_init(&hash_iter, priv->connections);
+  while(g_hash_table_iter_next(&hash_iter, &key, &value))
   {
-    removed_sheets = infd_directory_verify_acl(
-      directory,
-      node->acl,
-      verify_accounts,
-      lookup_if_not_cached,
-      TRUE
-    );
+    connection = INF_XML_CONNECTION(key);
+    conn_info = (InfdDirectoryConnectionInfo*)value;
+    account_id = conn_info->account_id;
+    g_assert(account_id != 0);
 
-    if(node == priv->root)
+    if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL) &&
+       connection != except)
     {
-      infd_directory_verify_acl(
-        directory,
-        priv->orig_root_acl,
-        verify_accounts,
-        lookup_if_not_cached,
-        FALSE
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        connection,
+        xmlCopyNode(xml, 1)
       );
     }
+  }
 
-    if(removed_sheets != NULL)
-    {
-      iter.node = node;
-      iter.node_id = node->id;
-
-      inf_browser_acl_changed(
-        INF_BROWSER(directory),
-        &iter,
-        removed_sheets,
-        NULL
-      );
+  inf_browser_acl_account_added(INF_BROWSER(directory), account, NULL);
 
-      inf_acl_sheet_set_free(removed_sheets);
-      infd_directory_write_acl(directory, node);
-    }
-  }
+  xmlFreeNode(xml);
 }
 
-static void
-infd_directory_verify_all_acls(InfdDirectory* directory,
-                               GHashTable* verify_accounts,
-                               gboolean lookup_if_not_cached)
+/* acl_connections is a list of connections which have queried the full ACL.
+ * It can be NULL in which case only the default sheet and the sheet for that
+ * particular connection are sent. */
+static gboolean
+infd_directory_acl_sheets_to_xml_for_connection(InfdDirectory* directory,
+                                                GSList* acl_connections,
+                                                const InfAclSheetSet* sheets,
+                                                InfXmlConnection* connection,
+                                                xmlNodePtr xml)
 {
   InfdDirectoryPrivate* priv;
-  GSList* item;
-  InfdDirectorySyncIn* sync_in;
-  InfdDirectorySubreq* subreq;
-  InfAclSheetSet* acl;
-  GHashTable* own_table;
-
-  own_table = NULL;
-  if(verify_accounts == NULL)
-  {
-    own_table = g_hash_table_new(NULL, NULL);
-    verify_accounts = own_table;
-  }
+  InfdDirectoryConnectionInfo* info;
+  guint written_sheets;
+  InfAclSheet selected_sheets[2];
+  InfAclSheetSet set;
+  InfAclAccountId default_id;
+  guint i;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  infd_directory_verify_acl_for_node(
-    directory,
-    priv->root,
-    verify_accounts,
-    lookup_if_not_cached
-  );
-
-  /* Remove ACL sheet from sync-ins and subscription requests. */
-  for(item = priv->sync_ins; item != NULL; item = item->next)
+  if(g_slist_find(acl_connections, connection) != NULL)
   {
-    sync_in = (InfdDirectorySyncIn*)item->data;
-
-    if(sync_in->sheet_set != NULL)
-    {
-      infd_directory_verify_acl(
-        directory,
-        sync_in->sheet_set,
-        verify_accounts,
-        lookup_if_not_cached,
-        FALSE
-      );
-    }
+    if(sheets->n_sheets > 0)
+      inf_acl_sheet_set_to_xml(sheets, xml);
+    written_sheets = sheets->n_sheets;
   }
-
-  for(item = priv->subscription_requests; item != NULL; item = item->next)
+  else
   {
-    subreq = (InfdDirectorySubreq*)item->data;
+    /* Otherwise, add only the sheets for the user itself and the default
+     * sheet. */
+    info = g_hash_table_lookup(priv->connections, connection);
+    g_assert(info != NULL);
 
-    switch(subreq->type)
+    default_id = inf_acl_account_id_from_string("default");
+
+    written_sheets = 0;
+    for(i = 0; i < sheets->n_sheets && written_sheets < 2; ++i)
     {
-    case INFD_DIRECTORY_SUBREQ_CHAT:
-    case INFD_DIRECTORY_SUBREQ_SESSION:
-      acl = NULL;
-      break;
-    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-      acl = subreq->shared.add_node.sheet_set;
-      break;
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
-      acl = subreq->shared.sync_in.sheet_set;
-      break;
-    default:
-      g_assert_not_reached();
-      break;
+      if(sheets->sheets[i].account == default_id ||
+         sheets->sheets[i].account == info->account_id)
+      {
+        selected_sheets[written_sheets] = sheets->sheets[i];
+        ++written_sheets;
+      }
     }
 
-    if(acl != NULL)
+    if(written_sheets > 0)
     {
-      infd_directory_verify_acl(
-        directory,
-        acl,
-        verify_accounts,
-        lookup_if_not_cached,
-        FALSE
-      );
+      set.own_sheets = NULL;
+      set.sheets = selected_sheets;
+      set.n_sheets = written_sheets;
+      inf_acl_sheet_set_to_xml(&set, xml);
     }
   }
 
-  if(own_table != NULL)
-    g_hash_table_destroy(own_table);
+  if(written_sheets == 0)
+    return FALSE;
+  return TRUE;
 }
 
-/* node can be NULL. If node is not NULL, additional sheets are returned
- * which correspond to erasure of the current ACL for the node. This allows
- * the ACL change to be performed atomically on the node.
- *
- * The verify_accounts table is a cache when verifying whether the accounts
- * present in the sheet exist or not. */
-static InfAclSheetSet*
-infd_directory_read_acl(InfdDirectory* directory,
-                        const gchar* path,
-                        InfdDirectoryNode* node,
-                        GHashTable* verify_accounts,
-                        GError** error)
+static void
+infd_directory_announce_acl_sheets_for_connection(InfdDirectory* directory,
+                                                  const InfdDirectoryNode* nd,
+                                                  const InfAclSheetSet* shts,
+                                                  InfXmlConnection* conn)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  GError* local_error;
-  GSList* acl;
-  GSList* item;
-  InfdStorageAcl* storage_acl;
-  InfAclSheetSet* sheet_set;
-  InfAclSheet* sheet;
-  InfAclAccountId account_id;
-  InfAclSheetSet* verify_sheets;
+  gboolean has_sheets;
+  xmlNodePtr xml;
+  gboolean any_sheets;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(priv->storage != NULL);
+  xml = xmlNewNode(NULL, (const xmlChar*)"set-acl");
 
-  local_error = NULL;
-  acl = infd_storage_read_acl(priv->storage, path, &local_error);
+  any_sheets = infd_directory_acl_sheets_to_xml_for_connection(
+    directory,
+    nd->acl_connections,
+    shts,
+    conn,
+    xml
+  );
 
-  if(local_error != NULL)
+  if(any_sheets == TRUE)
   {
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
+    inf_xml_util_set_attribute_uint(xml, "id", nd->id);
 
-  /* If there are any ACLs set already for this node, then clear them. This
-   * should usually not happen because we only call this function for new
-   * nodes, but it can happen when the storage is changed on the fly and the
-   * root node changes. */
-  if(node != NULL && node->acl != NULL)
-  {
-    sheet_set = inf_acl_sheet_set_get_clear_sheets(node->acl);
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      conn,
+      xml
+    );
   }
   else
   {
-    sheet_set = inf_acl_sheet_set_new();
+    xmlFreeNode(xml);
   }
+}
 
-  for(item = acl; item != NULL; item = g_slist_next(item))
-  {
-    storage_acl = (InfdStorageAcl*)item->data;
-    account_id = inf_acl_account_id_from_string(storage_acl->account_id);
+static void
+infd_directory_announce_acl_sheets(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   InfdRequest* request,
+                                   const InfAclSheetSet* sheet_set,
+                                   InfXmlConnection* except)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr xml;
+  GList* connection_list;
+  GSList* local_connection_list;
+  GList* item;
+  GSList* local_item;
+  InfBrowserIter iter;
 
-    sheet = inf_acl_sheet_set_add_sheet(sheet_set, account_id);
-    sheet->mask = storage_acl->mask;
-    sheet->perms = storage_acl->perms;
-  }
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  infd_storage_acl_list_free(acl);
+  /* Go through all connections that see this node, i.e. have explored the
+   * parent node. To those connections we need to send an ACL update. */
+  if(node->parent == NULL)
+  {
+    connection_list = g_hash_table_get_keys(priv->connections);
 
-  if(priv->account_storage != NULL)
+    for(item = connection_list; item != NULL; item = g_list_next(item))
+    {
+      if(item->data != except)
+      {
+        infd_directory_announce_acl_sheets_for_connection(
+          directory,
+          node,
+          sheet_set,
+          INF_XML_CONNECTION(item->data)
+        );
+      }
+    }
+
+    g_list_free(connection_list);
+  }
+  else
   {
-    verify_sheets = infd_directory_verify_acl(
-      directory,
-      sheet_set,
-      verify_accounts,
-      TRUE,
-      TRUE
-    );
+    local_connection_list = node->parent->shared.subdir.connections;
 
-    if(verify_sheets != NULL)
+    for(local_item = local_connection_list;
+        local_item != NULL;
+        local_item = g_slist_next(local_item))
     {
-      /* We do not need to make signal emissions here, since the ACL has just
-       * been read. However, if verify_sheets is not equal to zero, then
-       * sheets have been removed from the set, and we want to write the
-       * updated set to storage. */
-      infd_directory_write_acl_at_path(directory, path, sheet_set);
-      inf_acl_sheet_set_free(verify_sheets);
+      if(local_item->data != except)
+      {
+        infd_directory_announce_acl_sheets_for_connection(
+          directory,
+          node,
+          sheet_set,
+          INF_XML_CONNECTION(local_item->data)
+        );
+      }
     }
   }
 
-  return sheet_set;
+  iter.node_id = node->id;
+  iter.node = node;
+
+  inf_browser_acl_changed(
+    INF_BROWSER(directory),
+    &iter,
+    sheet_set,
+    INF_REQUEST(request)
+  );
 }
 
-static void
-infd_directory_report_support(InfdDirectory* directory,
-                              gboolean* add_account,
-                              gboolean* remove_account)
+static InfAclAccountId
+infd_directory_get_account_for_certificate(InfdDirectory* directory,
+                                           gnutls_x509_crt_t cert,
+                                           GError** error)
 {
   InfdDirectoryPrivate* priv;
-  gboolean supports_add_account;
-  gboolean supports_remove_account;
-  InfdAccountStorageSupport support;
+  gboolean supports_login_by_certificate;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  supports_add_account = FALSE;
-  supports_remove_account = FALSE;
 
+  supports_login_by_certificate = FALSE;
   if(priv->account_storage != NULL)
   {
-    support = infd_account_storage_get_support(priv->account_storage);
-
-    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_ADD_ACCOUNT)
-      if(priv->private_key != NULL && priv->certificate != NULL)
-        supports_add_account = TRUE;
-
-    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_REMOVE_ACCOUNT)
-      supports_remove_account = TRUE;
+    supports_login_by_certificate = infd_account_storage_supports(
+      priv->account_storage,
+      INFD_ACCOUNT_STORAGE_SUPPORT_CERTIFICATE_LOGIN
+    );
   }
 
-  if(add_account != NULL) *add_account = supports_add_account;
-  if(remove_account != NULL) *remove_account = supports_remove_account;
+  /* Don't create an error */
+  if(!supports_login_by_certificate)
+    return 0;
+
+  return infd_account_storage_login_by_certificate(
+    priv->account_storage,
+    cert,
+    error
+  );
 }
 
-/* Change the given sheet set such that if we don't support account creation
- * or removal, it is disabled in sheet_set. Return FALSE if sheet_set had to
- * be changed. */
-static gboolean
-infd_directory_report_support_in_sheets(InfdDirectory* directory,
-                                        InfAclSheetSet* sheet_set)
+static InfAclAccountId
+infd_directory_login_by_certificate(InfdDirectory* directory,
+                                    InfXmlConnection* connection)
 {
-  gboolean supports_remove_account;
-  gboolean supports_add_account;
-  gboolean unaltered;
+  InfdDirectoryPrivate* priv;
+  InfCertificateChain* chain;
+  InfAclAccountId login_id;
+  gchar* dn;
   guint i;
+  GError* error;
 
-  InfAclSheet* sheet;
-  InfAclMask tmp_mask;
-
-  g_assert(sheet_set->n_sheets == 0 || sheet_set->own_sheets != NULL);
-
-  infd_directory_report_support(
-    directory,
-    &supports_add_account,
-    &supports_remove_account
-  );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_object_get(G_OBJECT(connection), "remote-certificate", &chain, NULL);
 
-  unaltered = TRUE;
-  for(i = 0; i < sheet_set->n_sheets; ++i)
+  login_id = 0;
+  if(chain != NULL)
   {
-    sheet = &sheet_set->own_sheets[i];
-    if(supports_add_account == FALSE &&
-       inf_acl_mask_has(&sheet->mask, INF_ACL_CAN_CREATE_ACCOUNT) &&
-       inf_acl_mask_has(&sheet->perms, INF_ACL_CAN_CREATE_ACCOUNT))
-    {
-      /* Remove the INF_ACL_CAN_CREATE_ACCOUNT flag */
-      inf_acl_mask_set1(&tmp_mask, INF_ACL_CAN_CREATE_ACCOUNT);
-      inf_acl_mask_neg(&tmp_mask, &tmp_mask);
-      inf_acl_mask_and(&sheet->perms, &tmp_mask, &sheet->perms);
+    error = NULL;
 
-      unaltered = FALSE;
-    }
+    dn = inf_cert_util_get_dn(
+      inf_certificate_chain_get_own_certificate(chain)
+    );
     
-    if(supports_remove_account == FALSE &&
-       inf_acl_mask_has(&sheet->mask, INF_ACL_CAN_REMOVE_ACCOUNT) &&
-       inf_acl_mask_has(&sheet->perms, INF_ACL_CAN_REMOVE_ACCOUNT))
+    for(i = 0; i < priv->n_transient_accounts; ++i)
     {
-      /* Remove the INF_ACL_CAN_REMOVE_ACCOUNT flag */
-      inf_acl_mask_set1(&tmp_mask, INF_ACL_CAN_REMOVE_ACCOUNT);
-      inf_acl_mask_neg(&tmp_mask, &tmp_mask);
-      inf_acl_mask_and(&sheet->perms, &tmp_mask, &sheet->perms);
+      if(priv->transient_accounts[i].dn != NULL)
+      {
+        if(strcmp(priv->transient_accounts[i].dn, dn) == 0)
+        {
+          login_id = priv->transient_accounts[i].account.id;
+          break;
+        }
+      }
+    }
 
-      unaltered = FALSE;
+    if(login_id == 0)
+    {
+      login_id = infd_directory_get_account_for_certificate(
+        directory,
+        inf_certificate_chain_get_own_certificate(chain),
+        &error
+      );
+
+      if(error != NULL)
+      {
+        dn = inf_cert_util_get_dn(
+          inf_certificate_chain_get_own_certificate(chain)
+        );
+
+        g_warning(
+          _("Failed to login client \"%s\" by certificate: %s"),
+          dn,
+          error->message
+        );
+
+        g_error_free(error);
+      }
     }
+
+    g_free(dn);
+    inf_certificate_chain_unref(chain);
   }
 
-  return unaltered;
+  /* No client certificate provided, or certificate not registered with any
+   * account: Fall back to default user. */
+  if(login_id == 0)
+    login_id = inf_acl_account_id_from_string("default");
+
+  return login_id;
 }
 
 static void
-infd_directory_update_root_acl(InfdDirectory* directory)
+infd_directory_write_acl_at_path_cb(InfdStorage* storage,
+                                    const GError* error,
+                                    gpointer user_data)
 {
-  InfdDirectoryPrivate* priv;
-  InfAclSheetSet* copy_set;
-  InfAclSheetSet* merge_sheets;
-  guint i;
-  gboolean include_sheet;
-  const InfAclSheet* new_sheet;
-  const InfAclSheet* cur_sheet;
-  InfAclSheet* merge_sheet;
-  InfAclMask cur_perms;
-  InfAclMask new_perms;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  copy_set = inf_acl_sheet_set_copy(priv->orig_root_acl);
-  infd_directory_report_support_in_sheets(directory, copy_set);
-
-  /* We will now update root->acl to copy_set. Below we construct a
-   * sheet set which contains the differences. */
-  merge_sheets = inf_acl_sheet_set_new();
-  for(i = 0; i < copy_set->n_sheets; ++i)
-  {
-    include_sheet = TRUE;
-    new_sheet = &copy_set->sheets[i];
-
-    cur_sheet = inf_acl_sheet_set_find_const_sheet(
-      priv->root->acl,
-      new_sheet->account
-    );
-
-    g_assert(cur_sheet != NULL);
-
-    if(inf_acl_mask_equal(&new_sheet->mask, &cur_sheet->mask))
-    {
-      inf_acl_mask_and(&cur_sheet->perms, &cur_sheet->mask, &cur_perms);
-      inf_acl_mask_and(&new_sheet->perms, &new_sheet->mask, &new_perms);
-      if(inf_acl_mask_equal(&cur_perms, &new_perms))
-        include_sheet = FALSE;
-    }
-
-    /* The sheet has changed */
-    if(include_sheet)
-    {
-      merge_sheet = inf_acl_sheet_set_add_sheet(
-        merge_sheets,
-        new_sheet->account
-      );
-
-      merge_sheet->mask = new_sheet->mask;
-      merge_sheet->perms = new_sheet->perms;
-    }
-  }
+  gchar* path;
+  path = (gchar*)user_data;
 
-  /* We make use of the fact that there are the same sheets in
-   * priv->orig_root_acl and priv->root->acl. */
-  if(merge_sheets->n_sheets > 0)
+  if(error != NULL)
   {
-    inf_acl_sheet_set_free(priv->root->acl);
-    priv->root->acl = copy_set;
-
-    infd_directory_announce_acl_sheets(
-      directory,
-      priv->root,
-      NULL,
-      merge_sheets,
-      NULL
+    g_warning(
+      _("Failed to write ACL for node \"%s\": %s\nThe new ACL is applied "
+        "but will be lost after a server re-start. This is a possible "
+        "security problem. Please fix the problem with the storage!"),
+      path,
+      error->message
     );
   }
-  else
-  {
-    inf_acl_sheet_set_free(copy_set);
-  }
 
-  inf_acl_sheet_set_free(merge_sheets);
+  g_free(path);
 }
 
 static void
-infd_directory_read_root_acl(InfdDirectory* directory)
+infd_directory_write_acl_at_path(InfdDirectory* directory,
+                                 const gchar* path,
+                                 const InfAclSheetSet* acl)
 {
   InfdDirectoryPrivate* priv;
-  InfAclAccountId default_id;
-
-  InfAclSheetSet* sheet_set;
-  InfAclSheet* default_sheet;
-  InfAclSheet* sheet;
-  InfAclMask default_mask;
-  InfAclMask tmp_mask;
   GError* error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  error = NULL;
-
-  sheet_set = infd_directory_read_acl(
-    directory,
-    "/",
-    priv->root,
-    NULL,
-    &error
-  );
-
-  /* Will be reset below: */
-  if(priv->orig_root_acl != NULL)
-    inf_acl_sheet_set_free(priv->orig_root_acl);
-
-  default_id = inf_acl_account_id_from_string("default");
-  if(error != NULL)
+  /* Write the changed ACL into the storage. This happens in the background;
+   * the storage makes sure that later operations on it see the new ACL. */
+  if(priv->storage != NULL)
   {
-    g_assert(sheet_set == NULL);
-
-    g_warning(
-      _("Failed to read the ACL for the root node: %s\n"
-        "In order not to compromise security all permissions have been "
-        "revoked for all users. The infinote server is likely not very "
-        "usable in this configuration, so please check the storage "
-        "system, fix the problem and re-start the server."),
-      error->message
-    );
-
-    g_error_free(error);
-
-    /* Clear all existing sheets and add one sheet for the default user which
-     * prohibits everything. */
-    if(priv->root->acl != NULL)
-      sheet_set = inf_acl_sheet_set_get_clear_sheets(priv->root->acl);
+    /* TODO: Don't write sheets for transient accounts. It does not make much
+     * difference, because the transient user account is not stored, so the
+     * sheet will be rejected anyway when it is read from disk next time. */
+    if(priv->io != NULL)
+    {
+      infd_storage_write_acl_async(
+        priv->storage,
+        path,
+        acl,
+        priv->io,
+        infd_directory_write_acl_at_path_cb,
+        g_strdup(path)
+      );
+    }
     else
-      sheet_set = inf_acl_sheet_set_new();
-
-    default_sheet = inf_acl_sheet_set_add_sheet(sheet_set, default_id);
-    default_sheet->mask = INF_ACL_MASK_ALL;
-    inf_acl_mask_clear(&default_sheet->perms);
-
-    /* Make sure this "revoke-everything" sheet is not written to disk. */
-    priv->root->acl = inf_acl_sheet_set_merge_sheets(
-      priv->root->acl,
-      sheet_set
-    );
+    {
+      /* The storage can be set before the IO during construction */
+      error = NULL;
+      infd_storage_write_acl(priv->storage, path, acl, &error);
 
-    if(priv->root->acl != NULL)
-      priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
-    else
-      priv->orig_root_acl = NULL;
+      infd_directory_write_acl_at_path_cb(
+        priv->storage,
+        error,
+        g_strdup(path)
+      );
 
-    infd_directory_announce_acl_sheets(
-      directory,
-      priv->root,
-      NULL, /* TODO: make a request for this? */
-      sheet_set,
-      NULL
-    );
+      if(error != NULL)
+        g_error_free(error);
+    }
   }
-  else
-  {
-    /* Make sure there are permissions for the default user defined. If there
-     * are not, use sensible default permissions. */
-    default_sheet = inf_acl_sheet_set_add_sheet(sheet_set, default_id);
-
-    default_mask = default_sheet->mask;
-    inf_acl_mask_neg(&default_mask, &tmp_mask);
-    inf_acl_mask_and(&tmp_mask, &INF_ACL_MASK_DEFAULT, &tmp_mask);
-
-    inf_acl_mask_or(&default_sheet->perms, &tmp_mask, &default_sheet->perms);
-
-    default_sheet->mask = INF_ACL_MASK_ALL;
+}
 
-    /* Set original ACL as read from disk */
-    if(priv->root->acl != NULL)
-      priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
-    else
-      priv->orig_root_acl = NULL;
+static void
+infd_directory_write_acl(InfdDirectory* directory,
+                         InfdDirectoryNode* node)
+{
+  InfdDirectoryPrivate* priv;
+  InfBrowserIter iter;
+  InfAclSheetSet* acl;
+  gchar* path;
 
-    /* Note that the sheets array already includes sheets that clear the
-     * existing ACL. */
-    priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
-      priv->orig_root_acl,
-      sheet_set
-    );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-    /* For the actual permissions to use, remove the CAN_ADD_ACCOUNT
-     * permission if we do not have a certificate set or if it is not
-     * supported by the backend. */
-    infd_directory_report_support_in_sheets(directory, sheet_set);
+  /* Write the changed ACL into the storage */
+  if(priv->storage != NULL)
+  {
+    infd_directory_node_get_path(node, &path, NULL);
 
-    priv->root->acl = inf_acl_sheet_set_merge_sheets(
-      priv->root->acl,
-      sheet_set
-    );
+    /* In case this is the root node, store the original non-altered ACL. This
+     * allows to keep certain permissions at the original value, even if they
+     * are disabled in the current configuration. */
+    acl = node->acl;
+    if(node == priv->root) acl = priv->orig_root_acl;
 
-    infd_directory_announce_acl_sheets(
-      directory,
-      priv->root,
-      NULL, /* TODO: make a request for this? */
-      sheet_set,
-      NULL
-    );
+    infd_directory_write_acl_at_path(directory, path, acl);
 
-    inf_acl_mask_and(&default_mask, &INF_ACL_MASK_ALL, &default_mask);
-    if(!inf_acl_mask_equal(&default_mask, &INF_ACL_MASK_ALL))
-      infd_directory_write_acl(directory, priv->root);
+    g_free(path);
   }
-
-  inf_acl_sheet_set_free(sheet_set);
 }
 
-/*
- * Node construction and removal
+/* This function removes ACL sheets from sheet_set that do not belong to
+ * any known user. Known users are given in the verify_accounts hash table,
+ * and if lookup_if_not_cached is set to TRUE, then accounts not found in
+ * the hash table are looked up from the account storage, and the hash table
+ * is updated with the lookup result.
+ *
+ * The returned sheet set is NULL if no changes were made, or a sheet set
+ * containing all changed sheets. If report_changed_sheets is FALSE, the
+ * function always returns NULL.
  */
-
-/* Creates the subscription group for a node, named "InfSession_%u", %u being
- * the node id (which should be unique). */
-static InfCommunicationHostedGroup*
-infd_directory_create_subscription_group(InfdDirectory* directory,
-                                         guint node_id)
+static InfAclSheetSet*
+infd_directory_verify_acl(InfdDirectory* directory,
+                          InfAclSheetSet* sheet_set,
+                          GHashTable* verify_accounts,
+                          gboolean lookup_if_not_cached,
+                          gboolean report_changed_sheets)
 {
   InfdDirectoryPrivate* priv;
-  InfCommunicationHostedGroup* group;
-  gchar* group_name;
+  GArray* to_be_looked_up;
+  gboolean is_cached;
+  gpointer cache_result;
+  guint i, j;
 
-  /* TODO: For the moment, there only exist central methods anyway. In the
-   * long term, this should probably be a property, though. */
-  static const gchar* const methods[] = { "central", NULL };
+  InfAclSheetSet* changed_sheets;
+  InfAclSheet* sheet;
+
+  InfAclAccount* accounts;
+  InfAclAccountId account_id;
+  GError* error;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  group_name = g_strdup_printf("InfSession_%u", node_id);
 
-  group = inf_communication_manager_open_group(
-    priv->communication_manager,
+  g_assert(verify_accounts != NULL || lookup_if_not_cached == TRUE);
+  g_assert(sheet_set->n_sheets == 0 || sheet_set->own_sheets != NULL);
+
+  changed_sheets = NULL;
+  to_be_looked_up = NULL;
+  for(i = 0; i < sheet_set->n_sheets; )
+  {
+    if(verify_accounts != NULL)
+    {
+      is_cached = g_hash_table_lookup_extended(
+        verify_accounts,
+        INF_ACL_ACCOUNT_ID_TO_POINTER(sheet_set->sheets[i].account),
+        NULL,
+        &cache_result
+      );
+    }
+    else
+    {
+      is_cached = FALSE;
+    }
+
+    if(is_cached == TRUE)
+    {
+      if(GPOINTER_TO_BOOLEAN(cache_result) == FALSE)
+      {
+        account_id = sheet_set->sheets[i].account;
+        inf_acl_sheet_set_remove_sheet(sheet_set, &sheet_set->own_sheets[i]);
+
+        if(report_changed_sheets)
+        {
+          if(changed_sheets == NULL)
+            changed_sheets = inf_acl_sheet_set_new();
+          sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
+          inf_acl_mask_clear(&sheet->mask);
+        }
+      }
+      else
+      {
+        ++i;
+      }
+    }
+    else
+    {
+      /* Did not find in the cache */
+      if(lookup_if_not_cached)
+      {
+        /* Check transient accounts */
+        for(j = 0; j < priv->n_transient_accounts; ++j)
+        {
+          if(priv->transient_accounts[j].account.id ==
+             sheet_set->sheets[i].account)
+          {
+            if(verify_accounts != NULL)
+            {
+              g_hash_table_insert(
+                verify_accounts,
+                INF_ACL_ACCOUNT_ID_TO_POINTER(sheet_set->sheets[i].account),
+                GBOOLEAN_TO_POINTER(TRUE)
+              );
+            }
+
+            break;
+          }
+        }
+
+        if(j < priv->n_transient_accounts)
+        {
+          ++i;
+        }
+        else
+        {
+          if(priv->account_storage != NULL)
+          {
+            /* Not a transient account either, so look up from storage */
+            if(to_be_looked_up == NULL)
+            {
+              to_be_looked_up = g_array_new(
+                FALSE,
+                FALSE,
+                sizeof(InfAclAccountId)
+              );
+            }
+
+            g_array_append_val(to_be_looked_up, sheet_set->sheets[i].account);
+            ++i;
+          }
+          else
+          {
+            /* We do not have an account storage, so the account does
+             * definitely not exist */
+            account_id = sheet_set->sheets[i].account;
+            inf_acl_sheet_set_remove_sheet(
+              sheet_set,
+              &sheet_set->own_sheets[i]
+            );
+
+            if(report_changed_sheets)
+            {
+              if(changed_sheets == NULL)
+                changed_sheets = inf_acl_sheet_set_new();
+              sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
+              inf_acl_mask_clear(&sheet->mask);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /* Look up the missing pieces */
+  if(to_be_looked_up != NULL)
+  {
+    error = NULL;
+
+    accounts = infd_account_storage_lookup_accounts(
+      priv->account_storage,
+      (InfAclAccountId*)to_be_looked_up->data,
+      to_be_looked_up->len,
+      &error
+    );
+
+    if(error != NULL)
+    {
+      /* If an error occurred, keep the sheet set as it is, i.e. don't
+       * remove anything, just in case. */
+      g_warning(
+        _("Failed to look up accounts in account storage: %s"),
+        error->message
+      );
+
+      g_error_free(error);
+    }
+    else
+    {
+      for(i = 0; i < to_be_looked_up->len; ++i)
+      {
+        account_id = accounts[i].id;
+        if(account_id == 0)
+        {
+          /* Not found, remove from sheet set */
+          account_id = g_array_index(to_be_looked_up, InfAclAccountId, i);
+          sheet = inf_acl_sheet_set_find_sheet(sheet_set, account_id);
+          g_assert(sheet != NULL);
+
+          inf_acl_sheet_set_remove_sheet(sheet_set, sheet);
+
+          if(report_changed_sheets)
+          {
+            if(changed_sheets == NULL)
+              changed_sheets = inf_acl_sheet_set_new();
+            sheet = inf_acl_sheet_set_add_sheet(changed_sheets, account_id);
+            inf_acl_mask_clear(&sheet->mask);
+          }
+
+          if(verify_accounts != NULL)
+          {
+            g_hash_table_insert(
+              verify_accounts,
+              INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
+              GBOOLEAN_TO_POINTER(FALSE)
+            );
+          }
+        }
+        else
+        {
+          /* Found */
+          if(verify_accounts != NULL)
+          {
+            g_hash_table_insert(
+              verify_accounts,
+              INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
+              GBOOLEAN_TO_POINTER(TRUE)
+            );
+          }
+        }
+      }
+
+      inf_acl_account_array_free(accounts, to_be_looked_up->len);
+    }
+
+    g_array_free(to_be_looked_up, TRUE);
+  }
+
+  return changed_sheets;
+}
+
+static void
+infd_directory_verify_acl_for_node(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   GHashTable* verify_accounts,
+                                   gboolean lookup_if_not_cached)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
+  InfAclSheetSet* removed_sheets;
+  InfBrowserIter iter;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explored == TRUE)
+  {
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
+    {
+      infd_directory_verify_acl_for_node(
+        directory,
+        child,
+        verify_accounts,
+        lookup_if_not_cached
+      );
+    }
+  }
+
+  if(node->acl != NULL)
+  {
+    removed_sheets = infd_directory_verify_acl(
+      directory,
+      node->acl,
+      verify_accounts,
+      lookup_if_not_cached,
+      TRUE
+    );
+
+    if(node == priv->root)
+    {
+      infd_directory_verify_acl(
+        directory,
+        priv->orig_root_acl,
+        verify_accounts,
+        lookup_if_not_cached,
+        FALSE
+      );
+    }
+
+    if(removed_sheets != NULL)
+    {
+      iter.node = node;
+      iter.node_id = node->id;
+
+      inf_browser_acl_changed(
+        INF_BROWSER(directory),
+        &iter,
+        removed_sheets,
+        NULL
+      );
+
+      inf_acl_sheet_set_free(removed_sheets);
+      infd_directory_write_acl(directory, node);
+    }
+  }
+}
+
+static void
+infd_directory_verify_all_acls(InfdDirectory* directory,
+                               GHashTable* verify_accounts,
+                               gboolean lookup_if_not_cached)
+{
+  InfdDirectoryPrivate* priv;
+  GSList* item;
+  InfdDirectorySyncIn* sync_in;
+  InfdDirectorySubreq* subreq;
+  InfAclSheetSet* acl;
+  GHashTable* own_table;
+
+  own_table = NULL;
+  if(verify_accounts == NULL)
+  {
+    own_table = g_hash_table_new(NULL, NULL);
+    verify_accounts = own_table;
+  }
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  infd_directory_verify_acl_for_node(
+    directory,
+    priv->root,
+    verify_accounts,
+    lookup_if_not_cached
+  );
+
+  /* Remove ACL sheet from sync-ins and subscription requests. */
+  for(item = priv->sync_ins; item != NULL; item = item->next)
+  {
+    sync_in = (InfdDirectorySyncIn*)item->data;
+
+    if(sync_in->sheet_set != NULL)
+    {
+      infd_directory_verify_acl(
+        directory,
+        sync_in->sheet_set,
+        verify_accounts,
+        lookup_if_not_cached,
+        FALSE
+      );
+    }
+  }
+
+  for(item = priv->subscription_requests; item != NULL; item = item->next)
+  {
+    subreq = (InfdDirectorySubreq*)item->data;
+
+    switch(subreq->type)
+    {
+    case INFD_DIRECTORY_SUBREQ_CHAT:
+    case INFD_DIRECTORY_SUBREQ_SESSION:
+      acl = NULL;
+      break;
+    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+      acl = subreq->shared.add_node.sheet_set;
+      break;
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
+      acl = subreq->shared.sync_in.sheet_set;
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+
+    if(acl != NULL)
+    {
+      infd_directory_verify_acl(
+        directory,
+        acl,
+        verify_accounts,
+        lookup_if_not_cached,
+        FALSE
+      );
+    }
+  }
+
+  if(own_table != NULL)
+    g_hash_table_destroy(own_table);
+}
+
+/* Makes a sheet set from the ACL for the node at path as read from the
+ * storage. node can be NULL. If node is not NULL, additional sheets are
+ * returned which correspond to erasure of the current ACL for the node. This
+ * allows the ACL change to be performed atomically on the node.
+ *
+ * The verify_accounts table is a cache when verifying whether the accounts
+ * present in the sheet exist or not. */
+static InfAclSheetSet*
+infd_directory_acl_from_storage(InfdDirectory* directory,
+                                const gchar* path,
+                                InfdDirectoryNode* node,
+                                GSList* acl,
+                                GHashTable* verify_accounts)
+{
+  InfdDirectoryPrivate* priv;
+  GSList* item;
+  InfdStorageAcl* storage_acl;
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  InfAclAccountId account_id;
+  InfAclSheetSet* verify_sheets;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* If there are any ACLs set already for this node, then clear them. This
+   * should usually not happen because we only call this function for new
+   * nodes, but it can happen when the storage is changed on the fly and the
+   * root node changes. */
+  if(node != NULL && node->acl != NULL)
+  {
+    sheet_set = inf_acl_sheet_set_get_clear_sheets(node->acl);
+  }
+  else
+  {
+    sheet_set = inf_acl_sheet_set_new();
+  }
+
+  for(item = acl; item != NULL; item = g_slist_next(item))
+  {
+    storage_acl = (InfdStorageAcl*)item->data;
+    account_id = inf_acl_account_id_from_string(storage_acl->account_id);
+
+    sheet = inf_acl_sheet_set_add_sheet(sheet_set, account_id);
+    sheet->mask = storage_acl->mask;
+    sheet->perms = storage_acl->perms;
+  }
+
+  if(priv->account_storage != NULL)
+  {
+    verify_sheets = infd_directory_verify_acl(
+      directory,
+      sheet_set,
+      verify_accounts,
+      TRUE,
+      TRUE
+    );
+
+    if(verify_sheets != NULL)
+    {
+      /* We do not need to make signal emissions here, since the ACL has just
+       * been read. However, if verify_sheets is not equal to zero, then
+       * sheets have been removed from the set, and we want to write the
+       * updated set to storage. */
+      infd_directory_write_acl_at_path(directory, path, sheet_set);
+      inf_acl_sheet_set_free(verify_sheets);
+    }
+  }
+
+  return sheet_set;
+}
+
+/* Reads the ACL for the node at path from the storage, see
+ * infd_directory_acl_from_storage(). */
+static InfAclSheetSet*
+infd_directory_read_acl(InfdDirectory* directory,
+                        const gchar* path,
+                        InfdDirectoryNode* node,
+                        GHashTable* verify_accounts,
+                        GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  GError* local_error;
+  GSList* acl;
+  InfAclSheetSet* sheet_set;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+
+  local_error = NULL;
+  acl = infd_storage_read_acl(priv->storage, path, &local_error);
+
+  if(local_error != NULL)
+  {
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  sheet_set = infd_directory_acl_from_storage(
+    directory,
+    path,
+    node,
+    acl,
+    verify_accounts
+  );
+
+  infd_storage_acl_list_free(acl);
+  return sheet_set;
+}
+
+static void
+infd_directory_report_support(InfdDirectory* directory,
+                              gboolean* add_account,
+                              gboolean* remove_account)
+{
+  InfdDirectoryPrivate* priv;
+  gboolean supports_add_account;
+  gboolean supports_remove_account;
+  InfdAccountStorageSupport support;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  supports_add_account = FALSE;
+  supports_remove_account = FALSE;
+
+  if(priv->account_storage != NULL)
+  {
+    support = infd_account_storage_get_support(priv->account_storage);
+
+    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_ADD_ACCOUNT)
+      if(priv->private_key != NULL && priv->certificate != NULL)
+        supports_add_account = TRUE;
+
+    if(support & INFD_ACCOUNT_STORAGE_SUPPORT_REMOVE_ACCOUNT)
+      supports_remove_account = TRUE;
+  }
+
+  if(add_account != NULL) *add_account = supports_add_account;
+  if(remove_account != NULL) *remove_account = supports_remove_account;
+}
+
+/* Change the given sheet set such that if we don't support account creation
+ * or removal, it is disabled in sheet_set. Return FALSE if sheet_set had to
+ * be changed. */
+static gboolean
+infd_directory_report_support_in_sheets(InfdDirectory* directory,
+                                        InfAclSheetSet* sheet_set)
+{
+  gboolean supports_remove_account;
+  gboolean supports_add_account;
+  gboolean unaltered;
+  guint i;
+
+  InfAclSheet* sheet;
+  InfAclMask tmp_mask;
+
+  g_assert(sheet_set->n_sheets == 0 || sheet_set->own_sheets != NULL);
+
+  infd_directory_report_support(
+    directory,
+    &supports_add_account,
+    &supports_remove_account
+  );
+
+  unaltered = TRUE;
+  for(i = 0; i < sheet_set->n_sheets; ++i)
+  {
+    sheet = &sheet_set->own_sheets[i];
+    if(supports_add_account == FALSE &&
+       inf_acl_mask_has(&sheet->mask, INF_ACL_CAN_CREATE_ACCOUNT) &&
+       inf_acl_mask_has(&sheet->perms, INF_ACL_CAN_CREATE_ACCOUNT))
+    {
+      /* Remove the INF_ACL_CAN_CREATE_ACCOUNT flag */
+      inf_acl_mask_set1(&tmp_mask, INF_ACL_CAN_CREATE_ACCOUNT);
+      inf_acl_mask_neg(&tmp_mask, &tmp_mask);
+      inf_acl_mask_and(&sheet->perms, &tmp_mask, &sheet->perms);
+
+      unaltered = FALSE;
+    }
+    
+    if(supports_remove_account == FALSE &&
+       inf_acl_mask_has(&sheet->mask, INF_ACL_CAN_REMOVE_ACCOUNT) &&
+       inf_acl_mask_has(&sheet->perms, INF_ACL_CAN_REMOVE_ACCOUNT))
+    {
+      /* Remove the INF_ACL_CAN_REMOVE_ACCOUNT flag */
+      inf_acl_mask_set1(&tmp_mask, INF_ACL_CAN_REMOVE_ACCOUNT);
+      inf_acl_mask_neg(&tmp_mask, &tmp_mask);
+      inf_acl_mask_and(&sheet->perms, &tmp_mask, &sheet->perms);
+
+      unaltered = FALSE;
+    }
+  }
+
+  return unaltered;
+}
+
+static void
+infd_directory_update_root_acl(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  InfAclSheetSet* copy_set;
+  InfAclSheetSet* merge_sheets;
+  guint i;
+  gboolean include_sheet;
+  const InfAclSheet* new_sheet;
+  const InfAclSheet* cur_sheet;
+  InfAclSheet* merge_sheet;
+  InfAclMask cur_perms;
+  InfAclMask new_perms;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  copy_set = inf_acl_sheet_set_copy(priv->orig_root_acl);
+  infd_directory_report_support_in_sheets(directory, copy_set);
+
+  /* We will now update root->acl to copy_set. Below we construct a
+   * sheet set which contains the differences. */
+  merge_sheets = inf_acl_sheet_set_new();
+  for(i = 0; i < copy_set->n_sheets; ++i)
+  {
+    include_sheet = TRUE;
+    new_sheet = &copy_set->sheets[i];
+
+    cur_sheet = inf_acl_sheet_set_find_const_sheet(
+      priv->root->acl,
+      new_sheet->account
+    );
+
+    g_assert(cur_sheet != NULL);
+
+    if(inf_acl_mask_equal(&new_sheet->mask, &cur_sheet->mask))
+    {
+      inf_acl_mask_and(&cur_sheet->perms, &cur_sheet->mask, &cur_perms);
+      inf_acl_mask_and(&new_sheet->perms, &new_sheet->mask, &new_perms);
+      if(inf_acl_mask_equal(&cur_perms, &new_perms))
+        include_sheet = FALSE;
+    }
+
+    /* The sheet has changed */
+    if(include_sheet)
+    {
+      merge_sheet = inf_acl_sheet_set_add_sheet(
+        merge_sheets,
+        new_sheet->account
+      );
+
+      merge_sheet->mask = new_sheet->mask;
+      merge_sheet->perms = new_sheet->perms;
+    }
+  }
+
+  /* We make use of the fact that there are the same sheets in
+   * priv->orig_root_acl and priv->root->acl. */
+  if(merge_sheets->n_sheets > 0)
+  {
+    inf_acl_sheet_set_free(priv->root->acl);
+    priv->root->acl = copy_set;
+
+    infd_directory_announce_acl_sheets(
+      directory,
+      priv->root,
+      NULL,
+      merge_sheets,
+      NULL
+    );
+  }
+  else
+  {
+    inf_acl_sheet_set_free(copy_set);
+  }
+
+  inf_acl_sheet_set_free(merge_sheets);
+}
+
+static void
+infd_directory_read_root_acl(InfdDirectory* directory)
+{
+  InfdDirectoryPrivate* priv;
+  InfAclAccountId default_id;
+
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* default_sheet;
+  InfAclSheet* sheet;
+  InfAclMask default_mask;
+  InfAclMask tmp_mask;
+  GError* error;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  error = NULL;
+
+  sheet_set = infd_directory_read_acl(
+    directory,
+    "/",
+    priv->root,
+    NULL,
+    &error
+  );
+
+  /* Will be reset below: */
+  if(priv->orig_root_acl != NULL)
+    inf_acl_sheet_set_free(priv->orig_root_acl);
+
+  default_id = inf_acl_account_id_from_string("default");
+  if(error != NULL)
+  {
+    g_assert(sheet_set == NULL);
+
+    g_warning(
+      _("Failed to read the ACL for the root node: %s\n"
+        "In order not to compromise security all permissions have been "
+        "revoked for all users. The infinote server is likely not very "
+        "usable in this configuration, so please check the storage "
+        "system, fix the problem and re-start the server."),
+      error->message
+    );
+
+    g_error_free(error);
+
+    /* Clear all existing sheets and add one sheet for the default user which
+     * prohibits everything. */
+    if(priv->root->acl != NULL)
+      sheet_set = inf_acl_sheet_set_get_clear_sheets(priv->root->acl);
+    else
+      sheet_set = inf_acl_sheet_set_new();
+
+    default_sheet = inf_acl_sheet_set_add_sheet(sheet_set, default_id);
+    default_sheet->mask = INF_ACL_MASK_ALL;
+    inf_acl_mask_clear(&default_sheet->perms);
+
+    /* Make sure this "revoke-everything" sheet is not written to disk. */
+    priv->root->acl = inf_acl_sheet_set_merge_sheets(
+      priv->root->acl,
+      sheet_set
+    );
+
+    if(priv->root->acl != NULL)
+      priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
+    else
+      priv->orig_root_acl = NULL;
+
+    infd_directory_announce_acl_sheets(
+      directory,
+      priv->root,
+      NULL, /* TODO: make a request for this? */
+      sheet_set,
+      NULL
+    );
+  }
+  else
+  {
+    /* Make sure there are permissions for the default user defined. If there
+     * are not, use sensible default permissions. */
+    default_sheet = inf_acl_sheet_set_add_sheet(sheet_set, default_id);
+
+    default_mask = default_sheet->mask;
+    inf_acl_mask_neg(&default_mask, &tmp_mask);
+    inf_acl_mask_and(&tmp_mask, &INF_ACL_MASK_DEFAULT, &tmp_mask);
+
+    inf_acl_mask_or(&default_sheet->perms, &tmp_mask, &default_sheet->perms);
+
+    default_sheet->mask = INF_ACL_MASK_ALL;
+
+    /* Set original ACL as read from disk */
+    if(priv->root->acl != NULL)
+      priv->orig_root_acl = inf_acl_sheet_set_copy(priv->root->acl);
+    else
+      priv->orig_root_acl = NULL;
+
+    /* Note that the sheets array already includes sheets that clear the
+     * existing ACL. */
+    priv->orig_root_acl = inf_acl_sheet_set_merge_sheets(
+      priv->orig_root_acl,
+      sheet_set
+    );
+
+    /* For the actual permissions to use, remove the CAN_ADD_ACCOUNT
+     * permission if we do not have a certificate set or if it is not
+     * supported by the backend. */
+    infd_directory_report_support_in_sheets(directory, sheet_set);
+
+    priv->root->acl = inf_acl_sheet_set_merge_sheets(
+      priv->root->acl,
+      sheet_set
+    );
+
+    infd_directory_announce_acl_sheets(
+      directory,
+      priv->root,
+      NULL, /* TODO: make a request for this? */
+      sheet_set,
+      NULL
+    );
+
+    inf_acl_mask_and(&default_mask, &INF_ACL_MASK_ALL, &default_mask);
+    if(!inf_acl_mask_equal(&default_mask, &INF_ACL_MASK_ALL))
+      infd_directory_write_acl(directory, priv->root);
+  }
+
+  inf_acl_sheet_set_free(sheet_set);
+}
+
+/*
+ * Node construction and removal
+ */
+
+/* Creates the subscription group for a node, named "InfSession_%u", %u being
+ * the node id (which should be unique). If pin is TRUE, the group is opened
+ * in the worker thread responsible for the node, if any, and the session
+ * created for the group runs in that worker. */
+static InfCommunicationHostedGroup*
+infd_directory_create_subscription_group(InfdDirectory* directory,
+                                         guint node_id,
+                                         gboolean pin)
+{
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  gchar* group_name;
+  guint worker;
+
+  /* TODO: For the moment, there only exist central methods anyway. In the
+   * long term, this should probably be a property, though. */
+  static const gchar* const methods[] = { "central", NULL };
+
+  worker = 0;
+  if(pin == TRUE)
+    worker = infd_directory_get_worker_for_node(directory, node_id);
+
+  infd_directory_get_worker_context(directory, worker, NULL, &manager);
+  group_name = g_strdup_printf("InfSession_%u", node_id);
+
+  group = inf_communication_manager_open_group(
+    manager,
     group_name,
     methods
   );
 
-  g_free(group_name);
-  return group;
+  g_free(group_name);
+
+  if(worker != 0)
+  {
+    g_object_set_qdata(
+      G_OBJECT(group),
+      infd_directory_worker_quark,
+      GUINT_TO_POINTER(worker)
+    );
+  }
+
+  return group;
+}
+
+static InfdSessionProxy*
+infd_directory_create_session_proxy_with_group(InfdDirectory* directory,
+                                               InfSession* session,
+                                               InfCommunicationHostedGroup* g)
+{
+  InfdSessionProxy* proxy;
+  InfIo* io;
+  guint worker;
+
+  g_assert(
+    inf_communication_group_get_target(INF_COMMUNICATION_GROUP(g)) == NULL
+  );
+
+  worker = infd_directory_get_worker_for_object(g);
+  infd_directory_get_worker_context(directory, worker, &io, NULL);
+
+  proxy = INFD_SESSION_PROXY(
+    g_object_new(
+      INFD_TYPE_SESSION_PROXY,
+      "io", io,
+      "session", session,
+      "subscription-group", g,
+      NULL
+    )
+  );
+
+  if(worker != 0)
+  {
+    g_object_set_qdata(
+      G_OBJECT(proxy),
+      infd_directory_worker_quark,
+      GUINT_TO_POINTER(worker)
+    );
+  }
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(g),
+    INF_COMMUNICATION_OBJECT(proxy)
+  );
+
+  return proxy;
+}
+
+static InfdSessionProxy*
+infd_directory_create_session_proxy(InfdDirectory* directory,
+                                    const InfdNotePlugin* plugin,
+                                    InfSessionStatus status,
+                                    InfCommunicationHostedGroup* sync_g,
+                                    InfXmlConnection* sync_conn,
+                                    InfCommunicationHostedGroup* sub_g,
+                                    const char* path)
+{
+  InfSession* session;
+  InfdSessionProxy* proxy;
+  InfIo* io;
+  InfCommunicationManager* manager;
+  guint worker;
+
+  g_assert(sub_g != NULL);
+
+  /* Synchronization groups are always handled in the main thread */
+  worker = infd_directory_get_worker_for_object(sub_g);
+  g_assert(worker == 0 || sync_g == NULL);
+
+  infd_directory_get_worker_context(directory, worker, &io, &manager);
+
+  session = plugin->session_new(
+    io,
+    manager,
+    status,
+    INF_COMMUNICATION_GROUP(sync_g),
+    sync_conn,
+    path,
+    plugin->user_data
+  );
+
+  proxy = infd_directory_create_session_proxy_with_group(
+    directory,
+    session,
+    sub_g
+  );
+
+  g_object_unref(session);
+
+  if(sync_g != NULL && sync_g != sub_g)
+  {
+    inf_communication_group_set_target(
+      INF_COMMUNICATION_GROUP(sync_g),
+      INF_COMMUNICATION_OBJECT(proxy)
+    );
+  }
+
+  return proxy;
 }
 
-static InfdSessionProxy*
-infd_directory_create_session_proxy_with_group(InfdDirectory* directory,
-                                               InfSession* session,
-                                               InfCommunicationHostedGroup* g)
+/* Called after a session proxy has been created for a newly added node.
+ * It attempts to store the node in the storage. If it cannot be stored, the
+ * function fails and unrefs the proxy. */
+static gboolean
+infd_directory_session_proxy_ensure(InfdDirectory* directory,
+                                    InfdDirectoryNode* parent,
+                                    const gchar* name,
+                                    const InfdNotePlugin* plugin,
+                                    InfdSessionProxy* proxy,
+                                    GError** error)
 {
   InfdDirectoryPrivate* priv;
-  InfdSessionProxy* proxy;
-  
+  gchar* path;
+  InfSession* session;
+  gboolean ret;
+  InfCommunicationGroup* sub_group;
+  InfCommunicationGroup* sync_group;
+
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_assert(
-    inf_communication_group_get_target(INF_COMMUNICATION_GROUP(g)) == NULL
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  if(priv->storage != NULL)
+  {
+    /* Save session initially */
+    infd_directory_node_make_path(parent, name, &path, NULL);
+
+    ret = plugin->session_write(
+      priv->storage,
+      session,
+      path,
+      plugin->user_data,
+      error
+    );
+
+    g_free(path);
+
+    /* Unset modified flag since we just wrote the buffer contents into
+     * storage. */
+    if(ret == TRUE)
+      inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+  }
+  else
+  {
+    ret = TRUE;
+  }
+
+  if(ret == FALSE)
+  {
+    /* Reset communication groups for the proxy, to avoid a warning at
+     * final unref. Due do this failing the groups are very likely going to be
+     * unrefed as well any time soon. */
+    sub_group = inf_session_get_subscription_group(session);
+    inf_communication_group_set_target(sub_group, NULL);
+
+    g_object_get(G_OBJECT(session), "sync-group", &sync_group, NULL);
+    if(sync_group != NULL && sync_group != sub_group)
+      inf_communication_group_set_target(sync_group, NULL);
+    if(sync_group != NULL)
+      g_object_unref(sync_group);
+
+    g_object_unref(proxy);
+  }
+
+  g_object_unref(session);
+  return ret;
+}
+
+/* Links a InfdSessionProxy with a InfdDirectoryNode */
+static void
+infd_directory_node_link_session(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdRequest* request,
+                                 InfdSessionProxy* proxy)
+{
+  InfdDirectoryPrivate* priv;
+  InfBrowserIter iter;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session == NULL ||
+           (node->shared.note.session == proxy &&
+            node->shared.note.weakref == TRUE));
+
+  iter.node = node;
+  iter.node_id = node->id;
+
+  inf_browser_subscribe_session(
+    INF_BROWSER(directory),
+    &iter,
+    INF_SESSION_PROXY(proxy),
+    INF_REQUEST(request)
   );
+}
 
-  proxy = INFD_SESSION_PROXY(
-    g_object_new(
-      INFD_TYPE_SESSION_PROXY,
-      "io", priv->io,
-      "session", session,
-      "subscription-group", g,
-      NULL
-    )
+static void
+infd_directory_node_unlink_session(InfdDirectory* directory,
+                                   InfdDirectoryNode* node,
+                                   InfdRequest* request)
+{
+  InfdDirectoryPrivate* priv;
+  InfBrowserIter iter;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session != NULL);
+  g_assert(node->shared.note.weakref == FALSE);
+
+  iter.node = node;
+  iter.node_id = node->id;
+
+  inf_browser_unsubscribe_session(
+    INF_BROWSER(directory),
+    &iter,
+    INF_SESSION_PROXY(node->shared.note.session),
+    INF_REQUEST(request)
   );
+}
+
+/* Notes are saved into the storage when save_notes is TRUE. */
+static void
+infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
+                                          InfdDirectoryNode* node,
+                                          InfdRequest* request,
+                                          gboolean save_notes)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* child;
+  gchar* path;
+  GError* error;
+  InfSession* session;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  switch(node->type)
+  {
+  case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    if(node->shared.subdir.explored == TRUE)
+    {
+      for(child = node->shared.subdir.child;
+          child != NULL;
+          child = child->next)
+      {
+        infd_directory_node_unlink_child_sessions(
+          directory,
+          child,
+          request,
+          save_notes
+        );
+      }
+    }
+
+    break;
+  case INFD_DIRECTORY_NODE_NOTE:
+    if(node->shared.note.session != NULL)
+    {
+      if(save_notes)
+      {
+        infd_directory_node_get_path(node, &path, NULL);
+
+        error = NULL;
+
+        if(priv->storage != NULL)
+        {
+          g_object_get(
+            G_OBJECT(node->shared.note.session),
+            "session", &session,
+            NULL
+          );
+
+          node->shared.note.plugin->session_write(
+            priv->storage,
+            session,
+            path,
+            node->shared.note.plugin->user_data,
+            &error
+          );
+
+          g_object_unref(session);
+        }
+
+        /* TODO: Unset modified flag of buffer if result == TRUE */
+
+        if(error != NULL)
+        {
+          /* There is not really anything we could do about it here. Of
+           * course, any application should save the sessions explicitely
+           * before shutting the directory down, so that it has the chance to
+           * cancel the shutdown if the session could not be saved. */
+          /* TODO: We could try saving the session somewhere in /tmp, for
+           * example via to_xml_sync. */
+          g_warning(
+            _("Could not write session \"%s\" to storage: %s\n\nAll changes "
+              "since the document das been saved are lost."),
+            path,
+            error->message
+          );
+
+          g_error_free(error);
+        }
+
+        g_free(path);
+      }
 
-  inf_communication_group_set_target(
-    INF_COMMUNICATION_GROUP(g),
-    INF_COMMUNICATION_OBJECT(proxy)
-  );
+      if(node->shared.note.weakref == FALSE)
+        infd_directory_node_unlink_session(directory, node, request);
+    }
 
-  return proxy;
+    break;
+  case INFD_DIRECTORY_NODE_UNKNOWN:
+    /* Nothing to do */
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
 }
 
-static InfdSessionProxy*
-infd_directory_create_session_proxy(InfdDirectory* directory,
-                                    const InfdNotePlugin* plugin,
-                                    InfSessionStatus status,
-                                    InfCommunicationHostedGroup* sync_g,
-                                    InfXmlConnection* sync_conn,
-                                    InfCommunicationHostedGroup* sub_g,
-                                    const char* path)
+static void
+infd_directory_node_link(InfdDirectoryNode* node,
+                         InfdDirectoryNode* parent)
 {
-  InfdDirectoryPrivate* priv;
-  InfSession* session;
-  InfdSessionProxy* proxy;
-
-  g_assert(sub_g != NULL);
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_return_if_fail(node != NULL);
+  g_return_if_fail(parent != NULL);
+  infd_directory_return_if_subdir_fail(parent);
 
-  session = plugin->session_new(
-    priv->io,
-    priv->communication_manager,
-    status,
-    INF_COMMUNICATION_GROUP(sync_g),
-    sync_conn,
-    path,
-    plugin->user_data
-  );
+  node->prev = NULL;
+  if(parent->shared.subdir.child != NULL)
+  {
+    parent->shared.subdir.child->prev = node;
+    node->next = parent->shared.subdir.child;
+  }
+  else
+  {
+    node->next = NULL;
+  }
 
-  proxy = infd_directory_create_session_proxy_with_group(
-    directory,
-    session,
-    sub_g
-  );
+  parent->shared.subdir.child = node;
+}
 
-  g_object_unref(session);
+static void
+infd_directory_node_unlink(InfdDirectoryNode* node)
+{
+  g_return_if_fail(node != NULL);
+  g_return_if_fail(node->parent != NULL);
 
-  if(sync_g != NULL && sync_g != sub_g)
+  if(node->prev != NULL)
   {
-    inf_communication_group_set_target(
-      INF_COMMUNICATION_GROUP(sync_g),
-      INF_COMMUNICATION_OBJECT(proxy)
-    );
+    node->prev->next = node->next;
+  }
+  else 
+  {
+    g_assert(node->parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+    node->parent->shared.subdir.child = node->next;
   }
 
-  return proxy;
+  if(node->next != NULL)
+    node->next->prev = node->prev;
 }
 
-/* Called after a session proxy has been created for a newly added node.
- * It attempts to store the node in the storage. If it cannot be stored, the
- * function fails and unrefs the proxy. */
-static gboolean
-infd_directory_session_proxy_ensure(InfdDirectory* directory,
-                                    InfdDirectoryNode* parent,
-                                    const gchar* name,
-                                    const InfdNotePlugin* plugin,
-                                    InfdSessionProxy* proxy,
-                                    GError** error)
+/* This function takes ownership of name. If write_acl the ACL is written to
+ * the storage. This should be used for newly created nodes, but for nodes
+ * read from storage it should be false, since it is pointless to write
+ * the ACL again. */
+static InfdDirectoryNode*
+infd_directory_node_new_common(InfdDirectory* directory,
+                               InfdDirectoryNode* parent,
+                               InfdDirectoryNodeType type,
+                               guint node_id,
+                               gchar* name,
+                               const InfAclSheetSet* sheet_set,
+                               gboolean write_acl)
 {
   InfdDirectoryPrivate* priv;
-  gchar* path;
-  InfSession* session;
-  gboolean ret;
-  InfCommunicationGroup* sub_group;
-  InfCommunicationGroup* sync_group;
+  InfdDirectoryNode* node;
+  InfBrowserIter iter;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
-
-  if(priv->storage != NULL)
-  {
-    /* Save session initially */
-    infd_directory_node_make_path(parent, name, &path, NULL);
+  g_assert(
+    g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id)) == NULL
+  );
 
-    ret = plugin->session_write(
-      priv->storage,
-      session,
-      path,
-      plugin->user_data,
-      error
-    );
+  node = g_slice_new(InfdDirectoryNode);
+  node->parent = parent;
+  node->type = type;
+  node->id = node_id;
+  node->name = name;
+  node->acl = NULL;
+  node->acl_connections = NULL;
 
-    g_free(path);
+  if(sheet_set != NULL)
+  {
+    node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
+    if(write_acl == TRUE)
+      infd_directory_write_acl(directory, node);
+  }
 
-    /* Unset modified flag since we just wrote the buffer contents into
-     * storage. */
-    if(ret == TRUE)
-      inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+  if(parent != NULL)
+  {
+    infd_directory_node_link(node, parent);
   }
   else
   {
-    ret = TRUE;
+    node->prev = NULL;
+    node->next = NULL;
   }
 
-  if(ret == FALSE)
-  {
-    /* Reset communication groups for the proxy, to avoid a warning at
-     * final unref. Due do this failing the groups are very likely going to be
-     * unrefed as well any time soon. */
-    sub_group = inf_session_get_subscription_group(session);
-    inf_communication_group_set_target(sub_group, NULL);
+  g_hash_table_insert(priv->nodes, GUINT_TO_POINTER(node->id), node);
+  return node;
+}
 
-    g_object_get(G_OBJECT(session), "sync-group", &sync_group, NULL);
-    if(sync_group != NULL && sync_group != sub_group)
-      inf_communication_group_set_target(sync_group, NULL);
-    if(sync_group != NULL)
-      g_object_unref(sync_group);
+static InfdDirectoryNode*
+infd_directory_node_new_subdirectory(InfdDirectory* directory,
+                                     InfdDirectoryNode* parent,
+                                     guint node_id,
+                                     gchar* name,
+                                     const InfAclSheetSet* sheet_set,
+                                     gboolean write_acl)
+{
+  InfdDirectoryNode* node;
 
-    g_object_unref(proxy);
-  }
+  node = infd_directory_node_new_common(
+    directory,
+    parent,
+    INFD_DIRECTORY_NODE_SUBDIRECTORY,
+    node_id,
+    name,
+    sheet_set,
+    write_acl
+  );
 
-  g_object_unref(session);
-  return ret;
+  node->shared.subdir.connections = NULL;
+  node->shared.subdir.child = NULL;
+  node->shared.subdir.explored = FALSE;
+  node->shared.subdir.explore = NULL;
+
+  return node;
 }
 
-/* Links a InfdSessionProxy with a InfdDirectoryNode */
-static void
-infd_directory_node_link_session(InfdDirectory* directory,
-                                 InfdDirectoryNode* node,
-                                 InfdRequest* request,
-                                 InfdSessionProxy* proxy)
+static InfdDirectoryNode*
+infd_directory_node_new_note(InfdDirectory* directory,
+                             InfdDirectoryNode* parent,
+                             guint node_id,
+                             gchar* name,
+                             const InfAclSheetSet* sheet_set,
+                             gboolean write_acl,
+                             const InfdNotePlugin* plugin)
 {
-  InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
+  InfdDirectoryNode* node;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = infd_directory_node_new_common(
+    directory,
+    parent,
+    INFD_DIRECTORY_NODE_NOTE,
+    node_id,
+    name,
+    sheet_set,
+    write_acl
+  );
 
-  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(node->shared.note.session == NULL ||
-           (node->shared.note.session == proxy &&
-            node->shared.note.weakref == TRUE));
+  node->shared.note.session = NULL;
+  node->shared.note.plugin = plugin;
+  node->shared.note.save_timeout = NULL;
+  node->shared.note.weakref = FALSE;
+  node->shared.note.load = NULL;
 
-  iter.node = node;
-  iter.node_id = node->id;
+  return node;
+}
 
-  inf_browser_subscribe_session(
-    INF_BROWSER(directory),
-    &iter,
-    INF_SESSION_PROXY(proxy),
-    INF_REQUEST(request)
+static InfdDirectoryNode*
+infd_directory_node_new_unknown(InfdDirectory* directory,
+                                InfdDirectoryNode* parent,
+                                guint node_id,
+                                gchar* name,
+                                const InfAclSheetSet* sheet_set,
+                                gboolean write_acl,
+                                const gchar* note_type)
+{
+  InfdDirectoryNode* node;
+
+  node = infd_directory_node_new_common(
+    directory,
+    parent,
+    INFD_DIRECTORY_NODE_UNKNOWN,
+    node_id,
+    name,
+    sheet_set,
+    write_acl
   );
+
+  node->shared.unknown.type = g_quark_from_string(note_type);
+
+  return node;
 }
 
-static void
-infd_directory_node_unlink_session(InfdDirectory* directory,
-                                   InfdDirectoryNode* node,
-                                   InfdRequest* request)
-{
-  InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+/* Required by infd_directory_node_free() */
+static void
+infd_directory_remove_sync_in(InfdDirectory* directory,
+                              InfdDirectorySyncIn* sync_in);
 
-  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
-  g_assert(node->shared.note.session != NULL);
-  g_assert(node->shared.note.weakref == FALSE);
+static void
+infd_directory_explore_cancel(InfdDirectory* directory,
+                              InfdDirectoryExplore* explore,
+                              const GError* error);
 
-  iter.node = node;
-  iter.node_id = node->id;
+static void
+infd_directory_load_cancel(InfdDirectory* directory,
+                           InfdDirectoryLoad* load,
+                           const GError* error);
 
-  inf_browser_unsubscribe_session(
-    INF_BROWSER(directory),
-    &iter,
-    INF_SESSION_PROXY(node->shared.note.session),
-    INF_REQUEST(request)
-  );
-}
+static void
+infd_directory_remove_subreq(InfdDirectory* directory,
+                             InfdDirectorySubreq* request);
 
-/* Notes are saved into the storage when save_notes is TRUE. */
 static void
-infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
-                                          InfdDirectoryNode* node,
-                                          InfdRequest* request,
-                                          gboolean save_notes)
+infd_directory_node_free(InfdDirectory* directory,
+                         InfdDirectoryNode* node)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* child;
-  gchar* path;
+  InfBrowserIter iter;
+  gboolean removed;
   GError* error;
-  InfSession* session;
+
+  GSList* item;
+  GSList* next;
+  InfdDirectorySyncIn* sync_in;
+  InfdDirectorySubreq* request;
+
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  g_return_if_fail(node != NULL);
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
   switch(node->type)
   {
   case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    g_slist_free(node->shared.subdir.connections);
+
+    if(node->shared.subdir.explore != NULL)
+    {
+      error = NULL;
+
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+        _("The node to be explored has been removed")
+      );
+
+      infd_directory_explore_cancel(
+        directory,
+        node->shared.subdir.explore,
+        error
+      );
+
+      g_error_free(error);
+    }
+
+    /* Free child nodes */
     if(node->shared.subdir.explored == TRUE)
     {
-      for(child = node->shared.subdir.child;
-          child != NULL;
-          child = child->next)
+      while(node->shared.subdir.child != NULL)
       {
-        infd_directory_node_unlink_child_sessions(
-          directory,
-          child,
-          request,
-          save_notes
-        );
+        infd_directory_node_free(directory, node->shared.subdir.child);
       }
     }
 
     break;
   case INFD_DIRECTORY_NODE_NOTE:
+    /* Sessions must have been explicitely unlinked before; we might still
+     * have weak references though. */
+    g_assert(node->shared.note.session == NULL ||
+             node->shared.note.weakref == TRUE);
+
     if(node->shared.note.session != NULL)
     {
-      if(save_notes)
-      {
-        infd_directory_node_get_path(node, &path, NULL);
-
-        error = NULL;
-
-        if(priv->storage != NULL)
-        {
-          g_object_get(
-            G_OBJECT(node->shared.note.session),
-            "session", &session,
-            NULL
-          );
-
-          node->shared.note.plugin->session_write(
-            priv->storage,
-            session,
-            path,
-            node->shared.note.plugin->user_data,
-            &error
-          );
-
-          g_object_unref(session);
-        }
-
-        /* TODO: Unset modified flag of buffer if result == TRUE */
-
-        if(error != NULL)
-        {
-          /* There is not really anything we could do about it here. Of
-           * course, any application should save the sessions explicitely
-           * before shutting the directory down, so that it has the chance to
-           * cancel the shutdown if the session could not be saved. */
-          /* TODO: We could try saving the session somewhere in /tmp, for
-           * example via to_xml_sync. */
-          g_warning(
-            _("Could not write session \"%s\" to storage: %s\n\nAll changes "
-              "since the document das been saved are lost."),
-            path,
-            error->message
-          );
+      infd_directory_release_session(
+        directory,
+        node,
+        node->shared.note.session
+      );
+    }
 
-          g_error_free(error);
-        }
+    if(node->shared.note.load != NULL)
+    {
+      error = NULL;
 
-        g_free(path);
-      }
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_SUCH_NODE,
+        _("The node to be subscribed to has been removed")
+      );
 
-      if(node->shared.note.weakref == FALSE)
-        infd_directory_node_unlink_session(directory, node, request);
+      infd_directory_load_cancel(directory, node->shared.note.load, error);
+      g_error_free(error);
     }
 
     break;
@@ -2107,2407 +3093,2646 @@ infd_directory_node_unlink_child_sessions(InfdDirectory* directory,
     g_assert_not_reached();
     break;
   }
+
+  if(node->parent != NULL)
+    infd_directory_node_unlink(node);
+  g_slist_free(node->acl_connections);
+
+  /* Only clear ACL table after unlink, so that ACL has effect until the very
+   * moment where the node does not exist anymore, to avoid possible races. */
+  if(node->acl != NULL)
+    inf_acl_sheet_set_free(node->acl);
+
+  /* Remove sync-ins whose parent is gone */
+  for(item = priv->sync_ins; item != NULL; item = next)
+  {
+    next = item->next;
+    sync_in = (InfdDirectorySyncIn*)item->data;
+    if(sync_in->parent == node)
+      infd_directory_remove_sync_in(directory, sync_in);
+  }
+
+  for(item = priv->subscription_requests; item != NULL; item = next)
+  {
+    next = item->next;
+    request = (InfdDirectorySubreq*)item->data;
+
+    switch(request->type)
+    {
+    case INFD_DIRECTORY_SUBREQ_CHAT:
+      break;
+    case INFD_DIRECTORY_SUBREQ_SESSION:
+      /* Keep subscription requests whose parent is gone. They will be
+       * released upon client reply. */
+      /*if(request->node_id == node->id)
+        infd_directory_remove_subreq(directory, request);*/
+      break;
+    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+      if(request->shared.add_node.parent->id == node->id)
+        request->shared.add_node.parent = NULL;
+      break;
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
+      if(request->shared.sync_in.parent->id == node->id)
+        request->shared.sync_in.parent = NULL;
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+  }
+
+  removed = g_hash_table_remove(priv->nodes, GUINT_TO_POINTER(node->id));
+  g_assert(removed == TRUE);
+
+  g_free(node->name);
+  g_slice_free(InfdDirectoryNode, node);
 }
 
 static void
-infd_directory_node_link(InfdDirectoryNode* node,
-                         InfdDirectoryNode* parent)
+infd_directory_node_remove_connection(InfdDirectoryNode* node,
+                                      InfXmlConnection* connection)
 {
-  g_return_if_fail(node != NULL);
-  g_return_if_fail(parent != NULL);
-  infd_directory_return_if_subdir_fail(parent);
+  InfdDirectoryNode* child;
+  GSList* item;
 
-  node->prev = NULL;
-  if(parent->shared.subdir.child != NULL)
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == TRUE);
+
+  item = g_slist_find(node->shared.subdir.connections, connection);
+
+  /* Note that if the connection is not in this node's connection list,
+   * then it cannot be in a child's list either. */
+  if(item != NULL)
   {
-    parent->shared.subdir.child->prev = node;
-    node->next = parent->shared.subdir.child;
+    node->shared.subdir.connections = g_slist_delete_link(
+      node->shared.subdir.connections,
+      item
+    );
+
+    if(node->shared.subdir.explored == TRUE)
+    {
+      for(child = node->shared.subdir.child;
+          child != NULL;
+          child = child->next)
+      {
+        if(child->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+           child->shared.subdir.explored == TRUE)
+        {
+          infd_directory_node_remove_connection(child, connection);
+        }
+      }
+    }
+    else
+    {
+      g_assert(node->shared.subdir.connections == NULL);
+    }
   }
-  else
+
+  /* Remove the connection from ACL connections of ourselves and all
+   * children. Do not recurse, since the recursion has taken place
+   * in the loop above only for explored subdirectories. */
+  node->acl_connections = g_slist_remove(node->acl_connections, connection);
+  for(child = node->shared.subdir.child;
+      child != NULL;
+      child = child->next)
   {
-    node->next = NULL;
+    child->acl_connections = g_slist_remove(
+      child->acl_connections,
+      connection
+    );
   }
-
-  parent->shared.subdir.child = node;
 }
 
+/*
+ * Permission enforcement
+ */
+
+/* Return the permissions needed to create a new node */
 static void
-infd_directory_node_unlink(InfdDirectoryNode* node)
+infd_directory_get_add_node_permissions(InfdDirectory* directory,
+                                        InfAclMask* out,
+                                        gboolean subdirectory,
+                                        gboolean initial_subscribe,
+                                        gboolean sync_in,
+                                        const InfAclSheetSet* sheet_set)
 {
-  g_return_if_fail(node != NULL);
-  g_return_if_fail(node->parent != NULL);
+  if(subdirectory)
+    inf_acl_mask_set1(out, INF_ACL_CAN_ADD_SUBDIRECTORY);
+  else
+    inf_acl_mask_set1(out, INF_ACL_CAN_ADD_DOCUMENT);
 
-  if(node->prev != NULL)
-  {
-    node->prev->next = node->next;
-  }
-  else 
-  {
-    g_assert(node->parent->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-    node->parent->shared.subdir.child = node->next;
-  }
+  if(initial_subscribe == TRUE)
+    inf_acl_mask_or1(out, INF_ACL_CAN_SUBSCRIBE_SESSION);
+  if(sync_in == TRUE)
+    inf_acl_mask_or1(out, INF_ACL_CAN_SYNC_IN);
 
-  if(node->next != NULL)
-    node->next->prev = node->prev;
+  if(sheet_set != NULL && sheet_set->n_sheets > 0)
+    inf_acl_mask_or1(out, INF_ACL_CAN_SET_ACL);
 }
 
-/* This function takes ownership of name. If write_acl the ACL is written to
- * the storage. This should be used for newly created nodes, but for nodes
- * read from storage it should be false, since it is pointless to write
- * the ACL again. */
-static InfdDirectoryNode*
-infd_directory_node_new_common(InfdDirectory* directory,
-                               InfdDirectoryNode* parent,
-                               InfdDirectoryNodeType type,
-                               guint node_id,
-                               gchar* name,
-                               const InfAclSheetSet* sheet_set,
-                               gboolean write_acl)
+/* Enforces the ACL on the given node. If the exploration permission is no
+ * longer given for this node, then explorations and subscriptions are also
+ * removed from all children. Returns whether node is still explored by
+ * the connection.
+ *
+ * Note this function does not enforce all ACLs recursively! */
+static gboolean
+infd_directory_enforce_single_acl(InfdDirectory* directory,
+                                  InfXmlConnection* connection,
+                                  InfdDirectoryNode* node,
+                                  gboolean is_explored)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
+  InfdDirectoryConnectionInfo* info;
+  InfAclAccountId account;
+
+  InfBrowser* browser;
   InfBrowserIter iter;
+  InfAclMask mask;
+  xmlNodePtr child_xml;
+  InfdDirectoryNode* child;
+  InfdSessionProxy* proxy;
+  InfXmlConnection* proxy_connection;
+  GSList* item;
+  GSList* next;
+  InfdDirectorySubreq* subreq;
+  InfdDirectorySyncIn* sync_in;
+  InfXmlConnection* sync_in_connection;
+  gboolean retval;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
+  account = info->account_id;
 
-  g_assert(
-    g_hash_table_lookup(priv->nodes, GUINT_TO_POINTER(node_id)) == NULL
-  );
-
-  node = g_slice_new(InfdDirectoryNode);
-  node->parent = parent;
-  node->type = type;
-  node->id = node_id;
-  node->name = name;
-  node->acl = NULL;
-  node->acl_connections = NULL;
-
-  if(sheet_set != NULL)
-  {
-    node->acl = inf_acl_sheet_set_merge_sheets(node->acl, sheet_set);
-    if(write_acl == TRUE)
-      infd_directory_write_acl(directory, node);
-  }
+  browser = INF_BROWSER(directory);
+  iter.node = node;
+  iter.node_id = node->id;
 
-  if(parent != NULL)
-  {
-    infd_directory_node_link(node, parent);
-  }
-  else
+  retval = TRUE;
+  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
   {
-    node->prev = NULL;
-    node->next = NULL;
-  }
-
-  g_hash_table_insert(priv->nodes, GUINT_TO_POINTER(node->id), node);
-  return node;
-}
-
-static InfdDirectoryNode*
-infd_directory_node_new_subdirectory(InfdDirectory* directory,
-                                     InfdDirectoryNode* parent,
-                                     guint node_id,
-                                     gchar* name,
-                                     const InfAclSheetSet* sheet_set,
-                                     gboolean write_acl)
-{
-  InfdDirectoryNode* node;
-
-  node = infd_directory_node_new_common(
-    directory,
-    parent,
-    INFD_DIRECTORY_NODE_SUBDIRECTORY,
-    node_id,
-    name,
-    sheet_set,
-    write_acl
-  );
+    if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
+    {
+      /* Remove exploration if new account does not have permission, or
+       * if one of the parent folders is no longer explored */
+      inf_acl_mask_set1(&mask, INF_ACL_CAN_EXPLORE_NODE);
+      if(!is_explored ||
+         !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+      {
+        node->shared.subdir.connections =
+          g_slist_remove(node->shared.subdir.connections, connection);
+        retval = FALSE;
 
-  node->shared.subdir.connections = NULL;
-  node->shared.subdir.child = NULL;
-  node->shared.subdir.explored = FALSE;
+        /* If there are subscription requests to create a node into this node
+         * from this connection, then mark them as canceled, so that we don't
+         * create the node in handle_subscribe_ack(). The client might
+         * actually create the node if it does not register the new ACL early
+         * enough, but that's okay because it removes it again as
+         * soon as it does. */
+        for(item = priv->subscription_requests; item != NULL; item = next)
+        {
+          next = item->next;
+          subreq = (InfdDirectorySubreq*)item->data;
 
-  return node;
-}
+          switch(subreq->type)
+          {
+          case INFD_DIRECTORY_SUBREQ_CHAT:
+          case INFD_DIRECTORY_SUBREQ_SESSION:
+            break;
+          case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+            if(subreq->connection == connection)
+              if(subreq->shared.add_node.parent->id == node->id)
+                subreq->shared.add_node.parent = NULL;
+            break;
+          case INFD_DIRECTORY_SUBREQ_SYNC_IN:
+          case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
+            if(subreq->connection == connection)
+              if(subreq->shared.sync_in.parent->id == node->id)
+                subreq->shared.sync_in.parent = NULL;
+            break;
+          default:
+            g_assert_not_reached();
+            break;
+          }
+        }
 
-static InfdDirectoryNode*
-infd_directory_node_new_note(InfdDirectory* directory,
-                             InfdDirectoryNode* parent,
-                             guint node_id,
-                             gchar* name,
-                             const InfAclSheetSet* sheet_set,
-                             gboolean write_acl,
-                             const InfdNotePlugin* plugin)
-{
-  InfdDirectoryNode* node;
+        /* Remove sync-ins whose parent is gone */
+        for(item = priv->sync_ins; item != NULL; item = next)
+        {
+          next = item->next;
+          sync_in = (InfdDirectorySyncIn*)item->data;
 
-  node = infd_directory_node_new_common(
-    directory,
-    parent,
-    INFD_DIRECTORY_NODE_NOTE,
-    node_id,
-    name,
-    sheet_set,
-    write_acl
-  );
+          g_object_get(
+            G_OBJECT(sync_in->request),
+            "requestor", &sync_in_connection,
+            NULL
+          );
 
-  node->shared.note.session = NULL;
-  node->shared.note.plugin = plugin;
-  node->shared.note.save_timeout = NULL;
-  node->shared.note.weakref = FALSE;
+          if(sync_in_connection == connection && sync_in->parent == node)
+            infd_directory_remove_sync_in(directory, sync_in);
 
-  return node;
-}
+          g_object_unref(sync_in_connection);
+        }
 
-static InfdDirectoryNode*
-infd_directory_node_new_unknown(InfdDirectory* directory,
-                                InfdDirectoryNode* parent,
-                                guint node_id,
-                                gchar* name,
-                                const InfAclSheetSet* sheet_set,
-                                gboolean write_acl,
-                                const gchar* note_type)
-{
-  InfdDirectoryNode* node;
+        for(child = node->shared.subdir.child;
+            child != NULL;
+            child = child->next)
+        {
+          infd_directory_enforce_single_acl(
+            directory,
+            connection,
+            child,
+            FALSE
+          );
+        }
+      }
+    }
+    else
+    {
+      retval = FALSE;
+    }
+  }
+  else
+  {
+    retval = FALSE;
+    if(node->type == INFD_DIRECTORY_NODE_NOTE)
+    {
+      proxy = node->shared.note.session;
+      if(proxy != NULL)
+      {
+        proxy_connection = infd_directory_get_connection_for_proxy(
+          directory,
+          proxy,
+          connection,
+          FALSE
+        );
 
-  node = infd_directory_node_new_common(
-    directory,
-    parent,
-    INFD_DIRECTORY_NODE_UNKNOWN,
-    node_id,
-    name,
-    sheet_set,
-    write_acl
-  );
+        if(proxy_connection != NULL &&
+           infd_session_proxy_is_subscribed(proxy, proxy_connection))
+        {
+          /* Remove subscription if no longer allowed, or if parent directory
+           * is no longer explored */
+          inf_acl_mask_set1(&mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
+          if(!is_explored ||
+             !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+          {
+            infd_session_proxy_unsubscribe(proxy, proxy_connection);
+          }
+          else
+          {
+            /* TODO: Remove joined users if join-user
+             * permissions are no longer granted. */
+          }
+        }
+      }
+    }
+  }
 
-  node->shared.unknown.type = g_quark_from_string(note_type);
+  if(g_slist_find(node->acl_connections, connection) != NULL)
+  {
+    inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACL);
+    if(!is_explored ||
+       !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
+    {
+      node->acl_connections =
+        g_slist_remove(node->acl_connections, connection);
+    }
+  }
 
-  return node;
+  return retval;
 }
 
-
-/* Required by infd_directory_node_free() */
-static void
-infd_directory_remove_sync_in(InfdDirectory* directory,
-                              InfdDirectorySyncIn* sync_in);
-
-static void
-infd_directory_remove_subreq(InfdDirectory* directory,
-                             InfdDirectorySubreq* request);
-
+/* Enforce ACL for the given node and all its children for info. If
+ * reply_xml is set, then fill it with information about ACL for all
+ * nodes for info's account. This is used when a connection is
+ * switching accounts. */
 static void
-infd_directory_node_free(InfdDirectory* directory,
-                         InfdDirectoryNode* node)
+infd_directory_enforce_acl(InfdDirectory* directory,
+                           InfXmlConnection* conn,
+                           InfdDirectoryNode* node,
+                           xmlNodePtr reply_xml)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  gboolean removed;
-
-  GSList* item;
-  GSList* next;
-  InfdDirectorySyncIn* sync_in;
-  InfdDirectorySubreq* request;
 
-  g_return_if_fail(INFD_IS_DIRECTORY(directory));
-  g_return_if_fail(node != NULL);
+  InfdDirectoryNode* child;
+  InfdDirectoryConnectionInfo* info;
+  InfAclAccountId account;
+  const InfAclSheet* sheet;
+  xmlNodePtr child_xml;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  info = g_hash_table_lookup(priv->connections, conn);
+  g_assert(info != NULL);
+  account = info->account_id;
 
-  switch(node->type)
+  if(infd_directory_enforce_single_acl(directory, conn, node, TRUE) == TRUE)
   {
-  case INFD_DIRECTORY_NODE_SUBDIRECTORY:
-    g_slist_free(node->shared.subdir.connections);
+    g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
 
-    /* Free child nodes */
-    if(node->shared.subdir.explored == TRUE)
+    for(child = node->shared.subdir.child; child != NULL; child = child->next)
     {
-      while(node->shared.subdir.child != NULL)
+      infd_directory_enforce_acl(directory, conn, child, reply_xml);
+    }
+  }
+
+  /* If this node has ACLs set for the new account, then add this to the
+   * reply XML, so that the remote host knows its own permissions
+   * on the node */
+  if(reply_xml != NULL)
+  {
+    if(node->acl != NULL)
+    {
+      /* TODO: This is only necessary if the client has not queried the
+       * full ACL for this node. */
+      sheet = inf_acl_sheet_set_find_const_sheet(node->acl, account);
+      if(sheet != NULL)
       {
-        infd_directory_node_free(directory, node->shared.subdir.child);
+        child_xml = xmlNewChild(reply_xml, NULL, (const xmlChar*)"acl", NULL);
+        inf_xml_util_set_attribute_uint(child_xml, "node-id", node->id);
+        inf_acl_sheet_perms_to_xml(&sheet->mask, &sheet->perms, child_xml);
       }
     }
+  }
+}
 
-    break;
-  case INFD_DIRECTORY_NODE_NOTE:
-    /* Sessions must have been explicitely unlinked before; we might still
-     * have weak references though. */
-    g_assert(node->shared.note.session == NULL ||
-             node->shared.note.weakref == TRUE);
+static InfdDirectoryTransientAccount*
+infd_directory_lookup_transient_account(InfdDirectory* directory,
+                                        InfAclAccountId account)
+{
+  InfdDirectoryPrivate* priv;
+  guint i;
 
-    if(node->shared.note.session != NULL)
-    {
-      infd_directory_release_session(
-        directory,
-        node,
-        node->shared.note.session
-      );
-    }
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-    break;
-  case INFD_DIRECTORY_NODE_UNKNOWN:
-    /* Nothing to do */
-    break;
-  default:
-    g_assert_not_reached();
-    break;
-  }
+  for(i = 0; i < priv->n_transient_accounts; ++i)
+    if(priv->transient_accounts[i].account.id == account)
+      return &priv->transient_accounts[i];
 
-  if(node->parent != NULL)
-    infd_directory_node_unlink(node);
-  g_slist_free(node->acl_connections);
+  return NULL;
+}
 
-  /* Only clear ACL table after unlink, so that ACL has effect until the very
-   * moment where the node does not exist anymore, to avoid possible races. */
-  if(node->acl != NULL)
-    inf_acl_sheet_set_free(node->acl);
+static InfAclAccount*
+infd_directory_lookup_account(InfdDirectory* directory,
+                              InfAclAccountId account,
+                              guint* transient_index,
+                              GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryTransientAccount* transient;
+  InfAclAccount* result;
+  InfAclAccount* result_copy;
+  guint i;
 
-  /* Remove sync-ins whose parent is gone */
-  for(item = priv->sync_ins; item != NULL; item = next)
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  transient = infd_directory_lookup_transient_account(directory, account);
+  if(transient != NULL)
   {
-    next = item->next;
-    sync_in = (InfdDirectorySyncIn*)item->data;
-    if(sync_in->parent == node)
-      infd_directory_remove_sync_in(directory, sync_in);
+    if(transient_index != NULL)
+      *transient_index = transient - priv->transient_accounts;
+    return inf_acl_account_copy(&transient->account);
   }
 
-  for(item = priv->subscription_requests; item != NULL; item = next)
+  result = NULL;
+  if(priv->account_storage != NULL)
   {
-    next = item->next;
-    request = (InfdDirectorySubreq*)item->data;
+    result = infd_account_storage_lookup_accounts(
+      priv->account_storage,
+      &account,
+      1,
+      error
+    );
 
-    switch(request->type)
-    {
-    case INFD_DIRECTORY_SUBREQ_CHAT:
-      break;
-    case INFD_DIRECTORY_SUBREQ_SESSION:
-      /* Keep subscription requests whose parent is gone. They will be
-       * released upon client reply. */
-      /*if(request->node_id == node->id)
-        infd_directory_remove_subreq(directory, request);*/
-      break;
-    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-      if(request->shared.add_node.parent->id == node->id)
-        request->shared.add_node.parent = NULL;
-      break;
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
-      if(request->shared.sync_in.parent->id == node->id)
-        request->shared.sync_in.parent = NULL;
-      break;
-    default:
-      g_assert_not_reached();
-      break;
-    }
+    if(result == NULL)
+      return NULL;
   }
 
-  removed = g_hash_table_remove(priv->nodes, GUINT_TO_POINTER(node->id));
-  g_assert(removed == TRUE);
+  if(result == NULL || result[0].id == 0)
+  {
+    if(result != NULL)
+      inf_acl_account_array_free(result, 1);
 
-  g_free(node->name);
-  g_slice_free(InfdDirectoryNode, node);
+    return NULL;
+  }
+
+  if(transient_index != NULL)
+    *transient_index = priv->n_transient_accounts;
+
+  /* Note that the return value that we got from
+   * infd_account_storage_lookup_accounts() is actually an array, and
+   * therefore needs to be freed with inf_acl_account_array_free(). However,
+   * we only return a single account that we want to be freed with
+   * inf_acl_account_free(). Therefore, we are making a copy here -- note
+   * that the two free functions are in fact different if GSlice is enabled,
+   * since an array of InfAclAccounts in allocated with g_malloc, while a
+   * single InfAclAccount is allocated with GSlice. */
+  result_copy = inf_acl_account_copy(result);
+  inf_acl_account_array_free(result, 1);
+
+  return result_copy;
 }
 
-static void
-infd_directory_node_remove_connection(InfdDirectoryNode* node,
-                                      InfXmlConnection* connection)
+static InfAclAccountId
+infd_directory_lookup_account_by_name(InfdDirectory* directory,
+                                      const gchar* name,
+                                      GError** error)
 {
-  InfdDirectoryNode* child;
-  GSList* item;
+  InfdDirectoryPrivate* priv;
+  InfAclAccount* accounts;
+  guint n_accounts;
+  guint i;
+  GError* local_error;
+  InfAclAccountId account_id;
 
-  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
-  g_assert(node->shared.subdir.explored == TRUE);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  item = g_slist_find(node->shared.subdir.connections, connection);
+  for(i = 0; i < priv->n_transient_accounts; ++i)
+    if(priv->transient_accounts[i].account.name != NULL)
+      if(strcmp(name, priv->transient_accounts[i].account.name) == 0)
+        return priv->transient_accounts[i].account.id;
 
-  /* Note that if the connection is not in this node's connection list,
-   * then it cannot be in a child's list either. */
-  if(item != NULL)
+  account_id = 0;
+  if(priv->account_storage != NULL)
   {
-    node->shared.subdir.connections = g_slist_delete_link(
-      node->shared.subdir.connections,
-      item
+    local_error = NULL;
+
+    accounts = infd_account_storage_lookup_accounts_by_name(
+      priv->account_storage,
+      name,
+      &n_accounts,
+      &local_error
     );
 
-    if(node->shared.subdir.explored == TRUE)
+    if(local_error != NULL)
     {
-      for(child = node->shared.subdir.child;
-          child != NULL;
-          child = child->next)
-      {
-        if(child->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
-           child->shared.subdir.explored == TRUE)
-        {
-          infd_directory_node_remove_connection(child, connection);
-        }
-      }
+      g_propagate_error(error, local_error);
+      return 0;
     }
-    else
+
+    if(n_accounts > 0)
     {
-      g_assert(node->shared.subdir.connections == NULL);
+      account_id = accounts[0].id;
+      inf_acl_account_array_free(accounts, n_accounts);
     }
   }
 
-  /* Remove the connection from ACL connections of ourselves and all
-   * children. Do not recurse, since the recursion has taken place
-   * in the loop above only for explored subdirectories. */
-  node->acl_connections = g_slist_remove(node->acl_connections, connection);
-  for(child = node->shared.subdir.child;
-      child != NULL;
-      child = child->next)
-  {
-    child->acl_connections = g_slist_remove(
-      child->acl_connections,
-      connection
-    );
-  }
+  return account_id;
 }
 
-/*
- * Permission enforcement
- */
-
-/* Return the permissions needed to create a new node */
 static void
-infd_directory_get_add_node_permissions(InfdDirectory* directory,
-                                        InfAclMask* out,
-                                        gboolean subdirectory,
-                                        gboolean initial_subscribe,
-                                        gboolean sync_in,
-                                        const InfAclSheetSet* sheet_set)
-{
-  if(subdirectory)
-    inf_acl_mask_set1(out, INF_ACL_CAN_ADD_SUBDIRECTORY);
-  else
-    inf_acl_mask_set1(out, INF_ACL_CAN_ADD_DOCUMENT);
-
-  if(initial_subscribe == TRUE)
-    inf_acl_mask_or1(out, INF_ACL_CAN_SUBSCRIBE_SESSION);
-  if(sync_in == TRUE)
-    inf_acl_mask_or1(out, INF_ACL_CAN_SYNC_IN);
-
-  if(sheet_set != NULL && sheet_set->n_sheets > 0)
-    inf_acl_mask_or1(out, INF_ACL_CAN_SET_ACL);
-}
-
-/* Enforces the ACL on the given node. If the exploration permission is no
- * longer given for this node, then explorations and subscriptions are also
- * removed from all children. Returns whether node is still explored by
- * the connection.
- *
- * Note this function does not enforce all ACLs recursively! */
-static gboolean
-infd_directory_enforce_single_acl(InfdDirectory* directory,
+infd_directory_change_acl_account(InfdDirectory* directory,
                                   InfXmlConnection* connection,
-                                  InfdDirectoryNode* node,
-                                  gboolean is_explored)
+                                  const InfAclAccount* account)
 {
   InfdDirectoryPrivate* priv;
   InfdDirectoryConnectionInfo* info;
-  InfAclAccountId account;
-
-  InfBrowser* browser;
-  InfBrowserIter iter;
-  InfAclMask mask;
-  xmlNodePtr child_xml;
-  InfdDirectoryNode* child;
-  InfdSessionProxy* proxy;
-  GSList* item;
-  GSList* next;
-  InfdDirectorySubreq* subreq;
-  InfdDirectorySyncIn* sync_in;
-  InfXmlConnection* sync_in_connection;
-  gboolean retval;
+  InfAclAccountId default_id;
+  gboolean is_default_account;
+  xmlNodePtr xml;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  /* Set new account */
   info = g_hash_table_lookup(priv->connections, connection);
   g_assert(info != NULL);
-  account = info->account_id;
-
-  browser = INF_BROWSER(directory);
-  iter.node = node;
-  iter.node_id = node->id;
-
-  retval = TRUE;
-  if(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY)
-  {
-    if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
-    {
-      /* Remove exploration if new account does not have permission, or
-       * if one of the parent folders is no longer explored */
-      inf_acl_mask_set1(&mask, INF_ACL_CAN_EXPLORE_NODE);
-      if(!is_explored ||
-         !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
-      {
-        node->shared.subdir.connections =
-          g_slist_remove(node->shared.subdir.connections, connection);
-        retval = FALSE;
 
-        /* If there are subscription requests to create a node into this node
-         * from this connection, then mark them as canceled, so that we don't
-         * create the node in handle_subscribe_ack(). The client might
-         * actually create the node if it does not register the new ACL early
-         * enough, but that's okay because it removes it again as
-         * soon as it does. */
-        for(item = priv->subscription_requests; item != NULL; item = next)
-        {
-          next = item->next;
-          subreq = (InfdDirectorySubreq*)item->data;
+  if(info->account_id == account->id) return;
+  info->account_id = account->id;
 
-          switch(subreq->type)
-          {
-          case INFD_DIRECTORY_SUBREQ_CHAT:
-          case INFD_DIRECTORY_SUBREQ_SESSION:
-            break;
-          case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-            if(subreq->connection == connection)
-              if(subreq->shared.add_node.parent->id == node->id)
-                subreq->shared.add_node.parent = NULL;
-            break;
-          case INFD_DIRECTORY_SUBREQ_SYNC_IN:
-          case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
-            if(subreq->connection == connection)
-              if(subreq->shared.sync_in.parent->id == node->id)
-                subreq->shared.sync_in.parent = NULL;
-            break;
-          default:
-            g_assert_not_reached();
-            break;
-          }
-        }
+  /* Check whether we need to transfer ACLs for the new account to the
+   * connection. */
+  default_id = inf_acl_account_id_from_string("default");
+  is_default_account = FALSE;
+  if(account->id == default_id)
+    is_default_account = TRUE;
 
-        /* Remove sync-ins whose parent is gone */
-        for(item = priv->sync_ins; item != NULL; item = next)
-        {
-          next = item->next;
-          sync_in = (InfdDirectorySyncIn*)item->data;
+  xml = xmlNewNode(NULL, (const xmlChar*)"change-acl-account");
+  inf_acl_account_to_xml(account, xml);
 
-          g_object_get(
-            G_OBJECT(sync_in->request),
-            "requestor", &sync_in_connection,
-            NULL
-          );
+  /* Enforce the ACLs of the new account on the connection. While
+   * we do this, we also fill in the ACL sheets for all nodes of the
+   * new connection, to be transferred. */
+  infd_directory_enforce_acl(
+    directory,
+    connection,
+    priv->root,
+    is_default_account ? NULL : xml
+  );
 
-          if(sync_in_connection == connection && sync_in->parent == node)
-            infd_directory_remove_sync_in(directory, sync_in);
+  /* Send to client */
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    xml
+  );
+}
 
-          g_object_unref(sync_in_connection);
-        }
+static gnutls_x509_crt_t
+infd_directory_create_certificate_from_crq(InfdDirectory* directory,
+                                           gnutls_x509_crq_t crq,
+                                           guint64 validity,
+                                           GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  gnutls_x509_crt_t cert;
+  int res;
+  guint64 timestamp;
+  gchar serial_buffer[5];
 
-        for(child = node->shared.subdir.child;
-            child != NULL;
-            child = child->next)
-        {
-          infd_directory_enforce_single_acl(
-            directory,
-            connection,
-            child,
-            FALSE
-          );
-        }
-      }
-    }
-    else
-    {
-      retval = FALSE;
-    }
-  }
-  else
-  {
-    retval = FALSE;
-    if(node->type == INFD_DIRECTORY_NODE_NOTE)
-    {
-      proxy = node->shared.note.session;
-      if(proxy != NULL)
-      {
-        if(infd_session_proxy_is_subscribed(proxy, connection))
-        {
-          /* Remove subscription if no longer allowed, or if parent directory
-           * is no longer explored */
-          inf_acl_mask_set1(&mask, INF_ACL_CAN_SUBSCRIBE_SESSION);
-          if(!is_explored ||
-             !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
-          {
-            infd_session_proxy_unsubscribe(proxy, connection);
-          }
-          else
-          {
-            /* TODO: Remove joined users if join-user
-             * permissions are no longer granted. */
-          }
-        }
-      }
-    }
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  if(priv->certificate == NULL || priv->private_key == NULL)
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("Server does not support issuing certificates")
+    );
+
+    return NULL;
   }
 
-  if(g_slist_find(node->acl_connections, connection) != NULL)
+  res = gnutls_x509_crt_init(&cert);
+  if(res != GNUTLS_E_SUCCESS)
   {
-    inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACL);
-    if(!is_explored ||
-       !inf_browser_check_acl(browser, &iter, account, &mask, NULL))
-    {
-      node->acl_connections =
-        g_slist_remove(node->acl_connections, connection);
-    }
+    inf_gnutls_set_error(error, res);
+    return NULL;
   }
 
-  return retval;
-}
+  res = gnutls_x509_crt_set_crq(cert, crq);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
 
-/* Enforce ACL for the given node and all its children for info. If
- * reply_xml is set, then fill it with information about ACL for all
- * nodes for info's account. This is used when a connection is
- * switching accounts. */
-static void
-infd_directory_enforce_acl(InfdDirectory* directory,
-                           InfXmlConnection* conn,
-                           InfdDirectoryNode* node,
-                           xmlNodePtr reply_xml)
-{
-  InfdDirectoryPrivate* priv;
+  timestamp = time(NULL);
+  serial_buffer[4] = (timestamp      ) & 0xff;
+  serial_buffer[3] = (timestamp >>  8) & 0xff;
+  serial_buffer[2] = (timestamp >> 16) & 0xff;
+  serial_buffer[1] = (timestamp >> 24) & 0xff;
+  serial_buffer[0] = (timestamp >> 32) & 0xff;
 
-  InfdDirectoryNode* child;
-  InfdDirectoryConnectionInfo* info;
-  InfAclAccountId account;
-  const InfAclSheet* sheet;
-  xmlNodePtr child_xml;
+  res = gnutls_x509_crt_set_serial(cert, serial_buffer, 5);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  info = g_hash_table_lookup(priv->connections, conn);
-  g_assert(info != NULL);
-  account = info->account_id;
+  /* Set the activation time a bit in the past, so that if the client
+   * checks the certificate and has its clock slightly offset it doesn't
+   * find the certificate invalid. */
+  res = gnutls_x509_crt_set_activation_time(cert, timestamp - DAYS / 10);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
 
-  if(infd_directory_enforce_single_acl(directory, conn, node, TRUE) == TRUE)
+  res = gnutls_x509_crt_set_expiration_time(cert, timestamp + validity);
+  if(res != GNUTLS_E_SUCCESS)
   {
-    g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
 
-    for(child = node->shared.subdir.child; child != NULL; child = child->next)
-    {
-      infd_directory_enforce_acl(directory, conn, child, reply_xml);
-    }
+  res = gnutls_x509_crt_set_basic_constraints(cert, 0, -1);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
   }
 
-  /* If this node has ACLs set for the new account, then add this to the
-   * reply XML, so that the remote host knows its own permissions
-   * on the node */
-  if(reply_xml != NULL)
+  res = gnutls_x509_crt_set_key_usage(cert, GNUTLS_KEY_DIGITAL_SIGNATURE);
+  if(res != GNUTLS_E_SUCCESS)
   {
-    if(node->acl != NULL)
-    {
-      /* TODO: This is only necessary if the client has not queried the
-       * full ACL for this node. */
-      sheet = inf_acl_sheet_set_find_const_sheet(node->acl, account);
-      if(sheet != NULL)
-      {
-        child_xml = xmlNewChild(reply_xml, NULL, (const xmlChar*)"acl", NULL);
-        inf_xml_util_set_attribute_uint(child_xml, "node-id", node->id);
-        inf_acl_sheet_perms_to_xml(&sheet->mask, &sheet->perms, child_xml);
-      }
-    }
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
+
+  res = gnutls_x509_crt_set_version(cert, 3);
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
+  }
+
+  /* The certificate is now set up, we can sign it. */
+  res = gnutls_x509_crt_sign2(
+    cert,
+    inf_certificate_chain_get_own_certificate(priv->certificate),
+    priv->private_key,
+    GNUTLS_DIG_SHA256,
+    0
+  );
+
+  if(res != GNUTLS_E_SUCCESS)
+  {
+    gnutls_x509_crt_deinit(cert);
+    inf_gnutls_set_error(error, res);
+    return NULL;
   }
+
+  return cert;
 }
 
-static InfdDirectoryTransientAccount*
-infd_directory_lookup_transient_account(InfdDirectory* directory,
-                                        InfAclAccountId account)
+static gchar*
+infd_directory_account_name_from_certificate(gnutls_x509_crt_t cert,
+                                             GError** error)
 {
-  InfdDirectoryPrivate* priv;
-  guint i;
+  gchar* name;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  /* Check that a common name is set in the certificate. Without a common
+   * name, we cannot associate the certificate to an account. */
+  name = inf_cert_util_get_dn_by_oid(cert, GNUTLS_OID_X520_COMMON_NAME, 0);
+  if(name == NULL || name[0] == '\0')
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_INVALID_CERTIFICATE,
+      _("The certificate request has no common name set")
+    );
 
-  for(i = 0; i < priv->n_transient_accounts; ++i)
-    if(priv->transient_accounts[i].account.id == account)
-      return &priv->transient_accounts[i];
+    g_free(name);
+    return NULL;
+  }
 
-  return NULL;
+  return name;
 }
 
-static InfAclAccount*
-infd_directory_lookup_account(InfdDirectory* directory,
-                              InfAclAccountId account,
-                              guint* transient_index,
-                              GError** error)
+static void
+infd_directory_account_storage_account_added_cb(InfdAccountStorage* storage,
+                                                const InfAclAccount* acc,
+                                                gpointer user_data);
+
+static void
+infd_directory_account_storage_account_removed_cb(InfdAccountStorage* storage,
+                                                  const InfAclAccount* acc,
+                                                  gpointer user_data);
+
+static InfAclAccountId
+infd_directory_create_acl_account_with_certificates(InfdDirectory* directory,
+                                                    const gchar* account_name,
+                                                    gboolean transient,
+                                                    gnutls_x509_crt_t* certs,
+                                                    guint n_certs,
+                                                    InfXmlConnection* conn,
+                                                    GError** error)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryTransientAccount* transient;
-  InfAclAccount* result;
-  InfAclAccount* result_copy;
-  guint i;
+  gchar* transient_id_str;
+  InfAclAccountId account_id;
+  InfdDirectoryTransientAccount* transient_account;
+  InfAclAccount* account;
+  InfAclAccount announce_account;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  transient = infd_directory_lookup_transient_account(directory, account);
-  if(transient != NULL)
+  if(transient == TRUE)
   {
-    if(transient_index != NULL)
-      *transient_index = transient - priv->transient_accounts;
-    return inf_acl_account_copy(&transient->account);
+    /* Transient accounts only support one certificate at the moment */
+    g_assert(n_certs <= 1);
+
+    transient_id_str = g_strdup_printf("_transient:%s", account_name);
+    account_id = inf_acl_account_id_from_string(transient_id_str);
+    g_free(transient_id_str);
+
+    transient_account =
+      infd_directory_lookup_transient_account(directory, account_id);
+    if(transient_account != NULL)
+    {
+      g_set_error(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_DUPLICATE_ACCOUNT,
+        _("There is already a transient account with name \"%s\""),
+        account_name
+      );
+
+      return 0;
+    }
+
+    priv->transient_accounts = g_realloc(
+      priv->transient_accounts,
+      (priv->n_transient_accounts + 1) * sizeof(InfdDirectoryTransientAccount)
+    );
+
+    transient_account = &priv->transient_accounts[priv->n_transient_accounts];
+    account = &transient_account->account;
+    ++priv->n_transient_accounts;
+
+    account->id = account_id;
+    account->name = g_strdup(account_name);
+
+    transient_account->dn = NULL;
+    if(n_certs > 0)
+      transient_account->dn = inf_cert_util_get_dn(certs[0]);
   }
+  else if(priv->account_storage != NULL)
+  {
+    /* Note that we cannot rely on the account storage to provide proper
+     * notifications when adding the account to the storage, since
+     * implementation are not required to support notifications. Therefore,
+     * block our signal handlers and then announce explicitly. */
+    inf_signal_handlers_block_by_func(
+      G_OBJECT(priv->account_storage),
+      G_CALLBACK(infd_directory_account_storage_account_added_cb),
+      directory
+    );
 
-  result = NULL;
-  if(priv->account_storage != NULL)
-  {
-    result = infd_account_storage_lookup_accounts(
+    account_id = infd_account_storage_add_account(
       priv->account_storage,
-      &account,
-      1,
+      account_name,
+      certs,
+      n_certs,
+      NULL,
       error
     );
 
-    if(result == NULL)
-      return NULL;
-  }
+    inf_signal_handlers_unblock_by_func(
+      G_OBJECT(priv->account_storage),
+      G_CALLBACK(infd_directory_account_storage_account_added_cb),
+      directory
+    );
 
-  if(result == NULL || result[0].id == 0)
-  {
-    if(result != NULL)
-      inf_acl_account_array_free(result, 1);
+    if(account_id == 0)
+      return 0;
 
-    return NULL;
+    announce_account.id = account_id;
+    announce_account.name = (gchar*)account_name;
+    account = &announce_account;
   }
+  else
+  {
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("This server does not support creating accounts")
+    );
 
-  if(transient_index != NULL)
-    *transient_index = priv->n_transient_accounts;
-
-  /* Note that the return value that we got from
-   * infd_account_storage_lookup_accounts() is actually an array, and
-   * therefore needs to be freed with inf_acl_account_array_free(). However,
-   * we only return a single account that we want to be freed with
-   * inf_acl_account_free(). Therefore, we are making a copy here -- note
-   * that the two free functions are in fact different if GSlice is enabled,
-   * since an array of InfAclAccounts in allocated with g_malloc, while a
-   * single InfAclAccount is allocated with GSlice. */
-  result_copy = inf_acl_account_copy(result);
-  inf_acl_account_array_free(result, 1);
+    return 0;
+  }
 
-  return result_copy;
+  infd_directory_announce_acl_account(directory, account, conn);
+  return account_id;
 }
 
-static InfAclAccountId
-infd_directory_lookup_account_by_name(InfdDirectory* directory,
-                                      const gchar* name,
-                                      GError** error)
+/* If connection is set, make sure to send reply to this connection,
+ * even if it would normally not be notified. Don't actually remove, just
+ * announce and cleanup data structures. */
+static void
+infd_directory_cleanup_acl_account(InfdDirectory* directory,
+                                   const InfAclAccount* account,
+                                   gboolean cleanup_acls,
+                                   InfXmlConnection* connection,
+                                   const gchar* seq,
+                                   InfdRequest* request)
 {
   InfdDirectoryPrivate* priv;
-  InfAclAccount* accounts;
-  guint n_accounts;
-  guint i;
-  GError* local_error;
+
+  InfdDirectoryConnectionInfo* info;
   InfAclAccountId account_id;
+  InfAclAccountId default_id;
+
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  InfAclMask mask;
+
+  GHashTableIter hash_iter;
+  gpointer key;
+  gpointer value;
+  GHashTable* table;
+
+  GSList* notify_connections;
+  GSList* item;
+  xmlNodePtr xml;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  for(i = 0; i < priv->n_transient_accounts; ++i)
-    if(priv->transient_accounts[i].account.name != NULL)
-      if(strcmp(name, priv->transient_accounts[i].account.name) == 0)
-        return priv->transient_accounts[i].account.id;
+  account_id = account->id;
+  default_id = inf_acl_account_id_from_string("default");
+  g_assert(account_id != default_id);
 
-  account_id = 0;
-  if(priv->account_storage != NULL)
+  browser = INF_BROWSER(directory);
+  iter.node = priv->root;
+  iter.node_id = priv->root->id;
+  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+
+  /* First, demote all connections with this account to the default account,
+   * and make a list of connections that need to be notified about the removed
+   * account. */
+  notify_connections = NULL;
+  g_hash_table_iter_init(&hash_iter, priv->connections);
+  while(g_hash_table_iter_next(&hash_iter, &key, &value))
   {
-    local_error = NULL;
+    info = (InfdDirectoryConnectionInfo*)value;
+    if(info->account_id == account_id)
+    {
+      info->account_id = inf_acl_account_id_from_string("default");
 
-    accounts = infd_account_storage_lookup_accounts_by_name(
-      priv->account_storage,
-      name,
-      &n_accounts,
-      &local_error
-    );
+      infd_directory_enforce_acl(
+        directory,
+        (InfXmlConnection*)key,
+        priv->root,
+        NULL
+      );
 
-    if(local_error != NULL)
-    {
-      g_propagate_error(error, local_error);
-      return 0;
+      notify_connections = g_slist_prepend(notify_connections, key);
     }
-
-    if(n_accounts > 0)
+    else
     {
-      account_id = accounts[0].id;
-      inf_acl_account_array_free(accounts, n_accounts);
+      if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL))
+      {
+        /* Notify if CAN_QUERY_ACCOUNT_LIST permission is set */
+        notify_connections = g_slist_prepend(notify_connections, key);
+      }
     }
   }
 
-  return account_id;
-}
+  if(cleanup_acls == TRUE)
+  {
+    /* Next, remove this account from all ACL sheets. Note that we do not do
+     * this for sheets that we do not have explored yet. The permissions will
+     * be dropped automatically as soon as the node is explored. Note that
+     * this is a bit of a security issue at the moment: if an account with the
+     * previous ID is re-created, then the existing permissions of
+     * non-explored nodes are taken for the new account. Therefore, account
+     * storage backends should try hard to always produce unique IDs. */
+    table = g_hash_table_new(NULL, NULL);
 
-static void
-infd_directory_change_acl_account(InfdDirectory* directory,
-                                  InfXmlConnection* connection,
-                                  const InfAclAccount* account)
-{
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryConnectionInfo* info;
-  InfAclAccountId default_id;
-  gboolean is_default_account;
-  xmlNodePtr xml;
+    g_hash_table_insert(
+      table,
+      INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
+      GBOOLEAN_TO_POINTER(FALSE)
+    );
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+    infd_directory_verify_all_acls(directory, table, FALSE);
+    g_hash_table_destroy(table);
+  }
 
-  /* Set new account */
-  info = g_hash_table_lookup(priv->connections, connection);
-  g_assert(info != NULL);
+  /* Then, send requests */
+  if(connection != NULL)
+    if(g_slist_find(notify_connections, connection) == NULL)
+      notify_connections = g_slist_prepend(notify_connections, connection);
 
-  if(info->account_id == account->id) return;
-  info->account_id = account->id;
+  if(notify_connections != NULL)
+  {
+    xml = xmlNewNode(NULL, (const xmlChar*)"remove-acl-account");
+    inf_xml_util_set_attribute(
+      xml,
+      "id",
+      inf_acl_account_id_to_string(account_id)
+    );
 
-  /* Check whether we need to transfer ACLs for the new account to the
-   * connection. */
-  default_id = inf_acl_account_id_from_string("default");
-  is_default_account = FALSE;
-  if(account->id == default_id)
-    is_default_account = TRUE;
+    if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"change-acl-account");
-  inf_acl_account_to_xml(account, xml);
+    for(item = notify_connections; item != NULL; item = item->next)
+    {
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        (InfXmlConnection*)item->data,
+        (item->next == NULL) ? xml : xmlCopyNode(xml, 1)
+      );
+    }
+  }
 
-  /* Enforce the ACLs of the new account on the connection. While
-   * we do this, we also fill in the ACL sheets for all nodes of the
-   * new connection, to be transferred. */
-  infd_directory_enforce_acl(
-    directory,
-    connection,
-    priv->root,
-    is_default_account ? NULL : xml
-  );
+  g_slist_free(notify_connections);
 
-  /* Send to client */
-  inf_communication_group_send_message(
-    INF_COMMUNICATION_GROUP(priv->group),
-    connection,
-    xml
+  /* Then, make callback */
+  if(request != NULL)
+  {
+    inf_request_finish(
+      INF_REQUEST(request),
+      inf_request_result_make_remove_acl_account(
+        INF_BROWSER(directory),
+        account
+      )
+    );
+  }
+
+  inf_browser_acl_account_removed(
+    INF_BROWSER(directory),
+    account,
+    NULL
   );
 }
 
-static gnutls_x509_crt_t
-infd_directory_create_certificate_from_crq(InfdDirectory* directory,
-                                           gnutls_x509_crq_t crq,
-                                           guint64 validity,
-                                           GError** error)
+static gboolean
+infd_directory_remove_acl_account(InfdDirectory* directory,
+                                  InfAclAccountId account_id,
+                                  InfXmlConnection* connection,
+                                  const gchar* seq,
+                                  InfdRequest* request,
+                                  GError** error)
 {
   InfdDirectoryPrivate* priv;
-  gnutls_x509_crt_t cert;
-  int res;
-  guint64 timestamp;
-  gchar serial_buffer[5];
+  InfAclAccountId default_id;
+  InfAclAccount* account;
+  GError* local_error;
+  guint transient_index;
+  gboolean account_removed;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(priv->certificate == NULL || priv->private_key == NULL)
+  default_id = inf_acl_account_id_from_string("default");
+  if(account_id == default_id)
   {
     g_set_error_literal(
       error,
       inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
-      _("Server does not support issuing certificates")
+      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
+      _("The default account cannot be removed")
     );
 
-    return NULL;
+    return FALSE;
   }
 
-  res = gnutls_x509_crt_init(&cert);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    inf_gnutls_set_error(error, res);
-    return NULL;
-  }
+  local_error = NULL;
 
-  res = gnutls_x509_crt_set_crq(cert, crq);
-  if(res != GNUTLS_E_SUCCESS)
+  account = infd_directory_lookup_account(
+    directory,
+    account_id,
+    &transient_index,
+    &local_error
+  );
+  
+  if(local_error != NULL)
   {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
+    g_propagate_error(error, local_error);
+    return FALSE;
   }
 
-  timestamp = time(NULL);
-  serial_buffer[4] = (timestamp      ) & 0xff;
-  serial_buffer[3] = (timestamp >>  8) & 0xff;
-  serial_buffer[2] = (timestamp >> 16) & 0xff;
-  serial_buffer[1] = (timestamp >> 24) & 0xff;
-  serial_buffer[0] = (timestamp >> 32) & 0xff;
-
-  res = gnutls_x509_crt_set_serial(cert, serial_buffer, 5);
-  if(res != GNUTLS_E_SUCCESS)
+  if(account == NULL)
   {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
-  }
+    g_set_error(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
+      _("There is no such account with ID \"%s\""),
+      inf_acl_account_id_to_string(account_id)
+    );
 
-  /* Set the activation time a bit in the past, so that if the client
-   * checks the certificate and has its clock slightly offset it doesn't
-   * find the certificate invalid. */
-  res = gnutls_x509_crt_set_activation_time(cert, timestamp - DAYS / 10);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
+    return FALSE;
   }
 
-  res = gnutls_x509_crt_set_expiration_time(cert, timestamp + validity);
-  if(res != GNUTLS_E_SUCCESS)
+  if(transient_index < priv->n_transient_accounts)
   {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
-  }
+    /* Remove a transient account */
+    g_free(priv->transient_accounts[transient_index].account.name);
+    g_free(priv->transient_accounts[transient_index].dn);
 
-  res = gnutls_x509_crt_set_basic_constraints(cert, 0, -1);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
-  }
+    priv->transient_accounts[transient_index] =
+      priv->transient_accounts[priv->n_transient_accounts - 1];
 
-  res = gnutls_x509_crt_set_key_usage(cert, GNUTLS_KEY_DIGITAL_SIGNATURE);
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
+    priv->transient_accounts = g_realloc(
+      priv->transient_accounts,
+      (priv->n_transient_accounts - 1) * sizeof(InfdDirectoryTransientAccount)
+    );
+
+    --priv->n_transient_accounts;
   }
+  else if(priv->account_storage != NULL)
+  {
+    /* Note that we cannot rely on the account storage to provide proper
+     * notifications when adding the account to the storage, since
+     * implementation are not required to support notifications. Therefore,
+     * block our signal handlers and then announce explicitly. */
+    inf_signal_handlers_block_by_func(
+      G_OBJECT(priv->account_storage),
+      G_CALLBACK(infd_directory_account_storage_account_removed_cb),
+      directory
+    );
 
-  res = gnutls_x509_crt_set_version(cert, 3);
-  if(res != GNUTLS_E_SUCCESS)
+    account_removed = infd_account_storage_remove_account(
+      priv->account_storage,
+      account_id,
+      error
+    );
+
+    inf_signal_handlers_unblock_by_func(
+      G_OBJECT(priv->account_storage),
+      G_CALLBACK(infd_directory_account_storage_account_removed_cb),
+      directory
+    );
+
+    if(account_removed == FALSE)
+      return FALSE;
+  }
+  else
   {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
+    g_set_error_literal(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
+      _("This server does not support removing accounts")
+    );
+
+    return FALSE;
   }
 
-  /* The certificate is now set up, we can sign it. */
-  res = gnutls_x509_crt_sign2(
-    cert,
-    inf_certificate_chain_get_own_certificate(priv->certificate),
-    priv->private_key,
-    GNUTLS_DIG_SHA256,
-    0
+  infd_directory_cleanup_acl_account(
+    directory,
+    account,
+    TRUE,
+    connection,
+    seq,
+    request
   );
 
-  if(res != GNUTLS_E_SUCCESS)
-  {
-    gnutls_x509_crt_deinit(cert);
-    inf_gnutls_set_error(error, res);
-    return NULL;
-  }
+  inf_acl_account_free(account);
+  return TRUE;
+}
 
-  return cert;
+/*
+ * Node synchronization.
+ */
+
+static xmlNodePtr
+infd_directory_node_desc_register_to_xml(const gchar* node_name,
+                                         guint node_id,
+                                         InfdDirectoryNode* parent,
+                                         const gchar* plugin_type,
+                                         const gchar* name)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)node_name);
+
+  inf_xml_util_set_attribute_uint(xml, "id", node_id);
+  inf_xml_util_set_attribute_uint(xml, "parent", parent->id);
+  inf_xml_util_set_attribute(xml, "name", name);
+  inf_xml_util_set_attribute(xml, "type", plugin_type);
+
+  return xml;
 }
 
-static gchar*
-infd_directory_account_name_from_certificate(gnutls_x509_crt_t cert,
-                                             GError** error)
+/* Creates XML request to tell someone about a new node */
+static xmlNodePtr
+infd_directory_node_register_to_xml(InfdDirectoryNode* node)
 {
-  gchar* name;
+  const InfdNotePlugin* plugin;
+  const gchar* plugin_type;
 
-  /* Check that a common name is set in the certificate. Without a common
-   * name, we cannot associate the certificate to an account. */
-  name = inf_cert_util_get_dn_by_oid(cert, GNUTLS_OID_X520_COMMON_NAME, 0);
-  if(name == NULL || name[0] == '\0')
-  {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_INVALID_CERTIFICATE,
-      _("The certificate request has no common name set")
-    );
+  g_assert(node->parent != NULL);
 
-    g_free(name);
-    return NULL;
+  switch(node->type)
+  {
+  case INFD_DIRECTORY_NODE_SUBDIRECTORY:
+    plugin_type = "InfSubdirectory";
+    break;
+  case INFD_DIRECTORY_NODE_NOTE:
+    plugin_type = node->shared.note.plugin->note_type;
+    break;
+  case INFD_DIRECTORY_NODE_UNKNOWN:
+    plugin_type = g_quark_to_string(node->shared.unknown.type);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
   }
 
-  return name;
+  return infd_directory_node_desc_register_to_xml(
+    "add-node",
+    node->id,
+    node->parent,
+    plugin_type,
+    node->name
+  );
 }
 
-static void
-infd_directory_account_storage_account_added_cb(InfdAccountStorage* storage,
-                                                const InfAclAccount* acc,
-                                                gpointer user_data);
+/* Creates XML request to tell someone about a removed node */
+static xmlNodePtr
+infd_directory_node_unregister_to_xml(InfdDirectoryNode* node)
+{
+  xmlNodePtr xml;
+  gchar id_buf[16];
 
-static void
-infd_directory_account_storage_account_removed_cb(InfdAccountStorage* storage,
-                                                  const InfAclAccount* acc,
-                                                  gpointer user_data);
+  sprintf(id_buf, "%u", node->id);
 
-static InfAclAccountId
-infd_directory_create_acl_account_with_certificates(InfdDirectory* directory,
-                                                    const gchar* account_name,
-                                                    gboolean transient,
-                                                    gnutls_x509_crt_t* certs,
-                                                    guint n_certs,
-                                                    InfXmlConnection* conn,
-                                                    GError** error)
+  xml = xmlNewNode(NULL, (const xmlChar*)"remove-node");
+  xmlNewProp(xml, (const xmlChar*)"id", (const xmlChar*)id_buf);
+
+  return xml;
+}
+
+static gboolean
+infd_directory_make_seq(InfdDirectory* directory,
+                        InfXmlConnection* connection,
+                        xmlNodePtr xml,
+                        gchar** seq,
+                        GError** error)
 {
   InfdDirectoryPrivate* priv;
-  gchar* transient_id_str;
-  InfAclAccountId account_id;
-  InfdDirectoryTransientAccount* transient_account;
-  InfAclAccount* account;
-  InfAclAccount announce_account;
+  InfdDirectoryConnectionInfo* info;
+  GError* local_error;
+  guint seq_num;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-
-  if(transient == TRUE)
+  local_error = NULL;
+  if(!inf_xml_util_get_attribute_uint(xml, "seq", &seq_num, &local_error))
   {
-    /* Transient accounts only support one certificate at the moment */
-    g_assert(n_certs <= 1);
-
-    transient_id_str = g_strdup_printf("_transient:%s", account_name);
-    account_id = inf_acl_account_id_from_string(transient_id_str);
-    g_free(transient_id_str);
-
-    transient_account =
-      infd_directory_lookup_transient_account(directory, account_id);
-    if(transient_account != NULL)
+    if(local_error)
     {
-      g_set_error(
-        error,
-        inf_directory_error_quark(),
-        INF_DIRECTORY_ERROR_DUPLICATE_ACCOUNT,
-        _("There is already a transient account with name \"%s\""),
-        account_name
-      );
-
-      return 0;
+      g_propagate_error(error, local_error);
+      return FALSE;
     }
 
-    priv->transient_accounts = g_realloc(
-      priv->transient_accounts,
-      (priv->n_transient_accounts + 1) * sizeof(InfdDirectoryTransientAccount)
-    );
-
-    transient_account = &priv->transient_accounts[priv->n_transient_accounts];
-    account = &transient_account->account;
-    ++priv->n_transient_accounts;
+    *seq = NULL;
+    return TRUE;
+  }
 
-    account->id = account_id;
-    account->name = g_strdup(account_name);
+  info = g_hash_table_lookup(priv->connections, connection);
+  g_assert(info != NULL);
 
-    transient_account->dn = NULL;
-    if(n_certs > 0)
-      transient_account->dn = inf_cert_util_get_dn(certs[0]);
-  }
-  else if(priv->account_storage != NULL)
-  {
-    /* Note that we cannot rely on the account storage to provide proper
-     * notifications when adding the account to the storage, since
-     * implementation are not required to support notifications. Therefore,
-     * block our signal handlers and then announce explicitly. */
-    inf_signal_handlers_block_by_func(
-      G_OBJECT(priv->account_storage),
-      G_CALLBACK(infd_directory_account_storage_account_added_cb),
-      directory
-    );
+  *seq = g_strdup_printf("%u/%u", info->seq_id, seq_num);
+  return TRUE;
+}
 
-    account_id = infd_account_storage_add_account(
-      priv->account_storage,
-      account_name,
-      certs,
-      n_certs,
-      NULL,
-      error
-    );
+/* Tells connection that the request xml failed with the given error */
+static void
+infd_directory_send_request_failed(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   const xmlNodePtr xml,
+                                   const GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  xmlNodePtr reply_xml;
+  gchar* seq;
 
-    inf_signal_handlers_unblock_by_func(
-      G_OBJECT(priv->account_storage),
-      G_CALLBACK(infd_directory_account_storage_account_added_cb),
-      directory
-    );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-    if(account_id == 0)
-      return 0;
+  /* TODO: If error is not from the InfDirectoryError error domain, the
+   * client cannot reconstruct the error because he possibly does not know
+   * the error domain (it might even come from a storage plugin). */
+  if(!infd_directory_make_seq(directory, connection, xml, &seq, NULL))
+    seq = NULL;
 
-    announce_account.id = account_id;
-    announce_account.name = (gchar*)account_name;
-    account = &announce_account;
-  }
-  else
-  {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
-      _("This server does not support creating accounts")
-    );
+  /* An error happened, so tell the client that the request failed and
+   * what has gone wrong. */
+  reply_xml = inf_xml_util_new_node_from_error(
+    (GError*)error,
+    NULL,
+    "request-failed"
+  );
 
-    return 0;
-  }
+  if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
+  g_free(seq);
 
-  infd_directory_announce_acl_account(directory, account, conn);
-  return account_id;
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(priv->group),
+    connection,
+    reply_xml
+  );
 }
 
-/* If connection is set, make sure to send reply to this connection,
- * even if it would normally not be notified. Don't actually remove, just
- * announce and cleanup data structures. */
+/* Announces the presence of a new node. This is not done in
+ * infd_directory_node_new because we do not want to do this for all
+ * nodes we create (namely not for the root node). */
 static void
-infd_directory_cleanup_acl_account(InfdDirectory* directory,
-                                   const InfAclAccount* account,
-                                   gboolean cleanup_acls,
-                                   InfXmlConnection* connection,
-                                   const gchar* seq,
-                                   InfdRequest* request)
+infd_directory_node_register(InfdDirectory* directory,
+                             InfdDirectoryNode* node,
+                             InfdRequest* request,
+                             InfXmlConnection* except,
+                             const gchar* seq)
 {
   InfdDirectoryPrivate* priv;
-
-  InfdDirectoryConnectionInfo* info;
-  InfAclAccountId account_id;
-  InfAclAccountId default_id;
-
-  InfBrowser* browser;
   InfBrowserIter iter;
-  InfAclMask mask;
-
-  GHashTableIter hash_iter;
-  gpointer key;
-  gpointer value;
-  GHashTable* table;
-
-  GSList* notify_connections;
-  GSList* item;
+  InfdDirectoryConnectionInfo* info;
   xmlNodePtr xml;
+  xmlNodePtr copy_xml;
+  GSList* item;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  account_id = account->id;
-  default_id = inf_acl_account_id_from_string("default");
-  g_assert(account_id != default_id);
+  iter.node_id = node->id;
+  iter.node = node;
 
-  browser = INF_BROWSER(directory);
-  iter.node = priv->root;
-  iter.node_id = priv->root->id;
-  inf_acl_mask_set1(&mask, INF_ACL_CAN_QUERY_ACCOUNT_LIST);
+  inf_browser_node_added(
+    INF_BROWSER(directory),
+    &iter,
+    INF_REQUEST(request)
+  );
 
-  /* First, demote all connections with this account to the default account,
-   * and make a list of connections that need to be notified about the removed
-   * account. */
-  notify_connections = NULL;
-  g_hash_table_iter_init(&hash_iter, priv->connections);
-  while(g_hash_table_iter_next(&hash_iter, &key, &value))
+  xml = infd_directory_node_register_to_xml(node);
+  if(seq != NULL)
+   inf_xml_util_set_attribute(xml, "seq", seq);
+
+  for(item = node->parent->shared.subdir.connections;
+      item != NULL;
+      item = g_slist_next(item))
   {
-    info = (InfdDirectoryConnectionInfo*)value;
-    if(info->account_id == account_id)
+    if(item->data != except)
     {
-      info->account_id = inf_acl_account_id_from_string("default");
+      info = g_hash_table_lookup(priv->connections, item->data);
+      g_assert(info != NULL);
 
-      infd_directory_enforce_acl(
-        directory,
-        (InfXmlConnection*)key,
-        priv->root,
-        NULL
-      );
+      copy_xml = xmlCopyNode(xml, 1);
 
-      notify_connections = g_slist_prepend(notify_connections, key);
-    }
-    else
-    {
-      if(inf_browser_check_acl(browser, &iter, account_id, &mask, NULL))
+      if(node->acl != NULL)
       {
-        /* Notify if CAN_QUERY_ACCOUNT_LIST permission is set */
-        notify_connections = g_slist_prepend(notify_connections, key);
+        infd_directory_acl_sheets_to_xml_for_connection(
+          directory,
+          node->acl_connections,
+          node->acl,
+          INF_XML_CONNECTION(item->data),
+          copy_xml
+        );
       }
-    }
-  }
-
-  if(cleanup_acls == TRUE)
-  {
-    /* Next, remove this account from all ACL sheets. Note that we do not do
-     * this for sheets that we do not have explored yet. The permissions will
-     * be dropped automatically as soon as the node is explored. Note that
-     * this is a bit of a security issue at the moment: if an account with the
-     * previous ID is re-created, then the existing permissions of
-     * non-explored nodes are taken for the new account. Therefore, account
-     * storage backends should try hard to always produce unique IDs. */
-    table = g_hash_table_new(NULL, NULL);
-
-    g_hash_table_insert(
-      table,
-      INF_ACL_ACCOUNT_ID_TO_POINTER(account_id),
-      GBOOLEAN_TO_POINTER(FALSE)
-    );
 
-    infd_directory_verify_all_acls(directory, table, FALSE);
-    g_hash_table_destroy(table);
+      inf_communication_group_send_message(
+        INF_COMMUNICATION_GROUP(priv->group),
+        INF_XML_CONNECTION(item->data),
+        copy_xml
+      );
+    }
   }
 
-  /* Then, send requests */
-  if(connection != NULL)
-    if(g_slist_find(notify_connections, connection) == NULL)
-      notify_connections = g_slist_prepend(notify_connections, connection);
+  xmlFreeNode(xml);
+}
 
-  if(notify_connections != NULL)
-  {
-    xml = xmlNewNode(NULL, (const xmlChar*)"remove-acl-account");
-    inf_xml_util_set_attribute(
-      xml,
-      "id",
-      inf_acl_account_id_to_string(account_id)
-    );
+/* Announces that a node is removed. Again, this is not done in
+ * infd_directory_node_free because we do not want to do this for
+ * every subnode if a subdirectory is freed. */
+static void
+infd_directory_node_unregister(InfdDirectory* directory,
+                               InfdDirectoryNode* node,
+                               InfdRequest* request,
+                               const gchar* seq)
+{
+  InfdDirectoryPrivate* priv;
+  InfBrowserIter iter;
+  xmlNodePtr xml;
+  GSList* item;
 
-    if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  iter.node_id = node->id;
+  iter.node = node;
 
-    for(item = notify_connections; item != NULL; item = item->next)
-    {
-      inf_communication_group_send_message(
-        INF_COMMUNICATION_GROUP(priv->group),
-        (InfXmlConnection*)item->data,
-        (item->next == NULL) ? xml : xmlCopyNode(xml, 1)
-      );
-    }
-  }
+  inf_browser_node_removed(
+    INF_BROWSER(directory),
+    &iter,
+    INF_REQUEST(request)
+  );
 
-  g_slist_free(notify_connections);
+  xml = infd_directory_node_unregister_to_xml(node);
+  if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
 
-  /* Then, make callback */
-  if(request != NULL)
+  for(item = node->parent->shared.subdir.connections;
+      item != NULL;
+      item = g_slist_next(item))
   {
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_remove_acl_account(
-        INF_BROWSER(directory),
-        account
-      )
+    inf_communication_group_send_message(
+      INF_COMMUNICATION_GROUP(priv->group),
+      INF_XML_CONNECTION(item->data),
+      xmlCopyNode(xml, 1)
     );
   }
 
-  inf_browser_acl_account_removed(
-    INF_BROWSER(directory),
-    account,
-    NULL
-  );
+  xmlFreeNode(xml);
 }
 
 static gboolean
-infd_directory_remove_acl_account(InfdDirectory* directory,
-                                  InfAclAccountId account_id,
-                                  InfXmlConnection* connection,
-                                  const gchar* seq,
-                                  InfdRequest* request,
-                                  GError** error)
+infd_directory_node_name_equal(const gchar* name1,
+                               const gchar* name2)
 {
-  InfdDirectoryPrivate* priv;
-  InfAclAccountId default_id;
-  InfAclAccount* account;
-  GError* local_error;
-  guint transient_index;
-  gboolean account_removed;
+  gchar* f1 = g_utf8_casefold(name1, -1);
+  gchar* f2 = g_utf8_casefold(name2, -1);
+  gboolean result = (g_utf8_collate(f1, f2) == 0);
+  g_free(f2);
+  g_free(f1);
+  return result;
+}
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+/*
+ * Sync-In
+ */
 
-  default_id = inf_acl_account_id_from_string("default");
-  if(account_id == default_id)
-  {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
-      _("The default account cannot be removed")
-    );
+static void
+infd_directory_sync_in_synchronization_failed_cb(InfSession* session,
+                                                 InfXmlConnection* connection,
+                                                 const GError* error,
+                                                 gpointer user_data)
+{
+  /* Synchronization failed. We simply remove the sync-in. There is no further
+   * notification required since the synchronization failed on the remote site
+   * as well. */
+  InfdDirectorySyncIn* sync_in;
+  InfdDirectory* directory;
+  InfdRequest* request;
 
-    return FALSE;
-  }
+  sync_in = (InfdDirectorySyncIn*)user_data;
+  directory = sync_in->directory;
+  request = sync_in->request;
 
-  local_error = NULL;
+  infd_directory_lock_workers(directory);
 
-  account = infd_directory_lookup_account(
+  g_object_ref(request);
+  infd_directory_remove_sync_in(directory, sync_in);
+  inf_request_fail(INF_REQUEST(request), error);
+  g_object_unref(request);
+
+  infd_directory_unlock_workers(directory);
+}
+
+static void
+infd_directory_sync_in_synchronization_complete_cb(InfSession* session,
+                                                   InfXmlConnection* conn,
+                                                   gpointer user_data)
+{
+  /* Synchronization done. We can now safely create the node in the directory
+   * tree. */
+  InfdDirectorySyncIn* sync_in;
+  InfdDirectory* directory;
+  const InfdNotePlugin* plugin;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfBrowserIter iter;
+  InfBrowserIter parent;
+  InfdRequest* request;
+  InfdSessionProxy* proxy;
+  gchar* path;
+  gboolean ret;
+  GError* error;
+
+  sync_in = (InfdDirectorySyncIn*)user_data;
+  directory = sync_in->directory;
+  plugin = sync_in->plugin;
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  infd_directory_lock_workers(directory);
+
+  node = infd_directory_node_new_note(
     directory,
-    account_id,
-    &transient_index,
-    &local_error
+    sync_in->parent,
+    sync_in->node_id,
+    sync_in->name,
+    sync_in->sheet_set,
+    TRUE,
+    sync_in->plugin
   );
-  
-  if(local_error != NULL)
-  {
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
 
-  if(account == NULL)
-  {
-    g_set_error(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NO_SUCH_ACCOUNT,
-      _("There is no such account with ID \"%s\""),
-      inf_acl_account_id_to_string(account_id)
-    );
+  sync_in->name = NULL; /* Don't free, we passed ownership */
+  request = sync_in->request;
+  g_object_ref(request);
+  proxy = sync_in->proxy;
+  g_object_ref(proxy);
 
-    return FALSE;
-  }
+  parent.node_id = sync_in->parent->id;
+  parent.node = sync_in->parent;
+  infd_directory_remove_sync_in(directory, sync_in);
 
-  if(transient_index < priv->n_transient_accounts)
-  {
-    /* Remove a transient account */
-    g_free(priv->transient_accounts[transient_index].account.name);
-    g_free(priv->transient_accounts[transient_index].dn);
+  /* Don't send to conn since the completed synchronization already lets the
+   * remote site know that the node was inserted. */
+  infd_directory_node_register(directory, node, request, conn, NULL);
+  infd_directory_node_link_session(directory, node, request, proxy);
 
-    priv->transient_accounts[transient_index] =
-      priv->transient_accounts[priv->n_transient_accounts - 1];
+  /* Save session initially */
+  infd_directory_node_get_path(node, &path, NULL);
 
-    priv->transient_accounts = g_realloc(
-      priv->transient_accounts,
-      (priv->n_transient_accounts - 1) * sizeof(InfdDirectoryTransientAccount)
-    );
+  error = NULL;
 
-    --priv->n_transient_accounts;
-  }
-  else if(priv->account_storage != NULL)
+  if(priv->storage != NULL)
   {
-    /* Note that we cannot rely on the account storage to provide proper
-     * notifications when adding the account to the storage, since
-     * implementation are not required to support notifications. Therefore,
-     * block our signal handlers and then announce explicitly. */
-    inf_signal_handlers_block_by_func(
-      G_OBJECT(priv->account_storage),
-      G_CALLBACK(infd_directory_account_storage_account_removed_cb),
-      directory
-    );
-
-    account_removed = infd_account_storage_remove_account(
-      priv->account_storage,
-      account_id,
-      error
-    );
-
-    inf_signal_handlers_unblock_by_func(
-      G_OBJECT(priv->account_storage),
-      G_CALLBACK(infd_directory_account_storage_account_removed_cb),
-      directory
+    ret = plugin->session_write(
+      priv->storage,
+      session,
+      path,
+      plugin->user_data,
+      &error
     );
-
-    if(account_removed == FALSE)
-      return FALSE;
   }
   else
   {
-    g_set_error_literal(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_OPERATION_UNSUPPORTED,
-      _("This server does not support removing accounts")
+    ret = TRUE;
+  }
+
+  if(ret == FALSE)
+  {
+    /* Note that while indeed this may fail in theory we have already
+     * (successfully) written the session before we started the sync-in, so
+     * the name of the node is accepted by the storage backend. */
+    g_warning(
+      _("Session \"%s\" could not be saved: %s\nAnother attempt will "
+        "be made when the session is unused for a while or the server is "
+        "shut down."),
+      path,
+      error->message
     );
 
-    return FALSE;
+    g_error_free(error);
   }
 
-  infd_directory_cleanup_acl_account(
-    directory,
-    account,
-    TRUE,
-    connection,
-    seq,
-    request
+  g_free(path);
+
+  iter.node_id = node->id;
+  iter.node = node;
+
+  inf_request_finish(
+    INF_REQUEST(request),
+    inf_request_result_make_add_node(INF_BROWSER(directory), &parent, &iter)
   );
 
-  inf_acl_account_free(account);
-  return TRUE;
+  g_object_unref(request);
+  infd_directory_unlock_workers(directory);
 }
 
-/*
- * Node synchronization.
- */
-
-static xmlNodePtr
-infd_directory_node_desc_register_to_xml(const gchar* node_name,
-                                         guint node_id,
-                                         InfdDirectoryNode* parent,
-                                         const gchar* plugin_type,
-                                         const gchar* name)
+static InfdDirectorySyncIn*
+infd_directory_add_sync_in(InfdDirectory* directory,
+                           InfdDirectoryNode* parent,
+                           InfdRequest* request,
+                           guint node_id,
+                           const gchar* name,
+                           const InfAclSheetSet* sheet_set,
+                           const InfdNotePlugin* plugin,
+                           InfdSessionProxy* proxy)
 {
-  xmlNodePtr xml;
+  InfdDirectoryPrivate* priv;
+  InfdDirectorySyncIn* sync_in;
+  InfSession* session;
 
-  xml = xmlNewNode(NULL, (const xmlChar*)node_name);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  inf_xml_util_set_attribute_uint(xml, "id", node_id);
-  inf_xml_util_set_attribute_uint(xml, "parent", parent->id);
-  inf_xml_util_set_attribute(xml, "name", name);
-  inf_xml_util_set_attribute(xml, "type", plugin_type);
+  sync_in = g_slice_new(InfdDirectorySyncIn);
 
-  return xml;
+  sync_in->directory = directory;
+  sync_in->parent = parent;
+  sync_in->node_id = node_id;
+  sync_in->name = g_strdup(name);
+  if(sheet_set != NULL)
+    sync_in->sheet_set = inf_acl_sheet_set_copy(sheet_set);
+  else
+    sync_in->sheet_set = NULL;
+  sync_in->plugin = plugin;
+  sync_in->proxy = proxy;
+  sync_in->request = request;
+
+  g_object_ref(sync_in->proxy);
+  g_object_ref(sync_in->request);
+  
+  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+
+  /* Connect after the default handler, so that the session status has changed
+   * before our callbacks are called. This makes sure that the session status
+   * is RUNNING when we emit the "subscribe-session" signal. */
+  g_signal_connect_after(
+    G_OBJECT(session),
+    "synchronization-failed",
+    G_CALLBACK(infd_directory_sync_in_synchronization_failed_cb),
+    sync_in
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(session),
+    "synchronization-complete",
+    G_CALLBACK(infd_directory_sync_in_synchronization_complete_cb),
+    sync_in
+  );
+
+  g_object_unref(session);
+
+  priv->sync_ins = g_slist_prepend(priv->sync_ins, sync_in);
+  return sync_in;
 }
 
-/* Creates XML request to tell someone about a new node */
-static xmlNodePtr
-infd_directory_node_register_to_xml(InfdDirectoryNode* node)
+static void
+infd_directory_remove_sync_in(InfdDirectory* directory,
+                              InfdDirectorySyncIn* sync_in)
 {
-  const InfdNotePlugin* plugin;
-  const gchar* plugin_type;
+  InfdDirectoryPrivate* priv;
+  InfSession* session;
 
-  g_assert(node->parent != NULL);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_object_get(G_OBJECT(sync_in->proxy), "session", &session, NULL);
 
-  switch(node->type)
-  {
-  case INFD_DIRECTORY_NODE_SUBDIRECTORY:
-    plugin_type = "InfSubdirectory";
-    break;
-  case INFD_DIRECTORY_NODE_NOTE:
-    plugin_type = node->shared.note.plugin->note_type;
-    break;
-  case INFD_DIRECTORY_NODE_UNKNOWN:
-    plugin_type = g_quark_to_string(node->shared.unknown.type);
-    break;
-  default:
-    g_assert_not_reached();
-    break;
-  }
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infd_directory_sync_in_synchronization_failed_cb),
+    sync_in
+  );
 
-  return infd_directory_node_desc_register_to_xml(
-    "add-node",
-    node->id,
-    node->parent,
-    plugin_type,
-    node->name
+  inf_signal_handlers_disconnect_by_func(
+    G_OBJECT(session),
+    G_CALLBACK(infd_directory_sync_in_synchronization_complete_cb),
+    sync_in
   );
-}
 
-/* Creates XML request to tell someone about a removed node */
-static xmlNodePtr
-infd_directory_node_unregister_to_xml(InfdDirectoryNode* node)
-{
-  xmlNodePtr xml;
-  gchar id_buf[16];
+  g_object_unref(session);
 
-  sprintf(id_buf, "%u", node->id);
+  /* This cancels the synchronization: */
+  g_object_unref(sync_in->proxy);
 
-  xml = xmlNewNode(NULL, (const xmlChar*)"remove-node");
-  xmlNewProp(xml, (const xmlChar*)"id", (const xmlChar*)id_buf);
+  /* TODO: Fail request with a cancelled error? */
+  g_object_unref(sync_in->request);
 
-  return xml;
+  if(sync_in->sheet_set != NULL)
+    inf_acl_sheet_set_free(sync_in->sheet_set);
+  g_free(sync_in->name);
+  g_slice_free(InfdDirectorySyncIn, sync_in);
+
+  priv->sync_ins = g_slist_remove(priv->sync_ins, sync_in);
 }
 
-static gboolean
-infd_directory_make_seq(InfdDirectory* directory,
-                        InfXmlConnection* connection,
-                        xmlNodePtr xml,
-                        gchar** seq,
-                        GError** error)
+static InfdDirectorySyncIn*
+infd_directory_find_sync_in_by_name(InfdDirectory* directory,
+                                    InfdDirectoryNode* parent,
+                                    const gchar* name)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectoryConnectionInfo* info;
-  GError* local_error;
-  guint seq_num;
+  GSList* item;
+  InfdDirectorySyncIn* sync_in;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  local_error = NULL;
-  if(!inf_xml_util_get_attribute_uint(xml, "seq", &seq_num, &local_error))
+  for(item = priv->sync_ins; item != NULL; item = item->next)
   {
-    if(local_error)
+    sync_in = (InfdDirectorySyncIn*)item->data;
+    if(sync_in->parent == parent &&
+       infd_directory_node_name_equal(sync_in->name, name) == TRUE)
     {
-      g_propagate_error(error, local_error);
-      return FALSE;
+      return sync_in;
     }
-
-    *seq = NULL;
-    return TRUE;
   }
 
-  info = g_hash_table_lookup(priv->connections, connection);
-  g_assert(info != NULL);
-
-  *seq = g_strdup_printf("%u/%u", info->seq_id, seq_num);
-  return TRUE;
+  return NULL;
 }
 
-/* Announces the presence of a new node. This is not done in
- * infd_directory_node_new because we do not want to do this for all
- * nodes we create (namely not for the root node). */
-static void
-infd_directory_node_register(InfdDirectory* directory,
-                             InfdDirectoryNode* node,
-                             InfdRequest* request,
-                             InfXmlConnection* except,
-                             const gchar* seq)
+/*
+ * Subscription requests.
+ */
+
+static InfdDirectorySubreq*
+infd_directory_add_subreq_common(InfdDirectory* directory,
+                                 InfdDirectorySubreqType type,
+                                 InfXmlConnection* connection,
+                                 guint node_id)
 {
   InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  InfdDirectoryConnectionInfo* info;
-  xmlNodePtr xml;
-  xmlNodePtr copy_xml;
-  GSList* item;
-
+  InfdDirectorySubreq* request;
+  
   priv = INFD_DIRECTORY_PRIVATE(directory);
+  request = g_slice_new(InfdDirectorySubreq);
 
-  iter.node_id = node->id;
-  iter.node = node;
-
-  inf_browser_node_added(
-    INF_BROWSER(directory),
-    &iter,
-    INF_REQUEST(request)
-  );
-
-  xml = infd_directory_node_register_to_xml(node);
-  if(seq != NULL)
-   inf_xml_util_set_attribute(xml, "seq", seq);
+  request->type = type;
+  request->connection = connection;
+  request->node_id = node_id;
 
-  for(item = node->parent->shared.subdir.connections;
-      item != NULL;
-      item = g_slist_next(item))
-  {
-    if(item->data != except)
-    {
-      info = g_hash_table_lookup(priv->connections, item->data);
-      g_assert(info != NULL);
+  priv->subscription_requests =
+    g_slist_prepend(priv->subscription_requests, request);
 
-      copy_xml = xmlCopyNode(xml, 1);
+  return request;
+}
 
-      if(node->acl != NULL)
-      {
-        infd_directory_acl_sheets_to_xml_for_connection(
-          directory,
-          node->acl_connections,
-          node->acl,
-          INF_XML_CONNECTION(item->data),
-          copy_xml
-        );
-      }
+static InfdDirectorySubreq*
+infd_directory_add_subreq_chat(InfdDirectory* directory,
+                               InfXmlConnection* connection)
+{
+  InfdDirectorySubreq* request;
 
-      inf_communication_group_send_message(
-        INF_COMMUNICATION_GROUP(priv->group),
-        INF_XML_CONNECTION(item->data),
-        copy_xml
-      );
-    }
-  }
+  request = infd_directory_add_subreq_common(
+    directory,
+    INFD_DIRECTORY_SUBREQ_CHAT,
+    connection,
+    0
+  );
 
-  xmlFreeNode(xml);
+  return request;
 }
 
-/* Announces that a node is removed. Again, this is not done in
- * infd_directory_node_free because we do not want to do this for
- * every subnode if a subdirectory is freed. */
-static void
-infd_directory_node_unregister(InfdDirectory* directory,
-                               InfdDirectoryNode* node,
-                               InfdRequest* request,
-                               const gchar* seq)
+static InfdDirectorySubreq*
+infd_directory_add_subreq_session(InfdDirectory* directory,
+                                  InfXmlConnection* connection,
+                                  InfdRequest* request,
+                                  guint node_id,
+                                  InfdSessionProxy* proxy)
 {
-  InfdDirectoryPrivate* priv;
-  InfBrowserIter iter;
-  xmlNodePtr xml;
-  GSList* item;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  iter.node_id = node->id;
-  iter.node = node;
+  InfdDirectorySubreq* subreq;
 
-  inf_browser_node_removed(
-    INF_BROWSER(directory),
-    &iter,
-    INF_REQUEST(request)
+  subreq = infd_directory_add_subreq_common(
+    directory,
+    INFD_DIRECTORY_SUBREQ_SESSION,
+    connection,
+    node_id
   );
 
-  xml = infd_directory_node_unregister_to_xml(node);
-  if(seq != NULL) inf_xml_util_set_attribute(xml, "seq", seq);
+  subreq->shared.session.session = proxy; /* take ownership */
+  subreq->shared.session.request = request;
 
-  for(item = node->parent->shared.subdir.connections;
-      item != NULL;
-      item = g_slist_next(item))
+  if(request != NULL)
+    g_object_ref(request);
+  return subreq;
+}
+
+static InfdDirectorySubreq*
+infd_directory_add_subreq_add_node(InfdDirectory* directory,
+                                   InfXmlConnection* connection,
+                                   InfCommunicationHostedGroup* group,
+                                   InfdRequest* request,
+                                   InfdDirectoryNode* parent,
+                                   guint node_id,
+                                   const gchar* name,
+                                   const InfAclSheetSet* sheet_set,
+                                   const InfdNotePlugin* plugin,
+                                   InfSession* session,
+                                   GError** error)
+{
+  InfdDirectorySubreq* subreq;
+  InfdSessionProxy* proxy;
+  gchar* path;
+  gboolean ensured;
+
+  if(session != NULL)
   {
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
-      INF_XML_CONNECTION(item->data),
-      xmlCopyNode(xml, 1)
+    proxy = infd_directory_create_session_proxy_with_group(
+      directory,
+      session,
+      group
     );
   }
+  else
+  {
+    infd_directory_node_make_path(parent, name, &path, NULL);
 
-  xmlFreeNode(xml);
-}
+    proxy = infd_directory_create_session_proxy(
+      directory,
+      plugin,
+      INF_SESSION_RUNNING,
+      NULL,
+      NULL,
+      group,
+      path
+    );
 
-static gboolean
-infd_directory_node_name_equal(const gchar* name1,
-                               const gchar* name2)
-{
-  gchar* f1 = g_utf8_casefold(name1, -1);
-  gchar* f2 = g_utf8_casefold(name2, -1);
-  gboolean result = (g_utf8_collate(f1, f2) == 0);
-  g_free(f2);
-  g_free(f1);
-  return result;
-}
+    g_free(path);
+  }
 
-/*
- * Sync-In
- */
+  ensured = infd_directory_session_proxy_ensure(
+    directory,
+    parent,
+    name,
+    plugin,
+    proxy,
+    error
+  );
 
-static void
-infd_directory_sync_in_synchronization_failed_cb(InfSession* session,
-                                                 InfXmlConnection* connection,
-                                                 const GError* error,
-                                                 gpointer user_data)
-{
-  /* Synchronization failed. We simply remove the sync-in. There is no further
-   * notification required since the synchronization failed on the remote site
-   * as well. */
-  InfdDirectorySyncIn* sync_in;
-  InfdRequest* request;
+  if(ensured == FALSE)
+    return NULL;
 
-  sync_in = (InfdDirectorySyncIn*)user_data;
-  request = sync_in->request;
+  subreq = infd_directory_add_subreq_common(
+    directory,
+    INFD_DIRECTORY_SUBREQ_ADD_NODE,
+    connection,
+    node_id
+  );
+
+  subreq->shared.add_node.parent = parent;
+  subreq->shared.add_node.group = group;
+  subreq->shared.add_node.plugin = plugin;
+  subreq->shared.add_node.name = g_strdup(name);
+  if(sheet_set != NULL)
+    subreq->shared.add_node.sheet_set = inf_acl_sheet_set_copy(sheet_set);
+  else
+    subreq->shared.add_node.sheet_set = NULL;
+  subreq->shared.add_node.proxy = proxy;
+  subreq->shared.add_node.request = request;
 
   g_object_ref(request);
-  infd_directory_remove_sync_in(sync_in->directory, sync_in);
-  inf_request_fail(INF_REQUEST(request), error);
-  g_object_unref(request);
+  g_object_ref(group);
+  return subreq;
 }
 
-static void
-infd_directory_sync_in_synchronization_complete_cb(InfSession* session,
-                                                   InfXmlConnection* conn,
-                                                   gpointer user_data)
+static InfdDirectorySubreq*
+infd_directory_add_subreq_sync_in(InfdDirectory* directory,
+                                  InfXmlConnection* connection,
+                                  InfCommunicationHostedGroup* sync_group,
+                                  InfCommunicationHostedGroup* sub_group,
+                                  InfdRequest* request,
+                                  InfdDirectoryNode* parent,
+                                  guint node_id,
+                                  const gchar* name,
+                                  const InfAclSheetSet* sheet_set,
+                                  const InfdNotePlugin* plugin,
+                                  GError** error)
 {
-  /* Synchronization done. We can now safely create the node in the directory
-   * tree. */
-  InfdDirectorySyncIn* sync_in;
-  InfdDirectory* directory;
-  const InfdNotePlugin* plugin;
-  InfdDirectoryPrivate* priv;
-  InfdDirectoryNode* node;
-  InfBrowserIter iter;
-  InfBrowserIter parent;
-  InfdRequest* request;
+  InfdDirectorySubreq* subreq;
   InfdSessionProxy* proxy;
   gchar* path;
-  gboolean ret;
-  GError* error;
+  gboolean ensured;
 
-  sync_in = (InfdDirectorySyncIn*)user_data;
-  directory = sync_in->directory;
-  plugin = sync_in->plugin;
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  infd_directory_node_make_path(parent, name, &path, NULL);
 
-  node = infd_directory_node_new_note(
+  /* Keep proxy in PRESYNC state, until we have the confirmation from the
+   * remote site that the chosen method is OK and we can go on. */
+  proxy = infd_directory_create_session_proxy(
     directory,
-    sync_in->parent,
-    sync_in->node_id,
-    sync_in->name,
-    sync_in->sheet_set,
-    TRUE,
-    sync_in->plugin
+    plugin,
+    INF_SESSION_PRESYNC,
+    sync_group,
+    connection,
+    sub_group,
+    path
   );
 
-  sync_in->name = NULL; /* Don't free, we passed ownership */
-  request = sync_in->request;
-  g_object_ref(request);
-  proxy = sync_in->proxy;
-  g_object_ref(proxy);
-
-  parent.node_id = sync_in->parent->id;
-  parent.node = sync_in->parent;
-  infd_directory_remove_sync_in(directory, sync_in);
-
-  /* Don't send to conn since the completed synchronization already lets the
-   * remote site know that the node was inserted. */
-  infd_directory_node_register(directory, node, request, conn, NULL);
-  infd_directory_node_link_session(directory, node, request, proxy);
-
-  /* Save session initially */
-  infd_directory_node_get_path(node, &path, NULL);
+  g_free(path);
 
-  error = NULL;
+  ensured = infd_directory_session_proxy_ensure(
+    directory,
+    parent,
+    name,
+    plugin,
+    proxy,
+    error
+  );
 
-  if(priv->storage != NULL)
-  {
-    ret = plugin->session_write(
-      priv->storage,
-      session,
-      path,
-      plugin->user_data,
-      &error
-    );
-  }
-  else
-  {
-    ret = TRUE;
-  }
+  if(ensured == FALSE)
+    return NULL;
 
-  if(ret == FALSE)
-  {
-    /* Note that while indeed this may fail in theory we have already
-     * (successfully) written the session before we started the sync-in, so
-     * the name of the node is accepted by the storage backend. */
-    g_warning(
-      _("Session \"%s\" could not be saved: %s\nAnother attempt will "
-        "be made when the session is unused for a while or the server is "
-        "shut down."),
-      path,
-      error->message
-    );
+  subreq = infd_directory_add_subreq_common(
+    directory,
+    sync_group == sub_group ?
+      INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE :
+      INFD_DIRECTORY_SUBREQ_SYNC_IN,
+    connection,
+    node_id
+  );
 
-    g_error_free(error);
-  }
+  subreq->shared.sync_in.parent = parent;
+  subreq->shared.sync_in.synchronization_group = sync_group;
+  subreq->shared.sync_in.subscription_group = sub_group;
+  subreq->shared.sync_in.plugin = plugin;
+  subreq->shared.sync_in.name = g_strdup(name);
+  if(sheet_set != NULL)
+    subreq->shared.sync_in.sheet_set = inf_acl_sheet_set_copy(sheet_set);
+  else
+    subreq->shared.sync_in.sheet_set = NULL;
+  subreq->shared.sync_in.proxy = proxy;
+  subreq->shared.sync_in.request = request;
 
-  g_free(path);
+  g_object_ref(request);
+  g_object_ref(sync_group);
+  g_object_ref(sub_group);
 
-  iter.node_id = node->id;
-  iter.node = node;
+  return subreq;
+}
 
-  inf_request_finish(
-    INF_REQUEST(request),
-    inf_request_result_make_add_node(INF_BROWSER(directory), &parent, &iter)
-  );
+static void
+infd_directory_free_subreq(InfdDirectorySubreq* request)
+{
+  switch(request->type)
+  {
+  case INFD_DIRECTORY_SUBREQ_CHAT:
+    break;
+  case INFD_DIRECTORY_SUBREQ_SESSION:
+    g_object_unref(request->shared.session.session);
+    if(request->shared.session.request != NULL)
+      g_object_unref(request->shared.session.request);
+    break;
+  case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+    g_free(request->shared.add_node.name);
+    if(request->shared.add_node.sheet_set != NULL)
+      inf_acl_sheet_set_free(request->shared.add_node.sheet_set);
+    g_object_unref(request->shared.add_node.group);
+    g_object_unref(request->shared.add_node.proxy);
+    /* TODO: Fail with some cancelled error? */
+    g_object_unref(request->shared.add_node.request);
+    break;
+  case INFD_DIRECTORY_SUBREQ_SYNC_IN:
+  case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
+    g_free(request->shared.sync_in.name);
+    if(request->shared.sync_in.sheet_set != NULL)
+      inf_acl_sheet_set_free(request->shared.sync_in.sheet_set);
+    g_object_unref(request->shared.sync_in.synchronization_group);
+    g_object_unref(request->shared.sync_in.subscription_group);
+    g_object_unref(request->shared.sync_in.proxy);
+    /* TODO: Fail with some cancelled error? */
+    g_object_unref(request->shared.sync_in.request);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
 
-  g_object_unref(request);
+  g_slice_free(InfdDirectorySubreq, request);
 }
 
-static InfdDirectorySyncIn*
-infd_directory_add_sync_in(InfdDirectory* directory,
-                           InfdDirectoryNode* parent,
-                           InfdRequest* request,
-                           guint node_id,
-                           const gchar* name,
-                           const InfAclSheetSet* sheet_set,
-                           const InfdNotePlugin* plugin,
-                           InfdSessionProxy* proxy)
+static void
+infd_directory_unlink_subreq(InfdDirectory* directory,
+                             InfdDirectorySubreq* request)
 {
   InfdDirectoryPrivate* priv;
-  InfdDirectorySyncIn* sync_in;
-  InfSession* session;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  sync_in = g_slice_new(InfdDirectorySyncIn);
-
-  sync_in->directory = directory;
-  sync_in->parent = parent;
-  sync_in->node_id = node_id;
-  sync_in->name = g_strdup(name);
-  if(sheet_set != NULL)
-    sync_in->sheet_set = inf_acl_sheet_set_copy(sheet_set);
-  else
-    sync_in->sheet_set = NULL;
-  sync_in->plugin = plugin;
-  sync_in->proxy = proxy;
-  sync_in->request = request;
+  priv->subscription_requests =
+    g_slist_remove(priv->subscription_requests, request);
+}
 
-  g_object_ref(sync_in->proxy);
-  g_object_ref(sync_in->request);
-  
-  g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+static void
+infd_directory_remove_subreq(InfdDirectory* directory,
+                             InfdDirectorySubreq* request)
+{
+  infd_directory_unlink_subreq(directory, request);
+  infd_directory_free_subreq(request);
+}
 
-  /* Connect after the default handler, so that the session status has changed
-   * before our callbacks are called. This makes sure that the session status
-   * is RUNNING when we emit the "subscribe-session" signal. */
-  g_signal_connect_after(
-    G_OBJECT(session),
-    "synchronization-failed",
-    G_CALLBACK(infd_directory_sync_in_synchronization_failed_cb),
-    sync_in
-  );
+static InfdDirectorySubreq*
+infd_directory_find_subreq_by_node_id(InfdDirectory* directory,
+                                      InfdDirectorySubreqType type,
+                                      guint node_id)
+{
+  InfdDirectoryPrivate* priv;
+  GSList* item;
+  InfdDirectorySubreq* subreq;
 
-  g_signal_connect_after(
-    G_OBJECT(session),
-    "synchronization-complete",
-    G_CALLBACK(infd_directory_sync_in_synchronization_complete_cb),
-    sync_in
-  );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  g_object_unref(session);
+  for(item = priv->subscription_requests; item != NULL; item = item->next)
+  {
+    subreq = (InfdDirectorySubreq*)item->data;
+    if(subreq->type == type && subreq->node_id == node_id)
+      return subreq;
+  }
 
-  priv->sync_ins = g_slist_prepend(priv->sync_ins, sync_in);
-  return sync_in;
+  return NULL;
 }
 
-static void
-infd_directory_remove_sync_in(InfdDirectory* directory,
-                              InfdDirectorySyncIn* sync_in)
+static InfdDirectorySubreq*
+infd_directory_find_subreq_by_name(InfdDirectory* directory,
+                                   InfdDirectoryNode* parent,
+                                   const gchar* name)
 {
   InfdDirectoryPrivate* priv;
-  InfSession* session;
+  GSList* item;
+  InfdDirectorySubreq* request;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
-  g_object_get(G_OBJECT(sync_in->proxy), "session", &session, NULL);
 
-  inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(session),
-    G_CALLBACK(infd_directory_sync_in_synchronization_failed_cb),
-    sync_in
-  );
+  for(item = priv->subscription_requests; item != NULL; item = item->next)
+  {
+    request = (InfdDirectorySubreq*)item->data;
 
-  inf_signal_handlers_disconnect_by_func(
-    G_OBJECT(session),
-    G_CALLBACK(infd_directory_sync_in_synchronization_complete_cb),
-    sync_in
-  );
+    switch(request->type)
+    {
+    case INFD_DIRECTORY_SUBREQ_CHAT:
+    case INFD_DIRECTORY_SUBREQ_SESSION:
+      /* These don't occupy names */
+      break;
+    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
+      if(request->shared.add_node.parent == parent &&
+         infd_directory_node_name_equal(request->shared.add_node.name, name))
+      {
+        return request;
+      }
+      break;
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
+    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
+      if(request->shared.sync_in.parent == parent &&
+         infd_directory_node_name_equal(request->shared.sync_in.name, name))
+      {
+        return request;
+      }
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
+  }
 
-  g_object_unref(session);
+  return NULL;
+}
 
-  /* This cancels the synchronization: */
-  g_object_unref(sync_in->proxy);
+/*
+ * Directory tree operations.
+ */
 
-  /* TODO: Fail request with a cancelled error? */
-  g_object_unref(sync_in->request);
+static InfdDirectoryNode*
+infd_directory_node_find_child_by_name(InfdDirectoryNode* parent,
+                                       const gchar* name)
+{
+  InfdDirectoryNode* node;
 
-  if(sync_in->sheet_set != NULL)
-    inf_acl_sheet_set_free(sync_in->sheet_set);
-  g_free(sync_in->name);
-  g_slice_free(InfdDirectorySyncIn, sync_in);
+  infd_directory_return_val_if_subdir_fail(parent, NULL);
 
-  priv->sync_ins = g_slist_remove(priv->sync_ins, sync_in);
+  for(node = parent->shared.subdir.child; node != NULL; node = node->next)
+    if(infd_directory_node_name_equal(node->name, name))
+      return node;
+
+  return NULL;
 }
 
-static InfdDirectorySyncIn*
-infd_directory_find_sync_in_by_name(InfdDirectory* directory,
-                                    InfdDirectoryNode* parent,
-                                    const gchar* name)
+/* Checks whether a node with the given name can be created in the given
+ * parent directory. */
+static gboolean
+infd_directory_node_is_name_available(InfdDirectory* directory,
+                                      InfdDirectoryNode* parent,
+                                      const gchar* name,
+                                      GError** error)
 {
-  InfdDirectoryPrivate* priv;
-  GSList* item;
-  InfdDirectorySyncIn* sync_in;
+  gboolean has_sensible_character = FALSE;
+  const gchar* p;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  for(item = priv->sync_ins; item != NULL; item = item->next)
+  for (p = name; *p != '\0'; p = g_utf8_next_char(p))
   {
-    sync_in = (InfdDirectorySyncIn*)item->data;
-    if(sync_in->parent == parent &&
-       infd_directory_node_name_equal(sync_in->name, name) == TRUE)
+    if(!g_unichar_isprint(*p))
     {
-      return sync_in;
+      g_set_error(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_INVALID_NAME,
+        _("Name \"%s\" is an invalid name: contains non-printable characters"),
+        name
+      );
+
+      return FALSE;
+    }
+    else if(!g_unichar_isspace(*p))
+    {
+      has_sensible_character = TRUE;
     }
   }
 
-  return NULL;
-}
-
-/*
- * Subscription requests.
- */
-
-static InfdDirectorySubreq*
-infd_directory_add_subreq_common(InfdDirectory* directory,
-                                 InfdDirectorySubreqType type,
-                                 InfXmlConnection* connection,
-                                 guint node_id)
-{
-  InfdDirectoryPrivate* priv;
-  InfdDirectorySubreq* request;
-  
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-  request = g_slice_new(InfdDirectorySubreq);
+  if(!has_sensible_character)
+  {
+    g_set_error(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_INVALID_NAME,
+      _("Name \"%s\" is an invalid name: contains only space characters"),
+      name
+    );
 
-  request->type = type;
-  request->connection = connection;
-  request->node_id = node_id;
+    return FALSE;
+  }
 
-  priv->subscription_requests =
-    g_slist_prepend(priv->subscription_requests, request);
+  if(strchr(name, '/') != NULL)
+  {
+    g_set_error(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_INVALID_NAME,
+      _("Name \"%s\" is an invalid name: contains \"/\""),
+      name
+    );
 
-  return request;
-}
+    return FALSE;
+  }
 
-static InfdDirectorySubreq*
-infd_directory_add_subreq_chat(InfdDirectory* directory,
-                               InfXmlConnection* connection)
-{
-  InfdDirectorySubreq* request;
+  if(infd_directory_node_find_child_by_name(parent, name)         != NULL ||
+     infd_directory_find_sync_in_by_name(directory, parent, name) != NULL ||
+     infd_directory_find_subreq_by_name(directory, parent, name)  != NULL)
+  {
+    g_set_error(
+      error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_NODE_EXISTS,
+      _("A node with name \"%s\" exists already"),
+      name
+    );
 
-  request = infd_directory_add_subreq_common(
-    directory,
-    INFD_DIRECTORY_SUBREQ_CHAT,
-    connection,
-    0
-  );
+    return FALSE;
+  }
 
-  return request;
+  return TRUE;
 }
 
-static InfdDirectorySubreq*
-infd_directory_add_subreq_session(InfdDirectory* directory,
-                                  InfXmlConnection* connection,
-                                  InfdRequest* request,
-                                  guint node_id,
-                                  InfdSessionProxy* proxy)
+/* Fills the subdirectory node with its content as read from the storage.
+ * acls holds the ACL read from the storage for each item in list. */
+static void
+infd_directory_node_explore_fill(InfdDirectory* directory,
+                                 InfdDirectoryNode* node,
+                                 InfdProgressRequest* request,
+                                 GSList* list,
+                                 GSList** acls)
 {
-  InfdDirectorySubreq* subreq;
+  InfdDirectoryPrivate* priv;
+  InfdStorageNode* storage_node;
+  InfdDirectoryNode* new_node;
+  InfBrowserIter iter;
+  InfdNotePlugin* plugin;
+  InfAclSheetSet* sheet_set;
+  GHashTable* verify_table;
+  GSList* item;
+  gchar* path;
+  guint index;
 
-  subreq = infd_directory_add_subreq_common(
-    directory,
-    INFD_DIRECTORY_SUBREQ_SESSION,
-    connection,
-    node_id
-  );
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  subreq->shared.session.session = proxy; /* take ownership */
-  subreq->shared.session.request = request;
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
 
+  node->shared.subdir.explored = TRUE;
   if(request != NULL)
-    g_object_ref(request);
-  return subreq;
-}
+    infd_progress_request_initiated(request, g_slist_length(list));
 
-static InfdDirectorySubreq*
-infd_directory_add_subreq_add_node(InfdDirectory* directory,
-                                   InfXmlConnection* connection,
-                                   InfCommunicationHostedGroup* group,
-                                   InfdRequest* request,
-                                   InfdDirectoryNode* parent,
-                                   guint node_id,
-                                   const gchar* name,
-                                   const InfAclSheetSet* sheet_set,
-                                   const InfdNotePlugin* plugin,
-                                   InfSession* session,
-                                   GError** error)
-{
-  InfdDirectorySubreq* subreq;
-  InfdSessionProxy* proxy;
-  gchar* path;
-  gboolean ensured;
+  verify_table = g_hash_table_new(NULL, NULL);
 
-  if(session != NULL)
-  {
-    proxy = infd_directory_create_session_proxy_with_group(
-      directory,
-      session,
-      group
-    );
-  }
-  else
+  for(item = list, index = 0;
+      item != NULL;
+      item = g_slist_next(item), ++index)
   {
-    infd_directory_node_make_path(parent, name, &path, NULL);
+    storage_node = (InfdStorageNode*)item->data;
+    new_node = NULL;
 
-    proxy = infd_directory_create_session_proxy(
+    infd_directory_node_make_path(node, storage_node->name, &path, NULL);
+
+    sheet_set = infd_directory_acl_from_storage(
       directory,
-      plugin,
-      INF_SESSION_RUNNING,
-      NULL,
+      path,
       NULL,
-      group,
-      path
+      acls[index],
+      verify_table
     );
 
     g_free(path);
-  }
 
-  ensured = infd_directory_session_proxy_ensure(
-    directory,
-    parent,
-    name,
-    plugin,
-    proxy,
-    error
-  );
+    switch(storage_node->type)
+    {
+    case INFD_STORAGE_NODE_SUBDIRECTORY:
+      new_node = infd_directory_node_new_subdirectory(
+        directory,
+        node,
+        priv->node_counter++,
+        g_strdup(storage_node->name),
+        sheet_set,
+        FALSE
+      );
 
-  if(ensured == FALSE)
-    return NULL;
+      break;
+    case INFD_STORAGE_NODE_NOTE:
+      /* TODO: Currently we ignore notes of unknown type. Perhaps we should
+       * report some error. */
+      plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
+      if(plugin != NULL)
+      {
+        new_node = infd_directory_node_new_note(
+          directory,
+          node,
+          priv->node_counter++,
+          g_strdup(storage_node->name),
+          sheet_set,
+          FALSE,
+          plugin
+        );
+      }
+      else
+      {
+        new_node = infd_directory_node_new_unknown(
+          directory,
+          node,
+          priv->node_counter++,
+          g_strdup(storage_node->name),
+          sheet_set,
+          FALSE,
+          storage_node->identifier
+        );
+      }
 
-  subreq = infd_directory_add_subreq_common(
-    directory,
-    INFD_DIRECTORY_SUBREQ_ADD_NODE,
-    connection,
-    node_id
-  );
+      break;
+    default:
+      g_assert_not_reached();
+      break;
+    }
 
-  subreq->shared.add_node.parent = parent;
-  subreq->shared.add_node.group = group;
-  subreq->shared.add_node.plugin = plugin;
-  subreq->shared.add_node.name = g_strdup(name);
-  if(sheet_set != NULL)
-    subreq->shared.add_node.sheet_set = inf_acl_sheet_set_copy(sheet_set);
-  else
-    subreq->shared.add_node.sheet_set = NULL;
-  subreq->shared.add_node.proxy = proxy;
-  subreq->shared.add_node.request = request;
+    inf_acl_sheet_set_free(sheet_set);
 
-  g_object_ref(request);
-  g_object_ref(group);
-  return subreq;
+    if(new_node != NULL)
+    {
+      /* Announce the new node. In most cases, this does nothing on the
+       * network because there are no connections that have this node open
+       * (otherwise, we would already have explored the node earlier).
+       * However, if the background storage is replaced by a new one, the root
+       * folder of the new storage will be explored immediately (see below in
+       * infd_directory_set_storage()) and there might still be connections
+       * interesting in root folder changes (because they opened the root
+       * folder from the old storage). Also, local users might be interested
+       * in the new node. */
+      infd_directory_node_register(
+        directory,
+        new_node,
+        INFD_REQUEST(request),
+        NULL,
+        NULL
+      );
+    }
+
+    if(request != NULL) infd_progress_request_progress(request);
+  }
+
+  g_hash_table_destroy(verify_table);
+
+  if(request != NULL)
+  {
+    iter.node_id = node->id;
+    iter.node = node;
+
+    inf_request_finish(
+      INF_REQUEST(request),
+      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
+    );
+  }
 }
 
-static InfdDirectorySubreq*
-infd_directory_add_subreq_sync_in(InfdDirectory* directory,
-                                  InfXmlConnection* connection,
-                                  InfCommunicationHostedGroup* sync_group,
-                                  InfCommunicationHostedGroup* sub_group,
-                                  InfdRequest* request,
-                                  InfdDirectoryNode* parent,
-                                  guint node_id,
-                                  const gchar* name,
-                                  const InfAclSheetSet* sheet_set,
-                                  const InfdNotePlugin* plugin,
-                                  GError** error)
+/* Reads the content of the subdirectory node from the storage before
+ * returning. */
+static gboolean
+infd_directory_node_explore(InfdDirectory* directory,
+                            InfdDirectoryNode* node,
+                            InfdProgressRequest* request,
+                            GError** error)
 {
-  InfdDirectorySubreq* subreq;
-  InfdSessionProxy* proxy;
+  InfdDirectoryPrivate* priv;
+  InfdStorageNode* storage_node;
+  GError* local_error;
+  GSList* list;
+  GSList** acls;
+  GSList* item;
   gchar* path;
-  gboolean ensured;
+  gchar* child_path;
+  guint n_items;
+  guint index;
 
-  infd_directory_node_make_path(parent, name, &path, NULL);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* Keep proxy in PRESYNC state, until we have the confirmation from the
-   * remote site that the chosen method is OK and we can go on. */
-  proxy = infd_directory_create_session_proxy(
-    directory,
-    plugin,
-    INF_SESSION_PRESYNC,
-    sync_group,
-    connection,
-    sub_group,
-    path
-  );
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
+  g_assert(node->shared.subdir.explore == NULL);
 
+  local_error = NULL;
+  infd_directory_node_get_path(node, &path, NULL);
+  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
   g_free(path);
 
-  ensured = infd_directory_session_proxy_ensure(
-    directory,
-    parent,
-    name,
-    plugin,
-    proxy,
-    error
-  );
+  if(local_error != NULL)
+  {
+    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
 
-  if(ensured == FALSE)
-    return NULL;
+  /* Read the ACLs for each node first. If there is a problem reading the ACL
+   * for one node, cancel the full exploration. */
+  n_items = g_slist_length(list);
+  acls = g_new0(GSList*, n_items);
 
-  subreq = infd_directory_add_subreq_common(
-    directory,
-    sync_group == sub_group ?
-      INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE :
-      INFD_DIRECTORY_SUBREQ_SYNC_IN,
-    connection,
-    node_id
-  );
+  for(item = list, index = 0;
+      item != NULL;
+      item = g_slist_next(item), ++index)
+  {
+    storage_node = (InfdStorageNode*)item->data;
+    infd_directory_node_make_path(node, storage_node->name, &child_path, NULL);
 
-  subreq->shared.sync_in.parent = parent;
-  subreq->shared.sync_in.synchronization_group = sync_group;
-  subreq->shared.sync_in.subscription_group = sub_group;
-  subreq->shared.sync_in.plugin = plugin;
-  subreq->shared.sync_in.name = g_strdup(name);
-  if(sheet_set != NULL)
-    subreq->shared.sync_in.sheet_set = inf_acl_sheet_set_copy(sheet_set);
-  else
-    subreq->shared.sync_in.sheet_set = NULL;
-  subreq->shared.sync_in.proxy = proxy;
-  subreq->shared.sync_in.request = request;
+    acls[index] =
+      infd_storage_read_acl(priv->storage, child_path, &local_error);
+    g_free(child_path);
 
-  g_object_ref(request);
-  g_object_ref(sync_group);
-  g_object_ref(sub_group);
+    if(local_error != NULL)
+      break;
+  }
 
-  return subreq;
-}
+  if(local_error == NULL)
+    infd_directory_node_explore_fill(directory, node, request, list, acls);
 
-static void
-infd_directory_free_subreq(InfdDirectorySubreq* request)
-{
-  switch(request->type)
+  for(index = 0; index < n_items; ++index)
+    infd_storage_acl_list_free(acls[index]);
+  g_free(acls);
+  infd_storage_node_list_free(list);
+
+  if(local_error != NULL)
   {
-  case INFD_DIRECTORY_SUBREQ_CHAT:
-    break;
-  case INFD_DIRECTORY_SUBREQ_SESSION:
-    g_object_unref(request->shared.session.session);
-    if(request->shared.session.request != NULL)
-      g_object_unref(request->shared.session.request);
-    break;
-  case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-    g_free(request->shared.add_node.name);
-    if(request->shared.add_node.sheet_set != NULL)
-      inf_acl_sheet_set_free(request->shared.add_node.sheet_set);
-    g_object_unref(request->shared.add_node.group);
-    g_object_unref(request->shared.add_node.proxy);
-    /* TODO: Fail with some cancelled error? */
-    g_object_unref(request->shared.add_node.request);
-    break;
-  case INFD_DIRECTORY_SUBREQ_SYNC_IN:
-  case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
-    g_free(request->shared.sync_in.name);
-    if(request->shared.sync_in.sheet_set != NULL)
-      inf_acl_sheet_set_free(request->shared.sync_in.sheet_set);
-    g_object_unref(request->shared.sync_in.synchronization_group);
-    g_object_unref(request->shared.sync_in.subscription_group);
-    g_object_unref(request->shared.sync_in.proxy);
-    /* TODO: Fail with some cancelled error? */
-    g_object_unref(request->shared.sync_in.request);
-    break;
-  default:
-    g_assert_not_reached();
-    break;
+    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
+    g_propagate_error(error, local_error);
+    return FALSE;
   }
 
-  g_slice_free(InfdDirectorySubreq, request);
+  return TRUE;
 }
 
+/* Required by infd_directory_explore_finish() */
 static void
-infd_directory_unlink_subreq(InfdDirectory* directory,
-                             InfdDirectorySubreq* request)
-{
-  InfdDirectoryPrivate* priv;
-
-  priv = INFD_DIRECTORY_PRIVATE(directory);
-
-  priv->subscription_requests =
-    g_slist_remove(priv->subscription_requests, request);
-}
+infd_directory_handle_message(InfdDirectory* directory,
+                              InfXmlConnection* connection,
+                              const xmlNodePtr node);
 
 static void
-infd_directory_remove_subreq(InfdDirectory* directory,
-                             InfdDirectorySubreq* request)
+infd_directory_queued_request_free(InfdDirectoryQueuedRequest* queued)
 {
-  infd_directory_unlink_subreq(directory, request);
-  infd_directory_free_subreq(request);
+  g_object_unref(queued->connection);
+  xmlFreeNode(queued->xml);
+  g_slice_free(InfdDirectoryQueuedRequest, queued);
 }
 
-static InfdDirectorySubreq*
-infd_directory_find_subreq_by_node_id(InfdDirectory* directory,
-                                      InfdDirectorySubreqType type,
-                                      guint node_id)
+static void
+infd_directory_explore_free(InfdDirectoryExplore* explore)
 {
-  InfdDirectoryPrivate* priv;
-  GSList* item;
-  InfdDirectorySubreq* subreq;
+  guint i;
 
-  priv = INFD_DIRECTORY_PRIVATE(directory);
+  g_assert(explore->n_pending == 0);
+  g_assert(explore->queued == NULL);
 
-  for(item = priv->subscription_requests; item != NULL; item = item->next)
-  {
-    subreq = (InfdDirectorySubreq*)item->data;
-    if(subreq->type == type && subreq->node_id == node_id)
-      return subreq;
-  }
+  for(i = 0; i < explore->n_items; ++i)
+    infd_storage_acl_list_free(explore->acls[i]);
+  g_free(explore->acls);
+  g_free(explore->items);
+  infd_storage_node_list_free(explore->list);
 
-  return NULL;
+  if(explore->request != NULL)
+    g_object_unref(explore->request);
+  if(explore->error != NULL)
+    g_error_free(explore->error);
+
+  g_free(explore->path);
+  g_slice_free(InfdDirectoryExplore, explore);
 }
 
-static InfdDirectorySubreq*
-infd_directory_find_subreq_by_name(InfdDirectory* directory,
-                                   InfdDirectoryNode* parent,
-                                   const gchar* name)
+/* Called when the storage has reported back all results of an exploration
+ * that has not been cancelled. */
+static void
+infd_directory_explore_finish(InfdDirectoryExplore* explore)
 {
+  InfdDirectory* directory;
   InfdDirectoryPrivate* priv;
+  InfdDirectoryQueuedRequest* queued;
+  GSList* list;
   GSList* item;
-  InfdDirectorySubreq* request;
 
+  directory = explore->directory;
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  for(item = priv->subscription_requests; item != NULL; item = item->next)
-  {
-    request = (InfdDirectorySubreq*)item->data;
+  priv->explores = g_slist_remove(priv->explores, explore);
+  explore->node->shared.subdir.explore = NULL;
 
-    switch(request->type)
-    {
-    case INFD_DIRECTORY_SUBREQ_CHAT:
-    case INFD_DIRECTORY_SUBREQ_SESSION:
-      /* These don't occupy names */
-      break;
-    case INFD_DIRECTORY_SUBREQ_ADD_NODE:
-      if(request->shared.add_node.parent == parent &&
-         infd_directory_node_name_equal(request->shared.add_node.name, name))
-      {
-        return request;
-      }
-      break;
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN:
-    case INFD_DIRECTORY_SUBREQ_SYNC_IN_SUBSCRIBE:
-      if(request->shared.sync_in.parent == parent &&
-         infd_directory_node_name_equal(request->shared.sync_in.name, name))
-      {
-        return request;
-      }
-      break;
-    default:
-      g_assert_not_reached();
-      break;
-    }
+  if(explore->error != NULL)
+  {
+    if(explore->request != NULL)
+      inf_request_fail(INF_REQUEST(explore->request), explore->error);
+  }
+  else
+  {
+    infd_directory_node_explore_fill(
+      directory,
+      explore->node,
+      explore->request,
+      explore->list,
+      explore->acls
+    );
   }
 
-  return NULL;
-}
-
-/*
- * Directory tree operations.
- */
-
-static InfdDirectoryNode*
-infd_directory_node_find_child_by_name(InfdDirectoryNode* parent,
-                                       const gchar* name)
-{
-  InfdDirectoryNode* node;
-
-  infd_directory_return_val_if_subdir_fail(parent, NULL);
-
-  for(node = parent->shared.subdir.child; node != NULL; node = node->next)
-    if(infd_directory_node_name_equal(node->name, name))
-      return node;
-
-  return NULL;
-}
-
-/* Checks whether a node with the given name can be created in the given
- * parent directory. */
-static gboolean
-infd_directory_node_is_name_available(InfdDirectory* directory,
-                                      InfdDirectoryNode* parent,
-                                      const gchar* name,
-                                      GError** error)
-{
-  gboolean has_sensible_character = FALSE;
-  const gchar* p;
+  /* Now handle the requests that had to wait for the exploration, in the
+   * order in which they were made. */
+  list = g_slist_reverse(explore->queued);
+  explore->queued = NULL;
 
-  for (p = name; *p != '\0'; p = g_utf8_next_char(p))
+  for(item = list; item != NULL; item = g_slist_next(item))
   {
-    if(!g_unichar_isprint(*p))
+    queued = (InfdDirectoryQueuedRequest*)item->data;
+
+    if(explore->error != NULL)
     {
-      g_set_error(
-        error,
-        inf_directory_error_quark(),
-        INF_DIRECTORY_ERROR_INVALID_NAME,
-        _("Name \"%s\" is an invalid name: contains non-printable characters"),
-        name
+      infd_directory_send_request_failed(
+        directory,
+        queued->connection,
+        queued->xml,
+        explore->error
       );
-
-      return FALSE;
     }
-    else if(!g_unichar_isspace(*p))
+    else
     {
-      has_sensible_character = TRUE;
+      infd_directory_handle_message(directory, queued->connection, queued->xml);
     }
+
+    infd_directory_queued_request_free(queued);
   }
 
-  if(!has_sensible_character)
-  {
-    g_set_error(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_INVALID_NAME,
-      _("Name \"%s\" is an invalid name: contains only space characters"),
-      name
-    );
+  g_slist_free(list);
+  infd_directory_explore_free(explore);
+}
 
-    return FALSE;
-  }
+static void
+infd_directory_explore_read_acl_cb(InfdStorage* storage,
+                                   GSList* acl,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfdDirectoryExploreItem* item;
+  InfdDirectoryExplore* explore;
 
-  if(strchr(name, '/') != NULL)
-  {
-    g_set_error(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_INVALID_NAME,
-      _("Name \"%s\" is an invalid name: contains \"/\""),
-      name
-    );
+  item = (InfdDirectoryExploreItem*)user_data;
+  explore = item->explore;
 
-    return FALSE;
-  }
+  explore->acls[item->index] = acl;
+  if(error != NULL && explore->error == NULL)
+    explore->error = g_error_copy(error);
 
-  if(infd_directory_node_find_child_by_name(parent, name)         != NULL ||
-     infd_directory_find_sync_in_by_name(directory, parent, name) != NULL ||
-     infd_directory_find_subreq_by_name(directory, parent, name)  != NULL)
-  {
-    g_set_error(
-      error,
-      inf_directory_error_quark(),
-      INF_DIRECTORY_ERROR_NODE_EXISTS,
-      _("A node with name \"%s\" exists already"),
-      name
-    );
+  g_assert(explore->n_pending > 0);
+  --explore->n_pending;
 
-    return FALSE;
+  if(explore->n_pending == 0)
+  {
+    if(explore->directory != NULL)
+      infd_directory_explore_finish(explore);
+    else
+      infd_directory_explore_free(explore);
   }
-
-  return TRUE;
 }
 
-static gboolean
-infd_directory_node_explore(InfdDirectory* directory,
-                            InfdDirectoryNode* node,
-                            InfdProgressRequest* request,
-                            GError** error)
+static void
+infd_directory_explore_read_subdirectory_cb(InfdStorage* storage,
+                                            GSList* nodes,
+                                            const GError* error,
+                                            gpointer user_data)
 {
+  InfdDirectoryExplore* explore;
   InfdDirectoryPrivate* priv;
   InfdStorageNode* storage_node;
-  InfdDirectoryNode* new_node;
-  InfBrowserIter iter;
-  InfdNotePlugin* plugin;
-  GError* local_error;
-  GSList* list;
-  InfAclSheetSet* sheet_set;
-  GPtrArray* acls;
-  GHashTable* verify_table;
   GSList* item;
   gchar* path;
-  gsize len;
-  gsize node_len;
-  gsize sep_len;
-  gsize path_len;
   guint index;
 
+  explore = (InfdDirectoryExplore*)user_data;
+  g_assert(explore->n_pending == 1);
+
+  explore->list = nodes;
+
+  if(error != NULL)
+  {
+    explore->error = g_error_copy(error);
+  }
+  else if(explore->directory != NULL)
+  {
+    /* Read the ACLs of all items in parallel */
+    priv = INFD_DIRECTORY_PRIVATE(explore->directory);
+
+    explore->n_items = g_slist_length(nodes);
+    explore->acls = g_new0(GSList*, explore->n_items);
+    explore->items = g_new(InfdDirectoryExploreItem, explore->n_items);
+
+    for(item = nodes, index = 0;
+        item != NULL;
+        item = g_slist_next(item), ++index)
+    {
+      storage_node = (InfdStorageNode*)item->data;
+      explore->items[index].explore = explore;
+      explore->items[index].index = index;
+
+      infd_directory_node_make_path(
+        explore->node,
+        storage_node->name,
+        &path,
+        NULL
+      );
+
+      ++explore->n_pending;
+
+      infd_storage_read_acl_async(
+        storage,
+        path,
+        priv->io,
+        infd_directory_explore_read_acl_cb,
+        &explore->items[index]
+      );
+
+      g_free(path);
+    }
+  }
+
+  --explore->n_pending;
+
+  if(explore->n_pending == 0)
+  {
+    if(explore->directory != NULL)
+      infd_directory_explore_finish(explore);
+    else
+      infd_directory_explore_free(explore);
+  }
+}
+
+/* Starts reading the content of the subdirectory node from the storage in
+ * the background. request can be NULL. */
+static InfdDirectoryExplore*
+infd_directory_node_explore_begin(InfdDirectory* directory,
+                                  InfdDirectoryNode* node,
+                                  InfdProgressRequest* request)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExplore* explore;
+
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
   g_assert(priv->storage != NULL);
   g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
   g_assert(node->shared.subdir.explored == FALSE);
+  g_assert(node->shared.subdir.explore == NULL);
+
+  explore = g_slice_new(InfdDirectoryExplore);
+  explore->directory = directory;
+  explore->node = node;
+  explore->request = request;
+  infd_directory_node_get_path(node, &explore->path, NULL);
+  explore->queued = NULL;
+
+  explore->list = NULL;
+  explore->n_items = 0;
+  explore->acls = NULL;
+  explore->items = NULL;
+  explore->n_pending = 1;
+  explore->error = NULL;
 
-  local_error = NULL;
-  infd_directory_node_get_path(node, &path, &len);
-  list = infd_storage_read_subdirectory(priv->storage, path, &local_error);
+  if(request != NULL)
+    g_object_ref(request);
 
-  if(local_error != NULL)
-  {
-    g_free(path);
-    if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-    g_propagate_error(error, local_error);
-    return FALSE;
-  }
+  node->shared.subdir.explore = explore;
+  priv->explores = g_slist_prepend(priv->explores, explore);
 
-  /* First pass: Count the total number of items and read the ACLs for each
-   * node. If there is a problem reading the ACL for one node, cancel the
-   * full exploration. */
-  path_len = len;
-  acls = g_ptr_array_sized_new(16);
-  verify_table = g_hash_table_new(NULL, NULL);
-  for(item = list; item != NULL; item = g_slist_next(item))
-  {
-    storage_node = (InfdStorageNode*)item->data;
+  infd_storage_read_subdirectory_async(
+    priv->storage,
+    explore->path,
+    priv->io,
+    infd_directory_explore_read_subdirectory_cb,
+    explore
+  );
+
+  return explore;
+}
+
+/* Stops waiting for the results of an exploration. The request and all
+ * queued requests fail with the given error. */
+static void
+infd_directory_explore_cancel(InfdDirectory* directory,
+                              InfdDirectoryExplore* explore,
+                              const GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryQueuedRequest* queued;
+  InfdProgressRequest* request;
+  GSList* list;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-    /* Construct the storage path for this node */
-    node_len = strlen(storage_node->name);
+  g_assert(explore->directory == directory);
 
-    sep_len = 1;
-    if(path[len - 1] == '/') sep_len = 0;
+  priv->explores = g_slist_remove(priv->explores, explore);
+  explore->node->shared.subdir.explore = NULL;
 
-    if(len + sep_len + node_len < path_len)
-    {
-      path_len = len + sep_len + node_len;
-      path = g_realloc(path, path_len + sep_len);
-    }
+  /* The structure itself is freed once the storage has reported back */
+  explore->directory = NULL;
+  explore->node = NULL;
+
+  request = explore->request;
+  explore->request = NULL;
 
-    if(sep_len > 0)
-      path[len] = '/';
+  list = g_slist_reverse(explore->queued);
+  explore->queued = NULL;
 
-    memcpy(path + len + sep_len, storage_node->name, node_len + 1);
+  for(item = list; item != NULL; item = g_slist_next(item))
+  {
+    queued = (InfdDirectoryQueuedRequest*)item->data;
 
-    /* Read ACL */
-    sheet_set = infd_directory_read_acl(
+    infd_directory_send_request_failed(
       directory,
-      path,
-      NULL,
-      verify_table,
-      &local_error
+      queued->connection,
+      queued->xml,
+      error
     );
 
-    if(local_error != NULL)
-    {
-      for(index = 0; index < acls->len; ++index)
-        inf_acl_sheet_set_free(g_ptr_array_index(acls, index));
-      g_ptr_array_free(acls, TRUE);
-      g_hash_table_destroy(verify_table);
-      infd_storage_node_list_free(list);
-      g_free(path);
-      if(request != NULL) inf_request_fail(INF_REQUEST(request), local_error);
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
+    infd_directory_queued_request_free(queued);
+  }
 
-    g_ptr_array_add(acls, sheet_set);
+  g_slist_free(list);
+
+  if(request != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), error);
+    g_object_unref(request);
   }
+}
 
-  g_hash_table_destroy(verify_table);
-  node->shared.subdir.explored = TRUE;
+/* Makes sure that node is being explored, and queues the request xml
+ * received from connection, to be handled again once the exploration has
+ * finished. */
+static gboolean
+infd_directory_node_queue_for_explore(InfdDirectory* directory,
+                                      InfdDirectoryNode* node,
+                                      InfXmlConnection* connection,
+                                      const xmlNodePtr xml,
+                                      GError** error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryQueuedRequest* queued;
+  InfdProgressRequest* request;
+  InfBrowserIter iter;
 
-  g_free(path);
-  if(request != NULL) infd_progress_request_initiated(request, acls->len);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  /* Second pass, fill the directory tree */
-  index = 0;
-  for(item = list, index = 0;
-      item != NULL;
-      item = g_slist_next(item), ++index)
-  {
-    storage_node = (InfdStorageNode*)item->data;
-    sheet_set = (InfAclSheetSet*)g_ptr_array_index(acls, index);
-    new_node = NULL;
+  g_assert(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY);
+  g_assert(node->shared.subdir.explored == FALSE);
 
-    switch(storage_node->type)
+  explore = node->shared.subdir.explore;
+  if(explore == NULL)
+  {
+    if(priv->storage == NULL)
     {
-    case INFD_STORAGE_NODE_SUBDIRECTORY:
-      new_node = infd_directory_node_new_subdirectory(
-        directory,
-        node,
-        priv->node_counter++,
-        g_strdup(storage_node->name),
-        sheet_set,
-        FALSE
+      g_set_error_literal(
+        error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_NO_STORAGE,
+        inf_directory_strerror(INF_DIRECTORY_ERROR_NO_STORAGE)
       );
 
-      break;
-    case INFD_STORAGE_NODE_NOTE:
-      /* TODO: Currently we ignore notes of unknown type. Perhaps we should
-       * report some error. */
-      plugin = g_hash_table_lookup(priv->plugins, storage_node->identifier);
-      if(plugin != NULL)
-      {
-        new_node = infd_directory_node_new_note(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          plugin
-        );
-      }
-      else
-      {
-        new_node = infd_directory_node_new_unknown(
-          directory,
-          node,
-          priv->node_counter++,
-          g_strdup(storage_node->name),
-          sheet_set,
-          FALSE,
-          storage_node->identifier
-        );
-      }
-
-      break;
-    default:
-      g_assert_not_reached();
-      break;
+      return FALSE;
     }
 
-    inf_acl_sheet_set_free(sheet_set);
-
-    if(new_node != NULL)
-    {
-      /* Announce the new node. In most cases, this does nothing on the
-       * network because there are no connections that have this node open
-       * (otherwise, we would already have explored the node earlier).
-       * However, if the background storage is replaced by a new one, the root
-       * folder of the new storage will be explored immediately (see below in
-       * infd_directory_set_storage()) and there might still be connections
-       * interesting in root folder changes (because they opened the root
-       * folder from the old storage). Also, local users might be interested
-       * in the new node. */
-      infd_directory_node_register(
-        directory,
-        new_node,
-        INFD_REQUEST(request),
-        NULL,
+    request = INFD_PROGRESS_REQUEST(
+      g_object_new(
+        INFD_TYPE_PROGRESS_REQUEST,
+        "type", "explore-node",
+        "node-id", node->id,
+        "requestor", connection,
         NULL
-      );
-    }
+      )
+    );
+
+    iter.node_id = node->id;
+    iter.node = node;
+    inf_browser_begin_request(
+      INF_BROWSER(directory),
+      &iter,
+      INF_REQUEST(request)
+    );
+
+    explore = infd_directory_node_explore_begin(directory, node, request);
+    g_object_unref(request);
+  }
+
+  queued = g_slice_new(InfdDirectoryQueuedRequest);
+  queued->connection = connection;
+  queued->xml = xmlCopyNode(xml, 1);
+  g_object_ref(connection);
+
+  explore->queued = g_slist_prepend(explore->queued, queued);
+  return TRUE;
+}
 
-    if(request != NULL) infd_progress_request_progress(request);
-  }
+/* Drops all requests of connection that wait for an exploration or for a
+ * session to be read */
+static void
+infd_directory_remove_queued_requests(InfdDirectory* directory,
+                                      InfXmlConnection* connection)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryExplore* explore;
+  InfdDirectoryQueuedRequest* queued;
+  InfdDirectoryLoad* load;
+  GSList* item;
+  GSList* queued_item;
+  GSList* next;
 
-  g_ptr_array_free(acls, TRUE);
+  priv = INFD_DIRECTORY_PRIVATE(directory);
 
-  if(request != NULL)
+  for(item = priv->explores; item != NULL; item = g_slist_next(item))
   {
-    iter.node_id = node->id;
-    iter.node = node;
+    explore = (InfdDirectoryExplore*)item->data;
+    for(queued_item = explore->queued; queued_item != NULL; queued_item = next)
+    {
+      next = g_slist_next(queued_item);
+      queued = (InfdDirectoryQueuedRequest*)queued_item->data;
 
-    inf_request_finish(
-      INF_REQUEST(request),
-      inf_request_result_make_explore_node(INF_BROWSER(directory), &iter)
-    );
+      if(queued->connection == connection)
+      {
+        explore->queued = g_slist_delete_link(explore->queued, queued_item);
+        infd_directory_queued_request_free(queued);
+      }
+    }
   }
 
-  infd_storage_node_list_free(list);
+  for(item = priv->loads; item != NULL; item = g_slist_next(item))
+  {
+    load = (InfdDirectoryLoad*)item->data;
+    for(queued_item = load->queued; queued_item != NULL; queued_item = next)
+    {
+      next = g_slist_next(queued_item);
+      queued = (InfdDirectoryQueuedRequest*)queued_item->data;
 
-  return TRUE;
+      if(queued->connection == connection)
+      {
+        load->queued = g_slist_delete_link(load->queued, queued_item);
+        infd_directory_queued_request_free(queued);
+      }
+    }
+  }
 }
 
 static InfdDirectoryNode*
@@ -4643,7 +5868,12 @@ infd_directory_node_add_note(InfdDirectory* directory,
   if(local_error == NULL)
   {
     node_id = priv->node_counter++;
-    group = infd_directory_create_subscription_group(directory, node_id);
+    /* Sessions that already exist stay in the thread they were made in */
+    group = infd_directory_create_subscription_group(
+      directory,
+      node_id,
+      session == NULL
+    );
 
     if(subscribe_connection == TRUE)
     {
@@ -4840,7 +6070,7 @@ infd_directory_node_add_sync_in(InfdDirectory* directory,
     node_id = priv->node_counter++;
 
     subscription_group =
-      infd_directory_create_subscription_group(directory, node_id);
+      infd_directory_create_subscription_group(directory, node_id, FALSE);
 
     if(subscribe_sync_conn == TRUE)
     {
@@ -5036,6 +6266,32 @@ infd_directory_node_remove(InfdDirectory* directory,
   }
 }
 
+/* Creates a proxy for a session that has just been read from the storage.
+ * The proxy is not linked to the node. */
+static InfdSessionProxy*
+infd_directory_node_make_session_proxy(InfdDirectory* directory,
+                                       InfdDirectoryNode* node,
+                                       InfSession* session)
+{
+  InfCommunicationHostedGroup* group;
+  InfdSessionProxy* proxy;
+
+  /* Buffer might have been marked as modified while reading the session, but
+   * as we just read it from the storage, we don't consider it modified. */
+  inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+
+  group = infd_directory_create_subscription_group(directory, node->id, TRUE);
+
+  proxy = infd_directory_create_session_proxy_with_group(
+    directory,
+    session,
+    group
+  );
+
+  g_object_unref(group);
+  return proxy;
+}
+
 /* Returns the session for the given node. This does not link the session
  * (if it isn't already). This means that the next time this function is
  * called, the session will be created again if you don't link it yourself,
@@ -5049,9 +6305,10 @@ infd_directory_node_make_session(InfdDirectory* directory,
   InfSession* session;
   GSList* item;
   InfdDirectorySubreq* subreq;
-  InfCommunicationHostedGroup* group;
   InfdSessionProxy* proxy;
   gchar* path;
+  InfIo* io;
+  InfCommunicationManager* manager;
 
   g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
 
@@ -5081,11 +6338,18 @@ infd_directory_node_make_session(InfdDirectory* directory,
   /* If we don't have a background storage then all nodes are in memory */
   g_assert(priv->storage != NULL);
 
+  infd_directory_get_worker_context(
+    directory,
+    infd_directory_get_worker_for_node(directory, node->id),
+    &io,
+    &manager
+  );
+
   infd_directory_node_get_path(node, &path, NULL);
   session = node->shared.note.plugin->session_read(
     priv->storage,
-    priv->io,
-    priv->communication_manager,
+    io,
+    manager,
     path,
     node->shared.note.plugin->user_data,
     error
@@ -5093,22 +6357,279 @@ infd_directory_node_make_session(InfdDirectory* directory,
   g_free(path);
   if(session == NULL) return NULL;
 
-  /* Buffer might have been marked as modified while reading the session, but
-   * as we just read it from the storage, we don't consider it modified. */
-  inf_buffer_set_modified(inf_session_get_buffer(session), FALSE);
+  proxy = infd_directory_node_make_session_proxy(directory, node, session);
+  g_object_unref(session);
 
-  group = infd_directory_create_subscription_group(directory, node->id);
+  return proxy;
+}
 
-  proxy = infd_directory_create_session_proxy_with_group(
+static void
+infd_directory_load_free(InfdDirectoryLoad* load)
+{
+  g_assert(load->queued == NULL);
+
+  if(load->request != NULL)
+    g_object_unref(load->request);
+  if(load->proxy != NULL)
+    g_object_unref(load->proxy);
+
+  g_slice_free(InfdDirectoryLoad, load);
+}
+
+static void
+infd_directory_load_read_cb(InfSession* session,
+                            const GError* error,
+                            gpointer user_data)
+{
+  InfdDirectoryLoad* load;
+  InfdDirectory* directory;
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryNode* node;
+  InfdDirectoryQueuedRequest* queued;
+  InfBrowserIter iter;
+  GSList* list;
+  GSList* item;
+  GError* local_error;
+
+  load = (InfdDirectoryLoad*)user_data;
+  directory = load->directory;
+
+  if(directory == NULL)
+  {
+    infd_directory_load_free(load);
+    return;
+  }
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+  node = load->node;
+
+  priv->loads = g_slist_remove(priv->loads, load);
+
+  /* Nothing else creates a session for the node while it is being read */
+  g_assert(node->shared.note.session == NULL);
+
+  if(error == NULL)
+  {
+    load->proxy =
+      infd_directory_node_make_session_proxy(directory, node, session);
+  }
+
+  if(load->local == TRUE || error != NULL)
+  {
+    if(error != NULL)
+    {
+      inf_request_fail(INF_REQUEST(load->request), error);
+    }
+    else
+    {
+      infd_directory_node_link_session(
+        directory,
+        node,
+        load->request,
+        load->proxy
+      );
+
+      iter.node_id = node->id;
+      iter.node = node;
+
+      inf_request_finish(
+        INF_REQUEST(load->request),
+        inf_request_result_make_subscribe_session(
+          INF_BROWSER(directory),
+          &iter,
+          INF_SESSION_PROXY(load->proxy)
+        )
+      );
+    }
+
+    g_object_unref(load->request);
+    load->request = NULL;
+  }
+
+  /* Now handle the requests that had to wait for the session, in the order
+   * in which they were made. These take the session and the request from
+   * the load while it is still set on the node. */
+  list = g_slist_reverse(load->queued);
+  load->queued = NULL;
+
+  for(item = list; item != NULL; item = g_slist_next(item))
+  {
+    queued = (InfdDirectoryQueuedRequest*)item->data;
+
+    if(error != NULL)
+    {
+      infd_directory_send_request_failed(
+        directory,
+        queued->connection,
+        queued->xml,
+        error
+      );
+    }
+    else
+    {
+      infd_directory_handle_message(directory, queued->connection, queued->xml);
+    }
+
+    infd_directory_queued_request_free(queued);
+  }
+
+  g_slist_free(list);
+  node->shared.note.load = NULL;
+
+  /* If none of the waiting connections has subscribed, for example because
+   * they have been removed in the meanwhile, nobody finishes the request. */
+  if(load->request != NULL &&
+     infd_directory_find_subreq_by_node_id(
+       directory,
+       INFD_DIRECTORY_SUBREQ_SESSION,
+       node->id
+     ) == NULL)
+  {
+    local_error = NULL;
+
+    g_set_error_literal(
+      &local_error,
+      inf_directory_error_quark(),
+      INF_DIRECTORY_ERROR_FAILED,
+      _("Nobody is waiting for the session anymore")
+    );
+
+    inf_request_fail(INF_REQUEST(load->request), local_error);
+    g_error_free(local_error);
+  }
+
+  infd_directory_load_free(load);
+}
+
+/* Starts reading the session of node from the storage in the background,
+ * with the plugin's session_read_async. request is finished once the
+ * session has been read if the load is made local, otherwise it is handed
+ * to the subscription requests of the queued requests. */
+static InfdDirectoryLoad*
+infd_directory_node_load_begin(InfdDirectory* directory,
+                               InfdDirectoryNode* node,
+                               InfdRequest* request)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryLoad* load;
+  InfIo* io;
+  InfCommunicationManager* manager;
+  gchar* path;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(priv->storage != NULL);
+  g_assert(node->type == INFD_DIRECTORY_NODE_NOTE);
+  g_assert(node->shared.note.session == NULL);
+  g_assert(node->shared.note.load == NULL);
+  g_assert(node->shared.note.plugin->session_read_async != NULL);
+
+  load = g_slice_new(InfdDirectoryLoad);
+  load->directory = directory;
+  load->node = node;
+  load->request = request;
+  load->local = FALSE;
+  load->queued = NULL;
+  load->proxy = NULL;
+
+  g_object_ref(request);
+
+  node->shared.note.load = load;
+  priv->loads = g_slist_prepend(priv->loads, load);
+
+  infd_directory_get_worker_context(
     directory,
-    session,
-    group
+    infd_directory_get_worker_for_node(directory, node->id),
+    &io,
+    &manager
   );
 
-  g_object_unref(group);
-  g_object_unref(session);
+  infd_directory_node_get_path(node, &path, NULL);
 
-  return proxy;
+  node->shared.note.plugin->session_read_async(
+    priv->storage,
+    io,
+    manager,
+    path,
+    node->shared.note.plugin->user_data,
+    priv->io,
+    infd_directory_load_read_cb,
+    load
+  );
+
+  g_free(path);
+  return load;
+}
+
+/* Queues the request xml received from connection, to be handled again
+ * once the session of the load's node has been read. */
+static void
+infd_directory_node_queue_for_load(InfdDirectory* directory,
+                                   InfdDirectoryLoad* load,
+                                   InfXmlConnection* connection,
+                                   const xmlNodePtr xml)
+{
+  InfdDirectoryQueuedRequest* queued;
+
+  queued = g_slice_new(InfdDirectoryQueuedRequest);
+  queued->connection = connection;
+  queued->xml = xmlCopyNode(xml, 1);
+  g_object_ref(connection);
+
+  load->queued = g_slist_prepend(load->queued, queued);
+}
+
+/* Stops waiting for a session to be read. The request and all queued
+ * requests fail with the given error. */
+static void
+infd_directory_load_cancel(InfdDirectory* directory,
+                           InfdDirectoryLoad* load,
+                           const GError* error)
+{
+  InfdDirectoryPrivate* priv;
+  InfdDirectoryQueuedRequest* queued;
+  InfdRequest* request;
+  GSList* list;
+  GSList* item;
+
+  priv = INFD_DIRECTORY_PRIVATE(directory);
+
+  g_assert(load->directory == directory);
+
+  priv->loads = g_slist_remove(priv->loads, load);
+  load->node->shared.note.load = NULL;
+
+  /* The structure itself is freed once the plugin has reported back */
+  load->directory = NULL;
+  load->node = NULL;
+
+  request = load->request;
+  load->request = NULL;
+
+  list = g_slist_reverse(load->queued);
+  load->queued = NULL;
+
+  for(item = list; item != NULL; item = g_slist_next(item))
+  {
+    queued = (InfdDirectoryQueuedRequest*)item->data;
+
+    infd_directory_send_request_failed(
+      directory,
+      queued->connection,
+      queued->xml,
+      error
+    );
+
+    infd_directory_queued_request_free(queued);
+  }
+
+  g_slist_free(list);
+
+  if(request != NULL)
+  {
+    inf_request_fail(INF_REQUEST(request), error);
+    g_object_unref(request);
+  }
 }
 
 /*
@@ -5573,15 +7094,10 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfAclMask perms;
-  GSList* item;
-  InfdProgressRequest* request;
-  InfBrowserIter iter;
-  GError* local_error;
   InfdDirectoryNode* child;
   xmlNodePtr reply_xml;
   gchar* seq;
   guint total;
-  const InfAclSheetSet* sheet_set;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
@@ -5599,35 +7115,17 @@ infd_directory_handle_explore_node(InfdDirectory* directory,
   if(!infd_directory_check_auth(directory, node, connection, &perms, error))
     return FALSE;
 
+  /* Read the node from the storage in the background, and reply once that
+   * has finished. */
   if(node->shared.subdir.explored == FALSE)
   {
-    request = INFD_PROGRESS_REQUEST(
-      g_object_new(
-        INFD_TYPE_PROGRESS_REQUEST,
-        "type", "explore-node",
-        "node-id", node->id,
-        "requestor", connection,
-        NULL
-      )
-    );
-
-    iter.node_id = node->id;
-    iter.node = node;
-    inf_browser_begin_request(
-      INF_BROWSER(directory),
-      &iter,
-      INF_REQUEST(request)
+    return infd_directory_node_queue_for_explore(
+      directory,
+      node,
+      connection,
+      xml,
+      error
     );
-
-    local_error = NULL;
-    infd_directory_node_explore(directory, node, request, &local_error);
-    g_object_unref(request);
-
-    if(local_error != NULL)
-    {
-      g_propagate_error(error, local_error);
-      return FALSE;
-    }
   }
 
   if(g_slist_find(node->shared.subdir.connections, connection) != NULL)
@@ -5789,7 +7287,25 @@ infd_directory_handle_add_node(InfdDirectory* directory,
     if(sheet_set != NULL)
       inf_acl_sheet_set_free(sheet_set);
     xmlFree(type);
-    return FALSE;
+    return FALSE;
+  }
+
+  /* The content of the parent node needs to be known to add a new node to
+   * it, so handle the request again once it has been read from the
+   * storage. */
+  if(parent->shared.subdir.explored == FALSE)
+  {
+    if(sheet_set != NULL)
+      inf_acl_sheet_set_free(sheet_set);
+    xmlFree(type);
+
+    return infd_directory_node_queue_for_explore(
+      directory,
+      parent,
+      connection,
+      xml,
+      error
+    );
   }
 
   if(is_subdirectory == TRUE)
@@ -5999,6 +7515,7 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
   GSList* item;
   InfdDirectorySubreq* subreq;
   InfdSessionProxy* proxy;
+  InfdDirectoryLoad* load;
   InfBrowserIter iter;
   InfdRequest* request;
   InfCommunicationGroup* group;
@@ -6062,6 +7579,53 @@ infd_directory_handle_subscribe_session(InfdDirectory* directory,
     proxy = node->shared.note.session;
   }
 
+  load = node->shared.note.load;
+  if(request == NULL && proxy == NULL && load != NULL)
+  {
+    if(load->proxy != NULL)
+    {
+      /* The session has just been read for the requests that waited for
+       * it. The first of them takes the request of the load. */
+      request = load->request;
+      proxy = load->proxy;
+    }
+    else
+    {
+      /* Handle the request again once the session has been read */
+      infd_directory_node_queue_for_load(directory, load, connection, xml);
+      return TRUE;
+    }
+  }
+  else if(request == NULL && proxy == NULL &&
+          node->shared.note.session == NULL &&
+          node->shared.note.plugin->session_read_async != NULL)
+  {
+    /* Read the session in the background */
+    request = INFD_REQUEST(
+      g_object_new(
+        INFD_TYPE_REQUEST,
+        "type", "subscribe-session",
+        "node-id", node->id,
+        "requestor", connection,
+        NULL
+      )
+    );
+
+    iter.node_id = node->id;
+    iter.node = node;
+    inf_browser_begin_request(
+      INF_BROWSER(directory),
+      &iter,
+      INF_REQUEST(request)
+    );
+
+    load = infd_directory_node_load_begin(directory, node, request);
+    g_object_unref(request);
+
+    infd_directory_node_queue_for_load(directory, load, connection, xml);
+    return TRUE;
+  }
+
   if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
     return FALSE;
 
@@ -6177,6 +7741,7 @@ infd_directory_handle_save_session(InfdDirectory* directory,
   gchar* path;
   gchar* seq;
   InfSession* session;
+  InfXmlConnection* proxy_connection;
   gboolean result;
 
   priv = INFD_DIRECTORY_PRIVATE(directory);
@@ -6204,8 +7769,22 @@ infd_directory_handle_save_session(InfdDirectory* directory,
     error
   );
 
-  if(node->shared.note.session == NULL ||
-     !infd_session_proxy_is_subscribed(node->shared.note.session, connection))
+  proxy_connection = NULL;
+  if(node->shared.note.session != NULL)
+  {
+    proxy_connection = infd_directory_get_connection_for_proxy(
+      directory,
+      node->shared.note.session,
+      connection,
+      FALSE
+    );
+  }
+
+  if(proxy_connection == NULL ||
+     !infd_session_proxy_is_subscribed(
+       node->shared.note.session,
+       proxy_connection
+     ))
   {
     g_set_error_literal(
       error,
@@ -6235,6 +7814,19 @@ infd_directory_handle_save_session(InfdDirectory* directory,
   );
 #endif
 
+  if(node->shared.note.plugin->session_write_async != NULL)
+  {
+    /* Check the request now, so that it can only fail with an error from
+     * the storage once the session is being written. */
+    if(!infd_directory_make_seq(directory, connection, xml, &seq, error))
+      return FALSE;
+    g_free(seq);
+
+    /* The reply is sent when the session has been written */
+    infd_directory_node_save_session_async(directory, node, connection, xml);
+    return TRUE;
+  }
+
   infd_directory_node_get_path(node, &path, NULL);
 
   g_object_get(
@@ -7361,7 +8953,12 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
 
     infd_session_proxy_subscribe_to(
       subreq->shared.session.session,
-      connection,
+      infd_directory_get_connection_for_proxy(
+        directory,
+        subreq->shared.session.session,
+        connection,
+        TRUE
+      ),
       info->seq_id,
       TRUE
     );
@@ -7499,7 +9096,18 @@ infd_directory_handle_subscribe_ack(InfdDirectory* directory,
 
     /* Don't sync session to client if the client added this node, since the
      * node is empty anyway. */
-    infd_session_proxy_subscribe_to(proxy, connection, info->seq_id, FALSE);
+    infd_session_proxy_subscribe_to(
+      proxy,
+      infd_directory_get_connection_for_proxy(
+        directory,
+        proxy,
+        connection,
+        TRUE
+      ),
+      info->seq_id,
+      FALSE
+    );
+
     g_object_unref(proxy);
 
     break;
@@ -7789,6 +9397,8 @@ infd_directory_connection_notify_status_cb(GObject* object,
 
   if(status == INF_XML_CONNECTION_OPEN)
   {
+    infd_directory_lock_workers(directory);
+
     info = (InfdDirectoryConnectionInfo*)g_hash_table_lookup(
       priv->connections,
       connection
@@ -7803,6 +9413,8 @@ infd_directory_connection_notify_status_cb(GObject* object,
     );
 
     infd_directory_send_welcome_message(directory, connection);
+
+    infd_directory_unlock_workers(directory);
   }
 }
 
@@ -7822,6 +9434,8 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   directory = INFD_DIRECTORY(user_data);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
+  infd_directory_lock_workers(directory);
+
   /* TODO: Update last seen time, and write user list to storage */
 
   /* Remove sync-ins from this connection */
@@ -7854,6 +9468,8 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
       infd_directory_remove_subreq(directory, request);
   }
 
+  infd_directory_remove_queued_requests(directory, connection);
+
   if(priv->root != NULL)
   {
     if(priv->root->shared.subdir.explored == TRUE)
@@ -7872,12 +9488,24 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
   }
 
   info = g_hash_table_lookup(priv->connections, connection);
+  infd_directory_connection_info_release_mirrors(directory, info);
   g_slice_free(InfdDirectoryConnectionInfo, info);
 
   inf_signal_handlers_disconnect_by_func(G_OBJECT(connection),
     G_CALLBACK(infd_directory_connection_notify_status_cb),
     directory);
 
+  if(priv->workers != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(G_OBJECT(connection),
+      G_CALLBACK(infd_directory_connection_received_cb),
+      directory);
+
+    inf_signal_handlers_disconnect_by_func(G_OBJECT(connection),
+      G_CALLBACK(infd_directory_connection_sent_cb),
+      directory);
+  }
+
   g_hash_table_remove(priv->connections, connection);
 
   g_signal_emit(
@@ -7887,6 +9515,7 @@ infd_directory_member_removed_cb(InfCommunicationGroup* group,
     connection
   );
 
+  infd_directory_unlock_workers(directory);
   g_object_unref(connection);
 }
 
@@ -7895,8 +9524,13 @@ infd_directory_account_storage_account_added_cb(InfdAccountStorage* storage,
                                                 const InfAclAccount* acc,
                                                 gpointer user_data)
 {
+  InfdDirectory* directory;
+  directory = INFD_DIRECTORY(user_data);
+
   /* An account has been externally added to the storage: Announce */
-  infd_directory_announce_acl_account(INFD_DIRECTORY(user_data), acc, NULL);
+  infd_directory_lock_workers(directory);
+  infd_directory_announce_acl_account(directory, acc, NULL);
+  infd_directory_unlock_workers(directory);
 }
 
 static void
@@ -7904,16 +9538,23 @@ infd_directory_account_storage_account_removed_cb(InfdAccountStorage* storage,
                                                   const InfAclAccount* acc,
                                                   gpointer user_data)
 {
+  InfdDirectory* directory;
+  directory = INFD_DIRECTORY(user_data);
+
   /* An account has been externally removed from the storage: Cleanup ACL
    * sheets and announce. */
+  infd_directory_lock_workers(directory);
+
   infd_directory_cleanup_acl_account(
-    INFD_DIRECTORY(user_data),
+    directory,
     acc,
     TRUE,
     NULL,
     NULL,
     NULL
   );
+
+  infd_directory_unlock_workers(directory);
 }
 
 /*
@@ -7935,6 +9576,27 @@ infd_directory_set_storage(InfdDirectory* directory,
    * going to no storage, then keep current set of documents. */
   if(storage != NULL)
   {
+    /* Do not wait for the old storage to report the root node */
+    if(priv->root->shared.subdir.explore != NULL)
+    {
+      error = NULL;
+
+      g_set_error_literal(
+        &error,
+        inf_directory_error_quark(),
+        INF_DIRECTORY_ERROR_FAILED,
+        _("The storage has been changed during exploration")
+      );
+
+      infd_directory_explore_cancel(
+        directory,
+        priv->root->shared.subdir.explore,
+        error
+      );
+
+      g_error_free(error);
+    }
+
     /* TODO: Update last seen times of all connected users,
      * and write user list to storage. */
 
@@ -8561,8 +10223,19 @@ infd_directory_init(InfdDirectory* directory)
   priv->orig_root_acl = NULL;
   priv->sync_ins = NULL;
   priv->subscription_requests = NULL;
+  priv->explores = NULL;
+  priv->loads = NULL;
+  priv->saves = NULL;
 
   priv->chat_session = NULL;
+
+  priv->n_workers = 0;
+  priv->workers = NULL;
+  priv->worker_managers = NULL;
+
+  g_mutex_init(&priv->idle_mutex);
+  priv->idle_nodes = g_hash_table_new(NULL, NULL);
+  priv->idle_dispatch = NULL;
 }
 
 static void
@@ -8573,6 +10246,7 @@ infd_directory_constructed(GObject* object)
 
   InfAclSheet sheet;
   InfAclSheetSet sheet_set;
+  guint i;
 
   /* We only use central method for directory handling */
   static const gchar* const methods[] = { "centrol", NULL };
@@ -8585,6 +10259,23 @@ infd_directory_constructed(GObject* object)
   /* TODO: Use default communication manager in case none is set */
   g_assert(priv->communication_manager != NULL);
 
+  if(priv->n_workers > 0)
+  {
+    g_assert(priv->io != NULL);
+
+    /* From now on, everything the directory does in the main thread runs
+     * with all workers locked. */
+    priv->workers = infd_worker_io_new(priv->io, priv->n_workers);
+    g_object_unref(priv->io);
+    priv->io = INF_IO(priv->workers);
+    g_object_ref(priv->io);
+
+    priv->worker_managers =
+      g_new(InfCommunicationManager*, priv->n_workers);
+    for(i = 0; i < priv->n_workers; ++i)
+      priv->worker_managers[i] = inf_communication_manager_new();
+  }
+
   priv->group = inf_communication_manager_open_group(
     priv->communication_manager,
     "InfDirectory",
@@ -8638,10 +10329,18 @@ infd_directory_dispose(GObject* object)
   InfdDirectoryPrivate* priv;
   GHashTableIter iter;
   gpointer key;
+  GSList* item;
+  InfdDirectorySave* save;
+  guint i;
 
   directory = INFD_DIRECTORY(object);
   priv = INFD_DIRECTORY_PRIVATE(directory);
 
+  /* Wait for the worker threads to finish what they are doing. After this
+   * we can access everything directly. */
+  if(priv->workers != NULL)
+    infd_worker_io_stop(priv->workers);
+
   /* First, remove all connections */
   for(g_hash_table_iter_init(&iter, priv->connections);
       g_hash_table_iter_next(&iter, &key, NULL);
@@ -8657,6 +10356,17 @@ infd_directory_dispose(GObject* object)
   g_assert(priv->subscription_requests == NULL);
   g_assert(priv->sync_ins == NULL);
 
+  /* Sessions that are still being written are released when writing has
+   * finished. */
+  for(item = priv->saves; item != NULL; item = g_slist_next(item))
+  {
+    save = (InfdDirectorySave*)item->data;
+    save->directory = NULL;
+  }
+
+  g_slist_free(priv->saves);
+  priv->saves = NULL;
+
   /* We have dropped all references to connections now, so these do not try
    * to tell anyone that the directory tree has gone or whatever. */
   inf_signal_handlers_disconnect_by_func(
@@ -8685,6 +10395,10 @@ infd_directory_dispose(GObject* object)
   infd_directory_node_free(directory, priv->root);
   priv->root = NULL;
 
+  /* Explorations and loads are cancelled when their node is freed */
+  g_assert(priv->explores == NULL);
+  g_assert(priv->loads == NULL);
+
   /* Can be NULL, for example when no storage is set */
   if(priv->orig_root_acl != NULL)
   {
@@ -8698,6 +10412,23 @@ infd_directory_dispose(GObject* object)
   g_object_unref(priv->group);
   g_object_unref(priv->communication_manager);
 
+  if(priv->idle_dispatch != NULL)
+  {
+    inf_io_remove_dispatch(priv->io, priv->idle_dispatch);
+    priv->idle_dispatch = NULL;
+  }
+
+  if(priv->workers != NULL)
+  {
+    for(i = 0; i < priv->n_workers; ++i)
+      g_object_unref(priv->worker_managers[i]);
+    g_free(priv->worker_managers);
+    priv->worker_managers = NULL;
+
+    g_object_unref(priv->workers);
+    priv->workers = NULL;
+  }
+
   g_hash_table_destroy(priv->connections);
   priv->connections = NULL;
 
@@ -8736,6 +10467,9 @@ infd_directory_finalize(GObject* object)
   }
   g_free(priv->transient_accounts);
 
+  g_hash_table_destroy(priv->idle_nodes);
+  g_mutex_clear(&priv->idle_mutex);
+
   G_OBJECT_CLASS(infd_directory_parent_class)->finalize(object);
 }
 
@@ -8784,6 +10518,9 @@ infd_directory_set_property(GObject* object,
   case PROP_CERTIFICATE:
     priv->certificate = (InfCertificateChain*)g_value_dup_boxed(value);
     break;
+  case PROP_WORKER_THREADS:
+    priv->n_workers = g_value_get_uint(value);
+    break;
   case PROP_CHAT_SESSION:
   case PROP_STATUS:
     /* read only */
@@ -8825,6 +10562,9 @@ infd_directory_get_property(GObject* object,
   case PROP_CERTIFICATE:
     g_value_set_boxed(value, priv->certificate);
     break;
+  case PROP_WORKER_THREADS:
+    g_value_set_uint(value, priv->n_workers);
+    break;
   case PROP_CHAT_SESSION:
     g_value_set_object(value, G_OBJECT(priv->chat_session));
     break;
@@ -8841,19 +10581,14 @@ infd_directory_get_property(GObject* object,
  * InfCommunicationObject implementation.
  */
 
-static InfCommunicationScope
-infd_directory_communication_object_received(InfCommunicationObject* object,
-                                             InfXmlConnection* connection,
-                                             const xmlNodePtr node)
+/* Handles a request from connection. This is also used to handle requests
+ * again that had to wait for a subdirectory to be explored. */
+static void
+infd_directory_handle_message(InfdDirectory* directory,
+                              InfXmlConnection* connection,
+                              const xmlNodePtr node)
 {
-  InfdDirectory* directory;
-  InfdDirectoryPrivate* priv;
   GError* local_error;
-  xmlNodePtr reply_xml;
-  gchar* seq;
-
-  directory = INFD_DIRECTORY(object);
-  priv = INFD_DIRECTORY_PRIVATE(directory);
   local_error = NULL;
 
   if(strcmp((const char*)node->name, "explore-node") == 0)
@@ -8997,29 +10732,29 @@ infd_directory_communication_object_received(InfCommunicationObject* object,
 
   if(local_error != NULL)
   {
-    /* TODO: If error is not from the InfDirectoryError error domain, the
-     * client cannot reconstruct the error because he possibly does not know
-     * the error domain (it might even come from a storage plugin). */
-    if(!infd_directory_make_seq(directory, connection, node, &seq, NULL))
-      seq = NULL;
-
-    /* An error happened, so tell the client that the request failed and
-     * what has gone wrong. */
-    reply_xml = inf_xml_util_new_node_from_error(local_error,
-                                                 NULL,
-                                                 "request-failed");
-
-    if(seq != NULL) inf_xml_util_set_attribute(reply_xml, "seq", seq);
-    g_free(seq);
-
-    inf_communication_group_send_message(
-      INF_COMMUNICATION_GROUP(priv->group),
+    infd_directory_send_request_failed(
+      directory,
       connection,
-      reply_xml
+      node,
+      local_error
     );
 
     g_error_free(local_error);
   }
+}
+
+static InfCommunicationScope
+infd_directory_communication_object_received(InfCommunicationObject* object,
+                                             InfXmlConnection* connection,
+                                             const xmlNodePtr node)
+{
+  InfdDirectory* directory;
+  directory = INFD_DIRECTORY(object);
+
+  /* Requests can touch sessions running in worker threads */
+  infd_directory_lock_workers(directory);
+  infd_directory_handle_message(directory, connection, node);
+  infd_directory_unlock_workers(directory);
 
   /* Never forward directory messages */
   return INF_COMMUNICATION_SCOPE_PTP;
@@ -9135,14 +10870,28 @@ infd_directory_browser_unsubscribe_session(InfBrowser* browser,
       node->shared.note.save_timeout = NULL;
     }
 
-    g_object_weak_ref(
-      G_OBJECT(node->shared.note.session),
-      infd_directory_session_weak_ref_cb,
-      node
-    );
+    if(priv->workers != NULL)
+    {
+      /* The last reference might be dropped in a worker thread, in which
+       * case the weak reference callback would run there. Therefore, drop
+       * the session for good. */
+      infd_directory_release_session(
+        directory,
+        node,
+        node->shared.note.session
+      );
+    }
+    else
+    {
+      g_object_weak_ref(
+        G_OBJECT(node->shared.note.session),
+        infd_directory_session_weak_ref_cb,
+        node
+      );
 
-    node->shared.note.weakref = TRUE;
-    g_object_unref(node->shared.note.session);
+      node->shared.note.weakref = TRUE;
+      g_object_unref(node->shared.note.session);
+    }
   }
 }
 
@@ -9274,6 +11023,8 @@ infd_directory_browser_explore(InfBrowser* browser,
   node = (InfdDirectoryNode*)iter->node;
   g_return_val_if_fail(node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY, NULL);
   g_return_val_if_fail(node->shared.subdir.explored == FALSE, NULL);
+  g_return_val_if_fail(node->shared.subdir.explore == NULL, NULL);
+  g_return_val_if_fail(priv->storage != NULL, NULL);
 
   request = g_object_new(
     INFD_TYPE_PROGRESS_REQUEST,
@@ -9295,15 +11046,11 @@ infd_directory_browser_explore(InfBrowser* browser,
 
   inf_browser_begin_request(browser, iter, INF_REQUEST(request));
 
-  infd_directory_node_explore(
-    directory,
-    node,
-    request,
-    NULL
-  );
+  /* The request finishes when the storage has reported back */
+  infd_directory_node_explore_begin(directory, node, request);
 
   g_object_unref(request);
-  return NULL;
+  return INF_REQUEST(request);
 }
 
 static gboolean
@@ -9569,6 +11316,7 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   InfdDirectoryPrivate* priv;
   InfdDirectoryNode* node;
   InfdDirectorySubreq* subreq;
+  InfdDirectoryLoad* load;
   InfdRequest* request;
   InfdSessionProxy* proxy;
   GSList* item;
@@ -9615,11 +11363,23 @@ infd_directory_browser_subscribe(InfBrowser* browser,
     node->id
   );
 
+  load = node->shared.note.load;
   if(subreq != NULL)
   {
     request = subreq->shared.session.request;
     g_object_ref(request);
   }
+  else if(load != NULL)
+  {
+    /* Take the request from the session being read. If it has been read
+     * already, then the requests that waited for it are being handled right
+     * now, and we finish the request here. */
+    request = load->request;
+    if(load->proxy != NULL)
+      load->request = NULL;
+    else
+      g_object_ref(request);
+  }
   else
   {
     request = g_object_new(
@@ -9642,11 +11402,30 @@ infd_directory_browser_subscribe(InfBrowser* browser,
   }
 
   /* Emit begin-request if we created a new request */
-  if(subreq == NULL)
+  if(subreq == NULL && load == NULL)
   {
     inf_browser_begin_request(browser, iter, INF_REQUEST(request));
   }
 
+  /* If the session is being read, or if it can be read in the background,
+   * then it is linked, and the request finishes, once it has been read. */
+  if(load != NULL && load->proxy == NULL)
+  {
+    load->local = TRUE;
+    g_object_unref(request);
+    return INF_REQUEST(request);
+  }
+
+  if(subreq == NULL && load == NULL &&
+     node->shared.note.session == NULL &&
+     node->shared.note.plugin->session_read_async != NULL)
+  {
+    load = infd_directory_node_load_begin(directory, node, request);
+    load->local = TRUE;
+    g_object_unref(request);
+    return INF_REQUEST(request);
+  }
+
   /* Take the session proxy from pending subscription requests, if any. Also,
    * remove the request reference from them, since we will finish the
    * request. */
@@ -9677,9 +11456,15 @@ infd_directory_browser_subscribe(InfBrowser* browser,
     }
   }
 
-  /* If there was no subreq, create the session here */
+  /* If there was no subreq, take the session that has just been read, or
+   * create it here */
   error = NULL;
-  if(proxy == NULL)
+  if(proxy == NULL && load != NULL)
+  {
+    proxy = load->proxy;
+    g_object_ref(proxy);
+  }
+  else if(proxy == NULL)
   {
     proxy = infd_directory_node_make_session(directory, node, &error);
   }
@@ -9808,6 +11593,35 @@ infd_directory_browser_list_pending_requests(InfBrowser* browser,
     }
   }
 
+  /* Explorations in progress */
+  if(node != NULL &&
+     node->type == INFD_DIRECTORY_NODE_SUBDIRECTORY &&
+     node->shared.subdir.explore != NULL &&
+     node->shared.subdir.explore->request != NULL)
+  {
+    if(request_type == NULL || strcmp(request_type, "explore-node") == 0)
+    {
+      list = g_slist_prepend(
+        list,
+        INF_REQUEST(node->shared.subdir.explore->request)
+      );
+    }
+  }
+
+  /* Sessions being read */
+  if(node != NULL &&
+     node->type == INFD_DIRECTORY_NODE_NOTE &&
+     node->shared.note.load != NULL &&
+     node->shared.note.load->request != NULL)
+  {
+    request = INF_REQUEST(node->shared.note.load->request);
+    if(request_type == NULL || strcmp(request_type, "subscribe-session") == 0)
+    {
+      if(g_slist_find(list, request) == NULL)
+        list = g_slist_prepend(list, request);
+    }
+  }
+
   return list;
 }
 
@@ -10515,6 +12329,8 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
 
   infd_directory_node_id_quark =
     g_quark_from_static_string("INFD_DIRECTORY_NODE_ID");
+  infd_directory_worker_quark =
+    g_quark_from_static_string("INFD_DIRECTORY_WORKER");
 
   g_object_class_install_property(
     object_class,
@@ -10587,6 +12403,21 @@ infd_directory_class_init(InfdDirectoryClass* directory_class)
     )
   );
 
+  g_object_class_install_property(
+    object_class,
+    PROP_WORKER_THREADS,
+    g_param_spec_uint(
+      "worker-threads",
+      "Worker threads",
+      "The number of threads running sessions, or 0 to run all sessions "
+      "in the main thread",
+      0,
+      G_MAXUINT,
+      0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
   g_object_class_install_property(
     object_class,
     PROP_CHAT_SESSION,
@@ -10755,6 +12586,46 @@ infd_directory_get_io(InfdDirectory* directory)
   return INFD_DIRECTORY_PRIVATE(directory)->io;
 }
 
+/**
+ * infd_directory_lock:
+ * @directory: A #InfdDirectory.
+ *
+ * If the directory runs sessions in worker threads (see
+ * #InfdDirectory:worker-threads), this function waits until the workers are
+ * idle and prevents them from running until infd_directory_unlock() is
+ * called. This needs to be done before accessing the directory or any of
+ * its sessions from code that is not run by the directory itself, such as
+ * from a callback registered with an #InfIo other than the one returned by
+ * infd_directory_get_io(). Callbacks registered with that #InfIo, and signal
+ * handlers of the directory, are already run with the directory locked.
+ *
+ * Locks are recursive, so the directory may be locked more than once, and
+ * needs to be unlocked the same number of times. The directory must not be
+ * locked from within a session's signal handler, and it must not be locked
+ * when it is finalized. If the directory does not have worker threads this
+ * function does nothing.
+ */
+void
+infd_directory_lock(InfdDirectory* directory)
+{
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  infd_directory_lock_workers(directory);
+}
+
+/**
+ * infd_directory_unlock:
+ * @directory: A #InfdDirectory.
+ *
+ * Allows the worker threads of @directory to run again after a call to
+ * infd_directory_lock().
+ */
+void
+infd_directory_unlock(InfdDirectory* directory)
+{
+  g_return_if_fail(INFD_IS_DIRECTORY(directory));
+  infd_directory_unlock_workers(directory);
+}
+
 /**
  * infd_directory_get_storage:
  * @directory: A #InfdDirectory:
@@ -10906,6 +12777,7 @@ infd_directory_add_plugin(InfdDirectory* directory,
       node->shared.note.plugin = plugin;
       node->shared.note.save_timeout = NULL;
       node->shared.note.weakref = FALSE;
+      node->shared.note.load = NULL;
     }
   }
 
@@ -10935,6 +12807,7 @@ infd_directory_remove_plugin(InfdDirectory* directory,
   GSList* next;
   InfdDirectorySyncIn* sync_in;
   InfdDirectorySubreq* subreq;
+  GError* error;
 
   g_return_if_fail(INFD_IS_DIRECTORY(directory));
   g_return_if_fail(plugin != NULL);
@@ -10954,7 +12827,23 @@ infd_directory_remove_plugin(InfdDirectory* directory,
     if(node->type == INFD_DIRECTORY_NODE_NOTE &&
        node->shared.note.plugin == plugin)
     {
-      /* First, remove the note's session, if any */
+      /* First, stop reading the note's session, or remove it, if any */
+      if(node->shared.note.load != NULL)
+      {
+        error = NULL;
+
+        g_set_error(
+          &error,
+          inf_directory_error_quark(),
+          INF_DIRECTORY_ERROR_TYPE_UNKNOWN,
+          _("The plugin for note type \"%s\" has been removed"),
+          plugin->note_type
+        );
+
+        infd_directory_load_cancel(directory, node->shared.note.load, error);
+        g_error_free(error);
+      }
+
       if(node->shared.note.session != NULL &&
          node->shared.note.weakref == FALSE)
       {
@@ -10974,6 +12863,7 @@ infd_directory_remove_plugin(InfdDirectory* directory,
       g_assert(node->shared.note.plugin == plugin);
       g_assert(node->shared.note.save_timeout == NULL);
       g_assert(node->shared.note.weakref == FALSE);
+      g_assert(node->shared.note.load == NULL);
 
       /* Then, change the type to unknown */
       node->type = INFD_DIRECTORY_NODE_UNKNOWN;
@@ -11080,6 +12970,7 @@ infd_directory_add_connection(InfdDirectory* directory,
     FALSE
   );
 
+  infd_directory_lock_workers(directory);
   inf_communication_hosted_group_add_member(priv->group, connection);
 
   /* Find a free seq id */
@@ -11096,6 +12987,7 @@ infd_directory_add_connection(InfdDirectory* directory,
   info = g_slice_new(InfdDirectoryConnectionInfo);
   info->seq_id = seq_id;
   info->account_id = 0;
+  info->mirrors = NULL;
 
   g_hash_table_insert(priv->connections, connection, info);
   g_object_ref(connection);
@@ -11107,6 +12999,25 @@ infd_directory_add_connection(InfdDirectory* directory,
     directory
   );
 
+  if(priv->workers != NULL)
+  {
+    info->mirrors = g_new0(InfdWorkerConnection*, priv->n_workers);
+
+    g_signal_connect(
+      G_OBJECT(connection),
+      "received",
+      G_CALLBACK(infd_directory_connection_received_cb),
+      directory
+    );
+
+    g_signal_connect(
+      G_OBJECT(connection),
+      "sent",
+      G_CALLBACK(infd_directory_connection_sent_cb),
+      directory
+    );
+  }
+
   g_object_get(G_OBJECT(connection), "status", &status, NULL);
   if(status == INF_XML_CONNECTION_OPEN)
   {
@@ -11122,6 +13033,7 @@ infd_directory_add_connection(InfdDirectory* directory,
     connection
   );
 
+  infd_directory_unlock_workers(directory);
   return TRUE;
 }
 
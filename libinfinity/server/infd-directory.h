@@ -97,6 +97,12 @@ infd_directory_new(InfIo* io,
 InfIo*
 infd_directory_get_io(InfdDirectory* directory);
 
+void
+infd_directory_lock(InfdDirectory* directory);
+
+void
+infd_directory_unlock(InfdDirectory* directory);
+
 InfdStorage*
 infd_directory_get_storage(InfdDirectory* directory);
 
@@ -39,19 +39,66 @@
 # include <fcntl.h>
 # include <dirent.h>
 # include <unistd.h>
+#else
+# include <io.h>
 #endif
 
 typedef struct _InfdFilesystemStoragePrivate InfdFilesystemStoragePrivate;
 struct _InfdFilesystemStoragePrivate {
   gchar* root_directory;
+
+  /* Background I/O for the asynchronous storage calls. Reads are performed
+   * by up to max_threads threads in parallel. Writes are performed one
+   * after the other by a separate thread, so that they hit the disk in the
+   * order in which they were made. */
+  guint max_threads;
+  GThreadPool* read_pool;
+  GThreadPool* write_pool;
+
+  /* Number of writes queued and completed so far, protected by mutex. Any
+   * other operation waits for all writes queued before it to complete. */
+  GMutex mutex;
+  GCond cond;
+  guint64 writes_queued;
+  guint64 writes_done;
+};
+
+typedef enum _InfdFilesystemStorageTaskType {
+  INFD_FILESYSTEM_STORAGE_TASK_READ_SUBDIRECTORY,
+  INFD_FILESYSTEM_STORAGE_TASK_READ_ACL,
+  INFD_FILESYSTEM_STORAGE_TASK_WRITE_ACL
+} InfdFilesystemStorageTaskType;
+
+typedef struct _InfdFilesystemStorageTask InfdFilesystemStorageTask;
+struct _InfdFilesystemStorageTask {
+  InfdFilesystemStorage* storage;
+  InfdFilesystemStorageTaskType type;
+  gchar* path;
+  InfAclSheetSet* sheet_set;
+  guint64 write_serial;
+
+  InfIo* io;
+  union {
+    InfdStorageReadSubdirectoryFunc read_subdirectory;
+    InfdStorageReadAclFunc read_acl;
+    InfdStorageWriteAclFunc write_acl;
+  } func;
+  gpointer user_data;
+
+  GSList* list;
+  GError* error;
 };
 
 enum {
   PROP_0,
 
-  PROP_ROOT_DIRECTORY
+  PROP_ROOT_DIRECTORY,
+  PROP_MAX_THREADS
 };
 
+/* Default number of threads reading from disk in the background */
+#define INFD_FILESYSTEM_STORAGE_DEFAULT_MAX_THREADS 4
+
 #define INFD_FILESYSTEM_STORAGE_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_FILESYSTEM_STORAGE, InfdFilesystemStoragePrivate))
 
 static GQuark infd_filesystem_storage_error_quark;
@@ -204,6 +251,7 @@ infd_filesystem_storage_open_impl(InfdFilesystemStorage* storage,
 #else
   if(strcmp(mode, "r") == 0) open_mode = O_RDONLY;
   else if(strcmp(mode, "w") == 0) open_mode = O_CREAT | O_WRONLY | O_TRUNC;
+  else if(strcmp(mode, "a") == 0) open_mode = O_CREAT | O_WRONLY | O_APPEND;
   else g_assert_not_reached();
   fd = open(path, O_NOFOLLOW | open_mode, 0644);
   if(fd == -1)
@@ -366,6 +414,15 @@ infd_filesystem_storage_init(InfdFilesystemStorage* storage)
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
   priv->root_directory = NULL;
+
+  priv->max_threads = INFD_FILESYSTEM_STORAGE_DEFAULT_MAX_THREADS;
+  priv->read_pool = NULL;
+  priv->write_pool = NULL;
+
+  g_mutex_init(&priv->mutex);
+  g_cond_init(&priv->cond);
+  priv->writes_queued = 0;
+  priv->writes_done = 0;
 }
 
 static void
@@ -377,6 +434,16 @@ infd_filesystem_storage_finalize(GObject* object)
   storage = INFD_FILESYSTEM_STORAGE(object);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
 
+  /* Every task holds a reference on the storage, so there are no tasks left
+   * at this point, and the pools only have idle threads. */
+  if(priv->read_pool != NULL)
+    g_thread_pool_free(priv->read_pool, FALSE, TRUE);
+  if(priv->write_pool != NULL)
+    g_thread_pool_free(priv->write_pool, FALSE, TRUE);
+
+  g_mutex_clear(&priv->mutex);
+  g_cond_clear(&priv->cond);
+
   g_free(priv->root_directory);
 
   G_OBJECT_CLASS(infd_filesystem_storage_parent_class)->finalize(object);
@@ -402,6 +469,18 @@ infd_filesystem_storage_set_property(GObject* object,
       g_value_get_string(value)
     );
 
+    break;
+  case PROP_MAX_THREADS:
+    priv->max_threads = g_value_get_uint(value);
+    if(priv->read_pool != NULL)
+    {
+      g_thread_pool_set_max_threads(
+        priv->read_pool,
+        priv->max_threads,
+        NULL
+      );
+    }
+
     break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
@@ -426,12 +505,46 @@ infd_filesystem_storage_get_property(GObject* object,
   case PROP_ROOT_DIRECTORY:
     g_value_set_string(value, priv->root_directory);
     break;
+  case PROP_MAX_THREADS:
+    g_value_set_uint(value, priv->max_threads);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
     break;
   }
 }
 
+/* Waits until all writes with a serial up to and including the given one
+ * have been performed. */
+static void
+infd_filesystem_storage_wait_for_writes(InfdFilesystemStorage* storage,
+                                        guint64 serial)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->mutex);
+  while(priv->writes_done < serial)
+    g_cond_wait(&priv->cond, &priv->mutex);
+  g_mutex_unlock(&priv->mutex);
+}
+
+/* Waits until all writes queued so far have been performed */
+static void
+infd_filesystem_storage_flush_writes(InfdFilesystemStorage* storage)
+{
+  InfdFilesystemStoragePrivate* priv;
+  guint64 serial;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->mutex);
+  serial = priv->writes_queued;
+  g_mutex_unlock(&priv->mutex);
+
+  infd_filesystem_storage_wait_for_writes(storage, serial);
+}
+
 static gboolean
 infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
                                                             const gchar* path,
@@ -476,9 +589,9 @@ infd_filesystem_storage_storage_read_subdirectory_list_func(const gchar* name,
 }
 
 static GSList*
-infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
-                                                  const gchar* path,
-                                                  GError** error)
+infd_filesystem_storage_read_subdirectory_impl(InfdStorage* storage,
+                                               const gchar* path,
+                                               GError** error)
 {
   InfdFilesystemStorage* fs_storage;
   InfdFilesystemStoragePrivate* priv;
@@ -534,6 +647,8 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
 
+  infd_filesystem_storage_flush_writes(fs_storage);
+
   if(infd_filesystem_storage_verify_path(path, error) == FALSE)
     return FALSE;
 
@@ -550,6 +665,124 @@ infd_filesystem_storage_storage_create_subdirectory(InfdStorage* storage,
   return result;
 }
 
+typedef struct _InfdFilesystemStorageAuxiliaryFiles {
+  const gchar* prefix;
+  gsize prefix_len;
+  GSList* paths;
+} InfdFilesystemStorageAuxiliaryFiles;
+
+/* Suffixes of the files that plugins store next to a note file: a binary
+ * copy of the note, and a snapshot being written, with its binary copy.
+ * Journals are named journal-<n>, with n being a number. */
+static const gchar* const INFD_FILESYSTEM_STORAGE_AUXILIARY_SUFFIXES[] = {
+  "bin",
+  "new",
+  "new.bin",
+  NULL
+};
+
+#define INFD_FILESYSTEM_STORAGE_JOURNAL_PREFIX "journal-"
+
+static gboolean
+infd_filesystem_storage_is_auxiliary_suffix(const gchar* suffix)
+{
+  const gchar* const* auxiliary;
+
+  for(auxiliary = INFD_FILESYSTEM_STORAGE_AUXILIARY_SUFFIXES;
+      *auxiliary != NULL;
+      ++auxiliary)
+  {
+    if(strcmp(suffix, *auxiliary) == 0)
+      return TRUE;
+  }
+
+  if(!g_str_has_prefix(suffix, INFD_FILESYSTEM_STORAGE_JOURNAL_PREFIX))
+    return FALSE;
+
+  suffix += strlen(INFD_FILESYSTEM_STORAGE_JOURNAL_PREFIX);
+  if(*suffix == '\0')
+    return FALSE;
+
+  while(g_ascii_isdigit(*suffix))
+    ++suffix;
+
+  return *suffix == '\0';
+}
+
+static gboolean
+infd_filesystem_storage_list_auxiliary_files_func(const gchar* name,
+                                                  const gchar* path,
+                                                  InfFileType type,
+                                                  gpointer data,
+                                                  GError** error)
+{
+  InfdFilesystemStorageAuxiliaryFiles* files;
+  files = (InfdFilesystemStorageAuxiliaryFiles*)data;
+
+  /* Only match known suffixes, so that the files of other notes whose
+   * name starts with the same prefix are left alone. */
+  if(type == INF_FILE_TYPE_REG &&
+     strncmp(name, files->prefix, files->prefix_len) == 0 &&
+     infd_filesystem_storage_is_auxiliary_suffix(name + files->prefix_len))
+  {
+    files->paths = g_slist_prepend(files->paths, g_strdup(path));
+  }
+
+  return TRUE;
+}
+
+/* Removes the files named <name>.<identifier>.<suffix> next to the note
+ * file at full_name, which plugins use to store additional data for the
+ * note, such as journals. Only the suffixes listed above are removed. */
+static gboolean
+infd_filesystem_storage_remove_auxiliary_files(const gchar* full_name,
+                                               GError** error)
+{
+  InfdFilesystemStorageAuxiliaryFiles files;
+  gchar* dirname;
+  gchar* basename;
+  gchar* prefix;
+  GSList* item;
+  gboolean result;
+  int save_errno;
+
+  dirname = g_path_get_dirname(full_name);
+  basename = g_path_get_basename(full_name);
+  prefix = g_strconcat(basename, ".", NULL);
+  g_free(basename);
+
+  files.prefix = prefix;
+  files.prefix_len = strlen(prefix);
+  files.paths = NULL;
+
+  result = inf_file_util_list_directory(
+    dirname,
+    infd_filesystem_storage_list_auxiliary_files_func,
+    &files,
+    error
+  );
+
+  for(item = files.paths; item != NULL; item = item->next)
+  {
+    if(result == TRUE && g_unlink((const gchar*)item->data) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        infd_filesystem_storage_system_error(save_errno, error);
+        result = FALSE;
+      }
+    }
+
+    g_free(item->data);
+  }
+
+  g_slist_free(files.paths);
+  g_free(prefix);
+  g_free(dirname);
+  return result;
+}
+
 static gboolean
 infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
                                             const gchar* identifier,
@@ -567,6 +800,8 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   fs_storage = INFD_FILESYSTEM_STORAGE(storage);
   priv = INFD_FILESYSTEM_STORAGE_PRIVATE(fs_storage);
 
+  infd_filesystem_storage_flush_writes(fs_storage);
+
   if(infd_filesystem_storage_verify_path(path, error) == FALSE)
     return FALSE;
 
@@ -587,6 +822,8 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
   if(disk_name != converted_name) g_free(disk_name);
 
   result = inf_file_util_delete(full_name, error);
+  if(result == TRUE && identifier != NULL)
+    result = infd_filesystem_storage_remove_auxiliary_files(full_name, error);
   g_free(full_name);
 
   if(result == TRUE)
@@ -613,9 +850,9 @@ infd_filesystem_storage_storage_remove_node(InfdStorage* storage,
 }
 
 static GSList*
-infd_filesystem_storage_storage_read_acl(InfdStorage* storage,
-                                         const gchar* path,
-                                         GError** error)
+infd_filesystem_storage_read_acl_impl(InfdStorage* storage,
+                                      const gchar* path,
+                                      GError** error)
 {
   InfdFilesystemStorage* fs_storage;
   InfdFilesystemStoragePrivate* priv;
@@ -708,10 +945,10 @@ infd_filesystem_storage_storage_read_acl(InfdStorage* storage,
 }
 
 static gboolean
-infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
-                                          const gchar* path,
-                                          const InfAclSheetSet* sheet_set,
-                                          GError** error)
+infd_filesystem_storage_write_acl_impl(InfdStorage* storage,
+                                       const gchar* path,
+                                       const InfAclSheetSet* sheet_set,
+                                       GError** error)
 {
   InfdFilesystemStorage* fs_storage;
   InfdFilesystemStoragePrivate* priv;
@@ -799,6 +1036,325 @@ infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
   return TRUE;
 }
 
+static GSList*
+infd_filesystem_storage_storage_read_subdirectory(InfdStorage* storage,
+                                                  const gchar* path,
+                                                  GError** error)
+{
+  infd_filesystem_storage_flush_writes(INFD_FILESYSTEM_STORAGE(storage));
+  return infd_filesystem_storage_read_subdirectory_impl(storage, path, error);
+}
+
+static GSList*
+infd_filesystem_storage_storage_read_acl(InfdStorage* storage,
+                                         const gchar* path,
+                                         GError** error)
+{
+  infd_filesystem_storage_flush_writes(INFD_FILESYSTEM_STORAGE(storage));
+  return infd_filesystem_storage_read_acl_impl(storage, path, error);
+}
+
+static gboolean
+infd_filesystem_storage_storage_write_acl(InfdStorage* storage,
+                                          const gchar* path,
+                                          const InfAclSheetSet* sheet_set,
+                                          GError** error)
+{
+  infd_filesystem_storage_flush_writes(INFD_FILESYSTEM_STORAGE(storage));
+
+  return infd_filesystem_storage_write_acl_impl(
+    storage,
+    path,
+    sheet_set,
+    error
+  );
+}
+
+static void
+infd_filesystem_storage_task_dispatch_func(gpointer user_data)
+{
+  InfdFilesystemStorageTask* task;
+  GSList* list;
+
+  task = (InfdFilesystemStorageTask*)user_data;
+
+  /* Ownership of the list is passed to the callback */
+  list = task->list;
+  task->list = NULL;
+
+  switch(task->type)
+  {
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_SUBDIRECTORY:
+    task->func.read_subdirectory(
+      INFD_STORAGE(task->storage),
+      list,
+      task->error,
+      task->user_data
+    );
+
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_ACL:
+    task->func.read_acl(
+      INFD_STORAGE(task->storage),
+      list,
+      task->error,
+      task->user_data
+    );
+
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_WRITE_ACL:
+    if(task->func.write_acl != NULL)
+    {
+      task->func.write_acl(
+        INFD_STORAGE(task->storage),
+        task->error,
+        task->user_data
+      );
+    }
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+infd_filesystem_storage_task_free(gpointer data)
+{
+  InfdFilesystemStorageTask* task;
+  task = (InfdFilesystemStorageTask*)data;
+
+  switch(task->type)
+  {
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_SUBDIRECTORY:
+    infd_storage_node_list_free(task->list);
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_ACL:
+    infd_storage_acl_list_free(task->list);
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_WRITE_ACL:
+    g_assert(task->list == NULL);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  if(task->sheet_set != NULL)
+    inf_acl_sheet_set_free(task->sheet_set);
+  if(task->error != NULL)
+    g_error_free(task->error);
+
+  g_free(task->path);
+  g_object_unref(task->io);
+  g_object_unref(task->storage);
+  g_slice_free(InfdFilesystemStorageTask, task);
+}
+
+/* Runs in a thread of one of the pools */
+static void
+infd_filesystem_storage_task_func(gpointer data,
+                                  gpointer user_data)
+{
+  InfdFilesystemStorageTask* task;
+  InfdFilesystemStoragePrivate* priv;
+
+  task = (InfdFilesystemStorageTask*)data;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(task->storage);
+
+  switch(task->type)
+  {
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_SUBDIRECTORY:
+    infd_filesystem_storage_wait_for_writes(task->storage, task->write_serial);
+
+    task->list = infd_filesystem_storage_read_subdirectory_impl(
+      INFD_STORAGE(task->storage),
+      task->path,
+      &task->error
+    );
+
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_READ_ACL:
+    infd_filesystem_storage_wait_for_writes(task->storage, task->write_serial);
+
+    task->list = infd_filesystem_storage_read_acl_impl(
+      INFD_STORAGE(task->storage),
+      task->path,
+      &task->error
+    );
+
+    break;
+  case INFD_FILESYSTEM_STORAGE_TASK_WRITE_ACL:
+    infd_filesystem_storage_write_acl_impl(
+      INFD_STORAGE(task->storage),
+      task->path,
+      task->sheet_set,
+      &task->error
+    );
+
+    g_mutex_lock(&priv->mutex);
+    g_assert(priv->writes_done + 1 == task->write_serial);
+    priv->writes_done = task->write_serial;
+    g_cond_broadcast(&priv->cond);
+    g_mutex_unlock(&priv->mutex);
+
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  /* Report the result, and release the task, in the thread of the InfIo. In
+   * particular, the last reference on the storage must not be dropped in one
+   * of its own pool threads. */
+  inf_io_add_dispatch(
+    task->io,
+    infd_filesystem_storage_task_dispatch_func,
+    task,
+    infd_filesystem_storage_task_free
+  );
+}
+
+static InfdFilesystemStorageTask*
+infd_filesystem_storage_task_new(InfdFilesystemStorage* storage,
+                                 InfdFilesystemStorageTaskType type,
+                                 const gchar* path,
+                                 InfIo* io,
+                                 gpointer user_data)
+{
+  InfdFilesystemStorageTask* task;
+
+  task = g_slice_new(InfdFilesystemStorageTask);
+  task->storage = storage;
+  task->type = type;
+  task->path = g_strdup(path);
+  task->sheet_set = NULL;
+  task->write_serial = 0;
+  task->io = io;
+  task->user_data = user_data;
+  task->list = NULL;
+  task->error = NULL;
+
+  g_object_ref(storage);
+  g_object_ref(io);
+  return task;
+}
+
+static void
+infd_filesystem_storage_push_read(InfdFilesystemStorage* storage,
+                                  InfdFilesystemStorageTask* task)
+{
+  InfdFilesystemStoragePrivate* priv;
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  g_mutex_lock(&priv->mutex);
+  task->write_serial = priv->writes_queued;
+  g_mutex_unlock(&priv->mutex);
+
+  if(priv->read_pool == NULL)
+  {
+    priv->read_pool = g_thread_pool_new(
+      infd_filesystem_storage_task_func,
+      NULL,
+      priv->max_threads,
+      FALSE,
+      NULL
+    );
+  }
+
+  g_thread_pool_push(priv->read_pool, task, NULL);
+}
+
+static void
+infd_filesystem_storage_storage_read_subdirectory_async(
+  InfdStorage* storage,
+  const gchar* path,
+  InfIo* io,
+  InfdStorageReadSubdirectoryFunc func,
+  gpointer user_data)
+{
+  InfdFilesystemStorageTask* task;
+
+  task = infd_filesystem_storage_task_new(
+    INFD_FILESYSTEM_STORAGE(storage),
+    INFD_FILESYSTEM_STORAGE_TASK_READ_SUBDIRECTORY,
+    path,
+    io,
+    user_data
+  );
+
+  task->func.read_subdirectory = func;
+  infd_filesystem_storage_push_read(INFD_FILESYSTEM_STORAGE(storage), task);
+}
+
+static void
+infd_filesystem_storage_storage_read_acl_async(InfdStorage* storage,
+                                               const gchar* path,
+                                               InfIo* io,
+                                               InfdStorageReadAclFunc func,
+                                               gpointer user_data)
+{
+  InfdFilesystemStorageTask* task;
+
+  task = infd_filesystem_storage_task_new(
+    INFD_FILESYSTEM_STORAGE(storage),
+    INFD_FILESYSTEM_STORAGE_TASK_READ_ACL,
+    path,
+    io,
+    user_data
+  );
+
+  task->func.read_acl = func;
+  infd_filesystem_storage_push_read(INFD_FILESYSTEM_STORAGE(storage), task);
+}
+
+static void
+infd_filesystem_storage_storage_write_acl_async(
+  InfdStorage* storage,
+  const gchar* path,
+  const InfAclSheetSet* sheet_set,
+  InfIo* io,
+  InfdStorageWriteAclFunc func,
+  gpointer user_data)
+{
+  InfdFilesystemStoragePrivate* priv;
+  InfdFilesystemStorageTask* task;
+
+  priv = INFD_FILESYSTEM_STORAGE_PRIVATE(storage);
+
+  task = infd_filesystem_storage_task_new(
+    INFD_FILESYSTEM_STORAGE(storage),
+    INFD_FILESYSTEM_STORAGE_TASK_WRITE_ACL,
+    path,
+    io,
+    user_data
+  );
+
+  task->func.write_acl = func;
+  if(sheet_set != NULL)
+    task->sheet_set = inf_acl_sheet_set_copy(sheet_set);
+
+  g_mutex_lock(&priv->mutex);
+  task->write_serial = ++priv->writes_queued;
+  g_mutex_unlock(&priv->mutex);
+
+  /* A single thread performs the writes, so that they are performed in
+   * order. */
+  if(priv->write_pool == NULL)
+  {
+    priv->write_pool = g_thread_pool_new(
+      infd_filesystem_storage_task_func,
+      NULL,
+      1,
+      FALSE,
+      NULL
+    );
+  }
+
+  g_thread_pool_push(priv->write_pool, task, NULL);
+}
+
 static void
 infd_filesystem_storage_class_init(
   InfdFilesystemStorageClass* filesystem_storage_class)
@@ -825,6 +1381,20 @@ infd_filesystem_storage_class_init(
       G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
     )
   );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_MAX_THREADS,
+    g_param_spec_uint(
+      "max-threads",
+      "Maximum threads",
+      "The maximum number of threads reading from disk in the background",
+      1,
+      G_MAXINT,
+      INFD_FILESYSTEM_STORAGE_DEFAULT_MAX_THREADS,
+      G_PARAM_READWRITE
+    )
+  );
 }
 
 static void
@@ -840,6 +1410,12 @@ infd_filesystem_storage_storage_iface_init(InfdStorageInterface* iface)
     infd_filesystem_storage_storage_read_acl;
   iface->write_acl =
     infd_filesystem_storage_storage_write_acl;
+  iface->read_subdirectory_async =
+    infd_filesystem_storage_storage_read_subdirectory_async;
+  iface->read_acl_async =
+    infd_filesystem_storage_storage_read_acl_async;
+  iface->write_acl_async =
+    infd_filesystem_storage_storage_write_acl_async;
 }
 
 /**
@@ -918,13 +1494,15 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * @storage: A #InfdFilesystemStorage.
  * @identifier: The type of node to open.
  * @path: The path to open, in UTF-8.
- * @mode: Either "r" for reading or "w" for writing.
+ * @mode: Either "r" for reading, "w" for writing or "a" for appending.
  * @full_path: (out) (type filename) (transfer full): Return location
  * of the full filename, or %NULL.
  * @error: Location to store error information, if any.
  *
  * Opens a file in the given path within the storage's root directory. If
  * the file exists already, and @mode is set to "w", the file is overwritten.
+ * If @mode is set to "a", the file is created if it does not exist, and
+ * everything written to it is appended at its end.
  *
  * If @full_path is not %NULL, then it will be set to a newly allocated
  * string which contains the full name of the opened file, in the Glib file
@@ -933,7 +1511,11 @@ infd_filesystem_storage_get_path(InfdFilesystemStorage* storage,
  * Only if @identifier starts with &quot;Inf&quot;, the file will show up in
  * the directory listing of infd_storage_read_subdirectory(). Other
  * identifiers can be used to store custom data in the filesystem, linked to
- * this #InfdFilesystemStorage object.
+ * this #InfdFilesystemStorage object. Files whose identifier is the
+ * identifier of a note followed by &quot;.bin&quot;, &quot;.new&quot;,
+ * &quot;.new.bin&quot; or &quot;.journal-<n>&quot; with n being a number,
+ * such as &quot;InfText.journal-3&quot;, are considered to belong to that
+ * note, and are removed together with it.
  *
  * Returns: (transfer full): A stream for the open file. Close with
  * infd_filesystem_storage_stream_close().
@@ -980,6 +1562,55 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
   return res;
 }
 
+/**
+ * infd_filesystem_storage_map:
+ * @storage: A #InfdFilesystemStorage.
+ * @identifier: The type of node to map.
+ * @path: The path to map, in UTF-8.
+ * @error: Location to store error information, if any.
+ *
+ * Maps a file in the given path within the storage's root directory into
+ * memory for reading. See infd_filesystem_storage_open() for how
+ * @identifier and @path should be interpreted. This is useful for files in
+ * a binary format, which can then be read without copying their content
+ * first.
+ *
+ * Returns: (transfer full) (allow-none): A #GMappedFile for the file, or
+ * %NULL on error. Free with g_mapped_file_unref().
+ **/
+GMappedFile*
+infd_filesystem_storage_map(InfdFilesystemStorage* storage,
+                            const gchar* identifier,
+                            const gchar* path,
+                            GError** error)
+{
+  FILE* file;
+  GMappedFile* mapped;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(identifier != NULL, NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  file = infd_filesystem_storage_open(
+    storage,
+    identifier,
+    path,
+    "r",
+    NULL,
+    error
+  );
+
+  if(file == NULL)
+    return NULL;
+
+  /* The mapping stays valid after the file has been closed */
+  mapped = g_mapped_file_new_from_fd(fileno(file), FALSE, error);
+  infd_filesystem_storage_stream_close(file);
+
+  return mapped;
+}
+
 /**
  * infd_filesystem_storage_read_xml_file:
  * @storage: A #InfdFilesystemStorage.
@@ -1146,4 +1777,28 @@ infd_filesystem_storage_stream_write(FILE* file,
   return fwrite(buffer, 1, len, file);
 }
 
+/**
+ * infd_filesystem_storage_stream_sync:
+ * @file: A #FILE opened with infd_filesystem_storage_open().
+ *
+ * Flushes all data written to @file so far and waits until it has been
+ * written to the disk, by calling fflush() and then fsync() on the
+ * underlying file descriptor. Use this function to make sure that data
+ * written to the file survives a crash of the system.
+ *
+ * Returns: 0 on success, or -1 on error, in which case errno is set.
+ */
+int
+infd_filesystem_storage_stream_sync(FILE* file)
+{
+  if(fflush(file) != 0)
+    return -1;
+
+#ifdef G_OS_WIN32
+  return _commit(_fileno(file));
+#else
+  return fsync(fileno(file));
+#endif
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -77,6 +77,12 @@ infd_filesystem_storage_open(InfdFilesystemStorage* storage,
                              gchar** full_path,
                              GError** error);
 
+GMappedFile*
+infd_filesystem_storage_map(InfdFilesystemStorage* storage,
+                            const gchar* identifier,
+                            const gchar* path,
+                            GError** error);
+
 xmlDocPtr
 infd_filesystem_storage_read_xml_file(InfdFilesystemStorage* storage,
                                       const gchar* identifier,
@@ -104,6 +110,9 @@ infd_filesystem_storage_stream_write(FILE* file,
                                      gconstpointer buffer,
                                      gsize len);
 
+int
+infd_filesystem_storage_stream_sync(FILE* file);
+
 G_END_DECLS
 
 #endif /* __INFD_FILESYSTEM_STORAGE_H__ */
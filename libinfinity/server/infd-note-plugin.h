@@ -53,6 +53,33 @@ typedef gboolean(*InfdNotePluginSessionWrite)(InfdStorage*,
                                               gpointer,
                                               GError**);
 
+/* Called with the session read by session_read_async, or with an error.
+ * The session is only valid during the call; take a reference to keep it. */
+typedef void(*InfdNotePluginSessionReadFunc)(InfSession*,
+                                             const GError*,
+                                             gpointer);
+
+/* Called when session_write_async has finished writing a session */
+typedef void(*InfdNotePluginSessionWriteFunc)(const GError*,
+                                              gpointer);
+
+typedef void(*InfdNotePluginSessionReadAsync)(InfdStorage*,
+                                              InfIo*,
+                                              InfCommunicationManager*,
+                                              const gchar*,
+                                              gpointer,
+                                              InfIo*,
+                                              InfdNotePluginSessionReadFunc,
+                                              gpointer);
+
+typedef void(*InfdNotePluginSessionWriteAsync)(InfdStorage*,
+                                               InfSession*,
+                                               const gchar*,
+                                               gpointer,
+                                               InfIo*,
+                                               InfdNotePluginSessionWriteFunc,
+                                               gpointer);
+
 typedef struct _InfdNotePlugin InfdNotePlugin;
 struct _InfdNotePlugin {
   gpointer user_data;
@@ -67,6 +94,14 @@ struct _InfdNotePlugin {
   InfdNotePluginSessionNew session_new;
   InfdNotePluginSessionRead session_read;
   InfdNotePluginSessionWrite session_write;
+
+  /* Optional variants of session_read and session_write which do not block.
+   * The result is reported via the InfIo passed after the plugin's user
+   * data. The content of the session is taken when session_write_async is
+   * called, so the session can be modified while it is being written. If
+   * these are NULL, the directory uses the blocking functions. */
+  InfdNotePluginSessionReadAsync session_read_async;
+  InfdNotePluginSessionWriteAsync session_write_async;
 };
 
 G_END_DECLS
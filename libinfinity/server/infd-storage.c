@@ -20,6 +20,31 @@
 #include <libinfinity/server/infd-storage.h>
 #include <libinfinity/inf-define-enum.h>
 
+typedef enum _InfdStorageAsyncType {
+  INFD_STORAGE_ASYNC_READ_SUBDIRECTORY,
+  INFD_STORAGE_ASYNC_READ_ACL,
+  INFD_STORAGE_ASYNC_WRITE_ACL
+} InfdStorageAsyncType;
+
+/* Result of a synchronous storage call, to be reported via InfIo when the
+ * storage does not implement the asynchronous variant. */
+typedef struct _InfdStorageAsyncResult InfdStorageAsyncResult;
+struct _InfdStorageAsyncResult {
+  InfdStorage* storage;
+  InfdStorageAsyncType type;
+
+  union {
+    InfdStorageReadSubdirectoryFunc read_subdirectory;
+    InfdStorageReadAclFunc read_acl;
+    InfdStorageWriteAclFunc write_acl;
+  } func;
+
+  gpointer user_data;
+
+  GSList* list;
+  GError* error;
+};
+
 static const GEnumValue infd_storage_node_type_values[] = {
   {
     INFD_STORAGE_NODE_SUBDIRECTORY,
@@ -46,6 +71,94 @@ infd_storage_default_init(InfdStorageInterface* iface)
 {
 }
 
+static InfdStorageAsyncResult*
+infd_storage_async_result_new(InfdStorage* storage,
+                              InfdStorageAsyncType type,
+                              gpointer user_data)
+{
+  InfdStorageAsyncResult* result;
+
+  result = g_slice_new(InfdStorageAsyncResult);
+  result->storage = storage;
+  result->type = type;
+  result->user_data = user_data;
+  result->list = NULL;
+  result->error = NULL;
+
+  g_object_ref(storage);
+  return result;
+}
+
+static void
+infd_storage_async_result_dispatch_func(gpointer user_data)
+{
+  InfdStorageAsyncResult* result;
+  GSList* list;
+
+  result = (InfdStorageAsyncResult*)user_data;
+
+  /* Ownership of the list is passed to the callback */
+  list = result->list;
+  result->list = NULL;
+
+  switch(result->type)
+  {
+  case INFD_STORAGE_ASYNC_READ_SUBDIRECTORY:
+    result->func.read_subdirectory(
+      result->storage,
+      list,
+      result->error,
+      result->user_data
+    );
+
+    break;
+  case INFD_STORAGE_ASYNC_READ_ACL:
+    result->func.read_acl(
+      result->storage,
+      list,
+      result->error,
+      result->user_data
+    );
+
+    break;
+  case INFD_STORAGE_ASYNC_WRITE_ACL:
+    result->func.write_acl(result->storage, result->error, result->user_data);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+static void
+infd_storage_async_result_free(gpointer data)
+{
+  InfdStorageAsyncResult* result;
+  result = (InfdStorageAsyncResult*)data;
+
+  switch(result->type)
+  {
+  case INFD_STORAGE_ASYNC_READ_SUBDIRECTORY:
+    infd_storage_node_list_free(result->list);
+    break;
+  case INFD_STORAGE_ASYNC_READ_ACL:
+    infd_storage_acl_list_free(result->list);
+    break;
+  case INFD_STORAGE_ASYNC_WRITE_ACL:
+    g_assert(result->list == NULL);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+
+  if(result->error != NULL)
+    g_error_free(result->error);
+
+  g_object_unref(result->storage);
+  g_slice_free(InfdStorageAsyncResult, result);
+}
+
 /**
  * infd_storage_node_new_subdirectory: (constructor)
  * @path: Path to the node.
@@ -380,4 +493,193 @@ infd_storage_write_acl(InfdStorage* storage,
   return iface->write_acl(storage, path, sheet_set, error);
 }
 
+/**
+ * infd_storage_read_subdirectory_async:
+ * @storage: A #InfdStorage.
+ * @path: A path pointing to a subdirectory node.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @func: (scope async): Function to call with the result.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Starts reading a subdirectory from the storage, like
+ * infd_storage_read_subdirectory(). When the operation has finished, @func
+ * is called in the thread running @io. @func is never called before this
+ * function returns.
+ *
+ * Storages that support it perform the operation in the background. For
+ * other storages this function performs the synchronous call and only
+ * reports the result asynchronously.
+ **/
+void
+infd_storage_read_subdirectory_async(InfdStorage* storage,
+                                     const gchar* path,
+                                     InfIo* io,
+                                     InfdStorageReadSubdirectoryFunc func,
+                                     gpointer user_data)
+{
+  InfdStorageInterface* iface;
+  InfdStorageAsyncResult* result;
+
+  g_return_if_fail(INFD_IS_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+  g_return_if_fail(INF_IS_IO(io));
+  g_return_if_fail(func != NULL);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+
+  if(iface->read_subdirectory_async != NULL)
+  {
+    iface->read_subdirectory_async(storage, path, io, func, user_data);
+  }
+  else
+  {
+    g_return_if_fail(iface->read_subdirectory != NULL);
+
+    result = infd_storage_async_result_new(
+      storage,
+      INFD_STORAGE_ASYNC_READ_SUBDIRECTORY,
+      user_data
+    );
+
+    result->func.read_subdirectory = func;
+    result->list = iface->read_subdirectory(storage, path, &result->error);
+
+    inf_io_add_dispatch(
+      io,
+      infd_storage_async_result_dispatch_func,
+      result,
+      infd_storage_async_result_free
+    );
+  }
+}
+
+/**
+ * infd_storage_read_acl_async:
+ * @storage: A #InfdStorage.
+ * @path: A path pointing to an existing node.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @func: (scope async): Function to call with the result.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Starts reading the ACL for the node at the path @path from the storage,
+ * like infd_storage_read_acl(). When the operation has finished, @func is
+ * called in the thread running @io. @func is never called before this
+ * function returns.
+ **/
+void
+infd_storage_read_acl_async(InfdStorage* storage,
+                            const gchar* path,
+                            InfIo* io,
+                            InfdStorageReadAclFunc func,
+                            gpointer user_data)
+{
+  InfdStorageInterface* iface;
+  InfdStorageAsyncResult* result;
+
+  g_return_if_fail(INFD_IS_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+  g_return_if_fail(INF_IS_IO(io));
+  g_return_if_fail(func != NULL);
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+
+  if(iface->read_acl_async != NULL)
+  {
+    iface->read_acl_async(storage, path, io, func, user_data);
+  }
+  else
+  {
+    g_return_if_fail(iface->read_acl != NULL);
+
+    result = infd_storage_async_result_new(
+      storage,
+      INFD_STORAGE_ASYNC_READ_ACL,
+      user_data
+    );
+
+    result->func.read_acl = func;
+    result->list = iface->read_acl(storage, path, &result->error);
+
+    inf_io_add_dispatch(
+      io,
+      infd_storage_async_result_dispatch_func,
+      result,
+      infd_storage_async_result_free
+    );
+  }
+}
+
+/**
+ * infd_storage_write_acl_async:
+ * @storage: A #InfdStorage.
+ * @path: A path to an existing node.
+ * @sheet_set: Sheets to set for the node at @path, or %NULL.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @func: (scope async) (allow-none): Function to call with the result, or
+ * %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Starts writing the ACL defined by @sheet_set into storage, like
+ * infd_storage_write_acl(). @sheet_set is copied, so it can be freed after
+ * this function returns. When the operation has finished, @func is called
+ * in the thread running @io.
+ *
+ * Writes started with this function for the same storage are performed in
+ * the order in which they were started, and they are performed before any
+ * synchronous call on @storage that is made later.
+ **/
+void
+infd_storage_write_acl_async(InfdStorage* storage,
+                             const gchar* path,
+                             const InfAclSheetSet* sheet_set,
+                             InfIo* io,
+                             InfdStorageWriteAclFunc func,
+                             gpointer user_data)
+{
+  InfdStorageInterface* iface;
+  InfdStorageAsyncResult* result;
+  GError* error;
+
+  g_return_if_fail(INFD_IS_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+  g_return_if_fail(INF_IS_IO(io));
+
+  iface = INFD_STORAGE_GET_IFACE(storage);
+
+  if(iface->write_acl_async != NULL)
+  {
+    iface->write_acl_async(storage, path, sheet_set, io, func, user_data);
+  }
+  else
+  {
+    g_return_if_fail(iface->write_acl != NULL);
+
+    error = NULL;
+    iface->write_acl(storage, path, sheet_set, &error);
+
+    if(func != NULL)
+    {
+      result = infd_storage_async_result_new(
+        storage,
+        INFD_STORAGE_ASYNC_WRITE_ACL,
+        user_data
+      );
+
+      result->func.write_acl = func;
+      result->error = error;
+
+      inf_io_add_dispatch(
+        io,
+        infd_storage_async_result_dispatch_func,
+        result,
+        infd_storage_async_result_free
+      );
+    }
+    else if(error != NULL)
+    {
+      g_error_free(error);
+    }
+  }
+}
+
 /* vim:set et sw=2 ts=2: */
@@ -23,6 +23,7 @@
 #include <glib-object.h>
 
 #include <libinfinity/common/inf-acl.h>
+#include <libinfinity/common/inf-io.h>
 
 G_BEGIN_DECLS
 
@@ -58,13 +59,62 @@ struct _InfdStorageAcl {
   InfAclMask perms;  
 };
 
+/**
+ * InfdStorageReadSubdirectoryFunc:
+ * @storage: The #InfdStorage the subdirectory was read from.
+ * @nodes: (transfer full) (element-type InfdStorageNode) (allow-none): The
+ * content of the subdirectory, or %NULL.
+ * @error: Error information in case the operation failed, or %NULL.
+ * @user_data: User-defined data specified in
+ * infd_storage_read_subdirectory_async().
+ *
+ * Callback function that is called when an asynchronous read of a
+ * subdirectory has finished. The callback takes ownership of @nodes and needs
+ * to free it with infd_storage_node_list_free().
+ */
+typedef void(*InfdStorageReadSubdirectoryFunc)(InfdStorage* storage,
+                                               GSList* nodes,
+                                               const GError* error,
+                                               gpointer user_data);
+
+/**
+ * InfdStorageReadAclFunc:
+ * @storage: The #InfdStorage the ACL was read from.
+ * @acl: (transfer full) (element-type InfdStorageAcl) (allow-none): The ACL
+ * of the node, or %NULL.
+ * @error: Error information in case the operation failed, or %NULL.
+ * @user_data: User-defined data specified in infd_storage_read_acl_async().
+ *
+ * Callback function that is called when an asynchronous read of an ACL has
+ * finished. The callback takes ownership of @acl and needs to free it with
+ * infd_storage_acl_list_free().
+ */
+typedef void(*InfdStorageReadAclFunc)(InfdStorage* storage,
+                                      GSList* acl,
+                                      const GError* error,
+                                      gpointer user_data);
+
+/**
+ * InfdStorageWriteAclFunc:
+ * @storage: The #InfdStorage the ACL was written to.
+ * @error: Error information in case the operation failed, or %NULL.
+ * @user_data: User-defined data specified in infd_storage_write_acl_async().
+ *
+ * Callback function that is called when an asynchronous write of an ACL has
+ * finished.
+ */
+typedef void(*InfdStorageWriteAclFunc)(InfdStorage* storage,
+                                       const GError* error,
+                                       gpointer user_data);
+
 struct _InfdStorageInterface {
   GTypeInterface parent;
 
-  /* All these calls are supposed to be synchronous, e.g. completly perform
-   * the required task. Some day, we could implement asynchronous
-   * behaviour in InfdDirectory (e.g. it caches operations and executes
-   * them via the storage in the background). */
+  /* The synchronous calls completely perform the required task before they
+   * return. The asynchronous variants start the task and report the result
+   * via the given InfIo once it has been performed. They are optional; if a
+   * storage does not implement them, the synchronous call is made instead
+   * and only the result is reported via the InfIo. */
 
   /* Virtual Table */
   GSList* (*read_subdirectory)(InfdStorage* storage,
@@ -91,6 +141,25 @@ struct _InfdStorageInterface {
                         const gchar* path,
                         const InfAclSheetSet* sheet_set,
                         GError** error);
+
+  void (*read_subdirectory_async)(InfdStorage* storage,
+                                  const gchar* path,
+                                  InfIo* io,
+                                  InfdStorageReadSubdirectoryFunc func,
+                                  gpointer user_data);
+
+  void (*read_acl_async)(InfdStorage* storage,
+                         const gchar* path,
+                         InfIo* io,
+                         InfdStorageReadAclFunc func,
+                         gpointer user_data);
+
+  void (*write_acl_async)(InfdStorage* storage,
+                          const gchar* path,
+                          const InfAclSheetSet* sheet_set,
+                          InfIo* io,
+                          InfdStorageWriteAclFunc func,
+                          gpointer user_data);
 };
 
 GType
@@ -157,6 +226,28 @@ infd_storage_write_acl(InfdStorage* storage,
                        const InfAclSheetSet* sheet_set,
                        GError** error);
 
+void
+infd_storage_read_subdirectory_async(InfdStorage* storage,
+                                     const gchar* path,
+                                     InfIo* io,
+                                     InfdStorageReadSubdirectoryFunc func,
+                                     gpointer user_data);
+
+void
+infd_storage_read_acl_async(InfdStorage* storage,
+                            const gchar* path,
+                            InfIo* io,
+                            InfdStorageReadAclFunc func,
+                            gpointer user_data);
+
+void
+infd_storage_write_acl_async(InfdStorage* storage,
+                             const gchar* path,
+                             const InfAclSheetSet* sheet_set,
+                             InfIo* io,
+                             InfdStorageWriteAclFunc func,
+                             gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __INFD_STORAGE_H__ */
@@ -0,0 +1,541 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* InfdWorkerConnection stands in for a client connection in a worker thread
+ * of InfdDirectory. All network I/O still happens in the main thread: the
+ * directory forwards messages received and sent on the real connection to
+ * the connection's mirror in the worker that is responsible for them, and
+ * messages sent through the mirror are passed on to the main thread which
+ * sends them through the real connection. */
+
+#include <libinfinity/server/infd-worker-connection.h>
+#include <libinfinity/common/inf-xml-blob.h>
+#include <libinfinity/common/inf-certificate-chain.h>
+
+typedef enum _InfdWorkerConnectionEventType {
+  INFD_WORKER_CONNECTION_EVENT_RECEIVED,
+  INFD_WORKER_CONNECTION_EVENT_SENT
+} InfdWorkerConnectionEventType;
+
+typedef struct _InfdWorkerConnectionEvent InfdWorkerConnectionEvent;
+struct _InfdWorkerConnectionEvent {
+  InfdWorkerConnectionEventType type;
+  xmlNodePtr xml;
+};
+
+typedef struct _InfdWorkerConnectionPrivate InfdWorkerConnectionPrivate;
+struct _InfdWorkerConnectionPrivate {
+  InfdWorkerIo* worker;
+  InfIo* main_io;
+
+  /* The real connection. Only accessed in the main thread. Not referenced;
+   * the directory detaches the mirror before the connection goes away. */
+  InfXmlConnection* connection;
+
+  /* Changed only with the worker lock held */
+  InfXmlConnectionStatus status;
+
+  gchar* network;
+  gchar* local_id;
+  gchar* remote_id;
+  InfCertificateChain* remote_certificate;
+
+  /* Everything below is protected by mutex */
+  GMutex mutex;
+
+  /* Events to be delivered in the worker thread */
+  GQueue incoming;
+  gboolean incoming_scheduled;
+
+  /* Messages to be sent in the main thread */
+  GQueue outgoing;
+  gboolean outgoing_scheduled;
+  gboolean close_requested;
+};
+
+enum {
+  PROP_0,
+
+  /* From InfXmlConnection */
+  PROP_STATUS,
+  PROP_NETWORK,
+  PROP_LOCAL_ID,
+  PROP_REMOTE_ID,
+  PROP_LOCAL_CERTIFICATE,
+  PROP_REMOTE_CERTIFICATE
+};
+
+#define INFD_WORKER_CONNECTION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_WORKER_CONNECTION, InfdWorkerConnectionPrivate))
+
+static void infd_worker_connection_xml_connection_iface_init(InfXmlConnectionInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfdWorkerConnection, infd_worker_connection, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfdWorkerConnection)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, infd_worker_connection_xml_connection_iface_init))
+
+static void
+infd_worker_connection_free_xml(gpointer data)
+{
+  xmlNodePtr xml;
+  xml = (xmlNodePtr)data;
+
+  inf_xml_blob_release_references(xml);
+  xmlFreeNode(xml);
+}
+
+static void
+infd_worker_connection_event_free(gpointer data)
+{
+  InfdWorkerConnectionEvent* event;
+  event = (InfdWorkerConnectionEvent*)data;
+
+  infd_worker_connection_free_xml(event->xml);
+  g_slice_free(InfdWorkerConnectionEvent, event);
+}
+
+/* Runs in the worker thread, with the worker lock held */
+static void
+infd_worker_connection_incoming_func(gpointer user_data)
+{
+  InfdWorkerConnection* connection;
+  InfdWorkerConnectionPrivate* priv;
+  InfdWorkerConnectionEvent* event;
+
+  connection = INFD_WORKER_CONNECTION(user_data);
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  g_mutex_lock(&priv->mutex);
+  priv->incoming_scheduled = FALSE;
+
+  while((event = g_queue_pop_head(&priv->incoming)) != NULL)
+  {
+    g_mutex_unlock(&priv->mutex);
+
+    if(priv->status == INF_XML_CONNECTION_OPEN)
+    {
+      switch(event->type)
+      {
+      case INFD_WORKER_CONNECTION_EVENT_RECEIVED:
+        inf_xml_connection_received(INF_XML_CONNECTION(connection), event->xml);
+        break;
+      case INFD_WORKER_CONNECTION_EVENT_SENT:
+        inf_xml_connection_sent(INF_XML_CONNECTION(connection), event->xml);
+        break;
+      default:
+        g_assert_not_reached();
+        break;
+      }
+    }
+
+    infd_worker_connection_event_free(event);
+    g_mutex_lock(&priv->mutex);
+  }
+
+  g_mutex_unlock(&priv->mutex);
+}
+
+/* Runs in the main thread */
+static void
+infd_worker_connection_outgoing_func(gpointer user_data)
+{
+  InfdWorkerConnection* connection;
+  InfdWorkerConnectionPrivate* priv;
+  InfXmlConnectionStatus status;
+  xmlNodePtr xml;
+  gboolean close;
+
+  connection = INFD_WORKER_CONNECTION(user_data);
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  g_mutex_lock(&priv->mutex);
+  priv->outgoing_scheduled = FALSE;
+
+  while((xml = g_queue_pop_head(&priv->outgoing)) != NULL)
+  {
+    g_mutex_unlock(&priv->mutex);
+
+    status = INF_XML_CONNECTION_CLOSED;
+    if(priv->connection != NULL)
+      g_object_get(G_OBJECT(priv->connection), "status", &status, NULL);
+
+    if(status == INF_XML_CONNECTION_OPEN)
+      inf_xml_connection_send(priv->connection, xml);
+    else
+      infd_worker_connection_free_xml(xml);
+
+    g_mutex_lock(&priv->mutex);
+  }
+
+  close = priv->close_requested;
+  priv->close_requested = FALSE;
+  g_mutex_unlock(&priv->mutex);
+
+  if(close && priv->connection != NULL)
+    inf_xml_connection_close(priv->connection);
+}
+
+static void
+infd_worker_connection_schedule_outgoing(InfdWorkerConnection* connection)
+{
+  InfdWorkerConnectionPrivate* priv;
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  /* Must be called with mutex held */
+  if(!priv->outgoing_scheduled)
+  {
+    priv->outgoing_scheduled = TRUE;
+
+    inf_io_add_dispatch(
+      priv->main_io,
+      infd_worker_connection_outgoing_func,
+      g_object_ref(connection),
+      g_object_unref
+    );
+  }
+}
+
+static void
+infd_worker_connection_push_incoming(InfdWorkerConnection* connection,
+                                     InfdWorkerConnectionEventType type,
+                                     const xmlNodePtr xml)
+{
+  InfdWorkerConnectionPrivate* priv;
+  InfdWorkerConnectionEvent* event;
+
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  event = g_slice_new(InfdWorkerConnectionEvent);
+  event->type = type;
+  event->xml = inf_xml_blob_copy_tree(xml);
+
+  g_mutex_lock(&priv->mutex);
+  g_queue_push_tail(&priv->incoming, event);
+
+  if(!priv->incoming_scheduled)
+  {
+    priv->incoming_scheduled = TRUE;
+
+    inf_io_add_dispatch(
+      INF_IO(priv->worker),
+      infd_worker_connection_incoming_func,
+      g_object_ref(connection),
+      g_object_unref
+    );
+  }
+
+  g_mutex_unlock(&priv->mutex);
+}
+
+static void
+infd_worker_connection_init(InfdWorkerConnection* connection)
+{
+  InfdWorkerConnectionPrivate* priv;
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  priv->worker = NULL;
+  priv->main_io = NULL;
+  priv->connection = NULL;
+  priv->status = INF_XML_CONNECTION_OPEN;
+
+  priv->network = NULL;
+  priv->local_id = NULL;
+  priv->remote_id = NULL;
+  priv->remote_certificate = NULL;
+
+  g_mutex_init(&priv->mutex);
+  g_queue_init(&priv->incoming);
+  priv->incoming_scheduled = FALSE;
+  g_queue_init(&priv->outgoing);
+  priv->outgoing_scheduled = FALSE;
+  priv->close_requested = FALSE;
+}
+
+static void
+infd_worker_connection_dispose(GObject* object)
+{
+  InfdWorkerConnection* connection;
+  InfdWorkerConnectionPrivate* priv;
+
+  connection = INFD_WORKER_CONNECTION(object);
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  /* Pending dispatches hold a reference, so there are none at this point */
+  while(!g_queue_is_empty(&priv->incoming))
+    infd_worker_connection_event_free(g_queue_pop_head(&priv->incoming));
+  while(!g_queue_is_empty(&priv->outgoing))
+    infd_worker_connection_free_xml(g_queue_pop_head(&priv->outgoing));
+
+  if(priv->worker != NULL)
+  {
+    g_object_unref(priv->worker);
+    priv->worker = NULL;
+  }
+
+  if(priv->main_io != NULL)
+  {
+    g_object_unref(priv->main_io);
+    priv->main_io = NULL;
+  }
+
+  G_OBJECT_CLASS(infd_worker_connection_parent_class)->dispose(object);
+}
+
+static void
+infd_worker_connection_finalize(GObject* object)
+{
+  InfdWorkerConnection* connection;
+  InfdWorkerConnectionPrivate* priv;
+
+  connection = INFD_WORKER_CONNECTION(object);
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  g_free(priv->network);
+  g_free(priv->local_id);
+  g_free(priv->remote_id);
+
+  if(priv->remote_certificate != NULL)
+    inf_certificate_chain_unref(priv->remote_certificate);
+
+  g_mutex_clear(&priv->mutex);
+
+  G_OBJECT_CLASS(infd_worker_connection_parent_class)->finalize(object);
+}
+
+static void
+infd_worker_connection_get_property(GObject* object,
+                                    guint prop_id,
+                                    GValue* value,
+                                    GParamSpec* pspec)
+{
+  InfdWorkerConnection* connection;
+  InfdWorkerConnectionPrivate* priv;
+
+  connection = INFD_WORKER_CONNECTION(object);
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  switch(prop_id)
+  {
+  case PROP_STATUS:
+    g_value_set_enum(value, priv->status);
+    break;
+  case PROP_NETWORK:
+    g_value_set_string(value, priv->network);
+    break;
+  case PROP_LOCAL_ID:
+    g_value_set_string(value, priv->local_id);
+    break;
+  case PROP_REMOTE_ID:
+    g_value_set_string(value, priv->remote_id);
+    break;
+  case PROP_LOCAL_CERTIFICATE:
+    /* The local certificate is owned by the main thread */
+    g_value_set_pointer(value, NULL);
+    break;
+  case PROP_REMOTE_CERTIFICATE:
+    g_value_set_boxed(value, priv->remote_certificate);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+/*
+ * InfXmlConnection interface implementation
+ */
+
+static void
+infd_worker_connection_xml_connection_close(InfXmlConnection* connection)
+{
+  InfdWorkerConnectionPrivate* priv;
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  /* The status of the mirror changes once the real connection has been
+   * closed and the directory detaches the mirror. */
+  g_mutex_lock(&priv->mutex);
+  priv->close_requested = TRUE;
+  infd_worker_connection_schedule_outgoing(
+    INFD_WORKER_CONNECTION(connection)
+  );
+  g_mutex_unlock(&priv->mutex);
+}
+
+static void
+infd_worker_connection_xml_connection_send(InfXmlConnection* connection,
+                                           xmlNodePtr xml)
+{
+  InfdWorkerConnectionPrivate* priv;
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  g_assert(priv->status == INF_XML_CONNECTION_OPEN);
+
+  xmlUnlinkNode(xml);
+
+  g_mutex_lock(&priv->mutex);
+  g_queue_push_tail(&priv->outgoing, xml);
+  infd_worker_connection_schedule_outgoing(
+    INFD_WORKER_CONNECTION(connection)
+  );
+  g_mutex_unlock(&priv->mutex);
+}
+
+/*
+ * GObject type registration
+ */
+
+static void
+infd_worker_connection_class_init(
+  InfdWorkerConnectionClass* connection_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(connection_class);
+
+  object_class->dispose = infd_worker_connection_dispose;
+  object_class->finalize = infd_worker_connection_finalize;
+  object_class->get_property = infd_worker_connection_get_property;
+
+  g_object_class_override_property(object_class, PROP_STATUS, "status");
+  g_object_class_override_property(object_class, PROP_NETWORK, "network");
+  g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
+  g_object_class_override_property(object_class, PROP_REMOTE_ID, "remote-id");
+
+  g_object_class_override_property(
+    object_class,
+    PROP_LOCAL_CERTIFICATE,
+    "local-certificate"
+  );
+
+  g_object_class_override_property(
+    object_class,
+    PROP_REMOTE_CERTIFICATE,
+    "remote-certificate"
+  );
+}
+
+static void
+infd_worker_connection_xml_connection_iface_init(
+  InfXmlConnectionInterface* iface)
+{
+  iface->close = infd_worker_connection_xml_connection_close;
+  iface->send = infd_worker_connection_xml_connection_send;
+}
+
+/*
+ * Internal API
+ */
+
+/* Creates a mirror of connection for use in worker. Messages sent through
+ * the mirror are sent through connection in main_io. Must be called from the
+ * main thread. */
+InfdWorkerConnection*
+infd_worker_connection_new(InfXmlConnection* connection,
+                           InfdWorkerIo* worker,
+                           InfIo* main_io)
+{
+  InfdWorkerConnection* mirror;
+  InfdWorkerConnectionPrivate* priv;
+
+  g_return_val_if_fail(INF_IS_XML_CONNECTION(connection), NULL);
+  g_return_val_if_fail(INFD_IS_WORKER_IO(worker), NULL);
+  g_return_val_if_fail(INF_IS_IO(main_io), NULL);
+
+  mirror = INFD_WORKER_CONNECTION(
+    g_object_new(INFD_TYPE_WORKER_CONNECTION, NULL)
+  );
+
+  priv = INFD_WORKER_CONNECTION_PRIVATE(mirror);
+
+  priv->worker = worker;
+  g_object_ref(worker);
+  priv->main_io = main_io;
+  g_object_ref(main_io);
+  priv->connection = connection;
+
+  g_object_get(
+    G_OBJECT(connection),
+    "network", &priv->network,
+    "local-id", &priv->local_id,
+    "remote-id", &priv->remote_id,
+    "remote-certificate", &priv->remote_certificate,
+    NULL
+  );
+
+  return mirror;
+}
+
+/* Returns the real connection of a mirror, or NULL if it has been detached.
+ * Must be called from the main thread, or with the worker locked. */
+InfXmlConnection*
+infd_worker_connection_get_connection(InfdWorkerConnection* connection)
+{
+  g_return_val_if_fail(INFD_IS_WORKER_CONNECTION(connection), NULL);
+  return INFD_WORKER_CONNECTION_PRIVATE(connection)->connection;
+}
+
+/* Makes the mirror emit InfXmlConnection::received in the worker thread.
+ * xml is copied. */
+void
+infd_worker_connection_forward_received(InfdWorkerConnection* connection,
+                                        const xmlNodePtr xml)
+{
+  g_return_if_fail(INFD_IS_WORKER_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  infd_worker_connection_push_incoming(
+    connection,
+    INFD_WORKER_CONNECTION_EVENT_RECEIVED,
+    xml
+  );
+}
+
+/* Makes the mirror emit InfXmlConnection::sent in the worker thread. xml is
+ * copied. */
+void
+infd_worker_connection_forward_sent(InfdWorkerConnection* connection,
+                                    const xmlNodePtr xml)
+{
+  g_return_if_fail(INFD_IS_WORKER_CONNECTION(connection));
+  g_return_if_fail(xml != NULL);
+
+  infd_worker_connection_push_incoming(
+    connection,
+    INFD_WORKER_CONNECTION_EVENT_SENT,
+    xml
+  );
+}
+
+/* Closes the mirror, after the real connection was closed. Must be called
+ * from the main thread with the worker locked. */
+void
+infd_worker_connection_detach(InfdWorkerConnection* connection)
+{
+  InfdWorkerConnectionPrivate* priv;
+
+  g_return_if_fail(INFD_IS_WORKER_CONNECTION(connection));
+  priv = INFD_WORKER_CONNECTION_PRIVATE(connection);
+
+  priv->connection = NULL;
+
+  if(priv->status != INF_XML_CONNECTION_CLOSED)
+  {
+    priv->status = INF_XML_CONNECTION_CLOSED;
+    g_object_notify(G_OBJECT(connection), "status");
+  }
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,77 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFD_WORKER_CONNECTION_H__
+#define __INFD_WORKER_CONNECTION_H__
+
+#include <libinfinity/server/infd-worker-io.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <libxml/tree.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INFD_TYPE_WORKER_CONNECTION                 (infd_worker_connection_get_type())
+#define INFD_WORKER_CONNECTION(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INFD_TYPE_WORKER_CONNECTION, InfdWorkerConnection))
+#define INFD_WORKER_CONNECTION_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INFD_TYPE_WORKER_CONNECTION, InfdWorkerConnectionClass))
+#define INFD_IS_WORKER_CONNECTION(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_WORKER_CONNECTION))
+#define INFD_IS_WORKER_CONNECTION_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_WORKER_CONNECTION))
+#define INFD_WORKER_CONNECTION_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_WORKER_CONNECTION, InfdWorkerConnectionClass))
+
+typedef struct _InfdWorkerConnection InfdWorkerConnection;
+typedef struct _InfdWorkerConnectionClass InfdWorkerConnectionClass;
+
+struct _InfdWorkerConnectionClass {
+  GObjectClass parent_class;
+};
+
+struct _InfdWorkerConnection {
+  GObject parent;
+};
+
+GType
+infd_worker_connection_get_type(void) G_GNUC_CONST;
+
+InfdWorkerConnection*
+infd_worker_connection_new(InfXmlConnection* connection,
+                           InfdWorkerIo* worker,
+                           InfIo* main_io);
+
+InfXmlConnection*
+infd_worker_connection_get_connection(InfdWorkerConnection* connection);
+
+void
+infd_worker_connection_forward_received(InfdWorkerConnection* connection,
+                                        const xmlNodePtr xml);
+
+void
+infd_worker_connection_forward_sent(InfdWorkerConnection* connection,
+                                    const xmlNodePtr xml);
+
+void
+infd_worker_connection_detach(InfdWorkerConnection* connection);
+
+G_END_DECLS
+
+#endif /* __INFD_WORKER_CONNECTION_H__ */
+
+/* vim:set et sw=2 ts=2: */
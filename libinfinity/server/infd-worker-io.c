@@ -0,0 +1,875 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* InfdWorkerIo is the InfIo that InfdDirectory uses when it runs sessions in
+ * worker threads. There are two kinds of instances:
+ *
+ * A worker runs its own InfStandaloneIo in a separate thread. Callbacks
+ * registered with it are run in that thread, with the worker's lock held.
+ *
+ * A pool wraps the directory's main InfIo and owns all the workers.
+ * Callbacks registered with it are run in the main thread, with the locks of
+ * all workers held.
+ *
+ * Objects that belong to a worker, such as the sessions it runs, may only be
+ * accessed with that worker's lock held. State that is shared between the
+ * workers, such as the directory itself, is only modified with all locks
+ * held, i.e. only by the main thread. Workers only ever wait for their own
+ * lock and never for the main thread, so there is no lock ordering problem
+ * even though the main thread acquires several locks. */
+
+#include <libinfinity/server/infd-worker-io.h>
+#include <libinfinity/common/inf-standalone-io.h>
+
+typedef enum _InfdWorkerIoCallbackType {
+  INFD_WORKER_IO_WATCH,
+  INFD_WORKER_IO_TIMEOUT,
+  INFD_WORKER_IO_DISPATCH
+} InfdWorkerIoCallbackType;
+
+/* The handle returned to callers of add_watch, add_timeout and
+ * add_dispatch. */
+typedef struct _InfdWorkerIoCallback InfdWorkerIoCallback;
+struct _InfdWorkerIoCallback {
+  /* NULL when the callback has fired or the io has been disposed */
+  InfdWorkerIo* io;
+  InfdWorkerIoCallbackType type;
+  /* Handle of the callback in the inner io */
+  gpointer inner;
+
+  union {
+    InfIoWatchFunc watch;
+    InfIoTimeoutFunc timeout;
+    InfIoDispatchFunc dispatch;
+  } func;
+
+  gpointer user_data;
+  GDestroyNotify notify;
+
+  /* Set when the callback has been removed, or, for timeouts and
+   * dispatches, when it has been run. */
+  gboolean cancelled;
+  /* Set when notify has been called */
+  gboolean notified;
+
+  /* One reference is held by the inner io, and one temporarily while the
+   * callback is being added to it. */
+  gint ref_count;
+};
+
+typedef struct _InfdWorkerIoPrivate InfdWorkerIoPrivate;
+struct _InfdWorkerIoPrivate {
+  InfIo* inner;
+
+  /* The thread that runs the inner io, or NULL if it does not run anymore.
+   * Callbacks can only be removed from the inner io directly from within
+   * this thread; from other threads they are cancelled instead. */
+  GThread* thread;
+
+  /* For a pool, the workers. NULL for a worker. */
+  GPtrArray* workers;
+  /* For a worker, its lock */
+  GRecMutex lock;
+
+  /* All InfdWorkerIoCallbacks that the inner io still refers to. Protected
+   * by infd_worker_io_callback_mutex. */
+  GHashTable* callbacks;
+};
+
+#define INFD_WORKER_IO_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INFD_TYPE_WORKER_IO, InfdWorkerIoPrivate))
+
+/* Protects the callback lists of all InfdWorkerIos and the flags of the
+ * callbacks. This is a single global lock, since a callback needs to be able
+ * to find out whether its io is still alive. It is only held for short
+ * periods of time. */
+static GMutex infd_worker_io_callback_mutex;
+
+/* The worker running in the current thread, if any */
+static GPrivate infd_worker_io_current = G_PRIVATE_INIT(NULL);
+
+static void infd_worker_io_io_iface_init(InfIoInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfdWorkerIo, infd_worker_io, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfdWorkerIo)
+  G_IMPLEMENT_INTERFACE(INF_TYPE_IO, infd_worker_io_io_iface_init))
+
+static InfdWorkerIoCallback*
+infd_worker_io_callback_new(InfdWorkerIo* io,
+                            InfdWorkerIoCallbackType type,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+  InfdWorkerIoCallback* callback;
+
+  callback = g_slice_new(InfdWorkerIoCallback);
+  callback->io = io;
+  callback->type = type;
+  callback->inner = NULL;
+  callback->user_data = user_data;
+  callback->notify = notify;
+  callback->cancelled = FALSE;
+  callback->notified = FALSE;
+  callback->ref_count = 2;
+
+  return callback;
+}
+
+static void
+infd_worker_io_callback_unref(InfdWorkerIoCallback* callback)
+{
+  if(g_atomic_int_dec_and_test(&callback->ref_count))
+    g_slice_free(InfdWorkerIoCallback, callback);
+}
+
+/* Called by the inner io when it no longer refers to the callback */
+static void
+infd_worker_io_callback_free(gpointer data)
+{
+  InfdWorkerIoCallback* callback;
+  InfdWorkerIoPrivate* priv;
+  gboolean notify;
+
+  callback = (InfdWorkerIoCallback*)data;
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+
+  if(callback->io != NULL)
+  {
+    priv = INFD_WORKER_IO_PRIVATE(callback->io);
+    g_hash_table_remove(priv->callbacks, callback);
+    callback->io = NULL;
+  }
+
+  notify = !callback->notified;
+  callback->notified = TRUE;
+
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  if(notify && callback->notify != NULL)
+    callback->notify(callback->user_data);
+
+  infd_worker_io_callback_unref(callback);
+}
+
+/* Returns the io of callback with a reference added, or NULL if the callback
+ * has been detached from its io. */
+static InfdWorkerIo*
+infd_worker_io_callback_ref_io(InfdWorkerIoCallback* callback)
+{
+  InfdWorkerIo* io;
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  io = callback->io;
+  if(io != NULL) g_object_ref(io);
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  return io;
+}
+
+/* Runs a timeout or dispatch callback. Must be called with the io locked. */
+static void
+infd_worker_io_callback_run_once(InfdWorkerIoCallback* callback)
+{
+  gboolean cancelled;
+  gboolean notify;
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  cancelled = callback->cancelled;
+  callback->cancelled = TRUE;
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  if(!cancelled)
+  {
+    if(callback->type == INFD_WORKER_IO_TIMEOUT)
+      callback->func.timeout(callback->user_data);
+    else
+      callback->func.dispatch(callback->user_data);
+  }
+
+  /* Call the notify function while we still hold the lock, since it might
+   * touch objects belonging to the worker. */
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  notify = !callback->notified;
+  callback->notified = TRUE;
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  if(notify && callback->notify != NULL)
+    callback->notify(callback->user_data);
+}
+
+static void
+infd_worker_io_watch_func(InfNativeSocket* socket,
+                          InfIoEvent event,
+                          gpointer user_data)
+{
+  InfdWorkerIoCallback* callback;
+  InfdWorkerIo* io;
+  gboolean cancelled;
+
+  callback = (InfdWorkerIoCallback*)user_data;
+  io = infd_worker_io_callback_ref_io(callback);
+  if(io == NULL) return;
+
+  infd_worker_io_lock(io);
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  cancelled = callback->cancelled;
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  if(!cancelled)
+    callback->func.watch(socket, event, callback->user_data);
+
+  infd_worker_io_unlock(io);
+  g_object_unref(io);
+}
+
+static void
+infd_worker_io_once_func(gpointer user_data)
+{
+  InfdWorkerIoCallback* callback;
+  InfdWorkerIo* io;
+
+  callback = (InfdWorkerIoCallback*)user_data;
+  io = infd_worker_io_callback_ref_io(callback);
+  if(io == NULL) return;
+
+  infd_worker_io_lock(io);
+  infd_worker_io_callback_run_once(callback);
+  infd_worker_io_unlock(io);
+
+  g_object_unref(io);
+}
+
+static InfdWorkerIoCallback*
+infd_worker_io_add_callback(InfdWorkerIo* io,
+                            InfdWorkerIoCallback* callback,
+                            InfNativeSocket* socket,
+                            InfIoEvent events,
+                            guint msecs)
+{
+  InfdWorkerIoPrivate* priv;
+  InfdWorkerIo* current;
+  gboolean locked;
+  gpointer inner;
+
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  /* Hold the lock the callback runs with, so that a timeout or dispatch
+   * cannot run, and be freed by the inner io, before the handle has been
+   * returned to the caller. A worker thread must not lock the pool or other
+   * workers. Callbacks of the pool cannot run before the worker thread
+   * releases its own lock anyway, since the pool locks all workers. */
+  current = infd_worker_io_get_current();
+  locked = current == NULL || current == io;
+  if(locked)
+    infd_worker_io_lock(io);
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  g_hash_table_add(priv->callbacks, callback);
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  /* The inner io might call back into us with its own lock held, so we
+   * cannot hold the callback mutex while calling into it. */
+  switch(callback->type)
+  {
+  case INFD_WORKER_IO_WATCH:
+    inner = inf_io_add_watch(
+      priv->inner,
+      socket,
+      events,
+      infd_worker_io_watch_func,
+      callback,
+      infd_worker_io_callback_free
+    );
+
+    break;
+  case INFD_WORKER_IO_TIMEOUT:
+    inner = inf_io_add_timeout(
+      priv->inner,
+      msecs,
+      infd_worker_io_once_func,
+      callback,
+      infd_worker_io_callback_free
+    );
+
+    break;
+  case INFD_WORKER_IO_DISPATCH:
+    inner = inf_io_add_dispatch(
+      priv->inner,
+      infd_worker_io_once_func,
+      callback,
+      infd_worker_io_callback_free
+    );
+
+    break;
+  default:
+    g_assert_not_reached();
+    inner = NULL;
+    break;
+  }
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  callback->inner = inner;
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  /* The reference of the inner io is only released after the callback has
+   * run, which needs the lock, so the callback stays alive until we
+   * release it. */
+  infd_worker_io_callback_unref(callback);
+  if(locked)
+    infd_worker_io_unlock(io);
+
+  return callback;
+}
+
+static void
+infd_worker_io_remove_inner(InfdWorkerIo* io,
+                            InfdWorkerIoCallback* callback)
+{
+  InfdWorkerIoPrivate* priv;
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  switch(callback->type)
+  {
+  case INFD_WORKER_IO_WATCH:
+    inf_io_remove_watch(priv->inner, (InfIoWatch*)callback->inner);
+    break;
+  case INFD_WORKER_IO_TIMEOUT:
+    inf_io_remove_timeout(priv->inner, (InfIoTimeout*)callback->inner);
+    break;
+  case INFD_WORKER_IO_DISPATCH:
+    inf_io_remove_dispatch(priv->inner, (InfIoDispatch*)callback->inner);
+    break;
+  default:
+    g_assert_not_reached();
+    break;
+  }
+}
+
+/* Removes a timeout or a dispatch */
+static void
+infd_worker_io_remove_once(InfdWorkerIo* io,
+                           InfdWorkerIoCallback* callback)
+{
+  InfdWorkerIoPrivate* priv;
+  gboolean direct;
+  gboolean notify;
+
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+
+  /* Already run, or run right now */
+  if(callback->cancelled)
+  {
+    g_mutex_unlock(&infd_worker_io_callback_mutex);
+    return;
+  }
+
+  callback->cancelled = TRUE;
+
+  direct = priv->thread == NULL || priv->thread == g_thread_self();
+  notify = FALSE;
+
+  if(!direct)
+  {
+    /* The inner io might be about to run the callback in another thread, in
+     * which case the callback can go away at any time. We leave it in the
+     * inner io; it will not do anything when it fires. */
+    notify = !callback->notified;
+    callback->notified = TRUE;
+  }
+
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  if(direct)
+    infd_worker_io_remove_inner(io, callback);
+  else if(notify && callback->notify != NULL)
+    callback->notify(callback->user_data);
+}
+
+/* Removes all callbacks from the inner io */
+static void
+infd_worker_io_clear_callbacks(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  GHashTableIter iter;
+  gpointer key;
+  GSList* list;
+  GSList* item;
+  InfdWorkerIoCallback* callback;
+
+  priv = INFD_WORKER_IO_PRIVATE(io);
+  list = NULL;
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+
+  g_hash_table_iter_init(&iter, priv->callbacks);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    callback = (InfdWorkerIoCallback*)key;
+    callback->io = NULL;
+    list = g_slist_prepend(list, callback);
+  }
+
+  g_hash_table_remove_all(priv->callbacks);
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  /* The callbacks are freed by infd_worker_io_callback_free() */
+  for(item = list; item != NULL; item = item->next)
+    infd_worker_io_remove_inner(io, (InfdWorkerIoCallback*)item->data);
+
+  g_slist_free(list);
+}
+
+static void
+infd_worker_io_quit_func(gpointer user_data)
+{
+  inf_standalone_io_loop_quit(INF_STANDALONE_IO(user_data));
+}
+
+static gpointer
+infd_worker_io_thread_func(gpointer data)
+{
+  InfdWorkerIo* io;
+  InfdWorkerIoPrivate* priv;
+
+  io = INFD_WORKER_IO(data);
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_private_set(&infd_worker_io_current, io);
+  inf_standalone_io_loop(INF_STANDALONE_IO(priv->inner));
+  g_private_set(&infd_worker_io_current, NULL);
+
+  return NULL;
+}
+
+static InfdWorkerIo*
+infd_worker_io_new_worker(guint index)
+{
+  InfdWorkerIo* io;
+  InfdWorkerIoPrivate* priv;
+  gchar* name;
+
+  io = INFD_WORKER_IO(g_object_new(INFD_TYPE_WORKER_IO, NULL));
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  priv->inner = INF_IO(inf_standalone_io_new());
+
+  /* The thread keeps a reference on the worker until it is joined */
+  name = g_strdup_printf("infd-worker-%u", index);
+  priv->thread = g_thread_new(
+    name,
+    infd_worker_io_thread_func,
+    g_object_ref(io)
+  );
+
+  g_free(name);
+  return io;
+}
+
+static void
+infd_worker_io_stop_worker(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  if(priv->thread != NULL)
+  {
+    /* Quit from within the loop, so that it does not matter whether the
+     * thread has already entered it. */
+    inf_io_add_dispatch(
+      priv->inner,
+      infd_worker_io_quit_func,
+      priv->inner,
+      NULL
+    );
+
+    g_thread_join(priv->thread);
+    priv->thread = NULL;
+
+    /* Pending callbacks would never run, and they might keep objects alive
+     * that hold a reference on the worker. */
+    infd_worker_io_clear_callbacks(io);
+
+    /* Release the reference of the thread */
+    g_object_unref(io);
+  }
+}
+
+static void
+infd_worker_io_init(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  priv->inner = NULL;
+  priv->thread = NULL;
+  priv->workers = NULL;
+  g_rec_mutex_init(&priv->lock);
+  priv->callbacks = g_hash_table_new(NULL, NULL);
+}
+
+static void
+infd_worker_io_dispose(GObject* object)
+{
+  InfdWorkerIo* io;
+  InfdWorkerIoPrivate* priv;
+
+  io = INFD_WORKER_IO(object);
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  if(priv->workers != NULL)
+  {
+    infd_worker_io_stop(io);
+
+    /* The inner io is shared with others, so make sure it does not call
+     * into us anymore. */
+    if(priv->inner != NULL)
+      infd_worker_io_clear_callbacks(io);
+
+    g_ptr_array_free(priv->workers, TRUE);
+    priv->workers = NULL;
+  }
+
+  /* For a worker, the thread holds a reference, so it has been stopped at
+   * this point. Finalizing the inner io frees all remaining callbacks. */
+  if(priv->inner != NULL)
+  {
+    g_object_unref(priv->inner);
+    priv->inner = NULL;
+  }
+
+  G_OBJECT_CLASS(infd_worker_io_parent_class)->dispose(object);
+}
+
+static void
+infd_worker_io_finalize(GObject* object)
+{
+  InfdWorkerIo* io;
+  InfdWorkerIoPrivate* priv;
+
+  io = INFD_WORKER_IO(object);
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_assert(g_hash_table_size(priv->callbacks) == 0);
+  g_hash_table_destroy(priv->callbacks);
+  g_rec_mutex_clear(&priv->lock);
+
+  G_OBJECT_CLASS(infd_worker_io_parent_class)->finalize(object);
+}
+
+static InfIoWatch*
+infd_worker_io_io_add_watch(InfIo* io,
+                            InfNativeSocket* socket,
+                            InfIoEvent events,
+                            InfIoWatchFunc func,
+                            gpointer user_data,
+                            GDestroyNotify notify)
+{
+  InfdWorkerIoCallback* callback;
+
+  callback = infd_worker_io_callback_new(
+    INFD_WORKER_IO(io),
+    INFD_WORKER_IO_WATCH,
+    user_data,
+    notify
+  );
+
+  callback->func.watch = func;
+
+  return (InfIoWatch*)infd_worker_io_add_callback(
+    INFD_WORKER_IO(io),
+    callback,
+    socket,
+    events,
+    0
+  );
+}
+
+static void
+infd_worker_io_io_update_watch(InfIo* io,
+                               InfIoWatch* watch,
+                               InfIoEvent events)
+{
+  InfdWorkerIoPrivate* priv;
+  InfdWorkerIoCallback* callback;
+
+  priv = INFD_WORKER_IO_PRIVATE(io);
+  callback = (InfdWorkerIoCallback*)watch;
+
+  inf_io_update_watch(priv->inner, (InfIoWatch*)callback->inner, events);
+}
+
+static void
+infd_worker_io_io_remove_watch(InfIo* io,
+                               InfIoWatch* watch)
+{
+  InfdWorkerIoCallback* callback;
+  callback = (InfdWorkerIoCallback*)watch;
+
+  g_mutex_lock(&infd_worker_io_callback_mutex);
+  callback->cancelled = TRUE;
+  g_mutex_unlock(&infd_worker_io_callback_mutex);
+
+  /* Watches always live until they are removed, and the inner io delays
+   * freeing them when their callback is running, so we can always remove
+   * them directly. */
+  infd_worker_io_remove_inner(INFD_WORKER_IO(io), callback);
+}
+
+static InfIoTimeout*
+infd_worker_io_io_add_timeout(InfIo* io,
+                              guint msecs,
+                              InfIoTimeoutFunc func,
+                              gpointer user_data,
+                              GDestroyNotify notify)
+{
+  InfdWorkerIoCallback* callback;
+
+  callback = infd_worker_io_callback_new(
+    INFD_WORKER_IO(io),
+    INFD_WORKER_IO_TIMEOUT,
+    user_data,
+    notify
+  );
+
+  callback->func.timeout = func;
+
+  return (InfIoTimeout*)infd_worker_io_add_callback(
+    INFD_WORKER_IO(io),
+    callback,
+    NULL,
+    0,
+    msecs
+  );
+}
+
+static void
+infd_worker_io_io_remove_timeout(InfIo* io,
+                                 InfIoTimeout* timeout)
+{
+  infd_worker_io_remove_once(
+    INFD_WORKER_IO(io),
+    (InfdWorkerIoCallback*)timeout
+  );
+}
+
+static InfIoDispatch*
+infd_worker_io_io_add_dispatch(InfIo* io,
+                               InfIoDispatchFunc func,
+                               gpointer user_data,
+                               GDestroyNotify notify)
+{
+  InfdWorkerIoCallback* callback;
+
+  callback = infd_worker_io_callback_new(
+    INFD_WORKER_IO(io),
+    INFD_WORKER_IO_DISPATCH,
+    user_data,
+    notify
+  );
+
+  callback->func.dispatch = func;
+
+  return (InfIoDispatch*)infd_worker_io_add_callback(
+    INFD_WORKER_IO(io),
+    callback,
+    NULL,
+    0,
+    0
+  );
+}
+
+static void
+infd_worker_io_io_remove_dispatch(InfIo* io,
+                                  InfIoDispatch* dispatch)
+{
+  infd_worker_io_remove_once(
+    INFD_WORKER_IO(io),
+    (InfdWorkerIoCallback*)dispatch
+  );
+}
+
+static void
+infd_worker_io_class_init(InfdWorkerIoClass* io_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(io_class);
+
+  object_class->dispose = infd_worker_io_dispose;
+  object_class->finalize = infd_worker_io_finalize;
+}
+
+static void
+infd_worker_io_io_iface_init(InfIoInterface* iface)
+{
+  iface->add_watch = infd_worker_io_io_add_watch;
+  iface->update_watch = infd_worker_io_io_update_watch;
+  iface->remove_watch = infd_worker_io_io_remove_watch;
+  iface->add_timeout = infd_worker_io_io_add_timeout;
+  iface->remove_timeout = infd_worker_io_io_remove_timeout;
+  iface->add_dispatch = infd_worker_io_io_add_dispatch;
+  iface->remove_dispatch = infd_worker_io_io_remove_dispatch;
+}
+
+/* Creates a pool of n_workers worker threads. The pool itself wraps io,
+ * which must be run by the calling thread. */
+InfdWorkerIo*
+infd_worker_io_new(InfIo* io,
+                   guint n_workers)
+{
+  InfdWorkerIo* pool;
+  InfdWorkerIoPrivate* priv;
+  guint i;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(n_workers > 0, NULL);
+
+  pool = INFD_WORKER_IO(g_object_new(INFD_TYPE_WORKER_IO, NULL));
+  priv = INFD_WORKER_IO_PRIVATE(pool);
+
+  priv->inner = io;
+  g_object_ref(io);
+
+  priv->thread = g_thread_self();
+  priv->workers = g_ptr_array_new_with_free_func(g_object_unref);
+
+  for(i = 0; i < n_workers; ++i)
+    g_ptr_array_add(priv->workers, infd_worker_io_new_worker(i));
+
+  return pool;
+}
+
+/* Returns the number of workers of a pool */
+guint
+infd_worker_io_get_n_workers(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+
+  g_return_val_if_fail(INFD_IS_WORKER_IO(io), 0);
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_return_val_if_fail(priv->workers != NULL, 0);
+  return priv->workers->len;
+}
+
+/* Returns the index-th worker of a pool */
+InfdWorkerIo*
+infd_worker_io_get_worker(InfdWorkerIo* io,
+                          guint index)
+{
+  InfdWorkerIoPrivate* priv;
+
+  g_return_val_if_fail(INFD_IS_WORKER_IO(io), NULL);
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_return_val_if_fail(priv->workers != NULL, NULL);
+  g_return_val_if_fail(index < priv->workers->len, NULL);
+
+  return INFD_WORKER_IO(g_ptr_array_index(priv->workers, index));
+}
+
+/* Returns the io that io runs its callbacks on */
+InfIo*
+infd_worker_io_get_inner(InfdWorkerIo* io)
+{
+  g_return_val_if_fail(INFD_IS_WORKER_IO(io), NULL);
+  return INFD_WORKER_IO_PRIVATE(io)->inner;
+}
+
+/* Returns the worker whose thread is the calling thread, or NULL if the
+ * calling thread is not a worker thread. */
+InfdWorkerIo*
+infd_worker_io_get_current(void)
+{
+  return INFD_WORKER_IO(g_private_get(&infd_worker_io_current));
+}
+
+/* Locks a worker, or all workers of a pool. Locks are recursive. A worker
+ * thread must only ever lock its own worker. */
+void
+infd_worker_io_lock(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  guint i;
+
+  g_return_if_fail(INFD_IS_WORKER_IO(io));
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  if(priv->workers != NULL)
+  {
+    g_return_if_fail(infd_worker_io_get_current() == NULL);
+
+    for(i = 0; i < priv->workers->len; ++i)
+      infd_worker_io_lock(INFD_WORKER_IO(g_ptr_array_index(priv->workers, i)));
+  }
+  else
+  {
+    g_rec_mutex_lock(&priv->lock);
+  }
+}
+
+void
+infd_worker_io_unlock(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  guint i;
+
+  g_return_if_fail(INFD_IS_WORKER_IO(io));
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  if(priv->workers != NULL)
+  {
+    for(i = priv->workers->len; i > 0; --i)
+    {
+      infd_worker_io_unlock(
+        INFD_WORKER_IO(g_ptr_array_index(priv->workers, i - 1))
+      );
+    }
+  }
+  else
+  {
+    g_rec_mutex_unlock(&priv->lock);
+  }
+}
+
+/* Stops all worker threads of a pool. Callbacks registered with the workers
+ * are removed and not run anymore after this. This must be called from the main thread
+ * without holding any of the locks, since it waits for the workers to
+ * finish what they are currently doing. */
+void
+infd_worker_io_stop(InfdWorkerIo* io)
+{
+  InfdWorkerIoPrivate* priv;
+  guint i;
+
+  g_return_if_fail(INFD_IS_WORKER_IO(io));
+  priv = INFD_WORKER_IO_PRIVATE(io);
+
+  g_return_if_fail(priv->workers != NULL);
+
+  for(i = 0; i < priv->workers->len; ++i)
+  {
+    infd_worker_io_stop_worker(
+      INFD_WORKER_IO(g_ptr_array_index(priv->workers, i))
+    );
+  }
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,80 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INFD_WORKER_IO_H__
+#define __INFD_WORKER_IO_H__
+
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INFD_TYPE_WORKER_IO                 (infd_worker_io_get_type())
+#define INFD_WORKER_IO(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INFD_TYPE_WORKER_IO, InfdWorkerIo))
+#define INFD_WORKER_IO_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INFD_TYPE_WORKER_IO, InfdWorkerIoClass))
+#define INFD_IS_WORKER_IO(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INFD_TYPE_WORKER_IO))
+#define INFD_IS_WORKER_IO_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INFD_TYPE_WORKER_IO))
+#define INFD_WORKER_IO_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INFD_TYPE_WORKER_IO, InfdWorkerIoClass))
+
+typedef struct _InfdWorkerIo InfdWorkerIo;
+typedef struct _InfdWorkerIoClass InfdWorkerIoClass;
+
+struct _InfdWorkerIoClass {
+  GObjectClass parent_class;
+};
+
+struct _InfdWorkerIo {
+  GObject parent;
+};
+
+GType
+infd_worker_io_get_type(void) G_GNUC_CONST;
+
+InfdWorkerIo*
+infd_worker_io_new(InfIo* io,
+                   guint n_workers);
+
+guint
+infd_worker_io_get_n_workers(InfdWorkerIo* io);
+
+InfdWorkerIo*
+infd_worker_io_get_worker(InfdWorkerIo* io,
+                          guint index);
+
+InfIo*
+infd_worker_io_get_inner(InfdWorkerIo* io);
+
+InfdWorkerIo*
+infd_worker_io_get_current(void);
+
+void
+infd_worker_io_lock(InfdWorkerIo* io);
+
+void
+infd_worker_io_unlock(InfdWorkerIo* io);
+
+void
+infd_worker_io_stop(InfdWorkerIo* io);
+
+G_END_DECLS
+
+#endif /* __INFD_WORKER_IO_H__ */
+
+/* vim:set et sw=2 ts=2: */
@@ -256,6 +256,87 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
   iface->erase_text(buffer, pos, len, user);
 }
 
+/**
+ * inf_text_buffer_append:
+ * @buffer: A #InfTextBuffer.
+ * @chunk: (transfer none): A #InfTextChunk.
+ * @user: (allow-none): A #InfUser inserting @chunk, or %NULL.
+ *
+ * Inserts @chunk at the end of @buffer. This is equivalent to calling
+ * inf_text_buffer_insert_chunk() with the length of @buffer as position,
+ * but implementations can do this more efficiently, for example when
+ * filling an empty buffer. When loading a document, it is much cheaper to
+ * collect all of its text in a single #InfTextChunk first and then append
+ * it to the buffer in one go instead of inserting every segment on its
+ * own, since the #InfTextBuffer::text-inserted signal is emitted only once.
+ **/
+void
+inf_text_buffer_append(InfTextBuffer* buffer,
+                       InfTextChunk* chunk,
+                       InfUser* user)
+{
+  InfTextBufferInterface* iface;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(chunk != NULL);
+  g_return_if_fail(user == NULL || INF_IS_USER(user));
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->append != NULL)
+  {
+    iface->append(buffer, chunk, user);
+  }
+  else
+  {
+    g_return_if_fail(iface->insert_text != NULL);
+
+    iface->insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      chunk,
+      user
+    );
+  }
+}
+
+/**
+ * inf_text_buffer_clear:
+ * @buffer: A #InfTextBuffer.
+ * @user: (allow-none): A #InfUser that erases the text, or %NULL.
+ *
+ * Erases all text from @buffer. This is equivalent to calling
+ * inf_text_buffer_erase_text() for the whole buffer, but implementations
+ * can do this more efficiently.
+ **/
+void
+inf_text_buffer_clear(InfTextBuffer* buffer,
+                      InfUser* user)
+{
+  InfTextBufferInterface* iface;
+
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(user == NULL || INF_IS_USER(user));
+
+  iface = INF_TEXT_BUFFER_GET_IFACE(buffer);
+
+  if(iface->clear != NULL)
+  {
+    iface->clear(buffer, user);
+  }
+  else
+  {
+    g_return_if_fail(iface->erase_text != NULL);
+
+    iface->erase_text(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer),
+      user
+    );
+  }
+}
+
 /**
  * inf_text_buffer_create_begin_iter:
  * @buffer: A #InfTextBuffer.
@@ -59,6 +59,10 @@ typedef struct _InfTextBufferIter InfTextBufferIter;
  * @get_slice: Virtual function to extract a slice of text from the buffer.
  * @insert_text: Virtual function to insert text into the buffer.
  * @erase_text: Virtual function to remove text from the buffer.
+ * @append: Virtual function to insert text at the end of the buffer. If
+ * %NULL, @insert_text is used instead.
+ * @clear: Virtual function to remove all text from the buffer. If %NULL,
+ * @erase_text is used instead.
  * @create_begin_iter: Virtual function to create a #InfTextBufferIter at the
  * beginning of the buffer, used for traversing through buffer segments.
  * @create_end_iter: Virtual function to create a #InfTextBufferIter at the
@@ -112,6 +116,13 @@ struct _InfTextBufferInterface {
                     guint len,
                     InfUser* user);
 
+  void(*append)(InfTextBuffer* buffer,
+                InfTextChunk* chunk,
+                InfUser* user);
+
+  void(*clear)(InfTextBuffer* buffer,
+               InfUser* user);
+
   InfTextBufferIter*(*create_begin_iter)(InfTextBuffer* buffer);
 
   InfTextBufferIter*(*create_end_iter)(InfTextBuffer* buffer);
@@ -186,6 +197,15 @@ inf_text_buffer_erase_text(InfTextBuffer* buffer,
                            guint len,
                            InfUser* user);
 
+void
+inf_text_buffer_append(InfTextBuffer* buffer,
+                       InfTextChunk* chunk,
+                       InfUser* user);
+
+void
+inf_text_buffer_clear(InfTextBuffer* buffer,
+                      InfUser* user);
+
 InfTextBufferIter*
 inf_text_buffer_create_begin_iter(InfTextBuffer* buffer);
 
@@ -43,9 +43,19 @@
  * offsets where necessary. For a small set of selected encodings which are
  * very popular, most notably UTF-8, there exist more optimized code paths to
  * do the conversion.
+ *
+ * Copying an #InfTextChunk with inf_text_chunk_copy() or extracting a part
+ * of it with inf_text_chunk_substring() does usually not copy the text
+ * itself. The text is shared between the chunks, and only copied when one
+ * of them is modified.
+ *
+ * The segments are kept in a balanced tree, so that inserting and erasing
+ * text as well as looking up a position take logarithmic time in the number
+ * of segments, even for large documents written by many authors.
  */
 
 #include <libinftext/inf-text-chunk.h>
+#include <libinftext/inf-text-chunk-private.h>
 #include <libinfinity/common/inf-xml-util.h>
 
 #include <string.h>
@@ -64,23 +74,63 @@ struct _InfTextChunkPath {
                           guint offset);
 };
 
+typedef struct _InfTextChunkSegment InfTextChunkSegment;
+
+/* The segment tree of a chunk is shared between a chunk and all of its
+ * copies, until one of them is modified. Copies are handed to other
+ * threads, for example to write them to disk while the original keeps
+ * being edited, so the reference counts of storages and buffers are changed
+ * atomically. Shared storages and buffers are never modified, only read
+ * and eventually freed by the last owner. A chunk that is about to be
+ * modified first makes its own copy of whatever is shared, see
+ * inf_text_chunk_make_writable() and inf_text_chunk_segment_reserve().
+ * Once a reference count has dropped to 1, the other owners are done with
+ * the object, so it can be modified in place without locking. */
+typedef struct _InfTextChunkStorage InfTextChunkStorage;
+struct _InfTextChunkStorage {
+  gint ref_count;
+  InfTextChunkSegment* root;
+};
+
 struct _InfTextChunk {
-  GSequence* segments;
-  guint length; /* in characters */
+  InfTextChunkStorage* storage;
   GQuark encoding;
 
   const InfTextChunkPath* path;
 };
 
-typedef struct _InfTextChunkSegment InfTextChunkSegment;
+/* The text of a segment lives in a reference-counted buffer, which can be
+ * shared by several segments, also across chunks, each referring to a
+ * different part of it. A buffer is only written to if it is referenced by
+ * a single segment. The text follows the header in the same allocation. */
+typedef struct _InfTextChunkBuffer InfTextChunkBuffer;
+struct _InfTextChunkBuffer {
+  gint ref_count;
+  gsize size; /* allocated bytes for text */
+};
+
+#define INF_TEXT_CHUNK_BUFFER_DATA(buffer) \
+  ((gchar*)(buffer) + sizeof(InfTextChunkBuffer))
+
 struct _InfTextChunkSegment {
+  /* Position in the segment tree */
+  InfTextChunkSegment* parent;
+  InfTextChunkSegment* left;
+  InfTextChunkSegment* right;
+  gint height;
+
   guint author;
+  InfTextChunkBuffer* buffer;
   /* This is gchar so that we can do pointer arithmetic. It does not
    * necessarily store a full character in each byte. This depends on the
-   * encoding specified in the InfTextChunk. */
+   * encoding specified in the InfTextChunk. It points into buffer. */
   gchar* text;
-  gsize length; /* in bytes */
-  guint offset; /* absolute to chunk begin in characters, sort criteria */
+  gsize bytes;
+  guint chars;
+
+  /* Including this segment and all of its descendants */
+  gsize subtree_bytes;
+  guint subtree_chars;
 };
 
 /*
@@ -156,171 +206,714 @@ const InfTextChunkPath INF_TEXT_CHUNK_PATH_ICONV = {
  * Helper functions
  */
 
+static InfTextChunkBuffer*
+inf_text_chunk_buffer_new(gsize size)
+{
+  InfTextChunkBuffer* buffer;
+
+  buffer = g_malloc(sizeof(InfTextChunkBuffer) + size);
+  buffer->ref_count = 1;
+  buffer->size = size;
+
+  return buffer;
+}
+
+static void
+inf_text_chunk_buffer_unref(InfTextChunkBuffer* buffer)
+{
+  if(g_atomic_int_dec_and_test(&buffer->ref_count))
+    g_free(buffer);
+}
+
+/* Creates a new segment with a copy of text, in a buffer that has room for
+ * at least size bytes. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new(guint author,
+                           gconstpointer text,
+                           gsize bytes,
+                           guint chars,
+                           gsize size)
+{
+  InfTextChunkSegment* segment;
+
+  segment = g_slice_new(InfTextChunkSegment);
+  segment->parent = NULL;
+  segment->left = NULL;
+  segment->right = NULL;
+  segment->height = 1;
+
+  segment->author = author;
+  segment->buffer = inf_text_chunk_buffer_new(MAX(bytes, size));
+  segment->text = INF_TEXT_CHUNK_BUFFER_DATA(segment->buffer);
+  segment->bytes = bytes;
+  segment->chars = chars;
+  segment->subtree_bytes = bytes;
+  segment->subtree_chars = chars;
+
+  memcpy(segment->text, text, bytes);
+  return segment;
+}
+
+/* Creates a new segment which refers to bytes bytes of the text of
+ * segment, starting at index, without copying the text. If this is only a
+ * small part of the buffer, the text is copied anyway, so that a small
+ * piece of text, such as the one of a delete operation in the request log,
+ * does not keep a large buffer alive which is otherwise no longer used. */
+static InfTextChunkSegment*
+inf_text_chunk_segment_new_shared(const InfTextChunkSegment* segment,
+                                  gsize index,
+                                  gsize bytes,
+                                  guint chars)
+{
+  InfTextChunkSegment* new_segment;
+
+  g_assert(index + bytes <= segment->bytes);
+
+  if(bytes * 2 < segment->buffer->size)
+  {
+    return inf_text_chunk_segment_new(
+      segment->author,
+      segment->text + index,
+      bytes,
+      chars,
+      bytes
+    );
+  }
+
+  new_segment = g_slice_new(InfTextChunkSegment);
+  new_segment->parent = NULL;
+  new_segment->left = NULL;
+  new_segment->right = NULL;
+  new_segment->height = 1;
+
+  new_segment->author = segment->author;
+  new_segment->buffer = segment->buffer;
+  new_segment->text = segment->text + index;
+  new_segment->bytes = bytes;
+  new_segment->chars = chars;
+  new_segment->subtree_bytes = bytes;
+  new_segment->subtree_chars = chars;
+
+  g_atomic_int_inc(&segment->buffer->ref_count);
+  return new_segment;
+}
+
 static void
 inf_text_chunk_segment_free(InfTextChunkSegment* segment)
 {
-  g_free(segment->text);
+  inf_text_chunk_buffer_unref(segment->buffer);
   g_slice_free(InfTextChunkSegment, segment);
 }
 
-static int
-inf_text_chunk_segment_cmp(gconstpointer first,
-                           gconstpointer second,
-                           gpointer userdata)
+static void
+inf_text_chunk_segment_free_subtree(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+  {
+    inf_text_chunk_segment_free_subtree(segment->left);
+    inf_text_chunk_segment_free_subtree(segment->right);
+    inf_text_chunk_segment_free(segment);
+  }
+}
+
+/* Makes sure that the text of segment can be modified in place, and that
+ * there is room for at least size bytes. The current text of the segment
+ * is preserved, but segment->text might change. */
+static void
+inf_text_chunk_segment_reserve(InfTextChunkSegment* segment,
+                               gsize size)
+{
+  InfTextChunkBuffer* buffer;
+  gsize index;
+
+  buffer = segment->buffer;
+  index = segment->text - INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+
+  if(g_atomic_int_get(&buffer->ref_count) > 1)
+  {
+    /* Copy on write */
+    buffer = inf_text_chunk_buffer_new(MAX(size, segment->bytes));
+    memcpy(INF_TEXT_CHUNK_BUFFER_DATA(buffer), segment->text, segment->bytes);
+
+    inf_text_chunk_buffer_unref(segment->buffer);
+    segment->buffer = buffer;
+    segment->text = INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+  }
+  else if(index + size > buffer->size)
+  {
+    /* Don't realloc to make smaller */
+    if(index > 0)
+    {
+      g_memmove(
+        INF_TEXT_CHUNK_BUFFER_DATA(buffer),
+        segment->text,
+        segment->bytes
+      );
+    }
+
+    if(size > buffer->size)
+    {
+      buffer = g_realloc(buffer, sizeof(InfTextChunkBuffer) + size);
+      buffer->size = size;
+    }
+
+    segment->buffer = buffer;
+    segment->text = INF_TEXT_CHUNK_BUFFER_DATA(buffer);
+  }
+}
+
+/*
+ * Segment tree. The segments of a chunk form an AVL tree ordered by their
+ * position in the text. Each segment caches the number of characters and
+ * bytes in its subtree, so that a segment can be looked up by character
+ * offset, and the offset of a segment can be computed, in O(log n).
+ */
+
+#define INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment) \
+  ((segment) != NULL ? (segment)->height : 0)
+#define INF_TEXT_CHUNK_SEGMENT_CHARS(segment) \
+  ((segment) != NULL ? (segment)->subtree_chars : 0)
+#define INF_TEXT_CHUNK_SEGMENT_BYTES(segment) \
+  ((segment) != NULL ? (segment)->subtree_bytes : 0)
+
+static void
+inf_text_chunk_segment_update(InfTextChunkSegment* segment)
+{
+  gint left_height;
+  gint right_height;
+
+  left_height = INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left);
+  right_height = INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right);
+  segment->height = MAX(left_height, right_height) + 1;
+
+  segment->subtree_chars = segment->chars +
+    INF_TEXT_CHUNK_SEGMENT_CHARS(segment->left) +
+    INF_TEXT_CHUNK_SEGMENT_CHARS(segment->right);
+
+  segment->subtree_bytes = segment->bytes +
+    INF_TEXT_CHUNK_SEGMENT_BYTES(segment->left) +
+    INF_TEXT_CHUNK_SEGMENT_BYTES(segment->right);
+}
+
+/* Updates the cached subtree sizes after segment's own size changed */
+static void
+inf_text_chunk_segment_update_path(InfTextChunkSegment* segment)
+{
+  for(; segment != NULL; segment = segment->parent)
+    inf_text_chunk_segment_update(segment);
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_first(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->left != NULL)
+      segment = segment->left;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_last(InfTextChunkSegment* segment)
+{
+  if(segment != NULL)
+    while(segment->right != NULL)
+      segment = segment->right;
+  return segment;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_next(InfTextChunkSegment* segment)
+{
+  if(segment->right != NULL)
+    return inf_text_chunk_segment_first(segment->right);
+
+  while(segment->parent != NULL && segment->parent->right == segment)
+    segment = segment->parent;
+  return segment->parent;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_segment_prev(InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
- 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
-
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
-
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return 0;
+  if(segment->left != NULL)
+    return inf_text_chunk_segment_last(segment->left);
+
+  while(segment->parent != NULL && segment->parent->left == segment)
+    segment = segment->parent;
+  return segment->parent;
+}
+
+/* Returns the character offset of segment from the beginning of the chunk */
+static guint
+inf_text_chunk_segment_get_offset(InfTextChunkSegment* segment)
+{
+  guint offset;
+
+  offset = INF_TEXT_CHUNK_SEGMENT_CHARS(segment->left);
+  for(; segment->parent != NULL; segment = segment->parent)
+  {
+    if(segment->parent->right == segment)
+    {
+      offset += segment->parent->chars;
+      offset += INF_TEXT_CHUNK_SEGMENT_CHARS(segment->parent->left);
+    }
+  }
+
+  return offset;
+}
+
+/* Makes replacement take the place of segment in the tree. The children of
+ * replacement are not touched. */
+static void
+inf_text_chunk_storage_replace(InfTextChunkStorage* storage,
+                               InfTextChunkSegment* segment,
+                               InfTextChunkSegment* replacement)
+{
+  if(segment->parent == NULL)
+    storage->root = replacement;
+  else if(segment->parent->left == segment)
+    segment->parent->left = replacement;
   else
-    return 1;
+    segment->parent->right = replacement;
+
+  if(replacement != NULL)
+    replacement->parent = segment->parent;
+}
+
+static InfTextChunkSegment*
+inf_text_chunk_storage_rotate_left(InfTextChunkStorage* storage,
+                                   InfTextChunkSegment* segment)
+{
+  InfTextChunkSegment* right;
+
+  right = segment->right;
+  inf_text_chunk_storage_replace(storage, segment, right);
+
+  segment->right = right->left;
+  if(segment->right != NULL)
+    segment->right->parent = segment;
+
+  right->left = segment;
+  segment->parent = right;
+
+  inf_text_chunk_segment_update(segment);
+  inf_text_chunk_segment_update(right);
+  return right;
 }
 
-/* This is a special comparison function which is only used
- * in inf_text_chunk_get_segment. It makes sure that when two segments
- * have the same offset, the second one gets sorted behind. This ensures
- * that the first segment in the sequence is never returned, since it
- * always has offset 0, which is a precondition for the algorithm
- * in inf_text_chunk_get_segment. See also libinfinity github issue #10. */
-static int
-inf_text_chunk_segment_cmp_for_get_segment(gconstpointer first,
-                                           gconstpointer second,
-                                           gpointer userdata)
+static InfTextChunkSegment*
+inf_text_chunk_storage_rotate_right(InfTextChunkStorage* storage,
+                                    InfTextChunkSegment* segment)
 {
-  const InfTextChunkSegment* first_segment;
-  const InfTextChunkSegment* second_segment;
+  InfTextChunkSegment* left;
 
-  first_segment  = (const InfTextChunkSegment*)first;
-  second_segment = (const InfTextChunkSegment*)second;
+  left = segment->left;
+  inf_text_chunk_storage_replace(storage, segment, left);
 
-  g_return_val_if_fail(second != NULL && first != NULL, 0);
+  segment->left = left->right;
+  if(segment->left != NULL)
+    segment->left->parent = segment;
 
-  if (first_segment->offset < second_segment->offset)
-    return -1;
-  else if (first_segment->offset == second_segment->offset)
-    return -1;
+  left->right = segment;
+  segment->parent = left;
+
+  inf_text_chunk_segment_update(segment);
+  inf_text_chunk_segment_update(left);
+  return left;
+}
+
+/* Restores the AVL property and the cached subtree sizes on the path from
+ * segment to the root. */
+static void
+inf_text_chunk_storage_rebalance(InfTextChunkStorage* storage,
+                                 InfTextChunkSegment* segment)
+{
+  gint balance;
+
+  while(segment != NULL)
+  {
+    inf_text_chunk_segment_update(segment);
+
+    balance = INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left) -
+      INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right);
+
+    if(balance > 1)
+    {
+      if(INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left->left) <
+         INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left->right))
+      {
+        inf_text_chunk_storage_rotate_left(storage, segment->left);
+      }
+
+      segment = inf_text_chunk_storage_rotate_right(storage, segment);
+    }
+    else if(balance < -1)
+    {
+      if(INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right->right) <
+         INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right->left))
+      {
+        inf_text_chunk_storage_rotate_right(storage, segment->right);
+      }
+
+      segment = inf_text_chunk_storage_rotate_left(storage, segment);
+    }
+
+    segment = segment->parent;
+  }
+}
+
+/* Inserts new_segment in front of before, or at the end of the chunk if
+ * before is NULL. */
+static void
+inf_text_chunk_storage_insert_before(InfTextChunkStorage* storage,
+                                     InfTextChunkSegment* before,
+                                     InfTextChunkSegment* new_segment)
+{
+  InfTextChunkSegment* parent;
+
+  g_assert(new_segment->parent == NULL);
+  g_assert(new_segment->left == NULL && new_segment->right == NULL);
+
+  if(storage->root == NULL)
+  {
+    g_assert(before == NULL);
+    storage->root = new_segment;
+  }
   else
-    return 1;
+  {
+    if(before == NULL)
+    {
+      parent = inf_text_chunk_segment_last(storage->root);
+      parent->right = new_segment;
+    }
+    else if(before->left == NULL)
+    {
+      parent = before;
+      parent->left = new_segment;
+    }
+    else
+    {
+      parent = inf_text_chunk_segment_last(before->left);
+      parent->right = new_segment;
+    }
+
+    new_segment->parent = parent;
+    inf_text_chunk_storage_rebalance(storage, parent);
+  }
 }
 
-static guint
-inf_text_chunk_next_offset(InfTextChunk* self,
-                           GSequenceIter* iter)
+/* Removes segment from the tree and frees it. Other segments stay valid. */
+static void
+inf_text_chunk_storage_remove(InfTextChunkStorage* storage,
+                              InfTextChunkSegment* segment)
 {
-  GSequenceIter* next_iter;
+  InfTextChunkSegment* successor;
+  InfTextChunkSegment* rebalance;
+
+  if(segment->left != NULL && segment->right != NULL)
+  {
+    /* Move the successor, which has no left child, into the place of
+     * segment. */
+    successor = inf_text_chunk_segment_first(segment->right);
+
+    if(successor->parent == segment)
+    {
+      rebalance = successor;
+    }
+    else
+    {
+      rebalance = successor->parent;
+      inf_text_chunk_storage_replace(storage, successor, successor->right);
+
+      successor->right = segment->right;
+      successor->right->parent = successor;
+    }
 
-  g_assert(iter != g_sequence_get_end_iter(self->segments));
-  
-  next_iter = g_sequence_iter_next(iter);
-  if(next_iter == g_sequence_get_end_iter(self->segments))
-    return self->length;
+    successor->left = segment->left;
+    successor->left->parent = successor;
+    inf_text_chunk_storage_replace(storage, segment, successor);
+  }
   else
-    return ((InfTextChunkSegment*)g_sequence_get(next_iter))->offset;
+  {
+    rebalance = segment->parent;
+
+    if(segment->left != NULL)
+      inf_text_chunk_storage_replace(storage, segment, segment->left);
+    else
+      inf_text_chunk_storage_replace(storage, segment, segment->right);
+  }
+
+  inf_text_chunk_storage_rebalance(storage, rebalance);
+  inf_text_chunk_segment_free(segment);
 }
 
-#ifdef CHUNK_CHECK_INTEGRITY
-static gboolean
-inf_text_chunk_check_integrity(InfTextChunk* self)
+static InfTextChunkSegment*
+inf_text_chunk_storage_copy_subtree(InfTextChunkSegment* segment,
+                                    InfTextChunkSegment* parent)
+{
+  InfTextChunkSegment* new_segment;
+
+  if(segment == NULL)
+    return NULL;
+
+  new_segment = inf_text_chunk_segment_new_shared(
+    segment,
+    0,
+    segment->bytes,
+    segment->chars
+  );
+
+  new_segment->parent = parent;
+  new_segment->left =
+    inf_text_chunk_storage_copy_subtree(segment->left, new_segment);
+  new_segment->right =
+    inf_text_chunk_storage_copy_subtree(segment->right, new_segment);
+  inf_text_chunk_segment_update(new_segment);
+
+  return new_segment;
+}
+
+/* Links the segments between begin and end into a balanced subtree below
+ * parent, and returns its root. */
+static InfTextChunkSegment*
+inf_text_chunk_storage_build_subtree(InfTextChunkSegment** segments,
+                                     guint begin,
+                                     guint end,
+                                     InfTextChunkSegment* parent)
 {
-  GSequenceIter* iter;
   InfTextChunkSegment* segment;
-  guint offset;
-  guint new_offset;
+  guint middle;
+
+  if(begin == end)
+    return NULL;
 
-  offset = 0;
+  middle = begin + (end - begin) / 2;
+  segment = segments[middle];
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
+  segment->parent = parent;
+  segment->left =
+    inf_text_chunk_storage_build_subtree(segments, begin, middle, segment);
+  segment->right =
+    inf_text_chunk_storage_build_subtree(segments, middle + 1, end, segment);
+  inf_text_chunk_segment_update(segment);
+
+  return segment;
+}
+
+static InfTextChunkStorage*
+inf_text_chunk_storage_new(void)
+{
+  InfTextChunkStorage* storage;
+
+  storage = g_slice_new(InfTextChunkStorage);
+  storage->ref_count = 1;
+  storage->root = NULL;
+
+  return storage;
+}
+
+static void
+inf_text_chunk_storage_unref(InfTextChunkStorage* storage)
+{
+  if(g_atomic_int_dec_and_test(&storage->ref_count))
   {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    if(offset != segment->offset)
-      return FALSE;
+    inf_text_chunk_segment_free_subtree(storage->root);
+    g_slice_free(InfTextChunkStorage, storage);
+  }
+}
 
-    new_offset = inf_text_chunk_next_offset(self, iter);
-    if(new_offset <= offset)
-      return FALSE;
+/* Must be called before modifying the segments of self. If they are shared
+ * with another chunk, this creates a private segment tree for self. The
+ * segment text is still shared, and only copied once it is modified. */
+static void
+inf_text_chunk_make_writable(InfTextChunk* self)
+{
+  InfTextChunkStorage* storage;
 
-    if(new_offset - offset > segment->length)
-      return FALSE;
+  if(g_atomic_int_get(&self->storage->ref_count) > 1)
+  {
+    storage = inf_text_chunk_storage_new();
+    storage->root =
+      inf_text_chunk_storage_copy_subtree(self->storage->root, NULL);
 
-    offset = new_offset;
+    inf_text_chunk_storage_unref(self->storage);
+    self->storage = storage;
   }
+}
 
-  return TRUE;
+static guint
+inf_text_chunk_length(InfTextChunk* self)
+{
+  return INF_TEXT_CHUNK_SEGMENT_CHARS(self->storage->root);
+}
+
+#ifdef CHUNK_CHECK_INTEGRITY
+static gboolean
+inf_text_chunk_check_integrity_subtree(InfTextChunkSegment* segment,
+                                       InfTextChunkSegment* parent)
+{
+  gint balance;
+
+  if(segment == NULL)
+    return TRUE;
+
+  if(segment->parent != parent)
+    return FALSE;
+  if(segment->chars == 0 || segment->bytes < segment->chars)
+    return FALSE;
+
+  balance = INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left) -
+    INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right);
+  if(balance < -1 || balance > 1)
+    return FALSE;
+
+  if(segment->height != MAX(INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->left),
+                            INF_TEXT_CHUNK_SEGMENT_HEIGHT(segment->right)) + 1)
+    return FALSE;
+
+  if(segment->subtree_chars != segment->chars +
+     INF_TEXT_CHUNK_SEGMENT_CHARS(segment->left) +
+     INF_TEXT_CHUNK_SEGMENT_CHARS(segment->right))
+    return FALSE;
+
+  if(segment->subtree_bytes != segment->bytes +
+     INF_TEXT_CHUNK_SEGMENT_BYTES(segment->left) +
+     INF_TEXT_CHUNK_SEGMENT_BYTES(segment->right))
+    return FALSE;
+
+  return inf_text_chunk_check_integrity_subtree(segment->left, segment) &&
+         inf_text_chunk_check_integrity_subtree(segment->right, segment);
+}
+
+static gboolean
+inf_text_chunk_check_integrity(InfTextChunk* self)
+{
+  return inf_text_chunk_check_integrity_subtree(self->storage->root, NULL);
 }
 #endif
 
-static GSequenceIter*
+/* Returns the segment containing the character at position pos, and sets
+ * offset to the character offset of pos within that segment. If pos is at
+ * the border of two segments, the second one is returned, unless pos is at
+ * the end of the chunk. If index is non-NULL, it is set to the byte index
+ * of pos within the segment. Returns NULL if the chunk is empty. */
+static InfTextChunkSegment*
 inf_text_chunk_get_segment(InfTextChunk* self,
                            guint pos,
+                           guint* offset,
                            gsize* index)
 {
-  InfTextChunkSegment* found;
-  InfTextChunkSegment key;
-  GSequenceIter* iter;
-
-  g_assert(pos <= self->length);
+  InfTextChunkSegment* segment;
+  guint left_chars;
 
-  /* only offset is relevant for lookup */
-  key.offset = pos;
+  g_assert(pos <= inf_text_chunk_length(self));
 
-  /* TODO: Verify this does binary search */
-  iter = g_sequence_search(
-    self->segments,
-    &key,
-    inf_text_chunk_segment_cmp_for_get_segment,
-    NULL
-  );
-
-  if(self->length > 0)
+  segment = self->storage->root;
+  if(segment == NULL)
   {
-    g_assert(iter != g_sequence_get_begin_iter(self->segments));
+    *offset = 0;
+    if(index != NULL) *index = 0;
+    return NULL;
+  }
 
-    iter = g_sequence_iter_prev(iter);
-    found = g_sequence_get(iter);
+  for(;;)
+  {
+    left_chars = INF_TEXT_CHUNK_SEGMENT_CHARS(segment->left);
+    if(pos < left_chars)
+    {
+      segment = segment->left;
+    }
+    else
+    {
+      pos -= left_chars;
+      if(pos < segment->chars || segment->right == NULL)
+        break;
 
-    g_assert(pos >= found->offset);
+      pos -= segment->chars;
+      segment = segment->right;
+    }
+  }
 
-    /* This is not "<=" because it should rather find position 0 on the
-     * next segment in that case. */
-    g_assert(pos <= inf_text_chunk_next_offset(self, iter));
+  g_assert(pos <= segment->chars);
+  *offset = pos;
 
-    /* Find byte index in the segment where the specified character starts.
-     * This is rather ugly, I wish iconv or glib or someone had some nice(r)
-     * API for this. */
-    if(index != NULL)
+  /* Find byte index in the segment where the specified character starts.
+   * This is rather ugly, I wish iconv or glib or someone had some nice(r)
+   * API for this. */
+  if(index != NULL)
+  {
+    if(pos == segment->chars)
     {
-      if(pos == inf_text_chunk_next_offset(self, iter))
-      {
-        *index = found->length;
-      }
-      else
-      {
-        *index = self->path->get_byte_index(
-          self,
-          found->text,
-          found->length,
-          pos - found->offset
-        );
-      }
+      *index = segment->bytes;
+    }
+    else
+    {
+      *index = self->path->get_byte_index(
+        self,
+        segment->text,
+        segment->bytes,
+        pos
+      );
     }
   }
-  else
+
+  return segment;
+}
+
+/* Prepends or appends text to segment, which must have the same author */
+static void
+inf_text_chunk_segment_add_text(InfTextChunkSegment* segment,
+                                gsize index,
+                                gconstpointer text,
+                                gsize bytes,
+                                guint chars)
+{
+  inf_text_chunk_segment_reserve(segment, segment->bytes + bytes);
+
+  if(index < segment->bytes)
   {
-    if(index != NULL)
-      *index = 0;
+    g_memmove(
+      segment->text + index + bytes,
+      segment->text + index,
+      segment->bytes - index
+    );
   }
-  
-  return iter;
+
+  memcpy(segment->text + index, text, bytes);
+  segment->bytes += bytes;
+  segment->chars += chars;
+
+  inf_text_chunk_segment_update_path(segment);
+}
+
+/* Splits segment at the given character offset and byte index, and returns
+ * the second half, which is inserted into the tree behind segment. */
+static InfTextChunkSegment*
+inf_text_chunk_storage_split(InfTextChunkStorage* storage,
+                             InfTextChunkSegment* segment,
+                             guint offset,
+                             gsize index)
+{
+  InfTextChunkSegment* next;
+  InfTextChunkSegment* new_segment;
+
+  g_assert(offset > 0 && offset < segment->chars);
+
+  new_segment = inf_text_chunk_segment_new_shared(
+    segment,
+    index,
+    segment->bytes - index,
+    segment->chars - offset
+  );
+
+  /* Don't realloc to make smaller */
+  segment->bytes = index;
+  segment->chars = offset;
+  inf_text_chunk_segment_update_path(segment);
+
+  next = inf_text_chunk_segment_next(segment);
+  inf_text_chunk_storage_insert_before(storage, next, new_segment);
+  return new_segment;
 }
 
 /*
@@ -373,12 +966,8 @@ InfTextChunk*
 inf_text_chunk_new(const gchar* encoding)
 {
   InfTextChunk* chunk = g_slice_new(InfTextChunk);
-  
-  chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
 
-  chunk->length = 0;
+  chunk->storage = inf_text_chunk_storage_new();
   chunk->encoding = g_quark_from_string(encoding);
 
   if(chunk->encoding == g_quark_from_static_string("UTF-8"))
@@ -393,7 +982,8 @@ inf_text_chunk_new(const gchar* encoding)
  * inf_text_chunk_copy:
  * @self: A #InfTextChunk.
  *
- * Returns a copy of @self.
+ * Returns a copy of @self. This is a cheap operation since the content is
+ * shared between @self and the copy until either of them is modified.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -401,29 +991,13 @@ InfTextChunk*
 inf_text_chunk_copy(InfTextChunk* self)
 {
   InfTextChunk* new_chunk;
-  GSequenceIter* iter;
 
   g_return_val_if_fail(self != NULL, NULL);
 
   new_chunk = g_slice_new(InfTextChunk);
-  new_chunk->segments = g_sequence_new(
-    (GDestroyNotify)inf_text_chunk_segment_free
-  );
-  
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    InfTextChunkSegment* segment = g_sequence_get(iter);
-    InfTextChunkSegment* new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(segment->text, segment->length);
-    new_segment->length = segment->length;
-    new_segment->offset = segment->offset;
-    g_sequence_append(new_chunk->segments, new_segment);
-  }
+  new_chunk->storage = self->storage;
+  g_atomic_int_inc(&self->storage->ref_count);
 
-  new_chunk->length = self->length;
   new_chunk->encoding = self->encoding;
   new_chunk->path = self->path;
 
@@ -441,7 +1015,7 @@ void
 inf_text_chunk_free(InfTextChunk* self)
 {
   g_return_if_fail(self != NULL);
-  g_sequence_free(self->segments);
+  inf_text_chunk_storage_unref(self->storage);
   g_slice_free(InfTextChunk, self);
 }
 
@@ -472,7 +1046,7 @@ guint
 inf_text_chunk_get_length(InfTextChunk* self)
 {
   g_return_val_if_fail(self != NULL, 0);
-  return self->length;
+  return inf_text_chunk_length(self);
 }
 
 /**
@@ -482,7 +1056,8 @@ inf_text_chunk_get_length(InfTextChunk* self)
  * @length: The length of the text to extract.
  *
  * Returns a new #InfTextChunk containing a substring of @self, beginning
- * at character offset @begin and @length characters long.
+ * at character offset @begin and @length characters long. Where possible,
+ * the text is shared with @self instead of being copied.
  *
  * Returns: (transfer full): A new #InfTextChunk.
  **/
@@ -491,86 +1066,66 @@ inf_text_chunk_substring(InfTextChunk* self,
                          guint begin,
                          guint length)
 {
-  GSequenceIter* begin_iter;
-  GSequenceIter* end_iter;
-  gsize begin_index;
-  gsize end_index;
-
-  InfTextChunk* result;
   InfTextChunkSegment* segment;
   InfTextChunkSegment* new_segment;
-  guint current_length;
+  InfTextChunk* result;
+  guint offset;
+  gsize index;
+  guint end_offset;
+  gsize end_index;
 
   g_return_val_if_fail(self != NULL, NULL);
-  g_return_val_if_fail(begin + length <= self->length, NULL);
+  g_return_val_if_fail(begin + length <= inf_text_chunk_length(self), NULL);
 
-  if(self->length > 0 && length > 0)
+  /* The whole chunk, for example to write a document in the background:
+   * share the segment tree as well. */
+  if(begin == 0 && length == inf_text_chunk_length(self))
+    return inf_text_chunk_copy(self);
+
+  result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+
+  if(length > 0)
   {
-    begin_iter = inf_text_chunk_get_segment(self, begin, &begin_index);
-    end_iter = inf_text_chunk_get_segment(self, begin + length, &end_index);
+    segment = inf_text_chunk_get_segment(self, begin, &offset, &index);
 
-    if(end_index == 0)
+    while(length > 0)
     {
-      g_assert(end_iter != g_sequence_get_end_iter(self->segments));
-      end_iter = g_sequence_iter_prev(end_iter);
-      end_index = ((InfTextChunkSegment*)g_sequence_get(end_iter))->length;
-    }
+      g_assert(segment != NULL && offset < segment->chars);
 
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
-
-    current_length = 0;
-    segment = g_sequence_get(begin_iter);
+      if(length < segment->chars - offset)
+      {
+        /* Last segment, which is only partly contained */
+        inf_text_chunk_get_segment(
+          self,
+          begin + length,
+          &end_offset,
+          &end_index
+        );
 
-    while(begin_iter != end_iter)
-    {
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = segment->author;
+        g_assert(end_offset == offset + length);
+      }
+      else
+      {
+        end_offset = segment->chars;
+        end_index = segment->bytes;
+      }
 
-      new_segment->text = g_memdup(
-        segment->text + begin_index,
-        segment->length - begin_index
+      new_segment = inf_text_chunk_segment_new_shared(
+        segment,
+        index,
+        end_index - index,
+        end_offset - offset
       );
-      
-      new_segment->length = segment->length - begin_index;
-      new_segment->offset = current_length;
-
-      begin_iter = g_sequence_iter_next(begin_iter);
-      segment = g_sequence_get(begin_iter);
-
-      /* Add (remaining) length of this segment to current length */
-      current_length = segment->offset - begin;
-
-      /* So we get the next segment from the beginning. This may only be
-       * non-zero during the first iteration. */
-      begin_index = 0;
-    /*  begin = new_segment->offset;*/
-      
-      g_sequence_append(result->segments, new_segment);
-    }
 
-    /* Don't forget last segment */
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = segment->author;
-    new_segment->text = g_memdup(
-      segment->text + begin_index,
-      end_index - begin_index
-    );
-    
-    new_segment->length = end_index - begin_index;
-    new_segment->offset = current_length;
-    
-    g_sequence_append(result->segments, new_segment);
-
-    result->length = length;
-    result->encoding = self->encoding;
-    result->path = self->path;
-  }
-  else
-  {
-    g_assert(length == 0 || begin == 0);
+      inf_text_chunk_storage_insert_before(result->storage, NULL, new_segment);
+
+      begin += end_offset - offset;
+      length -= end_offset - offset;
 
-    /* New, empty chunk */
-    result = inf_text_chunk_new(g_quark_to_string(self->encoding));
+      segment = inf_text_chunk_segment_next(segment);
+      offset = 0;
+      index = 0;
+    }
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -601,103 +1156,76 @@ inf_text_chunk_insert_text(InfTextChunk* self,
                            guint length,
                            guint author)
 {
-  GSequenceIter* iter;
-  gsize offset_index;
   InfTextChunkSegment* segment;
   InfTextChunkSegment* new_segment;
+  guint segment_offset;
+  gsize segment_index;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(offset <= self->length);
+  g_return_if_fail(offset <= inf_text_chunk_length(self));
 
-  if(self->length > 0)
-  {
-    iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
+  if(length == 0)
+    return;
 
+  inf_text_chunk_make_writable(self);
+
+  segment = inf_text_chunk_get_segment(
+    self,
+    offset,
+    &segment_offset,
+    &segment_index
+  );
+
+  if(segment != NULL)
+  {
     /* Have to split segment, unless it is between two segments in which
      * case we can perhaps append to the previous. */
-    if(segment->author != author && offset > 0 && offset_index == 0)
+    if(segment->author != author && offset > 0 && segment_offset == 0)
     {
-      g_assert(iter != g_sequence_get_begin_iter(self->segments));
+      segment = inf_text_chunk_segment_prev(segment);
+      g_assert(segment != NULL);
 
-      iter = g_sequence_iter_prev(iter);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      offset_index = segment->length;
+      segment_offset = segment->chars;
+      segment_index = segment->bytes;
     }
 
-    if(segment->author != author)
+    if(segment->author == author)
+    {
+      inf_text_chunk_segment_add_text(
+        segment,
+        segment_index,
+        text,
+        bytes,
+        length
+      );
+    }
+    else
     {
       /* No luck, split if necessary */
-      if(offset_index > 0 && offset_index < segment->length)
+      if(segment_offset > 0 && segment_offset < segment->chars)
       {
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(
-          segment->text + offset_index,
-          segment->length - offset_index
+        segment = inf_text_chunk_storage_split(
+          self->storage,
+          segment,
+          segment_offset,
+          segment_index
         );
-
-        new_segment->length = segment->length - offset_index;
-        new_segment->offset = offset;
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* Don't realloc to make smaller */
-        segment->length = offset_index;
-        /* Note that we did not invalidate offsets so far */
       }
-      else if(offset_index == segment->length)
+      else if(segment_offset == segment->chars)
       {
         /* Insert behind segment */
-        iter = g_sequence_iter_next(iter);
+        segment = inf_text_chunk_segment_next(segment);
       }
 
-      new_segment = g_slice_new(InfTextChunkSegment);
-      new_segment->author = author;
-      new_segment->text = g_memdup(text, bytes);
-      new_segment->length = bytes;
-      new_segment->offset = offset;
-      g_sequence_insert_before(iter, new_segment);
-    }
-    else
-    {
-      /* TODO: g_malloc + g_free + 2*memcpy? */
-      segment->text = g_realloc(segment->text, segment->length + bytes);
-      if(offset_index < segment->length)
-      {
-        g_memmove(
-          segment->text + offset_index + bytes,
-          segment->text + offset_index,
-          segment->length - offset_index
-        );
-      }
-      
-      memcpy(segment->text + offset_index, text, bytes);
-      segment->length += bytes;
-      iter = g_sequence_iter_next(iter);
-    }
-
-    /* Adjust offsets */
-    while(iter != g_sequence_get_end_iter(self->segments))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-      segment->offset += length;
-      iter = g_sequence_iter_next(iter);
+      new_segment =
+        inf_text_chunk_segment_new(author, text, bytes, length, bytes);
+      inf_text_chunk_storage_insert_before(self->storage, segment, new_segment);
     }
-
-    self->length += length;
   }
   else
   {
-    new_segment = g_slice_new(InfTextChunkSegment);
-    new_segment->author = author;
-    new_segment->text = g_memdup(text, bytes);
-    new_segment->length = bytes;
-    new_segment->offset = 0;
-
-    g_sequence_append(self->segments, new_segment);
-    self->length = length;
+    new_segment = inf_text_chunk_segment_new(author, text, bytes, length, bytes);
+    inf_text_chunk_storage_insert_before(self->storage, NULL, new_segment);
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -719,262 +1247,124 @@ inf_text_chunk_insert_chunk(InfTextChunk* self,
                             guint offset,
                             InfTextChunk* text)
 {
-  GSequenceIter* iter;
-  GSequenceIter* text_iter;
-  gsize offset_index;
-  InfTextChunkSegment* segment;
-  InfTextChunkSegment* new_segment;
-
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
   InfTextChunkSegment* first;
   InfTextChunkSegment* last;
-
-  InfTextChunkSegment* first_merge;
-  InfTextChunkSegment* last_merge;
-  GSequenceIter* beyond;
+  InfTextChunkSegment* before;
+  InfTextChunkSegment* after;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* new_segment;
+  guint segment_offset;
+  gsize segment_index;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(offset <= self->length);
+  g_return_if_fail(offset <= inf_text_chunk_length(self));
   g_return_if_fail(text != NULL);
   g_return_if_fail(self->encoding == text->encoding);
 
-  if(self->length > 0 && text->length > 0)
-  {
-    if(g_sequence_get_length(text->segments) == 1)
-    {
-      segment = g_sequence_get(g_sequence_get_begin_iter(text->segments));
+  first = inf_text_chunk_segment_first(text->storage->root);
+  last = inf_text_chunk_segment_last(text->storage->root);
 
-      inf_text_chunk_insert_text(
-        self,
-        offset,
-        segment->text,
-        segment->length,
-        text->length,
-        segment->author
-      );
-    }
-    else
-    {
-      iter = inf_text_chunk_get_segment(self, offset, &offset_index);
-      segment = (InfTextChunkSegment*)g_sequence_get(iter);
-
-      /* First, we insert the first and last segment of text into self,
-       * possibly merging with adjacent segments. Then, the rest is
-       * copied. */
-      first_iter = g_sequence_get_begin_iter(text->segments);
-      last_iter = g_sequence_iter_prev(
-        g_sequence_get_end_iter(text->segments)
-      );
-
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      last = (InfTextChunkSegment*)g_sequence_get(last_iter);
+  if(first == NULL)
+    return;
 
-      /* 0 and 1 segment special cases have been handled above */
-      g_assert(first != last);
+  if(first == last)
+  {
+    inf_text_chunk_insert_text(
+      self,
+      offset,
+      first->text,
+      first->bytes,
+      first->chars,
+      first->author
+    );
 
-      last_merge = segment;
-      first_merge = segment;
+    return;
+  }
 
-      /* beyond points to the first segment that needs offset adjustment
-       * after insertion */
-      beyond = iter;
+  inf_text_chunk_make_writable(self);
 
-      /* Try merge with end of previous segment if inserting inbetween two
-       * segments. */
-      if(offset_index == 0 && offset > 0)
-      {
-        g_assert(iter != g_sequence_get_begin_iter(self->segments));
+  /* Find the segments before and after the insertion point, splitting a
+   * segment if we insert in the middle of it. */
+  after = inf_text_chunk_get_segment(
+    self,
+    offset,
+    &segment_offset,
+    &segment_index
+  );
 
-        iter = g_sequence_iter_prev(iter);
-        first_merge = (InfTextChunkSegment*)g_sequence_get(iter);
-        offset_index = first_merge->length;
-      }
+  if(after == NULL)
+  {
+    before = NULL;
+  }
+  else if(segment_offset == 0)
+  {
+    before = inf_text_chunk_segment_prev(after);
+  }
+  else if(segment_offset == after->chars)
+  {
+    before = after;
+    after = NULL;
+  }
+  else
+  {
+    before = after;
+    after = inf_text_chunk_storage_split(
+      self->storage,
+      before,
+      segment_offset,
+      segment_index
+    );
+  }
 
-      if(offset == 0 || offset == self->length || first_merge != last_merge)
-      {
-        /* Insert between two segments, or at beginning/end */
-        if(first_merge->author == first->author && offset > 0)
-        {
-          /* Can merge first segment */
-          first_merge->length += first->length;
-
-          first_merge->text = g_realloc(
-            first_merge->text,
-            first_merge->length
-          );
-
-          memcpy(
-            first_merge->text + first_merge->length - first->length,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-
-        if(last_merge->author == last->author && offset < self->length)
-        {
-          /* Can merge last segment */
-          last_merge->length += last->length;
-          last_merge->text = g_realloc(last_merge->text, last_merge->length);
-
-          g_memmove(
-            last_merge->text + last->length,
-            last_merge->text,
-            last_merge->length - last->length
-          );
-
-          memcpy(last_merge->text, last->text, last->length);
-          last_merge->offset = offset + last->offset;
-
-          /* Merged with last, so don't need to adjust last_merge->offset
-           * anymore, continue behind with offset adjustment. */
-          beyond = g_sequence_iter_next(beyond);
-        }
-        else
-        {
-          /* Could not merge last segment, so we have to insert it. Therefore,
-           * make last_iter point to the end of the sequence. */
-          last_iter = g_sequence_iter_next(last_iter);
-
-          if(offset_index > 0) /* Note: This is only false for offset == 0 */
-            beyond = g_sequence_iter_next(iter);
-        }
-
-        if(offset_index > 0) /* Note: This is only false for offset == 0 */
-        {
-          /* Pointing to the position before which to insert
-           * the rest of text. */
-          iter = g_sequence_iter_next(iter);
-        }
-      }
-      else
-      {
-        /* Insert within a segment, split segment */
-
-        new_segment = g_slice_new(InfTextChunkSegment);
-        new_segment->author = last_merge->author;
-
-        if(last_merge->author == last->author)
-        {
-          /* Merge last part into new segment */
-          new_segment->length = last_merge->length - offset_index +
-            last->length;
-
-          new_segment->text = g_malloc(new_segment->length);
-          memcpy(new_segment->text, last->text, last->length);
-
-          memcpy(
-            new_segment->text + last->length,
-            last_merge->text + offset_index,
-            last_merge->length - offset_index
-          );
-
-          new_segment->offset = offset + last->offset;
-        }
-        else
-        {
-          /* Split up last part */
-          new_segment->length = last_merge->length - offset_index;
-          new_segment->text = g_malloc(new_segment->length);
-
-          memcpy(
-            new_segment->text,
-            last_merge->text + offset_index,
-            new_segment->length
-          );
-
-          new_segment->offset = offset + text->length;
-
-          /* We still have to insert last segment since we could not merge */
-          last_iter = g_sequence_iter_next(last_iter);
-        }
-
-        iter = g_sequence_iter_next(iter);
-        iter = g_sequence_insert_before(iter, new_segment);
-
-        /* The segment just inserted is the last one being inserted, so
-         * we need to adjust beyond that */
-        beyond = g_sequence_iter_next(iter);
-
-        /* Note first_merge == last_merge */
-        if(first_merge->author == first->author)
-        {
-          /* Merge into first */
-          if(first_merge->length < offset_index + first->length)
-          {
-            first_merge->text = g_realloc(
-              first_merge->text,
-              offset_index + first->length
-            );
-          }
-
-          first_merge->length = offset_index + first->length;
-
-          memcpy(
-            first_merge->text + offset_index,
-            first->text,
-            first->length
-          );
-
-          /* Already inserted */
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        else
-        {
-          /* Cannot merge, just cut */
-          first_merge->length = offset_index;
-        }
-      }
+  /* Merge the first segment of text into the segment before the insertion
+   * point if possible, and the last segment into the segment after it. All
+   * other segments are inserted in between, sharing their text. */
+  segment = first;
+  if(before != NULL && before->author == first->author)
+  {
+    inf_text_chunk_segment_add_text(
+      before,
+      before->bytes,
+      first->text,
+      first->bytes,
+      first->chars
+    );
 
-      /* iter now points to the segment before which the rest of text has to
-       * be inserted */
+    segment = inf_text_chunk_segment_next(segment);
+  }
 
-      for(text_iter = first_iter;
-          text_iter != last_iter;
-          text_iter = g_sequence_iter_next(text_iter))
-      {
-        segment = g_sequence_get(text_iter);
-        new_segment = g_slice_new(InfTextChunkSegment);
-
-        new_segment->author = segment->author;
-        new_segment->text = g_memdup(segment->text, segment->length);
-        new_segment->length = segment->length;
-        new_segment->offset = offset + segment->offset;
-        g_sequence_insert_before(iter, new_segment);
-      }
+  for(; segment != last; segment = inf_text_chunk_segment_next(segment))
+  {
+    new_segment = inf_text_chunk_segment_new_shared(
+      segment,
+      0,
+      segment->bytes,
+      segment->chars
+    );
 
-      for(iter = beyond;
-          iter != g_sequence_get_end_iter(self->segments);
-          iter = g_sequence_iter_next(iter))
-      {
-        segment = g_sequence_get(iter);
-        segment->offset += inf_text_chunk_get_length(text);
-      }
+    inf_text_chunk_storage_insert_before(self->storage, after, new_segment);
+  }
 
-      self->length += text->length;
-    }
+  if(after != NULL && after->author == last->author)
+  {
+    inf_text_chunk_segment_add_text(
+      after,
+      0,
+      last->text,
+      last->bytes,
+      last->chars
+    );
   }
   else
   {
-    for(text_iter = g_sequence_get_begin_iter(text->segments);
-        text_iter != g_sequence_get_end_iter(text->segments);
-        text_iter = g_sequence_iter_next(text_iter))
-    {
-      segment = (InfTextChunkSegment*)g_sequence_get(text_iter);
-      new_segment = g_slice_new(InfTextChunkSegment);
-
-      new_segment->author = segment->author;
-      new_segment->text = g_memdup(segment->text, segment->length);
-      new_segment->length = segment->length;
-      new_segment->offset = segment->offset;
-
-      g_sequence_append(self->segments, new_segment);
-    }
+    new_segment = inf_text_chunk_segment_new_shared(
+      last,
+      0,
+      last->bytes,
+      last->chars
+    );
 
-    self->length += text->length;
+    inf_text_chunk_storage_insert_before(self->storage, after, new_segment);
   }
 
 #ifdef CHUNK_CHECK_INTEGRITY
@@ -995,178 +1385,105 @@ inf_text_chunk_erase(InfTextChunk* self,
                      guint begin,
                      guint length)
 {
-  GSequenceIter* first_iter;
-  GSequenceIter* last_iter;
-  GSequenceIter* beyond;
-  gsize first_index;
-  gsize last_index;
   InfTextChunkSegment* first;
   InfTextChunkSegment* last;
+  InfTextChunkSegment* segment;
+  InfTextChunkSegment* next;
+  guint first_offset;
+  gsize first_index;
+  guint last_offset;
+  gsize last_index;
 
   g_return_if_fail(self != NULL);
-  g_return_if_fail(begin + length <= self->length);
+  g_return_if_fail(begin + length <= inf_text_chunk_length(self));
 
-  if(self->length > 0 && length > 0)
-  {
-    first_iter = inf_text_chunk_get_segment(self, begin, &first_index);
-    last_iter = inf_text_chunk_get_segment(self, begin + length, &last_index);
+  if(length == 0)
+    return;
 
-    first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-    last = (InfTextChunkSegment*)g_sequence_get(last_iter);
+  inf_text_chunk_make_writable(self);
 
-    if(begin > 0 && begin + length < self->length)
-    {
-      if(first_index == 0)
-      {
-        g_assert(first_iter != g_sequence_get_end_iter(self->segments));
-        first_iter = g_sequence_iter_prev(first_iter);
-        first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-        first_index = first->length;
-      }
+  first = inf_text_chunk_get_segment(self, begin, &first_offset, &first_index);
+  last = inf_text_chunk_get_segment(
+    self,
+    begin + length,
+    &last_offset,
+    &last_index
+  );
 
-      if(first->author == last->author)
-      {
-        /* Can merge */
-        if(first == last)
-        {
-          /* Remove within a segment */
-          g_memmove(
-            first->text + first_index,
-            first->text + last_index,
-            first->length - last_index
-          );
-
-          first->length -= (last_index - first_index);
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          if(first->length < first_index + last->length - last_index)
-          {
-            first->text = g_realloc(
-              first->text,
-              first_index + last->length - last_index
-            );
-          }
-
-          first->length = first_index + last->length - last_index;
-
-          memcpy(
-            first->text + first_index,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last_iter = g_sequence_iter_next(last_iter);
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* This could only happen if these are the first or last segment,
-         * of the whole chunk, respectively, which they are not
-         * (as checked above). */
-        g_assert(first_index > 0);
-        g_assert(last_index < last->length);
-        
-        /* Erase from border segments */
-        first->length = first_index;
-
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-        }
-
-        last->length -= last_index;
-        last->offset = begin;
-
-        /* We already adjusted offset of last, so only adjust behind */
-        beyond = g_sequence_iter_next(last_iter);
-      }
+  if(first == last && first_offset > 0)
+  {
+    /* Remove within a segment */
+    inf_text_chunk_segment_reserve(first, first->bytes);
+
+    g_memmove(
+      first->text + first_index,
+      first->text + last_index,
+      first->bytes - last_index
+    );
 
-      /* Keep first alive, we merged stuff into it */
-      first_iter = g_sequence_iter_next(first_iter);
+    first->bytes -= last_index - first_index;
+    first->chars -= length;
+    inf_text_chunk_segment_update_path(first);
+  }
+  else
+  {
+    /* first is the segment whose beginning we keep, and last the segment
+     * whose end we keep, if any. All segments in between are removed. */
+    if(first_offset == 0)
+    {
+      segment = first;
+      first = inf_text_chunk_segment_prev(first);
     }
     else
     {
-      if(begin == 0 && length == self->length)
-      {
-        /* Erase everything */
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
-
-        beyond = last_iter;
-      }
-      else if(begin == 0)
-      {
-        g_assert(last_index < last->length);
-
-        /* Erase from beginning */
-        if(last_index > 0)
-        {
-          g_memmove(
-            last->text,
-            last->text + last_index,
-            last->length - last_index
-          );
-
-          last->length -= last_index;
-          last->offset = 0;
-
-          beyond = g_sequence_iter_next(last_iter);
-        }
-        else
-        {
-          /* First segments are completely removed */
-          beyond = last_iter;
-        }
-      }
-      else
-      {
-        /* Erase until end */
-
-        /* This could only be possible in the last segment, but then we
-         * would erase 0-length, which is a special case we would have
-         * catched elsewhere. */
-        g_assert(first_index < first->length);
-
+      segment = inf_text_chunk_segment_next(first);
+    }
 
-        if(first_index > 0)
-        {
-          /* Cannot erase whole first chunk */
-          first->length = first_index;
-          first_iter = g_sequence_iter_next(first_iter);
-        }
-        
-        last_iter = g_sequence_iter_next(last_iter);
-        g_assert(last_iter == g_sequence_get_end_iter(self->segments));
+    if(last_offset == last->chars)
+    {
+      g_assert(inf_text_chunk_segment_next(last) == NULL);
+      last = NULL;
+    }
 
-        beyond = last_iter;
-      }
+    while(segment != last)
+    {
+      next = inf_text_chunk_segment_next(segment);
+      inf_text_chunk_storage_remove(self->storage, segment);
+      segment = next;
     }
 
-    /* first_iter and last_iter have been adjusted so that we have to
-     * remove [first_iter, last_iter). */
+    if(first != NULL && first_offset > 0)
+    {
+      first->bytes = first_index;
+      first->chars = first_offset;
+      inf_text_chunk_segment_update_path(first);
+    }
 
-    /* segments are freed through the sequence's destroy function */
-    g_sequence_remove_range(first_iter, last_iter);
+    if(last != NULL && last_offset > 0)
+    {
+      /* Instead of moving the remaining text of last to the front, we
+       * simply skip the erased part. */
+      last->text += last_index;
+      last->bytes -= last_index;
+      last->chars -= last_offset;
+      inf_text_chunk_segment_update_path(last);
+    }
 
-    /* adjust offsets */
-    for(first_iter = beyond;
-        first_iter != g_sequence_get_end_iter(self->segments);
-        first_iter = g_sequence_iter_next(first_iter))
+    if(first != NULL && last != NULL && first->author == last->author)
     {
-      first = (InfTextChunkSegment*)g_sequence_get(first_iter);
-      first->offset -= length;
+      /* Can merge */
+      inf_text_chunk_segment_add_text(
+        first,
+        first->bytes,
+        last->text,
+        last->bytes,
+        last->chars
+      );
+
+      inf_text_chunk_storage_remove(self->storage, last);
     }
   }
 
-  self->length -= length;
-
 #ifdef CHUNK_CHECK_INTEGRITY
   g_assert(inf_text_chunk_check_integrity(self) == TRUE);
 #endif
@@ -1188,35 +1505,23 @@ gpointer
 inf_text_chunk_get_text(InfTextChunk* self,
                         gsize* length)
 {
-  GSequenceIter* iter;
   InfTextChunkSegment* segment;
   gsize bytes;
   gsize cur;
   gchar* result;
-  
-  g_return_val_if_fail(self != NULL, NULL);
-  bytes = 0;
 
-  /* First pass, determine size */
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
-  {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    bytes += segment->length;
-  }
+  g_return_val_if_fail(self != NULL, NULL);
 
-  /* Second pass, copy */
+  bytes = INF_TEXT_CHUNK_SEGMENT_BYTES(self->storage->root);
   result = g_malloc(bytes);
   cur = 0;
 
-  for(iter = g_sequence_get_begin_iter(self->segments);
-      iter != g_sequence_get_end_iter(self->segments);
-      iter = g_sequence_iter_next(iter))
+  for(segment = inf_text_chunk_segment_first(self->storage->root);
+      segment != NULL;
+      segment = inf_text_chunk_segment_next(segment))
   {
-    segment = (InfTextChunkSegment*)g_sequence_get(iter);
-    memcpy(result + cur, segment->text, segment->length);
-    cur += segment->length;
+    memcpy(result + cur, segment->text, segment->bytes);
+    cur += segment->bytes;
   }
 
   if(length != NULL) *length = bytes;
@@ -1237,8 +1542,6 @@ gboolean
 inf_text_chunk_equal(InfTextChunk* self,
                      InfTextChunk* other)
 {
-  GSequenceIter* iter1;
-  GSequenceIter* iter2;
   InfTextChunkSegment* segment1;
   InfTextChunkSegment* segment2;
 
@@ -1246,30 +1549,27 @@ inf_text_chunk_equal(InfTextChunk* self,
   g_return_val_if_fail(other != NULL, FALSE);
   g_return_val_if_fail(self->encoding == other->encoding, FALSE);
 
-  iter1 = g_sequence_get_begin_iter(self->segments);
-  iter2 = g_sequence_get_begin_iter(other->segments);
+  /* Chunks only share their segments as long as they are unmodified */
+  if(self->storage == other->storage)
+    return TRUE;
 
-  while(iter1 != g_sequence_get_end_iter(self->segments) &&
-        iter2 != g_sequence_get_end_iter(other->segments))
-  {
-    segment1 = (InfTextChunkSegment*)g_sequence_get(iter1);
-    segment2 = (InfTextChunkSegment*)g_sequence_get(iter2);
+  segment1 = inf_text_chunk_segment_first(self->storage->root);
+  segment2 = inf_text_chunk_segment_first(other->storage->root);
 
-    if(segment1->length != segment2->length)
+  while(segment1 != NULL && segment2 != NULL)
+  {
+    if(segment1->bytes != segment2->bytes)
       return FALSE;
 
-    if(memcmp(segment1->text, segment2->text, segment1->length) != 0)
+    if(memcmp(segment1->text, segment2->text, segment1->bytes) != 0)
       return FALSE;
 
-    iter1 = g_sequence_iter_next(iter1);
-    iter2 = g_sequence_iter_next(iter2);
+    segment1 = inf_text_chunk_segment_next(segment1);
+    segment2 = inf_text_chunk_segment_next(segment2);
   }
 
-  if(iter1 != g_sequence_get_end_iter(self->segments) ||
-     iter2 != g_sequence_get_end_iter(other->segments))
-  {
+  if(segment1 != NULL || segment2 != NULL)
     return FALSE;
-  }
 
   return TRUE;
 }
@@ -1289,14 +1589,17 @@ gboolean
 inf_text_chunk_iter_init_begin(InfTextChunk* self,
                                InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* first;
+
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(self->length > 0)
+  first = inf_text_chunk_segment_first(self->storage->root);
+  if(first != NULL)
   {
     iter->chunk = self;
-    iter->first = g_sequence_get_begin_iter(self->segments);
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->first = first;
+    iter->second = inf_text_chunk_segment_next(first);
     return TRUE;
   }
   else
@@ -1320,14 +1623,17 @@ gboolean
 inf_text_chunk_iter_init_end(InfTextChunk* self,
                              InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* last;
+
   g_return_val_if_fail(self != NULL, FALSE);
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(self->length > 0)
+  last = inf_text_chunk_segment_last(self->storage->root);
+  if(last != NULL)
   {
     iter->chunk = self;
-    iter->second = g_sequence_get_end_iter(self->segments);
-    iter->first = g_sequence_iter_prev(iter->second);
+    iter->first = last;
+    iter->second = NULL;
     return TRUE;
   }
   else
@@ -1350,10 +1656,10 @@ inf_text_chunk_iter_next(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_end(iter->second) == FALSE)
+  if(iter->second != NULL)
   {
     iter->first = iter->second;
-    iter->second = g_sequence_iter_next(iter->first);
+    iter->second = inf_text_chunk_segment_next(iter->first);
     return TRUE;
   }
   else
@@ -1374,12 +1680,15 @@ inf_text_chunk_iter_next(InfTextChunkIter* iter)
 gboolean
 inf_text_chunk_iter_prev(InfTextChunkIter* iter)
 {
+  InfTextChunkSegment* prev;
+
   g_return_val_if_fail(iter != NULL, FALSE);
 
-  if(g_sequence_iter_is_begin(iter->first) == FALSE)
+  prev = inf_text_chunk_segment_prev(iter->first);
+  if(prev != NULL)
   {
     iter->second = iter->first;
-    iter->first = g_sequence_iter_prev(iter->first);
+    iter->first = prev;
     return TRUE;
   }
   else
@@ -1401,7 +1710,7 @@ gconstpointer
 inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, NULL);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->text;
+  return ((InfTextChunkSegment*)iter->first)->text;
 }
 
 /**
@@ -1416,12 +1725,8 @@ inf_text_chunk_iter_get_text(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-  return first->offset;
+  return inf_text_chunk_segment_get_offset(iter->first);
 }
 
 /**
@@ -1435,22 +1740,8 @@ inf_text_chunk_iter_get_offset(InfTextChunkIter* iter)
 guint
 inf_text_chunk_iter_get_length(InfTextChunkIter* iter)
 {
-  InfTextChunkSegment* first;
-  InfTextChunkSegment* second;
-
   g_return_val_if_fail(iter != NULL, 0);
-
-  if(g_sequence_iter_is_end(iter->second) == TRUE)
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    return iter->chunk->length - first->offset;
-  }
-  else
-  {
-    first = (InfTextChunkSegment*)g_sequence_get(iter->first);
-    second = (InfTextChunkSegment*)g_sequence_get(iter->second);
-    return second->offset - first->offset;
-  }
+  return ((InfTextChunkSegment*)iter->first)->chars;
 }
 
 /**
@@ -1465,7 +1756,7 @@ gsize
 inf_text_chunk_iter_get_bytes(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->length;
+  return ((InfTextChunkSegment*)iter->first)->bytes;
 }
 
 /**
@@ -1480,7 +1771,65 @@ guint
 inf_text_chunk_iter_get_author(InfTextChunkIter* iter)
 {
   g_return_val_if_fail(iter != NULL, 0);
-  return ((InfTextChunkSegment*)g_sequence_get(iter->first))->author;
+  return ((InfTextChunkSegment*)iter->first)->author;
+}
+
+InfTextChunk*
+_inf_text_chunk_new_from_segments(const gchar* encoding,
+                                  const gchar* text,
+                                  const InfTextChunkSegmentInfo* segments,
+                                  guint n_segments)
+{
+  InfTextChunk* chunk;
+  InfTextChunkSegment** array;
+  guint n_array;
+  gsize bytes;
+  guint chars;
+  guint i;
+  guint j;
+
+  chunk = inf_text_chunk_new(encoding);
+  if(n_segments == 0)
+    return chunk;
+
+  array = g_new(InfTextChunkSegment*, n_segments);
+  n_array = 0;
+
+  for(i = 0; i < n_segments; i = j)
+  {
+    /* Merge adjacent segments of the same author, as
+     * inf_text_chunk_insert_text() would do. */
+    bytes = segments[i].bytes;
+    chars = segments[i].chars;
+    for(j = i + 1; j < n_segments; ++j)
+    {
+      if(segments[j].author != segments[i].author)
+        break;
+
+      bytes += segments[j].bytes;
+      chars += segments[j].chars;
+    }
+
+    array[n_array++] = inf_text_chunk_segment_new(
+      segments[i].author,
+      text,
+      bytes,
+      chars,
+      bytes
+    );
+
+    text += bytes;
+  }
+
+  chunk->storage->root =
+    inf_text_chunk_storage_build_subtree(array, 0, n_array, NULL);
+  g_free(array);
+
+#ifdef CHUNK_CHECK_INTEGRITY
+  g_assert(inf_text_chunk_check_integrity(chunk) == TRUE);
+#endif
+
+  return chunk;
 }
 
 /* vim:set et sw=2 ts=2: */
@@ -225,6 +225,61 @@ inf_text_default_buffer_buffer_erase_text(InfTextBuffer* buffer,
   }
 }
 
+static void
+inf_text_default_buffer_buffer_append(InfTextBuffer* buffer,
+                                      InfTextChunk* chunk,
+                                      InfUser* user)
+{
+  InfTextDefaultBufferPrivate* priv;
+  guint pos;
+
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+  pos = inf_text_chunk_get_length(priv->chunk);
+
+  /* When filling an empty buffer, share the segments with chunk instead of
+   * inserting them one by one. */
+  if(pos == 0)
+  {
+    inf_text_chunk_free(priv->chunk);
+    priv->chunk = inf_text_chunk_copy(chunk);
+  }
+  else
+  {
+    inf_text_chunk_insert_chunk(priv->chunk, pos, chunk);
+  }
+
+  inf_text_buffer_text_inserted(buffer, pos, chunk, user);
+
+  if(priv->modified == FALSE)
+  {
+    priv->modified = TRUE;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
+static void
+inf_text_default_buffer_buffer_clear(InfTextBuffer* buffer,
+                                     InfUser* user)
+{
+  InfTextDefaultBufferPrivate* priv;
+  InfTextChunk* chunk;
+
+  priv = INF_TEXT_DEFAULT_BUFFER_PRIVATE(buffer);
+
+  /* The erased text is the whole chunk, so there is no need to copy it */
+  chunk = priv->chunk;
+  priv->chunk = inf_text_chunk_new(priv->encoding);
+
+  inf_text_buffer_text_erased(buffer, 0, chunk, user);
+  inf_text_chunk_free(chunk);
+
+  if(priv->modified == FALSE)
+  {
+    priv->modified = TRUE;
+    g_object_notify(G_OBJECT(buffer), "modified");
+  }
+}
+
 static InfTextBufferIter*
 inf_text_default_buffer_buffer_create_begin_iter(InfTextBuffer* buffer)
 {
@@ -365,6 +420,8 @@ inf_text_default_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->get_slice = inf_text_default_buffer_buffer_get_slice;
   iface->insert_text = inf_text_default_buffer_buffer_insert_text;
   iface->erase_text = inf_text_default_buffer_buffer_erase_text;
+  iface->append = inf_text_default_buffer_buffer_append;
+  iface->clear = inf_text_default_buffer_buffer_clear;
   iface->create_begin_iter = inf_text_default_buffer_buffer_create_begin_iter;
   iface->create_end_iter = inf_text_default_buffer_buffer_create_end_iter;
   iface->destroy_iter = inf_text_default_buffer_buffer_destroy_iter;
@@ -0,0 +1,80 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_FILESYSTEM_FORMAT_PRIVATE_H__
+#define __INF_TEXT_FILESYSTEM_FORMAT_PRIVATE_H__
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-user-table.h>
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Like inf_text_filesystem_format_read(), but reads the file with the given
+ * storage identifier. If journal_sequence is not NULL, it is set to the
+ * journal sequence number stored in the file, or to -1 if there is none. */
+gboolean
+_inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                 const gchar* identifier,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 gint64* journal_sequence,
+                                 GError** error);
+
+/* Like inf_text_filesystem_format_write_with_type(), but writes the file
+ * with the given storage identifier. For
+ * INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY, the binary file has the
+ * identifier with ".bin" appended. If journal_sequence is non-negative, it
+ * is stored in the file. If sync is TRUE, the function only returns after
+ * the file has been written to disk. */
+gboolean
+_inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                  const gchar* identifier,
+                                  const gchar* path,
+                                  InfUserTable* user_table,
+                                  InfTextBuffer* buffer,
+                                  InfTextFilesystemFormatType type,
+                                  gint64 journal_sequence,
+                                  gboolean sync,
+                                  GError** error);
+
+/* Creates copies of user_table and buffer that can be written in another
+ * thread while the originals are being modified. The buffer copy shares its
+ * text with the original until either of them is modified; this is cheap
+ * and does not need to copy the whole document. */
+void
+_inf_text_filesystem_format_snapshot(InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     InfUserTable** user_table_copy,
+                                     InfTextBuffer** buffer_copy);
+
+/* Waits until all writes started with
+ * inf_text_filesystem_format_write_async() so far have finished. */
+void
+_inf_text_filesystem_format_flush_writes(void);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_FILESYSTEM_FORMAT_PRIVATE_H__ */
+
+/* vim:set et sw=2 ts=2: */
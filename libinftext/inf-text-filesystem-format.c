@@ -30,32 +30,214 @@
  * implementing a #InfdNotePlugin to handle #InfTextSession<!-- -->s. These
  * functions implement reading and writing the content of an #InfTextSession
  * to an XML file in the storage.
+ *
+ * For large documents, the content can also be stored in a compact binary
+ * format, either instead of the XML file or next to it, see
+ * #InfTextFilesystemFormatType. Reading a binary file does not involve any
+ * parsing: the file is mapped into memory, verified with a checksum, and
+ * the text is copied into the buffer in a single pass. The binary format
+ * is only meant as a cache for fast loading; the XML format remains the
+ * one to use for exchanging documents.
  */
 
 #include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-filesystem-format-private.h>
+#include <libinftext/inf-text-chunk-private.h>
+#include <libinftext/inf-text-default-buffer.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/inf-define-enum.h>
 #include <libinfinity/inf-i18n.h>
 
+#include <libxml/xmlreader.h>
+
 #include <string.h>
+#include <errno.h>
+
+/* A binary file consists of the following sections, each of which starts
+ * at a multiple of eight bytes, so that the file can be read in place when
+ * it is mapped into memory. All numbers are little endian.
+ *
+ * Header, 40 bytes:
+ *   magic (8 bytes), version (u32), number of users (u32), ID (u64),
+ *   journal sequence number (i64), size of the user table (u64)
+ * User table, for each user:
+ *   ID (u32), name length in bytes (u32), hue (IEEE 754 double, as u64),
+ *   name in UTF-8, padded to eight bytes
+ * Text of all segments, in UTF-8, padded to eight bytes
+ * Segment table, 16 bytes for each segment:
+ *   author (u32), length in characters (u32), length in bytes (u64)
+ * Trailer, 32 bytes:
+ *   size of the text (u64), number of segments (u32), reserved (u32),
+ *   MD5 digest of all preceding bytes of the file (16 bytes)
+ *
+ * The ID is non-zero for a binary file that is written next to an XML file,
+ * and is stored in the XML file as well, so that a binary file which does
+ * not belong to the XML file can be told apart. */
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC "\0InfText"
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE 8
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION 1
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_HEADER_SIZE 40
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_USER_SIZE 16
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE 16
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_TRAILER_SIZE 32
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE 16
+
+#define INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(size) \
+  (((guint64)(size) + 7) & ~(guint64)7)
+
+/* A document written in a separate thread by
+ * inf_text_filesystem_format_write_async(). The user table and buffer are
+ * copies of the session's, made by _inf_text_filesystem_format_snapshot(). */
+typedef struct _InfTextFilesystemFormatAsyncWrite {
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextFilesystemFormatType type;
+  InfIo* io;
+  InfTextFilesystemFormatWriteFunc func;
+  gpointer user_data;
+
+  guint64 serial;
+  GThread* thread;
+  GError* error;
+} InfTextFilesystemFormatAsyncWrite;
 
 typedef struct _InfTextFilesystemFormatWriteData {
-  xmlNodePtr root;
+  xmlTextWriterPtr writer;
   GHashTable* encountered_authors;
+  int result;
 } InfTextFilesystemFormatWriteData;
 
+/* Allows to look at the beginning of a file before handing it to the XML
+ * parser, to find out whether it is a binary file. */
+typedef struct _InfTextFilesystemFormatReadData {
+  FILE* stream;
+  gchar header[INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE];
+  gsize header_len;
+  gsize header_pos;
+} InfTextFilesystemFormatReadData;
+
+typedef struct _InfTextFilesystemFormatCollectData {
+  GHashTable* encountered_authors;
+  GPtrArray* users;
+} InfTextFilesystemFormatCollectData;
+
+typedef struct _InfTextFilesystemFormatBinaryWriter {
+  FILE* stream;
+  GChecksum* checksum;
+  guint64 offset;
+  int save_errno;
+} InfTextFilesystemFormatBinaryWriter;
+
+/* One entry of the segment table, already in little endian */
+typedef struct _InfTextFilesystemFormatBinarySegment {
+  guint32 author;
+  guint32 chars;
+  guint64 bytes;
+} InfTextFilesystemFormatBinarySegment;
+
+G_STATIC_ASSERT(
+  sizeof(InfTextFilesystemFormatBinarySegment) ==
+  INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE
+);
+
+static const GEnumValue inf_text_filesystem_format_type_values[] = {
+  {
+    INF_TEXT_FILESYSTEM_FORMAT_XML,
+    "INF_TEXT_FILESYSTEM_FORMAT_XML",
+    "xml"
+  }, {
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+    "INF_TEXT_FILESYSTEM_FORMAT_BINARY",
+    "binary"
+  }, {
+    INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY,
+    "INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY",
+    "xml-with-binary"
+  }, {
+    0,
+    NULL,
+    NULL
+  }
+};
+
+INF_DEFINE_ENUM_TYPE(InfTextFilesystemFormatType, inf_text_filesystem_format_type, inf_text_filesystem_format_type_values)
+
+/* Asynchronous writes are numbered, and each one waits for all previous
+ * ones to finish, so that the files end up with the most recent content
+ * when the same document is saved several times in a row. */
+static GMutex inf_text_filesystem_format_writes_mutex;
+static GCond inf_text_filesystem_format_writes_cond;
+static guint64 inf_text_filesystem_format_writes_queued;
+static guint64 inf_text_filesystem_format_writes_done;
+
 static GQuark
 inf_text_filesystem_format_error_quark()
 {
   return g_quark_from_static_string("INF_TEXT_FILESYSTEM_FORMAT_ERROR");
 }
 
+static void
+inf_text_filesystem_format_set_system_error(int code,
+                                            GError** error)
+{
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
 static int
 inf_text_filesystem_format_read_read_func(void* context,
                                           char* buffer,
                                           int len)
+{
+  InfTextFilesystemFormatReadData* data;
+  gsize header_res;
+  gsize res;
+
+  data = (InfTextFilesystemFormatReadData*)context;
+
+  /* Pass on the part of the file that has been read already first */
+  header_res = MIN((gsize)len, data->header_len - data->header_pos);
+  memcpy(buffer, data->header + data->header_pos, header_res);
+  data->header_pos += header_res;
+
+  res = infd_filesystem_storage_stream_read(
+    data->stream,
+    buffer + header_res,
+    len - header_res
+  );
+
+  if(ferror(data->stream))
+    return -1;
+
+  return (int)(header_res + res);
+}
+
+static int
+inf_text_filesystem_format_read_close_func(void* context)
+{
+  InfTextFilesystemFormatReadData* data;
+  int res;
+
+  data = (InfTextFilesystemFormatReadData*)context;
+  res = infd_filesystem_storage_stream_close(data->stream);
+  g_slice_free(InfTextFilesystemFormatReadData, data);
+
+  return res;
+}
+
+static int
+inf_text_filesystem_format_write_write_func(void* context,
+                                            const char* buffer,
+                                            int len)
 {
   gsize res;
-  res = infd_filesystem_storage_stream_read((FILE*)context, buffer, len);
+  res = infd_filesystem_storage_stream_write((FILE*)context, buffer, len);
 
   if(ferror((FILE*)context))
     return -1;
@@ -64,11 +246,68 @@ inf_text_filesystem_format_read_read_func(void* context,
 }
 
 static int
-inf_text_filesystem_format_read_close_func(void* context)
+inf_text_filesystem_format_write_close_func(void* context)
 {
   return infd_filesystem_storage_stream_close((FILE*)context);
 }
 
+static void
+inf_text_filesystem_format_set_xml_error(GError** error)
+{
+  xmlErrorPtr xmlerror;
+  xmlerror = xmlGetLastError();
+
+  if(xmlerror != NULL)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      xmlerror->code,
+      xmlerror->message
+    );
+  }
+  else
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+      0,
+      _("Failed to write XML output")
+    );
+  }
+}
+
+static void
+inf_text_filesystem_format_set_parser_error(GError** error,
+                                            const gchar* path)
+{
+  xmlErrorPtr xmlerror;
+  xmlerror = xmlGetLastError();
+
+  if(xmlerror != NULL)
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      xmlerror->code,
+      _("Error parsing XML in file \"%s\": [%d]: %s"),
+      path,
+      xmlerror->line,
+      xmlerror->message
+    );
+  }
+  else
+  {
+    g_set_error(
+      error,
+      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
+      0,
+      _("Error parsing XML in file \"%s\""),
+      path
+    );
+  }
+}
+
 static gboolean
 inf_text_filesystem_format_read_user(InfUserTable* user_table,
                                      xmlNodePtr node,
@@ -139,118 +378,101 @@ inf_text_filesystem_format_read_user(InfUserTable* user_table,
 }
 
 static gboolean
-inf_text_filesystem_format_read_buffer(InfTextBuffer* buffer,
-                                       InfUserTable* user_table,
-                                       xmlNodePtr node,
-                                       GError** error)
+inf_text_filesystem_format_read_segment(InfTextChunk* chunk,
+                                        InfUserTable* user_table,
+                                        gboolean is_utf8,
+                                        xmlNodePtr node,
+                                        GError** error)
 {
-  xmlNodePtr child;
   guint author;
   gchar* content;
-  gboolean result;
   gboolean res;
   InfUser* user;
   gsize bytes;
   guint chars;
 
-  gboolean is_utf8;
   gchar* converted;
   gsize converted_bytes;
 
-  g_assert(inf_text_buffer_get_length(buffer) == 0);
+  res = inf_xml_util_get_attribute_uint_required(
+    node,
+    "author",
+    &author,
+    error
+  );
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+  if(res == FALSE)
+    return FALSE;
 
-  for(child = node->children; child != NULL; child = child->next)
+  if(author != 0)
   {
-    if(child->type != XML_ELEMENT_NODE)
-      continue;
+    user = inf_user_table_lookup_user_by_id(user_table, author);
 
-    if(strcmp((const gchar*)child->name, "segment") == 0)
+    if(user == NULL)
     {
-      res = inf_xml_util_get_attribute_uint_required(
-        child,
-        "author",
-        &author,
-        error
+      g_set_error(
+        error,
+        g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
       );
 
-      if(res == FALSE)
-        return FALSE;
-
-      if(author != 0)
-      {
-        user = inf_user_table_lookup_user_by_id(user_table, author);
-
-        if(user == NULL)
-        {
-          g_set_error(
-            error,
-            g_quark_from_static_string("INF_NOTE_PLUGIN_TEXT_ERROR"),
-            INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
-            _("User with ID \"%u\" does not exist"),
-            author
-          );
-
-          return FALSE;
-        }
-      }
-      else
-      {
-        user = NULL;
-      }
+      return FALSE;
+    }
+  }
 
-      content = inf_xml_util_get_child_text(child, &bytes, &chars, error);
-      if(!content) return FALSE;
+  content = inf_xml_util_get_child_text(node, &bytes, &chars, error);
+  if(!content) return FALSE;
 
-      if(*content != '\0')
-      {
-        if(is_utf8)
-        {
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            content,
-            bytes,
-            chars,
-            user
-          );
+  if(*content != '\0')
+  {
+    if(is_utf8)
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        content,
+        bytes,
+        chars,
+        author
+      );
 
-          g_free(content);
-        }
-        else
-        {
-          /* Convert from UTF-8 to buffer encoding */
-          converted = g_convert(
-            content,
-            bytes,
-            inf_text_buffer_get_encoding(buffer),
-            "UTF-8",
-            NULL,
-            &converted_bytes, error
-          );
+      g_free(content);
+    }
+    else
+    {
+      /* Convert from UTF-8 to buffer encoding */
+      converted = g_convert(
+        content,
+        bytes,
+        inf_text_chunk_get_encoding(chunk),
+        "UTF-8",
+        NULL,
+        &converted_bytes, error
+      );
 
-          g_free(content);
+      g_free(content);
 
-          if(converted == NULL)
-            return FALSE;
+      if(converted == NULL)
+        return FALSE;
 
-          inf_text_buffer_insert_text(
-            buffer,
-            inf_text_buffer_get_length(buffer),
-            converted,
-            converted_bytes,
-            chars,
-            user
-          );
+      inf_text_chunk_insert_text(
+        chunk,
+        inf_text_chunk_get_length(chunk),
+        converted,
+        converted_bytes,
+        chars,
+        author
+      );
 
-          g_free(converted);
-        }
-      }
+      g_free(converted);
     }
   }
+  else
+  {
+    g_free(content);
+  }
 
   return TRUE;
 }
@@ -261,226 +483,302 @@ inf_text_filesystem_format_write_foreach_user_func(InfUser* user,
 {
   InfTextFilesystemFormatWriteData* data;
   gpointer user_id;
-  xmlNodePtr node;
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
 
   data = (InfTextFilesystemFormatWriteData*)user_data;
   user_id = GUINT_TO_POINTER(inf_user_get_id(user));
 
+  /* Skip the remaining users if writing failed already */
+  if(data->result < 0)
+    return;
+
   /* TODO: Use g_hash_table_contains when we can use glib 2.32 */
   if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
   {
-    node = xmlNewChild(data->root, NULL, (const xmlChar*)"user", NULL);
-
-    inf_xml_util_set_attribute_uint(node, "id", inf_user_get_id(user));
-    inf_xml_util_set_attribute(node, "name", inf_user_get_name(user));
-    inf_xml_util_set_attribute_double(
-      node,
-      "hue",
+    g_ascii_dtostr(
+      buffer,
+      G_ASCII_DTOSTR_BUF_SIZE,
       inf_text_user_get_hue(INF_TEXT_USER(user))
     );
+
+    data->result = xmlTextWriterWriteString(
+      data->writer,
+      (const xmlChar*)"\n  "
+    );
+    if(data->result < 0) return;
+
+    data->result = xmlTextWriterStartElement(
+      data->writer,
+      (const xmlChar*)"user"
+    );
+    if(data->result < 0) return;
+
+    data->result = xmlTextWriterWriteFormatAttribute(
+      data->writer,
+      (const xmlChar*)"id",
+      "%u",
+      inf_user_get_id(user)
+    );
+    if(data->result < 0) return;
+
+    data->result = xmlTextWriterWriteAttribute(
+      data->writer,
+      (const xmlChar*)"name",
+      (const xmlChar*)inf_user_get_name(user)
+    );
+    if(data->result < 0) return;
+
+    data->result = xmlTextWriterWriteAttribute(
+      data->writer,
+      (const xmlChar*)"hue",
+      (const xmlChar*)buffer
+    );
+    if(data->result < 0) return;
+
+    data->result = xmlTextWriterEndElement(data->writer);
   }
 }
 
-/**
- * inf_text_filesystem_format_read:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path to retrieve the session from.
- * @user_table: An empty #InfUserTable to use as the new session's user table.
- * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Reads a text session from @path in @storage. The file is expected to have
- * been saved with inf_text_filesystem_format_write() before. The @user_table
- * parameter should be an empty user table that will be used for the session,
- * and the @buffer parameter should be an empty #InfTextBuffer, and the
- * document will be written into this buffer. If the function succeeds, the
- * user table and buffer can be used to create an #InfTextSession with
- * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
-                                const gchar* path,
-                                InfUserTable* user_table,
-                                InfTextBuffer* buffer,
-                                GError** error)
+static int
+inf_text_filesystem_format_write_segment(xmlTextWriterPtr writer,
+                                         InfTextBuffer* buffer,
+                                         InfTextBufferIter* iter,
+                                         gboolean is_utf8,
+                                         GError** error)
 {
-  FILE* stream;
-  gchar* full_path;
-  gchar* uri;
+  guint author;
+  gchar* content;
+  gsize bytes;
+  gchar* converted;
+  gsize converted_bytes;
+  int result;
 
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  xmlNodePtr root;
-  xmlNodePtr child;
-  gboolean result;
+  author = inf_text_buffer_iter_get_author(buffer, iter);
+  content = inf_text_buffer_iter_get_text(buffer, iter);
+  bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+  if(!is_utf8)
+  {
+    /* Convert from buffer encoding to UTF-8 for storage */
+    converted = g_convert(
+      content,
+      bytes,
+      "UTF-8",
+      inf_text_buffer_get_encoding(buffer),
+      NULL,
+      &converted_bytes,
+      error
+    );
 
-  /* TODO: Use a SAX parser for better performance */
-  full_path = NULL;
-  stream = infd_filesystem_storage_open(
-    INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
-    path,
-    "r",
-    &full_path,
-    error
-  );
+    g_free(content);
 
-  if(stream == NULL)
+    /* g_convert() has set error. Return 0 instead of a negative value, so
+     * that the caller can tell conversion errors from XML errors, for which
+     * it still needs to set error itself. */
+    if(converted == NULL)
+      return 0;
+
+    content = converted;
+    bytes = converted_bytes;
+  }
+
+  result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n    ");
+  if(result >= 0)
+    result = xmlTextWriterStartElement(writer, (const xmlChar*)"segment");
+  if(result >= 0)
   {
-    g_free(full_path);
-    return FALSE;
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"author",
+      "%u",
+      author
+    );
   }
 
-  uri = g_filename_to_uri(full_path, NULL, error);
-  g_free(full_path);
+  if(result >= 0)
+    result = inf_xml_util_write_child_text(writer, content, bytes);
+  if(result >= 0)
+    result = xmlTextWriterEndElement(writer);
 
-  if(uri == NULL)
-    return FALSE;
+  g_free(content);
+  return result < 0 ? result : 1;
+}
 
-  doc = xmlReadIO(
-    inf_text_filesystem_format_read_read_func,
-    inf_text_filesystem_format_read_close_func,
-    stream,
-    uri,
-    "UTF-8",
-    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
-  );
+static guint32
+inf_text_filesystem_format_binary_get_uint32(const gchar* data)
+{
+  guint32 value;
+  memcpy(&value, data, sizeof(value));
+  return GUINT32_FROM_LE(value);
+}
 
-  g_free(uri);
+static guint64
+inf_text_filesystem_format_binary_get_uint64(const gchar* data)
+{
+  guint64 value;
+  memcpy(&value, data, sizeof(value));
+  return GUINT64_FROM_LE(value);
+}
 
-  if(doc == NULL)
-  {
-    xmlerror = xmlGetLastError();
+static void
+inf_text_filesystem_format_binary_write(
+  InfTextFilesystemFormatBinaryWriter* writer,
+  gconstpointer data,
+  gsize len)
+{
+  gsize res;
 
-    g_set_error(
-      error,
-      g_quark_from_static_string("LIBXML2_PARSER_ERROR"),
-      xmlerror->code,
-      _("Error parsing XML in file \"%s\": [%d]: %s"),
-      path,
-      xmlerror->line,
-      xmlerror->message
-    );
+  /* Skip everything after the first error */
+  if(writer->save_errno != 0 || len == 0)
+    return;
 
-    result = FALSE;
-  }
-  else
+  res = infd_filesystem_storage_stream_write(writer->stream, data, len);
+  if(res < len)
   {
-    root = xmlDocGetRootElement(doc);
-    if(strcmp((const char*)root->name, "inf-text-session") != 0)
-    {
-      g_set_error(
-        error,
-        inf_text_filesystem_format_error_quark(),
-        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
-        _("Error processing file \"%s\": %s"),
-        path,
-        _("The document is not a text session")
-      );
+    writer->save_errno = errno != 0 ? errno : EIO;
+    return;
+  }
 
-      result = FALSE;
-    }
-    else
-    {
-      for(child = root->children; child != NULL; child = child->next)
-      {
-        if(child->type != XML_ELEMENT_NODE)
-          continue;
+  g_checksum_update(writer->checksum, data, len);
+  writer->offset += len;
+}
 
-        if(strcmp((const char*)child->name, "user") == 0)
-        {
-          if(!inf_text_filesystem_format_read_user(user_table, child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-        else if(strcmp((const char*)child->name, "buffer") == 0)
-        {
-          if(!inf_text_filesystem_format_read_buffer(buffer, user_table,
-                                                     child, error))
-          {
-            g_prefix_error(error, _("Error processing file \"%s\": "), path);
-            result = FALSE;
-            break;
-          }
-        }
-      }
+static void
+inf_text_filesystem_format_binary_write_uint32(
+  InfTextFilesystemFormatBinaryWriter* writer,
+  guint32 value)
+{
+  value = GUINT32_TO_LE(value);
+  inf_text_filesystem_format_binary_write(writer, &value, sizeof(value));
+}
 
-      if(child == NULL)
-        result = TRUE;
-    }
+static void
+inf_text_filesystem_format_binary_write_uint64(
+  InfTextFilesystemFormatBinaryWriter* writer,
+  guint64 value)
+{
+  value = GUINT64_TO_LE(value);
+  inf_text_filesystem_format_binary_write(writer, &value, sizeof(value));
+}
 
-    xmlFreeDoc(doc);
-  }
+static void
+inf_text_filesystem_format_binary_write_padding(
+  InfTextFilesystemFormatBinaryWriter* writer)
+{
+  static const gchar zeros[8] = { 0 };
 
-  return result;
+  inf_text_filesystem_format_binary_write(
+    writer,
+    zeros,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(writer->offset) - writer->offset
+  );
 }
 
-/**
- * inf_text_filesystem_format_write:
- * @storage: A #InfdFilesystemStorage.
- * @path: Storage path where to write the session to.
- * @user_table: The #InfUserTable to write.
- * @buffer: The #InfTextBuffer to write.
- * @error: Location to store error information, if any, or %NULL.
- *
- * Writes the given user table and buffer into the filesystem storage at
- * @path. If successful, the session can then be read back with
- * inf_text_filesystem_format_read(). If the function fails, %FALSE is
- * returned and @error is set.
- *
- * Returns: %TRUE on success or %FALSE on error.
- */
-gboolean
-inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
-                                 const gchar* path,
-                                 InfUserTable* user_table,
-                                 InfTextBuffer* buffer,
-                                 GError** error)
+static void
+inf_text_filesystem_format_collect_foreach_user_func(InfUser* user,
+                                                     gpointer user_data)
 {
-  InfTextBufferIter* iter;
-  xmlNodePtr buffer_node;
-  xmlNodePtr segment_node;
+  InfTextFilesystemFormatCollectData* data;
+  gpointer user_id;
+
+  data = (InfTextFilesystemFormatCollectData*)user_data;
+  user_id = GUINT_TO_POINTER(inf_user_get_id(user));
+
+  if(g_hash_table_lookup(data->encountered_authors, user_id) != NULL)
+    g_ptr_array_add(data->users, user);
+}
 
+static gboolean
+inf_text_filesystem_format_write_binary(InfdFilesystemStorage* storage,
+                                        const gchar* identifier,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        guint64 id,
+                                        gint64 journal_sequence,
+                                        gboolean sync,
+                                        GError** error)
+{
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  InfTextFilesystemFormatCollectData collect;
+  InfTextFilesystemFormatBinaryWriter writer;
+  InfTextFilesystemFormatBinarySegment entry;
+  GArray* segments;
   guint author;
-  gchar* content;
+  gboolean is_utf8;
+  gboolean result;
+
+  FILE* stream;
+  InfUser* user;
+  const gchar* name;
+  gsize name_len;
+  gdouble hue;
+  guint64 hue_bits;
+  guint64 users_size;
+  guint64 text_bytes;
+  guint i;
+
+  gconstpointer text;
   gsize bytes;
   gchar* converted;
   gsize converted_bytes;
+  guint8 digest[INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE];
+  gsize digest_len;
+
+  /* Taking a slice of the whole buffer is cheap for InfTextDefaultBuffer,
+   * and allows to access the text of each segment without copying it. */
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
 
-  FILE* stream;
-  xmlDocPtr doc;
-  xmlErrorPtr xmlerror;
-  gboolean is_utf8;
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_chunk_get_encoding(chunk), "UTF-8") != 0)
+    is_utf8 = FALSE;
 
-  InfTextFilesystemFormatWriteData data;
+  /* As for XML, only users that have contributed to the document are
+   * written. The user table comes first, so find the authors in a first
+   * pass over the segments. */
+  collect.encountered_authors = g_hash_table_new(NULL, NULL);
+  collect.users = g_ptr_array_new();
 
-  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
-  g_return_val_if_fail(path != NULL, FALSE);
-  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
-  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
-  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
 
-  is_utf8 = TRUE;
-  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
-    is_utf8 = FALSE;
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        collect.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_collect_foreach_user_func,
+    &collect
+  );
+
+  g_hash_table_destroy(collect.encountered_authors);
+
+  users_size = 0;
+  for(i = 0; i < collect.users->len; ++i)
+  {
+    user = INF_USER(g_ptr_array_index(collect.users, i));
+    users_size += INF_TEXT_FILESYSTEM_FORMAT_BINARY_USER_SIZE;
+    users_size +=
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(strlen(inf_user_get_name(user)));
+  }
 
-  /* Open stream before exporting buffer to XML so possible errors are
-   * catched earlier. */
   stream = infd_filesystem_storage_open(
     INFD_FILESYSTEM_STORAGE(storage),
-    "InfText",
+    identifier,
     path,
     "w",
     NULL,
@@ -488,114 +786,1594 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
   );
 
   if(stream == NULL)
+  {
+    g_ptr_array_free(collect.users, TRUE);
+    inf_text_chunk_free(chunk);
     return FALSE;
+  }
 
-  data.root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
-  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  writer.stream = stream;
+  writer.checksum = g_checksum_new(G_CHECKSUM_MD5);
+  writer.offset = 0;
+  writer.save_errno = 0;
 
-  buffer_node = xmlNewNode(NULL, (const xmlChar*)"buffer");
-  iter = inf_text_buffer_create_begin_iter(buffer);
-  if(iter != NULL)
+  inf_text_filesystem_format_binary_write(
+    &writer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE
+  );
+
+  inf_text_filesystem_format_binary_write_uint32(
+    &writer,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION
+  );
+
+  inf_text_filesystem_format_binary_write_uint32(&writer, collect.users->len);
+  inf_text_filesystem_format_binary_write_uint64(&writer, id);
+  inf_text_filesystem_format_binary_write_uint64(
+    &writer,
+    (guint64)journal_sequence
+  );
+  inf_text_filesystem_format_binary_write_uint64(&writer, users_size);
+
+  for(i = 0; i < collect.users->len; ++i)
   {
-    do
-    {
-      author = inf_text_buffer_iter_get_author(buffer, iter);
-      content = inf_text_buffer_iter_get_text(buffer, iter);
-      bytes = inf_text_buffer_iter_get_bytes(buffer, iter);
+    user = INF_USER(g_ptr_array_index(collect.users, i));
+    name = inf_user_get_name(user);
+    name_len = strlen(name);
 
-      /* TODO: Use g_hash_table_add with glib 2.32 */
-      g_hash_table_insert(
-        data.encountered_authors,
-        GUINT_TO_POINTER(author),
-        GUINT_TO_POINTER(author)
-      );
+    hue = inf_text_user_get_hue(INF_TEXT_USER(user));
+    memcpy(&hue_bits, &hue, sizeof(hue_bits));
 
-      segment_node = xmlNewChild(
-        buffer_node,
-        NULL,
-        (const xmlChar*)"segment",
-        NULL
-      );
+    inf_text_filesystem_format_binary_write_uint32(
+      &writer,
+      inf_user_get_id(user)
+    );
+
+    inf_text_filesystem_format_binary_write_uint32(&writer, name_len);
+    inf_text_filesystem_format_binary_write_uint64(&writer, hue_bits);
+    inf_text_filesystem_format_binary_write(&writer, name, name_len);
+    inf_text_filesystem_format_binary_write_padding(&writer);
+  }
 
-      inf_xml_util_set_attribute_uint(segment_node, "author", author);
+  g_ptr_array_free(collect.users, TRUE);
 
-      if(is_utf8)
-      {
-        /* Buffer is UTF-8, no conversion necessary */
-        inf_xml_util_add_child_text(segment_node, content, bytes);
-        g_free(content);
-      }
-      else
+  /* The segment table follows the text, so that the text can be written
+   * while iterating over the segments, converting it on the fly if
+   * necessary. */
+  segments = g_array_new(
+    FALSE,
+    FALSE,
+    sizeof(InfTextFilesystemFormatBinarySegment)
+  );
+
+  text_bytes = 0;
+  result = TRUE;
+
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      text = inf_text_chunk_iter_get_text(&iter);
+      bytes = inf_text_chunk_iter_get_bytes(&iter);
+      converted = NULL;
+
+      if(!is_utf8)
       {
         /* Convert from buffer encoding to UTF-8 for storage */
         converted = g_convert(
-          content,
+          text,
           bytes,
           "UTF-8",
-          inf_text_buffer_get_encoding(buffer),
+          inf_text_chunk_get_encoding(chunk),
           NULL,
           &converted_bytes,
           error
         );
 
-        g_free(content);
-
         if(converted == NULL)
         {
-          xmlFreeNode(buffer_node);
-          xmlFreeNode(data.root);
-          g_hash_table_destroy(data.encountered_authors);
-          infd_filesystem_storage_stream_close(stream);
-          return FALSE;
+          result = FALSE;
+          break;
         }
 
-        inf_xml_util_add_child_text(segment_node, converted, converted_bytes);
-        g_free(converted);
+        text = converted;
+        bytes = converted_bytes;
       }
-    } while(inf_text_buffer_iter_next(buffer, iter));
 
-    inf_text_buffer_destroy_iter(buffer, iter);
+      inf_text_filesystem_format_binary_write(&writer, text, bytes);
+      g_free(converted);
+
+      entry.author = GUINT32_TO_LE(inf_text_chunk_iter_get_author(&iter));
+      entry.chars = GUINT32_TO_LE(inf_text_chunk_iter_get_length(&iter));
+      entry.bytes = GUINT64_TO_LE(bytes);
+      g_array_append_val(segments, entry);
+
+      text_bytes += bytes;
+    } while(inf_text_chunk_iter_next(&iter));
   }
 
-  /* After we wrote the buffer, now write the user table, but only for those
-   * users that have contributed to the document. The others we drop, to
-   * avoid cluttering the user table too much. */
-  inf_user_table_foreach_user(
-    user_table,
-    inf_text_filesystem_format_write_foreach_user_func,
-    &data
+  inf_text_chunk_free(chunk);
+
+  if(result == TRUE)
+  {
+    inf_text_filesystem_format_binary_write_padding(&writer);
+
+    inf_text_filesystem_format_binary_write(
+      &writer,
+      segments->data,
+      segments->len * INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE
+    );
+
+    inf_text_filesystem_format_binary_write_uint64(&writer, text_bytes);
+    inf_text_filesystem_format_binary_write_uint32(&writer, segments->len);
+    inf_text_filesystem_format_binary_write_uint32(&writer, 0);
+
+    /* The digest itself is not part of the checksum */
+    digest_len = INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE;
+    g_checksum_get_digest(writer.checksum, digest, &digest_len);
+
+    if(writer.save_errno == 0)
+    {
+      bytes = infd_filesystem_storage_stream_write(
+        stream,
+        digest,
+        INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE
+      );
+
+      if(bytes < INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE)
+        writer.save_errno = errno != 0 ? errno : EIO;
+    }
+
+    if(writer.save_errno == 0 && sync)
+      if(infd_filesystem_storage_stream_sync(stream) != 0)
+        writer.save_errno = errno;
+
+    if(writer.save_errno != 0)
+    {
+      inf_text_filesystem_format_set_system_error(writer.save_errno, error);
+      result = FALSE;
+    }
+  }
+
+  g_array_free(segments, TRUE);
+  g_checksum_free(writer.checksum);
+
+  if(infd_filesystem_storage_stream_close(stream) != 0 && result == TRUE)
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    result = FALSE;
+  }
+
+  return result;
+}
+
+static void
+inf_text_filesystem_format_set_binary_error(const gchar* message,
+                                            GError** error)
+{
+  g_set_error_literal(
+    error,
+    inf_text_filesystem_format_error_quark(),
+    INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_BINARY,
+    message
   );
+}
 
-  g_hash_table_destroy(data.encountered_authors);
+/* Reads the users of a binary file into users, but does not add them to
+ * user_table yet, so that nothing is modified if the file turns out to be
+ * invalid later. */
+static gboolean
+inf_text_filesystem_format_read_binary_users(const gchar* data,
+                                             guint64 size,
+                                             guint n_users,
+                                             InfUserTable* user_table,
+                                             GPtrArray* users,
+                                             GHashTable* ids,
+                                             GError** error)
+{
+  GHashTable* names;
+  InfUser* user;
+  const gchar* end;
+  guint32 id;
+  guint32 name_len;
+  guint64 hue_bits;
+  gdouble hue;
+  gchar* name;
+  gboolean result;
+  guint i;
 
-  /* Write the buffer after the users */
-  xmlAddChild(data.root, buffer_node);
+  names = g_hash_table_new(g_str_hash, g_str_equal);
+  end = data + size;
+  result = TRUE;
+
+  for(i = 0; i < n_users && result == TRUE; ++i)
+  {
+    if((guint64)(end - data) < INF_TEXT_FILESYSTEM_FORMAT_BINARY_USER_SIZE)
+    {
+      inf_text_filesystem_format_set_binary_error(
+        _("The binary file is corrupted"),
+        error
+      );
+
+      result = FALSE;
+      break;
+    }
+
+    id = inf_text_filesystem_format_binary_get_uint32(data);
+    name_len = inf_text_filesystem_format_binary_get_uint32(data + 4);
+    hue_bits = inf_text_filesystem_format_binary_get_uint64(data + 8);
+    data += INF_TEXT_FILESYSTEM_FORMAT_BINARY_USER_SIZE;
+
+    if(id == 0 ||
+       INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(name_len) >
+         (guint64)(end - data) ||
+       !g_utf8_validate(data, name_len, NULL))
+    {
+      inf_text_filesystem_format_set_binary_error(
+        _("The binary file is corrupted"),
+        error
+      );
+
+      result = FALSE;
+      break;
+    }
+
+    name = g_strndup(data, name_len);
+    data += INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(name_len);
+
+    if(inf_user_table_lookup_user_by_id(user_table, id) != NULL ||
+       g_hash_table_lookup(ids, GUINT_TO_POINTER(id)) != NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+        _("User with ID %u exists already"),
+        id
+      );
+
+      result = FALSE;
+    }
+    else if(inf_user_table_lookup_user_by_name(user_table, name) != NULL ||
+            g_hash_table_lookup(names, name) != NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
+        _("User with name \"%s\" exists already"),
+        name
+      );
+
+      result = FALSE;
+    }
+    else
+    {
+      memcpy(&hue, &hue_bits, sizeof(hue));
+
+      user = INF_USER(
+        g_object_new(
+          INF_TEXT_TYPE_USER,
+          "id", id,
+          "name", name,
+          "hue", hue,
+          NULL
+        )
+      );
+
+      g_ptr_array_add(users, user);
+      g_hash_table_insert(ids, GUINT_TO_POINTER(id), user);
+      g_hash_table_insert(names, (gpointer)inf_user_get_name(user), user);
+    }
 
-  doc = xmlNewDoc((const xmlChar*)"1.0");
-  xmlDocSetRootElement(doc, data.root);
+    g_free(name);
+  }
 
-  /* TODO: At this point, we should tell libxml2 to use
-   * infd_filesystem_storage_stream_write() instead of fwrite(),
-   * to prevent C runtime mixups. */
-  if(xmlDocFormatDump(stream, doc, 1) == -1)
+  if(result == TRUE && data != end)
   {
-    xmlerror = xmlGetLastError();
-    infd_filesystem_storage_stream_close(stream);
-    xmlFreeDoc(doc);
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file is corrupted"),
+      error
+    );
 
-    g_set_error_literal(
-      error,
-      g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
-      xmlerror->code,
-      xmlerror->message
+    result = FALSE;
+  }
+
+  g_hash_table_destroy(names);
+  return result;
+}
+
+/* Reads the segment table of a binary file into segments, and verifies it
+ * against the text. */
+static gboolean
+inf_text_filesystem_format_read_binary_segments(const gchar* text,
+                                                guint64 text_bytes,
+                                                const gchar* table,
+                                                guint n_segments,
+                                                GHashTable* ids,
+                                                InfTextChunkSegmentInfo* infos,
+                                                GError** error)
+{
+  guint64 offset;
+  guint32 author;
+  guint32 chars;
+  guint64 bytes;
+  guint i;
+
+  offset = 0;
+  for(i = 0; i < n_segments; ++i)
+  {
+    author = inf_text_filesystem_format_binary_get_uint32(table);
+    chars = inf_text_filesystem_format_binary_get_uint32(table + 4);
+    bytes = inf_text_filesystem_format_binary_get_uint64(table + 8);
+    table += INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE;
+
+    /* The text as a whole is valid UTF-8 already. Make sure that each
+     * segment consists of whole characters, and that its character count
+     * is right, since the chunk relies on it. */
+    if(chars == 0 || bytes < chars || bytes > text_bytes - offset ||
+       (text[offset] & 0xc0) == 0x80 ||
+       (guint64)g_utf8_strlen(text + offset, bytes) != chars)
+    {
+      inf_text_filesystem_format_set_binary_error(
+        _("The binary file is corrupted"),
+        error
+      );
+
+      return FALSE;
+    }
+
+    if(author != 0 && g_hash_table_lookup(ids, GUINT_TO_POINTER(author)) == NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+        _("User with ID \"%u\" does not exist"),
+        author
+      );
+
+      return FALSE;
+    }
+
+    infos[i].author = author;
+    infos[i].bytes = bytes;
+    infos[i].chars = chars;
+    offset += bytes;
+  }
+
+  if(offset != text_bytes)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file is corrupted"),
+      error
     );
 
     return FALSE;
   }
 
-  infd_filesystem_storage_stream_close(stream);
-  xmlFreeDoc(doc);
   return TRUE;
 }
 
+/* Reads a binary file from memory. If id is non-zero, the file must have
+ * been written with that ID. Neither user_table nor buffer are modified if
+ * the function fails. */
+static gboolean
+inf_text_filesystem_format_read_binary_data(const gchar* data,
+                                            gsize length,
+                                            InfUserTable* user_table,
+                                            InfTextBuffer* buffer,
+                                            guint64 id,
+                                            gint64* journal_sequence,
+                                            GError** error)
+{
+  GChecksum* checksum;
+  guint8 digest[INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE];
+  gsize digest_len;
+  const gchar* trailer;
+  const gchar* text;
+  const gchar* table;
+  guint32 n_users;
+  gint64 sequence;
+  guint64 users_size;
+  guint64 text_bytes;
+  guint32 n_segments;
+
+  GPtrArray* users;
+  GHashTable* ids;
+  InfTextChunkSegmentInfo* infos;
+  const gchar* encoding;
+  GString* converted;
+  gchar* segment_text;
+  gsize segment_bytes;
+  InfTextChunk* chunk;
+  gboolean result;
+  guint64 offset;
+  guint i;
+
+  if(length < INF_TEXT_FILESYSTEM_FORMAT_BINARY_HEADER_SIZE +
+              INF_TEXT_FILESYSTEM_FORMAT_BINARY_TRAILER_SIZE ||
+     memcmp(data,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE) != 0)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file is corrupted"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  if(inf_text_filesystem_format_binary_get_uint32(data + 8) !=
+     INF_TEXT_FILESYSTEM_FORMAT_BINARY_VERSION)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file has an unsupported version"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  if(id != 0 && inf_text_filesystem_format_binary_get_uint64(data + 16) != id)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file does not belong to the XML file"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  checksum = g_checksum_new(G_CHECKSUM_MD5);
+  g_checksum_update(
+    checksum,
+    (const guchar*)data,
+    length - INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE
+  );
+
+  digest_len = INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE;
+  g_checksum_get_digest(checksum, digest, &digest_len);
+  g_checksum_free(checksum);
+
+  if(memcmp(digest,
+            data + length - INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_DIGEST_SIZE) != 0)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The checksum of the binary file does not match"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  n_users = inf_text_filesystem_format_binary_get_uint32(data + 12);
+  sequence = (gint64)inf_text_filesystem_format_binary_get_uint64(data + 24);
+  users_size = inf_text_filesystem_format_binary_get_uint64(data + 32);
+
+  trailer = data + length - INF_TEXT_FILESYSTEM_FORMAT_BINARY_TRAILER_SIZE;
+  text_bytes = inf_text_filesystem_format_binary_get_uint64(trailer);
+  n_segments = inf_text_filesystem_format_binary_get_uint32(trailer + 8);
+
+  /* Each section must be smaller than the file, which also makes sure that
+   * the sum of their sizes does not overflow. */
+  if(sequence < -1 || users_size > length || text_bytes > length ||
+     n_segments > length / INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE ||
+     INF_TEXT_FILESYSTEM_FORMAT_BINARY_HEADER_SIZE + users_size +
+       INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(text_bytes) +
+       (guint64)n_segments * INF_TEXT_FILESYSTEM_FORMAT_BINARY_SEGMENT_SIZE +
+       INF_TEXT_FILESYSTEM_FORMAT_BINARY_TRAILER_SIZE != length)
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file is corrupted"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  text = data + INF_TEXT_FILESYSTEM_FORMAT_BINARY_HEADER_SIZE + users_size;
+  table = text + INF_TEXT_FILESYSTEM_FORMAT_BINARY_PAD(text_bytes);
+
+  /* Validating all text at once is much faster than validating it segment
+   * by segment. This also rejects null characters. */
+  if(!g_utf8_validate(text, text_bytes, NULL))
+  {
+    inf_text_filesystem_format_set_binary_error(
+      _("The binary file is corrupted"),
+      error
+    );
+
+    return FALSE;
+  }
+
+  users = g_ptr_array_new_with_free_func(g_object_unref);
+  ids = g_hash_table_new(NULL, NULL);
+  infos = g_new(InfTextChunkSegmentInfo, n_segments);
+
+  result = inf_text_filesystem_format_read_binary_users(
+    data + INF_TEXT_FILESYSTEM_FORMAT_BINARY_HEADER_SIZE,
+    users_size,
+    n_users,
+    user_table,
+    users,
+    ids,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    result = inf_text_filesystem_format_read_binary_segments(
+      text,
+      text_bytes,
+      table,
+      n_segments,
+      ids,
+      infos,
+      error
+    );
+  }
+
+  encoding = inf_text_buffer_get_encoding(buffer);
+  converted = NULL;
+
+  if(result == TRUE && strcmp(encoding, "UTF-8") != 0)
+  {
+    /* Convert from UTF-8 to buffer encoding */
+    converted = g_string_sized_new(text_bytes);
+    offset = 0;
+
+    for(i = 0; i < n_segments && result == TRUE; ++i)
+    {
+      segment_text = g_convert(
+        text + offset,
+        infos[i].bytes,
+        encoding,
+        "UTF-8",
+        NULL,
+        &segment_bytes,
+        error
+      );
+
+      if(segment_text == NULL)
+      {
+        result = FALSE;
+      }
+      else
+      {
+        offset += infos[i].bytes;
+        infos[i].bytes = segment_bytes;
+
+        g_string_append_len(converted, segment_text, segment_bytes);
+        g_free(segment_text);
+      }
+    }
+
+    text = converted->str;
+  }
+
+  if(result == TRUE)
+  {
+    for(i = 0; i < users->len; ++i)
+    {
+      inf_user_table_add_user(
+        user_table,
+        INF_USER(g_ptr_array_index(users, i))
+      );
+    }
+
+    if(n_segments > 0)
+    {
+      chunk = _inf_text_chunk_new_from_segments(
+        encoding,
+        text,
+        infos,
+        n_segments
+      );
+
+      inf_text_buffer_append(buffer, chunk, NULL);
+      inf_text_chunk_free(chunk);
+    }
+
+    if(journal_sequence != NULL)
+      *journal_sequence = sequence;
+  }
+
+  if(converted != NULL)
+    g_string_free(converted, TRUE);
+
+  g_free(infos);
+  g_hash_table_destroy(ids);
+  g_ptr_array_free(users, TRUE);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_format_read_binary(InfdFilesystemStorage* storage,
+                                       const gchar* identifier,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       guint64 id,
+                                       gint64* journal_sequence,
+                                       GError** error)
+{
+  GMappedFile* mapped;
+  gboolean result;
+
+  mapped = infd_filesystem_storage_map(storage, identifier, path, error);
+  if(mapped == NULL)
+    return FALSE;
+
+  result = inf_text_filesystem_format_read_binary_data(
+    g_mapped_file_get_contents(mapped),
+    g_mapped_file_get_length(mapped),
+    user_table,
+    buffer,
+    id,
+    journal_sequence,
+    error
+  );
+
+  g_mapped_file_unref(mapped);
+
+  if(result == FALSE)
+    g_prefix_error(error, _("Error processing file \"%s\": "), path);
+
+  return result;
+}
+
+gboolean
+_inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                 const gchar* identifier,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 gint64* journal_sequence,
+                                 GError** error)
+{
+  FILE* stream;
+  gchar* full_path;
+  gchar* uri;
+  InfTextFilesystemFormatReadData* data;
+
+  xmlTextReaderPtr reader;
+  xmlNodePtr node;
+  const xmlChar* name;
+  xmlChar* sequence;
+  xmlChar* binary_id;
+  gchar* endptr;
+  gchar* binary_identifier;
+  guint64 id;
+  GError* local_error;
+  InfTextChunk* chunk;
+  gboolean is_utf8;
+  gboolean in_binary;
+  gboolean in_buffer;
+  gboolean skip;
+  gboolean result;
+  int depth;
+  int ret;
+
+  full_path = NULL;
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    identifier,
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  if(stream == NULL)
+  {
+    g_free(full_path);
+    return FALSE;
+  }
+
+  data = g_slice_new(InfTextFilesystemFormatReadData);
+  data->stream = stream;
+  data->header_pos = 0;
+  data->header_len = infd_filesystem_storage_stream_read(
+    stream,
+    data->header,
+    INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE
+  );
+
+  if(data->header_len == INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE &&
+     memcmp(data->header,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC,
+            INF_TEXT_FILESYSTEM_FORMAT_BINARY_MAGIC_SIZE) == 0)
+  {
+    /* The file has been written in the binary format */
+    g_free(full_path);
+    inf_text_filesystem_format_read_close_func(data);
+
+    return inf_text_filesystem_format_read_binary(
+      storage,
+      identifier,
+      path,
+      user_table,
+      buffer,
+      0,
+      journal_sequence,
+      error
+    );
+  }
+
+  uri = g_filename_to_uri(full_path, NULL, error);
+  g_free(full_path);
+
+  if(uri == NULL)
+  {
+    inf_text_filesystem_format_read_close_func(data);
+    return FALSE;
+  }
+
+  /* The file is parsed as a stream, so that only the element currently
+   * being processed needs to be kept in memory instead of the whole
+   * document. The segments are collected in a chunk which is appended to
+   * the buffer at the end, so the buffer is modified only once. */
+  xmlResetLastError();
+  reader = xmlReaderForIO(
+    inf_text_filesystem_format_read_read_func,
+    inf_text_filesystem_format_read_close_func,
+    data,
+    uri,
+    "UTF-8",
+    XML_PARSE_NOWARNING | XML_PARSE_NOERROR
+  );
+
+  g_free(uri);
+
+  if(reader == NULL)
+  {
+    /* xmlReaderForIO() closes the stream, and frees data, on failure */
+    inf_text_filesystem_format_set_parser_error(error, path);
+    return FALSE;
+  }
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  chunk = inf_text_chunk_new(inf_text_buffer_get_encoding(buffer));
+  if(journal_sequence != NULL) *journal_sequence = -1;
+  in_binary = FALSE;
+  in_buffer = FALSE;
+  skip = FALSE;
+  result = TRUE;
+
+  /* Find the root element */
+  do
+  {
+    ret = xmlTextReaderRead(reader);
+  } while(ret == 1 && xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT);
+
+  if(ret == 1)
+  {
+    name = xmlTextReaderConstName(reader);
+    if(strcmp((const char*)name, "inf-text-session") != 0)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_format_error_quark(),
+        INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+        _("Error processing file \"%s\": %s"),
+        path,
+        _("The document is not a text session")
+      );
+
+      result = FALSE;
+    }
+    else if(journal_sequence != NULL)
+    {
+      sequence = xmlTextReaderGetAttribute(
+        reader,
+        (const xmlChar*)"journal-sequence"
+      );
+
+      if(sequence != NULL)
+      {
+        *journal_sequence =
+          g_ascii_strtoll((const gchar*)sequence, &endptr, 10);
+
+        if(*endptr != '\0' || *journal_sequence < 0)
+        {
+          g_set_error(
+            error,
+            inf_text_filesystem_format_error_quark(),
+            INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
+            _("Error processing file \"%s\": %s"),
+            path,
+            _("The journal sequence number is invalid")
+          );
+
+          result = FALSE;
+        }
+
+        xmlFree(sequence);
+      }
+    }
+
+    /* If the document has been written together with a binary file, read
+     * the binary file instead of the rest of the XML, as long as it
+     * belongs to this XML file. If it does not, for example because the
+     * binary file could not be written completely, or because the XML file
+     * was modified by hand, fall back to XML. */
+    binary_id = NULL;
+    if(result == TRUE)
+    {
+      binary_id = xmlTextReaderGetAttribute(
+        reader,
+        (const xmlChar*)"binary-id"
+      );
+    }
+
+    if(binary_id != NULL)
+    {
+      id = g_ascii_strtoull((const gchar*)binary_id, &endptr, 16);
+      if(*endptr == '\0' && id != 0)
+      {
+        binary_identifier = g_strconcat(identifier, ".bin", NULL);
+        local_error = NULL;
+
+        in_binary = inf_text_filesystem_format_read_binary(
+          storage,
+          binary_identifier,
+          path,
+          user_table,
+          buffer,
+          id,
+          NULL,
+          &local_error
+        );
+
+        if(local_error != NULL)
+          g_error_free(local_error);
+        g_free(binary_identifier);
+      }
+
+      xmlFree(binary_id);
+    }
+  }
+
+  while(ret == 1 && result == TRUE && !in_binary)
+  {
+    /* After an element has been processed as a whole, continue with its
+     * next sibling instead of descending into it. */
+    if(skip)
+      ret = xmlTextReaderNext(reader);
+    else
+      ret = xmlTextReaderRead(reader);
+
+    skip = FALSE;
+    if(ret != 1)
+      break;
+
+    depth = xmlTextReaderDepth(reader);
+    switch(xmlTextReaderNodeType(reader))
+    {
+    case XML_READER_TYPE_ELEMENT:
+      name = xmlTextReaderConstName(reader);
+
+      if(depth == 1 && strcmp((const char*)name, "user") == 0)
+      {
+        node = xmlTextReaderExpand(reader);
+        if(node == NULL)
+        {
+          ret = -1;
+          break;
+        }
+
+        if(!inf_text_filesystem_format_read_user(user_table, node, error))
+          result = FALSE;
+
+        skip = TRUE;
+      }
+      else if(depth == 1 && strcmp((const char*)name, "buffer") == 0)
+      {
+        if(!xmlTextReaderIsEmptyElement(reader))
+          in_buffer = TRUE;
+      }
+      else if(depth == 2 && in_buffer &&
+              strcmp((const char*)name, "segment") == 0)
+      {
+        node = xmlTextReaderExpand(reader);
+        if(node == NULL)
+        {
+          ret = -1;
+          break;
+        }
+
+        result = inf_text_filesystem_format_read_segment(
+          chunk,
+          user_table,
+          is_utf8,
+          node,
+          error
+        );
+
+        skip = TRUE;
+      }
+      else if(depth > 0)
+      {
+        /* Ignore unknown elements */
+        skip = TRUE;
+      }
+
+      break;
+    case XML_READER_TYPE_END_ELEMENT:
+      if(depth == 1)
+        in_buffer = FALSE;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if(result == FALSE)
+  {
+    g_prefix_error(error, _("Error processing file \"%s\": "), path);
+  }
+  else if(ret == -1)
+  {
+    inf_text_filesystem_format_set_parser_error(error, path);
+    result = FALSE;
+  }
+  else if(!in_binary && inf_text_chunk_get_length(chunk) > 0)
+  {
+    inf_text_buffer_append(buffer, chunk, NULL);
+  }
+
+  inf_text_chunk_free(chunk);
+  xmlFreeTextReader(reader);
+  return result;
+}
+
+/**
+ * inf_text_filesystem_format_read:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path to retrieve the session from.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer to use as the new session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads a text session from @path in @storage. The file is expected to have
+ * been saved with inf_text_filesystem_format_write() before. The @user_table
+ * parameter should be an empty user table that will be used for the session,
+ * and the @buffer parameter should be an empty #InfTextBuffer, and the
+ * document will be written into this buffer. If the function succeeds, the
+ * user table and buffer can be used to create an #InfTextSession with
+ * inf_text_session_new_with_user_table(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * Files written with inf_text_filesystem_format_write_with_type() can be
+ * read as well, whatever #InfTextFilesystemFormatType they were written
+ * with.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  _inf_text_filesystem_format_flush_writes();
+
+  return _inf_text_filesystem_format_read(
+    storage,
+    "InfText",
+    path,
+    user_table,
+    buffer,
+    NULL,
+    error
+  );
+}
+
+static gboolean
+inf_text_filesystem_format_write_xml(InfdFilesystemStorage* storage,
+                                     const gchar* identifier,
+                                     const gchar* path,
+                                     InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     guint64 binary_id,
+                                     gint64 journal_sequence,
+                                     gboolean sync,
+                                     GError** error)
+{
+  InfTextBufferIter* iter;
+  guint author;
+
+  FILE* stream;
+  xmlOutputBufferPtr output;
+  xmlTextWriterPtr writer;
+  gboolean is_utf8;
+  int result;
+
+  InfTextFilesystemFormatWriteData data;
+
+  is_utf8 = TRUE;
+  if(strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") != 0)
+    is_utf8 = FALSE;
+
+  stream = infd_filesystem_storage_open(
+    INFD_FILESYSTEM_STORAGE(storage),
+    identifier,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  /* The document is streamed to the file segment by segment instead of
+   * building the full XML tree first, so that the memory needed to save a
+   * document does not grow with the number of segments. The output is
+   * passed through infd_filesystem_storage_stream_write() to avoid mixing
+   * C runtimes. */
+  output = xmlOutputBufferCreateIO(
+    inf_text_filesystem_format_write_write_func,
+    inf_text_filesystem_format_write_close_func,
+    stream,
+    NULL
+  );
+
+  if(output == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    inf_text_filesystem_format_set_xml_error(error);
+    return FALSE;
+  }
+
+  /* From here on, the stream is closed when the writer is freed */
+  writer = xmlNewTextWriter(output);
+  if(writer == NULL)
+  {
+    xmlOutputBufferClose(output);
+    inf_text_filesystem_format_set_xml_error(error);
+    return FALSE;
+  }
+
+  /* Only users that have contributed to the document are written into the
+   * user table, to avoid cluttering it too much. Since the user table comes
+   * before the buffer in the file, find the authors in a first pass over
+   * the segments, which does not need to copy any text. */
+  data.writer = writer;
+  data.encountered_authors = g_hash_table_new(NULL, NULL);
+  data.result = 0;
+
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  if(iter != NULL)
+  {
+    do
+    {
+      author = inf_text_buffer_iter_get_author(buffer, iter);
+
+      /* TODO: Use g_hash_table_add with glib 2.32 */
+      g_hash_table_insert(
+        data.encountered_authors,
+        GUINT_TO_POINTER(author),
+        GUINT_TO_POINTER(author)
+      );
+    } while(inf_text_buffer_iter_next(buffer, iter));
+
+    inf_text_buffer_destroy_iter(buffer, iter);
+  }
+
+  result = xmlTextWriterStartDocument(writer, NULL, "UTF-8", NULL);
+  if(result >= 0)
+  {
+    result = xmlTextWriterStartElement(
+      writer,
+      (const xmlChar*)"inf-text-session"
+    );
+  }
+
+  if(result >= 0 && journal_sequence >= 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"journal-sequence",
+      "%" G_GINT64_FORMAT,
+      journal_sequence
+    );
+  }
+
+  if(result >= 0 && binary_id != 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"binary-id",
+      "%016" G_GINT64_MODIFIER "x",
+      binary_id
+    );
+  }
+
+  if(result >= 0)
+  {
+    inf_user_table_foreach_user(
+      user_table,
+      inf_text_filesystem_format_write_foreach_user_func,
+      &data
+    );
+
+    result = data.result;
+  }
+
+  g_hash_table_destroy(data.encountered_authors);
+
+  /* Write the buffer after the users */
+  if(result >= 0)
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n  ");
+  if(result >= 0)
+    result = xmlTextWriterStartElement(writer, (const xmlChar*)"buffer");
+
+  if(result >= 0)
+  {
+    iter = inf_text_buffer_create_begin_iter(buffer);
+    if(iter != NULL)
+    {
+      do
+      {
+        result = inf_text_filesystem_format_write_segment(
+          writer,
+          buffer,
+          iter,
+          is_utf8,
+          error
+        );
+      } while(result > 0 && inf_text_buffer_iter_next(buffer, iter));
+
+      inf_text_buffer_destroy_iter(buffer, iter);
+
+      /* Conversion into UTF-8 failed, error is set already */
+      if(result == 0)
+      {
+        xmlFreeTextWriter(writer);
+        return FALSE;
+      }
+    }
+  }
+
+  if(result >= 0)
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n  ");
+  if(result >= 0)
+    result = xmlTextWriterEndElement(writer);
+  if(result >= 0)
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n");
+  if(result >= 0)
+    result = xmlTextWriterEndDocument(writer);
+  if(result >= 0)
+    result = xmlTextWriterFlush(writer);
+
+  if(result < 0)
+  {
+    inf_text_filesystem_format_set_xml_error(error);
+    xmlFreeTextWriter(writer);
+    return FALSE;
+  }
+
+  if(sync && infd_filesystem_storage_stream_sync(stream) != 0)
+  {
+    inf_text_filesystem_format_set_system_error(errno, error);
+    xmlFreeTextWriter(writer);
+    return FALSE;
+  }
+
+  xmlFreeTextWriter(writer);
+  return TRUE;
+}
+
+gboolean
+_inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                  const gchar* identifier,
+                                  const gchar* path,
+                                  InfUserTable* user_table,
+                                  InfTextBuffer* buffer,
+                                  InfTextFilesystemFormatType type,
+                                  gint64 journal_sequence,
+                                  gboolean sync,
+                                  GError** error)
+{
+  gchar* binary_identifier;
+  guint64 id;
+  gboolean result;
+
+  switch(type)
+  {
+  case INF_TEXT_FILESYSTEM_FORMAT_XML:
+    return inf_text_filesystem_format_write_xml(
+      storage,
+      identifier,
+      path,
+      user_table,
+      buffer,
+      0,
+      journal_sequence,
+      sync,
+      error
+    );
+  case INF_TEXT_FILESYSTEM_FORMAT_BINARY:
+    return inf_text_filesystem_format_write_binary(
+      storage,
+      identifier,
+      path,
+      user_table,
+      buffer,
+      0,
+      journal_sequence,
+      sync,
+      error
+    );
+  case INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY:
+    /* A new ID links the two files. The binary file is written first, so
+     * that if writing the XML file fails, the old XML file still refers to
+     * a different ID, and the new binary file is ignored. */
+    do
+    {
+      id = ((guint64)g_random_int() << 32) | g_random_int();
+    } while(id == 0);
+
+    binary_identifier = g_strconcat(identifier, ".bin", NULL);
+
+    result = inf_text_filesystem_format_write_binary(
+      storage,
+      binary_identifier,
+      path,
+      user_table,
+      buffer,
+      id,
+      journal_sequence,
+      sync,
+      error
+    );
+
+    g_free(binary_identifier);
+
+    if(result == TRUE)
+    {
+      result = inf_text_filesystem_format_write_xml(
+        storage,
+        identifier,
+        path,
+        user_table,
+        buffer,
+        id,
+        journal_sequence,
+        sync,
+        error
+      );
+    }
+
+    return result;
+  default:
+    g_assert_not_reached();
+    return FALSE;
+  }
+}
+
+static void
+inf_text_filesystem_format_snapshot_foreach_user_func(InfUser* user,
+                                                      gpointer user_data)
+{
+  InfUserTable* user_table;
+  InfUser* copy;
+
+  user_table = (InfUserTable*)user_data;
+
+  copy = INF_USER(
+    g_object_new(
+      INF_TEXT_TYPE_USER,
+      "id", inf_user_get_id(user),
+      "name", inf_user_get_name(user),
+      "hue", inf_text_user_get_hue(INF_TEXT_USER(user)),
+      NULL
+    )
+  );
+
+  inf_user_table_add_user(user_table, copy);
+  g_object_unref(copy);
+}
+
+void
+_inf_text_filesystem_format_snapshot(InfUserTable* user_table,
+                                     InfTextBuffer* buffer,
+                                     InfUserTable** user_table_copy,
+                                     InfTextBuffer** buffer_copy)
+{
+  InfTextChunk* chunk;
+
+  *user_table_copy = inf_user_table_new();
+
+  inf_user_table_foreach_user(
+    user_table,
+    inf_text_filesystem_format_snapshot_foreach_user_func,
+    *user_table_copy
+  );
+
+  *buffer_copy = INF_TEXT_BUFFER(
+    inf_text_default_buffer_new(inf_text_buffer_get_encoding(buffer))
+  );
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  /* This shares the text with buffer. That is safe even though buffer keeps
+   * being modified, since chunks copy shared text before modifying it. */
+  inf_text_buffer_append(*buffer_copy, chunk, NULL);
+  inf_text_chunk_free(chunk);
+}
+
+void
+_inf_text_filesystem_format_flush_writes(void)
+{
+  guint64 serial;
+
+  g_mutex_lock(&inf_text_filesystem_format_writes_mutex);
+
+  serial = inf_text_filesystem_format_writes_queued;
+  while(inf_text_filesystem_format_writes_done < serial)
+  {
+    g_cond_wait(
+      &inf_text_filesystem_format_writes_cond,
+      &inf_text_filesystem_format_writes_mutex
+    );
+  }
+
+  g_mutex_unlock(&inf_text_filesystem_format_writes_mutex);
+}
+
+static void
+inf_text_filesystem_format_async_write_free(
+  InfTextFilesystemFormatAsyncWrite* write)
+{
+  g_object_unref(write->storage);
+  g_free(write->path);
+  g_object_unref(write->user_table);
+  g_object_unref(write->buffer);
+  g_object_unref(write->io);
+  if(write->error != NULL)
+    g_error_free(write->error);
+
+  g_slice_free(InfTextFilesystemFormatAsyncWrite, write);
+}
+
+static void
+inf_text_filesystem_format_async_write_dispatch_func(gpointer user_data)
+{
+  InfTextFilesystemFormatAsyncWrite* write;
+  write = (InfTextFilesystemFormatAsyncWrite*)user_data;
+
+  g_thread_join(write->thread);
+  write->thread = NULL;
+
+  if(write->func != NULL)
+    write->func(write->error, write->user_data);
+
+  inf_text_filesystem_format_async_write_free(write);
+}
+
+static gpointer
+inf_text_filesystem_format_async_write_thread_func(gpointer data)
+{
+  InfTextFilesystemFormatAsyncWrite* write;
+  write = (InfTextFilesystemFormatAsyncWrite*)data;
+
+  g_mutex_lock(&inf_text_filesystem_format_writes_mutex);
+  while(inf_text_filesystem_format_writes_done + 1 < write->serial)
+  {
+    g_cond_wait(
+      &inf_text_filesystem_format_writes_cond,
+      &inf_text_filesystem_format_writes_mutex
+    );
+  }
+  g_mutex_unlock(&inf_text_filesystem_format_writes_mutex);
+
+  _inf_text_filesystem_format_write(
+    write->storage,
+    "InfText",
+    write->path,
+    write->user_table,
+    write->buffer,
+    write->type,
+    -1,
+    FALSE,
+    &write->error
+  );
+
+  g_mutex_lock(&inf_text_filesystem_format_writes_mutex);
+  inf_text_filesystem_format_writes_done = write->serial;
+  g_cond_broadcast(&inf_text_filesystem_format_writes_cond);
+  g_mutex_unlock(&inf_text_filesystem_format_writes_mutex);
+
+  /* Report the result in the thread of the caller */
+  inf_io_add_dispatch(
+    write->io,
+    inf_text_filesystem_format_async_write_dispatch_func,
+    write,
+    NULL
+  );
+
+  return NULL;
+}
+
+/**
+ * inf_text_filesystem_format_write:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path. If successful, the session can then be read back with
+ * inf_text_filesystem_format_read(). If the function fails, %FALSE is
+ * returned and @error is set.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  _inf_text_filesystem_format_flush_writes();
+
+  return _inf_text_filesystem_format_write(
+    storage,
+    "InfText",
+    path,
+    user_table,
+    buffer,
+    INF_TEXT_FILESYSTEM_FORMAT_XML,
+    -1,
+    FALSE,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_format_write_with_type:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @type: The format in which to write the session.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path, like inf_text_filesystem_format_write(), but allows to choose the
+ * format in which the session is stored. With
+ * %INF_TEXT_FILESYSTEM_FORMAT_XML, this is the same as
+ * inf_text_filesystem_format_write(). Sessions in all formats can be read
+ * back with inf_text_filesystem_format_read().
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_format_write_with_type(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           InfUserTable* user_table,
+                                           InfTextBuffer* buffer,
+                                           InfTextFilesystemFormatType type,
+                                           GError** error)
+{
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  _inf_text_filesystem_format_flush_writes();
+
+  return _inf_text_filesystem_format_write(
+    storage,
+    "InfText",
+    path,
+    user_table,
+    buffer,
+    type,
+    -1,
+    FALSE,
+    error
+  );
+}
+
+/**
+ * inf_text_filesystem_format_write_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to write the session to.
+ * @user_table: The #InfUserTable to write.
+ * @buffer: The #InfTextBuffer to write.
+ * @type: The format in which to write the session.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @func: Function to call when the session has been written, or %NULL.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Writes the given user table and buffer into the filesystem storage at
+ * @path, like inf_text_filesystem_format_write_with_type(), but does not
+ * block. The content of @user_table and @buffer is copied before the
+ * function returns, so that they can be modified while the document is
+ * being written in a separate thread. When writing has finished, @func is
+ * called via @io with the result.
+ *
+ * Multiple writes are carried out in the order in which this function
+ * was called, and the synchronous functions of this module wait for all
+ * pending asynchronous writes before they access the storage.
+ */
+void
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextFilesystemFormatType type,
+                                       InfIo* io,
+                                       InfTextFilesystemFormatWriteFunc func,
+                                       gpointer user_data)
+{
+  InfTextFilesystemFormatAsyncWrite* write;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+  g_return_if_fail(INF_IS_USER_TABLE(user_table));
+  g_return_if_fail(INF_TEXT_IS_BUFFER(buffer));
+  g_return_if_fail(INF_IS_IO(io));
+
+  write = g_slice_new(InfTextFilesystemFormatAsyncWrite);
+  write->storage = storage;
+  write->path = g_strdup(path);
+  write->type = type;
+  write->io = io;
+  write->func = func;
+  write->user_data = user_data;
+  write->error = NULL;
+
+  g_object_ref(storage);
+  g_object_ref(io);
+
+  _inf_text_filesystem_format_snapshot(
+    user_table,
+    buffer,
+    &write->user_table,
+    &write->buffer
+  );
+
+  g_mutex_lock(&inf_text_filesystem_format_writes_mutex);
+  write->serial = ++inf_text_filesystem_format_writes_queued;
+  g_mutex_unlock(&inf_text_filesystem_format_writes_mutex);
+
+  write->thread = g_thread_new(
+    "InfTextFilesystemFormatWrite",
+    inf_text_filesystem_format_async_write_thread_func,
+    write
+  );
+}
+
 /* vim:set et sw=2 ts=2: */
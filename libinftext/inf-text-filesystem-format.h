@@ -22,11 +22,34 @@
 
 #include <libinftext/inf-text-session.h>
 #include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-io.h>
 
 #include <glib.h>
 
 G_BEGIN_DECLS
 
+#define INF_TEXT_TYPE_FILESYSTEM_FORMAT_TYPE (inf_text_filesystem_format_type_get_type())
+
+/**
+ * InfTextFilesystemFormatType:
+ * @INF_TEXT_FILESYSTEM_FORMAT_XML: The document is stored as XML.
+ * @INF_TEXT_FILESYSTEM_FORMAT_BINARY: The document is stored in a compact
+ * binary format instead of XML. Such files are much faster to load, but
+ * they cannot be edited by hand, and older versions of libinftext cannot
+ * read them.
+ * @INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY: The document is stored as
+ * XML, and in addition in the binary format in a separate file. The binary
+ * file is used to load the document as long as it matches the XML file.
+ *
+ * Specifies how inf_text_filesystem_format_write_with_type() stores a
+ * document in a #InfdFilesystemStorage.
+ */
+typedef enum _InfTextFilesystemFormatType {
+  INF_TEXT_FILESYSTEM_FORMAT_XML,
+  INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+  INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY
+} InfTextFilesystemFormatType;
+
 /**
  * InfTextFilesystemFormatError:
  * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION: The file to be read
@@ -35,6 +58,8 @@ G_BEGIN_DECLS
  * session contains users with duplicate ID or duplicate name.
  * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER: A segment of the text
  * document is written by a user which does not exist.
+ * @INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_BINARY: A file in the binary
+ * format is corrupted, or was written by a newer version of libinftext.
  *
  * Errors that can occur when reading a #InfTextSession from a
  * #InfdFilesystemStorage.
@@ -42,9 +67,26 @@ G_BEGIN_DECLS
 typedef enum _InfTextFilesystemFormatError {
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_NOT_A_TEXT_SESSION,
   INF_TEXT_FILESYSTEM_FORMAT_ERROR_USER_EXISTS,
-  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_NO_SUCH_USER,
+  INF_TEXT_FILESYSTEM_FORMAT_ERROR_INVALID_BINARY
 } InfTextFilesystemFormatError;
 
+/**
+ * InfTextFilesystemFormatWriteFunc:
+ * @error: Error information in case the document could not be written, or
+ * %NULL.
+ * @user_data: User-defined data specified in
+ * inf_text_filesystem_format_write_async().
+ *
+ * Callback function that is called when a document has been written with
+ * inf_text_filesystem_format_write_async().
+ */
+typedef void(*InfTextFilesystemFormatWriteFunc)(const GError* error,
+                                                gpointer user_data);
+
+GType
+inf_text_filesystem_format_type_get_type(void) G_GNUC_CONST;
+
 gboolean
 inf_text_filesystem_format_read(InfdFilesystemStorage* storage,
                                 const gchar* path,
@@ -59,6 +101,24 @@ inf_text_filesystem_format_write(InfdFilesystemStorage* storage,
                                  InfTextBuffer* buffer,
                                  GError** error);
 
+gboolean
+inf_text_filesystem_format_write_with_type(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           InfUserTable* user_table,
+                                           InfTextBuffer* buffer,
+                                           InfTextFilesystemFormatType type,
+                                           GError** error);
+
+void
+inf_text_filesystem_format_write_async(InfdFilesystemStorage* storage,
+                                       const gchar* path,
+                                       InfUserTable* user_table,
+                                       InfTextBuffer* buffer,
+                                       InfTextFilesystemFormatType type,
+                                       InfIo* io,
+                                       InfTextFilesystemFormatWriteFunc func,
+                                       gpointer user_data);
+
 G_END_DECLS
 
 #endif /* __INF_TEXT_FILESYSTEM_FORMAT_H__ */
@@ -0,0 +1,2458 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/**
+ * SECTION:inf-text-filesystem-journal
+ * @title: InfTextFilesystemJournal
+ * @short_description: Incremental storage of text sessions
+ * @include: libinftext/inf-text-filesystem-journal.h
+ * @see_also: #InfdFilesystemStorage, inf_text_filesystem_format_write()
+ * @stability: Unstable
+ *
+ * #InfTextFilesystemJournal stores a text document in a #InfdFilesystemStorage
+ * as a snapshot, in the format written by inf_text_filesystem_format_write(),
+ * plus a journal of all changes made to the buffer since the snapshot was
+ * written. Each change is appended to the journal as it happens, so that
+ * saving the document only costs as much as the changes made since the last
+ * save, instead of the size of the whole document.
+ *
+ * The journal is written to disk in batches, at most #InfTextFilesystemJournal:sync-interval
+ * milliseconds after a change, so that a crash only loses the changes of
+ * the last batch. Once the journal has grown larger than
+ * #InfTextFilesystemJournal:compact-size bytes, a new snapshot is written in
+ * a background thread, and the journal entries contained in it are removed.
+ * Setting #InfTextFilesystemJournal:snapshot-type allows these snapshots to
+ * be written in the binary format, which is faster to load for large
+ * documents.
+ *
+ * Use inf_text_filesystem_journal_open() to read a document from the storage
+ * and continue its journal, and inf_text_filesystem_journal_create() to
+ * start a new journal for a document that is not in the storage yet.
+ * inf_text_filesystem_journal_recover() reads the document without
+ * journaling further changes.
+ */
+
+#include <libinftext/inf-text-filesystem-journal.h>
+#include <libinftext/inf-text-filesystem-format-private.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/inf-signals.h>
+#include <libinfinity/inf-i18n.h>
+
+#include <libxml/xmlwriter.h>
+#include <libxml/parser.h>
+
+#include <glib/gstdio.h>
+
+#include <string.h>
+#include <errno.h>
+
+/* An open journal file. Entries are written to it through writer. */
+typedef struct _InfTextFilesystemJournalFile InfTextFilesystemJournalFile;
+struct _InfTextFilesystemJournalFile {
+  FILE* stream;
+  xmlTextWriterPtr writer;
+  gint64 first_sequence;
+  gsize size;
+};
+
+/* A snapshot being written in a background thread. The user table and
+ * buffer are copies of the session's at the time the compaction was
+ * started. */
+typedef struct _InfTextFilesystemJournalCompaction
+  InfTextFilesystemJournalCompaction;
+struct _InfTextFilesystemJournalCompaction {
+  InfTextFilesystemJournal* journal;
+  GThread* thread;
+
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextFilesystemFormatType snapshot_type;
+  gint64 sequence;
+
+  /* First sequence numbers of the journal files to remove once the
+   * snapshot has been written */
+  GArray* journals;
+  GError* error;
+};
+
+/* A document being recovered in a background thread by
+ * inf_text_filesystem_journal_recover_async(). */
+typedef struct _InfTextFilesystemJournalRecovery
+  InfTextFilesystemJournalRecovery;
+struct _InfTextFilesystemJournalRecovery {
+  GThread* thread;
+
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfIo* io;
+  InfTextFilesystemJournalRecoverFunc func;
+  gpointer user_data;
+
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  GError* error;
+};
+
+typedef struct _InfTextFilesystemJournalList InfTextFilesystemJournalList;
+struct _InfTextFilesystemJournalList {
+  const gchar* prefix;
+  gsize prefix_len;
+  GArray* sequences;
+};
+
+typedef struct _InfTextFilesystemJournalReader InfTextFilesystemJournalReader;
+struct _InfTextFilesystemJournalReader {
+  FILE* stream;
+  GString* data;
+  gsize line;
+  gboolean eof;
+};
+
+typedef struct _InfTextFilesystemJournalPrivate InfTextFilesystemJournalPrivate;
+struct _InfTextFilesystemJournalPrivate {
+  InfIo* io;
+  InfdFilesystemStorage* storage;
+  gchar* path;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+
+  guint sync_interval;
+  guint compact_size;
+  InfTextFilesystemFormatType snapshot_type;
+
+  InfTextFilesystemJournalFile* file;
+  gint64 sequence;
+  /* Authors for which the current journal file contains a user entry */
+  GHashTable* authors;
+  /* First sequence numbers of older journal files which are not yet
+   * covered by a snapshot */
+  GArray* journals;
+
+  InfIoTimeout* sync_timeout;
+  gboolean dirty;
+  GError* error;
+
+  InfTextFilesystemJournalCompaction* compaction;
+};
+
+enum {
+  PROP_0,
+
+  PROP_IO,
+  PROP_STORAGE,
+  PROP_PATH,
+  PROP_USER_TABLE,
+  PROP_BUFFER,
+
+  PROP_SEQUENCE,
+  PROP_COMPACTING,
+  PROP_SYNC_INTERVAL,
+  PROP_COMPACT_SIZE,
+  PROP_SNAPSHOT_TYPE
+};
+
+#define INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_FILESYSTEM_JOURNAL, InfTextFilesystemJournalPrivate))
+
+G_DEFINE_TYPE_WITH_CODE(InfTextFilesystemJournal, inf_text_filesystem_journal, G_TYPE_OBJECT,
+  G_ADD_PRIVATE(InfTextFilesystemJournal))
+
+static GQuark
+inf_text_filesystem_journal_error_quark()
+{
+  return g_quark_from_static_string("INF_TEXT_FILESYSTEM_JOURNAL_ERROR");
+}
+
+static void
+inf_text_filesystem_journal_set_xml_error(GError** error)
+{
+  g_set_error_literal(
+    error,
+    g_quark_from_static_string("LIBXML2_OUTPUT_ERROR"),
+    0,
+    _("Failed to write XML output")
+  );
+}
+
+static void
+inf_text_filesystem_journal_set_system_error(int code,
+                                             GError** error)
+{
+  g_set_error_literal(
+    error,
+    G_FILE_ERROR,
+    g_file_error_from_errno(code),
+    g_strerror(code)
+  );
+}
+
+static gchar*
+inf_text_filesystem_journal_get_identifier(gint64 sequence)
+{
+  return g_strdup_printf("InfText.journal-%" G_GINT64_FORMAT, sequence);
+}
+
+static gint
+inf_text_filesystem_journal_compare_sequence(gconstpointer first,
+                                             gconstpointer second)
+{
+  gint64 first_sequence;
+  gint64 second_sequence;
+
+  first_sequence = *(const gint64*)first;
+  second_sequence = *(const gint64*)second;
+
+  if(first_sequence < second_sequence) return -1;
+  if(first_sequence > second_sequence) return 1;
+  return 0;
+}
+
+static gboolean
+inf_text_filesystem_journal_list_func(const gchar* name,
+                                      const gchar* path,
+                                      InfFileType type,
+                                      gpointer user_data,
+                                      GError** error)
+{
+  InfTextFilesystemJournalList* list;
+  gint64 sequence;
+  gchar* endptr;
+
+  list = (InfTextFilesystemJournalList*)user_data;
+
+  if(type == INF_FILE_TYPE_REG &&
+     strncmp(name, list->prefix, list->prefix_len) == 0)
+  {
+    sequence = g_ascii_strtoll(name + list->prefix_len, &endptr, 10);
+    if(endptr != name + list->prefix_len && *endptr == '\0' && sequence >= 0)
+      g_array_append_val(list->sequences, sequence);
+  }
+
+  return TRUE;
+}
+
+/* Returns the first sequence numbers of all journal files of the document
+ * at path, in ascending order. */
+static GArray*
+inf_text_filesystem_journal_list(InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 GError** error)
+{
+  InfTextFilesystemJournalList list;
+  gchar* full_name;
+  gchar* dirname;
+  gchar* basename;
+  gchar* prefix;
+  gboolean result;
+
+  full_name = infd_filesystem_storage_get_path(storage, "InfText", path, error);
+  if(full_name == NULL)
+    return NULL;
+
+  dirname = g_path_get_dirname(full_name);
+  basename = g_path_get_basename(full_name);
+  prefix = g_strconcat(basename, ".journal-", NULL);
+  g_free(basename);
+  g_free(full_name);
+
+  list.prefix = prefix;
+  list.prefix_len = strlen(prefix);
+  list.sequences = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+  result = inf_file_util_list_directory(
+    dirname,
+    inf_text_filesystem_journal_list_func,
+    &list,
+    error
+  );
+
+  g_free(prefix);
+  g_free(dirname);
+
+  if(result == FALSE)
+  {
+    g_array_free(list.sequences, TRUE);
+    return NULL;
+  }
+
+  g_array_sort(list.sequences, inf_text_filesystem_journal_compare_sequence);
+  return list.sequences;
+}
+
+static gboolean
+inf_text_filesystem_journal_remove_files(InfdFilesystemStorage* storage,
+                                         const gchar* path,
+                                         GArray* journals,
+                                         GError** error)
+{
+  gchar* identifier;
+  gchar* full_name;
+  int save_errno;
+  guint i;
+
+  for(i = 0; i < journals->len; ++i)
+  {
+    identifier = inf_text_filesystem_journal_get_identifier(
+      g_array_index(journals, gint64, i)
+    );
+
+    full_name = infd_filesystem_storage_get_path(
+      storage,
+      identifier,
+      path,
+      error
+    );
+
+    g_free(identifier);
+    if(full_name == NULL)
+      return FALSE;
+
+    if(g_unlink(full_name) == -1)
+    {
+      save_errno = errno;
+      if(save_errno != ENOENT)
+      {
+        inf_text_filesystem_journal_set_system_error(save_errno, error);
+        g_free(full_name);
+        return FALSE;
+      }
+    }
+
+    g_free(full_name);
+  }
+
+  return TRUE;
+}
+
+/* Writes a new snapshot of the document and replaces the old one with it.
+ * This is called from the compaction thread, so it must not touch anything
+ * but its arguments. */
+static gboolean
+inf_text_filesystem_journal_write_snapshot(InfdFilesystemStorage* storage,
+                                           const gchar* path,
+                                           InfUserTable* user_table,
+                                           InfTextBuffer* buffer,
+                                           InfTextFilesystemFormatType type,
+                                           gint64 sequence,
+                                           GError** error)
+{
+  gchar* new_name;
+  gchar* full_name;
+  gboolean result;
+  int save_errno;
+
+  result = _inf_text_filesystem_format_write(
+    storage,
+    "InfText.new",
+    path,
+    user_table,
+    buffer,
+    type,
+    sequence,
+    TRUE,
+    error
+  );
+
+  if(result == FALSE)
+    return FALSE;
+
+  /* The binary file goes first. The XML file that is replaced does not
+   * refer to the new binary file, so the binary file is ignored if the XML
+   * file cannot be renamed. */
+  if(type == INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY)
+  {
+    new_name = infd_filesystem_storage_get_path(
+      storage,
+      "InfText.new.bin",
+      path,
+      error
+    );
+
+    if(new_name == NULL)
+      return FALSE;
+
+    full_name = infd_filesystem_storage_get_path(
+      storage,
+      "InfText.bin",
+      path,
+      error
+    );
+
+    if(full_name == NULL)
+    {
+      g_free(new_name);
+      return FALSE;
+    }
+
+    if(g_rename(new_name, full_name) == -1)
+    {
+      save_errno = errno;
+      inf_text_filesystem_journal_set_system_error(save_errno, error);
+      result = FALSE;
+    }
+
+    g_free(full_name);
+    g_free(new_name);
+
+    if(result == FALSE)
+      return FALSE;
+  }
+
+  new_name = infd_filesystem_storage_get_path(
+    storage,
+    "InfText.new",
+    path,
+    error
+  );
+
+  if(new_name == NULL)
+    return FALSE;
+
+  full_name = infd_filesystem_storage_get_path(storage, "InfText", path, error);
+  if(full_name == NULL)
+  {
+    g_free(new_name);
+    return FALSE;
+  }
+
+  /* The snapshot is written to a separate file first and then renamed, so
+   * that there is always a complete snapshot on disk. */
+  if(g_rename(new_name, full_name) == -1)
+  {
+    save_errno = errno;
+    inf_text_filesystem_journal_set_system_error(save_errno, error);
+    result = FALSE;
+  }
+
+  g_free(full_name);
+  g_free(new_name);
+  return result;
+}
+
+static int
+inf_text_filesystem_journal_file_write_func(void* context,
+                                            const char* buffer,
+                                            int len)
+{
+  InfTextFilesystemJournalFile* file;
+  gsize res;
+
+  file = (InfTextFilesystemJournalFile*)context;
+  res = infd_filesystem_storage_stream_write(file->stream, buffer, len);
+
+  if(ferror(file->stream))
+    return -1;
+
+  file->size += res;
+  return (int)res;
+}
+
+static int
+inf_text_filesystem_journal_file_close_func(void* context)
+{
+  InfTextFilesystemJournalFile* file;
+  file = (InfTextFilesystemJournalFile*)context;
+
+  return infd_filesystem_storage_stream_close(file->stream);
+}
+
+static void
+inf_text_filesystem_journal_file_free(InfTextFilesystemJournalFile* file)
+{
+  /* This also closes the stream */
+  xmlFreeTextWriter(file->writer);
+  g_slice_free(InfTextFilesystemJournalFile, file);
+}
+
+/* Creates the journal file whose first entry has the given sequence number.
+ * If such a file exists already, it is overwritten. */
+static InfTextFilesystemJournalFile*
+inf_text_filesystem_journal_file_new(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     gint64 sequence,
+                                     GError** error)
+{
+  InfTextFilesystemJournalFile* file;
+  xmlOutputBufferPtr output;
+  gchar* identifier;
+  FILE* stream;
+  int result;
+
+  identifier = inf_text_filesystem_journal_get_identifier(sequence);
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    identifier,
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  g_free(identifier);
+  if(stream == NULL)
+    return NULL;
+
+  file = g_slice_new(InfTextFilesystemJournalFile);
+  file->stream = stream;
+  file->writer = NULL;
+  file->first_sequence = sequence;
+  file->size = 0;
+
+  output = xmlOutputBufferCreateIO(
+    inf_text_filesystem_journal_file_write_func,
+    inf_text_filesystem_journal_file_close_func,
+    file,
+    NULL
+  );
+
+  if(output == NULL)
+  {
+    infd_filesystem_storage_stream_close(stream);
+    g_slice_free(InfTextFilesystemJournalFile, file);
+    inf_text_filesystem_journal_set_xml_error(error);
+    return NULL;
+  }
+
+  file->writer = xmlNewTextWriter(output);
+  if(file->writer == NULL)
+  {
+    xmlOutputBufferClose(output);
+    g_slice_free(InfTextFilesystemJournalFile, file);
+    inf_text_filesystem_journal_set_xml_error(error);
+    return NULL;
+  }
+
+  result = xmlTextWriterStartDocument(file->writer, NULL, "UTF-8", NULL);
+  if(result >= 0)
+  {
+    result = xmlTextWriterStartElement(
+      file->writer,
+      (const xmlChar*)"inf-text-journal"
+    );
+  }
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      file->writer,
+      (const xmlChar*)"sequence",
+      "%" G_GINT64_FORMAT,
+      sequence
+    );
+  }
+
+  if(result >= 0)
+    result = xmlTextWriterWriteString(file->writer, (const xmlChar*)"\n");
+
+  if(result < 0)
+  {
+    inf_text_filesystem_journal_file_free(file);
+    inf_text_filesystem_journal_set_xml_error(error);
+    return NULL;
+  }
+
+  return file;
+}
+
+/* Makes sure that everything written to file so far is on disk */
+static gboolean
+inf_text_filesystem_journal_file_sync(InfTextFilesystemJournalFile* file,
+                                      GError** error)
+{
+  if(xmlTextWriterFlush(file->writer) < 0)
+  {
+    inf_text_filesystem_journal_set_xml_error(error);
+    return FALSE;
+  }
+
+  if(infd_filesystem_storage_stream_sync(file->stream) != 0)
+  {
+    inf_text_filesystem_journal_set_system_error(errno, error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Each entry is written on a line of its own, which is only terminated once
+ * the entry has been written completely. This way, an entry that was cut
+ * off by a crash can be recognized, and the entries before it can still be
+ * read, which a streaming XML parser does not guarantee for a document with
+ * an error at the end. Newlines in the text are therefore written as
+ * character references. */
+static int
+inf_text_filesystem_journal_write_text(xmlTextWriterPtr writer,
+                                       const gchar* text,
+                                       gsize bytes)
+{
+  const gchar* newline;
+  int result;
+
+  while((newline = memchr(text, '\n', bytes)) != NULL)
+  {
+    result = inf_xml_util_write_child_text(writer, text, newline - text);
+    if(result < 0) return result;
+
+    result = xmlTextWriterWriteRaw(writer, (const xmlChar*)"&#10;");
+    if(result < 0) return result;
+
+    bytes -= newline - text + 1;
+    text = newline + 1;
+  }
+
+  return inf_xml_util_write_child_text(writer, text, bytes);
+}
+
+static int
+inf_text_filesystem_journal_write_user(xmlTextWriterPtr writer,
+                                       InfUser* user)
+{
+  char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  int result;
+
+  g_ascii_dtostr(
+    buffer,
+    G_ASCII_DTOSTR_BUF_SIZE,
+    inf_text_user_get_hue(INF_TEXT_USER(user))
+  );
+
+  result = xmlTextWriterWriteString(writer, (const xmlChar*)"  ");
+  if(result >= 0)
+    result = xmlTextWriterStartElement(writer, (const xmlChar*)"user");
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"id",
+      "%u",
+      inf_user_get_id(user)
+    );
+  }
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteAttribute(
+      writer,
+      (const xmlChar*)"name",
+      (const xmlChar*)inf_user_get_name(user)
+    );
+  }
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteAttribute(
+      writer,
+      (const xmlChar*)"hue",
+      (const xmlChar*)buffer
+    );
+  }
+
+  if(result >= 0)
+    result = xmlTextWriterEndElement(writer);
+  if(result >= 0)
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n");
+
+  return result;
+}
+
+/* Records the error that made writing the journal fail. No further entries
+ * are written after that, and the error is reported by the next call to
+ * inf_text_filesystem_journal_sync(). */
+static void
+inf_text_filesystem_journal_failed(InfTextFilesystemJournal* journal,
+                                   GError* error)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  if(priv->error == NULL)
+  {
+    g_warning(
+      _("Failed to write journal for document \"%s\": %s"),
+      priv->path,
+      error->message
+    );
+
+    priv->error = error;
+  }
+  else
+  {
+    g_error_free(error);
+  }
+}
+
+static gboolean
+inf_text_filesystem_journal_compact_impl(InfTextFilesystemJournal* journal,
+                                         GError** error);
+
+static void
+inf_text_filesystem_journal_sync_timeout_func(gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+  GError* error;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(user_data);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  priv->sync_timeout = NULL;
+  error = NULL;
+
+  if(priv->error == NULL && priv->dirty)
+  {
+    if(!inf_text_filesystem_journal_file_sync(priv->file, &error))
+      inf_text_filesystem_journal_failed(journal, error);
+    else
+      priv->dirty = FALSE;
+  }
+
+  if(priv->error == NULL && priv->compaction == NULL &&
+     priv->compact_size > 0 && priv->file->size >= priv->compact_size)
+  {
+    if(!inf_text_filesystem_journal_compact_impl(journal, &error))
+      inf_text_filesystem_journal_failed(journal, error);
+  }
+}
+
+static void
+inf_text_filesystem_journal_written(InfTextFilesystemJournal* journal)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  priv->dirty = TRUE;
+
+  if(priv->sync_interval == 0)
+  {
+    inf_text_filesystem_journal_sync_timeout_func(journal);
+  }
+  else if(priv->sync_timeout == NULL)
+  {
+    priv->sync_timeout = inf_io_add_timeout(
+      priv->io,
+      priv->sync_interval,
+      inf_text_filesystem_journal_sync_timeout_func,
+      journal,
+      NULL
+    );
+  }
+}
+
+/* Writes a user entry for author into the current journal file, unless
+ * there is one already. */
+static int
+inf_text_filesystem_journal_add_author(InfTextFilesystemJournal* journal,
+                                       guint author)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  InfUser* user;
+  int result;
+
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  if(author == 0)
+    return 0;
+  if(g_hash_table_lookup(priv->authors, GUINT_TO_POINTER(author)) != NULL)
+    return 0;
+
+  user = inf_user_table_lookup_user_by_id(priv->user_table, author);
+  if(user == NULL)
+    return 0;
+
+  result = inf_text_filesystem_journal_write_user(priv->file->writer, user);
+  if(result < 0)
+    return result;
+
+  g_hash_table_insert(
+    priv->authors,
+    GUINT_TO_POINTER(author),
+    GUINT_TO_POINTER(author)
+  );
+
+  return result;
+}
+
+static void
+inf_text_filesystem_journal_text_inserted_cb(InfTextBuffer* buffer,
+                                             guint pos,
+                                             InfTextChunk* chunk,
+                                             InfUser* user,
+                                             gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+  xmlTextWriterPtr writer;
+  InfTextChunkIter iter;
+  guint author;
+  int result;
+  GError* error;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(user_data);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+  writer = priv->file->writer;
+
+  if(priv->error != NULL)
+    return;
+
+  /* Write one entry per segment, so that the author of each segment is
+   * kept. */
+  result = 0;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      author = inf_text_chunk_iter_get_author(&iter);
+
+      result = inf_text_filesystem_journal_add_author(journal, author);
+      if(result >= 0)
+        result = xmlTextWriterWriteString(writer, (const xmlChar*)"  ");
+      if(result >= 0)
+        result = xmlTextWriterStartElement(writer, (const xmlChar*)"insert");
+
+      if(result >= 0)
+      {
+        result = xmlTextWriterWriteFormatAttribute(
+          writer,
+          (const xmlChar*)"pos",
+          "%u",
+          pos
+        );
+      }
+
+      if(result >= 0)
+      {
+        result = xmlTextWriterWriteFormatAttribute(
+          writer,
+          (const xmlChar*)"author",
+          "%u",
+          author
+        );
+      }
+
+      if(result >= 0)
+      {
+        result = inf_text_filesystem_journal_write_text(
+          writer,
+          inf_text_chunk_iter_get_text(&iter),
+          inf_text_chunk_iter_get_bytes(&iter)
+        );
+      }
+
+      if(result >= 0)
+        result = xmlTextWriterEndElement(writer);
+      if(result >= 0)
+        result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n");
+
+      pos += inf_text_chunk_iter_get_length(&iter);
+      ++priv->sequence;
+    } while(result >= 0 && inf_text_chunk_iter_next(&iter));
+  }
+
+  if(result < 0)
+  {
+    error = NULL;
+    inf_text_filesystem_journal_set_xml_error(&error);
+    inf_text_filesystem_journal_failed(journal, error);
+  }
+  else
+  {
+    inf_text_filesystem_journal_written(journal);
+  }
+}
+
+static void
+inf_text_filesystem_journal_text_erased_cb(InfTextBuffer* buffer,
+                                           guint pos,
+                                           InfTextChunk* chunk,
+                                           InfUser* user,
+                                           gpointer user_data)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+  xmlTextWriterPtr writer;
+  int result;
+  GError* error;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(user_data);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+  writer = priv->file->writer;
+
+  if(priv->error != NULL)
+    return;
+
+  result = xmlTextWriterWriteString(writer, (const xmlChar*)"  ");
+  if(result >= 0)
+    result = xmlTextWriterStartElement(writer, (const xmlChar*)"erase");
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"pos",
+      "%u",
+      pos
+    );
+  }
+
+  if(result >= 0)
+  {
+    result = xmlTextWriterWriteFormatAttribute(
+      writer,
+      (const xmlChar*)"len",
+      "%u",
+      inf_text_chunk_get_length(chunk)
+    );
+  }
+
+  if(result >= 0)
+    result = xmlTextWriterEndElement(writer);
+  if(result >= 0)
+    result = xmlTextWriterWriteString(writer, (const xmlChar*)"\n");
+
+  ++priv->sequence;
+
+  if(result < 0)
+  {
+    error = NULL;
+    inf_text_filesystem_journal_set_xml_error(&error);
+    inf_text_filesystem_journal_failed(journal, error);
+  }
+  else
+  {
+    inf_text_filesystem_journal_written(journal);
+  }
+}
+
+static gboolean
+inf_text_filesystem_journal_replay_user(InfUserTable* user_table,
+                                        xmlNodePtr node,
+                                        GError** error)
+{
+  guint id;
+  gdouble hue;
+  xmlChar* name;
+  gboolean result;
+  InfUser* user;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "id", &id, error))
+    return FALSE;
+
+  if(!inf_xml_util_get_attribute_double_required(node, "hue", &hue, error))
+    return FALSE;
+
+  /* The user is declared again in every journal file, and it might be
+   * contained in the snapshot already. */
+  if(inf_user_table_lookup_user_by_id(user_table, id) != NULL)
+    return TRUE;
+
+  name = inf_xml_util_get_attribute_required(node, "name", error);
+  if(name == NULL)
+    return FALSE;
+
+  if(inf_user_table_lookup_user_by_name(user_table, (const gchar*)name))
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_journal_error_quark(),
+      INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY,
+      _("User with name \"%s\" exists already"),
+      (const gchar*)name
+    );
+
+    result = FALSE;
+  }
+  else
+  {
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", id,
+        "name", name,
+        "hue", hue,
+        NULL
+      )
+    );
+
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+    result = TRUE;
+  }
+
+  xmlFree(name);
+  return result;
+}
+
+static gboolean
+inf_text_filesystem_journal_replay_insert(InfUserTable* user_table,
+                                          InfTextBuffer* buffer,
+                                          xmlNodePtr node,
+                                          GError** error)
+{
+  guint pos;
+  guint author;
+  InfUser* user;
+  gchar* text;
+  gsize bytes;
+  guint chars;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "pos", &pos, error))
+    return FALSE;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "author", &author, error))
+    return FALSE;
+
+  if(pos > inf_text_buffer_get_length(buffer))
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_journal_error_quark(),
+      INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY,
+      _("Insertion position %u is behind the end of the document"),
+      pos
+    );
+
+    return FALSE;
+  }
+
+  user = NULL;
+  if(author != 0)
+  {
+    user = inf_user_table_lookup_user_by_id(user_table, author);
+    if(user == NULL)
+    {
+      g_set_error(
+        error,
+        inf_text_filesystem_journal_error_quark(),
+        INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY,
+        _("User with ID \"%u\" does not exist"),
+        author
+      );
+
+      return FALSE;
+    }
+  }
+
+  text = inf_xml_util_get_child_text(node, &bytes, &chars, error);
+  if(text == NULL)
+    return FALSE;
+
+  if(chars > 0)
+    inf_text_buffer_insert_text(buffer, pos, text, bytes, chars, user);
+
+  g_free(text);
+  return TRUE;
+}
+
+static gboolean
+inf_text_filesystem_journal_replay_erase(InfTextBuffer* buffer,
+                                         xmlNodePtr node,
+                                         GError** error)
+{
+  guint pos;
+  guint len;
+  guint length;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "pos", &pos, error))
+    return FALSE;
+
+  if(!inf_xml_util_get_attribute_uint_required(node, "len", &len, error))
+    return FALSE;
+
+  length = inf_text_buffer_get_length(buffer);
+  if(pos > length || len > length - pos)
+  {
+    g_set_error(
+      error,
+      inf_text_filesystem_journal_error_quark(),
+      INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY,
+      _("Erasing %u characters at position %u goes beyond the end of "
+        "the document"),
+      len,
+      pos
+    );
+
+    return FALSE;
+  }
+
+  if(len > 0)
+    inf_text_buffer_erase_text(buffer, pos, len, NULL);
+
+  return TRUE;
+}
+
+/* Returns the next line of the file, without the terminating newline, or
+ * NULL at the end of the file. A last line without newline is not returned,
+ * since it is an entry that was not written completely. */
+static const gchar*
+inf_text_filesystem_journal_reader_next_line(
+  InfTextFilesystemJournalReader* reader,
+  gsize* len,
+  GError** error)
+{
+  const gchar* line;
+  const gchar* newline;
+  gsize size;
+  gsize res;
+
+  for(;;)
+  {
+    line = reader->data->str + reader->line;
+    newline = memchr(line, '\n', reader->data->len - reader->line);
+
+    if(newline != NULL)
+    {
+      *len = newline - line;
+      reader->line += *len + 1;
+      return line;
+    }
+
+    if(reader->eof)
+      return NULL;
+
+    g_string_erase(reader->data, 0, reader->line);
+    reader->line = 0;
+
+    size = reader->data->len;
+    g_string_set_size(reader->data, size + 4096);
+
+    res = infd_filesystem_storage_stream_read(
+      reader->stream,
+      reader->data->str + size,
+      4096
+    );
+
+    g_string_set_size(reader->data, size + res);
+
+    if(ferror(reader->stream))
+    {
+      inf_text_filesystem_journal_set_system_error(errno, error);
+      return NULL;
+    }
+
+    if(res == 0)
+      reader->eof = TRUE;
+  }
+}
+
+/* Applies the entries of the journal file starting at first_sequence to
+ * buffer, skipping the ones before *sequence, and sets *sequence to the
+ * sequence number following the last entry in the file. Reading stops
+ * without error at the first entry that is incomplete, since that is where
+ * writing the file was interrupted. */
+static gboolean
+inf_text_filesystem_journal_replay(InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   gint64 first_sequence,
+                                   InfUserTable* user_table,
+                                   InfTextBuffer* buffer,
+                                   gint64* sequence,
+                                   GError** error)
+{
+  InfTextFilesystemJournalReader reader;
+  gchar* identifier;
+  gchar* full_path;
+  const gchar* line;
+  gsize len;
+  gboolean in_journal;
+  gboolean result;
+  GError* local_error;
+  gint64 current;
+  xmlDocPtr doc;
+  xmlNodePtr node;
+
+  identifier = inf_text_filesystem_journal_get_identifier(first_sequence);
+  full_path = NULL;
+
+  reader.stream = infd_filesystem_storage_open(
+    storage,
+    identifier,
+    path,
+    "r",
+    &full_path,
+    error
+  );
+
+  g_free(identifier);
+
+  if(reader.stream == NULL)
+  {
+    g_free(full_path);
+    return FALSE;
+  }
+
+  reader.data = g_string_sized_new(4096);
+  reader.line = 0;
+  reader.eof = FALSE;
+
+  current = first_sequence;
+  in_journal = FALSE;
+  result = TRUE;
+  local_error = NULL;
+
+  while(result == TRUE)
+  {
+    line = inf_text_filesystem_journal_reader_next_line(
+      &reader,
+      &len,
+      &local_error
+    );
+
+    if(line == NULL)
+    {
+      if(local_error != NULL)
+        result = FALSE;
+      break;
+    }
+
+    /* The XML declaration and the start tag of the journal come first */
+    if(!in_journal)
+    {
+      if(len >= 17 && strncmp(line, "<inf-text-journal", 17) == 0)
+        in_journal = TRUE;
+      else if(len < 5 || strncmp(line, "<?xml", 5) != 0)
+        break;
+      continue;
+    }
+
+    doc = xmlReadMemory(
+      line,
+      len,
+      NULL,
+      "UTF-8",
+      XML_PARSE_NOWARNING | XML_PARSE_NOERROR | XML_PARSE_NONET
+    );
+
+    /* Either the end tag of the journal or a broken entry */
+    if(doc == NULL)
+      break;
+
+    node = xmlDocGetRootElement(doc);
+    if(strcmp((const char*)node->name, "user") == 0)
+    {
+      result = inf_text_filesystem_journal_replay_user(
+        user_table,
+        node,
+        &local_error
+      );
+    }
+    else if(strcmp((const char*)node->name, "insert") == 0)
+    {
+      if(current >= *sequence)
+      {
+        result = inf_text_filesystem_journal_replay_insert(
+          user_table,
+          buffer,
+          node,
+          &local_error
+        );
+
+        if(result == TRUE)
+          *sequence = current + 1;
+      }
+
+      ++current;
+    }
+    else if(strcmp((const char*)node->name, "erase") == 0)
+    {
+      if(current >= *sequence)
+      {
+        result = inf_text_filesystem_journal_replay_erase(
+          buffer,
+          node,
+          &local_error
+        );
+
+        if(result == TRUE)
+          *sequence = current + 1;
+      }
+
+      ++current;
+    }
+
+    xmlFreeDoc(doc);
+  }
+
+  if(result == FALSE)
+  {
+    g_propagate_prefixed_error(
+      error,
+      local_error,
+      _("Error processing file \"%s\": "),
+      full_path
+    );
+  }
+
+  g_string_free(reader.data, TRUE);
+  infd_filesystem_storage_stream_close(reader.stream);
+  g_free(full_path);
+  return result;
+}
+
+/* Reads the snapshot of the document at path and applies all journal
+ * entries written after it. If journals is not NULL, it is set to the list
+ * of existing journal files. */
+static gboolean
+inf_text_filesystem_journal_recover_impl(InfdFilesystemStorage* storage,
+                                         const gchar* path,
+                                         InfUserTable* user_table,
+                                         InfTextBuffer* buffer,
+                                         gint64* sequence,
+                                         GArray** journals,
+                                         GError** error)
+{
+  GArray* sequences;
+  gint64 first_sequence;
+  gboolean result;
+  guint i;
+
+  _inf_text_filesystem_format_flush_writes();
+
+  result = _inf_text_filesystem_format_read(
+    storage,
+    "InfText",
+    path,
+    user_table,
+    buffer,
+    sequence,
+    error
+  );
+
+  if(result == FALSE)
+    return FALSE;
+
+  sequences = inf_text_filesystem_journal_list(storage, path, error);
+  if(sequences == NULL)
+    return FALSE;
+
+  /* Without sequence number, the snapshot was written without journal,
+   * after any journal files that might be left over. */
+  if(*sequence >= 0)
+  {
+    for(i = 0; i < sequences->len && result == TRUE; ++i)
+    {
+      first_sequence = g_array_index(sequences, gint64, i);
+      if(first_sequence > *sequence)
+      {
+        g_set_error(
+          error,
+          inf_text_filesystem_journal_error_quark(),
+          INF_TEXT_FILESYSTEM_JOURNAL_ERROR_MISSING_ENTRIES,
+          _("Journal entries %" G_GINT64_FORMAT " to %" G_GINT64_FORMAT
+            " of document \"%s\" are missing"),
+          *sequence,
+          first_sequence - 1,
+          path
+        );
+
+        result = FALSE;
+      }
+      else
+      {
+        result = inf_text_filesystem_journal_replay(
+          storage,
+          path,
+          first_sequence,
+          user_table,
+          buffer,
+          sequence,
+          error
+        );
+      }
+    }
+  }
+
+  if(result == TRUE && journals != NULL)
+    *journals = sequences;
+  else
+    g_array_free(sequences, TRUE);
+
+  return result;
+}
+
+static void
+inf_text_filesystem_journal_recovery_dispatch_func(gpointer user_data)
+{
+  InfTextFilesystemJournalRecovery* recovery;
+  recovery = (InfTextFilesystemJournalRecovery*)user_data;
+
+  g_thread_join(recovery->thread);
+
+  if(recovery->error != NULL)
+  {
+    recovery->func(NULL, NULL, recovery->error, recovery->user_data);
+    g_error_free(recovery->error);
+  }
+  else
+  {
+    recovery->func(
+      recovery->user_table,
+      recovery->buffer,
+      NULL,
+      recovery->user_data
+    );
+  }
+
+  g_object_unref(recovery->user_table);
+  g_object_unref(recovery->buffer);
+  g_object_unref(recovery->storage);
+  g_object_unref(recovery->io);
+  g_free(recovery->path);
+  g_slice_free(InfTextFilesystemJournalRecovery, recovery);
+}
+
+static gpointer
+inf_text_filesystem_journal_recovery_thread_func(gpointer data)
+{
+  InfTextFilesystemJournalRecovery* recovery;
+  gint64 sequence;
+
+  recovery = (InfTextFilesystemJournalRecovery*)data;
+
+  inf_text_filesystem_journal_recover_impl(
+    recovery->storage,
+    recovery->path,
+    recovery->user_table,
+    recovery->buffer,
+    &sequence,
+    NULL,
+    &recovery->error
+  );
+
+  /* Hand the result to the thread which started the recovery */
+  inf_io_add_dispatch(
+    recovery->io,
+    inf_text_filesystem_journal_recovery_dispatch_func,
+    recovery,
+    NULL
+  );
+
+  return NULL;
+}
+
+static void
+inf_text_filesystem_journal_compaction_free(
+  InfTextFilesystemJournalCompaction* compaction)
+{
+  g_object_unref(compaction->storage);
+  g_free(compaction->path);
+  g_object_unref(compaction->user_table);
+  g_object_unref(compaction->buffer);
+  g_array_free(compaction->journals, TRUE);
+  if(compaction->error != NULL)
+    g_error_free(compaction->error);
+
+  g_slice_free(InfTextFilesystemJournalCompaction, compaction);
+}
+
+static void
+inf_text_filesystem_journal_compaction_dispatch_func(gpointer user_data)
+{
+  InfTextFilesystemJournalCompaction* compaction;
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+
+  compaction = (InfTextFilesystemJournalCompaction*)user_data;
+  journal = compaction->journal;
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  g_assert(priv->compaction == compaction);
+  g_thread_join(compaction->thread);
+  priv->compaction = NULL;
+
+  /* The journal files are still needed if the snapshot could not be
+   * written. Otherwise, try again to remove them at the next compaction. */
+  if(compaction->error != NULL)
+  {
+    g_warning(
+      _("Failed to compact journal for document \"%s\": %s"),
+      priv->path,
+      compaction->error->message
+    );
+
+    g_array_append_vals(
+      priv->journals,
+      compaction->journals->data,
+      compaction->journals->len
+    );
+  }
+
+  inf_text_filesystem_journal_compaction_free(compaction);
+
+  g_object_notify(G_OBJECT(journal), "compacting");
+  g_object_unref(journal);
+}
+
+static gpointer
+inf_text_filesystem_journal_compaction_thread_func(gpointer data)
+{
+  InfTextFilesystemJournalCompaction* compaction;
+  InfTextFilesystemJournalPrivate* priv;
+  gboolean result;
+
+  compaction = (InfTextFilesystemJournalCompaction*)data;
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(compaction->journal);
+
+  result = inf_text_filesystem_journal_write_snapshot(
+    compaction->storage,
+    compaction->path,
+    compaction->user_table,
+    compaction->buffer,
+    compaction->snapshot_type,
+    compaction->sequence,
+    &compaction->error
+  );
+
+  if(result == TRUE)
+  {
+    inf_text_filesystem_journal_remove_files(
+      compaction->storage,
+      compaction->path,
+      compaction->journals,
+      &compaction->error
+    );
+  }
+
+  /* Finish the compaction in the thread of the session */
+  inf_io_add_dispatch(
+    priv->io,
+    inf_text_filesystem_journal_compaction_dispatch_func,
+    compaction,
+    NULL
+  );
+
+  return NULL;
+}
+
+static gboolean
+inf_text_filesystem_journal_compact_impl(InfTextFilesystemJournal* journal,
+                                         GError** error)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  InfTextFilesystemJournalCompaction* compaction;
+  InfTextFilesystemJournalFile* file;
+
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+  g_assert(priv->compaction == NULL);
+
+  /* The entries of the current journal file need to be on disk before any
+   * entries are written to the next one, since otherwise a crash could
+   * leave a gap between the two. */
+  if(!inf_text_filesystem_journal_file_sync(priv->file, error))
+    return FALSE;
+
+  priv->dirty = FALSE;
+
+  file = inf_text_filesystem_journal_file_new(
+    priv->storage,
+    priv->path,
+    priv->sequence,
+    error
+  );
+
+  if(file == NULL)
+    return FALSE;
+
+  xmlTextWriterEndDocument(priv->file->writer);
+  g_array_append_val(priv->journals, priv->file->first_sequence);
+  inf_text_filesystem_journal_file_free(priv->file);
+
+  priv->file = file;
+  g_hash_table_remove_all(priv->authors);
+
+  /* Take a copy of the document for the compaction thread. Copying the
+   * buffer content is cheap, since it is shared with the original until
+   * the original is modified. */
+  compaction = g_slice_new(InfTextFilesystemJournalCompaction);
+  compaction->journal = journal;
+  compaction->storage = g_object_ref(priv->storage);
+  compaction->path = g_strdup(priv->path);
+  compaction->snapshot_type = priv->snapshot_type;
+  compaction->sequence = priv->sequence;
+  compaction->journals = priv->journals;
+  compaction->error = NULL;
+
+  _inf_text_filesystem_format_snapshot(
+    priv->user_table,
+    priv->buffer,
+    &compaction->user_table,
+    &compaction->buffer
+  );
+
+  priv->journals = g_array_new(FALSE, FALSE, sizeof(gint64));
+  priv->compaction = compaction;
+
+  /* Keep the journal alive until the thread has been joined in the
+   * dispatch function */
+  g_object_ref(journal);
+
+  compaction->thread = g_thread_new(
+    "InfTextFilesystemJournal",
+    inf_text_filesystem_journal_compaction_thread_func,
+    compaction
+  );
+
+  g_object_notify(G_OBJECT(journal), "compacting");
+  return TRUE;
+}
+
+static InfTextFilesystemJournal*
+inf_text_filesystem_journal_new(InfIo* io,
+                                InfdFilesystemStorage* storage,
+                                const gchar* path,
+                                InfUserTable* user_table,
+                                InfTextBuffer* buffer,
+                                gint64 sequence,
+                                GArray* journals,
+                                GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+  InfTextFilesystemJournalFile* file;
+  guint i;
+
+  file = inf_text_filesystem_journal_file_new(storage, path, sequence, error);
+  if(file == NULL)
+    return NULL;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(
+    g_object_new(
+      INF_TEXT_TYPE_FILESYSTEM_JOURNAL,
+      "io", io,
+      "storage", storage,
+      "path", path,
+      "user-table", user_table,
+      "buffer", buffer,
+      NULL
+    )
+  );
+
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+  priv->file = file;
+  priv->sequence = sequence;
+
+  /* A journal file starting at sequence was overwritten by the new one */
+  for(i = 0; i < journals->len; ++i)
+    if(g_array_index(journals, gint64, i) < sequence)
+      g_array_append_val(priv->journals, g_array_index(journals, gint64, i));
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-inserted",
+    G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+    journal
+  );
+
+  g_signal_connect_after(
+    G_OBJECT(buffer),
+    "text-erased",
+    G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+    journal
+  );
+
+  return journal;
+}
+
+static void
+inf_text_filesystem_journal_init(InfTextFilesystemJournal* journal)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  priv->io = NULL;
+  priv->storage = NULL;
+  priv->path = NULL;
+  priv->user_table = NULL;
+  priv->buffer = NULL;
+
+  priv->sync_interval = 1000;
+  priv->compact_size = 1 << 20;
+  priv->snapshot_type = INF_TEXT_FILESYSTEM_FORMAT_XML;
+
+  priv->file = NULL;
+  priv->sequence = 0;
+  priv->authors = g_hash_table_new(NULL, NULL);
+  priv->journals = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+  priv->sync_timeout = NULL;
+  priv->dirty = FALSE;
+  priv->error = NULL;
+
+  priv->compaction = NULL;
+}
+
+static void
+inf_text_filesystem_journal_dispose(GObject* object)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+  GError* error;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(object);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  /* A running compaction holds a reference on the journal */
+  g_assert(priv->compaction == NULL);
+
+  if(priv->sync_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->sync_timeout);
+    priv->sync_timeout = NULL;
+  }
+
+  if(priv->buffer != NULL)
+  {
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->buffer),
+      G_CALLBACK(inf_text_filesystem_journal_text_inserted_cb),
+      journal
+    );
+
+    inf_signal_handlers_disconnect_by_func(
+      G_OBJECT(priv->buffer),
+      G_CALLBACK(inf_text_filesystem_journal_text_erased_cb),
+      journal
+    );
+
+    g_object_unref(priv->buffer);
+    priv->buffer = NULL;
+  }
+
+  if(priv->file != NULL)
+  {
+    error = NULL;
+    if(priv->error == NULL && priv->dirty)
+      if(!inf_text_filesystem_journal_file_sync(priv->file, &error))
+        inf_text_filesystem_journal_failed(journal, error);
+
+    xmlTextWriterEndDocument(priv->file->writer);
+    inf_text_filesystem_journal_file_free(priv->file);
+    priv->file = NULL;
+  }
+
+  if(priv->user_table != NULL)
+  {
+    g_object_unref(priv->user_table);
+    priv->user_table = NULL;
+  }
+
+  if(priv->storage != NULL)
+  {
+    g_object_unref(priv->storage);
+    priv->storage = NULL;
+  }
+
+  if(priv->io != NULL)
+  {
+    g_object_unref(priv->io);
+    priv->io = NULL;
+  }
+
+  G_OBJECT_CLASS(inf_text_filesystem_journal_parent_class)->dispose(object);
+}
+
+static void
+inf_text_filesystem_journal_finalize(GObject* object)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(object);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  g_free(priv->path);
+  g_hash_table_destroy(priv->authors);
+  g_array_free(priv->journals, TRUE);
+
+  if(priv->error != NULL)
+    g_error_free(priv->error);
+
+  G_OBJECT_CLASS(inf_text_filesystem_journal_parent_class)->finalize(object);
+}
+
+static void
+inf_text_filesystem_journal_set_property(GObject* object,
+                                         guint prop_id,
+                                         const GValue* value,
+                                         GParamSpec* pspec)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(object);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_assert(priv->io == NULL); /* construct only */
+    priv->io = INF_IO(g_value_dup_object(value));
+    break;
+  case PROP_STORAGE:
+    g_assert(priv->storage == NULL); /* construct only */
+    priv->storage = INFD_FILESYSTEM_STORAGE(g_value_dup_object(value));
+    break;
+  case PROP_PATH:
+    g_assert(priv->path == NULL); /* construct only */
+    priv->path = g_value_dup_string(value);
+    break;
+  case PROP_USER_TABLE:
+    g_assert(priv->user_table == NULL); /* construct only */
+    priv->user_table = INF_USER_TABLE(g_value_dup_object(value));
+    break;
+  case PROP_BUFFER:
+    g_assert(priv->buffer == NULL); /* construct only */
+    priv->buffer = INF_TEXT_BUFFER(g_value_dup_object(value));
+    break;
+  case PROP_SYNC_INTERVAL:
+    priv->sync_interval = g_value_get_uint(value);
+    break;
+  case PROP_COMPACT_SIZE:
+    priv->compact_size = g_value_get_uint(value);
+    break;
+  case PROP_SNAPSHOT_TYPE:
+    priv->snapshot_type = g_value_get_enum(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_text_filesystem_journal_get_property(GObject* object,
+                                         guint prop_id,
+                                         GValue* value,
+                                         GParamSpec* pspec)
+{
+  InfTextFilesystemJournal* journal;
+  InfTextFilesystemJournalPrivate* priv;
+
+  journal = INF_TEXT_FILESYSTEM_JOURNAL(object);
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  switch(prop_id)
+  {
+  case PROP_IO:
+    g_value_set_object(value, priv->io);
+    break;
+  case PROP_STORAGE:
+    g_value_set_object(value, priv->storage);
+    break;
+  case PROP_PATH:
+    g_value_set_string(value, priv->path);
+    break;
+  case PROP_USER_TABLE:
+    g_value_set_object(value, priv->user_table);
+    break;
+  case PROP_BUFFER:
+    g_value_set_object(value, priv->buffer);
+    break;
+  case PROP_SEQUENCE:
+    g_value_set_int64(value, priv->sequence);
+    break;
+  case PROP_COMPACTING:
+    g_value_set_boolean(value, priv->compaction != NULL);
+    break;
+  case PROP_SYNC_INTERVAL:
+    g_value_set_uint(value, priv->sync_interval);
+    break;
+  case PROP_COMPACT_SIZE:
+    g_value_set_uint(value, priv->compact_size);
+    break;
+  case PROP_SNAPSHOT_TYPE:
+    g_value_set_enum(value, priv->snapshot_type);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_text_filesystem_journal_class_init(
+  InfTextFilesystemJournalClass* journal_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(journal_class);
+
+  object_class->dispose = inf_text_filesystem_journal_dispose;
+  object_class->finalize = inf_text_filesystem_journal_finalize;
+  object_class->set_property = inf_text_filesystem_journal_set_property;
+  object_class->get_property = inf_text_filesystem_journal_get_property;
+
+  g_object_class_install_property(
+    object_class,
+    PROP_IO,
+    g_param_spec_object(
+      "io",
+      "IO",
+      "The I/O object used to schedule writing the journal to disk",
+      INF_TYPE_IO,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_STORAGE,
+    g_param_spec_object(
+      "storage",
+      "Storage",
+      "The storage in which the document is stored",
+      INFD_TYPE_FILESYSTEM_STORAGE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_PATH,
+    g_param_spec_string(
+      "path",
+      "Path",
+      "The path of the document in the storage",
+      NULL,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_USER_TABLE,
+    g_param_spec_object(
+      "user-table",
+      "User table",
+      "The user table of the document's session",
+      INF_TYPE_USER_TABLE,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_BUFFER,
+    g_param_spec_object(
+      "buffer",
+      "Buffer",
+      "The buffer whose changes are written to the journal",
+      INF_TEXT_TYPE_BUFFER,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SEQUENCE,
+    g_param_spec_int64(
+      "sequence",
+      "Sequence",
+      "The sequence number of the next journal entry",
+      0,
+      G_MAXINT64,
+      0,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPACTING,
+    g_param_spec_boolean(
+      "compacting",
+      "Compacting",
+      "Whether a new snapshot is being written in the background",
+      FALSE,
+      G_PARAM_READABLE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SYNC_INTERVAL,
+    g_param_spec_uint(
+      "sync-interval",
+      "Sync interval",
+      "Time in milliseconds after which journal entries are written to "
+      "disk, or 0 to write each entry to disk immediately",
+      0,
+      G_MAXUINT,
+      1000,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_COMPACT_SIZE,
+    g_param_spec_uint(
+      "compact-size",
+      "Compact size",
+      "Size of the journal in bytes after which a new snapshot is written, "
+      "or 0 to never write snapshots automatically",
+      0,
+      G_MAXUINT,
+      1 << 20,
+      G_PARAM_READWRITE
+    )
+  );
+
+  g_object_class_install_property(
+    object_class,
+    PROP_SNAPSHOT_TYPE,
+    g_param_spec_enum(
+      "snapshot-type",
+      "Snapshot type",
+      "The format in which snapshots are written when the journal is "
+      "compacted",
+      INF_TEXT_TYPE_FILESYSTEM_FORMAT_TYPE,
+      INF_TEXT_FILESYSTEM_FORMAT_XML,
+      G_PARAM_READWRITE
+    )
+  );
+}
+
+/**
+ * inf_text_filesystem_journal_recover:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document to recover.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer with UTF-8 encoding to use as the new
+ * session's buffer.
+ * @sequence: (out) (allow-none): Location to store the sequence number of
+ * the next journal entry, or %NULL.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads the document at @path from @storage, like
+ * inf_text_filesystem_format_read(), and applies all changes recorded in
+ * its journal after the snapshot was written. The document is not modified
+ * on disk, and changes made to @buffer afterwards are not recorded.
+ *
+ * Entries at the end of a journal file which have not been written
+ * completely, for example because the server crashed while writing them,
+ * are ignored. If the document was not stored with a journal, @sequence is
+ * set to -1.
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_recover(InfdFilesystemStorage* storage,
+                                    const gchar* path,
+                                    InfUserTable* user_table,
+                                    InfTextBuffer* buffer,
+                                    gint64* sequence,
+                                    GError** error)
+{
+  gint64 next_sequence;
+
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), FALSE);
+  g_return_val_if_fail(path != NULL, FALSE);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), FALSE);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, FALSE);
+
+  g_return_val_if_fail(
+    strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0,
+    FALSE
+  );
+
+  if(!inf_text_filesystem_journal_recover_impl(storage, path, user_table,
+                                               buffer, &next_sequence,
+                                               NULL, error))
+  {
+    return FALSE;
+  }
+
+  if(sequence != NULL)
+    *sequence = next_sequence;
+
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_journal_recover_async:
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document to recover.
+ * @io: The #InfIo of the thread in which to call @func.
+ * @func: Function to call with the recovered document.
+ * @user_data: Additional data to pass to @func.
+ *
+ * Recovers the document at @path like inf_text_filesystem_journal_recover(),
+ * but reads it in a separate thread, so that the function does not block.
+ * When the document has been read, @func is called via @io with a new
+ * #InfUserTable and an #InfTextBuffer in UTF-8 encoding holding the
+ * document, or with an error if the document could not be read. Documents
+ * that are being written by inf_text_filesystem_format_write_async() are
+ * read only after writing has finished.
+ */
+void
+inf_text_filesystem_journal_recover_async(
+  InfdFilesystemStorage* storage,
+  const gchar* path,
+  InfIo* io,
+  InfTextFilesystemJournalRecoverFunc func,
+  gpointer user_data)
+{
+  InfTextFilesystemJournalRecovery* recovery;
+
+  g_return_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage));
+  g_return_if_fail(path != NULL);
+  g_return_if_fail(INF_IS_IO(io));
+  g_return_if_fail(func != NULL);
+
+  recovery = g_slice_new(InfTextFilesystemJournalRecovery);
+  recovery->storage = storage;
+  recovery->path = g_strdup(path);
+  recovery->io = io;
+  recovery->func = func;
+  recovery->user_data = user_data;
+  recovery->user_table = inf_user_table_new();
+  recovery->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  recovery->error = NULL;
+
+  g_object_ref(storage);
+  g_object_ref(io);
+
+  recovery->thread = g_thread_new(
+    "InfTextFilesystemJournalRecover",
+    inf_text_filesystem_journal_recovery_thread_func,
+    recovery
+  );
+}
+
+/**
+ * inf_text_filesystem_journal_open:
+ * @io: A #InfIo object to schedule writing the journal to disk.
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path of the document to open.
+ * @user_table: An empty #InfUserTable to use as the new session's user table.
+ * @buffer: An empty #InfTextBuffer with UTF-8 encoding to use as the new
+ * session's buffer.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Reads the document at @path from @storage with
+ * inf_text_filesystem_journal_recover(), and starts recording all further
+ * changes to @buffer in the document's journal. If the document was stored
+ * without a journal before, then a snapshot of it is written first.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal, or %NULL on
+ * error.
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfIo* io,
+                                 InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  GArray* journals;
+  gint64 sequence;
+  gboolean result;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+  g_return_val_if_fail(inf_text_buffer_get_length(buffer) == 0, NULL);
+
+  g_return_val_if_fail(
+    strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0,
+    NULL
+  );
+
+  result = inf_text_filesystem_journal_recover_impl(
+    storage,
+    path,
+    user_table,
+    buffer,
+    &sequence,
+    &journals,
+    error
+  );
+
+  if(result == FALSE)
+    return NULL;
+
+  if(sequence < 0)
+  {
+    /* Remove left-over journal files before writing the new snapshot, so
+     * that they cannot be applied to it. */
+    result = inf_text_filesystem_journal_remove_files(
+      storage,
+      path,
+      journals,
+      error
+    );
+
+    if(result == TRUE)
+    {
+      result = inf_text_filesystem_journal_write_snapshot(
+        storage,
+        path,
+        user_table,
+        buffer,
+        INF_TEXT_FILESYSTEM_FORMAT_XML,
+        0,
+        error
+      );
+    }
+
+    g_array_set_size(journals, 0);
+    sequence = 0;
+  }
+
+  journal = NULL;
+  if(result == TRUE)
+  {
+    journal = inf_text_filesystem_journal_new(
+      io,
+      storage,
+      path,
+      user_table,
+      buffer,
+      sequence,
+      journals,
+      error
+    );
+  }
+
+  g_array_free(journals, TRUE);
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_create:
+ * @io: A #InfIo object to schedule writing the journal to disk.
+ * @storage: A #InfdFilesystemStorage.
+ * @path: Storage path where to store the document.
+ * @user_table: The #InfUserTable of the document's session.
+ * @buffer: The #InfTextBuffer of the document's session, with UTF-8
+ * encoding.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes a snapshot of the document in @buffer to @path in @storage,
+ * replacing any document stored there before, and starts recording all
+ * further changes to @buffer in a new journal.
+ *
+ * Returns: (transfer full): A new #InfTextFilesystemJournal, or %NULL on
+ * error.
+ */
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_create(InfIo* io,
+                                   InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   InfUserTable* user_table,
+                                   InfTextBuffer* buffer,
+                                   GError** error)
+{
+  InfTextFilesystemJournal* journal;
+  GArray* journals;
+  gboolean result;
+
+  g_return_val_if_fail(INF_IS_IO(io), NULL);
+  g_return_val_if_fail(INFD_IS_FILESYSTEM_STORAGE(storage), NULL);
+  g_return_val_if_fail(path != NULL, NULL);
+  g_return_val_if_fail(INF_IS_USER_TABLE(user_table), NULL);
+  g_return_val_if_fail(INF_TEXT_IS_BUFFER(buffer), NULL);
+  g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+  g_return_val_if_fail(
+    strcmp(inf_text_buffer_get_encoding(buffer), "UTF-8") == 0,
+    NULL
+  );
+
+  journals = inf_text_filesystem_journal_list(storage, path, error);
+  if(journals == NULL)
+    return NULL;
+
+  result = inf_text_filesystem_journal_remove_files(
+    storage,
+    path,
+    journals,
+    error
+  );
+
+  if(result == TRUE)
+  {
+    result = inf_text_filesystem_journal_write_snapshot(
+      storage,
+      path,
+      user_table,
+      buffer,
+      INF_TEXT_FILESYSTEM_FORMAT_XML,
+      0,
+      error
+    );
+  }
+
+  journal = NULL;
+  if(result == TRUE)
+  {
+    g_array_set_size(journals, 0);
+
+    journal = inf_text_filesystem_journal_new(
+      io,
+      storage,
+      path,
+      user_table,
+      buffer,
+      0,
+      journals,
+      error
+    );
+  }
+
+  g_array_free(journals, TRUE);
+  return journal;
+}
+
+/**
+ * inf_text_filesystem_journal_get_path:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Returns the storage path of the document whose changes @journal records.
+ *
+ * Returns: The path of the document in the storage.
+ */
+const gchar*
+inf_text_filesystem_journal_get_path(InfTextFilesystemJournal* journal)
+{
+  g_return_val_if_fail(INF_TEXT_IS_FILESYSTEM_JOURNAL(journal), NULL);
+  return INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal)->path;
+}
+
+/**
+ * inf_text_filesystem_journal_get_sequence:
+ * @journal: A #InfTextFilesystemJournal.
+ *
+ * Returns the sequence number of the next entry written to the journal.
+ * Each insertion or deletion of a segment of text increases the sequence
+ * number by one.
+ *
+ * Returns: The sequence number of the next journal entry.
+ */
+gint64
+inf_text_filesystem_journal_get_sequence(InfTextFilesystemJournal* journal)
+{
+  g_return_val_if_fail(INF_TEXT_IS_FILESYSTEM_JOURNAL(journal), -1);
+  return INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal)->sequence;
+}
+
+/**
+ * inf_text_filesystem_journal_sync:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Writes all journal entries that have not yet been written to disk, and
+ * waits until they have been written. This is done automatically after
+ * #InfTextFilesystemJournal:sync-interval milliseconds, but this function
+ * can be used to make sure all changes are stored, for example when the
+ * document is saved.
+ *
+ * If writing the journal failed at some point, then this function returns
+ * %FALSE and changes made since then are not stored. In that case, a new
+ * journal should be started with inf_text_filesystem_journal_create().
+ *
+ * Returns: %TRUE on success or %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_sync(InfTextFilesystemJournal* journal,
+                                 GError** error)
+{
+  InfTextFilesystemJournalPrivate* priv;
+  GError* local_error;
+
+  g_return_val_if_fail(INF_TEXT_IS_FILESYSTEM_JOURNAL(journal), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  if(priv->sync_timeout != NULL)
+  {
+    inf_io_remove_timeout(priv->io, priv->sync_timeout);
+    priv->sync_timeout = NULL;
+  }
+
+  if(priv->error == NULL && priv->dirty)
+  {
+    local_error = NULL;
+    if(!inf_text_filesystem_journal_file_sync(priv->file, &local_error))
+      inf_text_filesystem_journal_failed(journal, local_error);
+    else
+      priv->dirty = FALSE;
+  }
+
+  if(priv->error != NULL)
+  {
+    g_propagate_error(error, g_error_copy(priv->error));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * inf_text_filesystem_journal_compact:
+ * @journal: A #InfTextFilesystemJournal.
+ * @error: Location to store error information, if any, or %NULL.
+ *
+ * Starts writing a new snapshot of the document in a background thread.
+ * Once the snapshot is written, the journal entries it contains are
+ * removed. Further changes are recorded in a new journal file in the
+ * meanwhile. This is done automatically once the journal has grown larger
+ * than #InfTextFilesystemJournal:compact-size bytes. If a compaction is
+ * running already, the function does nothing.
+ *
+ * Returns: %TRUE if the compaction was started or is running already, or
+ * %FALSE on error.
+ */
+gboolean
+inf_text_filesystem_journal_compact(InfTextFilesystemJournal* journal,
+                                    GError** error)
+{
+  InfTextFilesystemJournalPrivate* priv;
+
+  g_return_val_if_fail(INF_TEXT_IS_FILESYSTEM_JOURNAL(journal), FALSE);
+  g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+  priv = INF_TEXT_FILESYSTEM_JOURNAL_PRIVATE(journal);
+
+  if(priv->compaction != NULL)
+    return TRUE;
+
+  if(priv->error != NULL)
+  {
+    g_propagate_error(error, g_error_copy(priv->error));
+    return FALSE;
+  }
+
+  return inf_text_filesystem_journal_compact_impl(journal, error);
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,148 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+#ifndef __INF_TEXT_FILESYSTEM_JOURNAL_H__
+#define __INF_TEXT_FILESYSTEM_JOURNAL_H__
+
+#include <libinftext/inf-text-buffer.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-io.h>
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define INF_TEXT_TYPE_FILESYSTEM_JOURNAL                 (inf_text_filesystem_journal_get_type())
+#define INF_TEXT_FILESYSTEM_JOURNAL(obj)                 (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TEXT_TYPE_FILESYSTEM_JOURNAL, InfTextFilesystemJournal))
+#define INF_TEXT_FILESYSTEM_JOURNAL_CLASS(klass)         (G_TYPE_CHECK_CLASS_CAST((klass), INF_TEXT_TYPE_FILESYSTEM_JOURNAL, InfTextFilesystemJournalClass))
+#define INF_TEXT_IS_FILESYSTEM_JOURNAL(obj)              (G_TYPE_CHECK_INSTANCE_TYPE((obj), INF_TEXT_TYPE_FILESYSTEM_JOURNAL))
+#define INF_TEXT_IS_FILESYSTEM_JOURNAL_CLASS(klass)      (G_TYPE_CHECK_CLASS_TYPE((klass), INF_TEXT_TYPE_FILESYSTEM_JOURNAL))
+#define INF_TEXT_FILESYSTEM_JOURNAL_GET_CLASS(obj)       (G_TYPE_INSTANCE_GET_CLASS((obj), INF_TEXT_TYPE_FILESYSTEM_JOURNAL, InfTextFilesystemJournalClass))
+
+typedef struct _InfTextFilesystemJournal InfTextFilesystemJournal;
+typedef struct _InfTextFilesystemJournalClass InfTextFilesystemJournalClass;
+
+/**
+ * InfTextFilesystemJournalError:
+ * @INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY: An entry in a journal
+ * file cannot be applied to the document.
+ * @INF_TEXT_FILESYSTEM_JOURNAL_ERROR_MISSING_ENTRIES: Entries between the
+ * snapshot and a journal file, or between two journal files, are missing.
+ *
+ * Errors that can occur when recovering a text document from its snapshot
+ * and journal files.
+ */
+typedef enum _InfTextFilesystemJournalError {
+  INF_TEXT_FILESYSTEM_JOURNAL_ERROR_INVALID_ENTRY,
+  INF_TEXT_FILESYSTEM_JOURNAL_ERROR_MISSING_ENTRIES
+} InfTextFilesystemJournalError;
+
+/**
+ * InfTextFilesystemJournalClass:
+ *
+ * This structure does not contain any public fields.
+ */
+struct _InfTextFilesystemJournalClass {
+  /*< private >*/
+  GObjectClass parent_class;
+};
+
+/**
+ * InfTextFilesystemJournal:
+ *
+ * #InfTextFilesystemJournal is an opaque data type. You should only access
+ * it via the public API functions.
+ */
+struct _InfTextFilesystemJournal {
+  /*< private >*/
+  GObject parent;
+};
+
+/**
+ * InfTextFilesystemJournalRecoverFunc:
+ * @user_table: The user table of the recovered document, or %NULL on error.
+ * @buffer: The buffer of the recovered document, or %NULL on error.
+ * @error: Error information in case the document could not be recovered, or
+ * %NULL.
+ * @user_data: User-defined data specified in
+ * inf_text_filesystem_journal_recover_async().
+ *
+ * Callback function that is called with the result of
+ * inf_text_filesystem_journal_recover_async().
+ */
+typedef void(*InfTextFilesystemJournalRecoverFunc)(InfUserTable* user_table,
+                                                   InfTextBuffer* buffer,
+                                                   const GError* error,
+                                                   gpointer user_data);
+
+GType
+inf_text_filesystem_journal_get_type(void) G_GNUC_CONST;
+
+gboolean
+inf_text_filesystem_journal_recover(InfdFilesystemStorage* storage,
+                                    const gchar* path,
+                                    InfUserTable* user_table,
+                                    InfTextBuffer* buffer,
+                                    gint64* sequence,
+                                    GError** error);
+
+void
+inf_text_filesystem_journal_recover_async(
+  InfdFilesystemStorage* storage,
+  const gchar* path,
+  InfIo* io,
+  InfTextFilesystemJournalRecoverFunc func,
+  gpointer user_data);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_open(InfIo* io,
+                                 InfdFilesystemStorage* storage,
+                                 const gchar* path,
+                                 InfUserTable* user_table,
+                                 InfTextBuffer* buffer,
+                                 GError** error);
+
+InfTextFilesystemJournal*
+inf_text_filesystem_journal_create(InfIo* io,
+                                   InfdFilesystemStorage* storage,
+                                   const gchar* path,
+                                   InfUserTable* user_table,
+                                   InfTextBuffer* buffer,
+                                   GError** error);
+
+const gchar*
+inf_text_filesystem_journal_get_path(InfTextFilesystemJournal* journal);
+
+gint64
+inf_text_filesystem_journal_get_sequence(InfTextFilesystemJournal* journal);
+
+gboolean
+inf_text_filesystem_journal_sync(InfTextFilesystemJournal* journal,
+                                 GError** error);
+
+gboolean
+inf_text_filesystem_journal_compact(InfTextFilesystemJournal* journal,
+                                    GError** error);
+
+G_END_DECLS
+
+#endif /* __INF_TEXT_FILESYSTEM_JOURNAL_H__ */
+
+/* vim:set et sw=2 ts=2: */
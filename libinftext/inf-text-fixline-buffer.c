@@ -1787,6 +1787,8 @@ inf_text_fixline_buffer_text_buffer_iface_init(InfTextBufferInterface* iface)
   iface->get_slice = inf_text_fixline_buffer_buffer_get_slice;
   iface->insert_text = inf_text_fixline_buffer_buffer_insert_text;
   iface->erase_text = inf_text_fixline_buffer_buffer_erase_text;
+  iface->append = NULL;
+  iface->clear = NULL;
   iface->create_begin_iter = inf_text_fixline_buffer_buffer_create_begin_iter;
   iface->create_end_iter = inf_text_fixline_buffer_buffer_create_end_iter;
   iface->destroy_iter = inf_text_fixline_buffer_buffer_destroy_iter;
@@ -28,6 +28,8 @@
 #include <libinftext/inf-text-user.h>
 #include <libinfinity/adopted/inf-adopted-no-operation.h>
 #include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-xml-blob.h>
+#include <libinfinity/common/inf-binary-util.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/inf-i18n.h>
 #include <libinfinity/inf-signals.h>
@@ -47,10 +49,29 @@ struct _InfTextSessionLocalUser {
   InfIoTimeout* caret_timeout;
 };
 
+/* The sync-segment messages for the buffer content at a given state, shared
+ * by the synchronizations that start while the buffer is in that state */
+typedef struct _InfTextSessionSyncSegments InfTextSessionSyncSegments;
+struct _InfTextSessionSyncSegments {
+  guint ref_count;
+  InfTextSession* session; /* NULL if no longer the session's segments */
+  InfAdoptedStateVector* vector;
+  GPtrArray* blobs;
+};
+
+typedef struct _InfTextSessionSyncSegmentsStep InfTextSessionSyncSegmentsStep;
+struct _InfTextSessionSyncSegmentsStep {
+  InfTextSessionSyncSegments* segments;
+  guint pos;
+};
+
 typedef struct _InfTextSessionPrivate InfTextSessionPrivate;
 struct _InfTextSessionPrivate {
   guint caret_update_interval;
   GSList* local_users;
+
+  /* Not referenced by the session itself */
+  InfTextSessionSyncSegments* sync_segments;
 };
 
 enum {
@@ -76,6 +97,14 @@ struct _InfTextSessionEraseForeachData {
   InfUser* user;
 };
 
+/* Identifies the operation of a Do request in binary form */
+typedef enum _InfTextSessionBinaryOperation {
+  INF_TEXT_SESSION_BINARY_INSERT,
+  INF_TEXT_SESSION_BINARY_DELETE,
+  INF_TEXT_SESSION_BINARY_MOVE,
+  INF_TEXT_SESSION_BINARY_NO_OP
+} InfTextSessionBinaryOperation;
+
 #define INF_TEXT_SESSION_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), INF_TEXT_TYPE_SESSION, InfTextSessionPrivate))
 
 static GQuark inf_text_session_error_quark;
@@ -741,6 +770,7 @@ inf_text_session_init(InfTextSession* session)
   priv = INF_TEXT_SESSION_PRIVATE(session);
 
   priv->caret_update_interval = 500;
+  priv->sync_segments = NULL;
 }
 
 static void
@@ -815,6 +845,12 @@ inf_text_session_dispose(GObject* object)
     );
   }
 
+  if(priv->sync_segments != NULL)
+  {
+    priv->sync_segments->session = NULL;
+    priv->sync_segments = NULL;
+  }
+
   inf_signal_handlers_disconnect_by_func(
     G_OBJECT(buffer),
     G_CALLBACK(inf_text_session_buffer_text_inserted_cb),
@@ -976,8 +1012,8 @@ inf_text_session_handle_user_color_change(InfTextSession* session,
  */
 
 static void
-inf_text_session_to_xml_sync(InfSession* session,
-                             xmlNodePtr parent)
+inf_text_session_to_xml_sync_segments(InfSession* session,
+                                      xmlNodePtr parent)
 {
   InfTextBuffer* buffer;
   InfTextBufferIter* iter;
@@ -989,11 +1025,6 @@ inf_text_session_to_xml_sync(InfSession* session,
   gsize bytes_left;
   GIConv cd;
 
-  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
-    session,
-    parent
-  );
-
   buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
   cd = g_iconv_open("UTF-8", inf_text_buffer_get_encoding(buffer));
 
@@ -1030,6 +1061,158 @@ inf_text_session_to_xml_sync(InfSession* session,
   g_iconv_close(cd);
 }
 
+static void
+inf_text_session_to_xml_sync(InfSession* session,
+                             xmlNodePtr parent)
+{
+  INF_SESSION_CLASS(inf_text_session_parent_class)->to_xml_sync(
+    session,
+    parent
+  );
+
+  inf_text_session_to_xml_sync_segments(session, parent);
+}
+
+static void
+inf_text_session_sync_segments_unref(InfTextSessionSyncSegments* segments)
+{
+  InfTextSessionPrivate* priv;
+  guint i;
+
+  if(-- segments->ref_count > 0)
+    return;
+
+  if(segments->session != NULL)
+  {
+    priv = INF_TEXT_SESSION_PRIVATE(segments->session);
+    g_assert(priv->sync_segments == segments);
+    priv->sync_segments = NULL;
+  }
+
+  for(i = 0; i < segments->blobs->len; ++ i)
+    inf_xml_blob_unref(g_ptr_array_index(segments->blobs, i));
+
+  g_ptr_array_free(segments->blobs, TRUE);
+  inf_adopted_state_vector_free(segments->vector);
+  g_slice_free(InfTextSessionSyncSegments, segments);
+}
+
+/* Returns the sync-segment messages for the current buffer content. Every
+ * change to the buffer goes through the algorithm, so segments made at the
+ * current state of the algorithm are still up to date. */
+static InfTextSessionSyncSegments*
+inf_text_session_sync_segments_get(InfTextSession* session)
+{
+  InfTextSessionPrivate* priv;
+  InfTextSessionSyncSegments* segments;
+  InfAdoptedStateVector* current;
+  xmlNodePtr container;
+  xmlNodePtr child;
+
+  priv = INF_TEXT_SESSION_PRIVATE(session);
+  current = inf_adopted_algorithm_get_current(
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(session))
+  );
+
+  segments = priv->sync_segments;
+  if(segments != NULL)
+  {
+    if(inf_adopted_state_vector_compare(segments->vector, current) == 0)
+    {
+      ++ segments->ref_count;
+      return segments;
+    }
+
+    /* Outdated; the synchronizations using it keep it alive */
+    segments->session = NULL;
+  }
+
+  container = xmlNewNode(NULL, (const xmlChar*)"sync-container");
+  inf_text_session_to_xml_sync_segments(INF_SESSION(session), container);
+
+  segments = g_slice_new(InfTextSessionSyncSegments);
+  segments->ref_count = 1;
+  segments->session = session;
+  segments->vector = inf_adopted_state_vector_copy(current);
+  segments->blobs = g_ptr_array_new();
+
+  while(container->children != NULL)
+  {
+    child = container->children;
+    xmlUnlinkNode(child);
+    g_ptr_array_add(segments->blobs, inf_xml_blob_new(child));
+  }
+
+  xmlFreeNode(container);
+
+  priv->sync_segments = segments;
+  return segments;
+}
+
+static void
+inf_text_session_sync_segments_func(InfSession* session,
+                                    xmlNodePtr parent,
+                                    guint n_messages,
+                                    gpointer user_data)
+{
+  InfTextSessionSyncSegmentsStep* step;
+  guint i;
+
+  step = (InfTextSessionSyncSegmentsStep*)user_data;
+
+  for(i = 0; i < n_messages; ++ i)
+  {
+    g_assert(step->pos < step->segments->blobs->len);
+
+    xmlAddChild(
+      parent,
+      inf_xml_blob_reference_new(
+        g_ptr_array_index(step->segments->blobs, step->pos)
+      )
+    );
+
+    ++ step->pos;
+  }
+}
+
+static void
+inf_text_session_sync_segments_free(gpointer user_data)
+{
+  InfTextSessionSyncSegmentsStep* step;
+  step = (InfTextSessionSyncSegmentsStep*)user_data;
+
+  inf_text_session_sync_segments_unref(step->segments);
+  g_slice_free(InfTextSessionSyncSegmentsStep, step);
+}
+
+static void
+inf_text_session_init_sync_generator(InfSession* session,
+                                     InfSessionSyncGenerator* generator)
+{
+  InfSessionClass* parent_class;
+  InfTextSessionSyncSegmentsStep* step;
+
+  parent_class = INF_SESSION_CLASS(inf_text_session_parent_class);
+  parent_class->init_sync_generator(session, generator);
+
+  /* The segments are created right away, since they need to be taken from
+   * the buffer as it is now. This costs about as much memory as a copy of
+   * the buffer content would, but it is shared with all other
+   * synchronizations that start before the buffer changes. */
+  step = g_slice_new(InfTextSessionSyncSegmentsStep);
+  step->segments =
+    inf_text_session_sync_segments_get(INF_TEXT_SESSION(session));
+  step->pos = 0;
+
+  inf_session_sync_generator_add_step(
+    generator,
+    step->segments->blobs->len,
+    inf_text_session_sync_segments_func,
+    step,
+    inf_text_session_sync_segments_free
+  );
+}
+
 static gboolean
 inf_text_session_process_xml_sync(InfSession* session,
                                   InfXmlConnection* connection,
@@ -1747,6 +1930,226 @@ fail:
   return NULL;
 }
 
+/* Binary requests carry the same information as the XML requests written by
+ * inf_text_session_request_to_xml() with for_sync set to FALSE, with the
+ * inserted text in UTF-8. */
+static void
+inf_text_session_operation_to_binary(InfAdoptedSession* session,
+                                     InfAdoptedOperation* operation,
+                                     GByteArray* data)
+{
+  InfTextChunk* chunk;
+  InfTextChunkIter iter;
+  gboolean result;
+
+  gchar* utf8_text;
+  gsize bytes_read;
+  gsize bytes_written;
+
+  if(INF_TEXT_IS_INSERT_OPERATION(operation))
+  {
+    inf_binary_util_write_uint(data, INF_TEXT_SESSION_BINARY_INSERT);
+
+    inf_binary_util_write_uint(
+      data,
+      inf_text_insert_operation_get_position(
+        INF_TEXT_INSERT_OPERATION(operation)
+      )
+    );
+
+    /* Must be default insert operation so we get the inserted text */
+    g_assert(INF_TEXT_IS_DEFAULT_INSERT_OPERATION(operation));
+
+    chunk = inf_text_default_insert_operation_get_chunk(
+      INF_TEXT_DEFAULT_INSERT_OPERATION(operation)
+    );
+
+    result = inf_text_chunk_iter_init_begin(chunk, &iter);
+    g_assert(result == TRUE);
+
+    if(g_ascii_strcasecmp(inf_text_chunk_get_encoding(chunk), "UTF-8") == 0)
+    {
+      inf_binary_util_write_string(
+        data,
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter)
+      );
+    }
+    else
+    {
+      utf8_text = g_convert(
+        inf_text_chunk_iter_get_text(&iter),
+        inf_text_chunk_iter_get_bytes(&iter),
+        "UTF-8",
+        inf_text_chunk_get_encoding(chunk),
+        &bytes_read,
+        &bytes_written,
+        NULL
+      );
+
+      /* Conversion to UTF-8 should always succeed */
+      g_assert(utf8_text != NULL);
+      g_assert(bytes_read == inf_text_chunk_iter_get_bytes(&iter));
+
+      inf_binary_util_write_string(data, utf8_text, bytes_written);
+      g_free(utf8_text);
+    }
+
+    /* The whole inserted text must be written by a single user */
+    g_assert(inf_text_chunk_iter_next(&iter) == FALSE);
+  }
+  else if(INF_TEXT_IS_DELETE_OPERATION(operation))
+  {
+    /* The other site generates a InfTextRemoteDeleteOperation, as for
+     * XML requests. */
+    inf_binary_util_write_uint(data, INF_TEXT_SESSION_BINARY_DELETE);
+
+    inf_binary_util_write_uint(
+      data,
+      inf_text_delete_operation_get_position(
+        INF_TEXT_DELETE_OPERATION(operation)
+      )
+    );
+
+    inf_binary_util_write_uint(
+      data,
+      inf_text_delete_operation_get_length(
+        INF_TEXT_DELETE_OPERATION(operation)
+      )
+    );
+  }
+  else if(INF_TEXT_IS_MOVE_OPERATION(operation))
+  {
+    inf_binary_util_write_uint(data, INF_TEXT_SESSION_BINARY_MOVE);
+
+    inf_binary_util_write_uint(
+      data,
+      inf_text_move_operation_get_position(INF_TEXT_MOVE_OPERATION(operation))
+    );
+
+    inf_binary_util_write_int(
+      data,
+      inf_text_move_operation_get_length(INF_TEXT_MOVE_OPERATION(operation))
+    );
+  }
+  else if(INF_ADOPTED_IS_NO_OPERATION(operation))
+  {
+    inf_binary_util_write_uint(data, INF_TEXT_SESSION_BINARY_NO_OP);
+  }
+  else
+  {
+    g_assert_not_reached();
+  }
+}
+
+static InfAdoptedOperation*
+inf_text_session_binary_to_operation(InfAdoptedSession* session,
+                                     guint user_id,
+                                     const guchar** data,
+                                     const guchar* end,
+                                     GError** error)
+{
+  InfTextBuffer* buffer;
+  const gchar* encoding;
+  InfTextChunk* chunk;
+  InfAdoptedOperation* operation;
+  guint type;
+  guint pos;
+  guint length;
+  gint selection;
+
+  const gchar* utf8_text;
+  gsize in_bytes;
+  gchar* text;
+  gsize bytes;
+
+  if(!inf_binary_util_read_uint(data, end, &type, error))
+    return NULL;
+
+  switch(type)
+  {
+  case INF_TEXT_SESSION_BINARY_INSERT:
+    if(!inf_binary_util_read_uint(data, end, &pos, error))
+      return NULL;
+
+    utf8_text = inf_binary_util_read_utf8(data, end, &in_bytes, &length, error);
+    if(utf8_text == NULL)
+      return NULL;
+
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(INF_SESSION(session)));
+    encoding = inf_text_buffer_get_encoding(buffer);
+    chunk = inf_text_chunk_new(encoding);
+
+    if(g_ascii_strcasecmp(encoding, "UTF-8") == 0)
+    {
+      inf_text_chunk_insert_text(
+        chunk,
+        0,
+        utf8_text,
+        in_bytes,
+        length,
+        user_id
+      );
+    }
+    else
+    {
+      text = g_convert(
+        utf8_text,
+        in_bytes,
+        encoding,
+        "UTF-8",
+        NULL,
+        &bytes,
+        error
+      );
+
+      if(text == NULL)
+      {
+        inf_text_chunk_free(chunk);
+        return NULL;
+      }
+
+      inf_text_chunk_insert_text(chunk, 0, text, bytes, length, user_id);
+      g_free(text);
+    }
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(pos, chunk)
+    );
+
+    inf_text_chunk_free(chunk);
+    return operation;
+  case INF_TEXT_SESSION_BINARY_DELETE:
+    if(!inf_binary_util_read_uint(data, end, &pos, error))
+      return NULL;
+    if(!inf_binary_util_read_uint(data, end, &length, error))
+      return NULL;
+
+    return INF_ADOPTED_OPERATION(
+      inf_text_remote_delete_operation_new(pos, length)
+    );
+  case INF_TEXT_SESSION_BINARY_MOVE:
+    if(!inf_binary_util_read_uint(data, end, &pos, error))
+      return NULL;
+    if(!inf_binary_util_read_int(data, end, &selection, error))
+      return NULL;
+
+    return INF_ADOPTED_OPERATION(inf_text_move_operation_new(pos, selection));
+  case INF_TEXT_SESSION_BINARY_NO_OP:
+    return INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
+  default:
+    g_set_error(
+      error,
+      inf_adopted_session_error_quark(),
+      INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST,
+      _("Unknown operation type %u in binary request"),
+      type
+    );
+
+    return NULL;
+  }
+}
+
 /*
  * Gype registration.
  */
@@ -1769,6 +2172,7 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
   object_class->get_property = inf_text_session_get_property;
 
   session_class->to_xml_sync = inf_text_session_to_xml_sync;
+  session_class->init_sync_generator = inf_text_session_init_sync_generator;
   session_class->process_xml_sync = inf_text_session_process_xml_sync;
   session_class->process_xml_run = inf_text_session_process_xml_run;
   session_class->get_xml_user_props = inf_text_session_get_xml_user_props;
@@ -1780,6 +2184,10 @@ inf_text_session_class_init(InfTextSessionClass* text_session_class)
 
   adopted_session_class->xml_to_request = inf_text_session_xml_to_request;
   adopted_session_class->request_to_xml = inf_text_session_request_to_xml;
+  adopted_session_class->operation_to_binary =
+    inf_text_session_operation_to_binary;
+  adopted_session_class->binary_to_operation =
+    inf_text_session_binary_to_operation;
 
   inf_text_session_error_quark = g_quark_from_static_string(
     "INF_TEXT_SESSION_ERROR"
@@ -0,0 +1,388 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the cost of fanning out a single group message to a growing
+ * number of subscribers, by broadcasting messages to an
+ * InfCommunicationHostedGroup with simulated members. The members serialize
+ * every message the same way InfXmppConnection does. The test runs once
+ * with members which accept InfXmlBlob references, so that a message is
+ * serialized only once for all of them, and once with members which do not,
+ * so that the message is copied and serialized for every member, which is
+ * what broadcasts used to do. */
+
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/communication/inf-communication-hosted-group.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-xml-blob.h>
+#include <libinfinity/common/inf-xml-util.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const guint INF_TEST_BROADCAST_SUBSCRIBERS[] = { 1, 10, 100, 1000 };
+static const guint INF_TEST_BROADCAST_MESSAGES = 200;
+
+/* A connection which serializes what it is asked to send, and then drops
+ * it. It reports every message as sent right away. */
+#define INF_TEST_TYPE_BROADCAST_CONNECTION \
+  (inf_test_broadcast_connection_get_type())
+#define INF_TEST_BROADCAST_CONNECTION(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), INF_TEST_TYPE_BROADCAST_CONNECTION, \
+                              InfTestBroadcastConnection))
+
+typedef struct _InfTestBroadcastConnection InfTestBroadcastConnection;
+struct _InfTestBroadcastConnection {
+  GObject parent;
+
+  gboolean accepts_blob_references;
+  gchar* remote_id;
+  xmlBufferPtr buffer;
+
+  /* The first message sent, as it would go over the wire */
+  xmlBufferPtr first;
+};
+
+typedef struct _InfTestBroadcastConnectionClass
+  InfTestBroadcastConnectionClass;
+struct _InfTestBroadcastConnectionClass {
+  GObjectClass parent_class;
+};
+
+enum {
+  PROP_0,
+
+  PROP_STATUS,
+  PROP_NETWORK,
+  PROP_LOCAL_ID,
+  PROP_REMOTE_ID,
+  PROP_LOCAL_CERTIFICATE,
+  PROP_REMOTE_CERTIFICATE
+};
+
+GType inf_test_broadcast_connection_get_type(void) G_GNUC_CONST;
+static void inf_test_broadcast_connection_xml_connection_iface_init(
+  InfXmlConnectionInterface* iface);
+G_DEFINE_TYPE_WITH_CODE(InfTestBroadcastConnection, inf_test_broadcast_connection, G_TYPE_OBJECT,
+  G_IMPLEMENT_INTERFACE(INF_TYPE_XML_CONNECTION, inf_test_broadcast_connection_xml_connection_iface_init))
+
+static void
+inf_test_broadcast_connection_init(InfTestBroadcastConnection* connection)
+{
+  connection->accepts_blob_references = FALSE;
+  connection->remote_id = NULL;
+  connection->buffer = xmlBufferCreate();
+  connection->first = NULL;
+}
+
+static void
+inf_test_broadcast_connection_finalize(GObject* object)
+{
+  InfTestBroadcastConnection* connection;
+  connection = INF_TEST_BROADCAST_CONNECTION(object);
+
+  g_free(connection->remote_id);
+  xmlBufferFree(connection->buffer);
+  if(connection->first != NULL)
+    xmlBufferFree(connection->first);
+
+  G_OBJECT_CLASS(inf_test_broadcast_connection_parent_class)->finalize(
+    object
+  );
+}
+
+static void
+inf_test_broadcast_connection_set_property(GObject* object,
+                                           guint prop_id,
+                                           const GValue* value,
+                                           GParamSpec* pspec)
+{
+  /* All properties are read-only */
+  G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+}
+
+static void
+inf_test_broadcast_connection_get_property(GObject* object,
+                                           guint prop_id,
+                                           GValue* value,
+                                           GParamSpec* pspec)
+{
+  InfTestBroadcastConnection* connection;
+  connection = INF_TEST_BROADCAST_CONNECTION(object);
+
+  switch(prop_id)
+  {
+  case PROP_STATUS:
+    g_value_set_enum(value, INF_XML_CONNECTION_OPEN);
+    break;
+  case PROP_NETWORK:
+    g_value_set_static_string(value, "local");
+    break;
+  case PROP_LOCAL_ID:
+    g_value_set_static_string(value, "publisher");
+    break;
+  case PROP_REMOTE_ID:
+    g_value_set_string(value, connection->remote_id);
+    break;
+  case PROP_LOCAL_CERTIFICATE:
+    g_value_set_pointer(value, NULL);
+    break;
+  case PROP_REMOTE_CERTIFICATE:
+    g_value_set_boxed(value, NULL);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+}
+
+static void
+inf_test_broadcast_connection_class_init(
+  InfTestBroadcastConnectionClass* connection_class)
+{
+  GObjectClass* object_class;
+  object_class = G_OBJECT_CLASS(connection_class);
+
+  object_class->finalize = inf_test_broadcast_connection_finalize;
+  object_class->set_property = inf_test_broadcast_connection_set_property;
+  object_class->get_property = inf_test_broadcast_connection_get_property;
+
+  g_object_class_override_property(object_class, PROP_STATUS, "status");
+  g_object_class_override_property(object_class, PROP_NETWORK, "network");
+  g_object_class_override_property(object_class, PROP_LOCAL_ID, "local-id");
+  g_object_class_override_property(object_class, PROP_REMOTE_ID, "remote-id");
+
+  g_object_class_override_property(
+    object_class,
+    PROP_LOCAL_CERTIFICATE,
+    "local-certificate"
+  );
+
+  g_object_class_override_property(
+    object_class,
+    PROP_REMOTE_CERTIFICATE,
+    "remote-certificate"
+  );
+}
+
+static void
+inf_test_broadcast_connection_send(InfXmlConnection* xml_connection,
+                                   xmlNodePtr xml)
+{
+  InfTestBroadcastConnection* connection;
+  connection = INF_TEST_BROADCAST_CONNECTION(xml_connection);
+
+  /* This is what InfXmppConnection does with the message */
+  inf_xml_blob_dump(connection->buffer, NULL, xml);
+
+  if(connection->first == NULL)
+  {
+    connection->first = xmlBufferCreate();
+
+    xmlBufferAdd(
+      connection->first,
+      xmlBufferContent(connection->buffer),
+      xmlBufferLength(connection->buffer)
+    );
+  }
+
+  xmlBufferEmpty(connection->buffer);
+
+  inf_xml_connection_sent(xml_connection, xml);
+  inf_xml_blob_release_references(xml);
+  xmlFreeNode(xml);
+}
+
+static gboolean
+inf_test_broadcast_connection_accepts_blob_references(
+  InfXmlConnection* xml_connection)
+{
+  InfTestBroadcastConnection* connection;
+  connection = INF_TEST_BROADCAST_CONNECTION(xml_connection);
+
+  return connection->accepts_blob_references;
+}
+
+static void
+inf_test_broadcast_connection_xml_connection_iface_init(
+  InfXmlConnectionInterface* iface)
+{
+  iface->send = inf_test_broadcast_connection_send;
+  iface->accepts_blob_references =
+    inf_test_broadcast_connection_accepts_blob_references;
+}
+
+static xmlNodePtr
+inf_test_broadcast_make_message(void)
+{
+  xmlNodePtr request;
+  xmlNodePtr operation;
+  guint i;
+
+  request = xmlNewNode(NULL, (const xmlChar*)"request");
+  inf_xml_util_set_attribute(request, "user", "3");
+  inf_xml_util_set_attribute(request, "time", "1:1043;2:817;4:22;7:5");
+
+  operation = xmlNewChild(request, NULL, (const xmlChar*)"insert-caret", NULL);
+  inf_xml_util_set_attribute_uint(operation, "pos", 18231);
+
+  for(i = 0; i < 4; ++i)
+    inf_xml_util_add_child_text(operation, "Hello <World> & ", 16);
+
+  return request;
+}
+
+/* Broadcasts the message to a group with the given number of members, and
+ * stores what the first member got for its first message in check. */
+static gdouble
+inf_test_broadcast_run(xmlNodePtr message,
+                       guint subscribers,
+                       gboolean accepts_blob_references,
+                       xmlBufferPtr check)
+{
+  InfCommunicationManager* manager;
+  InfCommunicationHostedGroup* group;
+  InfTestBroadcastConnection** connections;
+  GTimer* timer;
+  gdouble elapsed;
+  guint i;
+
+  manager = inf_communication_manager_new();
+  group = inf_communication_manager_open_group(
+    manager,
+    "InfTestBroadcast",
+    NULL
+  );
+
+  connections = g_malloc(sizeof(InfTestBroadcastConnection*) * subscribers);
+  for(i = 0; i < subscribers; ++i)
+  {
+    connections[i] = g_object_new(INF_TEST_TYPE_BROADCAST_CONNECTION, NULL);
+    connections[i]->accepts_blob_references = accepts_blob_references;
+    connections[i]->remote_id = g_strdup_printf("subscriber_%u", i);
+
+    inf_communication_hosted_group_add_member(
+      group,
+      INF_XML_CONNECTION(connections[i])
+    );
+  }
+
+  timer = g_timer_new();
+
+  for(i = 0; i < INF_TEST_BROADCAST_MESSAGES; ++i)
+  {
+    inf_communication_group_send_group_message(
+      INF_COMMUNICATION_GROUP(group),
+      xmlCopyNode(message, 1)
+    );
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  g_assert(connections[0]->first != NULL);
+  xmlBufferAdd(
+    check,
+    xmlBufferContent(connections[0]->first),
+    xmlBufferLength(connections[0]->first)
+  );
+
+  for(i = 0; i < subscribers; ++i)
+  {
+    inf_communication_hosted_group_remove_member(
+      group,
+      INF_XML_CONNECTION(connections[i])
+    );
+
+    g_object_unref(connections[i]);
+  }
+
+  g_free(connections);
+  g_object_unref(group);
+  g_object_unref(manager);
+  return elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+  xmlNodePtr message;
+  xmlBufferPtr copy_check;
+  xmlBufferPtr blob_check;
+  gdouble copy_time;
+  gdouble blob_time;
+  guint i;
+  int result;
+
+  message = inf_test_broadcast_make_message();
+  result = 0;
+
+  printf("%12s %14s %14s %8s\n", "subscribers", "copy [us/msg]", "blob [us/msg]",
+         "speedup");
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_BROADCAST_SUBSCRIBERS); ++i)
+  {
+    copy_check = xmlBufferCreate();
+    blob_check = xmlBufferCreate();
+
+    copy_time = inf_test_broadcast_run(
+      message,
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      FALSE,
+      copy_check
+    );
+
+    blob_time = inf_test_broadcast_run(
+      message,
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      TRUE,
+      blob_check
+    );
+
+    /* Both ways must put the very same bytes on the wire */
+    if(xmlBufferLength(copy_check) != xmlBufferLength(blob_check) ||
+       memcmp(xmlBufferContent(copy_check), xmlBufferContent(blob_check),
+              xmlBufferLength(copy_check)) != 0)
+    {
+      fprintf(
+        stderr,
+        "Serialization mismatch:\n%s\n%s\n",
+        (const char*)xmlBufferContent(copy_check),
+        (const char*)xmlBufferContent(blob_check)
+      );
+
+      result = 1;
+    }
+
+    printf(
+      "%12u %14.2f %14.2f %7.2fx\n",
+      INF_TEST_BROADCAST_SUBSCRIBERS[i],
+      copy_time * 1e6 / INF_TEST_BROADCAST_MESSAGES,
+      blob_time * 1e6 / INF_TEST_BROADCAST_MESSAGES,
+      blob_time > 0.0 ? copy_time / blob_time : 0.0
+    );
+
+    xmlBufferFree(copy_check);
+    xmlBufferFree(blob_check);
+  }
+
+  xmlFreeNode(message);
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,231 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Replays session records and reports how long it takes and how many
+ * memory allocations are made while doing so. Text chunks are copied,
+ * split and merged all the time while transforming and applying requests,
+ * so this mostly measures the cost of InfTextChunk. Build it against
+ * different revisions of libinftext to compare them. If no record files
+ * are given, all records in the replay/ directory are replayed. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/adopted/inf-adopted-session-replay.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+/* Count allocations by interposing the malloc family. With G_SLICE set to
+ * always-malloc this also covers the slice allocator. */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static guint64 inf_test_chunk_replay_allocations;
+
+void*
+malloc(size_t size)
+{
+  ++ inf_test_chunk_replay_allocations;
+  return __libc_malloc(size);
+}
+
+void*
+calloc(size_t nmemb,
+       size_t size)
+{
+  ++ inf_test_chunk_replay_allocations;
+  return __libc_calloc(nmemb, size);
+}
+
+void*
+realloc(void* ptr,
+        size_t size)
+{
+  ++ inf_test_chunk_replay_allocations;
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+static InfSession*
+inf_test_chunk_replay_session_new(InfIo* io,
+                                  InfCommunicationManager* manager,
+                                  InfSessionStatus status,
+                                  InfCommunicationGroup* sync_group,
+                                  InfXmlConnection* sync_connection,
+                                  const gchar* path,
+                                  gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static const InfcNotePlugin INF_TEST_CHUNK_REPLAY_TEXT_PLUGIN = {
+  NULL, "InfText", inf_test_chunk_replay_session_new
+};
+
+static gboolean
+inf_test_chunk_replay_file(const gchar* filename,
+                           gdouble* elapsed,
+                           guint64* allocations,
+                           GError** error)
+{
+  InfAdoptedSessionReplay* replay;
+  GTimer* timer;
+  gboolean result;
+
+  replay = inf_adopted_session_replay_new();
+  timer = g_timer_new();
+
+#ifdef __GLIBC__
+  inf_test_chunk_replay_allocations = 0;
+#endif
+
+  result = inf_adopted_session_replay_set_record(
+    replay,
+    filename,
+    &INF_TEST_CHUNK_REPLAY_TEXT_PLUGIN,
+    error
+  );
+
+  if(result == TRUE)
+    result = inf_adopted_session_replay_play_to_end(replay, error);
+
+  g_object_unref(replay);
+
+  *elapsed = g_timer_elapsed(timer, NULL);
+#ifdef __GLIBC__
+  *allocations = inf_test_chunk_replay_allocations;
+#else
+  *allocations = 0;
+#endif
+
+  g_timer_destroy(timer);
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GPtrArray* files;
+  GDir* dir;
+  const gchar* name;
+  GError* error;
+  gdouble elapsed;
+  guint64 allocations;
+  gdouble total_elapsed;
+  guint64 total_allocations;
+  guint i;
+  int ret;
+
+  /* Must be set before the slice allocator is used for the first time */
+  g_setenv("G_SLICE", "always-malloc", TRUE);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+
+  files = g_ptr_array_new_with_free_func(g_free);
+  if(argc > 1)
+  {
+    for(i = 1; i < (guint)argc; ++i)
+      g_ptr_array_add(files, g_strdup(argv[i]));
+  }
+  else
+  {
+    dir = g_dir_open(REPLAY_DIR, 0, &error);
+    if(dir == NULL)
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      g_ptr_array_free(files, TRUE);
+      return -1;
+    }
+
+    while((name = g_dir_read_name(dir)) != NULL)
+      if(g_str_has_suffix(name, ".record.xml"))
+        g_ptr_array_add(files, g_build_filename(REPLAY_DIR, name, NULL));
+
+    g_dir_close(dir);
+  }
+
+  ret = 0;
+  total_elapsed = 0.0;
+  total_allocations = 0;
+
+  printf("%-40s %12s %14s\n", "record", "time [ms]", "allocations");
+
+  for(i = 0; i < files->len; ++i)
+  {
+    name = g_ptr_array_index(files, i);
+
+    if(!inf_test_chunk_replay_file(name, &elapsed, &allocations, &error))
+    {
+      fprintf(stderr, "%s: %s\n", name, error->message);
+      g_error_free(error);
+      error = NULL;
+
+      ret = -1;
+    }
+    else
+    {
+      printf(
+        "%-40s %12.2f %14" G_GUINT64_FORMAT "\n",
+        strrchr(name, G_DIR_SEPARATOR) != NULL ?
+          strrchr(name, G_DIR_SEPARATOR) + 1 : name,
+        elapsed * 1000.0,
+        allocations
+      );
+
+      total_elapsed += elapsed;
+      total_allocations += allocations;
+    }
+  }
+
+  printf(
+    "%-40s %12.2f %14" G_GUINT64_FORMAT "\n",
+    "total",
+    total_elapsed * 1000.0,
+    total_allocations
+  );
+
+  g_ptr_array_free(files, TRUE);
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -19,10 +19,19 @@
 
 #include <libinftext/inf-text-chunk.h>
 
+#include <string.h>
+
 int main()
 {
   InfTextChunk* chunk;
   InfTextChunk* chunk2;
+  InfTextChunk* chunk3;
+  gpointer text;
+  gsize bytes;
+  InfTextChunkIter iter;
+  guint offset;
+  guint i;
+  int result;
 
   chunk2 = inf_text_chunk_new("UTF-8");
 
@@ -33,7 +42,56 @@ int main()
   chunk = inf_text_chunk_substring(chunk2, 0, 3);
 
   inf_text_chunk_free(chunk);
+
+  /* Copies and substrings share text with the original. Modifying one of
+   * them must not affect the others. */
+  chunk = inf_text_chunk_copy(chunk2);
+  chunk3 = inf_text_chunk_substring(chunk2, 1, 3);
+
+  inf_text_chunk_insert_text(chunk, 1, "d", 1, 1, 501);
+  inf_text_chunk_erase(chunk3, 0, 1);
+  inf_text_chunk_insert_text(chunk2, 4, "e", 1, 1, 503);
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  result = bytes != 6 || memcmp(text, "cdba\xc3\xbc", 6) != 0;
+  g_free(text);
+
+  text = inf_text_chunk_get_text(chunk2, &bytes);
+  result = result || bytes != 6 || memcmp(text, "cba\xc3\xbc" "e", 6) != 0;
+  g_free(text);
+
+  text = inf_text_chunk_get_text(chunk3, &bytes);
+  result = result || bytes != 3 || memcmp(text, "a\xc3\xbc", 3) != 0;
+  g_free(text);
+
+  inf_text_chunk_free(chunk);
+  inf_text_chunk_free(chunk2);
+  inf_text_chunk_free(chunk3);
+
+  /* Many segments by alternating authors, to exercise the segment tree.
+   * Each segment must start where the previous one ended. */
+  chunk = inf_text_chunk_new("UTF-8");
+  for(i = 0; i < 1000; ++i)
+    inf_text_chunk_insert_text(chunk, i / 2, "ab", 2, 2, i % 2);
+
+  inf_text_chunk_erase(chunk, 100, 1000);
+  chunk2 = inf_text_chunk_substring(chunk, 50, 500);
+  inf_text_chunk_insert_chunk(chunk, 75, chunk2);
   inf_text_chunk_free(chunk2);
 
-  return 0;
+  offset = 0;
+  if(inf_text_chunk_iter_init_begin(chunk, &iter))
+  {
+    do
+    {
+      if(inf_text_chunk_iter_get_offset(&iter) != offset)
+        result = 1;
+      offset += inf_text_chunk_iter_get_length(&iter);
+    } while(inf_text_chunk_iter_next(&iter));
+  }
+
+  result = result || offset != 1500 || inf_text_chunk_get_length(chunk) != 1500;
+  inf_text_chunk_free(chunk);
+
+  return result;
 }
@@ -29,28 +29,112 @@
 #include <libinfinity/common/inf-tcp-connection.h>
 #include <libinfinity/common/inf-ip-address.h>
 #include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-epoll-io.h>
 #include <libinfinity/common/inf-error.h>
 #include <libinfinity/common/inf-protocol.h>
 #include <libinfinity/common/inf-init.h>
+#include <libinfinity/inf-config.h>
 
+#include <stdlib.h>
 #include <string.h>
 
+typedef struct _InfTestMassJoin InfTestMassJoin;
+
 typedef struct _InfTestMassJoiner InfTestMassJoiner;
 struct _InfTestMassJoiner {
+  InfTestMassJoin* massjoin;
   InfCommunicationManager* communication_manager;
   InfcBrowser* browser;
   InfcSessionProxy* session;
 
   gchar* document;
   gchar* username;
+  gboolean done;
 };
 
-typedef struct _InfTestMassJoin InfTestMassJoin;
 struct _InfTestMassJoin {
   InfIo* io;
   GSList* joiners;
+
+  /* Statistics for the benchmark */
+  GTimer* timer;
+  guint n_joiners;
+  guint n_done;
+  guint n_joined;
+  gboolean stay;
 };
 
+static void
+inf_test_mass_join_loop(InfIo* io)
+{
+#ifdef LIBINFINITY_HAVE_EPOLL
+  if(INF_IS_EPOLL_IO(io))
+  {
+    inf_epoll_io_loop(INF_EPOLL_IO(io));
+    return;
+  }
+#endif
+
+  inf_standalone_io_loop(INF_STANDALONE_IO(io));
+}
+
+static void
+inf_test_mass_join_loop_quit(InfIo* io)
+{
+#ifdef LIBINFINITY_HAVE_EPOLL
+  if(INF_IS_EPOLL_IO(io))
+  {
+    inf_epoll_io_loop_quit(INF_EPOLL_IO(io));
+    return;
+  }
+#endif
+
+  inf_standalone_io_loop_quit(INF_STANDALONE_IO(io));
+}
+
+/* Called when a joiner has either joined a user into the session or has
+ * given up. Once all joiners are done, prints how long it took and closes
+ * all connections, unless the joiners should stay in the session. */
+static void
+inf_test_mass_join_joiner_done(InfTestMassJoiner* joiner,
+                               gboolean joined)
+{
+  InfTestMassJoin* massjoin;
+  GSList* joiners;
+  GSList* item;
+
+  massjoin = joiner->massjoin;
+  if(joiner->done) return;
+
+  joiner->done = TRUE;
+  ++massjoin->n_done;
+  if(joined) ++massjoin->n_joined;
+
+  if(massjoin->n_done == massjoin->n_joiners)
+  {
+    fprintf(
+      stdout,
+      "%u of %u joiners joined in %g secs\n",
+      massjoin->n_joined,
+      massjoin->n_joiners,
+      g_timer_elapsed(massjoin->timer, NULL)
+    );
+
+    if(!massjoin->stay)
+    {
+      /* Closing a connection removes its joiner from the list */
+      joiners = g_slist_copy(massjoin->joiners);
+      for(item = joiners; item != NULL; item = item->next)
+      {
+        joiner = (InfTestMassJoiner*)item->data;
+        inf_xml_connection_close(infc_browser_get_connection(joiner->browser));
+      }
+
+      g_slist_free(joiners);
+    }
+  }
+}
+
 static InfSession*
 inf_test_mass_join_session_new(InfIo* io,
                                InfCommunicationManager* manager,
@@ -93,6 +177,7 @@ inf_test_mass_join_user_join_finished_cb(InfRequest* request,
   if(error == NULL)
   {
     fprintf(stdout, "Joiner %s: User joined!\n", joiner->username);
+    inf_test_mass_join_joiner_done(joiner, TRUE);
   }
   else
   {
@@ -342,8 +427,9 @@ inf_test_mass_join_browser_notify_status_cb(GObject* object,
   case INF_BROWSER_CLOSED:
     fprintf(stdout, "Joiner %s: Disconnected\n", joiner->username);
     massjoin->joiners = g_slist_remove(massjoin->joiners, joiner);
+    inf_test_mass_join_joiner_done(joiner, FALSE);
     if(massjoin->joiners == NULL)
-      inf_standalone_io_loop_quit(INF_STANDALONE_IO(massjoin->io));
+      inf_test_mass_join_loop_quit(massjoin->io);
     break;
   default:
     g_assert_not_reached();
@@ -379,6 +465,7 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
   );
 
   joiner = g_slice_new(InfTestMassJoiner);
+  joiner->massjoin = massjoin;
   joiner->communication_manager = inf_communication_manager_new();
   joiner->browser = infc_browser_new(
     massjoin->io,
@@ -388,6 +475,7 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
   joiner->session = NULL;
   joiner->document = g_strdup(document);
   joiner->username = g_strdup(username);
+  joiner->done = FALSE;
 
   g_object_unref(xmpp);
   g_object_unref(tcp);
@@ -417,9 +505,10 @@ inf_test_mass_join_connect(InfTestMassJoin* massjoin,
 
     g_error_free(error);
     massjoin->joiners = g_slist_remove(massjoin->joiners, joiner);
+    inf_test_mass_join_joiner_done(joiner, FALSE);
 
     if(massjoin->joiners == NULL)
-      inf_standalone_io_loop_quit(INF_STANDALONE_IO(massjoin->io));
+      inf_test_mass_join_loop_quit(massjoin->io);
   }
 }
 
@@ -429,9 +518,46 @@ main(int argc,
 {
   InfTestMassJoin massjoin;
   GError* error;
+  const char* hostname;
+  gboolean use_epoll;
+  guint n_args;
   int i;
   gchar* name;
 
+  massjoin.n_joiners = 128;
+  massjoin.stay = FALSE;
+  hostname = "127.0.0.1";
+  use_epoll = FALSE;
+  n_args = 0;
+
+  for(i = 1; i < argc; ++i)
+  {
+    if(strcmp(argv[i], "--epoll") == 0)
+      use_epoll = TRUE;
+    else if(strcmp(argv[i], "--stay") == 0)
+      massjoin.stay = TRUE;
+    else if(n_args == 0)
+      massjoin.n_joiners = atoi(argv[i]);
+    else if(n_args == 1)
+      hostname = argv[i];
+    else
+      break;
+
+    if(argv[i][0] != '-')
+      ++n_args;
+  }
+
+  if(i < argc || massjoin.n_joiners == 0)
+  {
+    fprintf(
+      stderr,
+      "Usage: %s [--epoll] [--stay] [<joiners> [<host>]]\n",
+      argv[0]
+    );
+
+    return -1;
+  }
+
   error = NULL;
   if(!inf_init(&error))
   {
@@ -439,26 +565,45 @@ main(int argc,
     return -1;
   }
 
-  massjoin.io = INF_IO(inf_standalone_io_new());
+  if(use_epoll)
+  {
+#ifdef LIBINFINITY_HAVE_EPOLL
+    massjoin.io = INF_IO(inf_epoll_io_new());
+#else
+    fprintf(stderr, "epoll support is not available on this platform\n");
+    return -1;
+#endif
+  }
+  else
+  {
+    massjoin.io = INF_IO(inf_standalone_io_new());
+  }
+
   massjoin.joiners = NULL;
+  massjoin.timer = g_timer_new();
+  massjoin.n_done = 0;
+  massjoin.n_joined = 0;
 
-  for(i = 0; i < 128; ++i)
+  for(i = 0; i < (int)massjoin.n_joiners; ++i)
   {
     name = g_strdup_printf("MassJoin%03d", i);
 
     inf_test_mass_join_connect(
       &massjoin,
-      "127.0.0.1",
+      hostname,
       inf_protocol_get_default_port(),
       "Test",
       name
     );
 
     g_free(name);
-    //g_usleep(100000);
   }
 
-  inf_standalone_io_loop(INF_STANDALONE_IO(massjoin.io));
+  if(massjoin.joiners != NULL)
+    inf_test_mass_join_loop(massjoin.io);
+
+  g_timer_destroy(massjoin.timer);
+  g_object_unref(massjoin.io);
   return 0;
 }
 
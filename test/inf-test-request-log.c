@@ -0,0 +1,312 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Checks the transformation cache of InfAdoptedRequestLog: that the least
+ * recently used entry is evicted once the cache is full, that lowering
+ * the max-cache-size property evicts entries right away, and that
+ * inf_adopted_request_log_remove_requests() drops exactly the cached
+ * translations of the removed requests. */
+
+#include <libinfinity/adopted/inf-adopted-request-log.h>
+#include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+
+#define INF_TEST_REQUEST_LOG_USER 1
+#define INF_TEST_REQUEST_LOG_OTHER 2
+#define INF_TEST_REQUEST_LOG_REQUESTS 5
+
+/* Creates a request of the log's user at the state where the log's user
+ * has made n requests and the other user has made m requests. */
+static InfAdoptedRequest*
+inf_test_request_log_make_request(guint n,
+                                  guint m)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+
+  vector = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vector, INF_TEST_REQUEST_LOG_USER, n);
+  inf_adopted_state_vector_set(vector, INF_TEST_REQUEST_LOG_OTHER, m);
+
+  operation = INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
+  request = inf_adopted_request_new_do(
+    vector,
+    INF_TEST_REQUEST_LOG_USER,
+    operation,
+    0
+  );
+
+  g_object_unref(operation);
+  inf_adopted_state_vector_free(vector);
+  return request;
+}
+
+static void
+inf_test_request_log_add_cached(InfAdoptedRequestLog* log,
+                                guint n,
+                                guint m)
+{
+  InfAdoptedRequest* request;
+
+  request = inf_test_request_log_make_request(n, m);
+  inf_adopted_request_log_add_cached_request(log, request);
+  g_object_unref(request);
+}
+
+static gboolean
+inf_test_request_log_is_cached(InfAdoptedRequestLog* log,
+                               guint n,
+                               guint m)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedRequest* request;
+
+  vector = inf_adopted_state_vector_new();
+  inf_adopted_state_vector_set(vector, INF_TEST_REQUEST_LOG_USER, n);
+  inf_adopted_state_vector_set(vector, INF_TEST_REQUEST_LOG_OTHER, m);
+
+  /* Note that this moves the entry to the front of the LRU list */
+  request = inf_adopted_request_log_lookup_cached_request(log, vector);
+  inf_adopted_state_vector_free(vector);
+
+  if(request == NULL)
+    return FALSE;
+
+  g_assert(inf_adopted_request_get_user_id(request) ==
+           INF_TEST_REQUEST_LOG_USER);
+  return TRUE;
+}
+
+static gboolean
+inf_test_request_log_eviction(void)
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  gpointer evicted;
+
+  log = inf_adopted_request_log_new(INF_TEST_REQUEST_LOG_USER);
+  g_object_set(G_OBJECT(log), "max-cache-size", 3, NULL);
+
+  /* Keep track of the entry that is going to be evicted, to verify that the
+   * cache releases its reference. */
+  request = inf_test_request_log_make_request(0, 1);
+  evicted = request;
+  g_object_add_weak_pointer(G_OBJECT(request), &evicted);
+  inf_adopted_request_log_add_cached_request(log, request);
+  g_object_unref(request);
+
+  inf_test_request_log_add_cached(log, 0, 0);
+  inf_test_request_log_add_cached(log, 0, 2);
+
+  /* Touch the oldest entry, so that (0, 1) is the least recently used one */
+  if(!inf_test_request_log_is_cached(log, 0, 0))
+  {
+    fprintf(stderr, "Cached request (0, 0) not found\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  inf_test_request_log_add_cached(log, 0, 3);
+
+  if(evicted != NULL || inf_test_request_log_is_cached(log, 0, 1))
+  {
+    fprintf(stderr, "Least recently used request (0, 1) was not evicted\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  if(!inf_test_request_log_is_cached(log, 0, 2) ||
+     !inf_test_request_log_is_cached(log, 0, 3) ||
+     !inf_test_request_log_is_cached(log, 0, 0))
+  {
+    fprintf(stderr, "Recently used request was evicted\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  g_object_unref(log);
+  return TRUE;
+}
+
+static gboolean
+inf_test_request_log_shrink(void)
+{
+  InfAdoptedRequestLog* log;
+  guint max_cache_size;
+  guint i;
+
+  log = inf_adopted_request_log_new(INF_TEST_REQUEST_LOG_USER);
+  for(i = 0; i < 10; ++i)
+    inf_test_request_log_add_cached(log, 0, i);
+
+  /* Make (0, 4) and then (0, 7) the most recently used entries */
+  if(!inf_test_request_log_is_cached(log, 0, 4) ||
+     !inf_test_request_log_is_cached(log, 0, 7))
+  {
+    fprintf(stderr, "Cached request not found\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  g_object_set(G_OBJECT(log), "max-cache-size", 2, NULL);
+  g_object_get(G_OBJECT(log), "max-cache-size", &max_cache_size, NULL);
+  g_assert(max_cache_size == 2);
+
+  for(i = 0; i < 10; ++i)
+  {
+    if(inf_test_request_log_is_cached(log, 0, i) != (i == 4 || i == 7))
+    {
+      fprintf(stderr, "Shrinking the cache kept the wrong entries\n");
+      g_object_unref(log);
+      return FALSE;
+    }
+  }
+
+  /* A size of zero disables the cache altogether */
+  g_object_set(G_OBJECT(log), "max-cache-size", 0, NULL);
+  inf_test_request_log_add_cached(log, 0, 10);
+
+  if(inf_test_request_log_is_cached(log, 0, 4) ||
+     inf_test_request_log_is_cached(log, 0, 7) ||
+     inf_test_request_log_is_cached(log, 0, 10))
+  {
+    fprintf(stderr, "Disabled cache still contains entries\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  g_object_unref(log);
+  return TRUE;
+}
+
+static gboolean
+inf_test_request_log_remove(void)
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* request;
+  guint up_to;
+  guint i;
+
+  log = inf_adopted_request_log_new(INF_TEST_REQUEST_LOG_USER);
+
+  for(i = 0; i < INF_TEST_REQUEST_LOG_REQUESTS; ++i)
+  {
+    request = inf_test_request_log_make_request(i, 0);
+    inf_adopted_request_log_add_request(log, request);
+    g_object_unref(request);
+
+    /* Several translations per request, so that cleanup has to remove
+     * more than one entry with the same user component. */
+    inf_test_request_log_add_cached(log, i, 1);
+    inf_test_request_log_add_cached(log, i, 2);
+  }
+
+  up_to = 3;
+  inf_adopted_request_log_remove_requests(log, up_to);
+  g_assert(inf_adopted_request_log_get_begin(log) == up_to);
+
+  for(i = 0; i < INF_TEST_REQUEST_LOG_REQUESTS; ++i)
+  {
+    if(inf_test_request_log_is_cached(log, i, 1) != (i >= up_to) ||
+       inf_test_request_log_is_cached(log, i, 2) != (i >= up_to))
+    {
+      fprintf(
+        stderr,
+        "Cached translation of request %u was %s\n",
+        i,
+        i >= up_to ? "removed" : "kept"
+      );
+
+      g_object_unref(log);
+      return FALSE;
+    }
+  }
+
+  /* Removing the remaining requests empties the cache, and it can be
+   * filled again afterwards. */
+  inf_adopted_request_log_remove_requests(
+    log,
+    inf_adopted_request_log_get_end(log)
+  );
+
+  for(i = 0; i < INF_TEST_REQUEST_LOG_REQUESTS; ++i)
+  {
+    if(inf_test_request_log_is_cached(log, i, 1) ||
+       inf_test_request_log_is_cached(log, i, 2))
+    {
+      fprintf(stderr, "Cached translation of request %u was kept\n", i);
+      g_object_unref(log);
+      return FALSE;
+    }
+  }
+
+  inf_test_request_log_add_cached(log, INF_TEST_REQUEST_LOG_REQUESTS, 1);
+  if(!inf_test_request_log_is_cached(log, INF_TEST_REQUEST_LOG_REQUESTS, 1))
+  {
+    fprintf(stderr, "Cache cannot be used after cleanup\n");
+    g_object_unref(log);
+    return FALSE;
+  }
+
+  g_object_unref(log);
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GError* error;
+  int result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  result = 0;
+
+  printf("LRU eviction... ");
+  if(inf_test_request_log_eviction())
+    printf("OK\n");
+  else
+    result = 1;
+
+  printf("Shrinking the cache... ");
+  if(inf_test_request_log_shrink())
+    printf("OK\n");
+  else
+    result = 1;
+
+  printf("Removing requests... ");
+  if(inf_test_request_log_remove())
+    printf("OK\n");
+  else
+    result = 1;
+
+  inf_deinit();
+  return result;
+}
+
+/* vim:set et sw=2 ts=2: */
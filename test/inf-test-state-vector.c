@@ -20,6 +20,10 @@
 #include <libinfinity/adopted/inf-adopted-state-vector.h>
 #include <libinfinity/common/inf-user.h>
 #include <string.h>
+#include <stdlib.h>
+
+#define INF_TEST_STATE_VECTOR_RANDOM_IDS 8
+#define INF_TEST_STATE_VECTOR_BENCH_ITERATIONS 100000
 
 static void cmp(const char* should_be, InfAdoptedStateVector* vec) {
   char* is;
@@ -125,6 +129,251 @@ static void l_test() {
 
   apply(free, (vec));
   apply(free, (vec_));
+
+  /* Duplicate IDs are rejected even if one of the components is zero */
+  g_assert(apply(from_string, ("1:0;1:5", NULL)) == NULL);
+  g_assert(apply(from_string, ("1:5;1:0", NULL)) == NULL);
+  g_assert(apply(from_string, ("1:0;1:0", NULL)) == NULL);
+}
+
+static InfAdoptedStateVector*
+random_vector(void)
+{
+  InfAdoptedStateVector* vec;
+  guint id;
+
+  vec = inf_adopted_state_vector_new();
+  for(id = 1; id <= INF_TEST_STATE_VECTOR_RANDOM_IDS; ++id)
+    if(rand() % 2 == 0)
+      inf_adopted_state_vector_set(vec, id, rand() % 4);
+
+  return vec;
+}
+
+static void
+intern_test(void)
+{
+  InfAdoptedStateVector* vec;
+  InfAdoptedStateVector* first;
+  InfAdoptedStateVector* second;
+  InfAdoptedStateVector* third;
+  guint n_vectors;
+  guint n_references;
+
+  vec = inf_adopted_state_vector_from_string("1:3;2:5", NULL);
+  first = inf_adopted_state_vector_intern(vec);
+  second = inf_adopted_state_vector_intern(vec);
+  g_assert(first == second);
+  g_assert(first != vec);
+  g_assert(inf_adopted_state_vector_compare(first, vec) == 0);
+  g_assert(
+    inf_adopted_state_vector_hash(first) == inf_adopted_state_vector_hash(vec)
+  );
+
+  inf_adopted_state_vector_set(vec, 2, 6);
+  third = inf_adopted_state_vector_intern(vec);
+  g_assert(third != first);
+
+  inf_adopted_state_vector_get_intern_statistics(
+    &n_vectors,
+    &n_references,
+    NULL
+  );
+
+  g_assert(n_vectors == 2);
+  g_assert(n_references == 3);
+
+  inf_adopted_state_vector_free(first);
+  inf_adopted_state_vector_free(third);
+  inf_adopted_state_vector_free(vec);
+
+  /* The vector stays interned while there are references left */
+  vec = inf_adopted_state_vector_copy(second);
+  first = inf_adopted_state_vector_intern(vec);
+  g_assert(first == second);
+
+  inf_adopted_state_vector_free(first);
+  inf_adopted_state_vector_free(second);
+  inf_adopted_state_vector_free(vec);
+
+  inf_adopted_state_vector_get_intern_statistics(
+    &n_vectors,
+    &n_references,
+    NULL
+  );
+
+  g_assert(n_vectors == 0);
+  g_assert(n_references == 0);
+
+  printf("intern ok!\n");
+}
+
+/* Compares the merge-based functions with a straightforward evaluation
+ * component by component. */
+static void
+random_test(void)
+{
+  InfAdoptedStateVector* first;
+  InfAdoptedStateVector* second;
+  InfAdoptedStateVector* lcs;
+  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector* diff_vec;
+  gboolean before;
+  gboolean before_inc;
+  guint a, b;
+  guint id;
+  guint inc;
+  gchar* str;
+  int i;
+
+  for(i = 0; i < 10000; ++i)
+  {
+    first = random_vector();
+    second = random_vector();
+    inc = 1 + rand() % INF_TEST_STATE_VECTOR_RANDOM_IDS;
+
+    lcs = inf_adopted_state_vector_least_common_successor(first, second);
+    lcp = inf_adopted_state_vector_least_common_predecessor(first, second);
+
+    before = TRUE;
+    before_inc = TRUE;
+    for(id = 1; id <= INF_TEST_STATE_VECTOR_RANDOM_IDS; ++id)
+    {
+      a = inf_adopted_state_vector_get(first, id);
+      b = inf_adopted_state_vector_get(second, id);
+
+      if(a > b) before = FALSE;
+      if(a + (id == inc ? 1 : 0) > b) before_inc = FALSE;
+
+      g_assert(inf_adopted_state_vector_get(lcs, id) == MAX(a, b));
+      g_assert(inf_adopted_state_vector_get(lcp, id) == MIN(a, b));
+    }
+
+    g_assert(
+      inf_adopted_state_vector_causally_before(first, second) == before
+    );
+
+    g_assert(
+      inf_adopted_state_vector_causally_before_inc(first, second, inc) ==
+      before_inc
+    );
+
+    g_assert(inf_adopted_state_vector_causally_before(first, lcs));
+    g_assert(inf_adopted_state_vector_causally_before(second, lcs));
+    g_assert(inf_adopted_state_vector_causally_before(lcp, first));
+    g_assert(inf_adopted_state_vector_causally_before(lcp, second));
+
+    g_assert(
+      (inf_adopted_state_vector_compare(first, second) == 0) ==
+      (before && inf_adopted_state_vector_causally_before(second, first))
+    );
+
+    g_assert(
+      inf_adopted_state_vector_compare(first, second) ==
+      -inf_adopted_state_vector_compare(second, first)
+    );
+
+    str = inf_adopted_state_vector_to_string_diff(lcs, first);
+    diff_vec = inf_adopted_state_vector_from_string_diff(str, first, NULL);
+    g_assert(diff_vec != NULL);
+    g_assert(inf_adopted_state_vector_compare(diff_vec, lcs) == 0);
+    g_free(str);
+
+    inf_adopted_state_vector_free(diff_vec);
+    inf_adopted_state_vector_free(lcs);
+    inf_adopted_state_vector_free(lcp);
+    inf_adopted_state_vector_free(first);
+    inf_adopted_state_vector_free(second);
+  }
+
+  printf("random ok!\n");
+}
+
+/* Times the functions that run for every transformation on vectors
+ * containing n_users users, which is the common case in a session with
+ * that many users. */
+static void
+bench(guint n_users)
+{
+  InfAdoptedStateVector* first;
+  InfAdoptedStateVector* second;
+  InfAdoptedStateVector* result;
+  GTimer* timer;
+  guint id;
+  guint sum;
+  int i;
+
+  first = inf_adopted_state_vector_new();
+  second = inf_adopted_state_vector_new();
+
+  for(id = 1; id <= n_users; ++id)
+  {
+    inf_adopted_state_vector_set(first, id, 100 + rand() % 100);
+    inf_adopted_state_vector_set(
+      second,
+      id,
+      inf_adopted_state_vector_get(first, id) + rand() % 10
+    );
+  }
+
+  timer = g_timer_new();
+  sum = 0;
+
+  for(i = 0; i < INF_TEST_STATE_VECTOR_BENCH_ITERATIONS; ++i)
+    sum += inf_adopted_state_vector_compare(first, second) + 1;
+  printf(
+    "%u users: compare:          %6.1f ns\n",
+    n_users,
+    g_timer_elapsed(timer, NULL) * 1e9 / INF_TEST_STATE_VECTOR_BENCH_ITERATIONS
+  );
+
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_STATE_VECTOR_BENCH_ITERATIONS; ++i)
+    sum += inf_adopted_state_vector_causally_before(first, second);
+  printf(
+    "%u users: causally_before:  %6.1f ns\n",
+    n_users,
+    g_timer_elapsed(timer, NULL) * 1e9 / INF_TEST_STATE_VECTOR_BENCH_ITERATIONS
+  );
+
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_STATE_VECTOR_BENCH_ITERATIONS; ++i)
+    sum += inf_adopted_state_vector_vdiff(first, second);
+  printf(
+    "%u users: vdiff:            %6.1f ns\n",
+    n_users,
+    g_timer_elapsed(timer, NULL) * 1e9 / INF_TEST_STATE_VECTOR_BENCH_ITERATIONS
+  );
+
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_STATE_VECTOR_BENCH_ITERATIONS; ++i)
+  {
+    result = inf_adopted_state_vector_least_common_successor(first, second);
+    inf_adopted_state_vector_free(result);
+  }
+  printf(
+    "%u users: lcs:              %6.1f ns\n",
+    n_users,
+    g_timer_elapsed(timer, NULL) * 1e9 / INF_TEST_STATE_VECTOR_BENCH_ITERATIONS
+  );
+
+  g_timer_start(timer);
+  for(i = 0; i < INF_TEST_STATE_VECTOR_BENCH_ITERATIONS; ++i)
+  {
+    result = inf_adopted_state_vector_least_common_predecessor(first, second);
+    inf_adopted_state_vector_free(result);
+  }
+  printf(
+    "%u users: lcp:              %6.1f ns\n",
+    n_users,
+    g_timer_elapsed(timer, NULL) * 1e9 / INF_TEST_STATE_VECTOR_BENCH_ITERATIONS
+  );
+
+  g_timer_destroy(timer);
+  g_assert(sum > 0);
+
+  inf_adopted_state_vector_free(first);
+  inf_adopted_state_vector_free(second);
 }
 
 int main(int argc, char* argv[])
@@ -156,8 +405,22 @@ int main(int argc, char* argv[])
   inf_adopted_state_vector_set(vec, users[1], 5);
   g_assert(inf_adopted_state_vector_get(vec, users[1]) == 5);
 
+  inf_adopted_state_vector_set(vec, users[1], 0);
+  g_assert(inf_adopted_state_vector_get(vec, users[1]) == 0);
+
+  inf_adopted_state_vector_add(vec, users[0], -6);
+  vec2 = inf_adopted_state_vector_new();
+  g_assert(inf_adopted_state_vector_compare(vec, vec2) == 0);
+  inf_adopted_state_vector_free(vec2);
+
   inf_adopted_state_vector_free(vec);
   l_test();
+  random_test();
+  intern_test();
+
+  bench(2);
+  bench(20);
+  bench(200);
   return 0;
 }
 
@@ -0,0 +1,342 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Fills a temporary directory with subdirectories and notes, writes ACLs
+ * for some of them with the asynchronous storage calls and reads them back
+ * right away, and then explores the directory with an InfdDirectory.
+ * Verifies that reads see previously started writes, that the exploration
+ * finishes asynchronously, and that the explored tree matches what is on
+ * disk. */
+
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_STORAGE_ASYNC_SUBDIRECTORIES 50
+#define INF_TEST_STORAGE_ASYNC_NOTES 50
+
+typedef struct _InfTestStorageAsync InfTestStorageAsync;
+struct _InfTestStorageAsync {
+  InfStandaloneIo* io;
+  guint pending;
+  gboolean failed;
+};
+
+static void
+inf_test_storage_async_fail(InfTestStorageAsync* test,
+                            const gchar* message)
+{
+  fprintf(stderr, "%s\n", message);
+  test->failed = TRUE;
+}
+
+static void
+inf_test_storage_async_done(InfTestStorageAsync* test)
+{
+  g_assert(test->pending > 0);
+  if(--test->pending == 0)
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_storage_async_write_acl_cb(InfdStorage* storage,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  InfTestStorageAsync* test;
+  test = (InfTestStorageAsync*)user_data;
+
+  if(error != NULL)
+    inf_test_storage_async_fail(test, error->message);
+
+  inf_test_storage_async_done(test);
+}
+
+static void
+inf_test_storage_async_read_acl_cb(InfdStorage* storage,
+                                   GSList* acl,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfTestStorageAsync* test;
+  InfdStorageAcl* storage_acl;
+
+  test = (InfTestStorageAsync*)user_data;
+
+  if(error != NULL)
+  {
+    inf_test_storage_async_fail(test, error->message);
+  }
+  else if(acl == NULL || acl->next != NULL)
+  {
+    inf_test_storage_async_fail(test, "ACL read back has wrong length");
+  }
+  else
+  {
+    storage_acl = (InfdStorageAcl*)acl->data;
+    if(strcmp(storage_acl->account_id, "default") != 0 ||
+       !inf_acl_mask_has(&storage_acl->mask, INF_ACL_CAN_REMOVE_NODE) ||
+       inf_acl_mask_has(&storage_acl->perms, INF_ACL_CAN_REMOVE_NODE))
+    {
+      inf_test_storage_async_fail(test, "ACL read back does not match");
+    }
+  }
+
+  infd_storage_acl_list_free(acl);
+  inf_test_storage_async_done(test);
+}
+
+static void
+inf_test_storage_async_explore_cb(InfRequest* request,
+                                  const InfRequestResult* result,
+                                  const GError* error,
+                                  gpointer user_data)
+{
+  InfTestStorageAsync* test;
+  test = (InfTestStorageAsync*)user_data;
+
+  if(error != NULL)
+    inf_test_storage_async_fail(test, error->message);
+
+  inf_test_storage_async_done(test);
+}
+
+static gboolean
+inf_test_storage_async_populate(const gchar* root,
+                                GError** error)
+{
+  gchar* name;
+  gchar* path;
+  gboolean result;
+  guint i;
+
+  for(i = 0; i < INF_TEST_STORAGE_ASYNC_SUBDIRECTORIES; ++i)
+  {
+    name = g_strdup_printf("dir-%03u", i);
+    path = g_build_filename(root, name, NULL);
+    g_free(name);
+
+    result = inf_file_util_create_single_directory(path, 0755, error);
+    g_free(path);
+
+    if(!result)
+      return FALSE;
+  }
+
+  for(i = 0; i < INF_TEST_STORAGE_ASYNC_NOTES; ++i)
+  {
+    name = g_strdup_printf("note-%03u.InfText", i);
+    path = g_build_filename(root, name, NULL);
+    g_free(name);
+
+    result = g_file_set_contents(path, "", 0, error);
+    g_free(path);
+
+    if(!result)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_storage_async_acl(InfTestStorageAsync* test,
+                           InfdStorage* storage)
+{
+  InfAclSheetSet* sheet_set;
+  InfAclSheet* sheet;
+  gchar* path;
+  guint i;
+
+  sheet_set = inf_acl_sheet_set_new();
+  sheet = inf_acl_sheet_set_add_sheet(
+    sheet_set,
+    inf_acl_account_id_from_string("default")
+  );
+
+  inf_acl_mask_set1(&sheet->mask, INF_ACL_CAN_REMOVE_NODE);
+  inf_acl_mask_clear(&sheet->perms);
+
+  /* Each read is started right after the write for the same node, and must
+   * see its result. */
+  for(i = 0; i < INF_TEST_STORAGE_ASYNC_SUBDIRECTORIES; ++i)
+  {
+    path = g_strdup_printf("/dir-%03u", i);
+
+    infd_storage_write_acl_async(
+      storage,
+      path,
+      sheet_set,
+      INF_IO(test->io),
+      inf_test_storage_async_write_acl_cb,
+      test
+    );
+
+    infd_storage_read_acl_async(
+      storage,
+      path,
+      INF_IO(test->io),
+      inf_test_storage_async_read_acl_cb,
+      test
+    );
+
+    test->pending += 2;
+    g_free(path);
+  }
+
+  inf_acl_sheet_set_free(sheet_set);
+  inf_standalone_io_loop(test->io);
+}
+
+static void
+inf_test_storage_async_explore(InfTestStorageAsync* test,
+                               InfdStorage* storage)
+{
+  InfCommunicationManager* manager;
+  InfdDirectory* directory;
+  InfBrowserIter iter;
+  InfRequest* request;
+  const InfAclSheetSet* sheet_set;
+  const InfAclSheet* sheet;
+  guint n_children;
+
+  manager = inf_communication_manager_new();
+  directory = infd_directory_new(INF_IO(test->io), storage, manager);
+  g_object_unref(manager);
+
+  inf_browser_get_root(INF_BROWSER(directory), &iter);
+
+  request = inf_browser_explore(
+    INF_BROWSER(directory),
+    &iter,
+    inf_test_storage_async_explore_cb,
+    test
+  );
+
+  if(request == NULL ||
+     inf_browser_get_explored(INF_BROWSER(directory), &iter) == TRUE)
+  {
+    inf_test_storage_async_fail(test, "Exploration finished synchronously");
+    g_object_unref(directory);
+    return;
+  }
+
+  ++test->pending;
+  inf_standalone_io_loop(test->io);
+
+  n_children = 0;
+  if(inf_browser_get_child(INF_BROWSER(directory), &iter))
+  {
+    do
+    {
+      ++n_children;
+
+      if(strncmp(inf_browser_get_node_name(INF_BROWSER(directory), &iter),
+                 "dir-", 4) == 0)
+      {
+        sheet_set = inf_browser_get_acl(INF_BROWSER(directory), &iter);
+        sheet = NULL;
+
+        if(sheet_set != NULL)
+        {
+          sheet = inf_acl_sheet_set_find_const_sheet(
+            sheet_set,
+            inf_acl_account_id_from_string("default")
+          );
+        }
+
+        if(sheet == NULL)
+          inf_test_storage_async_fail(test, "Explored node lacks its ACL");
+      }
+    } while(inf_browser_get_next(INF_BROWSER(directory), &iter));
+  }
+
+  if(n_children !=
+     INF_TEST_STORAGE_ASYNC_SUBDIRECTORIES + INF_TEST_STORAGE_ASYNC_NOTES)
+  {
+    inf_test_storage_async_fail(test, "Wrong number of explored nodes");
+  }
+
+  g_object_unref(directory);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfTestStorageAsync test;
+  InfdFilesystemStorage* storage;
+  GError* error;
+  gchar* root;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root = g_dir_make_tmp("inf-test-storage-async-XXXXXX", &error);
+  if(root == NULL || !inf_test_storage_async_populate(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    g_free(root);
+    return 1;
+  }
+
+  test.io = inf_standalone_io_new();
+  test.pending = 0;
+  test.failed = FALSE;
+
+  storage = infd_filesystem_storage_new(root);
+  g_object_set(G_OBJECT(storage), "max-threads", 2, NULL);
+
+  inf_test_storage_async_acl(&test, INFD_STORAGE(storage));
+  printf("Write and read back ACLs... %s\n", test.failed ? "FAILED" : "OK");
+
+  if(!test.failed)
+  {
+    inf_test_storage_async_explore(&test, INFD_STORAGE(storage));
+    printf("Explore directory... %s\n", test.failed ? "FAILED" : "OK");
+  }
+
+  g_object_unref(storage);
+  g_object_unref(test.io);
+
+  if(!inf_file_util_delete(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  inf_deinit();
+  return test.failed ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,363 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Measures the throughput of InfTcpConnection over the loopback interface.
+ * A client sends a fixed amount of data to an InfdTcpServer running in the
+ * same process, once for each of a number of chunk sizes, and the time
+ * until the server side has received everything is printed. Small chunks
+ * show the per-call overhead, large ones how well the send queue and the
+ * receive buffer handle bulk transfers such as session synchronization. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const guint INF_TEST_TCP_THROUGHPUT_CHUNK_SIZES[] = {
+  64, 512, 4096, 65536
+};
+
+/* Maximum amount of data that is handed to the connection but has not yet
+ * been sent, so that we do not queue the whole transfer at once. */
+#define INF_TEST_TCP_THROUGHPUT_WINDOW (1024 * 1024)
+
+typedef struct _InfTestTcpThroughput InfTestTcpThroughput;
+struct _InfTestTcpThroughput {
+  InfStandaloneIo* io;
+  InfTcpConnection* client;
+  InfTcpConnection* server_connection;
+
+  gchar* chunk;
+  guint chunk_size;
+
+  guint64 total;
+  guint64 queued;
+  guint64 sent;
+  guint64 received;
+
+  gboolean filling;
+  gboolean failed;
+  GTimer* timer;
+};
+
+static void
+inf_test_tcp_throughput_fill(InfTestTcpThroughput* test)
+{
+  guint len;
+
+  /* inf_tcp_connection_send() emits "sent" synchronously if the data
+   * could be sent right away, in which case we end up here again. The
+   * outer call keeps on filling in that case. */
+  if(test->filling)
+    return;
+
+  test->filling = TRUE;
+
+  while(test->queued < test->total &&
+        test->queued - test->sent < INF_TEST_TCP_THROUGHPUT_WINDOW &&
+        !test->failed)
+  {
+    len = test->chunk_size;
+    if(test->total - test->queued < len)
+      len = test->total - test->queued;
+
+    test->queued += len;
+    inf_tcp_connection_send(test->client, test->chunk, len);
+  }
+
+  test->filling = FALSE;
+}
+
+static void
+inf_test_tcp_throughput_fail(InfTestTcpThroughput* test,
+                             const GError* error)
+{
+  fprintf(stderr, "Error: %s\n", error->message);
+
+  test->failed = TRUE;
+  if(inf_standalone_io_loop_running(test->io))
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_tcp_throughput_error_cb(GObject* object,
+                                 const GError* error,
+                                 gpointer user_data)
+{
+  inf_test_tcp_throughput_fail((InfTestTcpThroughput*)user_data, error);
+}
+
+static void
+inf_test_tcp_throughput_sent_cb(InfTcpConnection* connection,
+                                gconstpointer data,
+                                guint len,
+                                gpointer user_data)
+{
+  InfTestTcpThroughput* test;
+  test = (InfTestTcpThroughput*)user_data;
+
+  test->sent += len;
+  inf_test_tcp_throughput_fill(test);
+}
+
+static void
+inf_test_tcp_throughput_received_cb(InfTcpConnection* connection,
+                                    gconstpointer data,
+                                    guint len,
+                                    gpointer user_data)
+{
+  InfTestTcpThroughput* test;
+  test = (InfTestTcpThroughput*)user_data;
+
+  test->received += len;
+  if(test->received == test->total)
+  {
+    g_timer_stop(test->timer);
+    inf_standalone_io_loop_quit(test->io);
+  }
+}
+
+static void
+inf_test_tcp_throughput_notify_status_cb(GObject* object,
+                                         GParamSpec* pspec,
+                                         gpointer user_data)
+{
+  InfTestTcpThroughput* test;
+  InfTcpConnectionStatus status;
+
+  test = (InfTestTcpThroughput*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_TCP_CONNECTION_CONNECTED)
+  {
+    g_timer_start(test->timer);
+    inf_test_tcp_throughput_fill(test);
+  }
+}
+
+static void
+inf_test_tcp_throughput_new_connection_cb(InfdTcpServer* server,
+                                          InfTcpConnection* connection,
+                                          gpointer user_data)
+{
+  InfTestTcpThroughput* test;
+  test = (InfTestTcpThroughput*)user_data;
+
+  g_assert(test->server_connection == NULL);
+  test->server_connection = connection;
+  g_object_ref(connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_tcp_throughput_received_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "error",
+    G_CALLBACK(inf_test_tcp_throughput_error_cb),
+    test
+  );
+}
+
+static void
+inf_test_tcp_throughput_close(InfTcpConnection* connection)
+{
+  InfTcpConnectionStatus status;
+  g_object_get(G_OBJECT(connection), "status", &status, NULL);
+
+  if(status != INF_TCP_CONNECTION_CLOSED)
+    inf_tcp_connection_close(connection);
+  g_object_unref(connection);
+}
+
+static gboolean
+inf_test_tcp_throughput_run(InfStandaloneIo* io,
+                            guint chunk_size,
+                            guint64 total)
+{
+  InfTestTcpThroughput test;
+  InfdTcpServer* server;
+  InfdTcpServerStatus status;
+  InfIpAddress* address;
+  guint port;
+  GError* error;
+  gdouble elapsed;
+
+  test.io = io;
+  test.client = NULL;
+  test.server_connection = NULL;
+  test.chunk = g_malloc(chunk_size);
+  test.chunk_size = chunk_size;
+  test.total = total;
+  test.queued = 0;
+  test.sent = 0;
+  test.received = 0;
+  test.filling = FALSE;
+  test.failed = FALSE;
+  test.timer = g_timer_new();
+
+  memset(test.chunk, 'x', chunk_size);
+
+  address = inf_ip_address_new_loopback4();
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-address", address,
+    "local-port", 0,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_tcp_throughput_new_connection_cb),
+    &test
+  );
+
+  error = NULL;
+  if(!infd_tcp_server_open(server, &error))
+  {
+    inf_test_tcp_throughput_fail(&test, error);
+    g_error_free(error);
+  }
+  else
+  {
+    g_object_get(G_OBJECT(server), "local-port", &port, NULL);
+    test.client = inf_tcp_connection_new(INF_IO(io), address, port);
+
+    g_signal_connect(
+      G_OBJECT(test.client),
+      "sent",
+      G_CALLBACK(inf_test_tcp_throughput_sent_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(test.client),
+      "error",
+      G_CALLBACK(inf_test_tcp_throughput_error_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(test.client),
+      "notify::status",
+      G_CALLBACK(inf_test_tcp_throughput_notify_status_cb),
+      &test
+    );
+
+    if(!inf_tcp_connection_open(test.client, &error))
+    {
+      inf_test_tcp_throughput_fail(&test, error);
+      g_error_free(error);
+    }
+    else
+    {
+      inf_standalone_io_loop(io);
+    }
+  }
+
+  if(!test.failed)
+  {
+    elapsed = g_timer_elapsed(test.timer, NULL);
+
+    printf(
+      "Chunk size %6u: %" G_GUINT64_FORMAT " MiB in %.3f secs "
+      "(%.1f MiB/s)\n",
+      chunk_size,
+      total / (1024 * 1024),
+      elapsed,
+      (total / (1024.0 * 1024.0)) / elapsed
+    );
+  }
+
+  if(test.client != NULL)
+    inf_test_tcp_throughput_close(test.client);
+  if(test.server_connection != NULL)
+    inf_test_tcp_throughput_close(test.server_connection);
+
+  g_object_get(G_OBJECT(server), "status", &status, NULL);
+  if(status != INFD_TCP_SERVER_CLOSED)
+    infd_tcp_server_close(server);
+  g_object_unref(server);
+  inf_ip_address_free(address);
+
+  g_timer_destroy(test.timer);
+  g_free(test.chunk);
+
+  return !test.failed;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  GError* error;
+  guint megabytes;
+  gboolean result;
+  guint i;
+
+  megabytes = 256;
+  if(argc > 1)
+    megabytes = atoi(argv[1]);
+
+  if(argc > 2 || megabytes == 0)
+  {
+    fprintf(stderr, "Usage: %s [<megabytes>]\n", argv[0]);
+    return 1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  io = inf_standalone_io_new();
+  result = TRUE;
+
+  for(i = 0; i < G_N_ELEMENTS(INF_TEST_TCP_THROUGHPUT_CHUNK_SIZES); ++i)
+  {
+    result = inf_test_tcp_throughput_run(
+      io,
+      INF_TEST_TCP_THROUGHPUT_CHUNK_SIZES[i],
+      (guint64)megabytes * 1024 * 1024
+    );
+
+    if(!result)
+      break;
+  }
+
+  g_object_unref(io);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
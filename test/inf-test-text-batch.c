@@ -0,0 +1,512 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Generates a history of Do, Undo and Redo requests from several users, and
+ * executes it on two other sessions, once request by request with
+ * inf_adopted_algorithm_execute_request() and once at once with
+ * inf_adopted_algorithm_execute_requests(). Verifies that both end up in the
+ * same state as the original session. Then checks that a batch stops at a
+ * request that cannot be executed and reports an error for it. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_BATCH_USERS 8
+#define INF_TEST_TEXT_BATCH_REQUESTS 3000
+
+typedef struct _InfTestTextBatch InfTestTextBatch;
+struct _InfTestTextBatch {
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+  InfAdoptedAlgorithm* algorithm;
+  guint modified_notifications;
+};
+
+static void
+inf_test_text_batch_notify_modified_cb(GObject* object,
+                                       GParamSpec* pspec,
+                                       gpointer user_data)
+{
+  InfTestTextBatch* test;
+  test = (InfTestTextBatch*)user_data;
+
+  ++test->modified_notifications;
+}
+
+static void
+inf_test_text_batch_init(InfTestTextBatch* test)
+{
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  gchar* user_name;
+  guint i;
+
+  test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  test->modified_notifications = 0;
+
+  g_signal_connect(
+    G_OBJECT(test->buffer),
+    "notify::modified",
+    G_CALLBACK(inf_test_text_batch_notify_modified_cb),
+    test
+  );
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= INF_TEST_TEXT_BATCH_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  test->session = inf_text_session_new_with_user_table(
+    manager,
+    test->buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  test->algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(test->session));
+
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+}
+
+static void
+inf_test_text_batch_finalize(InfTestTextBatch* test)
+{
+  g_object_unref(test->session);
+  g_object_unref(test->buffer);
+}
+
+static InfAdoptedUser*
+inf_test_text_batch_lookup_user(InfTestTextBatch* test,
+                                guint user_id)
+{
+  InfUserTable* user_table;
+  user_table = inf_session_get_user_table(INF_SESSION(test->session));
+
+  return INF_ADOPTED_USER(
+    inf_user_table_lookup_user_by_id(user_table, user_id)
+  );
+}
+
+static InfAdoptedOperation*
+inf_test_text_batch_make_operation(InfTextBuffer* buffer,
+                                   guint user_id,
+                                   GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  gchar text;
+
+  length = inf_text_buffer_get_length(buffer);
+  pos = g_rand_int_range(rand, 0, length + 1);
+
+  if(length > 0 && g_rand_int_range(rand, 0, 3) == 0)
+  {
+    if(pos == length) --pos;
+    chunk = inf_text_buffer_get_slice(buffer, pos, 1);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_delete_operation_new(pos, chunk)
+    );
+  }
+  else
+  {
+    text = 'a' + g_rand_int_range(rand, 0, 26);
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, &text, 1, 1, user_id);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(pos, chunk)
+    );
+  }
+
+  inf_text_chunk_free(chunk);
+  return operation;
+}
+
+/* Makes requests on source and stores them in requests, in the order they
+ * were executed. The last user does not make any requests. */
+static void
+inf_test_text_batch_generate(InfTestTextBatch* source,
+                             GPtrArray* requests,
+                             GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  InfAdoptedRequestType type;
+  gboolean result;
+  guint user_id;
+  guint i;
+
+  for(i = 0; i < INF_TEST_TEXT_BATCH_REQUESTS; ++i)
+  {
+    user_id = g_rand_int_range(rand, 1, INF_TEST_TEXT_BATCH_USERS);
+    user = inf_test_text_batch_lookup_user(source, user_id);
+
+    type = INF_ADOPTED_REQUEST_DO;
+    switch(g_rand_int_range(rand, 0, 6))
+    {
+    case 0:
+      if(inf_adopted_algorithm_can_undo(source->algorithm, user))
+        type = INF_ADOPTED_REQUEST_UNDO;
+      break;
+    case 1:
+      if(inf_adopted_algorithm_can_redo(source->algorithm, user))
+        type = INF_ADOPTED_REQUEST_REDO;
+      break;
+    default:
+      break;
+    }
+
+    operation = NULL;
+    if(type == INF_ADOPTED_REQUEST_DO)
+    {
+      operation = inf_test_text_batch_make_operation(
+        source->buffer,
+        user_id,
+        rand
+      );
+    }
+
+    request = inf_adopted_algorithm_generate_request(
+      source->algorithm,
+      type,
+      user,
+      operation
+    );
+
+    if(operation != NULL)
+      g_object_unref(operation);
+
+    result = inf_adopted_algorithm_execute_request(
+      source->algorithm,
+      request,
+      TRUE,
+      NULL
+    );
+
+    g_assert(result == TRUE);
+    g_ptr_array_add(requests, request);
+  }
+}
+
+static gboolean
+inf_test_text_batch_compare(InfTestTextBatch* first,
+                            InfTestTextBatch* second)
+{
+  InfTextChunk* first_chunk;
+  InfTextChunk* second_chunk;
+  InfAdoptedUser* first_user;
+  InfAdoptedUser* second_user;
+  gboolean result;
+  guint i;
+
+  first_chunk = inf_text_buffer_get_slice(
+    first->buffer,
+    0,
+    inf_text_buffer_get_length(first->buffer)
+  );
+
+  second_chunk = inf_text_buffer_get_slice(
+    second->buffer,
+    0,
+    inf_text_buffer_get_length(second->buffer)
+  );
+
+  result = inf_adopted_state_vector_compare(
+    inf_adopted_algorithm_get_current(first->algorithm),
+    inf_adopted_algorithm_get_current(second->algorithm)
+  ) == 0 && inf_text_chunk_equal(first_chunk, second_chunk);
+
+  inf_text_chunk_free(first_chunk);
+  inf_text_chunk_free(second_chunk);
+
+  for(i = 1; i <= INF_TEST_TEXT_BATCH_USERS && result; ++i)
+  {
+    first_user = inf_test_text_batch_lookup_user(first, i);
+    second_user = inf_test_text_batch_lookup_user(second, i);
+
+    if(inf_adopted_algorithm_can_undo(first->algorithm, first_user) !=
+       inf_adopted_algorithm_can_undo(second->algorithm, second_user) ||
+       inf_adopted_algorithm_can_redo(first->algorithm, first_user) !=
+       inf_adopted_algorithm_can_redo(second->algorithm, second_user))
+    {
+      result = FALSE;
+    }
+  }
+
+  return result;
+}
+
+static void
+inf_test_text_batch_log_func(const gchar* log_domain,
+                             GLogLevelFlags log_level,
+                             const gchar* message,
+                             gpointer user_data)
+{
+  /* Expected criticals from precondition checks */
+}
+
+/* Checks that a batch stops at an Undo request of a user who has nothing to
+ * undo, and at a request that is not causally before the current state. */
+static gboolean
+inf_test_text_batch_check_errors(GPtrArray* requests)
+{
+  InfTestTextBatch target;
+  InfAdoptedRequest* undo;
+  InfAdoptedRequest* batch[3];
+  GError* error;
+  guint n_executed;
+  guint handler;
+  GQuark domain;
+  gboolean result;
+  guint k;
+
+  domain = g_quark_from_static_string("INF_ADOPTED_ALGORITHM_ERROR");
+  inf_test_text_batch_init(&target);
+  k = requests->len / 2;
+
+  /* Bring target to the state before request k */
+  result = inf_adopted_algorithm_execute_requests(
+    target.algorithm,
+    (InfAdoptedRequest**)requests->pdata,
+    k - 1,
+    TRUE,
+    &n_executed,
+    NULL
+  );
+
+  g_assert(result == TRUE && n_executed == k - 1);
+
+  undo = inf_adopted_request_new_undo(
+    inf_adopted_request_get_vector(g_ptr_array_index(requests, k)),
+    INF_TEST_TEXT_BATCH_USERS,
+    g_get_real_time()
+  );
+
+  batch[0] = g_ptr_array_index(requests, k - 1);
+  batch[1] = undo;
+  batch[2] = g_ptr_array_index(requests, k);
+
+  error = NULL;
+  result = inf_adopted_algorithm_execute_requests(
+    target.algorithm,
+    batch,
+    3,
+    TRUE,
+    &n_executed,
+    &error
+  );
+
+  g_object_unref(undo);
+
+  if(result == TRUE || n_executed != 1 || error == NULL ||
+     error->domain != domain ||
+     error->code != INF_ADOPTED_ALGORITHM_ERROR_NO_UNDO ||
+     inf_adopted_state_vector_compare(
+       inf_adopted_algorithm_get_current(target.algorithm),
+       inf_adopted_request_get_vector(g_ptr_array_index(requests, k))
+     ) != 0)
+  {
+    if(error != NULL) g_error_free(error);
+    inf_test_text_batch_finalize(&target);
+    return FALSE;
+  }
+
+  g_error_free(error);
+
+  /* Request k + 1 depends on request k, which has not been executed */
+  handler = g_log_set_handler(
+    NULL,
+    G_LOG_LEVEL_CRITICAL,
+    inf_test_text_batch_log_func,
+    NULL
+  );
+
+  error = NULL;
+  result = inf_adopted_algorithm_execute_requests(
+    target.algorithm,
+    (InfAdoptedRequest**)requests->pdata + k + 1,
+    1,
+    TRUE,
+    &n_executed,
+    &error
+  );
+
+  g_log_remove_handler(NULL, handler);
+
+  if(result == TRUE || n_executed != 0 || error == NULL ||
+     error->domain != domain ||
+     error->code != INF_ADOPTED_ALGORITHM_ERROR_FAILED)
+  {
+    if(error != NULL) g_error_free(error);
+    inf_test_text_batch_finalize(&target);
+    return FALSE;
+  }
+
+  g_error_free(error);
+  inf_test_text_batch_finalize(&target);
+  return TRUE;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTextBatch source;
+  InfTestTextBatch single;
+  InfTestTextBatch batch;
+  GPtrArray* requests;
+  GTimer* timer;
+  gdouble single_time;
+  gdouble batch_time;
+  GError* error;
+  GRand* rand;
+  guint rseed;
+  guint n_executed;
+  gboolean result;
+  guint i;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+  requests = g_ptr_array_new();
+
+  inf_test_text_batch_init(&source);
+  inf_test_text_batch_init(&single);
+  inf_test_text_batch_init(&batch);
+
+  inf_test_text_batch_generate(&source, requests, rand);
+
+  timer = g_timer_new();
+  for(i = 0; i < requests->len; ++i)
+  {
+    result = inf_adopted_algorithm_execute_request(
+      single.algorithm,
+      g_ptr_array_index(requests, i),
+      TRUE,
+      NULL
+    );
+
+    g_assert(result == TRUE);
+  }
+  single_time = g_timer_elapsed(timer, NULL);
+
+  g_timer_start(timer);
+  result = inf_adopted_algorithm_execute_requests(
+    batch.algorithm,
+    (InfAdoptedRequest**)requests->pdata,
+    requests->len,
+    TRUE,
+    &n_executed,
+    &error
+  );
+  batch_time = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  if(result == FALSE)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  result = result && n_executed == requests->len &&
+    inf_test_text_batch_compare(&source, &single) &&
+    inf_test_text_batch_compare(&source, &batch) &&
+    batch.modified_notifications <= 1;
+
+  printf(
+    "Single: %g secs, batch: %g secs, %u requests... %s\n",
+    single_time,
+    batch_time,
+    requests->len,
+    result ? "OK" : "FAILED"
+  );
+
+  if(result)
+  {
+    result = inf_test_text_batch_check_errors(requests);
+    printf("Failing requests... %s\n", result ? "OK" : "FAILED");
+  }
+
+  for(i = 0; i < requests->len; ++i)
+    g_object_unref(g_ptr_array_index(requests, i));
+  g_ptr_array_free(requests, TRUE);
+
+  inf_test_text_batch_finalize(&source);
+  inf_test_text_batch_finalize(&single);
+  inf_test_text_batch_finalize(&batch);
+
+  g_rand_free(rand);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
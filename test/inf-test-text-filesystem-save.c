@@ -0,0 +1,615 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Saves a synthetic document consisting of many small segments by different
+ * authors with inf_text_filesystem_format_write(), and for comparison by
+ * building the full XML tree first and dumping it, as the filesystem format
+ * used to do. Prints the time and the peak amount of memory allocated by
+ * libxml2 for both, and verifies that both files read back into the
+ * original document, printing the same for loading them as well. Does the
+ * same for the binary format, on its own and next to the XML file, and
+ * checks that a corrupted binary file is ignored in favor of the XML file.
+ * The number of segments can be given on the command line. */
+
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-xml-util.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <libxml/xmlmemory.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_TEXT_FILESYSTEM_SAVE_USERS 4
+#define INF_TEST_TEXT_FILESYSTEM_SAVE_SEGMENTS 100000
+
+/* Keep track of the memory allocated by libxml2. Every block is prefixed
+ * with its size so that frees can be accounted for. */
+typedef union _InfTestTextFilesystemSaveHeader {
+  size_t size;
+  gdouble align_double;
+  gpointer align_pointer;
+} InfTestTextFilesystemSaveHeader;
+
+static gsize inf_test_text_filesystem_save_current;
+static gsize inf_test_text_filesystem_save_peak;
+
+static void*
+inf_test_text_filesystem_save_malloc(size_t size)
+{
+  InfTestTextFilesystemSaveHeader* header;
+
+  header = malloc(sizeof(InfTestTextFilesystemSaveHeader) + size);
+  if(header == NULL) return NULL;
+
+  header->size = size;
+  inf_test_text_filesystem_save_current += size;
+  if(inf_test_text_filesystem_save_current >
+     inf_test_text_filesystem_save_peak)
+  {
+    inf_test_text_filesystem_save_peak =
+      inf_test_text_filesystem_save_current;
+  }
+
+  return header + 1;
+}
+
+static void
+inf_test_text_filesystem_save_free(void* ptr)
+{
+  InfTestTextFilesystemSaveHeader* header;
+
+  if(ptr != NULL)
+  {
+    header = (InfTestTextFilesystemSaveHeader*)ptr - 1;
+    inf_test_text_filesystem_save_current -= header->size;
+    free(header);
+  }
+}
+
+static void*
+inf_test_text_filesystem_save_realloc(void* ptr,
+                                      size_t size)
+{
+  void* new_ptr;
+  size_t old_size;
+
+  if(ptr == NULL)
+    return inf_test_text_filesystem_save_malloc(size);
+
+  old_size = ((InfTestTextFilesystemSaveHeader*)ptr - 1)->size;
+  new_ptr = inf_test_text_filesystem_save_malloc(size);
+  if(new_ptr == NULL) return NULL;
+
+  memcpy(new_ptr, ptr, MIN(old_size, size));
+  inf_test_text_filesystem_save_free(ptr);
+  return new_ptr;
+}
+
+static char*
+inf_test_text_filesystem_save_strdup(const char* str)
+{
+  char* copy;
+  size_t len;
+
+  len = strlen(str);
+  copy = inf_test_text_filesystem_save_malloc(len + 1);
+  if(copy != NULL) memcpy(copy, str, len + 1);
+  return copy;
+}
+
+static void
+inf_test_text_filesystem_save_fill(InfTextBuffer* buffer,
+                                   InfUserTable* user_table,
+                                   guint n_segments,
+                                   GRand* rand)
+{
+  InfUser* user;
+  gchar text[16];
+  guint author;
+  guint last_author;
+  guint len;
+  guint i;
+  guint j;
+
+  last_author = 0;
+  for(i = 0; i < n_segments; ++i)
+  {
+    /* Make sure that every insertion starts a new segment. Author 0 stands
+     * for text that was not written by any user. */
+    do
+    {
+      author = g_rand_int_range(rand, 0, INF_TEST_TEXT_FILESYSTEM_SAVE_USERS);
+    } while(author == last_author && i > 0);
+
+    len = g_rand_int_range(rand, 1, sizeof(text) + 1);
+    for(j = 0; j < len; ++j)
+    {
+      /* Throw in a character that cannot be represented in XML text now
+       * and then, so that <uchar> elements are written as well. */
+      if(g_rand_int_range(rand, 0, 64) == 0)
+        text[j] = '\f';
+      else if(g_rand_int_range(rand, 0, 16) == 0)
+        text[j] = '<';
+      else
+        text[j] = 'a' + g_rand_int_range(rand, 0, 26);
+    }
+
+    if(author != 0)
+      user = inf_user_table_lookup_user_by_id(user_table, author);
+    else
+      user = NULL;
+
+    inf_text_buffer_insert_text(
+      buffer,
+      inf_text_buffer_get_length(buffer),
+      text,
+      len,
+      len,
+      user
+    );
+
+    last_author = author;
+  }
+}
+
+/* Saves the document by building the complete XML tree first */
+static gboolean
+inf_test_text_filesystem_save_write_dom(InfdFilesystemStorage* storage,
+                                        const gchar* path,
+                                        InfUserTable* user_table,
+                                        InfTextBuffer* buffer,
+                                        GError** error)
+{
+  InfTextBufferIter* iter;
+  InfUser* user;
+  xmlNodePtr root;
+  xmlNodePtr buffer_node;
+  xmlNodePtr node;
+  xmlDocPtr doc;
+  gchar* content;
+  FILE* stream;
+  guint i;
+  int result;
+
+  stream = infd_filesystem_storage_open(
+    storage,
+    "InfText",
+    path,
+    "w",
+    NULL,
+    error
+  );
+
+  if(stream == NULL)
+    return FALSE;
+
+  root = xmlNewNode(NULL, (const xmlChar*)"inf-text-session");
+  for(i = 1; i < INF_TEST_TEXT_FILESYSTEM_SAVE_USERS; ++i)
+  {
+    user = inf_user_table_lookup_user_by_id(user_table, i);
+    node = xmlNewChild(root, NULL, (const xmlChar*)"user", NULL);
+
+    inf_xml_util_set_attribute_uint(node, "id", inf_user_get_id(user));
+    inf_xml_util_set_attribute(node, "name", inf_user_get_name(user));
+    inf_xml_util_set_attribute_double(
+      node,
+      "hue",
+      inf_text_user_get_hue(INF_TEXT_USER(user))
+    );
+  }
+
+  buffer_node = xmlNewChild(root, NULL, (const xmlChar*)"buffer", NULL);
+  iter = inf_text_buffer_create_begin_iter(buffer);
+  g_assert(iter != NULL);
+
+  do
+  {
+    content = inf_text_buffer_iter_get_text(buffer, iter);
+    node = xmlNewChild(buffer_node, NULL, (const xmlChar*)"segment", NULL);
+
+    inf_xml_util_set_attribute_uint(
+      node,
+      "author",
+      inf_text_buffer_iter_get_author(buffer, iter)
+    );
+
+    inf_xml_util_add_child_text(
+      node,
+      content,
+      inf_text_buffer_iter_get_bytes(buffer, iter)
+    );
+
+    g_free(content);
+  } while(inf_text_buffer_iter_next(buffer, iter));
+
+  inf_text_buffer_destroy_iter(buffer, iter);
+
+  doc = xmlNewDoc((const xmlChar*)"1.0");
+  xmlDocSetRootElement(doc, root);
+
+  result = xmlDocFormatDump(stream, doc, 1);
+  infd_filesystem_storage_stream_close(stream);
+  xmlFreeDoc(doc);
+
+  if(result == -1)
+  {
+    g_set_error_literal(
+      error,
+      g_quark_from_static_string("INF_TEST_TEXT_FILESYSTEM_SAVE_ERROR"),
+      0,
+      "Failed to write XML document"
+    );
+
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+inf_test_text_filesystem_save_text_inserted_cb(InfTextBuffer* buffer,
+                                               guint pos,
+                                               InfTextChunk* chunk,
+                                               InfUser* user,
+                                               gpointer user_data)
+{
+  ++ *(guint*)user_data;
+}
+
+static gboolean
+inf_test_text_filesystem_save_verify(InfdFilesystemStorage* storage,
+                                     const gchar* path,
+                                     InfTextBuffer* buffer,
+                                     GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* read_buffer;
+  InfTextChunk* chunk;
+  InfTextChunk* read_chunk;
+  GTimer* timer;
+  guint n_inserted;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  read_buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  n_inserted = 0;
+
+  g_signal_connect(
+    G_OBJECT(read_buffer),
+    "text-inserted",
+    G_CALLBACK(inf_test_text_filesystem_save_text_inserted_cb),
+    &n_inserted
+  );
+
+  inf_test_text_filesystem_save_current = 0;
+  inf_test_text_filesystem_save_peak = 0;
+  timer = g_timer_new();
+
+  result = inf_text_filesystem_format_read(
+    storage,
+    path,
+    user_table,
+    read_buffer,
+    error
+  );
+
+  printf(
+    "  Loading: %g secs, %" G_GSIZE_FORMAT " KiB peak libxml2 memory, "
+    "%u insertions\n",
+    g_timer_elapsed(timer, NULL),
+    inf_test_text_filesystem_save_peak / 1024,
+    n_inserted
+  );
+
+  g_timer_destroy(timer);
+
+  if(result == TRUE)
+  {
+    chunk = inf_text_buffer_get_slice(
+      buffer,
+      0,
+      inf_text_buffer_get_length(buffer)
+    );
+
+    read_chunk = inf_text_buffer_get_slice(
+      read_buffer,
+      0,
+      inf_text_buffer_get_length(read_buffer)
+    );
+
+    result = inf_text_chunk_equal(chunk, read_chunk);
+
+    inf_text_chunk_free(chunk);
+    inf_text_chunk_free(read_chunk);
+  }
+
+  g_object_unref(read_buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+/* Flips a byte in the middle of the binary file stored next to the XML
+ * file at path */
+static gboolean
+inf_test_text_filesystem_save_corrupt(InfdFilesystemStorage* storage,
+                                      const gchar* path,
+                                      GError** error)
+{
+  gchar* full_path;
+  gchar* content;
+  gsize length;
+  gboolean result;
+
+  full_path = infd_filesystem_storage_get_path(
+    storage,
+    "InfText.bin",
+    path,
+    error
+  );
+
+  if(full_path == NULL)
+    return FALSE;
+
+  result = g_file_get_contents(full_path, &content, &length, error);
+  if(result == TRUE)
+  {
+    content[length / 2] ^= 0x01;
+    result = g_file_set_contents(full_path, content, length, error);
+    g_free(content);
+  }
+
+  g_free(full_path);
+  return result;
+}
+
+static gboolean
+inf_test_text_filesystem_save_run(InfdFilesystemStorage* storage,
+                                  const gchar* name,
+                                  const gchar* path,
+                                  gboolean dom,
+                                  InfTextFilesystemFormatType type,
+                                  InfUserTable* user_table,
+                                  InfTextBuffer* buffer)
+{
+  GTimer* timer;
+  gdouble elapsed;
+  gsize peak;
+  gboolean result;
+  GError* error;
+
+  error = NULL;
+  timer = g_timer_new();
+
+  inf_test_text_filesystem_save_current = 0;
+  inf_test_text_filesystem_save_peak = 0;
+
+  if(dom)
+  {
+    result = inf_test_text_filesystem_save_write_dom(
+      storage,
+      path,
+      user_table,
+      buffer,
+      &error
+    );
+  }
+  else
+  {
+    result = inf_text_filesystem_format_write_with_type(
+      storage,
+      path,
+      user_table,
+      buffer,
+      type,
+      &error
+    );
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  peak = inf_test_text_filesystem_save_peak;
+  g_timer_destroy(timer);
+
+  printf(
+    "%s: %g secs, %" G_GSIZE_FORMAT " KiB peak libxml2 memory\n",
+    name,
+    elapsed,
+    peak / 1024
+  );
+
+  if(result == TRUE)
+    result = inf_test_text_filesystem_save_verify(storage, path, buffer, &error);
+
+  /* The XML file needs to be used if the binary file is broken */
+  if(result == TRUE && type == INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY)
+  {
+    printf("%s, corrupted binary file:\n", name);
+    result = inf_test_text_filesystem_save_corrupt(storage, path, &error);
+
+    if(result == TRUE)
+    {
+      result = inf_test_text_filesystem_save_verify(
+        storage,
+        path,
+        buffer,
+        &error
+      );
+    }
+  }
+
+  printf("%s... %s\n", name, result ? "OK" : "FAILED");
+
+  if(error != NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfUser* user;
+  GRand* rand;
+  GError* error;
+  gchar* root;
+  gchar* user_name;
+  guint n_segments;
+  gboolean result;
+  guint i;
+
+  if(argc > 1)
+    n_segments = atoi(argv[1]);
+  else
+    n_segments = INF_TEST_TEXT_FILESYSTEM_SAVE_SEGMENTS;
+
+  if(n_segments == 0)
+  {
+    fprintf(stderr, "Number of segments must be positive\n");
+    return 1;
+  }
+
+  /* This needs to be done before libxml2 allocates anything */
+  xmlMemSetup(
+    inf_test_text_filesystem_save_free,
+    inf_test_text_filesystem_save_malloc,
+    inf_test_text_filesystem_save_realloc,
+    inf_test_text_filesystem_save_strdup
+  );
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root = g_dir_make_tmp("inf-test-text-filesystem-save-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  user_table = inf_user_table_new();
+  for(i = 1; i < INF_TEST_TEXT_FILESYSTEM_SAVE_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "hue", i / (gdouble)INF_TEST_TEXT_FILESYSTEM_SAVE_USERS,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  rand = g_rand_new_with_seed(42);
+  inf_test_text_filesystem_save_fill(buffer, user_table, n_segments, rand);
+  g_rand_free(rand);
+
+  printf("Saving %u segments\n", n_segments);
+
+  storage = infd_filesystem_storage_new(root);
+
+  result = inf_test_text_filesystem_save_run(
+    storage,
+    "XML tree",
+    "/dom",
+    TRUE,
+    INF_TEXT_FILESYSTEM_FORMAT_XML,
+    user_table,
+    buffer
+  );
+
+  if(result)
+  {
+    result = inf_test_text_filesystem_save_run(
+      storage,
+      "Streaming",
+      "/stream",
+      FALSE,
+      INF_TEXT_FILESYSTEM_FORMAT_XML,
+      user_table,
+      buffer
+    );
+  }
+
+  if(result)
+  {
+    result = inf_test_text_filesystem_save_run(
+      storage,
+      "Binary",
+      "/binary",
+      FALSE,
+      INF_TEXT_FILESYSTEM_FORMAT_BINARY,
+      user_table,
+      buffer
+    );
+  }
+
+  if(result)
+  {
+    result = inf_test_text_filesystem_save_run(
+      storage,
+      "XML with binary",
+      "/xml-with-binary",
+      FALSE,
+      INF_TEXT_FILESYSTEM_FORMAT_XML_WITH_BINARY,
+      user_table,
+      buffer
+    );
+  }
+
+  g_object_unref(storage);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+
+  if(!inf_file_util_delete(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
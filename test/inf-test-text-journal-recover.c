@@ -0,0 +1,157 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Recovers a text document that was stored with InfTextFilesystemJournal,
+ * by reading its snapshot and applying the entries of its journal files,
+ * and prints the recovered text. With -w, a new snapshot of the recovered
+ * document is written, replacing the journal files. */
+
+#include <libinftext/inf-text-filesystem-journal.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static void
+inf_test_text_journal_recover_print_buffer(InfTextBuffer* buffer)
+{
+  InfTextChunk* chunk;
+  gchar* text;
+  gsize bytes;
+
+  chunk = inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+
+  text = inf_text_chunk_get_text(chunk, &bytes);
+  inf_text_chunk_free(chunk);
+
+  fwrite(text, 1, bytes, stdout);
+  g_free(text);
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfStandaloneIo* io;
+  InfTextFilesystemJournal* journal;
+  GError* error;
+  gboolean write;
+  gint64 sequence;
+  int ret;
+
+  write = FALSE;
+  if(argc == 4 && strcmp(argv[1], "-w") == 0)
+  {
+    write = TRUE;
+    ++argv;
+    --argc;
+  }
+
+  if(argc != 3)
+  {
+    fprintf(stderr, "Usage: %s [-w] <root-directory> <path>\n", argv[0]);
+    return 1;
+  }
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  storage = infd_filesystem_storage_new(argv[1]);
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  ret = 0;
+  if(!inf_text_filesystem_journal_recover(storage, argv[2], user_table,
+                                          buffer, &sequence, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    ret = 1;
+  }
+  else
+  {
+    inf_test_text_journal_recover_print_buffer(buffer);
+
+    if(sequence < 0)
+    {
+      fprintf(stderr, "Document \"%s\" has no journal\n", argv[2]);
+    }
+    else
+    {
+      fprintf(
+        stderr,
+        "Recovered document \"%s\" up to journal entry %" G_GINT64_FORMAT "\n",
+        argv[2],
+        sequence
+      );
+    }
+
+    if(write)
+    {
+      /* Writing the snapshot removes the journal files, and the new journal
+       * is empty when it is released right away. */
+      io = inf_standalone_io_new();
+
+      journal = inf_text_filesystem_journal_create(
+        INF_IO(io),
+        storage,
+        argv[2],
+        user_table,
+        buffer,
+        &error
+      );
+
+      if(journal == NULL)
+      {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        ret = 1;
+      }
+      else
+      {
+        fprintf(stderr, "Wrote new snapshot of document \"%s\"\n", argv[2]);
+        g_object_unref(journal);
+      }
+
+      g_object_unref(io);
+    }
+  }
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  g_object_unref(storage);
+  inf_deinit();
+  return ret;
+}
+
+/* vim:set et sw=2 ts=2: */
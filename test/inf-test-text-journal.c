@@ -0,0 +1,518 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Records random edits of a document with InfTextFilesystemJournal in a
+ * temporary storage, and verifies that the document can be recovered from
+ * the snapshot and journal: after syncing, while a compaction has written a
+ * new snapshot in the background, and when the last journal entry was cut
+ * off by a crash. Finally, removes the document and checks that its journal
+ * is removed with it. */
+
+#include <libinftext/inf-text-filesystem-journal.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/server/infd-storage.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_JOURNAL_USERS 4
+#define INF_TEST_TEXT_JOURNAL_EDITS 2000
+
+static const gchar* const INF_TEST_TEXT_JOURNAL_CHARS[] = {
+  "a", "b", "c", " ", "\n", "<", "&", "\xc3\xa4", "\xe2\x82\xac"
+};
+
+static void
+inf_test_text_journal_insert_text(InfTextChunk* chunk,
+                                  guint author,
+                                  GRand* rand)
+{
+  GString* text;
+  guint len;
+  guint i;
+
+  text = g_string_new(NULL);
+  len = g_rand_int_range(rand, 1, 20);
+
+  for(i = 0; i < len; ++i)
+  {
+    g_string_append(
+      text,
+      INF_TEST_TEXT_JOURNAL_CHARS[
+        g_rand_int_range(rand, 0, G_N_ELEMENTS(INF_TEST_TEXT_JOURNAL_CHARS))
+      ]
+    );
+  }
+
+  inf_text_chunk_insert_text(
+    chunk,
+    inf_text_chunk_get_length(chunk),
+    text->str,
+    text->len,
+    len,
+    author
+  );
+
+  g_string_free(text, TRUE);
+}
+
+/* Returns the ID of a random user of user_table, or 0 */
+static guint
+inf_test_text_journal_author(InfUserTable* user_table,
+                             GRand* rand)
+{
+  guint author;
+  author = g_rand_int_range(rand, 0, INF_TEST_TEXT_JOURNAL_USERS + 1);
+
+  if(inf_user_table_lookup_user_by_id(user_table, author) == NULL)
+    return 0;
+  return author;
+}
+
+static void
+inf_test_text_journal_edit(InfTextBuffer* buffer,
+                           InfUserTable* user_table,
+                           GRand* rand)
+{
+  InfTextChunk* chunk;
+  InfUser* user;
+  guint length;
+  guint pos;
+  guint len;
+  guint author;
+
+  length = inf_text_buffer_get_length(buffer);
+  pos = g_rand_int_range(rand, 0, length + 1);
+
+  author = inf_test_text_journal_author(user_table, rand);
+  user = inf_user_table_lookup_user_by_id(user_table, author);
+
+  if(length > 0 && g_rand_int_range(rand, 0, 3) == 0)
+  {
+    if(pos == length) --pos;
+    len = g_rand_int_range(rand, 1, MIN(length - pos, 30) + 1);
+    inf_text_buffer_erase_text(buffer, pos, len, user);
+  }
+  else
+  {
+    /* Sometimes insert text of several authors at once */
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_test_text_journal_insert_text(chunk, author, rand);
+    if(g_rand_int_range(rand, 0, 4) == 0)
+    {
+      author = inf_test_text_journal_author(user_table, rand);
+      inf_test_text_journal_insert_text(chunk, author, rand);
+    }
+
+    inf_text_buffer_insert_chunk(buffer, pos, chunk, user);
+    inf_text_chunk_free(chunk);
+  }
+}
+
+static InfTextChunk*
+inf_test_text_journal_get_content(InfTextBuffer* buffer)
+{
+  return inf_text_buffer_get_slice(
+    buffer,
+    0,
+    inf_text_buffer_get_length(buffer)
+  );
+}
+
+/* Recovers the document from storage and compares it to expected */
+static gboolean
+inf_test_text_journal_check(InfdFilesystemStorage* storage,
+                            InfTextChunk* expected,
+                            const gchar* name)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextChunk* content;
+  GError* error;
+  GTimer* timer;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  error = NULL;
+  timer = g_timer_new();
+
+  result = inf_text_filesystem_journal_recover(
+    storage,
+    "/doc",
+    user_table,
+    buffer,
+    NULL,
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("%s... FAILED (%s)\n", name, error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    content = inf_test_text_journal_get_content(buffer);
+    result = inf_text_chunk_equal(content, expected);
+    inf_text_chunk_free(content);
+
+    printf(
+      "%s... %s (%g secs)\n",
+      name,
+      result ? "OK" : "FAILED",
+      g_timer_elapsed(timer, NULL)
+    );
+  }
+
+  g_timer_destroy(timer);
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  return result;
+}
+
+static gboolean
+inf_test_text_journal_exists(InfdFilesystemStorage* storage,
+                             gint64 sequence)
+{
+  gchar* identifier;
+  gchar* path;
+  gboolean result;
+
+  identifier = g_strdup_printf("InfText.journal-%" G_GINT64_FORMAT, sequence);
+  path = infd_filesystem_storage_get_path(storage, identifier, "/doc", NULL);
+  result = g_file_test(path, G_FILE_TEST_EXISTS);
+
+  g_free(path);
+  g_free(identifier);
+  return result;
+}
+
+/* Cuts off the last entry of the journal file in the middle, as if the
+ * server had crashed while writing it */
+static gboolean
+inf_test_text_journal_truncate(InfdFilesystemStorage* storage,
+                               gint64 sequence)
+{
+  gchar* identifier;
+  gchar* path;
+  gchar* content;
+  gsize length;
+  gchar* end;
+  gchar* line;
+  gboolean result;
+
+  identifier = g_strdup_printf("InfText.journal-%" G_GINT64_FORMAT, sequence);
+  path = infd_filesystem_storage_get_path(storage, identifier, "/doc", NULL);
+  g_free(identifier);
+
+  result = g_file_get_contents(path, &content, &length, NULL);
+  if(result == TRUE)
+  {
+    /* Skip the end tag of the journal, and find the last entry */
+    end = g_strrstr_len(content, length - 1, "\n");
+    g_assert(end != NULL);
+    line = g_strrstr_len(content, end - content, "\n");
+    g_assert(line != NULL);
+
+    result = g_file_set_contents(
+      path,
+      content,
+      line + 1 + (end - line) / 2 - content,
+      NULL
+    );
+
+    g_free(content);
+  }
+
+  g_free(path);
+  return result;
+}
+
+/* Removes the document, and checks that this removes its journal and
+ * snapshot files, but not another document whose name starts with the file
+ * name of the document. */
+static gboolean
+inf_test_text_journal_remove(InfdFilesystemStorage* storage,
+                             const gchar* root)
+{
+  FILE* stream;
+  GError* error;
+  GDir* dir;
+  const gchar* name;
+  gboolean found;
+  gboolean result;
+
+  error = NULL;
+  stream = infd_filesystem_storage_open(
+    storage,
+    "InfText",
+    "/doc.InfText.bin",
+    "w",
+    NULL,
+    &error
+  );
+
+  g_assert(stream != NULL);
+  infd_filesystem_storage_stream_close(stream);
+
+  result = infd_storage_remove_node(
+    INFD_STORAGE(storage),
+    "InfText",
+    "/doc",
+    &error
+  );
+
+  if(result == FALSE)
+  {
+    printf("Remove... FAILED (%s)\n", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  dir = g_dir_open(root, 0, NULL);
+  g_assert(dir != NULL);
+
+  found = FALSE;
+  while((name = g_dir_read_name(dir)) != NULL)
+  {
+    if(strcmp(name, "doc.InfText.bin.InfText") == 0)
+      found = TRUE;
+    else
+      result = FALSE;
+  }
+
+  g_dir_close(dir);
+
+  result = result && found;
+  printf("Remove... %s\n", result ? "OK" : "FAILED");
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfdFilesystemStorage* storage;
+  InfStandaloneIo* io;
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextFilesystemJournal* journal;
+  InfTextChunk* expected;
+  InfUser* user;
+  GRand* rand;
+  GError* error;
+  gchar* root;
+  gchar* user_name;
+  gint64 first_sequence;
+  guint rseed;
+  gboolean compacting;
+  gboolean result;
+  guint i;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root = g_dir_make_tmp("inf-test-text-journal-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+  storage = infd_filesystem_storage_new(root);
+  io = inf_standalone_io_new();
+
+  user_table = inf_user_table_new();
+  for(i = 1; i <= INF_TEST_TEXT_JOURNAL_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "hue", g_rand_double(rand),
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, user);
+    g_object_unref(user);
+  }
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  for(i = 0; i < INF_TEST_TEXT_JOURNAL_EDITS / 10; ++i)
+    inf_test_text_journal_edit(buffer, user_table, rand);
+
+  journal = inf_text_filesystem_journal_create(
+    INF_IO(io),
+    storage,
+    "/doc",
+    user_table,
+    buffer,
+    &error
+  );
+
+  if(journal == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  g_object_set(G_OBJECT(journal), "compact-size", 0, NULL);
+
+  /* Replay the journal after syncing */
+  for(i = 0; i < INF_TEST_TEXT_JOURNAL_EDITS; ++i)
+    inf_test_text_journal_edit(buffer, user_table, rand);
+
+  result = inf_text_filesystem_journal_sync(journal, &error);
+  g_assert(result == TRUE);
+
+  expected = inf_test_text_journal_get_content(buffer);
+  result = inf_test_text_journal_check(storage, expected, "Replay");
+  inf_text_chunk_free(expected);
+
+  /* Write a snapshot in the background while more edits are made */
+  if(result)
+  {
+    first_sequence = inf_text_filesystem_journal_get_sequence(journal);
+    result = inf_text_filesystem_journal_compact(journal, &error);
+    g_assert(result == TRUE);
+
+    for(i = 0; i < INF_TEST_TEXT_JOURNAL_EDITS; ++i)
+      inf_test_text_journal_edit(buffer, user_table, rand);
+
+    /* The compaction is finished in the thread running the I/O */
+    g_object_get(G_OBJECT(journal), "compacting", &compacting, NULL);
+    while(compacting)
+    {
+      inf_standalone_io_iteration(io);
+      g_object_get(G_OBJECT(journal), "compacting", &compacting, NULL);
+    }
+
+    result = inf_text_filesystem_journal_sync(journal, &error);
+    g_assert(result == TRUE);
+
+    expected = inf_test_text_journal_get_content(buffer);
+    result = inf_test_text_journal_check(storage, expected, "Compaction");
+    inf_text_chunk_free(expected);
+
+    if(result && inf_test_text_journal_exists(storage, 0))
+    {
+      printf("Compacted journal file was not removed\n");
+      result = FALSE;
+    }
+  }
+
+  /* Lose the last entry in a crash, then continue the journal */
+  if(result)
+  {
+    expected = inf_test_text_journal_get_content(buffer);
+    inf_text_buffer_insert_text(buffer, 0, "crash", 5, 5, NULL);
+
+    g_object_unref(journal);
+    journal = NULL;
+
+    g_object_unref(buffer);
+    g_object_unref(user_table);
+
+    result = inf_test_text_journal_truncate(storage, first_sequence);
+    g_assert(result == TRUE);
+
+    result = inf_test_text_journal_check(storage, expected, "Truncated entry");
+    inf_text_chunk_free(expected);
+
+    user_table = inf_user_table_new();
+    buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+    if(result)
+    {
+      journal = inf_text_filesystem_journal_open(
+        INF_IO(io),
+        storage,
+        "/doc",
+        user_table,
+        buffer,
+        &error
+      );
+
+      g_assert(journal != NULL);
+
+      for(i = 0; i < INF_TEST_TEXT_JOURNAL_EDITS / 10; ++i)
+        inf_test_text_journal_edit(buffer, user_table, rand);
+
+      result = inf_text_filesystem_journal_sync(journal, &error);
+      g_assert(result == TRUE);
+
+      expected = inf_test_text_journal_get_content(buffer);
+      result = inf_test_text_journal_check(storage, expected, "Reopen");
+      inf_text_chunk_free(expected);
+    }
+  }
+
+  if(journal != NULL)
+    g_object_unref(journal);
+
+  if(result)
+    result = inf_test_text_journal_remove(storage, root);
+
+  g_object_unref(buffer);
+  g_object_unref(user_table);
+  g_object_unref(io);
+  g_object_unref(storage);
+  g_rand_free(rand);
+
+  if(!inf_file_util_delete(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,431 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Executes a random history of Do, Undo and Redo requests from several
+ * users, while the users' vectors fall behind, catch up, and users leave
+ * and rejoin. After every step, the least common predecessor is computed
+ * from scratch, and it is verified that inf_adopted_algorithm_cleanup(),
+ * which maintains it incrementally, removes exactly the requests that the
+ * full recomputation allows to be removed. */
+
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_LCP_USERS 6
+#define INF_TEST_TEXT_LCP_REQUESTS 5000
+#define INF_TEST_TEXT_LCP_MAX_TOTAL_LOG_SIZE 32
+
+typedef struct _InfTestTextLcp InfTestTextLcp;
+struct _InfTestTextLcp {
+  InfTextBuffer* buffer;
+  InfUserTable* user_table;
+  InfAdoptedAlgorithm* algorithm;
+};
+
+static InfAdoptedUser*
+inf_test_text_lcp_lookup_user(InfTestTextLcp* test,
+                              guint user_id)
+{
+  return INF_ADOPTED_USER(
+    inf_user_table_lookup_user_by_id(test->user_table, user_id)
+  );
+}
+
+static void
+inf_test_text_lcp_init(InfTestTextLcp* test)
+{
+  InfTextUser* user;
+  gchar* user_name;
+  guint i;
+
+  test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  test->user_table = inf_user_table_new();
+
+  for(i = 1; i <= INF_TEST_TEXT_LCP_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(test->user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  test->algorithm = inf_adopted_algorithm_new_full(
+    test->user_table,
+    INF_BUFFER(test->buffer),
+    INF_TEST_TEXT_LCP_MAX_TOTAL_LOG_SIZE
+  );
+}
+
+static void
+inf_test_text_lcp_finalize(InfTestTextLcp* test)
+{
+  g_object_unref(test->algorithm);
+  g_object_unref(test->user_table);
+  g_object_unref(test->buffer);
+}
+
+static InfAdoptedOperation*
+inf_test_text_lcp_make_operation(InfTextBuffer* buffer,
+                                 guint user_id,
+                                 GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  gchar text;
+
+  length = inf_text_buffer_get_length(buffer);
+  pos = g_rand_int_range(rand, 0, length + 1);
+
+  if(length > 0 && g_rand_int_range(rand, 0, 3) == 0)
+  {
+    if(pos == length) --pos;
+    chunk = inf_text_buffer_get_slice(buffer, pos, 1);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_delete_operation_new(pos, chunk)
+    );
+  }
+  else
+  {
+    text = 'a' + g_rand_int_range(rand, 0, 26);
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, &text, 1, 1, user_id);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(pos, chunk)
+    );
+  }
+
+  inf_text_chunk_free(chunk);
+  return operation;
+}
+
+/* Computes the least common predecessor of the current state and the
+ * vectors of all available users from scratch. */
+static InfAdoptedStateVector*
+inf_test_text_lcp_compute(InfTestTextLcp* test)
+{
+  InfAdoptedStateVector* lcp;
+  InfAdoptedStateVector* temp;
+  InfAdoptedUser* user;
+  guint i;
+
+  lcp = inf_adopted_state_vector_copy(
+    inf_adopted_algorithm_get_current(test->algorithm)
+  );
+
+  for(i = 1; i <= INF_TEST_TEXT_LCP_USERS; ++i)
+  {
+    user = inf_test_text_lcp_lookup_user(test, i);
+    if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+    {
+      temp = inf_adopted_state_vector_least_common_predecessor(
+        lcp,
+        inf_adopted_user_get_vector(user)
+      );
+
+      inf_adopted_state_vector_free(lcp);
+      lcp = temp;
+    }
+  }
+
+  return lcp;
+}
+
+/* Returns the index of the first request in the log of the given user that
+ * cleanup must keep according to lcp, with the same rules as
+ * inf_adopted_algorithm_cleanup(). */
+static guint
+inf_test_text_lcp_expected_begin(InfAdoptedUser* user,
+                                 InfAdoptedStateVector* lcp)
+{
+  InfAdoptedRequestLog* log;
+  InfAdoptedRequest* req;
+  InfAdoptedStateVector* req_vec;
+  InfAdoptedStateVector* low_vec;
+  guint id;
+  guint n;
+
+  id = inf_user_get_id(INF_USER(user));
+  log = inf_adopted_user_get_request_log(user);
+  n = inf_adopted_request_log_get_begin(log);
+
+  while(n < inf_adopted_request_log_get_end(log))
+  {
+    req = inf_adopted_request_log_upper_related(log, n);
+    req_vec = inf_adopted_request_get_vector(req);
+
+    if(!inf_adopted_state_vector_causally_before_inc(req_vec, lcp, id))
+      break;
+
+    low_vec = inf_adopted_request_get_vector(
+      inf_adopted_request_log_get_request(log, n)
+    );
+
+    if(inf_adopted_state_vector_vdiff(low_vec, lcp) <
+       INF_TEST_TEXT_LCP_MAX_TOTAL_LOG_SIZE)
+    {
+      break;
+    }
+
+    n = inf_adopted_state_vector_get(req_vec, id) + 1;
+  }
+
+  return n;
+}
+
+/* Runs cleanup and checks that it removed what a full recomputation of the
+ * least common predecessor allows it to remove. */
+static gboolean
+inf_test_text_lcp_check(InfTestTextLcp* test,
+                        guint step)
+{
+  InfAdoptedStateVector* lcp;
+  InfAdoptedUser* user;
+  guint expected[INF_TEST_TEXT_LCP_USERS];
+  guint begin;
+  gchar* lcp_str;
+  guint i;
+
+  lcp = inf_test_text_lcp_compute(test);
+  for(i = 0; i < INF_TEST_TEXT_LCP_USERS; ++i)
+  {
+    user = inf_test_text_lcp_lookup_user(test, i + 1);
+    expected[i] = inf_test_text_lcp_expected_begin(user, lcp);
+  }
+
+  inf_adopted_algorithm_cleanup(test->algorithm);
+
+  for(i = 0; i < INF_TEST_TEXT_LCP_USERS; ++i)
+  {
+    user = inf_test_text_lcp_lookup_user(test, i + 1);
+    begin = inf_adopted_request_log_get_begin(
+      inf_adopted_user_get_request_log(user)
+    );
+
+    if(begin != expected[i])
+    {
+      lcp_str = inf_adopted_state_vector_to_string(lcp);
+
+      fprintf(
+        stderr,
+        "Step %u: Log of user %u begins at %u instead of %u, lcp is %s\n",
+        step,
+        i + 1,
+        begin,
+        expected[i],
+        lcp_str
+      );
+
+      g_free(lcp_str);
+      inf_adopted_state_vector_free(lcp);
+      return FALSE;
+    }
+  }
+
+  inf_adopted_state_vector_free(lcp);
+  return TRUE;
+}
+
+/* Lets a user make a request at the current state, or leave or rejoin the
+ * session, and lets another user catch up with the current state. */
+static void
+inf_test_text_lcp_step(InfTestTextLcp* test,
+                       GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfAdoptedUser* user;
+  InfAdoptedRequestType type;
+  gboolean result;
+  guint user_id;
+
+  user_id = g_rand_int_range(rand, 1, INF_TEST_TEXT_LCP_USERS + 1);
+  user = inf_test_text_lcp_lookup_user(test, user_id);
+
+  if(inf_user_get_status(INF_USER(user)) == INF_USER_UNAVAILABLE)
+  {
+    /* A rejoining user is synchronized to the current state */
+    inf_adopted_user_set_vector(
+      user,
+      inf_adopted_state_vector_copy(
+        inf_adopted_algorithm_get_current(test->algorithm)
+      )
+    );
+
+    g_object_set(G_OBJECT(user), "status", INF_USER_ACTIVE, NULL);
+    return;
+  }
+
+  if(g_rand_int_range(rand, 0, 40) == 0)
+  {
+    g_object_set(G_OBJECT(user), "status", INF_USER_UNAVAILABLE, NULL);
+    return;
+  }
+
+  type = INF_ADOPTED_REQUEST_DO;
+  switch(g_rand_int_range(rand, 0, 6))
+  {
+  case 0:
+    if(inf_adopted_algorithm_can_undo(test->algorithm, user))
+      type = INF_ADOPTED_REQUEST_UNDO;
+    break;
+  case 1:
+    if(inf_adopted_algorithm_can_redo(test->algorithm, user))
+      type = INF_ADOPTED_REQUEST_REDO;
+    break;
+  default:
+    break;
+  }
+
+  operation = NULL;
+  if(type == INF_ADOPTED_REQUEST_DO)
+  {
+    operation = inf_test_text_lcp_make_operation(
+      test->buffer,
+      user_id,
+      rand
+    );
+  }
+
+  request = inf_adopted_algorithm_generate_request(
+    test->algorithm,
+    type,
+    user,
+    operation
+  );
+
+  if(operation != NULL)
+    g_object_unref(operation);
+
+  result = inf_adopted_algorithm_execute_request(
+    test->algorithm,
+    request,
+    TRUE,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+  g_object_unref(request);
+
+  /* The issuing user has seen everything up to its own request, in the same
+   * way as InfAdoptedSession updates a remote user's vector. */
+  inf_adopted_user_set_vector(
+    user,
+    inf_adopted_state_vector_copy(
+      inf_adopted_algorithm_get_current(test->algorithm)
+    )
+  );
+
+  /* Sometimes, another user catches up, as if it had sent a status
+   * update. All other users fall further behind. */
+  if(g_rand_int_range(rand, 0, 3) == 0)
+  {
+    user_id = g_rand_int_range(rand, 1, INF_TEST_TEXT_LCP_USERS + 1);
+    user = inf_test_text_lcp_lookup_user(test, user_id);
+
+    if(inf_user_get_status(INF_USER(user)) != INF_USER_UNAVAILABLE)
+    {
+      inf_adopted_user_set_vector(
+        user,
+        inf_adopted_state_vector_copy(
+          inf_adopted_algorithm_get_current(test->algorithm)
+        )
+      );
+    }
+  }
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTextLcp test;
+  GError* error;
+  GRand* rand;
+  guint rseed;
+  gboolean result;
+  guint i;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+  inf_test_text_lcp_init(&test);
+
+  result = TRUE;
+  for(i = 0; i < INF_TEST_TEXT_LCP_REQUESTS && result; ++i)
+  {
+    inf_test_text_lcp_step(&test, rand);
+    result = inf_test_text_lcp_check(&test, i);
+
+    /* Cleanup right after cleanup must not remove anything else */
+    if(result)
+      result = inf_test_text_lcp_check(&test, i);
+  }
+
+  printf(
+    "%u steps with %u users... %s\n",
+    i,
+    INF_TEST_TEXT_LCP_USERS,
+    result ? "OK" : "FAILED"
+  );
+
+  inf_test_text_lcp_finalize(&test);
+  g_rand_free(rand);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
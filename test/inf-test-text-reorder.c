@@ -0,0 +1,483 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Generates a long history of requests from several users, where each
+ * request depends on all previous requests, and then feeds them to a second
+ * session in an order that differs from the order they were made in. Most
+ * requests arrive before the requests they depend on and need to be
+ * buffered until they can be executed. Verifies that the second session
+ * ends up in the same state as the first one. Once more with a
+ * check-request handler connected, which verifies that each request is
+ * checked right before it is executed. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_REORDER_USERS 8
+#define INF_TEST_TEXT_REORDER_REQUESTS 5000
+
+typedef enum _InfTestTextReorderOrder {
+  INF_TEST_TEXT_REORDER_RANDOM,
+  INF_TEST_TEXT_REORDER_REVERSE
+} InfTestTextReorderOrder;
+
+typedef struct _InfTestTextReorder InfTestTextReorder;
+struct _InfTestTextReorder {
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+
+  guint n_checked;
+  guint n_executed;
+  gboolean check_failed;
+};
+
+static gboolean
+inf_test_text_reorder_check_request_cb(InfAdoptedSession* session,
+                                       InfAdoptedRequest* request,
+                                       InfAdoptedUser* user,
+                                       gpointer user_data)
+{
+  InfTestTextReorder* test;
+  test = (InfTestTextReorder*)user_data;
+
+  /* The previously checked request must have been executed already, and
+   * this one must be executable in the current state. */
+  if(test->n_checked != test->n_executed)
+    test->check_failed = TRUE;
+
+  if(!inf_adopted_state_vector_causally_before(
+       inf_adopted_request_get_vector(request),
+       inf_adopted_algorithm_get_current(
+         inf_adopted_session_get_algorithm(session)
+       )))
+  {
+    test->check_failed = TRUE;
+  }
+
+  ++test->n_checked;
+  return FALSE;
+}
+
+static void
+inf_test_text_reorder_begin_execute_request_cb(InfAdoptedAlgorithm* algo,
+                                               InfAdoptedUser* user,
+                                               InfAdoptedRequest* request,
+                                               gpointer user_data)
+{
+  InfTestTextReorder* test;
+  test = (InfTestTextReorder*)user_data;
+
+  ++test->n_executed;
+}
+
+static void
+inf_test_text_reorder_init(InfTestTextReorder* test)
+{
+  InfCommunicationManager* manager;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  gchar* user_name;
+  guint i;
+
+  test->buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= INF_TEST_TEXT_REORDER_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  test->session = inf_text_session_new_with_user_table(
+    manager,
+    test->buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  test->n_checked = 0;
+  test->n_executed = 0;
+  test->check_failed = FALSE;
+
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+}
+
+static void
+inf_test_text_reorder_connect_checks(InfTestTextReorder* test)
+{
+  g_signal_connect(
+    G_OBJECT(test->session),
+    "check-request",
+    G_CALLBACK(inf_test_text_reorder_check_request_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(inf_adopted_session_get_algorithm(
+      INF_ADOPTED_SESSION(test->session)
+    )),
+    "begin-execute-request",
+    G_CALLBACK(inf_test_text_reorder_begin_execute_request_cb),
+    test
+  );
+}
+
+static void
+inf_test_text_reorder_finalize(InfTestTextReorder* test)
+{
+  g_object_unref(test->session);
+  g_object_unref(test->buffer);
+}
+
+static InfAdoptedOperation*
+inf_test_text_reorder_make_operation(InfTextBuffer* buffer,
+                                     guint user_id,
+                                     GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  gchar text;
+
+  length = inf_text_buffer_get_length(buffer);
+  pos = g_rand_int_range(rand, 0, length + 1);
+
+  if(length > 0 && g_rand_int_range(rand, 0, 3) == 0)
+  {
+    if(pos == length) --pos;
+    chunk = inf_text_buffer_get_slice(buffer, pos, 1);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_delete_operation_new(pos, chunk)
+    );
+  }
+  else
+  {
+    text = 'a' + g_rand_int_range(rand, 0, 26);
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, &text, 1, 1, user_id);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(pos, chunk)
+    );
+  }
+
+  inf_text_chunk_free(chunk);
+  return operation;
+}
+
+/* Makes requests on source and returns them as XML, in one queue per user,
+ * as the other session would receive them. */
+static void
+inf_test_text_reorder_generate(InfTestTextReorder* source,
+                               GQueue* queues,
+                               GRand* rand)
+{
+  InfAdoptedSessionClass* session_class;
+  InfAdoptedAlgorithm* algorithm;
+  InfUserTable* user_table;
+  InfAdoptedStateVector* last_vectors[INF_TEST_TEXT_REORDER_USERS];
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfUser* user;
+  xmlNodePtr xml;
+  gboolean result;
+  guint user_id;
+  guint i;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(source->session);
+  algorithm = inf_adopted_session_get_algorithm(
+    INF_ADOPTED_SESSION(source->session)
+  );
+
+  user_table = inf_session_get_user_table(INF_SESSION(source->session));
+
+  for(i = 0; i < INF_TEST_TEXT_REORDER_USERS; ++i)
+    last_vectors[i] = inf_adopted_state_vector_new();
+
+  for(i = 0; i < INF_TEST_TEXT_REORDER_REQUESTS; ++i)
+  {
+    user_id = g_rand_int_range(rand, 1, INF_TEST_TEXT_REORDER_USERS + 1);
+    user = inf_user_table_lookup_user_by_id(user_table, user_id);
+
+    operation = inf_test_text_reorder_make_operation(
+      source->buffer,
+      user_id,
+      rand
+    );
+
+    request = inf_adopted_algorithm_generate_request(
+      algorithm,
+      INF_ADOPTED_REQUEST_DO,
+      INF_ADOPTED_USER(user),
+      operation
+    );
+
+    g_object_unref(operation);
+
+    result = inf_adopted_algorithm_execute_request(
+      algorithm,
+      request,
+      TRUE,
+      NULL
+    );
+
+    g_assert(result == TRUE);
+
+    xml = xmlNewNode(NULL, (const xmlChar*)"request");
+    session_class->request_to_xml(
+      INF_ADOPTED_SESSION(source->session),
+      xml,
+      request,
+      last_vectors[user_id - 1],
+      FALSE
+    );
+
+    g_queue_push_tail(&queues[user_id - 1], xml);
+
+    inf_adopted_state_vector_free(last_vectors[user_id - 1]);
+    last_vectors[user_id - 1] =
+      inf_adopted_state_vector_copy(inf_adopted_request_get_vector(request));
+    inf_adopted_state_vector_add(last_vectors[user_id - 1], user_id, 1);
+
+    g_object_unref(request);
+  }
+
+  for(i = 0; i < INF_TEST_TEXT_REORDER_USERS; ++i)
+    inf_adopted_state_vector_free(last_vectors[i]);
+}
+
+/* Feeds the requests in queues to target. The order of requests of the same
+ * user is preserved, since that is guaranteed by the network connection. */
+static gdouble
+inf_test_text_reorder_deliver(InfTestTextReorder* target,
+                              GQueue* queues,
+                              InfTestTextReorderOrder order,
+                              GRand* rand)
+{
+  GTimer* timer;
+  gdouble elapsed;
+  xmlNodePtr xml;
+  guint remaining;
+  guint i;
+
+  remaining = 0;
+  for(i = 0; i < INF_TEST_TEXT_REORDER_USERS; ++i)
+    remaining += queues[i].length;
+
+  timer = g_timer_new();
+
+  while(remaining > 0)
+  {
+    if(order == INF_TEST_TEXT_REORDER_RANDOM)
+    {
+      do
+      {
+        i = g_rand_int_range(rand, 0, INF_TEST_TEXT_REORDER_USERS);
+      } while(g_queue_is_empty(&queues[i]));
+    }
+    else
+    {
+      i = INF_TEST_TEXT_REORDER_USERS - 1;
+      while(g_queue_is_empty(&queues[i]))
+        --i;
+    }
+
+    xml = g_queue_pop_head(&queues[i]);
+
+    inf_communication_object_received(
+      INF_COMMUNICATION_OBJECT(target->session),
+      NULL,
+      xml
+    );
+
+    xmlFreeNode(xml);
+    --remaining;
+  }
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+  return elapsed;
+}
+
+static gboolean
+inf_test_text_reorder_run(InfTestTextReorderOrder order,
+                          gboolean check,
+                          const gchar* name,
+                          GRand* rand)
+{
+  InfTestTextReorder source;
+  InfTestTextReorder target;
+  GQueue queues[INF_TEST_TEXT_REORDER_USERS];
+  InfTextChunk* source_chunk;
+  InfTextChunk* target_chunk;
+  gint cmp;
+  gboolean result;
+  gdouble elapsed;
+  guint i;
+
+  for(i = 0; i < INF_TEST_TEXT_REORDER_USERS; ++i)
+    g_queue_init(&queues[i]);
+
+  inf_test_text_reorder_init(&source);
+  inf_test_text_reorder_init(&target);
+  if(check)
+    inf_test_text_reorder_connect_checks(&target);
+
+  inf_test_text_reorder_generate(&source, queues, rand);
+  elapsed = inf_test_text_reorder_deliver(&target, queues, order, rand);
+
+  cmp = inf_adopted_state_vector_compare(
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(source.session))
+    ),
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(target.session))
+    )
+  );
+
+  source_chunk = inf_text_buffer_get_slice(
+    source.buffer,
+    0,
+    inf_text_buffer_get_length(source.buffer)
+  );
+
+  target_chunk = inf_text_buffer_get_slice(
+    target.buffer,
+    0,
+    inf_text_buffer_get_length(target.buffer)
+  );
+
+  result = cmp == 0 && inf_text_chunk_equal(source_chunk, target_chunk);
+
+  if(check)
+  {
+    result = result && !target.check_failed &&
+      target.n_checked == INF_TEST_TEXT_REORDER_REQUESTS &&
+      target.n_executed == INF_TEST_TEXT_REORDER_REQUESTS;
+  }
+
+  printf(
+    "%s: %u requests... %s (%g secs)\n",
+    name,
+    INF_TEST_TEXT_REORDER_REQUESTS,
+    result ? "OK" : "FAILED",
+    elapsed
+  );
+
+  inf_text_chunk_free(source_chunk);
+  inf_text_chunk_free(target_chunk);
+
+  inf_test_text_reorder_finalize(&source);
+  inf_test_text_reorder_finalize(&target);
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GError* error;
+  GRand* rand;
+  guint rseed;
+  gboolean result;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+
+  result = inf_test_text_reorder_run(
+    INF_TEST_TEXT_REORDER_RANDOM,
+    FALSE,
+    "Random order",
+    rand
+  );
+
+  if(result)
+  {
+    result = inf_test_text_reorder_run(
+      INF_TEST_TEXT_REORDER_REVERSE,
+      FALSE,
+      "Reverse user order",
+      rand
+    );
+  }
+
+  if(result)
+  {
+    result = inf_test_text_reorder_run(
+      INF_TEST_TEXT_REORDER_RANDOM,
+      TRUE,
+      "Random order with check-request",
+      rand
+    );
+  }
+
+  g_rand_free(rand);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -303,6 +303,40 @@ inf_test_text_replay_end_execute_request_cb(InfAdoptedAlgorithm* algorithm,
   }
 }
 
+/*
+ * Memory report
+ */
+
+static void
+inf_test_text_replay_print_vector_statistics(void)
+{
+  guint n_vectors;
+  guint n_references;
+  gsize n_bytes;
+  gsize n_unshared_bytes;
+
+  inf_adopted_state_vector_get_intern_statistics(
+    &n_vectors,
+    &n_references,
+    &n_bytes
+  );
+
+  /* Without interning, each reference would be a vector of its own. */
+  n_unshared_bytes = 0;
+  if(n_vectors > 0)
+    n_unshared_bytes = n_bytes / n_vectors * n_references;
+
+  fprintf(
+    stderr,
+    "State vectors: %u references to %u interned vectors, "
+    "%" G_GSIZE_FORMAT " bytes (%" G_GSIZE_FORMAT " bytes unshared)\n",
+    n_references,
+    n_vectors,
+    n_bytes,
+    n_unshared_bytes
+  );
+}
+
 /*
  * Undo grouping
  */
@@ -453,6 +487,7 @@ int main(int argc, char* argv[])
       {
         fprintf(stderr, "\n");
         inf_test_util_print_buffer(INF_TEXT_BUFFER(buffer));
+        inf_test_text_replay_print_vector_statistics();
       }
 
       g_string_free(content, TRUE);
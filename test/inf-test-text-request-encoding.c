@@ -0,0 +1,728 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Encodes randomly generated requests, including multi-byte text, Undo,
+ * Redo, caret moves and no-ops, in binary form and decodes them again, and
+ * verifies that the result is the same request by comparing the XML of both.
+ * Then checks that truncated or corrupted binary requests are rejected
+ * without crashing, and compares size and speed of XML and binary requests
+ * in the form they are sent over the network. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-remote-delete-operation.h>
+#include <libinftext/inf-text-move-operation.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/adopted/inf-adopted-no-operation.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_REQUEST_ENCODING_USERS 8
+#define INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS 20000
+#define INF_TEST_TEXT_REQUEST_ENCODING_MUTATIONS 20
+
+typedef struct _InfTestTextRequestEncodingEntry
+  InfTestTextRequestEncodingEntry;
+struct _InfTestTextRequestEncodingEntry {
+  InfAdoptedRequest* request;
+  InfAdoptedStateVector* diff_vec;
+  guint num;
+};
+
+/* Text pieces of one to four bytes in UTF-8 */
+static const struct {
+  const gchar* text;
+  gsize bytes;
+} INF_TEST_TEXT_REQUEST_ENCODING_PIECES[] = {
+  { "a", 1 },
+  { " ", 1 },
+  { "\n", 1 },
+  { "\xc3\xa4", 2 },
+  { "\xe2\x82\xac", 3 },
+  { "\xf0\x9d\x84\x9e", 4 }
+};
+
+static InfTextSession*
+inf_test_text_request_encoding_session_new(void)
+{
+  InfCommunicationManager* manager;
+  InfTextBuffer* buffer;
+  InfIo* io;
+  InfUserTable* user_table;
+  InfTextUser* user;
+  InfTextSession* session;
+  gchar* user_name;
+  guint i;
+
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  manager = inf_communication_manager_new();
+  io = INF_IO(inf_standalone_io_new());
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= INF_TEST_TEXT_REQUEST_ENCODING_USERS; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+    g_object_unref(user);
+  }
+
+  session = inf_text_session_new_with_user_table(
+    manager,
+    buffer,
+    io,
+    user_table,
+    INF_SESSION_RUNNING,
+    NULL,
+    NULL
+  );
+
+  g_object_unref(buffer);
+  g_object_unref(io);
+  g_object_unref(manager);
+  g_object_unref(user_table);
+  return session;
+}
+
+static InfAdoptedOperation*
+inf_test_text_request_encoding_make_operation(guint user_id,
+                                              GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfTextChunk* chunk;
+  GString* text;
+  guint length;
+  guint piece;
+  guint i;
+
+  switch(g_rand_int_range(rand, 0, 4))
+  {
+  case 0:
+    text = g_string_new(NULL);
+    length = g_rand_int_range(rand, 1, 40);
+
+    for(i = 0; i < length; ++i)
+    {
+      piece = g_rand_int_range(
+        rand,
+        0,
+        G_N_ELEMENTS(INF_TEST_TEXT_REQUEST_ENCODING_PIECES)
+      );
+
+      g_string_append_len(
+        text,
+        INF_TEST_TEXT_REQUEST_ENCODING_PIECES[piece].text,
+        INF_TEST_TEXT_REQUEST_ENCODING_PIECES[piece].bytes
+      );
+    }
+
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, text->str, text->len, length, user_id);
+    g_string_free(text, TRUE);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(
+        g_rand_int_range(rand, 0, 100000),
+        chunk
+      )
+    );
+
+    inf_text_chunk_free(chunk);
+    return operation;
+  case 1:
+    return INF_ADOPTED_OPERATION(
+      inf_text_remote_delete_operation_new(
+        g_rand_int_range(rand, 0, 100000),
+        g_rand_int_range(rand, 1, 1000)
+      )
+    );
+  case 2:
+    return INF_ADOPTED_OPERATION(
+      inf_text_move_operation_new(
+        g_rand_int_range(rand, 0, 100000),
+        g_rand_int_range(rand, -1000, 1000)
+      )
+    );
+  case 3:
+    return INF_ADOPTED_OPERATION(inf_adopted_no_operation_new());
+  default:
+    g_assert_not_reached();
+    return NULL;
+  }
+}
+
+/* Generates requests whose state vectors advance by a few components at a
+ * time, so that they are written as small diffs as in a real session. */
+static void
+inf_test_text_request_encoding_generate(InfTestTextRequestEncodingEntry* e,
+                                        guint n_entries,
+                                        GRand* rand)
+{
+  InfAdoptedStateVector* vector;
+  InfAdoptedOperation* operation;
+  guint user_id;
+  guint i;
+  guint j;
+
+  vector = inf_adopted_state_vector_new();
+
+  for(i = 0; i < n_entries; ++i)
+  {
+    e[i].diff_vec = inf_adopted_state_vector_copy(vector);
+    e[i].num = g_rand_int_range(rand, 0, 10) == 0 ?
+      g_rand_int_range(rand, 2, 300) : 1;
+
+    for(j = g_rand_int_range(rand, 0, 4); j > 0; --j)
+    {
+      inf_adopted_state_vector_add(
+        vector,
+        g_rand_int_range(rand, 1, INF_TEST_TEXT_REQUEST_ENCODING_USERS + 1),
+        g_rand_int_range(rand, 1, 200)
+      );
+    }
+
+    user_id =
+      g_rand_int_range(rand, 1, INF_TEST_TEXT_REQUEST_ENCODING_USERS + 1);
+
+    switch(g_rand_int_range(rand, 0, 6))
+    {
+    case 0:
+      e[i].request =
+        inf_adopted_request_new_undo(vector, user_id, g_get_real_time());
+      break;
+    case 1:
+      e[i].request =
+        inf_adopted_request_new_redo(vector, user_id, g_get_real_time());
+      break;
+    default:
+      operation = inf_test_text_request_encoding_make_operation(user_id, rand);
+
+      e[i].request = inf_adopted_request_new_do(
+        vector,
+        user_id,
+        operation,
+        g_get_real_time()
+      );
+
+      g_object_unref(operation);
+      break;
+    }
+  }
+
+  inf_adopted_state_vector_free(vector);
+}
+
+/* Returns the request as it is sent in XML form, with num as attribute */
+static xmlNodePtr
+inf_test_text_request_encoding_to_xml(InfTextSession* session,
+                                      InfAdoptedRequest* request,
+                                      InfAdoptedStateVector* diff_vec,
+                                      guint num)
+{
+  xmlNodePtr xml;
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+
+  INF_ADOPTED_SESSION_GET_CLASS(session)->request_to_xml(
+    INF_ADOPTED_SESSION(session),
+    xml,
+    request,
+    diff_vec,
+    FALSE
+  );
+
+  if(num > 1)
+    xmlNewProp(xml, (const xmlChar*)"num", (const xmlChar*)"n");
+
+  return xml;
+}
+
+static gchar*
+inf_test_text_request_encoding_dump(xmlNodePtr xml,
+                                    gsize* length)
+{
+  xmlBufferPtr buffer;
+  gchar* result;
+
+  buffer = xmlBufferCreate();
+  xmlNodeDump(buffer, NULL, xml, 0, 0);
+
+  *length = xmlBufferLength(buffer);
+  result = g_strndup((const gchar*)xmlBufferContent(buffer), *length);
+  xmlBufferFree(buffer);
+  return result;
+}
+
+static gboolean
+inf_test_text_request_encoding_roundtrip(InfTextSession* session,
+                                         InfTestTextRequestEncodingEntry* e,
+                                         guint n_entries)
+{
+  GByteArray* data;
+  InfAdoptedRequest* decoded;
+  xmlNodePtr xml;
+  gchar* expected;
+  gchar* result;
+  gsize length;
+  guint num;
+  GError* error;
+  guint i;
+
+  data = g_byte_array_new();
+
+  for(i = 0; i < n_entries; ++i)
+  {
+    g_byte_array_set_size(data, 0);
+
+    inf_adopted_session_request_to_binary(
+      INF_ADOPTED_SESSION(session),
+      e[i].request,
+      e[i].diff_vec,
+      e[i].num,
+      data
+    );
+
+    error = NULL;
+    decoded = inf_adopted_session_request_from_binary(
+      INF_ADOPTED_SESSION(session),
+      data->data,
+      data->len,
+      e[i].diff_vec,
+      &num,
+      &error
+    );
+
+    if(decoded == NULL)
+    {
+      fprintf(stderr, "Request %u: %s\n", i, error->message);
+      g_error_free(error);
+      g_byte_array_unref(data);
+      return FALSE;
+    }
+
+    xml = inf_test_text_request_encoding_to_xml(
+      session,
+      e[i].request,
+      e[i].diff_vec,
+      e[i].num
+    );
+
+    expected = inf_test_text_request_encoding_dump(xml, &length);
+    xmlFreeNode(xml);
+
+    xml = inf_test_text_request_encoding_to_xml(
+      session,
+      decoded,
+      e[i].diff_vec,
+      num
+    );
+
+    result = inf_test_text_request_encoding_dump(xml, &length);
+    xmlFreeNode(xml);
+    g_object_unref(decoded);
+
+    if(strcmp(expected, result) != 0 || num != e[i].num)
+    {
+      fprintf(stderr, "Request %u: Expected %s, got %s\n", i, expected, result);
+      g_free(expected);
+      g_free(result);
+      g_byte_array_unref(data);
+      return FALSE;
+    }
+
+    g_free(expected);
+    g_free(result);
+  }
+
+  g_byte_array_unref(data);
+  return TRUE;
+}
+
+/* Returns whether the data could be decoded. If not, an error must be set,
+ * and its code is stored in code. */
+static gboolean
+inf_test_text_request_encoding_try_decode(InfTextSession* session,
+                                          const guchar* data,
+                                          gsize length,
+                                          InfAdoptedStateVector* diff_vec,
+                                          gint* code)
+{
+  InfAdoptedRequest* request;
+  GError* error;
+  guint num;
+
+  error = NULL;
+  request = inf_adopted_session_request_from_binary(
+    INF_ADOPTED_SESSION(session),
+    data,
+    length,
+    diff_vec,
+    &num,
+    &error
+  );
+
+  if(request == NULL)
+  {
+    /* Corrupted data can refer to another user, everything else is
+     * reported as an invalid binary request. */
+    g_assert(error != NULL);
+    g_assert(error->domain == inf_adopted_session_error_quark());
+    g_assert(error->code == INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST ||
+             error->code == INF_ADOPTED_SESSION_ERROR_NO_SUCH_USER);
+
+    *code = error->code;
+    g_error_free(error);
+    return FALSE;
+  }
+
+  g_assert(error == NULL);
+  g_object_unref(request);
+  return TRUE;
+}
+
+static gboolean
+inf_test_text_request_encoding_fuzz(InfTextSession* session,
+                                    InfTestTextRequestEncodingEntry* e,
+                                    guint n_entries,
+                                    GRand* rand)
+{
+  GByteArray* data;
+  guchar* mutated;
+  gboolean result;
+  guint n_accepted;
+  guint n_mutated;
+  gint code;
+  gsize len;
+  guint i;
+  guint j;
+
+  data = g_byte_array_new();
+  result = TRUE;
+  n_accepted = 0;
+  n_mutated = 0;
+
+  for(i = 0; i < n_entries && result; ++i)
+  {
+    g_byte_array_set_size(data, 0);
+
+    inf_adopted_session_request_to_binary(
+      INF_ADOPTED_SESSION(session),
+      e[i].request,
+      e[i].diff_vec,
+      e[i].num,
+      data
+    );
+
+    /* No field is optional, so no prefix of a request is a request */
+    for(len = 0; len < data->len && result; ++len)
+    {
+      mutated = g_memdup(data->data, len);
+
+      result = !inf_test_text_request_encoding_try_decode(
+        session,
+        mutated,
+        len,
+        e[i].diff_vec,
+        &code
+      );
+
+      /* The user IDs take a single byte, so a truncated request never
+       * refers to another user. */
+      if(result)
+        result = code == INF_ADOPTED_SESSION_ERROR_INVALID_BINARY_REQUEST;
+
+      g_free(mutated);
+    }
+
+    if(!result)
+      fprintf(stderr, "Request %u: Truncated request not rejected\n", i);
+
+    /* Corrupted requests may or may not be valid, but must never be read
+     * beyond their end. */
+    for(j = 0; j < INF_TEST_TEXT_REQUEST_ENCODING_MUTATIONS; ++j)
+    {
+      len = g_rand_int_range(rand, 1, data->len + 1);
+      mutated = g_memdup(data->data, len);
+      mutated[g_rand_int_range(rand, 0, len)] = g_rand_int_range(rand, 0, 256);
+
+      if(inf_test_text_request_encoding_try_decode(session, mutated, len,
+                                                   e[i].diff_vec, &code))
+      {
+        ++ n_accepted;
+      }
+
+      ++ n_mutated;
+      g_free(mutated);
+    }
+  }
+
+  printf("%u of %u corrupted requests were still valid\n",
+         n_accepted, n_mutated);
+
+  g_byte_array_unref(data);
+  return result;
+}
+
+static gboolean
+inf_test_text_request_encoding_benchmark(InfTextSession* session,
+                                         InfTestTextRequestEncodingEntry* e,
+                                         guint n_entries)
+{
+  InfAdoptedSessionClass* session_class;
+  GTimer* timer;
+  xmlNodePtr* nodes;
+  GByteArray* data;
+  InfAdoptedRequest* request;
+  gchar* encoded;
+  guchar* decoded;
+  gchar* dump;
+  gsize length;
+  gsize xml_bytes;
+  gsize binary_bytes;
+  gdouble xml_encode;
+  gdouble xml_decode;
+  gdouble binary_encode;
+  gdouble binary_decode;
+  guint num;
+  guint i;
+
+  session_class = INF_ADOPTED_SESSION_GET_CLASS(session);
+  nodes = g_malloc(sizeof(xmlNodePtr) * n_entries);
+  timer = g_timer_new();
+
+  /* XML requests, as by inf_adopted_session_broadcast_request() and
+   * the processing of received <request> messages */
+  g_timer_start(timer);
+  for(i = 0; i < n_entries; ++i)
+  {
+    nodes[i] = inf_test_text_request_encoding_to_xml(
+      session,
+      e[i].request,
+      e[i].diff_vec,
+      1
+    );
+  }
+  xml_encode = g_timer_elapsed(timer, NULL);
+
+  g_timer_start(timer);
+  for(i = 0; i < n_entries; ++i)
+  {
+    request = session_class->xml_to_request(
+      INF_ADOPTED_SESSION(session),
+      nodes[i],
+      e[i].diff_vec,
+      FALSE,
+      NULL
+    );
+
+    g_assert(request != NULL);
+    g_object_unref(request);
+  }
+  xml_decode = g_timer_elapsed(timer, NULL);
+
+  xml_bytes = 0;
+  for(i = 0; i < n_entries; ++i)
+  {
+    dump = inf_test_text_request_encoding_dump(nodes[i], &length);
+    xml_bytes += length;
+    g_free(dump);
+    xmlFreeNode(nodes[i]);
+  }
+
+  /* The same for binary requests, which are sent as base64 text of a
+   * <binary-request> element. */
+  data = g_byte_array_new();
+
+  g_timer_start(timer);
+  for(i = 0; i < n_entries; ++i)
+  {
+    g_byte_array_set_size(data, 0);
+
+    inf_adopted_session_request_to_binary(
+      INF_ADOPTED_SESSION(session),
+      e[i].request,
+      e[i].diff_vec,
+      1,
+      data
+    );
+
+    nodes[i] = xmlNewNode(NULL, (const xmlChar*)"binary-request");
+    encoded = g_base64_encode(data->data, data->len);
+    xmlNodeAddContent(nodes[i], (const xmlChar*)encoded);
+    g_free(encoded);
+  }
+  binary_encode = g_timer_elapsed(timer, NULL);
+
+  g_timer_start(timer);
+  for(i = 0; i < n_entries; ++i)
+  {
+    encoded = (gchar*)xmlNodeGetContent(nodes[i]);
+    decoded = g_base64_decode_inplace(encoded, &length);
+
+    request = inf_adopted_session_request_from_binary(
+      INF_ADOPTED_SESSION(session),
+      decoded,
+      length,
+      e[i].diff_vec,
+      &num,
+      NULL
+    );
+
+    g_assert(request != NULL);
+    g_object_unref(request);
+    xmlFree(encoded);
+  }
+  binary_decode = g_timer_elapsed(timer, NULL);
+
+  binary_bytes = 0;
+  for(i = 0; i < n_entries; ++i)
+  {
+    dump = inf_test_text_request_encoding_dump(nodes[i], &length);
+    binary_bytes += length;
+    g_free(dump);
+    xmlFreeNode(nodes[i]);
+  }
+
+  g_byte_array_unref(data);
+  g_timer_destroy(timer);
+  g_free(nodes);
+
+  printf(
+    "XML:    %8lu bytes, encode %g secs, decode %g secs\n"
+    "Binary: %8lu bytes, encode %g secs, decode %g secs\n",
+    (unsigned long)xml_bytes,
+    xml_encode,
+    xml_decode,
+    (unsigned long)binary_bytes,
+    binary_encode,
+    binary_decode
+  );
+
+  return binary_bytes < xml_bytes;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfTestTextRequestEncodingEntry* entries;
+  InfTextSession* session;
+  GError* error;
+  GRand* rand;
+  guint rseed;
+  gboolean result;
+  guint i;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+  session = inf_test_text_request_encoding_session_new();
+
+  entries = g_malloc(
+    sizeof(InfTestTextRequestEncodingEntry) *
+    INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS
+  );
+
+  inf_test_text_request_encoding_generate(
+    entries,
+    INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS,
+    rand
+  );
+
+  result = inf_test_text_request_encoding_roundtrip(
+    session,
+    entries,
+    INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS
+  );
+
+  printf(
+    "Round trip: %u requests... %s\n",
+    INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS,
+    result ? "OK" : "FAILED"
+  );
+
+  if(result)
+  {
+    /* Decoding truncated requests is quadratic, so only use some of them */
+    result = inf_test_text_request_encoding_fuzz(
+      session,
+      entries,
+      INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS / 10,
+      rand
+    );
+
+    printf("Corrupted requests... %s\n", result ? "OK" : "FAILED");
+  }
+
+  if(result)
+  {
+    result = inf_test_text_request_encoding_benchmark(
+      session,
+      entries,
+      INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS
+    );
+
+    printf("Binary requests are smaller... %s\n", result ? "OK" : "FAILED");
+  }
+
+  for(i = 0; i < INF_TEST_TEXT_REQUEST_ENCODING_REQUESTS; ++i)
+  {
+    g_object_unref(entries[i].request);
+    inf_adopted_state_vector_free(entries[i].diff_vec);
+  }
+
+  g_free(entries);
+  g_object_unref(session);
+  g_rand_free(rand);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,845 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Synchronizes a text session with a long request history to several other
+ * sessions at the same time, through simulated connections. The
+ * synchronization messages are generated lazily while they are being sent
+ * and are shared between the synchronizations, so this also makes changes to
+ * the first session while the synchronizations are in progress, and starts
+ * one of them only after some of the changes have been made. Verifies that
+ * all other sessions still end up in the same state as the first one, and
+ * that the changes made meanwhile do not cause all of the synchronization
+ * messages to be queued at once. Also checks that with snapshot
+ * synchronization, old requests that everybody has processed already and
+ * that cannot be undone anymore are left out, and that an Undo of an old
+ * request that was kept is processed on all sites. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-insert-operation.h>
+#include <libinftext/inf-text-default-delete-operation.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-user.h>
+#include <libinfinity/communication/inf-communication-manager.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-user-table.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define INF_TEST_TEXT_SYNC_USERS 8
+#define INF_TEST_TEXT_SYNC_REQUESTS 5000
+#define INF_TEST_TEXT_SYNC_CONCURRENT_REQUESTS 20
+#define INF_TEST_TEXT_SYNC_RECENT_REQUESTS 100
+/* Requests older than this cannot be undone anymore, so snapshot
+ * synchronization can leave them out */
+#define INF_TEST_TEXT_SYNC_MAX_TOTAL_LOG_SIZE 100
+#define INF_TEST_TEXT_SYNC_CLIENTS 3
+
+/* InfSession keeps generating synchronization messages in batches of 16 as
+ * long as fewer than 32 are waiting to be sent, so there should never be
+ * more than 48 waiting, including sync-end. */
+#define INF_TEST_TEXT_SYNC_MAX_QUEUE_LENGTH 48
+
+typedef struct _InfTestTextSyncClient InfTestTextSyncClient;
+struct _InfTestTextSyncClient {
+  InfSimulatedConnection* publisher_conn;
+  InfSimulatedConnection* client_conn;
+
+  InfCommunicationManager* client_manager;
+  InfCommunicationJoinedGroup* client_group;
+
+  InfTextBuffer* target_buffer;
+  InfTextSession* target;
+};
+
+typedef struct _InfTestTextSync InfTestTextSync;
+struct _InfTestTextSync {
+  InfIo* io;
+
+  InfCommunicationManager* publisher_manager;
+  InfCommunicationHostedGroup* publisher_group;
+
+  InfTextBuffer* source_buffer;
+  InfTextSession* source;
+  InfTextUser* local_user;
+
+  InfTestTextSyncClient clients[INF_TEST_TEXT_SYNC_CLIENTS];
+};
+
+static InfAdoptedOperation*
+inf_test_text_sync_make_operation(InfTextBuffer* buffer,
+                                  guint user_id,
+                                  GRand* rand)
+{
+  InfAdoptedOperation* operation;
+  InfTextChunk* chunk;
+  guint length;
+  guint pos;
+  gchar text;
+
+  length = inf_text_buffer_get_length(buffer);
+  pos = g_rand_int_range(rand, 0, length + 1);
+
+  if(length > 0 && g_rand_int_range(rand, 0, 3) == 0)
+  {
+    if(pos == length) --pos;
+    chunk = inf_text_buffer_get_slice(buffer, pos, 1);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_delete_operation_new(pos, chunk)
+    );
+  }
+  else
+  {
+    text = 'a' + g_rand_int_range(rand, 0, 26);
+    chunk = inf_text_chunk_new("UTF-8");
+    inf_text_chunk_insert_text(chunk, 0, &text, 1, 1, user_id);
+
+    operation = INF_ADOPTED_OPERATION(
+      inf_text_default_insert_operation_new(pos, chunk)
+    );
+  }
+
+  inf_text_chunk_free(chunk);
+  return operation;
+}
+
+/* Creates the source session with a history of random requests of the
+ * non-local users. For snapshot synchronization, all users acknowledge the
+ * state before the last few requests, as if they had sent a noop. The first
+ * user makes the request right before that, and none of the recent ones, so
+ * that its last request is only kept because it can still be undone. */
+static void
+inf_test_text_sync_init_source(InfTestTextSync* test,
+                               gboolean snapshot,
+                               GRand* rand)
+{
+  InfUserTable* user_table;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  InfTextUser* user;
+  gchar* user_name;
+  gboolean result;
+  guint user_id;
+  guint i;
+
+  test->source_buffer =
+    INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+  user_table = inf_user_table_new();
+
+  for(i = 1; i <= INF_TEST_TEXT_SYNC_USERS + 1; ++i)
+  {
+    user_name = g_strdup_printf("User_%u", i);
+
+    user = INF_TEXT_USER(
+      g_object_new(
+        INF_TEXT_TYPE_USER,
+        "id", i,
+        "name", user_name,
+        "status", INF_USER_ACTIVE,
+        "flags", i > INF_TEST_TEXT_SYNC_USERS ? INF_USER_LOCAL : 0,
+        NULL
+      )
+    );
+
+    g_free(user_name);
+    inf_user_table_add_user(user_table, INF_USER(user));
+
+    if(i > INF_TEST_TEXT_SYNC_USERS)
+      test->local_user = user;
+    g_object_unref(user);
+  }
+
+  test->source = INF_TEXT_SESSION(
+    g_object_new(
+      INF_TEXT_TYPE_SESSION,
+      "communication-manager", test->publisher_manager,
+      "buffer", test->source_buffer,
+      "user-table", user_table,
+      "status", INF_SESSION_RUNNING,
+      "io", test->io,
+      "max-total-log-size", INF_TEST_TEXT_SYNC_MAX_TOTAL_LOG_SIZE,
+      "snapshot-sync", snapshot,
+      NULL
+    )
+  );
+
+  g_object_unref(user_table);
+
+  algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(test->source));
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_REQUESTS; ++i)
+  {
+    if(snapshot &&
+       i == INF_TEST_TEXT_SYNC_REQUESTS - INF_TEST_TEXT_SYNC_RECENT_REQUESTS)
+    {
+      for(user_id = 1; user_id <= INF_TEST_TEXT_SYNC_USERS + 1; ++user_id)
+      {
+        inf_adopted_user_set_vector(
+          INF_ADOPTED_USER(
+            inf_user_table_lookup_user_by_id(
+              inf_session_get_user_table(INF_SESSION(test->source)),
+              user_id
+            )
+          ),
+          inf_adopted_state_vector_copy(
+            inf_adopted_algorithm_get_current(algorithm)
+          )
+        );
+      }
+    }
+
+    if(snapshot &&
+       i >= INF_TEST_TEXT_SYNC_REQUESTS - INF_TEST_TEXT_SYNC_RECENT_REQUESTS)
+    {
+      user_id = g_rand_int_range(rand, 2, INF_TEST_TEXT_SYNC_USERS + 1);
+    }
+    else if(snapshot &&
+            i + 1 ==
+              INF_TEST_TEXT_SYNC_REQUESTS - INF_TEST_TEXT_SYNC_RECENT_REQUESTS)
+    {
+      user_id = 1;
+    }
+    else
+    {
+      user_id = g_rand_int_range(rand, 1, INF_TEST_TEXT_SYNC_USERS + 1);
+    }
+
+    operation = inf_test_text_sync_make_operation(
+      test->source_buffer,
+      user_id,
+      rand
+    );
+
+    request = inf_adopted_algorithm_generate_request(
+      algorithm,
+      INF_ADOPTED_REQUEST_DO,
+      INF_ADOPTED_USER(
+        inf_user_table_lookup_user_by_id(
+          inf_session_get_user_table(INF_SESSION(test->source)),
+          user_id
+        )
+      ),
+      operation
+    );
+
+    g_object_unref(operation);
+
+    result = inf_adopted_algorithm_execute_request(
+      algorithm,
+      request,
+      TRUE,
+      NULL
+    );
+
+    g_assert(result == TRUE);
+    g_object_unref(request);
+  }
+}
+
+static void
+inf_test_text_sync_init_client(InfTestTextSync* test,
+                               InfTestTextSyncClient* client)
+{
+  client->publisher_conn = inf_simulated_connection_new();
+  client->client_conn = inf_simulated_connection_new();
+
+  inf_simulated_connection_connect(
+    client->publisher_conn,
+    client->client_conn
+  );
+
+  inf_simulated_connection_set_mode(
+    client->publisher_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->client_conn,
+    INF_SIMULATED_CONNECTION_DELAYED
+  );
+
+  inf_communication_hosted_group_add_member(
+    test->publisher_group,
+    INF_XML_CONNECTION(client->publisher_conn)
+  );
+
+  client->client_manager = inf_communication_manager_new();
+  client->client_group = inf_communication_manager_join_group(
+    client->client_manager,
+    "InfTestTextSync",
+    INF_XML_CONNECTION(client->client_conn),
+    "central"
+  );
+
+  client->target_buffer =
+    INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  client->target = inf_text_session_new(
+    client->client_manager,
+    client->target_buffer,
+    test->io,
+    INF_SESSION_SYNCHRONIZING,
+    INF_COMMUNICATION_GROUP(client->client_group),
+    INF_XML_CONNECTION(client->client_conn)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(client->client_group),
+    INF_COMMUNICATION_OBJECT(client->target)
+  );
+
+  inf_session_set_subscription_group(
+    INF_SESSION(client->target),
+    INF_COMMUNICATION_GROUP(client->client_group)
+  );
+}
+
+static void
+inf_test_text_sync_init(InfTestTextSync* test,
+                        gboolean snapshot,
+                        GRand* rand)
+{
+  guint i;
+
+  test->io = INF_IO(inf_standalone_io_new());
+
+  test->publisher_manager = inf_communication_manager_new();
+  test->publisher_group = inf_communication_manager_open_group(
+    test->publisher_manager,
+    "InfTestTextSync",
+    NULL
+  );
+
+  inf_test_text_sync_init_source(test, snapshot, rand);
+
+  inf_session_set_subscription_group(
+    INF_SESSION(test->source),
+    INF_COMMUNICATION_GROUP(test->publisher_group)
+  );
+
+  inf_communication_group_set_target(
+    INF_COMMUNICATION_GROUP(test->publisher_group),
+    INF_COMMUNICATION_OBJECT(test->source)
+  );
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS; ++i)
+    inf_test_text_sync_init_client(test, &test->clients[i]);
+}
+
+static void
+inf_test_text_sync_finalize(InfTestTextSync* test)
+{
+  InfTestTextSyncClient* client;
+  guint i;
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS; ++i)
+  {
+    client = &test->clients[i];
+
+    g_object_unref(client->target);
+    g_object_unref(client->target_buffer);
+    g_object_unref(client->client_group);
+    g_object_unref(client->client_manager);
+  }
+
+  g_object_unref(test->source);
+  g_object_unref(test->source_buffer);
+  g_object_unref(test->publisher_group);
+  g_object_unref(test->publisher_manager);
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS; ++i)
+  {
+    g_object_unref(test->clients[i].client_conn);
+    g_object_unref(test->clients[i].publisher_conn);
+  }
+
+  g_object_unref(test->io);
+}
+
+/* Makes a change as the local user of the source session, and sends it to
+ * the subscription group, which includes the connections being
+ * synchronized. */
+static void
+inf_test_text_sync_local_request(InfTestTextSync* test,
+                                 GRand* rand)
+{
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedOperation* operation;
+  InfAdoptedRequest* request;
+  gboolean result;
+
+  algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(test->source));
+
+  operation = inf_test_text_sync_make_operation(
+    test->source_buffer,
+    inf_user_get_id(INF_USER(test->local_user)),
+    rand
+  );
+
+  request = inf_adopted_algorithm_generate_request(
+    algorithm,
+    INF_ADOPTED_REQUEST_DO,
+    INF_ADOPTED_USER(test->local_user),
+    operation
+  );
+
+  g_object_unref(operation);
+
+  result = inf_adopted_algorithm_execute_request(
+    algorithm,
+    request,
+    TRUE,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+
+  inf_adopted_session_broadcast_request(
+    INF_ADOPTED_SESSION(test->source),
+    request
+  );
+
+  g_object_unref(request);
+}
+
+static void
+inf_test_text_sync_flush(InfTestTextSync* test)
+{
+  guint i;
+
+  /* Synchronization messages, then sync-ack, then anything sent after
+   * the synchronization has been completed */
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS; ++i)
+  {
+    inf_simulated_connection_flush(test->clients[i].publisher_conn);
+    inf_simulated_connection_flush(test->clients[i].client_conn);
+    inf_simulated_connection_flush(test->clients[i].publisher_conn);
+  }
+}
+
+static void
+inf_test_text_sync_start(InfTestTextSync* test,
+                         InfTestTextSyncClient* client)
+{
+  inf_session_synchronize_to(
+    INF_SESSION(test->source),
+    INF_COMMUNICATION_GROUP(test->publisher_group),
+    INF_XML_CONNECTION(client->publisher_conn)
+  );
+}
+
+/* Checks that the synchronization messages for the clients being
+ * synchronized are still generated lazily. */
+static gboolean
+inf_test_text_sync_check_queue_length(InfTestTextSync* test)
+{
+  InfXmlConnection* connection;
+  guint queue_length;
+  guint i;
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS; ++i)
+  {
+    connection = INF_XML_CONNECTION(test->clients[i].publisher_conn);
+
+    if(inf_session_get_synchronization_status(
+         INF_SESSION(test->source),
+         connection) != INF_SESSION_SYNC_NONE)
+    {
+      queue_length = inf_session_get_synchronization_queue_length(
+        INF_SESSION(test->source),
+        connection
+      );
+
+      if(queue_length > INF_TEST_TEXT_SYNC_MAX_QUEUE_LENGTH)
+      {
+        fprintf(
+          stderr,
+          "%u synchronization messages queued for client %u\n",
+          queue_length,
+          i
+        );
+
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static gboolean
+inf_test_text_sync_check(InfTestTextSync* test,
+                         InfTestTextSyncClient* client)
+{
+  InfTextChunk* source_chunk;
+  InfTextChunk* target_chunk;
+  gboolean result;
+  gint cmp;
+
+  if(inf_session_get_status(INF_SESSION(client->target)) !=
+     INF_SESSION_RUNNING)
+  {
+    return FALSE;
+  }
+
+  cmp = inf_adopted_state_vector_compare(
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(test->source))
+    ),
+    inf_adopted_algorithm_get_current(
+      inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(client->target))
+    )
+  );
+
+  source_chunk = inf_text_buffer_get_slice(
+    test->source_buffer,
+    0,
+    inf_text_buffer_get_length(test->source_buffer)
+  );
+
+  target_chunk = inf_text_buffer_get_slice(
+    client->target_buffer,
+    0,
+    inf_text_buffer_get_length(client->target_buffer)
+  );
+
+  result = cmp == 0 && inf_text_chunk_equal(source_chunk, target_chunk);
+
+  inf_text_chunk_free(source_chunk);
+  inf_text_chunk_free(target_chunk);
+  return result;
+}
+
+static void
+inf_test_text_sync_error_cb(InfSession* session,
+                            InfXmlConnection* connection,
+                            xmlNodePtr xml,
+                            const GError* error,
+                            gpointer user_data)
+{
+  GError** first_error;
+  first_error = (GError**)user_data;
+
+  if(*first_error == NULL)
+    *first_error = g_error_copy(error);
+}
+
+/* Makes the first user, which made none of the recent requests, undo its
+ * last request from the first client. The snapshot synchronization needs
+ * to have included that request, so that the Undo request is executed on
+ * all sites and they stay in the same state. */
+static gboolean
+inf_test_text_sync_undo_old(InfTestTextSync* test)
+{
+  InfTestTextSyncClient* client;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedAlgorithm* client_algorithm;
+  InfAdoptedStateVector* current;
+  InfAdoptedRequest* request;
+  InfUser* user;
+  xmlNodePtr xml;
+  GError* error;
+  gboolean result;
+  guint i;
+
+  client = &test->clients[0];
+  algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(test->source));
+  client_algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(client->target));
+  current =
+    inf_adopted_state_vector_copy(inf_adopted_algorithm_get_current(algorithm));
+
+  /* Let the user join from the client's connection */
+  user = inf_user_table_lookup_user_by_id(
+    inf_session_get_user_table(INF_SESSION(test->source)),
+    1
+  );
+
+  g_object_set(
+    G_OBJECT(user),
+    "connection", client->publisher_conn,
+    NULL
+  );
+
+  user = inf_user_table_lookup_user_by_id(
+    inf_session_get_user_table(INF_SESSION(client->target)),
+    1
+  );
+
+  if(inf_adopted_request_log_next_undo(
+       inf_adopted_user_get_request_log(INF_ADOPTED_USER(user))) == NULL)
+  {
+    fprintf(stderr, "Request to be undone was left out\n");
+    inf_adopted_state_vector_free(current);
+    return FALSE;
+  }
+
+  /* Apply the Undo on the client and send it to the source, as if the user
+   * was local to the client. */
+  request = inf_adopted_algorithm_generate_request(
+    client_algorithm,
+    INF_ADOPTED_REQUEST_UNDO,
+    INF_ADOPTED_USER(user),
+    NULL
+  );
+
+  xml = xmlNewNode(NULL, (const xmlChar*)"request");
+
+  INF_ADOPTED_SESSION_GET_CLASS(client->target)->request_to_xml(
+    INF_ADOPTED_SESSION(client->target),
+    xml,
+    request,
+    inf_adopted_user_get_vector(INF_ADOPTED_USER(user)),
+    FALSE
+  );
+
+  result = inf_adopted_algorithm_execute_request(
+    client_algorithm,
+    request,
+    TRUE,
+    NULL
+  );
+
+  g_assert(result == TRUE);
+  g_object_unref(request);
+
+  error = NULL;
+  g_signal_connect(
+    G_OBJECT(test->source),
+    "error",
+    G_CALLBACK(inf_test_text_sync_error_cb),
+    &error
+  );
+
+  inf_communication_group_send_message(
+    INF_COMMUNICATION_GROUP(client->client_group),
+    INF_XML_CONNECTION(client->client_conn),
+    xml
+  );
+
+  inf_test_text_sync_flush(test);
+
+  g_signal_handlers_disconnect_by_func(
+    G_OBJECT(test->source),
+    G_CALLBACK(inf_test_text_sync_error_cb),
+    &error
+  );
+
+  result = TRUE;
+  if(error != NULL)
+  {
+    fprintf(stderr, "Undo of an old request failed: %s\n", error->message);
+    result = FALSE;
+  }
+  else if(inf_adopted_state_vector_compare(
+            current,
+            inf_adopted_algorithm_get_current(algorithm)) == 0)
+  {
+    fprintf(stderr, "Undo of an old request was not executed\n");
+    result = FALSE;
+  }
+
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS && result; ++i)
+    result = inf_test_text_sync_check(test, &test->clients[i]);
+
+  if(error != NULL)
+    g_error_free(error);
+  inf_adopted_state_vector_free(current);
+  return result;
+}
+
+static void
+inf_test_text_sync_count_requests_foreach_func(InfUser* user,
+                                               gpointer user_data)
+{
+  InfAdoptedRequestLog* log;
+  log = inf_adopted_user_get_request_log(INF_ADOPTED_USER(user));
+
+  *(guint*)user_data +=
+    inf_adopted_request_log_get_end(log) -
+    inf_adopted_request_log_get_begin(log);
+}
+
+static guint
+inf_test_text_sync_count_requests(InfTextSession* session)
+{
+  guint n_requests;
+  n_requests = 0;
+
+  inf_user_table_foreach_user(
+    inf_session_get_user_table(INF_SESSION(session)),
+    inf_test_text_sync_count_requests_foreach_func,
+    &n_requests
+  );
+
+  return n_requests;
+}
+
+static gboolean
+inf_test_text_sync_run(guint n_concurrent,
+                       gboolean snapshot,
+                       const gchar* name,
+                       GRand* rand)
+{
+  InfTestTextSync test;
+  GTimer* timer;
+  gdouble elapsed;
+  gboolean result;
+  guint n_synced;
+  guint i;
+
+  inf_test_text_sync_init(&test, snapshot, rand);
+
+  timer = g_timer_new();
+  result = TRUE;
+
+  /* All but the last client join at the same time, and share the same
+   * synchronization messages. */
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS - 1; ++i)
+    inf_test_text_sync_start(&test, &test.clients[i]);
+
+  /* Nothing has been delivered yet at this point, so most of the
+   * synchronizations are still to be generated. The last client joins
+   * after some changes have been made, so it gets a newer snapshot.
+   * Several changes are made between the flushes, and each of them is sent
+   * to the clients being synchronized. */
+  for(i = 0; i < n_concurrent; ++i)
+  {
+    if(i == n_concurrent / 2)
+    {
+      inf_test_text_sync_start(
+        &test,
+        &test.clients[INF_TEST_TEXT_SYNC_CLIENTS - 1]
+      );
+    }
+
+    inf_test_text_sync_local_request(&test, rand);
+    if(!inf_test_text_sync_check_queue_length(&test)) result = FALSE;
+    if(i % 4 == 3) inf_test_text_sync_flush(&test);
+  }
+
+  if(n_concurrent == 0)
+  {
+    inf_test_text_sync_start(
+      &test,
+      &test.clients[INF_TEST_TEXT_SYNC_CLIENTS - 1]
+    );
+  }
+
+  inf_test_text_sync_flush(&test);
+
+  elapsed = g_timer_elapsed(timer, NULL);
+  g_timer_destroy(timer);
+
+  if(inf_session_has_synchronizations(INF_SESSION(test.source)))
+    result = FALSE;
+  for(i = 0; i < INF_TEST_TEXT_SYNC_CLIENTS && result; ++i)
+    result = inf_test_text_sync_check(&test, &test.clients[i]);
+
+  /* The first client has been synchronized before any concurrent changes
+   * were made. With snapshot synchronization, it gets the recent requests,
+   * and the ones before them that can still be undone. */
+  n_synced = inf_test_text_sync_count_requests(test.clients[0].target);
+  if(result && snapshot)
+  {
+    result = n_synced <=
+      INF_TEST_TEXT_SYNC_RECENT_REQUESTS +
+      INF_TEST_TEXT_SYNC_MAX_TOTAL_LOG_SIZE + n_concurrent;
+  }
+  else if(result)
+    result = n_synced == INF_TEST_TEXT_SYNC_REQUESTS + n_concurrent;
+
+  if(result && snapshot)
+    result = inf_test_text_sync_undo_old(&test);
+
+  printf(
+    "%s: %u of %u requests, %u clients... %s (%g secs)\n",
+    name,
+    n_synced,
+    INF_TEST_TEXT_SYNC_REQUESTS + n_concurrent,
+    INF_TEST_TEXT_SYNC_CLIENTS,
+    result ? "OK" : "FAILED",
+    elapsed
+  );
+
+  inf_test_text_sync_finalize(&test);
+  return result;
+}
+
+int
+main(int argc, char* argv[])
+{
+  GError* error;
+  GRand* rand;
+  guint rseed;
+  gboolean result;
+
+  if(argc > 1)
+    rseed = atoi(argv[1]);
+  else
+    rseed = time(NULL);
+
+  printf("Using random seed %u\n", rseed);
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  rand = g_rand_new_with_seed(rseed);
+
+  result = inf_test_text_sync_run(0, FALSE, "Synchronization", rand);
+
+  if(result)
+  {
+    result = inf_test_text_sync_run(
+      INF_TEST_TEXT_SYNC_CONCURRENT_REQUESTS,
+      FALSE,
+      "Synchronization with concurrent changes",
+      rand
+    );
+  }
+
+  if(result)
+  {
+    result = inf_test_text_sync_run(
+      INF_TEST_TEXT_SYNC_CONCURRENT_REQUESTS,
+      TRUE,
+      "Snapshot synchronization",
+      rand
+    );
+  }
+
+  g_rand_free(rand);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */
@@ -0,0 +1,760 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Runs an InfdDirectory with worker threads and lets several clients, which
+ * are connected through simulated connections, join the same documents and
+ * edit them concurrently. The documents are spread over the workers, so
+ * sessions in different threads are edited at the same time. Verifies that
+ * all clients and the server end up with the same text, and that closing the
+ * connections and the directory afterwards works. */
+
+#include <libinftext/inf-text-session.h>
+#include <libinftext/inf-text-default-buffer.h>
+#include <libinftext/inf-text-filesystem-format.h>
+#include <libinfinity/server/infd-directory.h>
+#include <libinfinity/server/infd-filesystem-storage.h>
+#include <libinfinity/client/infc-browser.h>
+#include <libinfinity/adopted/inf-adopted-session.h>
+#include <libinfinity/adopted/inf-adopted-algorithm.h>
+#include <libinfinity/adopted/inf-adopted-state-vector.h>
+#include <libinfinity/common/inf-simulated-connection.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-request-result.h>
+#include <libinfinity/common/inf-file-util.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define INF_TEST_WORKER_THREADS_WORKERS 3
+#define INF_TEST_WORKER_THREADS_DOCUMENTS 4
+#define INF_TEST_WORKER_THREADS_CLIENTS 8
+#define INF_TEST_WORKER_THREADS_EDITS 200
+
+typedef struct _InfTestWorkerThreads InfTestWorkerThreads;
+
+typedef struct _InfTestWorkerThreadsClient InfTestWorkerThreadsClient;
+struct _InfTestWorkerThreadsClient {
+  InfTestWorkerThreads* test;
+  guint index;
+
+  InfSimulatedConnection* server_conn;
+  InfSimulatedConnection* client_conn;
+  InfcBrowser* browser;
+
+  InfSessionProxy* proxy;
+  InfSession* session;
+  InfUser* user;
+
+  guint n_edits;
+  gboolean done;
+};
+
+struct _InfTestWorkerThreads {
+  InfStandaloneIo* io;
+  InfdDirectory* directory;
+
+  InfBrowserIter documents[INF_TEST_WORKER_THREADS_DOCUMENTS];
+  guint n_documents;
+
+  InfTestWorkerThreadsClient clients[INF_TEST_WORKER_THREADS_CLIENTS];
+  guint n_done;
+
+  gboolean failed;
+};
+
+static void
+inf_test_worker_threads_fail(InfTestWorkerThreads* test,
+                             const gchar* message)
+{
+  fprintf(stderr, "%s\n", message);
+  test->failed = TRUE;
+  inf_standalone_io_loop_quit(test->io);
+}
+
+static InfSession*
+inf_test_worker_threads_session_new(InfIo* io,
+                                    InfCommunicationManager* manager,
+                                    InfSessionStatus status,
+                                    InfCommunicationGroup* sync_group,
+                                    InfXmlConnection* sync_connection,
+                                    const gchar* path,
+                                    gpointer user_data)
+{
+  InfTextDefaultBuffer* buffer;
+  InfTextSession* session;
+
+  buffer = inf_text_default_buffer_new("UTF-8");
+  session = inf_text_session_new(
+    manager,
+    INF_TEXT_BUFFER(buffer),
+    io,
+    status,
+    sync_group,
+    sync_connection
+  );
+  g_object_unref(buffer);
+
+  return INF_SESSION(session);
+}
+
+static InfSession*
+inf_test_worker_threads_session_read(InfdStorage* storage,
+                                     InfIo* io,
+                                     InfCommunicationManager* manager,
+                                     const gchar* path,
+                                     gpointer user_data,
+                                     GError** error)
+{
+  InfUserTable* user_table;
+  InfTextBuffer* buffer;
+  InfTextSession* session;
+  gboolean result;
+
+  user_table = inf_user_table_new();
+  buffer = INF_TEXT_BUFFER(inf_text_default_buffer_new("UTF-8"));
+
+  result = inf_text_filesystem_format_read(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    user_table,
+    buffer,
+    error
+  );
+
+  session = NULL;
+  if(result == TRUE)
+  {
+    session = inf_text_session_new_with_user_table(
+      manager,
+      buffer,
+      io,
+      user_table,
+      INF_SESSION_RUNNING,
+      NULL,
+      NULL
+    );
+  }
+
+  g_object_unref(user_table);
+  g_object_unref(buffer);
+  return INF_SESSION(session);
+}
+
+static gboolean
+inf_test_worker_threads_session_write(InfdStorage* storage,
+                                      InfSession* session,
+                                      const gchar* path,
+                                      gpointer user_data,
+                                      GError** error)
+{
+  return inf_text_filesystem_format_write(
+    INFD_FILESYSTEM_STORAGE(storage),
+    path,
+    inf_session_get_user_table(session),
+    INF_TEXT_BUFFER(inf_session_get_buffer(session)),
+    error
+  );
+}
+
+static const InfdNotePlugin INF_TEST_WORKER_THREADS_SERVER_PLUGIN = {
+  NULL,
+  "InfdFilesystemStorage",
+  "InfText",
+  inf_test_worker_threads_session_new,
+  inf_test_worker_threads_session_read,
+  inf_test_worker_threads_session_write,
+  NULL,
+  NULL
+};
+
+static const InfcNotePlugin INF_TEST_WORKER_THREADS_CLIENT_PLUGIN = {
+  NULL,
+  "InfText",
+  inf_test_worker_threads_session_new
+};
+
+/* Compares the text of each document on the server with the text all
+ * clients subscribed to it see, and then closes all connections. Runs with
+ * the directory locked, since it is called from a callback of the
+ * directory's I/O. */
+static void
+inf_test_worker_threads_finish(InfTestWorkerThreads* test)
+{
+  InfTestWorkerThreadsClient* client;
+  InfSessionProxy* proxy;
+  InfSession* session;
+  InfTextChunk* server_chunk;
+  InfTextChunk* client_chunk;
+  InfTextBuffer* buffer;
+  guint i;
+
+  for(i = 0; i < INF_TEST_WORKER_THREADS_CLIENTS; ++i)
+  {
+    client = &test->clients[i];
+
+    proxy = inf_browser_get_session(
+      INF_BROWSER(test->directory),
+      &test->documents[i % INF_TEST_WORKER_THREADS_DOCUMENTS]
+    );
+
+    if(proxy == NULL)
+    {
+      inf_test_worker_threads_fail(test, "Server session has gone away");
+      return;
+    }
+
+    g_object_get(G_OBJECT(proxy), "session", &session, NULL);
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(session));
+    server_chunk =
+      inf_text_buffer_get_slice(buffer, 0, inf_text_buffer_get_length(buffer));
+    g_object_unref(session);
+
+    buffer = INF_TEXT_BUFFER(inf_session_get_buffer(client->session));
+    client_chunk =
+      inf_text_buffer_get_slice(buffer, 0, inf_text_buffer_get_length(buffer));
+
+    if(!inf_text_chunk_equal(server_chunk, client_chunk))
+      inf_test_worker_threads_fail(test, "Client and server text differ");
+
+    inf_text_chunk_free(server_chunk);
+    inf_text_chunk_free(client_chunk);
+  }
+
+  for(i = 0; i < INF_TEST_WORKER_THREADS_CLIENTS; ++i)
+  {
+    inf_xml_connection_close(
+      INF_XML_CONNECTION(test->clients[i].client_conn)
+    );
+  }
+
+  inf_standalone_io_loop_quit(test->io);
+}
+
+/* Waits until a client has seen the edits of all clients subscribed to the
+ * same document. Since every document has more than one client, the server
+ * has then executed all of them as well. */
+static void
+inf_test_worker_threads_check_cb(gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  InfTestWorkerThreads* test;
+  InfAdoptedAlgorithm* algorithm;
+  InfAdoptedStateVector* initial;
+  guint n_executed;
+
+  client = (InfTestWorkerThreadsClient*)user_data;
+  test = client->test;
+
+  algorithm =
+    inf_adopted_session_get_algorithm(INF_ADOPTED_SESSION(client->session));
+  initial = inf_adopted_state_vector_new();
+  n_executed = inf_adopted_state_vector_vdiff(
+    initial,
+    inf_adopted_algorithm_get_current(algorithm)
+  );
+  inf_adopted_state_vector_free(initial);
+
+  if(n_executed < INF_TEST_WORKER_THREADS_EDITS *
+                  INF_TEST_WORKER_THREADS_CLIENTS /
+                  INF_TEST_WORKER_THREADS_DOCUMENTS)
+  {
+    inf_io_add_timeout(
+      infd_directory_get_io(test->directory),
+      10,
+      inf_test_worker_threads_check_cb,
+      client,
+      NULL
+    );
+  }
+  else
+  {
+    client->done = TRUE;
+    if(++test->n_done == INF_TEST_WORKER_THREADS_CLIENTS)
+      inf_test_worker_threads_finish(test);
+  }
+}
+
+static void
+inf_test_worker_threads_edit_cb(gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  InfTextBuffer* buffer;
+  guint length;
+  gchar c;
+
+  client = (InfTestWorkerThreadsClient*)user_data;
+  buffer = INF_TEXT_BUFFER(inf_session_get_buffer(client->session));
+  length = inf_text_buffer_get_length(buffer);
+
+  if(length > 0 && g_random_int_range(0, 3) == 0)
+  {
+    inf_text_buffer_erase_text(
+      buffer,
+      g_random_int_range(0, length),
+      1,
+      client->user
+    );
+  }
+  else
+  {
+    c = 'a' + client->index;
+    inf_text_buffer_insert_text(
+      buffer,
+      g_random_int_range(0, length + 1),
+      &c,
+      1,
+      1,
+      client->user
+    );
+  }
+
+  if(++client->n_edits < INF_TEST_WORKER_THREADS_EDITS)
+  {
+    inf_io_add_timeout(
+      infd_directory_get_io(client->test->directory),
+      g_random_int_range(0, 3),
+      inf_test_worker_threads_edit_cb,
+      client,
+      NULL
+    );
+  }
+  else
+  {
+    inf_test_worker_threads_check_cb(client);
+  }
+}
+
+static void
+inf_test_worker_threads_join_user_cb(InfRequest* request,
+                                     const InfRequestResult* result,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  client = (InfTestWorkerThreadsClient*)user_data;
+
+  if(error != NULL)
+  {
+    inf_test_worker_threads_fail(client->test, error->message);
+    return;
+  }
+
+  inf_request_result_get_join_user(result, NULL, &client->user);
+  g_object_ref(client->user);
+
+  inf_test_worker_threads_edit_cb(client);
+}
+
+static void
+inf_test_worker_threads_join_user(InfTestWorkerThreadsClient* client)
+{
+  gchar* name;
+
+  name = g_strdup_printf("client-%u", client->index);
+
+  inf_text_session_join_user(
+    client->proxy,
+    name,
+    INF_USER_ACTIVE,
+    (gdouble)client->index / INF_TEST_WORKER_THREADS_CLIENTS,
+    0,
+    0,
+    inf_test_worker_threads_join_user_cb,
+    client
+  );
+
+  g_free(name);
+}
+
+static void
+inf_test_worker_threads_session_notify_status_cb(GObject* object,
+                                                 GParamSpec* pspec,
+                                                 gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  client = (InfTestWorkerThreadsClient*)user_data;
+
+  if(client->user == NULL &&
+     inf_session_get_status(client->session) == INF_SESSION_RUNNING)
+  {
+    inf_test_worker_threads_join_user(client);
+  }
+}
+
+static void
+inf_test_worker_threads_subscribe_cb(InfRequest* request,
+                                     const InfRequestResult* result,
+                                     const GError* error,
+                                     gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  client = (InfTestWorkerThreadsClient*)user_data;
+
+  if(error != NULL)
+  {
+    inf_test_worker_threads_fail(client->test, error->message);
+    return;
+  }
+
+  inf_request_result_get_subscribe_session(result, NULL, NULL, &client->proxy);
+  g_object_ref(client->proxy);
+  g_object_get(G_OBJECT(client->proxy), "session", &client->session, NULL);
+
+  g_signal_connect(
+    G_OBJECT(client->session),
+    "notify::status",
+    G_CALLBACK(inf_test_worker_threads_session_notify_status_cb),
+    client
+  );
+
+  if(inf_session_get_status(client->session) == INF_SESSION_RUNNING)
+    inf_test_worker_threads_join_user(client);
+}
+
+static void
+inf_test_worker_threads_explore_cb(InfRequest* request,
+                                   const InfRequestResult* result,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  InfBrowser* browser;
+  InfBrowserIter iter;
+  gchar* name;
+  gboolean have_iter;
+
+  client = (InfTestWorkerThreadsClient*)user_data;
+  browser = INF_BROWSER(client->browser);
+
+  if(error != NULL)
+  {
+    inf_test_worker_threads_fail(client->test, error->message);
+    return;
+  }
+
+  name = g_strdup_printf(
+    "doc-%u",
+    client->index % INF_TEST_WORKER_THREADS_DOCUMENTS
+  );
+
+  inf_browser_get_root(browser, &iter);
+  for(have_iter = inf_browser_get_child(browser, &iter);
+      have_iter == TRUE;
+      have_iter = inf_browser_get_next(browser, &iter))
+  {
+    if(strcmp(inf_browser_get_node_name(browser, &iter), name) == 0)
+    {
+      inf_browser_subscribe(
+        browser,
+        &iter,
+        inf_test_worker_threads_subscribe_cb,
+        client
+      );
+
+      break;
+    }
+  }
+
+  g_free(name);
+
+  if(have_iter == FALSE)
+    inf_test_worker_threads_fail(client->test, "Document not found");
+}
+
+static void
+inf_test_worker_threads_browser_notify_status_cb(GObject* object,
+                                                 GParamSpec* pspec,
+                                                 gpointer user_data)
+{
+  InfTestWorkerThreadsClient* client;
+  InfBrowserStatus status;
+  InfBrowserIter iter;
+
+  client = (InfTestWorkerThreadsClient*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  if(status == INF_BROWSER_OPEN)
+  {
+    inf_browser_get_root(INF_BROWSER(client->browser), &iter);
+
+    inf_browser_explore(
+      INF_BROWSER(client->browser),
+      &iter,
+      inf_test_worker_threads_explore_cb,
+      client
+    );
+  }
+  else if(status == INF_BROWSER_CLOSED && !client->done)
+  {
+    inf_test_worker_threads_fail(client->test, "Connection closed early");
+  }
+}
+
+static void
+inf_test_worker_threads_connect_client(InfTestWorkerThreads* test,
+                                       guint index)
+{
+  InfTestWorkerThreadsClient* client;
+  InfCommunicationManager* manager;
+  InfIo* io;
+
+  client = &test->clients[index];
+  io = infd_directory_get_io(test->directory);
+
+  client->test = test;
+  client->index = index;
+  client->proxy = NULL;
+  client->session = NULL;
+  client->user = NULL;
+  client->n_edits = 0;
+  client->done = FALSE;
+
+  client->server_conn = inf_simulated_connection_new_with_io(io);
+  client->client_conn = inf_simulated_connection_new_with_io(io);
+
+  inf_simulated_connection_connect(client->server_conn, client->client_conn);
+
+  inf_simulated_connection_set_mode(
+    client->server_conn,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  inf_simulated_connection_set_mode(
+    client->client_conn,
+    INF_SIMULATED_CONNECTION_IO_CONTROLLED
+  );
+
+  infd_directory_add_connection(
+    test->directory,
+    INF_XML_CONNECTION(client->server_conn)
+  );
+
+  manager = inf_communication_manager_new();
+
+  client->browser = infc_browser_new(
+    io,
+    manager,
+    INF_XML_CONNECTION(client->client_conn)
+  );
+
+  g_object_unref(manager);
+
+  infc_browser_add_plugin(
+    client->browser,
+    &INF_TEST_WORKER_THREADS_CLIENT_PLUGIN
+  );
+
+  g_signal_connect(
+    G_OBJECT(client->browser),
+    "notify::status",
+    G_CALLBACK(inf_test_worker_threads_browser_notify_status_cb),
+    client
+  );
+}
+
+static void
+inf_test_worker_threads_add_note_cb(InfRequest* request,
+                                    const InfRequestResult* result,
+                                    const GError* error,
+                                    gpointer user_data)
+{
+  InfTestWorkerThreads* test;
+  const InfBrowserIter* iter;
+  guint i;
+
+  test = (InfTestWorkerThreads*)user_data;
+
+  if(error != NULL)
+  {
+    inf_test_worker_threads_fail(test, error->message);
+    return;
+  }
+
+  inf_request_result_get_add_node(result, NULL, NULL, &iter);
+  test->documents[test->n_documents++] = *iter;
+
+  if(test->n_documents == INF_TEST_WORKER_THREADS_DOCUMENTS)
+    for(i = 0; i < INF_TEST_WORKER_THREADS_CLIENTS; ++i)
+      inf_test_worker_threads_connect_client(test, i);
+}
+
+static void
+inf_test_worker_threads_server_explore_cb(InfRequest* request,
+                                          const InfRequestResult* result,
+                                          const GError* error,
+                                          gpointer user_data)
+{
+  InfTestWorkerThreads* test;
+  InfBrowserIter iter;
+  gchar* name;
+  guint i;
+
+  test = (InfTestWorkerThreads*)user_data;
+
+  if(error != NULL)
+  {
+    inf_test_worker_threads_fail(test, error->message);
+    return;
+  }
+
+  for(i = 0; i < INF_TEST_WORKER_THREADS_DOCUMENTS; ++i)
+  {
+    inf_browser_get_root(INF_BROWSER(test->directory), &iter);
+    name = g_strdup_printf("doc-%u", i);
+
+    inf_browser_add_note(
+      INF_BROWSER(test->directory),
+      &iter,
+      name,
+      "InfText",
+      NULL,
+      NULL,
+      FALSE,
+      inf_test_worker_threads_add_note_cb,
+      test
+    );
+
+    g_free(name);
+  }
+}
+
+static void
+inf_test_worker_threads_run(InfTestWorkerThreads* test,
+                            InfdStorage* storage)
+{
+  InfCommunicationManager* manager;
+  InfBrowserIter iter;
+  guint i;
+
+  manager = inf_communication_manager_new();
+
+  test->directory = INFD_DIRECTORY(
+    g_object_new(
+      INFD_TYPE_DIRECTORY,
+      "io", test->io,
+      "storage", storage,
+      "communication-manager", manager,
+      "worker-threads", INF_TEST_WORKER_THREADS_WORKERS,
+      NULL
+    )
+  );
+
+  g_object_unref(manager);
+
+  infd_directory_add_plugin(
+    test->directory,
+    &INF_TEST_WORKER_THREADS_SERVER_PLUGIN
+  );
+
+  /* We are not running from within the directory's I/O here */
+  infd_directory_lock(test->directory);
+  inf_browser_get_root(INF_BROWSER(test->directory), &iter);
+
+  inf_browser_explore(
+    INF_BROWSER(test->directory),
+    &iter,
+    inf_test_worker_threads_server_explore_cb,
+    test
+  );
+
+  infd_directory_unlock(test->directory);
+
+  inf_standalone_io_loop(test->io);
+
+  if(!test->failed && test->n_done < INF_TEST_WORKER_THREADS_CLIENTS)
+  {
+    fprintf(stderr, "Not all clients finished editing\n");
+    test->failed = TRUE;
+  }
+
+  if(test->n_documents == INF_TEST_WORKER_THREADS_DOCUMENTS)
+  {
+    for(i = 0; i < INF_TEST_WORKER_THREADS_CLIENTS; ++i)
+    {
+      if(test->clients[i].user != NULL)
+        g_object_unref(test->clients[i].user);
+      if(test->clients[i].session != NULL)
+        g_object_unref(test->clients[i].session);
+      if(test->clients[i].proxy != NULL)
+        g_object_unref(test->clients[i].proxy);
+
+      g_object_unref(test->clients[i].browser);
+      g_object_unref(test->clients[i].client_conn);
+      g_object_unref(test->clients[i].server_conn);
+    }
+  }
+
+  g_object_unref(test->directory);
+}
+
+int
+main(int argc,
+     char* argv[])
+{
+  InfTestWorkerThreads test;
+  InfdFilesystemStorage* storage;
+  GError* error;
+  gchar* root;
+  guint32 seed;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  root = g_dir_make_tmp("inf-test-worker-threads-XXXXXX", &error);
+  if(root == NULL)
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  seed = time(NULL);
+  printf("Random seed: %u\n", seed);
+  g_random_set_seed(seed);
+
+  test.io = inf_standalone_io_new();
+  test.n_documents = 0;
+  test.n_done = 0;
+  test.failed = FALSE;
+
+  storage = infd_filesystem_storage_new(root);
+  inf_test_worker_threads_run(&test, INFD_STORAGE(storage));
+  printf("Join, edit and close... %s\n", test.failed ? "FAILED" : "OK");
+
+  g_object_unref(storage);
+  g_object_unref(test.io);
+
+  if(!inf_file_util_delete(root, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_free(root);
+  inf_deinit();
+  return test.failed ? 1 : 0;
+}
+
+/* vim:set et sw=2 ts=2: */
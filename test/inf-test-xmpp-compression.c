@@ -0,0 +1,491 @@
+/* libinfinity - a GObject-based infinote implementation
+ * Copyright (C) 2007-2015 Armin Burgmeier <armin@arbur.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston,
+ * MA 02110-1301, USA.
+ */
+
+/* Sets up a client and a server InfXmppConnection over the loopback
+ * interface and sends a number of request-like messages and one large
+ * sync-like message from the client to the server, once without and once
+ * with stream compression. Verifies that the server receives all messages
+ * unchanged, that compression is negotiated only when both sites enable it,
+ * and prints the amount of data that went over the wire in both cases. */
+
+#include <libinfinity/server/infd-tcp-server.h>
+#include <libinfinity/common/inf-xmpp-connection.h>
+#include <libinfinity/common/inf-xml-connection.h>
+#include <libinfinity/common/inf-tcp-connection.h>
+#include <libinfinity/common/inf-ip-address.h>
+#include <libinfinity/common/inf-standalone-io.h>
+#include <libinfinity/common/inf-init.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INF_TEST_XMPP_COMPRESSION_MESSAGES 2000
+#define INF_TEST_XMPP_COMPRESSION_SYNC_SIZE (256 * 1024)
+
+typedef struct _InfTestXmppCompression InfTestXmppCompression;
+struct _InfTestXmppCompression {
+  InfStandaloneIo* io;
+  gboolean compression;
+
+  InfTcpConnection* client_tcp;
+  InfXmppConnection* client;
+  InfTcpConnection* server_tcp;
+  InfXmppConnection* server;
+
+  gchar* sync_text;
+  guint received;
+  guint64 received_bytes;
+  gboolean failed;
+};
+
+static void
+inf_test_xmpp_compression_fail(InfTestXmppCompression* test,
+                               const gchar* message)
+{
+  fprintf(stderr, "Error: %s\n", message);
+
+  test->failed = TRUE;
+  if(inf_standalone_io_loop_running(test->io))
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static xmlNodePtr
+inf_test_xmpp_compression_make_message(InfTestXmppCompression* test,
+                                       guint index)
+{
+  xmlNodePtr group;
+  xmlNodePtr request;
+  xmlNodePtr operation;
+  gchar* str;
+
+  group = xmlNewNode(NULL, (const xmlChar*)"group");
+  xmlNewProp(group, (const xmlChar*)"name", (const xmlChar*)"InfSession_1");
+  xmlNewProp(group, (const xmlChar*)"publisher", (const xmlChar*)"me");
+
+  if(index == INF_TEST_XMPP_COMPRESSION_MESSAGES / 2)
+  {
+    operation = xmlNewTextChild(
+      group,
+      NULL,
+      (const xmlChar*)"sync-segment",
+      (const xmlChar*)test->sync_text
+    );
+
+    xmlNewProp(operation, (const xmlChar*)"author", (const xmlChar*)"1");
+  }
+  else
+  {
+    request = xmlNewChild(group, NULL, (const xmlChar*)"request", NULL);
+
+    str = g_strdup_printf("%u", 1 + index % 3);
+    xmlNewProp(request, (const xmlChar*)"user", (const xmlChar*)str);
+    g_free(str);
+
+    str = g_strdup_printf("1:%u;2:%u;3:%u", index, index / 2, index / 3);
+    xmlNewProp(request, (const xmlChar*)"time", (const xmlChar*)str);
+    g_free(str);
+
+    operation = xmlNewTextChild(
+      request,
+      NULL,
+      (const xmlChar*)"insert-caret",
+      (const xmlChar*)"x"
+    );
+
+    str = g_strdup_printf("%u", index);
+    xmlNewProp(operation, (const xmlChar*)"pos", (const xmlChar*)str);
+    g_free(str);
+  }
+
+  return group;
+}
+
+static gboolean
+inf_test_xmpp_compression_check_message(InfTestXmppCompression* test,
+                                        const xmlNodePtr xml,
+                                        guint index)
+{
+  xmlNodePtr expected;
+  xmlBufferPtr expected_buf;
+  xmlBufferPtr received_buf;
+  gboolean result;
+
+  expected = inf_test_xmpp_compression_make_message(test, index);
+
+  expected_buf = xmlBufferCreate();
+  received_buf = xmlBufferCreate();
+
+  xmlNodeDump(expected_buf, NULL, expected, 0, 0);
+  xmlNodeDump(received_buf, NULL, xml, 0, 0);
+
+  result = strcmp(
+    (const char*)xmlBufferContent(expected_buf),
+    (const char*)xmlBufferContent(received_buf)
+  ) == 0;
+
+  xmlBufferFree(expected_buf);
+  xmlBufferFree(received_buf);
+  xmlFreeNode(expected);
+
+  return result;
+}
+
+static void
+inf_test_xmpp_compression_error_cb(InfXmlConnection* connection,
+                                   const GError* error,
+                                   gpointer user_data)
+{
+  inf_test_xmpp_compression_fail(
+    (InfTestXmppCompression*)user_data,
+    error->message
+  );
+}
+
+static void
+inf_test_xmpp_compression_tcp_received_cb(InfTcpConnection* connection,
+                                          gconstpointer data,
+                                          guint len,
+                                          gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  test->received_bytes += len;
+}
+
+static void
+inf_test_xmpp_compression_received_cb(InfXmlConnection* connection,
+                                      const xmlNodePtr xml,
+                                      gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  if(!inf_test_xmpp_compression_check_message(test, xml, test->received))
+  {
+    inf_test_xmpp_compression_fail(test, "Received message differs");
+    return;
+  }
+
+  ++test->received;
+  if(test->received == INF_TEST_XMPP_COMPRESSION_MESSAGES)
+    inf_standalone_io_loop_quit(test->io);
+}
+
+static void
+inf_test_xmpp_compression_notify_status_cb(GObject* object,
+                                           GParamSpec* pspec,
+                                           gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  InfXmlConnectionStatus status;
+  guint i;
+
+  test = (InfTestXmppCompression*)user_data;
+  g_object_get(object, "status", &status, NULL);
+
+  switch(status)
+  {
+  case INF_XML_CONNECTION_OPEN:
+    if(inf_xmpp_connection_get_compression_enabled(test->client) !=
+       test->compression)
+    {
+      inf_test_xmpp_compression_fail(test, "Compression was not negotiated");
+      break;
+    }
+
+    for(i = 0; i < INF_TEST_XMPP_COMPRESSION_MESSAGES; ++i)
+    {
+      inf_xml_connection_send(
+        INF_XML_CONNECTION(test->client),
+        inf_test_xmpp_compression_make_message(test, i)
+      );
+    }
+
+    break;
+  case INF_XML_CONNECTION_CLOSING:
+  case INF_XML_CONNECTION_CLOSED:
+    inf_test_xmpp_compression_fail(test, "Connection was closed");
+    break;
+  case INF_XML_CONNECTION_OPENING:
+  default:
+    break;
+  }
+}
+
+static void
+inf_test_xmpp_compression_new_connection_cb(InfdTcpServer* server,
+                                            InfTcpConnection* connection,
+                                            gpointer user_data)
+{
+  InfTestXmppCompression* test;
+  test = (InfTestXmppCompression*)user_data;
+
+  g_assert(test->server == NULL);
+
+  test->server_tcp = connection;
+  g_object_ref(connection);
+
+  g_signal_connect(
+    G_OBJECT(connection),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_tcp_received_cb),
+    test
+  );
+
+  test->server = inf_xmpp_connection_new(
+    connection,
+    INF_XMPP_CONNECTION_SERVER,
+    NULL,
+    "localhost",
+    INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+    NULL,
+    NULL,
+    NULL
+  );
+
+  /* The server always offers compression, so that it is the client that
+   * decides whether it is used. */
+  g_object_set(G_OBJECT(test->server), "compression", TRUE, NULL);
+
+  g_signal_connect(
+    G_OBJECT(test->server),
+    "received",
+    G_CALLBACK(inf_test_xmpp_compression_received_cb),
+    test
+  );
+
+  g_signal_connect(
+    G_OBJECT(test->server),
+    "error",
+    G_CALLBACK(inf_test_xmpp_compression_error_cb),
+    test
+  );
+}
+
+static void
+inf_test_xmpp_compression_close(InfXmppConnection* xmpp,
+                                InfTcpConnection* tcp)
+{
+  InfTcpConnectionStatus status;
+
+  /* Just close the TCP connection, there is no point in waiting for the
+   * remote site to acknowledge the end of the stream. */
+  g_object_get(G_OBJECT(tcp), "status", &status, NULL);
+  if(status != INF_TCP_CONNECTION_CLOSED)
+    inf_tcp_connection_close(tcp);
+
+  g_object_unref(xmpp);
+  g_object_unref(tcp);
+}
+
+static gboolean
+inf_test_xmpp_compression_run(InfStandaloneIo* io,
+                              gboolean compression,
+                              GRand* rand,
+                              guint64* bytes)
+{
+  InfTestXmppCompression test;
+  InfdTcpServer* server;
+  InfdTcpServerStatus status;
+  InfIpAddress* address;
+  guint port;
+  GError* error;
+  guint i;
+
+  test.io = io;
+  test.compression = compression;
+  test.client_tcp = NULL;
+  test.client = NULL;
+  test.server_tcp = NULL;
+  test.server = NULL;
+  test.sync_text = g_malloc(INF_TEST_XMPP_COMPRESSION_SYNC_SIZE + 1);
+  test.received = 0;
+  test.received_bytes = 0;
+  test.failed = FALSE;
+
+  /* Text with some redundancy, as in a real document */
+  for(i = 0; i < INF_TEST_XMPP_COMPRESSION_SYNC_SIZE; ++i)
+    test.sync_text[i] = "etaoin shrdlu\n"[g_rand_int_range(rand, 0, 14)];
+  test.sync_text[INF_TEST_XMPP_COMPRESSION_SYNC_SIZE] = '\0';
+
+  address = inf_ip_address_new_loopback4();
+
+  server = g_object_new(
+    INFD_TYPE_TCP_SERVER,
+    "io", io,
+    "local-address", address,
+    "local-port", 0,
+    NULL
+  );
+
+  g_signal_connect(
+    G_OBJECT(server),
+    "new-connection",
+    G_CALLBACK(inf_test_xmpp_compression_new_connection_cb),
+    &test
+  );
+
+  error = NULL;
+  if(!infd_tcp_server_open(server, &error))
+  {
+    inf_test_xmpp_compression_fail(&test, error->message);
+    g_error_free(error);
+  }
+  else
+  {
+    g_object_get(G_OBJECT(server), "local-port", &port, NULL);
+    test.client_tcp = inf_tcp_connection_new(INF_IO(io), address, port);
+
+    test.client = inf_xmpp_connection_new(
+      test.client_tcp,
+      INF_XMPP_CONNECTION_CLIENT,
+      NULL,
+      "localhost",
+      INF_XMPP_CONNECTION_SECURITY_ONLY_UNSECURED,
+      NULL,
+      NULL,
+      NULL
+    );
+
+    g_object_set(G_OBJECT(test.client), "compression", compression, NULL);
+
+    g_signal_connect(
+      G_OBJECT(test.client),
+      "notify::status",
+      G_CALLBACK(inf_test_xmpp_compression_notify_status_cb),
+      &test
+    );
+
+    g_signal_connect(
+      G_OBJECT(test.client),
+      "error",
+      G_CALLBACK(inf_test_xmpp_compression_error_cb),
+      &test
+    );
+
+    if(!inf_tcp_connection_open(test.client_tcp, &error))
+    {
+      inf_test_xmpp_compression_fail(&test, error->message);
+      g_error_free(error);
+    }
+    else
+    {
+      inf_standalone_io_loop(io);
+    }
+  }
+
+  if(!test.failed && test.server != NULL &&
+     inf_xmpp_connection_get_compression_enabled(test.server) != compression)
+  {
+    inf_test_xmpp_compression_fail(&test, "Compression was not negotiated");
+  }
+
+  if(!test.failed)
+  {
+    printf(
+      "%s: %u messages, %" G_GUINT64_FORMAT " bytes received\n",
+      compression ? "With compression" : "Without compression",
+      test.received,
+      test.received_bytes
+    );
+  }
+
+  if(test.client != NULL)
+  {
+    g_signal_handlers_disconnect_by_data(G_OBJECT(test.client), &test);
+    inf_test_xmpp_compression_close(test.client, test.client_tcp);
+  }
+
+  if(test.server != NULL)
+  {
+    g_signal_handlers_disconnect_by_data(G_OBJECT(test.server), &test);
+    g_signal_handlers_disconnect_by_data(G_OBJECT(test.server_tcp), &test);
+    inf_test_xmpp_compression_close(test.server, test.server_tcp);
+  }
+
+  g_object_get(G_OBJECT(server), "status", &status, NULL);
+  if(status != INFD_TCP_SERVER_CLOSED)
+    infd_tcp_server_close(server);
+  g_object_unref(server);
+  inf_ip_address_free(address);
+
+  g_free(test.sync_text);
+
+  *bytes = test.received_bytes;
+  return !test.failed;
+}
+
+int
+main(int argc, char* argv[])
+{
+  InfStandaloneIo* io;
+  GError* error;
+  GRand* rand;
+  guint64 plain_bytes;
+  guint64 compressed_bytes;
+  gboolean result;
+
+  error = NULL;
+  if(!inf_init(&error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  io = inf_standalone_io_new();
+  rand = g_rand_new_with_seed(0);
+
+  result = inf_test_xmpp_compression_run(io, FALSE, rand, &plain_bytes);
+
+  if(result)
+  {
+    result = inf_test_xmpp_compression_run(
+      io,
+      TRUE,
+      rand,
+      &compressed_bytes
+    );
+  }
+
+  if(result)
+  {
+    if(compressed_bytes >= plain_bytes)
+    {
+      fprintf(stderr, "Compression did not reduce the amount of data\n");
+      result = FALSE;
+    }
+    else
+    {
+      printf(
+        "Compressed to %.1f%%\n",
+        100.0 * compressed_bytes / plain_bytes
+      );
+    }
+  }
+
+  g_rand_free(rand);
+  g_object_unref(io);
+  inf_deinit();
+  return result ? 0 : 1;
+}
+
+/* vim:set et sw=2 ts=2: */